@@ -7,14 +7,61 @@
 // Written by racaljk@github<1948638989@qq.com>
 //===----------------------------------------------------------------------===//
 #include <cctype>
+#include <cstdarg>
+#include <cfloat>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <fstream>
 #include <functional>
+#include <new>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <tuple>
+#include <typeinfo>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <stdexcept>
+#include <bitset>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#if defined(__x86_64__) || defined(_M_X64)
+#define G5_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define G5_AVX2
+#else
+#define G5_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+// code reading memory other threads write without synchronizing, on purpose
+#if defined(__GNUC__) && !defined(__clang__)
+#define G5_RACY __attribute__((no_sanitize_thread))
+#elif defined(__clang__)
+#define G5_RACY __attribute__((no_sanitize("thread")))
+#else
+#define G5_RACY
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #define ASTNODE :public AstNode
 using namespace std;
 
@@ -22,7 +69,7 @@ using namespace std;
 //===----------------------------------------------------------------------===//
 // various declarations 
 //===----------------------------------------------------------------------===//
-string keywords[] = { "break",    "default",     "func",   "interface", "select",
+constexpr string_view keywords[] = { "break",    "default",     "func",   "interface", "select",
                      "case",     "defer",       "go",     "map",       "struct",
                      "chan",     "else",        "goto",   "package",   "switch",
                      "const",    "fallthrough", "if",     "range",     "type",
@@ -41,16 +88,62 @@ enum TokenType : signed int {
     OP_NOT, OP_VARIADIC, OP_DOT, OP_COLON, OP_ANDXOR, OP_ANDXORAGN, TK_ID,
     LITERAL_INT, LITERAL_FLOAT, LITERAL_IMG, LITERAL_RUNE, LITERAL_STR, TK_EOF
 };
-//todo: add destructors for these structures
-struct AstNode { virtual ~AstNode() {} };
-struct AstIdentifierList ASTNODE { vector<string> identifierList; };
+// Spelling of the operators, indexed from OP_ADD.
+constexpr string_view operators[] = { "+", "&", "+=", "&=", "&&", "==", "!=", "(", ")",
+                     "-", "|", "-=", "|=", "||", "<", "<=", "[", "]", "*", "^", "*=",
+                     "^=", "<-", ">", ">=", "{", "}", "/", "<<", "/=", "<<=", "++", "=",
+                     ":=", ",", ";", "%", ">>", "%=", ">>=", "--", "!", "...", ".", ":",
+                     "&^", "&^=" };
+static_assert(sizeof(operators) / sizeof(operators[0]) == OP_ANDXORAGN - OP_ADD + 1,
+    "operators[] must spell every operator token");
+// Keywords are found by a perfect hash over the first two bytes and the length
+// of an identifier(the same function gc uses), the table is built at compile
+// time and the build fails if two keywords ever collide.
+constexpr unsigned keywordHash(const char* s, size_t length) {
+    return (((unsigned char)s[0] << 4 ^ (unsigned char)s[1]) + unsigned(length)) & 63;
+}
+struct KeywordTable { signed char keyword[64]; };
+constexpr KeywordTable makeKeywordTable() {
+    KeywordTable table{};
+    for (auto& k : table.keyword) k = -1;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        unsigned h = keywordHash(keywords[i].data(), keywords[i].size());
+        if (table.keyword[h] != -1) throw logic_error("keyword hash collision");
+        table.keyword[h] = i;
+    }
+    return table;
+}
+constexpr KeywordTable keywordTable = makeKeywordTable();
+
+inline TokenType lookupKeyword(string_view lexeme) {
+    if (lexeme.size() >= 2 && lexeme.size() <= 11) {
+        int i = keywordTable.keyword[keywordHash(lexeme.data(), lexeme.size())];
+        if (i >= 0 && keywords[i] == lexeme) return static_cast<TokenType>(i);
+    }
+    return TK_ID;
+}
+
+// A name interned by the Interner, 0 is the empty string i.e. no name.
+using Symbol = uint32_t;
+
+// The tree the parser builds, which flatten() turns into the Tree every later
+// pass reads. What is left of replacing it is to have the parser add Nodes to
+// a Tree directly; until then the untagged unions below are resolved in
+// flatten() only, and -ast, -api and the lazy documents still walk this tree.
+// Every node knows the line and column of the token it starts at.
+struct AstNode {
+    virtual ~AstNode() {}
+    int line = 0, column = 0;
+};
+struct AstIdentifierList ASTNODE { vector<Symbol> identifierList; };
 struct AstExpressionList ASTNODE { vector<AstNode*> expressionList; };
 struct AstSourceFile ASTNODE {
+    AstNode* packageClause;
     vector<AstNode*> importDecl;
     vector<AstNode*> topLevelDecl;
 };
-struct AstPackageClause ASTNODE { string packageName; };
-struct AstImportDecl ASTNODE { map<string, string> imports; };
+struct AstPackageClause ASTNODE { Symbol packageName; };
+struct AstImportDecl ASTNODE { vector<pair<Symbol, Symbol>> imports; };
 struct AstTopLevelDecl ASTNODE {
     union {
         AstNode* decl;
@@ -76,7 +169,10 @@ struct AstType ASTNODE {
         AstNode* typeLit;
     }at;
 };
-struct AstTypeName ASTNODE { string typeName; };
+struct AstTypeName ASTNODE {
+    Symbol packageName;
+    Symbol typeName;
+};
 struct AstArrayType ASTNODE {
     AstNode* length;
     AstNode* elementType;
@@ -103,7 +199,7 @@ struct AstParameterDecl ASTNODE {
     bool isVariadic = false;
     bool hasName = false;
     AstNode* type;
-    string name;
+    Symbol name;
 };
 struct AstResult ASTNODE {
     union {
@@ -121,17 +217,22 @@ struct AstMethodSpec ASTNODE {
         AstNode* interfaceTypeName;
     }ams;
 };
-struct AstMethodName ASTNODE { string methodName; };
+struct AstMethodName ASTNODE { Symbol methodName; };
 struct AstSliceType ASTNODE { AstNode* elementType; };
 struct AstMapType ASTNODE {
     AstNode* keyType;
     AstNode* elementType;
 };
-struct AstChannelType ASTNODE { AstNode* elementType; };
+struct AstChannelType ASTNODE {
+    AstNode* elementType;
+    bool sendOnly;
+    bool recvOnly;
+};
 struct AstTypeDecl ASTNODE { vector<AstNode*> typeSpec; };
 struct AstTypeSpec ASTNODE {
-    string identifier;
+    Symbol identifier;
     AstNode* type;
+    bool isAlias;
 };
 struct AstVarDecl ASTNODE { vector<AstNode*> varSpec; };
 struct AstVarSpec ASTNODE {
@@ -145,7 +246,7 @@ struct AstVarSpec ASTNODE {
     }avs;
 };
 struct AstFunctionDecl ASTNODE {
-    string funcName;
+    Symbol funcName;
     AstNode* receiver;
     AstNode* signature;
     AstNode* functionBody;
@@ -172,7 +273,7 @@ struct AstStatement ASTNODE {
     }as;
 };
 struct AstLabeledStmt ASTNODE {
-    string identifier;
+    Symbol identifier;
     AstNode* statement;
 };
 struct AstSimpleStmt ASTNODE {
@@ -186,9 +287,9 @@ struct AstSimpleStmt ASTNODE {
 };
 struct AstGoStmt ASTNODE { AstNode* expression; };
 struct AstReturnStmt ASTNODE { AstNode* expressionList; };
-struct AstBreakStmt ASTNODE { string label; };
-struct AstContinueStmt ASTNODE { string label; };
-struct AstGotoStmt ASTNODE { string label; };
+struct AstBreakStmt ASTNODE { Symbol label; };
+struct AstContinueStmt ASTNODE { Symbol label; };
+struct AstGotoStmt ASTNODE { Symbol label; };
 struct AstFallthroughStmt ASTNODE {};
 struct AstIfStmt ASTNODE {
     AstNode* condition;
@@ -202,6 +303,7 @@ struct AstIfStmt ASTNODE {
 struct AstSwitchStmt ASTNODE {
     AstNode* condition;
     AstNode* conditionExpr;
+    bool isTypeSwitch;
     vector<AstNode*> exprCaseClause;
 };
 struct AstExprCaseClause ASTNODE {
@@ -318,7 +420,7 @@ struct AstPrimaryExpr ASTNODE {
         }argument;
     }ape;
 };
-struct AstSelector ASTNODE { string identifier; };
+struct AstSelector ASTNODE { Symbol identifier; };
 struct AstIndex ASTNODE { AstNode* expression; };
 struct AstSlice ASTNODE {
     AstNode*start;
@@ -343,7 +445,7 @@ struct AstOperand ASTNODE {
         AstNode*expression;
     }ao;
 };
-struct AstOperandName ASTNODE { string operandName; };
+struct AstOperandName ASTNODE { Symbol operandName; };
 struct AstLiteral ASTNODE {
     union {
         AstNode*basicLit;
@@ -382,7 +484,7 @@ struct AstKey ASTNODE {
     }ak;
 };
 struct AstFieldName ASTNODE {
-    string fieldName;
+    Symbol fieldName;
 };
 struct AstElement ASTNODE {
     union {
@@ -400,183 +502,810 @@ struct AstConversion ASTNODE {
 };
 struct AstMethodExpr ASTNODE {
     AstNode*receiverType;
-    string methodName;
+    Symbol methodName;
+};
+struct LazyFile;
+// A function body skipped by parseHeaders(), the block from its '{' on the line
+// and column given up to its '}' is parsed when it is first asked for, see
+// bodyOf.
+struct AstLazyBlock ASTNODE {
+    const LazyFile* file;
+    size_t begin, end;
+    int line, column;
+    mutable AstNode* block;
 };
 //===----------------------------------------------------------------------===//
 // global data
 //===----------------------------------------------------------------------===//
-static int line = 1, column = 1, lastToken = -1, shouldEof = 0;
+// Whole source file in one contiguous buffer followed by zero padding, so the
+// lexKernel scans it with a raw pointer and may look ahead without bound checks.
+// The file is mapped directly when the unused tail of its last page is large
+// enough to serve as padding(the kernel zero-fills it), otherwise it is read
+// into memory with a single read.
+struct Source {
+    static constexpr size_t padding = 64;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    explicit Source(const string& filename) {
+        size_t size = 0;
+#ifndef _WIN32
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) close(fd);
+            throw runtime_error("can not open source file " + filename);
+        }
+        size = st.st_size;
+        size_t page = sysconf(_SC_PAGESIZE);
+        if (size % page != 0 && page - size % page >= padding) {
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                mapped = size;
+                begin = static_cast<const char*>(addr);
+            }
+        }
+        close(fd);
+#endif
+        if (begin == nullptr) {
+            fstream f(filename, ios::binary | ios::in | ios::ate);
+            if (!f.is_open()) {
+                throw runtime_error("can not open source file " + filename);
+            }
+            size = f.tellg();
+            buffer.resize(size + padding, '\0');
+            f.seekg(0);
+            f.read(buffer.data(), size);
+            begin = buffer.data();
+        }
+        end = begin + size;
+    }
+    // Source text that is not in a file, e.g. generated by a test.
+    Source(const char* text, size_t size) : buffer(size + padding, '\0') {
+        memcpy(buffer.data(), text, size);
+        begin = buffer.data();
+        end = begin + size;
+    }
+    ~Source() {
+#ifndef _WIN32
+        if (mapped != 0) munmap(const_cast<char*>(begin), mapped);
+#endif
+    }
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+
+private:
+    vector<char> buffer;
+    size_t mapped = 0;
+};
+// Lexing state of one file, each file being compiled has its own so that
+// files can be lexed and parsed on different threads at the same time.
+struct Lexer {
+    const Source& source;
+    const char* cur;
+    const char* end;
+    const char* lineBegin;
+    // end of the token before the one lexed last, i.e. of the last token the
+    // parser consumed
+    const char* prevEnd;
+    int line, lastToken, shouldEof;
+    explicit Lexer(const Source& s) : source(s), end(s.end) { rewind(); }
+    void rewind() {
+        cur = lineBegin = prevEnd = source.begin;
+        line = 1, lastToken = -1, shouldEof = 0;
+    }
+    // Continues at p in the middle of the source as if a token of type previous
+    // had just ended there, p is on the given line which starts at first.
+    void resume(const char* p, const char* first, int atLine, int previous) {
+        cur = prevEnd = p;
+        lineBegin = first;
+        line = atLine, lastToken = previous;
+    }
+};
+// The lexeme is a view into the Source the token came from, line and column
+// are where the token starts.
 struct Token {
-    TokenType type; string lexeme;
-    Token(TokenType a, const string&b) :type(a), lexeme(b) {}
+    TokenType type; string_view lexeme; int line, column;
+    Symbol symbol = 0;
+    Token(TokenType a, string_view b, int l, int c) :type(a), lexeme(b), line(l), column(c) {}
 };
 static struct goruntime {
     string package;
 } grt;
 
+//===----------------------------------------------------------------------===//
+// work-stealing thread pool
+//===----------------------------------------------------------------------===//
+// Every worker owns a deque of tasks, it pushes and pops its own tasks at the
+// back and steals from the front of the other deques once its own runs dry.
+// Tasks submitted from outside the pool are dealt to the deques round robin.
+struct ThreadPool {
+    explicit ThreadPool(int workerCount) {
+        for (int i = 0; i < workerCount; i++) workers.push_back(make_unique<Worker>());
+        for (int i = 0; i < workerCount; i++) threads.emplace_back([this, i] { work(i); });
+    }
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(idleLock);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (auto& t : threads) t.join();
+    }
+    void submit(function<void()> task) {
+        size_t target = currentWorker >= 0 && currentPool == this ? currentWorker :
+            nextWorker++ % workers.size();
+        pending++;
+        {
+            lock_guard<mutex> guard(workers[target]->lock);
+            workers[target]->tasks.push_back(move(task));
+        }
+        {
+            lock_guard<mutex> guard(idleLock);
+            queued++;
+        }
+        idle.notify_one();
+    }
+    // Block until every submitted task, including tasks submitted by tasks,
+    // has finished.
+    void wait() {
+        unique_lock<mutex> guard(idleLock);
+        done.wait(guard, [this] { return pending == 0; });
+    }
+    int size() const { return int(workers.size()); }
+
+private:
+    struct Worker {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+    static thread_local int currentWorker;
+    static thread_local ThreadPool* currentPool;
+
+    bool take(int self, function<void()>& task) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            auto& w = *workers[(self + i) % workers.size()];
+            lock_guard<mutex> guard(w.lock);
+            if (!w.tasks.empty()) {
+                if (i == 0) {
+                    task = move(w.tasks.back());
+                    w.tasks.pop_back();
+                }
+                else {
+                    task = move(w.tasks.front());
+                    w.tasks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+    void work(int self) {
+        currentWorker = self;
+        currentPool = this;
+        for (;;) {
+            {
+                unique_lock<mutex> guard(idleLock);
+                idle.wait(guard, [this] { return stopping || queued > 0; });
+                if (queued == 0) return;
+                queued--;
+            }
+            function<void()> task;
+            while (!take(self, task)) this_thread::yield();
+            task();
+            if (--pending == 0) {
+                lock_guard<mutex> guard(idleLock);
+                done.notify_all();
+            }
+        }
+    }
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    atomic<size_t> pending{ 0 }, nextWorker{ 0 };
+    size_t queued = 0;
+    bool stopping = false;
+    mutex idleLock;
+    condition_variable idle, done;
+};
+thread_local int ThreadPool::currentWorker = -1;
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+
+//===----------------------------------------------------------------------===//
+// arena allocator for AST nodes
+//===----------------------------------------------------------------------===//
+// Nodes of one compilation are bumped out of large blocks in the order they are
+// parsed and released all at once when the arena dies. Nodes that own memory
+// themselves(strings, vectors) are chained so their destructors still run,
+// newest first. An arena belongs to one thread at a time.
+struct Arena {
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        for (auto* f = finalizers; f != nullptr; f = f->next) f->destroy(f->object);
+        while (blocks != nullptr) {
+            auto* next = blocks->next;
+            ::operator delete(blocks);
+            blocks = next;
+        }
+    }
+
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        if constexpr (is_trivially_destructible_v<T>) {
+            return new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+        }
+        else {
+            auto* finalizer = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+            T* object = new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+            *finalizer = { [](void* p) { static_cast<T*>(p)->~T(); }, object, finalizers };
+            finalizers = finalizer;
+            return object;
+        }
+    }
+    // bytes handed out so far, including the finalizer chain
+    size_t size() const { return used; }
+
+private:
+    struct Block { Block* next; };
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        Finalizer* next;
+    };
+    static constexpr size_t blockSize = 64 * 1024;
+
+    void* allocate(size_t size, size_t align) {
+        auto p = (uintptr_t(cur) + align - 1) & ~uintptr_t(align - 1);
+        if (cur == nullptr || p + size > uintptr_t(limit)) {
+            size_t capacity = max(blockSize, sizeof(Block) + size + align);
+            auto* block = static_cast<Block*>(::operator new(capacity));
+            block->next = blocks;
+            blocks = block;
+            cur = reinterpret_cast<char*>(block + 1);
+            limit = reinterpret_cast<char*>(block) + capacity;
+            p = (uintptr_t(cur) + align - 1) & ~uintptr_t(align - 1);
+        }
+        cur = reinterpret_cast<char*>(p + size);
+        used += size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    Block* blocks = nullptr;
+    char* cur = nullptr;
+    char* limit = nullptr;
+    Finalizer* finalizers = nullptr;
+    size_t used = 0;
+};
+
+//===----------------------------------------------------------------------===//
+// string interner for identifiers
+//===----------------------------------------------------------------------===//
+// Every distinct name of a compilation gets a 32-bit Symbol when it is lexed, so
+// the AST and later phases compare and hash names as integers. Lookups never
+// lock: the open addressing table is reached through an atomic pointer, a slot
+// only ever goes from empty to a symbol, and an entry never changes once its
+// symbol is published. Adding a name takes the writer lock, looks again and
+// grows the table by building a bigger one, old tables stay alive for readers
+// that may still be probing them.
+struct Interner {
+    Interner() { intern(""); }
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+    ~Interner() {
+        for (auto& chunk : chunks) delete[] chunk.load(memory_order_relaxed);
+        for (auto* block : blocks) delete[] block;
+    }
+
+    // The symbol of text, text is copied the first time it is seen.
+    Symbol intern(string_view text) {
+        uint32_t hash = hashOf(text);
+        if (Symbol s = find(*table.load(memory_order_acquire), text, hash); s != none) return s;
+        lock_guard<mutex> lock(writer);
+        Table* t = table.load(memory_order_relaxed);
+        if (Symbol s = find(*t, text, hash); s != none) return s;
+        Symbol s = count.load(memory_order_relaxed);
+        if ((s >> chunkBits) >= maxChunks) throw runtime_error("too many distinct names");
+        auto& chunk = chunks[s >> chunkBits];
+        if (chunk.load(memory_order_relaxed) == nullptr) {
+            chunk.store(new Entry[size_t(1) << chunkBits], memory_order_release);
+        }
+        chunk.load(memory_order_relaxed)[s & chunkMask] = { copy(text), uint32_t(text.size()), hash };
+        if ((s + 1) * 2 > t->mask + 1) t = grow(*t);
+        insert(*t, s, hash);
+        count.store(s + 1, memory_order_release);
+        return s;
+    }
+    string_view text(Symbol s) const {
+        const Entry& e = chunks[s >> chunkBits].load(memory_order_acquire)[s & chunkMask];
+        return { e.text, e.size };
+    }
+    size_t size() const { return count.load(memory_order_acquire); }
+
+private:
+    struct Entry {
+        const char* text;
+        uint32_t size;
+        uint32_t hash;
+    };
+    // slots hold symbol + 1, 0 is an empty slot
+    struct Table {
+        explicit Table(uint32_t capacity) : mask(capacity - 1), slots(new atomic<uint32_t>[capacity]) {
+            for (uint32_t i = 0; i < capacity; i++) slots[i].store(0, memory_order_relaxed);
+        }
+        uint32_t mask;
+        unique_ptr<atomic<uint32_t>[]> slots;
+    };
+    static constexpr Symbol none = ~Symbol(0);
+    static constexpr int chunkBits = 12;
+    static constexpr Symbol chunkMask = (Symbol(1) << chunkBits) - 1;
+    static constexpr size_t maxChunks = 4096;
+    static constexpr size_t blockSize = 64 * 1024;
+
+    static uint32_t hashOf(string_view text) {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : text) h = (h ^ c) * 16777619u;
+        return h;
+    }
+    Symbol find(const Table& t, string_view text, uint32_t hash) const {
+        for (uint32_t i = hash & t.mask;; i = (i + 1) & t.mask) {
+            uint32_t slot = t.slots[i].load(memory_order_acquire);
+            if (slot == 0) return none;
+            const Entry& e = chunks[(slot - 1) >> chunkBits].load(memory_order_relaxed)[(slot - 1) & chunkMask];
+            if (e.hash == hash && e.size == text.size() && memcmp(e.text, text.data(), e.size) == 0) {
+                return slot - 1;
+            }
+        }
+    }
+    static void insert(Table& t, Symbol s, uint32_t hash) {
+        uint32_t i = hash & t.mask;
+        while (t.slots[i].load(memory_order_relaxed) != 0) i = (i + 1) & t.mask;
+        t.slots[i].store(s + 1, memory_order_release);
+    }
+    Table* grow(const Table& old) {
+        auto* t = new Table((old.mask + 1) * 2);
+        for (Symbol s = 0, n = count.load(memory_order_relaxed); s < n; s++) {
+            insert(*t, s, chunks[s >> chunkBits].load(memory_order_relaxed)[s & chunkMask].hash);
+        }
+        tables.emplace_back(t);
+        table.store(t, memory_order_release);
+        return t;
+    }
+    const char* copy(string_view text) {
+        if (text.empty()) return "";
+        if (text.size() > size_t(limit - cur)) {
+            size_t capacity = max(blockSize, text.size());
+            blocks.push_back(new char[capacity]);
+            cur = blocks.back();
+            limit = cur + capacity;
+        }
+        memcpy(cur, text.data(), text.size());
+        cur += text.size();
+        return cur - text.size();
+    }
+
+    vector<unique_ptr<Table>> tables = [] {
+        vector<unique_ptr<Table>> v;
+        v.emplace_back(new Table(1024));
+        return v;
+    }();
+    atomic<Table*> table{ tables.back().get() };
+    atomic<Entry*> chunks[maxChunks] = {};
+    atomic<Symbol> count{ 0 };
+    mutex writer;
+    vector<char*> blocks;
+    char* cur = nullptr;
+    char* limit = nullptr;
+};
+static Interner symbols;
+
+//===----------------------------------------------------------------------===//
+// scanning kernels used by the lexKernel
+//===----------------------------------------------------------------------===//
+// Byte sets the lexKernel skips over in bulk, each kernel stops at the first byte
+// that ends its run. Every set stops at '\0' so a scan always ends within the
+// padding of a Source.
+enum ScanSet {
+    SCAN_BLANK,     // stop at anything but ' ' '\t' '\r'
+    SCAN_SPACE,     // stop at anything but ' ' '\t' '\r' '\n'
+    SCAN_IDENT,     // stop at anything but letters, digits and '_'
+    SCAN_STRING,    // stop at '"' '\\' '\n' '\r'
+    SCAN_RAW,       // stop at '`'
+    SCAN_LINE,      // stop at '\n' '\r'
+    SCAN_COMMENT,   // stop at '*'
+    SCAN_BRACE      // stop at '{' '}' '/' and the quotes '"' '\'' '`'
+};
+struct ScanTable { unsigned char stop[256]; };
+constexpr ScanTable makeScanTable() {
+    ScanTable table{};
+    for (int i = 0; i < 256; i++) {
+        char c = char(i);
+        bool blank = c == ' ' || c == '\t' || c == '\r';
+        bool ident = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_';
+        bool end = c == '\0';
+        table.stop[i] = (!blank) << SCAN_BLANK |
+            (!blank && c != '\n') << SCAN_SPACE |
+            (!ident) << SCAN_IDENT |
+            (end || c == '"' || c == '\\' || c == '\n' || c == '\r') << SCAN_STRING |
+            (end || c == '`') << SCAN_RAW |
+            (end || c == '\n' || c == '\r') << SCAN_LINE |
+            (end || c == '*') << SCAN_COMMENT |
+            (end || c == '{' || c == '}' || c == '/' || c == '"' || c == '\'' || c == '`') << SCAN_BRACE;
+    }
+    return table;
+}
+constexpr ScanTable scanTable = makeScanTable();
+
+inline int lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return int(i);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+inline int highestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, mask);
+    return int(i);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+inline int lowestBit64(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, mask);
+    return int(i);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+inline int bitCount64(uint64_t mask) {
+#ifdef _MSC_VER
+    return int(bitset<64>(mask).count());
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+// a op b into r, returning whether it overflowed
+inline bool addOverflows(int64_t a, int64_t b, int64_t& r) {
+#ifdef _MSC_VER
+    r = int64_t(uint64_t(a) + uint64_t(b));
+    return (a < 0) == (b < 0) && (r < 0) != (a < 0);
+#else
+    return __builtin_add_overflow(a, b, &r);
+#endif
+}
+inline bool subOverflows(int64_t a, int64_t b, int64_t& r) {
+#ifdef _MSC_VER
+    r = int64_t(uint64_t(a) - uint64_t(b));
+    return (a < 0) != (b < 0) && (r < 0) != (a < 0);
+#else
+    return __builtin_sub_overflow(a, b, &r);
+#endif
+}
+inline bool mulOverflows(int64_t a, int64_t b, int64_t& r) {
+#ifdef _MSC_VER
+    r = int64_t(uint64_t(a) * uint64_t(b));
+    if (a == 0 || b == 0) return false;
+    if (a == -1 || b == -1) return (a == -1 ? b : a) == INT64_MIN;
+    return r / b != a;
+#else
+    return __builtin_mul_overflow(a, b, &r);
+#endif
+}
+
+// A kernel classifies a block of width bytes at once: block() returns one bit
+// per byte that stops the set and reports the newlines of the block.
+struct ScalarScan {
+    static constexpr int width = 1;
+    static unsigned block(const char* p, ScanSet set, unsigned& newlines) {
+        newlines = *p == '\n';
+        return (scanTable.stop[(unsigned char)*p] >> set) & 1;
+    }
+};
+#ifdef G5_SIMD
+struct Sse2Scan {
+    static constexpr int width = 16;
+    static unsigned match(__m128i c, char x) {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(x)));
+    }
+    static unsigned atMost(__m128i c, char low, char n) {
+        __m128i offset = _mm_sub_epi8(c, _mm_set1_epi8(low));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(n)), offset));
+    }
+    static unsigned block(const char* p, ScanSet set, unsigned& newlines) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        newlines = match(c, '\n');
+        switch (set) {
+        case SCAN_BLANK: return ~(match(c, ' ') | match(c, '\t') | match(c, '\r')) & 0xffff;
+        case SCAN_SPACE:
+            return ~(match(c, ' ') | match(c, '\t') | match(c, '\r') | newlines) & 0xffff;
+        case SCAN_IDENT: {
+            __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            return ~(atMost(lower, 'a', 25) | atMost(c, '0', 9) | match(c, '_')) & 0xffff;
+        }
+        case SCAN_STRING:
+            return match(c, '"') | match(c, '\\') | newlines | match(c, '\r') | match(c, 0);
+        case SCAN_RAW: return match(c, '`') | match(c, 0);
+        case SCAN_LINE: return newlines | match(c, '\r') | match(c, 0);
+        case SCAN_COMMENT: return match(c, '*') | match(c, 0);
+        case SCAN_BRACE:
+            return match(c, '{') | match(c, '}') | match(c, '/') | match(c, '"') |
+                match(c, '\'') | match(c, '`') | match(c, 0);
+        }
+        return 0;
+    }
+};
+struct Avx2Scan {
+    static constexpr int width = 32;
+    G5_AVX2 static unsigned match(__m256i c, char x) {
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(x)));
+    }
+    G5_AVX2 static unsigned atMost(__m256i c, char low, char n) {
+        __m256i offset = _mm256_sub_epi8(c, _mm256_set1_epi8(low));
+        return _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(n)), offset));
+    }
+    G5_AVX2 static unsigned block(const char* p, ScanSet set, unsigned& newlines) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        newlines = match(c, '\n');
+        switch (set) {
+        case SCAN_BLANK: return ~(match(c, ' ') | match(c, '\t') | match(c, '\r'));
+        case SCAN_SPACE: return ~(match(c, ' ') | match(c, '\t') | match(c, '\r') | newlines);
+        case SCAN_IDENT: {
+            __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+            return ~(atMost(lower, 'a', 25) | atMost(c, '0', 9) | match(c, '_'));
+        }
+        case SCAN_STRING:
+            return match(c, '"') | match(c, '\\') | newlines | match(c, '\r') | match(c, 0);
+        case SCAN_RAW: return match(c, '`') | match(c, 0);
+        case SCAN_LINE: return newlines | match(c, '\r') | match(c, 0);
+        case SCAN_COMMENT: return match(c, '*') | match(c, 0);
+        case SCAN_BRACE:
+            return match(c, '{') | match(c, '}') | match(c, '/') | match(c, '"') |
+                match(c, '\'') | match(c, '`') | match(c, 0);
+        }
+        return 0;
+    }
+};
+#endif
+
+// Advance p to the first byte that stops the set, counting the newlines passed
+// on the way.
+template <class Scan>
+inline const char* scan(const char* p, ScanSet set, int& line, const char*& lineBegin) {
+    // most runs between tokens are empty, settle them without a whole block
+    if ((scanTable.stop[(unsigned char)*p] >> set) & 1) return p;
+    for (;; p += Scan::width) {
+        unsigned newlines, stop = Scan::block(p, set, newlines);
+        if (stop != 0) newlines &= (stop & (0u - stop)) - 1;
+        if (newlines != 0) {
+            line += int(bitset<32>(newlines).count());
+            lineBegin = p + highestBit(newlines) + 1;
+        }
+        if (stop != 0) return p + lowestBit(stop);
+    }
+}
+
 //===----------------------------------------------------------------------===//
 // Implementation of golang compiler and runtime within 5 functions
 //===----------------------------------------------------------------------===//
 
-Token next(fstream& f) {
+// Go's error for the number literal text, empty when it is well formed: its
+// digits must be of its base, separated by single underscores and there must
+// be some, a radix point only comes in decimal and hexadecimal, and an
+// exponent has digits and the letter the base asks for.
+string numberLiteralError(string_view text) {
+    size_t i = 0;
+    auto at = [&] { return i < text.size() ? text[i] : '\0'; };
+    char prefix = 0;
+    int base = 10, seen = 0;
+    size_t invalid = string_view::npos;
+    bool isFloat = false;
+    // sets bit 0 of seen for a digit, bit 1 for a separator
+    auto digits = [&](int base, bool check) {
+        for (; i < text.size(); i++) {
+            char c = text[i];
+            if (c == '_') {
+                seen |= 2;
+                continue;
+            }
+            if (base == 16 ? !isxdigit((unsigned char)c) : !isdigit((unsigned char)c)) break;
+            seen |= 1;
+            if (check && base < 10 && c - '0' >= base && invalid == string_view::npos) invalid = i;
+        }
+    };
+    if (at() != '.') {
+        if (at() == '0') {
+            i++;
+            prefix = char(tolower(at()));
+            if (prefix == 'x' || prefix == 'o' || prefix == 'b') {
+                base = prefix == 'x' ? 16 : prefix == 'o' ? 8 : 2;
+                i++;
+            }
+            else {
+                // a leading 0 is a digit of an octal literal
+                prefix = '0';
+                base = 8;
+                seen = 1;
+            }
+        }
+        digits(base, true);
+    }
+    string name = prefix == 'x' ? "hexadecimal literal" : prefix == 'b' ? "binary literal" :
+        prefix == 'o' || prefix == '0' ? "octal literal" : "decimal literal";
+    if (at() == '.') {
+        if (prefix == 'o' || prefix == 'b') return "invalid radix point in " + name;
+        isFloat = true;
+        i++;
+        digits(base, true);
+    }
+    if (!(seen & 1)) return name + " has no digits";
+    char e = char(tolower(at()));
+    if (e == 'e' || e == 'p') {
+        if (e == 'e' && prefix != 0 && prefix != '0') return string("'") + at() + "' exponent requires decimal mantissa";
+        if (e == 'p' && prefix != 'x') return string("'") + at() + "' exponent requires hexadecimal mantissa";
+        isFloat = true;
+        i++;
+        if (at() == '+' || at() == '-') i++;
+        int before = seen;
+        seen = 0;
+        digits(10, false);
+        bool none = !(seen & 1);
+        seen |= before;
+        if (none) return "exponent has no digits";
+    }
+    else if (prefix == 'x' && isFloat) {
+        return "hexadecimal mantissa requires a 'p' exponent";
+    }
+    bool imaginary = at() == 'i';
+    if (imaginary) i++;
+    if (!isFloat && !imaginary && invalid != string_view::npos) {
+        return string("invalid digit '") + text[invalid] + "' in " + name;
+    }
+    if (!(seen & 2)) return "";
+    // a separator follows the prefix or a digit, and is followed by a digit
+    bool hexDigits = prefix == 'x';
+    char previous = prefix == 'x' || prefix == 'o' || prefix == 'b' ? '0' : '.';
+    for (size_t k = previous == '0' ? 2 : 0; k < text.size(); k++) {
+        char c = text[k], kind = c == '_' ? '_' : isdigit((unsigned char)c) || (hexDigits && isxdigit((unsigned char)c)) ? '0' : '.';
+        if ((kind == '_' && previous != '0') || (kind == '.' && previous == '_')) return "'_' must separate successive digits";
+        previous = kind;
+    }
+    if (previous == '_') return "'_' must separate successive digits";
+    return "";
+}
+
+// The lexKernel is instantiated once per scanning kernel, next() dispatches to the
+// best one the cpu supports.
+template <class Scan>
+Token lex(Lexer& f) {
     auto consumePeek = [&](char& c) {
-        f.get();
-        column++;
+        f.cur++;
         char oc = c;
-        c = f.peek();
+        c = *f.cur;
         return oc;
     };
-    char c = f.peek();
+    auto newline = [&]() {
+        f.line++;
+        f.lineBegin = f.cur + 1;
+    };
+    f.prevEnd = f.cur;
+    char c = *f.cur;
 
 skip_comment_and_find_next:
 
-    for (; c == ' ' || c == '\r' || c == '\t' || c == '\n'; column++) {
+    // a newline only matters when it ends a line with a semicolon, otherwise
+    // the whole run of white space is skipped at once
+    if ((f.lastToken >= TK_ID && f.lastToken <= LITERAL_STR)
+        || f.lastToken == KW_fallthrough || f.lastToken == KW_continue
+        || f.lastToken == KW_return || f.lastToken == KW_break
+        || f.lastToken == OP_INC || f.lastToken == OP_DEC
+        || f.lastToken == OP_RPAREN
+        || f.lastToken == OP_RBRACKET || f.lastToken == OP_RBRACE) {
+        f.cur = scan<Scan>(f.cur, SCAN_BLANK, f.line, f.lineBegin);
+        c = *f.cur;
         if (c == '\n') {
-            line++;
-            column = 1;
-            if ((lastToken >= TK_ID && lastToken <= LITERAL_STR)
-                || lastToken == KW_fallthrough || lastToken == KW_continue
-                || lastToken == KW_return || lastToken == KW_break
-                || lastToken == OP_INC || lastToken == OP_DEC
-                || lastToken == OP_RPAREN
-                || lastToken == OP_RBRACKET || lastToken == OP_RBRACE) {
-                consumePeek(c);
-                lastToken = OP_SEMI;
-                return Token(OP_SEMI, ";");
-            }
+            Token semi(OP_SEMI, ";", f.line, int(f.cur - f.lineBegin) + 1);
+            newline();
+            consumePeek(c);
+            f.lastToken = OP_SEMI;
+            return semi;
         }
-        consumePeek(c);
     }
-    if (f.eof()) {
-        if (shouldEof) {
-            lastToken = TK_EOF;
-            return Token(TK_EOF, "");
-        }
-        shouldEof = 1;
-        lastToken = OP_SEMI;
-        return Token(OP_SEMI, ";");
+    else {
+        f.cur = scan<Scan>(f.cur, SCAN_SPACE, f.line, f.lineBegin);
+        c = *f.cur;
     }
+    const char* start = f.cur;
+    const int column = int(start - f.lineBegin) + 1;
+    auto token = [&](TokenType type) {
+        f.lastToken = type;
+        return Token(type, string_view(start, f.cur - start), f.line, column);
+    };
 
-    string lexeme;
-
+    if (f.cur >= f.end) {
+        if (f.shouldEof) {
+            f.lastToken = TK_EOF;
+            return Token(TK_EOF, "", f.line, column);
+        }
+        f.shouldEof = 1;
+        f.lastToken = OP_SEMI;
+        return Token(OP_SEMI, ";", f.line, column);
+    }
 
     // identifier = letter { letter | unicode_digit } .
     if (isalpha(c) || c == '_') {
-        while (isalnum(c) || c == '_') {
-            lexeme += consumePeek(c);
-        }
-
-        for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
-            if (keywords[i] == lexeme) {
-                lastToken = static_cast<TokenType>(i);
-                return Token(static_cast<TokenType>(i), lexeme);
-            }
-        lastToken = TK_ID;
-        return Token(TK_ID, lexeme);
+        f.cur = scan<Scan>(f.cur + 1, SCAN_IDENT, f.line, f.lineBegin);
+        Token t = token(lookupKeyword(string_view(start, f.cur - start)));
+        if (t.type == TK_ID) t.symbol = symbols.intern(t.lexeme);
+        return t;
     }
 
     // int_lit     = decimal_lit | octal_lit | hex_lit .
     // decimal_lit = ( "1" … "9" ) { decimal_digit } .
     // octal_lit   = "0" { octal_digit } .
     // hex_lit     = "0" ( "x" | "X" ) hex_digit { hex_digit } .
+    // binary_lit  = "0" ( "b" | "B" ) binary_digit { binary_digit } .
+    // digits may be separated by "_", an "0o" prefix marks an octal_lit too
 
     // float_lit = decimals "." [ decimals ] [ exponent ] |
     //         decimals exponent |
     //         "." decimals [ exponent ] .
     // decimals  = decimal_digit { decimal_digit } .
     // exponent  = ( "e" | "E" ) [ "+" | "-" ] decimals .
+    // hex_float_lit = "0" ( "x" | "X" ) hex_mantissa ( "p" | "P" ) [ "+" | "-" ] decimals .
 
     // imaginary_lit = (decimals | float_lit) "i" .
-    if (isdigit(c) || c == '.') {
+    if (isdigit(c) || (c == '.' && isdigit((unsigned char)f.cur[1]))) {
+        // taken as far as Go takes a number, every digit whatever the base,
+        // then checked, so that a malformed one gets Go's error
+        auto digits = [&](bool hex) {
+            while (isdigit((unsigned char)c) || c == '_' || (hex && isxdigit((unsigned char)c))) consumePeek(c);
+        };
+        TokenType type = LITERAL_INT;
+        bool hex = false;
         if (c == '0') {
-            lexeme += consumePeek(c);
-            if (c == 'x' || c == 'X') {
-                do {
-                    lexeme += consumePeek(c);
-                } while (isdigit(c) || c >= 'a' && c <= 'f' || c >= 'A' && c <= 'F');
-                lastToken = LITERAL_INT;
-                return Token(LITERAL_INT, lexeme);
-            }
-            else if ((c >= '0' && c <= '9') ||
-                (c == '.' || c == 'e' || c == 'E' || c == 'i')) {
-                while ((c >= '0' && c <= '9') ||
-                    (c == '.' || c == 'e' || c == 'E' || c == 'i')) {
-                    if (c >= '0' && c <= '7') {
-                        lexeme += consumePeek(c);
-                    }
-                    else {
-                        goto shall_float;
-                    }
-                }
-                lastToken = LITERAL_INT;
-                return Token(LITERAL_INT, lexeme);
+            consumePeek(c);
+            char prefix = char(tolower(c));
+            if (prefix == 'x' || prefix == 'o' || prefix == 'b') {
+                hex = prefix == 'x';
+                consumePeek(c);
             }
-            goto may_float;
         }
-        else {  // 1-9 or . or just a single 0
-        may_float:
-            TokenType type = LITERAL_INT;
-            if (c == '.') {
-                lexeme += consumePeek(c);
-                if (c == '.') {
-                    lexeme += consumePeek(c);
-                    if (c == '.') {
-                        lexeme += consumePeek(c);
-                        lastToken = OP_VARIADIC;
-                        return Token(OP_VARIADIC, lexeme);
-                    }
-                    else {
-                        throw runtime_error(
-                            "expect variadic notation(...) but got .." + c);
-                    }
-                }
-                else if (c >= '0'&&c <= '9') {
-                    type = LITERAL_FLOAT;
-                }
-                else {
-                    lastToken = OP_DOT;
-                    return Token(OP_DOT, ".");
-                }
-                goto shall_float;
-            }
-            else if (c >= '1'&&c <= '9') {
-                lexeme += consumePeek(c);
-            shall_float:  // skip char consuming and appending since we did that before jumping here;
-                bool hasDot = false, hasExponent = false;
-                while ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
-                    c == 'i') {
-                    if (c >= '0' && c <= '9') {
-                        lexeme += consumePeek(c);
-                    }
-                    else if (c == '.' && !hasDot) {
-                        lexeme += consumePeek(c);
-                        type = LITERAL_FLOAT;
-                    }
-                    else if ((c == 'e' && !hasExponent) ||
-                        (c == 'E' && !hasExponent)) {
-                        hasExponent = true;
-                        type = LITERAL_FLOAT;
-                        lexeme += consumePeek(c);
-                        if (c == '+' || c == '-') {
-                            lexeme += consumePeek(c);
-                        }
-                    }
-                    else {
-                        f.get();
-                        column++;
-                        lexeme += c;
-                        lastToken = LITERAL_IMG;
-                        return Token(LITERAL_IMG, lexeme);
-                    }
-                }
-                lastToken = type;
-                return Token(type, lexeme);
-            }
-            else {
-                lastToken = type;
-                return Token(type, lexeme);
-            }
+        digits(hex);
+        if (c == '.') {
+            type = LITERAL_FLOAT;
+            consumePeek(c);
+            digits(hex);
         }
+        if (c == 'e' || c == 'E' || c == 'p' || c == 'P') {
+            type = LITERAL_FLOAT;
+            consumePeek(c);
+            if (c == '+' || c == '-') consumePeek(c);
+            digits(false);
+        }
+        if (c == 'i') {
+            type = LITERAL_IMG;
+            consumePeek(c);
+        }
+        string error = numberLiteralError(string_view(start, f.cur - start));
+        if (!error.empty()) throw runtime_error(error);
+        return token(type);
+    }
+    if (c == '.') {
+        consumePeek(c);
+        if (c != '.') return token(OP_DOT);
+        consumePeek(c);
+        if (c != '.') throw runtime_error(string("expect variadic notation(...) but got ..") + c);
+        consumePeek(c);
+        return token(OP_VARIADIC);
     }
 
     //! NOT FULLY SUPPORT UNICODE RELATED LITERALS
@@ -592,24 +1321,24 @@ skip_comment_and_find_next:
     // escaped_char     = `\` ( "a" | "b" | "f" | "n" | "r" | "t" | "v" | `\` |
     // "'" | `"` ) .
     if (c == '\'') {
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '\\') {
-            lexeme += consumePeek(c);
+            consumePeek(c);
 
             if (c == 'U' || c == 'u' || c == 'x' || c == 'X') {
                 do {
-                    lexeme += consumePeek(c);
+                    consumePeek(c);
                 } while (isdigit(c) || (c >= 'a' && c <= 'f') ||
                     (c >= 'A' && c <= 'F'));
             }
             else if (c >= '0' && c <= '7') {
                 do {
-                    lexeme += consumePeek(c);
+                    consumePeek(c);
                 } while (c >= '0' && c <= '7');
             }
             else if (c == 'a' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't' ||
                 c == 'v' || c == '\\' || c == '\'' || c == '"') {
-                lexeme += consumePeek(c);
+                consumePeek(c);
             }
             else {
                 throw runtime_error("illegal rune");
@@ -617,1059 +1346,1145 @@ skip_comment_and_find_next:
 
         }
         else {
-            lexeme += consumePeek(c);
+            consumePeek(c);
         }
 
         if (c != '\'') {
             throw runtime_error(
                 "illegal rune at least in current implementation of g8");
         }
-        lexeme += consumePeek(c);
-        lastToken = LITERAL_RUNE;
-        return Token(LITERAL_RUNE, lexeme);
+        consumePeek(c);
+        return token(LITERAL_RUNE);
     }
 
     // string_lit             = raw_string_lit | interpreted_string_lit .
     // raw_string_lit         = "`" { unicode_char | newline } "`" .
     // interpreted_string_lit = `"` { unicode_value | byte_value } `"` .
     if (c == '`') {
-        do {
-            lexeme += consumePeek(c);
-            if (c == '\n') line++;
-        } while (f.good() && c != '`');
+        f.cur = scan<Scan>(f.cur + 1, SCAN_RAW, f.line, f.lineBegin);
+        c = *f.cur;
         if (c != '`') {
             throw runtime_error(
                 "raw string literal does not have a closed symbol \"`\"");
         }
-        lexeme += consumePeek(c);
-        lastToken = LITERAL_STR;
-        return Token(LITERAL_STR, lexeme);
+        consumePeek(c);
+        return token(LITERAL_STR);
     }
     else if (c == '"') {
-        do {
-            lexeme += consumePeek(c);
-            if (c == '\\') {
-                lexeme += consumePeek(c);
-                lexeme += consumePeek(c);
-            }
-        } while (f.good() && (c != '\n' && c != '\r' && c != '"'));
+        f.cur = scan<Scan>(f.cur + 1, SCAN_STRING, f.line, f.lineBegin);
+        while (*f.cur == '\\' && f.cur < f.end) {
+            f.cur = scan<Scan>(f.cur + 2, SCAN_STRING, f.line, f.lineBegin);
+        }
+        c = *f.cur;
         if (c != '"') {
             throw runtime_error(
                 "string literal does not have a closed symbol \"\"\"");
         }
-        lexeme += consumePeek(c);
-        lastToken = LITERAL_STR;
-        return Token(LITERAL_STR, lexeme);
+        consumePeek(c);
+        return token(LITERAL_STR);
     }
 
     // operators
     switch (c) {
     case '+':  //+  += ++
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_ADDAGN;
-            return Token(OP_ADDAGN, lexeme);
+            consumePeek(c);
+            return token(OP_ADDAGN);
         }
         else if (c == '+') {
-            lexeme += consumePeek(c);
-            lastToken = OP_INC;
-            return Token(OP_INC, lexeme);
+            consumePeek(c);
+            return token(OP_INC);
         }
-        return Token(OP_ADD, lexeme);
+        return token(OP_ADD);
     case '&':  //&  &=  &&  &^  &^=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_BITANDAGN;
-            return Token(OP_BITANDAGN, lexeme);
+            consumePeek(c);
+            return token(OP_BITANDAGN);
         }
         else if (c == '&') {
-            lexeme += consumePeek(c);
-            lastToken = OP_AND;
-            return Token(OP_AND, lexeme);
+            consumePeek(c);
+            return token(OP_AND);
         }
         else if (c == '^') {
-            lexeme += consumePeek(c);
+            consumePeek(c);
             if (c == '=') {
-                lexeme += consumePeek(c);
-                lastToken = OP_ANDXORAGN;
-                return Token(OP_ANDXORAGN, lexeme);
+                consumePeek(c);
+                return token(OP_ANDXORAGN);
             }
-            lastToken = OP_ANDXOR;
-            return Token(OP_ANDXOR, lexeme);
+            return token(OP_ANDXOR);
         }
-        lastToken = OP_BITAND;
-        return Token(OP_BITAND, lexeme);
+        return token(OP_BITAND);
     case '=':  //=  ==
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lastToken = OP_EQ;
-            return Token(OP_EQ, lexeme);
+            consumePeek(c);
+            return token(OP_EQ);
         }
-        lastToken = OP_AGN;
-        return Token(OP_AGN, lexeme);
+        return token(OP_AGN);
     case '!':  //!  !=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_NE;
-            return Token(OP_NE, lexeme);
+            consumePeek(c);
+            return token(OP_NE);
         }
-        lastToken = OP_NOT;
-        return Token(OP_NOT, lexeme);
+        return token(OP_NOT);
     case '(':
-        lexeme += consumePeek(c);
-        lastToken = OP_LPAREN;
-        return Token(OP_LPAREN, lexeme);
+        consumePeek(c);
+        return token(OP_LPAREN);
     case ')':
-        lexeme += consumePeek(c);
-        lastToken = OP_RPAREN;
-        return Token(OP_RPAREN, lexeme);
+        consumePeek(c);
+        return token(OP_RPAREN);
     case '-':  //-  -= --
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_SUBAGN;
-            return Token(OP_SUBAGN, lexeme);
+            consumePeek(c);
+            return token(OP_SUBAGN);
         }
         else if (c == '-') {
-            lexeme += consumePeek(c);
-            lastToken = OP_DEC;
-            return Token(OP_DEC, lexeme);
+            consumePeek(c);
+            return token(OP_DEC);
         }
-        lastToken = OP_SUB;
-        return Token(OP_SUB, lexeme);
+        return token(OP_SUB);
     case '|':  //|  |=  ||
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_BITORAGN;
-            return Token(OP_BITORAGN, lexeme);
+            consumePeek(c);
+            return token(OP_BITORAGN);
         }
         else if (c == '|') {
-            lexeme += consumePeek(c);
-            lastToken = OP_OR;
-            return Token(OP_OR, lexeme);
+            consumePeek(c);
+            return token(OP_OR);
         }
-        lastToken = OP_BITOR;
-        return Token(OP_BITOR, lexeme);
+        return token(OP_BITOR);
     case '<':  //<  <=  <- <<  <<=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_LE;
-            return Token(OP_LE, lexeme);
+            consumePeek(c);
+            return token(OP_LE);
         }
         else if (c == '-') {
-            lexeme += consumePeek(c);
-            lastToken = OP_CHAN;
-            return Token(OP_CHAN, lexeme);
+            consumePeek(c);
+            return token(OP_CHAN);
         }
         else if (c == '<') {
-            lexeme += consumePeek(c);
+            consumePeek(c);
             if (c == '=') {
-                lastToken = OP_LSFTAGN;
-                return Token(OP_LSFTAGN, lexeme);
+                consumePeek(c);
+                return token(OP_LSFTAGN);
             }
-            lastToken = OP_LSHIFT;
-            return Token(OP_LSHIFT, lexeme);
+            return token(OP_LSHIFT);
         }
-        lastToken = OP_LT;
-        return Token(OP_LT, lexeme);
+        return token(OP_LT);
     case '[':
-        lexeme += consumePeek(c);
-        lastToken = OP_LBRACKET;
-        return Token(OP_LBRACKET, lexeme);
+        consumePeek(c);
+        return token(OP_LBRACKET);
     case ']':
-        lexeme += consumePeek(c);
-        lastToken = OP_RBRACKET;
-        return Token(OP_RBRACKET, lexeme);
+        consumePeek(c);
+        return token(OP_RBRACKET);
     case '*':  //*  *=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lastToken = OP_MULAGN;
-            return Token(OP_MULAGN, lexeme);
+            consumePeek(c);
+            return token(OP_MULAGN);
         }
-        lastToken = OP_MUL;
-        return Token(OP_MUL, lexeme);
+        return token(OP_MUL);
     case '^':  //^  ^=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lastToken = OP_BITXORAGN;
-            return Token(OP_BITXORAGN, lexeme);
+            consumePeek(c);
+            return token(OP_BITXORAGN);
         }
-        lastToken = OP_XOR;
-        return Token(OP_XOR, lexeme);
+        return token(OP_XOR);
     case '>':  //>  >=  >>  >>=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_GE;
-            return Token(OP_GE, lexeme);
+            consumePeek(c);
+            return token(OP_GE);
         }
         else if (c == '>') {
-            lexeme += consumePeek(c);
+            consumePeek(c);
             if (c == '=') {
-                lastToken = OP_RSFTAGN;
-                return Token(OP_RSFTAGN, lexeme);
+                consumePeek(c);
+                return token(OP_RSFTAGN);
             }
-            lastToken = OP_RSHIFT;
-            return Token(OP_RSHIFT, lexeme);
+            return token(OP_RSHIFT);
         }
-        lastToken = OP_GT;
-        return Token(OP_GT, lexeme);
+        return token(OP_GT);
     case '{':
-        lexeme += consumePeek(c);
-        lastToken = OP_LBRACE;
-        return Token(OP_LBRACE, lexeme);
+        consumePeek(c);
+        return token(OP_LBRACE);
     case '}':
-        lexeme += consumePeek(c);
-        lastToken = OP_RBRACE;
-        return Token(OP_RBRACE, lexeme);
+        consumePeek(c);
+        return token(OP_RBRACE);
     case '/': {  // /  /= // /*...*/
-        char pending = consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += pending;
-            lexeme += consumePeek(c);
-            lastToken = OP_DIVAGN;
-            return Token(OP_DIVAGN, lexeme);
+            consumePeek(c);
+            return token(OP_DIVAGN);
         }
         else if (c == '/') {
-            do {
-                consumePeek(c);
-            } while (f.good() && (c != '\n' && c != '\r'));
+            f.cur = scan<Scan>(f.cur + 1, SCAN_LINE, f.line, f.lineBegin);
+            c = *f.cur;
             goto skip_comment_and_find_next;
         }
         else if (c == '*') {
-            do {
-                consumePeek(c);
-                if (c == '\n') line++;
-                if (c == '*') {
-                    consumePeek(c);
-                    if (c == '/') {
-                        consumePeek(c);
-                        goto skip_comment_and_find_next;
-                    }
+            f.cur = scan<Scan>(f.cur + 1, SCAN_COMMENT, f.line, f.lineBegin);
+            while (f.cur < f.end) {
+                if (f.cur[1] == '/') {
+                    f.cur += 2;
+                    c = *f.cur;
+                    goto skip_comment_and_find_next;
                 }
-            } while (f.good());
+                f.cur = scan<Scan>(f.cur + 1, SCAN_COMMENT, f.line, f.lineBegin);
+            }
+            c = *f.cur;
         }
-        lexeme += pending;
-        lastToken = OP_DIV;
-        return Token(OP_DIV, lexeme);
+        return token(OP_DIV);
     }
     case ':':  // :=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_SHORTAGN;
-            return Token(OP_SHORTAGN, lexeme);
+            consumePeek(c);
+            return token(OP_SHORTAGN);
         }
-        lastToken = OP_COLON;
-        return Token(OP_COLON, lexeme);
+        return token(OP_COLON);
     case ',':
-        lexeme += consumePeek(c);
-        lastToken = OP_COMMA;
-        return Token(OP_COMMA, lexeme);
+        consumePeek(c);
+        return token(OP_COMMA);
     case ';':
-        lexeme += consumePeek(c);
-        lastToken = OP_SEMI;
-        return Token(OP_SEMI, lexeme);
+        consumePeek(c);
+        return token(OP_SEMI);
     case '%':  //%  %=
-        lexeme += consumePeek(c);
+        consumePeek(c);
         if (c == '=') {
-            lexeme += consumePeek(c);
-            lastToken = OP_MODAGN;
-            return Token(OP_MODAGN, lexeme);
+            consumePeek(c);
+            return token(OP_MODAGN);
         }
-        lastToken = OP_MOD;
-        return Token(OP_MOD, lexeme);
+        return token(OP_MOD);
         // case '.' has already checked
     }
 
     throw runtime_error("illegal token in source file");
 }
 
-const AstNode* parse(const string & filename) {
-    fstream f(filename, ios::binary | ios::in);
-    auto t = next(f);
-
-    auto eat = [&f, &t](TokenType tk, const string&msg) {
-        if (t.type != tk) throw runtime_error(msg);
-        t = next(f);
-    };
-
-    auto expect = [&f, &t](TokenType tk, const string& msg) {
-        t = next(f);
-        if (t.type != tk) throw runtime_error(msg);
-        return t;
-    };
-
-    function<AstNode*(Token&)> parseImportDecl, parseTopLevelDecl, parseTypeAssertion,
-        parseDeclaration, parseConstDecl, parseIdentifierList, parseType, parseTypeName,
-        parseArrayType, parseStructType, parsePointerType, parseFunctionType,
-        parseSignature, parseParameter, parseParameterDecl, parseResult, parseInterfaceType,
-        parseMethodSpec, parseMethodName, parseSliceType, parseMapType, parseChannelType,
-        parseTypeDecl, parseTypeSpec, parseVarDecl, parseVarSpec, parseFunctionDecl,
-        parseStatementList, parseStatement, parseCompositeLit, parseFieldName, parseConversion,
-        parseLabeledStmt, parseSimpleStmt, parseGoStmt, parseReturnStmt, parseBreakStmt,
-        parseContinueStmt, parseGotoStmt, parseFallthroughStmt, parseBlock, parseIfStmt,
-        parseSwitchStmt, parseSelectStmt, parseForStmt, parseDeferStmt, parseExpressionStmt,
-        parseSendStmt, parseIncDecStmt, parseAssignment, parseShortVarDecl, parseExprCaseClause,
-        parseExprSwitchCase, parseCommClause, parseCommCase, parseRecvStmt, parseForClause,
-        parseRangeClause, parseSourceFile, parseExpressionList, parseExpression,
-        parseUnaryExpr, parsePrimaryExpr, parseSelector, parseIndex, parseSlice,
-        parseArgument, parseOperand, parseOperandName, parseLiteral, parseBasicLit,
-        parseLiteralValue, parseElementList, parseKeyedElement, parseKey, parseElement,
-        parseFunctionLit, parseMethodExpr;
-
-    parseIdentifierList = [&](Token&t)->AstNode* {
-        AstIdentifierList* node = nullptr;
-        if (t.type = TK_ID) {
-            node = new  AstIdentifierList;
-            node->identifierList.emplace_back(t.lexeme);
-            t = next(f);
-            while (t.type == OP_COMMA) {
-                node->identifierList.emplace_back(expect(TK_ID, "it shall be an identifier").lexeme);
-                t = next(f);
+// Skips the rest of a block whose '{' was lexed last, up to and including the
+// matching '}', by matching braces over the raw text without making tokens.
+// Strings, runes and comments are stepped over whole so braces in them do not
+// count, anything malformed is left for whoever parses the block later. The
+// lexer then stands after the '}' as if it had lexed it. False when the source
+// ends first.
+template <class Scan>
+bool skip(Lexer& f) {
+    const char* p = f.cur;
+    for (int depth = 1; depth > 0;) {
+        p = scan<Scan>(p, SCAN_BRACE, f.line, f.lineBegin);
+        switch (*p) {
+        case '{':
+            depth++;
+            p++;
+            break;
+        case '}':
+            depth--;
+            p++;
+            break;
+        case '"':
+            p = scan<Scan>(p + 1, SCAN_STRING, f.line, f.lineBegin);
+            while (*p == '\\' && p < f.end) p = scan<Scan>(p + 2, SCAN_STRING, f.line, f.lineBegin);
+            if (*p == '"') p++;
+            break;
+        case '\'':
+            for (p++; p < f.end && *p != '\'' && *p != '\n'; p++) {
+                if (*p == '\\') p++;
             }
-        }
-        return node;
-    };
-    parseExpressionList = [&](Token&t)->AstNode* {
-        AstExpressionList* node = nullptr;
-        if (auto* tmp = parseExpression(t); tmp != nullptr) {
-            node = new  AstExpressionList;
-            node->expressionList.emplace_back(tmp);
-            while (t.type == OP_COMMA) {
-                t = next(f);
-                node->expressionList.emplace_back(parseExpression(t));
+            if (*p == '\'') p++;
+            break;
+        case '`':
+            p = scan<Scan>(p + 1, SCAN_RAW, f.line, f.lineBegin);
+            if (*p == '`') p++;
+            break;
+        case '/':
+            if (p[1] == '/') {
+                p = scan<Scan>(p + 2, SCAN_LINE, f.line, f.lineBegin);
             }
-        }
-        return node;
-    };
-    parseSourceFile = [&](Token&t)->AstNode* {
-        AstSourceFile * node = nullptr;
-        if (t.type == KW_package) {
-            grt.package = expect(TK_ID, "expect identifier").lexeme;
-            node = new AstSourceFile;
-            expect(OP_SEMI, "expect a semicolon after package declaration");
-            t = next(f);
-            while (t.type == KW_import) {
-                node->importDecl.push_back(parseImportDecl(t));
-                if (t.type == OP_SEMI) {
-                    t = next(f);
+            else if (p[1] == '*') {
+                for (p = scan<Scan>(p + 2, SCAN_COMMENT, f.line, f.lineBegin); p < f.end;
+                    p = scan<Scan>(p + 1, SCAN_COMMENT, f.line, f.lineBegin)) {
+                    if (p[1] == '/') {
+                        p += 2;
+                        break;
+                    }
                 }
-                t = next(f);
             }
-            while (t.type != TK_EOF) {
-                node->topLevelDecl.push_back(parseTopLevelDecl(t));
-                t = next(f);
+            else {
+                p++;
+            }
+            break;
+        default:
+            if (p >= f.end) {
+                f.cur = f.end;
+                return false;
             }
+            p++;
         }
+    }
+    f.cur = p;
+    f.lastToken = OP_RBRACE;
+    return true;
+}
+
+Token lexScalar(Lexer& f) { return lex<ScalarScan>(f); }
+bool skipScalar(Lexer& f) { return skip<ScalarScan>(f); }
+#ifdef G5_SIMD
+Token lexSse2(Lexer& f) { return lex<Sse2Scan>(f); }
+bool skipSse2(Lexer& f) { return skip<Sse2Scan>(f); }
+#ifdef _MSC_VER
+Token lexAvx2(Lexer& f) { return lex<Avx2Scan>(f); }
+bool skipAvx2(Lexer& f) { return skip<Avx2Scan>(f); }
+#else
+G5_AVX2 __attribute__((flatten)) Token lexAvx2(Lexer& f) { return lex<Avx2Scan>(f); }
+G5_AVX2 __attribute__((flatten)) bool skipAvx2(Lexer& f) { return skip<Avx2Scan>(f); }
+#endif
+#endif
+
+struct Scanner { const char* name; Token(*lex)(Lexer&); bool(*skip)(Lexer&); };
+const vector<Scanner>& availableScanners() {
+    static const vector<Scanner> scanners = [] {
+        vector<Scanner> v{ { "scalar", lexScalar, skipScalar } };
+#ifdef G5_SIMD
+        v.push_back({ "sse2", lexSse2, skipSse2 });
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7) {
+            __cpuidex(info, 7, 0);
+            bool avx2 = (info[1] & (1 << 5)) != 0;
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (avx2 && osxsave && (_xgetbv(0) & 6) == 6) v.push_back({ "avx2", lexAvx2, skipAvx2 });
+        }
+#else
+        if (__builtin_cpu_supports("avx2")) v.push_back({ "avx2", lexAvx2, skipAvx2 });
+#endif
+#endif
+        return v;
+    }();
+    return scanners;
+}
+static Token(*lexKernel)(Lexer&) = availableScanners().back().lex;
+static bool(*skipKernel)(Lexer&) = availableScanners().back().skip;
+
+Token next(Lexer& f) { return lexKernel(f); }
+bool skipBlock(Lexer& f) { return skipKernel(f); }
+
+// Where a top level declaration is in its file: the bytes from its first token
+// to the end of its last one and the line it starts on.
+struct DeclSpan {
+    size_t begin, end;
+    int line;
+};
+// What an ElementSpan is the span of.
+enum ElementKind : uint8_t { EK_STATEMENT, EK_KEYED_ELEMENT, EK_CASE_CLAUSE, EK_COMM_CLAUSE };
+// The span of a statement of a block, an element of a composite literal or a
+// clause of a switch or select, which is element index of list. after is the
+// end of the token before it.
+struct ElementSpan : DeclSpan {
+    size_t after;
+    vector<AstNode*>* list;
+    size_t index;
+    ElementKind kind;
+};
 
+// Recursive descent parser of one file, every grammar rule is an ordinary
+// member function so rules call each other directly and may be inlined. t is
+// always the first token that has not been consumed yet. A rule returns nullptr
+// without consuming anything when t can not start it, and throws once it has
+// committed to a rule that turns out to be malformed.
+struct Parser {
+    Lexer f;
+    Arena& arena;
+    Token t;
+    // Parentheses and brackets around t, it is -1 in the header of if, for and
+    // switch where a '{' after a type name opens the block instead of a literal.
+    int exprLev = 0;
+    // When set it receives the span of the package clause and imports followed
+    // by the span of every top level declaration, see Document.
+    vector<DeclSpan>* spans = nullptr;
+    // and when set the span of every statement, element of a composite literal
+    // and case clause, an element before the ones nested in it
+    vector<ElementSpan>* elements = nullptr;
+    // When set, the bodies of function declarations are skipped and left to
+    // be parsed from it on demand.
+    const LazyFile* lazy = nullptr;
 
+    Parser(const Source& source, Arena& arena)
+        : f(source), arena(arena), t(OP_SEMI, "", 1, 1) {}
+
+    // A node of type T that starts at token at, the current one by default.
+    template <class T>
+    T* make(const Token& at) {
+        T* node = arena.make<T>();
+        node->line = at.line;
+        node->column = at.column;
         return node;
-    };
-    parseImportDecl = [&](Token&t)->AstNode* {
-        if (t.type == KW_import) {
-            auto node = new AstImportDecl;
+    }
+    template <class T>
+    T* make() { return make<T>(t); }
+    Token eat(TokenType tk, const char* msg) {
+        if (t.type != tk) throw runtime_error(msg);
+        Token consumed = t;
+        t = next(f);
+        return consumed;
+    }
+    bool accept(TokenType tk) {
+        if (t.type != tk) return false;
+        t = next(f);
+        return true;
+    }
+    template <class T>
+    T* must(T* node, const char* msg) {
+        if (node == nullptr) throw runtime_error(msg);
+        return node;
+    }
+    size_t offset(const char* p) const { return p - f.source.begin; }
+    // Records the span from begin up to the last consumed token.
+    void mark(size_t begin, int line) {
+        if (spans != nullptr) spans->push_back({ begin, offset(f.prevEnd), line });
+    }
+    // Opens the span of the element that list gets next, which starts at t.
+    size_t openElement(vector<AstNode*>& list, ElementKind kind) {
+        if (elements == nullptr) return 0;
+        elements->push_back({ { offset(t.lexeme.data()), 0, t.line }, offset(f.prevEnd), &list,
+            list.size(), kind });
+        return elements->size() - 1;
+    }
+    void closeElement(size_t slot) {
+        if (elements != nullptr) (*elements)[slot].end = offset(f.prevEnd);
+    }
+    // Forgets the span just opened, the element turned out to be empty.
+    void dropElement() {
+        if (elements != nullptr) elements->pop_back();
+    }
+
+    //===------------------------------------------------------------------===//
+    // declarations
+    //===------------------------------------------------------------------===//
+    AstNode* parseSourceFile() {
+        AstSourceFile* node = nullptr;
+        t = next(f);
+        if (t.type == KW_package) {
+            size_t begin = offset(t.lexeme.data());
+            int line = t.line;
             t = next(f);
-            if (t.type == OP_LPAREN) {
-                t = next(f);
-                do {
-                    string importName, alias;
-                    if (t.type == OP_DOT || t.type == TK_ID) {
-                        alias = t.lexeme;
-                        importName = expect(LITERAL_STR, "import path should not empty").lexeme;
-                    }
-                    else {
-                        importName = t.lexeme;
-                    }
-                    importName = importName.substr(1, importName.length() - 2);
-                    expect(OP_SEMI, "expect an explicit semicolon after import declaration");
-                    node->imports[importName] = alias;
-                    t = next(f);
-                } while (t.type != OP_RPAREN);
+            auto* packageClause = make<AstPackageClause>();
+            packageClause->packageName = eat(TK_ID, "expect identifier").symbol;
+            node = make<AstSourceFile>();
+            node->packageClause = packageClause;
+            size_t end = offset(f.prevEnd);
+            eat(OP_SEMI, "expect a semicolon after package declaration");
+            while (t.type == KW_import) {
+                node->importDecl.push_back(parseImportDecl());
+                end = offset(f.prevEnd);
+                eat(OP_SEMI, "expect a semicolon after import declaration");
             }
-            else {
-                string importName, alias;
-                if (t.type == OP_DOT || t.type == TK_ID) {
-                    alias = t.lexeme;
-                    importName = expect(LITERAL_STR, "import path should not empty").lexeme;
-                }
-                else {
-                    importName = t.lexeme;
-                }
-                importName = importName.substr(1, importName.length() - 2);
-                node->imports[importName] = alias;
+            if (spans != nullptr) spans->push_back({ begin, end, line });
+            while (t.type != TK_EOF) {
+                if (accept(OP_SEMI)) continue;
+                begin = offset(t.lexeme.data());
+                line = t.line;
+                node->topLevelDecl.push_back(must(parseTopLevelDecl(), "expect a declaration"));
+                mark(begin, line);
+                if (t.type != TK_EOF) eat(OP_SEMI, "expect a semicolon after declaration");
             }
-            return node;
         }
-        return nullptr;
-    };
-    parseTopLevelDecl = [&](Token&t)->AstNode* {
+        return node;
+    }
+    AstNode* parseImportDecl() {
+        AstImportDecl* node = nullptr;
+        if (t.type == KW_import) {
+            node = make<AstImportDecl>();
+            t = next(f);
+            parseGroup([&] { parseImportSpec(node); });
+        }
+        return node;
+    }
+    void parseImportSpec(AstImportDecl* node) {
+        Symbol alias = 0;
+        if (t.type == OP_DOT || t.type == TK_ID) {
+            alias = symbols.intern(t.lexeme);
+            t = next(f);
+        }
+        string_view importName = eat(LITERAL_STR, "import path should not empty").lexeme;
+        node->imports.emplace_back(symbols.intern(importName.substr(1, importName.length() - 2)), alias);
+    }
+    // Spec | "(" { Spec ";" } ")"
+    template <class ParseSpec>
+    void parseGroup(ParseSpec parseSpec) {
+        if (accept(OP_LPAREN)) {
+            while (t.type != OP_RPAREN) {
+                parseSpec();
+                if (t.type != OP_RPAREN) eat(OP_SEMI, "expect an explicit semicolon");
+            }
+            t = next(f);
+        }
+        else {
+            parseSpec();
+        }
+    }
+    AstNode* parseTopLevelDecl() {
         AstTopLevelDecl* node = nullptr;
         // TopLevelDecl  = Declaration | FunctionDecl | MethodDecl .
-        if (auto* tmp = parseDeclaration(t); tmp != nullptr) {
-            node = new AstTopLevelDecl;
+        if (auto* tmp = parseDeclaration(); tmp != nullptr) {
+            node = make<AstTopLevelDecl>();
             node->atld.decl = tmp;
         }
-        else if (auto* tmp = parseFunctionDecl(t); tmp != nullptr) {
-            node = new AstTopLevelDecl;
+        else if (auto* tmp = parseFunctionDecl(); tmp != nullptr) {
+            node = make<AstTopLevelDecl>();
             node->atld.functionDecl = tmp;
         }
         return node;
-    };
-    parseDeclaration = [&](Token&t)->AstNode* {
-        AstDeclaration * node = nullptr;
+    }
+    AstNode* parseDeclaration() {
+        AstDeclaration* node = nullptr;
         // Declaration   = ConstDecl | TypeDecl | VarDecl .
-        if (auto*tmp = parseConstDecl(t); tmp != nullptr) {
-            node = new AstDeclaration;
+        if (auto* tmp = parseConstDecl(); tmp != nullptr) {
+            node = make<AstDeclaration>();
             node->ad.constDecl = tmp;
         }
-        else  if (auto*tmp = parseTypeDecl(t); tmp != nullptr) {
-            node = new AstDeclaration;
+        else if (auto* tmp = parseTypeDecl(); tmp != nullptr) {
+            node = make<AstDeclaration>();
             node->ad.typeDecl = tmp;
         }
-        else  if (auto*tmp = parseVarDecl(t); tmp != nullptr) {
-            node = new AstDeclaration;
+        else if (auto* tmp = parseVarDecl(); tmp != nullptr) {
+            node = make<AstDeclaration>();
             node->ad.varDecl = tmp;
         }
         return node;
-    };
-    parseConstDecl = [&](Token&t)->AstNode* {
-        AstConstDecl * node = nullptr;
+    }
+    AstNode* parseConstDecl() {
+        AstConstDecl* node = nullptr;
         if (t.type == KW_const) {
-            node = new AstConstDecl;
+            node = make<AstConstDecl>();
             t = next(f);
-            if (t.type == OP_LPAREN) {
-                t = next(f);
-                do {
-                    node->identifierList.push_back(parseIdentifierList(t));
-                    if (auto*tmp = parseType(t); tmp != nullptr) {
-                        node->type.push_back(tmp);
-                    }
-                    else {
-                        node->type.push_back(nullptr);
-                    }
-                    if (t.type == OP_AGN) {
-                        t = next(f);
-                        node->expressionList.push_back(parseExpressionList(t));
-                    }
-                    else {
-                        node->expressionList.push_back(nullptr);
-                    }
-                    eat(OP_SEMI, "expect an explicit semicolon");
-                } while (t.type != OP_RPAREN);
-                eat(OP_RPAREN, "eat right parenthesis");
-            }
-            else {
-                node->identifierList.push_back(parseIdentifierList(t));
-                if (auto*tmp = parseType(t); tmp != nullptr) {
-                    node->type.push_back(tmp);
-                    t = next(f);
-                }
-                else {
-                    node->type.push_back(nullptr);
-                }
-                if (t.type == OP_AGN) {
-                    t = next(f);
-                    node->expressionList.push_back(parseExpressionList(t));
-                }
-                else {
-                    node->expressionList.push_back(nullptr);
-                }
-                if (t.type != OP_SEMI) {
-
-                    throw runtime_error("expect an explicit semicolon");
-                }
-            }
-            eat(OP_SEMI, "expect ;");
+            parseGroup([&] {
+                node->identifierList.push_back(must(parseIdentifierList(), "expect constant name"));
+                node->type.push_back(t.type != OP_AGN && t.type != OP_SEMI && t.type != OP_RPAREN ?
+                    must(parseType(), "expect type of constant") : nullptr);
+                node->expressionList.push_back(accept(OP_AGN) ?
+                    must(parseExpressionList(), "expect constant value") : nullptr);
+            });
         }
         return node;
-    };
-    parseType = [&](Token&t)->AstNode* {
-        AstType * node = nullptr;
-        if (auto*tmp = parseTypeName(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeName = tmp;
+    }
+    AstNode* parseTypeDecl() {
+        AstTypeDecl* node = nullptr;
+        if (t.type == KW_type) {
+            node = make<AstTypeDecl>();
+            t = next(f);
+            parseGroup([&] { node->typeSpec.push_back(parseTypeSpec()); });
         }
-        if (auto*tmp = parseArrayType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+    AstNode* parseTypeSpec() {
+        auto* node = make<AstTypeSpec>();
+        node->identifier = eat(TK_ID, "expect type name").symbol;
+        node->isAlias = accept(OP_AGN);
+        node->type = must(parseType(), "expect type in type declaration");
+        return node;
+    }
+    AstNode* parseVarDecl() {
+        AstVarDecl* node = nullptr;
+        if (t.type == KW_var) {
+            node = make<AstVarDecl>();
+            t = next(f);
+            parseGroup([&] { node->varSpec.push_back(parseVarSpec()); });
         }
-        else  if (auto*tmp = parseStructType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+    AstNode* parseVarSpec() {
+        auto* node = make<AstVarSpec>();
+        node->identifierList = must(parseIdentifierList(), "expect variable name");
+        if (accept(OP_AGN)) {
+            node->avs.expressionList = must(parseExpressionList(), "expect initial value");
         }
-        else  if (auto*tmp = parsePointerType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        else {
+            node->avs.named.type = must(parseType(), "expect type or = in var declaration");
+            if (accept(OP_AGN)) {
+                node->avs.named.expressionList = must(parseExpressionList(), "expect initial value");
+            }
         }
-        else  if (auto*tmp = parseFunctionType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+    AstNode* parseFunctionDecl() {
+        AstFunctionDecl* node = nullptr;
+        if (t.type == KW_func) {
+            node = make<AstFunctionDecl>();
+            t = next(f);
+            if (t.type == OP_LPAREN) {
+                node->receiver = parseParameter();
+            }
+            node->funcName = eat(TK_ID, "expect function name").symbol;
+            node->signature = must(parseSignature(), "expect parameters of function");
+            node->functionBody = lazy != nullptr ? skipBody() : parseBlock();
         }
-        else  if (auto*tmp = parseInterfaceType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+    AstNode* skipBody() {
+        AstLazyBlock* node = nullptr;
+        if (t.type == OP_LBRACE) {
+            node = make<AstLazyBlock>();
+            node->file = lazy;
+            node->begin = offset(t.lexeme.data());
+            node->line = t.line;
+            node->column = t.column;
+            if (!skipBlock(f)) throw runtime_error("brace {} must match in block");
+            node->end = offset(f.cur);
+            t = next(f);
         }
-        else  if (auto*tmp = parseSliceType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+    AstNode* parseIdentifierList() {
+        AstIdentifierList* node = nullptr;
+        if (t.type == TK_ID) {
+            node = make<AstIdentifierList>();
+            node->identifierList.push_back(t.symbol);
+            t = next(f);
+            while (accept(OP_COMMA)) {
+                node->identifierList.push_back(eat(TK_ID, "it shall be an identifier").symbol);
+            }
         }
-        else  if (auto*tmp = parseMapType(t); tmp != nullptr) {
-            node = new AstType;
-            node->at.typeLit = tmp;
+        return node;
+    }
+
+    //===------------------------------------------------------------------===//
+    // types
+    //===------------------------------------------------------------------===//
+    AstNode* parseType() {
+        AstType* node = nullptr;
+        if (auto* tmp = parseTypeName(); tmp != nullptr) {
+            node = make<AstType>();
+            node->at.typeName = tmp;
         }
-        else  if (auto*tmp = parseChannelType(t); tmp != nullptr) {
-            node = new AstType;
+        else if (auto* tmp = parseTypeLit(); tmp != nullptr) {
+            node = make<AstType>();
             node->at.typeLit = tmp;
         }
-        else  if (t.type == OP_LPAREN) {
-            t = next(f);
-            node = dynamic_cast<AstType*>(parseType(t));
-            expect(OP_RPAREN, "the parenthesis () must match in type declaration");
+        else if (accept(OP_LPAREN)) {
+            node = dynamic_cast<AstType*>(must(parseType(), "expect type in parentheses"));
+            eat(OP_RPAREN, "the parenthesis () must match in type declaration");
         }
         return node;
-    };
-    parseTypeName = [&](Token&t)->AstNode* {
-        AstTypeName * node = nullptr;
+    }
+    AstNode* parseTypeLit() {
+        switch (t.type) {
+        case OP_LBRACKET: return parseArrayOrSliceType(false);
+        case KW_struct: return parseStructType();
+        case OP_MUL: return parsePointerType();
+        case KW_func: return parseFunctionType();
+        case KW_interface: return parseInterfaceType();
+        case KW_map: return parseMapType();
+        case KW_chan: case OP_CHAN: return parseChannelType();
+        default: return nullptr;
+        }
+    }
+    AstNode* parseTypeName() {
+        AstTypeName* node = nullptr;
         if (t.type == TK_ID) {
-            node = new AstTypeName;
-            string typeName;
-            typeName += t.lexeme;
+            node = make<AstTypeName>();
+            node->typeName = t.symbol;
             t = next(f);
-            if (t.type == OP_DOT) {
-                t = next(f);
-                typeName.operator+=(".").operator+=(t.lexeme);
-                t = next(f);
+            if (accept(OP_DOT)) {
+                node->packageName = node->typeName;
+                node->typeName = eat(TK_ID, "expect type name after package").symbol;
             }
-            node->typeName = typeName;
-
         }
         return node;
-    };
-    parseArrayType = [&](Token&t)->AstNode* {
-        AstArrayType* node = nullptr;
-        if (t.type == OP_LBRACKET) {
-            node = new AstArrayType;
-            t = next(f);
-            if (t.type != OP_RBRACKET) {
-                node->length = parseExpression(t);
-                t = next(f);
-            }
-            else {
-                t = next(f);
-            }
-            node->elementType = parseType(t);
+    }
+    // The length of an array type may be "..." only in a composite literal, such
+    // an array type has no length.
+    AstNode* parseArrayOrSliceType(bool ellipsisOk) {
+        eat(OP_LBRACKET, "expect [");
+        if (accept(OP_RBRACKET)) {
+            auto* node = make<AstSliceType>();
+            node->elementType = must(parseType(), "expect element type of slice");
+            return node;
+        }
+        auto* node = make<AstArrayType>();
+        if (!ellipsisOk || !accept(OP_VARIADIC)) {
+            exprLev++;
+            node->length = must(parseExpression(), "expect array length");
+            exprLev--;
         }
+        eat(OP_RBRACKET, "bracket [] must match in array type declaration");
+        node->elementType = must(parseType(), "expect element type of array");
         return node;
-    };
-    parseStructType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseStructType() {
         AstStructType* node = nullptr;
         if (t.type == KW_struct) {
-            node = new  AstStructType;
-            expect(OP_LBRACE, "left brace { must exist in struct type declaration");
+            node = make<AstStructType>();
             t = next(f);
-            do {
-                AstStructType::_FieldDecl fd;
-                if (auto * tmp = parseIdentifierList(t); tmp != nullptr) {
-                    fd.named.identifierList = tmp;
-                    fd.named.type = parseType(t);
+            eat(OP_LBRACE, "left brace { must exist in struct type declaration");
+            while (t.type != OP_RBRACE) {
+                AstStructType::_FieldDecl fd{};
+                if (accept(OP_MUL)) {
+                    auto* baseType = make<AstType>();
+                    baseType->at.typeName = must(parseTypeName(), "expect embedded type name");
+                    auto* pointer = make<AstPointerType>();
+                    pointer->baseType = baseType;
+                    fd.typeName = pointer;
                 }
                 else {
-                    if (t.type == OP_MUL) {
-                        t = next(f);
+                    Token name = eat(TK_ID, "expect field name");
+                    if (t.type == OP_DOT || t.type == OP_SEMI || t.type == OP_RBRACE ||
+                        t.type == LITERAL_STR) {
+                        auto* typeName = make<AstTypeName>();
+                        typeName->typeName = name.symbol;
+                        if (accept(OP_DOT)) {
+                            typeName->packageName = typeName->typeName;
+                            typeName->typeName = eat(TK_ID, "expect type name after package").symbol;
+                        }
+                        fd.typeName = typeName;
+                    }
+                    else {
+                        auto* identifierList = make<AstIdentifierList>();
+                        identifierList->identifierList.push_back(name.symbol);
+                        while (accept(OP_COMMA)) {
+                            identifierList->identifierList.push_back(
+                                eat(TK_ID, "it shall be an identifier").symbol);
+                        }
+                        fd.named.identifierList = identifierList;
+                        fd.named.type = must(parseType(), "expect field type");
                     }
-                    fd.typeName = parseTypeName(t);
                 }
                 string tag;
                 if (t.type == LITERAL_STR) {
                     tag = t.lexeme;
-                }
-                node->fields.push_back(make_tuple(fd, tag));
-                if (t.type == OP_SEMI) {
                     t = next(f);
                 }
-            } while (t.type != OP_RBRACE);
-            eat(OP_RBRACE, "expect }");
-            eat(OP_SEMI, "expect ;");
+                node->fields.push_back(make_tuple(fd, tag));
+                if (t.type != OP_RBRACE) eat(OP_SEMI, "expect a semicolon after field");
+            }
+            t = next(f);
         }
         return node;
-    };
-    parsePointerType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parsePointerType() {
         AstPointerType* node = nullptr;
         if (t.type == OP_MUL) {
-            node = new AstPointerType;
+            node = make<AstPointerType>();
             t = next(f);
-            node->baseType = parseType(t);
+            node->baseType = must(parseType(), "expect base type of pointer");
         }
         return node;
-    };
-    parseFunctionType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseFunctionType() {
         AstFunctionType* node = nullptr;
         if (t.type == KW_func) {
-            node = new AstFunctionType;
+            node = make<AstFunctionType>();
             t = next(f);
-            node->signature = parseSignature(t);
+            node->signature = must(parseSignature(), "expect parameters of function type");
         }
         return node;
-    };
-    parseSignature = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseSignature() {
         AstSignature* node = nullptr;
         if (t.type == OP_LPAREN) {
-            node = new AstSignature;
-            node->parameters = parseParameter(t);
-            node->result = parseResult(t);
+            node = make<AstSignature>();
+            node->parameters = parseParameter();
+            node->result = parseResult();
         }
         return node;
-    };
-    parseParameter = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseParameter() {
         AstParameter* node = nullptr;
         if (t.type == OP_LPAREN) {
-            node = new AstParameter;
+            node = make<AstParameter>();
             t = next(f);
-            do {
-                if (auto * tmp = parseParameterDecl(t); tmp != nullptr) {
-                    node->parameterList.push_back(tmp);
-                }
-                if (t.type == OP_COMMA) {
-                    t = next(f);
-                }
-            } while (t.type != OP_RPAREN);
+            while (t.type != OP_RPAREN) {
+                node->parameterList.push_back(must(parseParameterDecl(), "expect parameter"));
+                if (t.type != OP_RPAREN) eat(OP_COMMA, "expect comma between parameters");
+            }
             t = next(f);
 
-            for (int i = 0, rewriteStart = 0; i < node->parameterList.size(); i++) {
-                if (dynamic_cast<AstParameterDecl*>(node->parameterList[i])->hasName == true) {
-                    for (int k = rewriteStart; k < i; k++) {
-                        string name = dynamic_cast<AstTypeName*>(
-                            dynamic_cast<AstType*>(dynamic_cast<AstParameterDecl*>(node->parameterList[k])->type)->at.typeName)->typeName;
-                        dynamic_cast<AstParameterDecl*>(node->parameterList[k])->type = dynamic_cast<AstParameterDecl*>(node->parameterList[i])->type;
-                        dynamic_cast<AstParameterDecl*>(node->parameterList[k])->name = name;
-                        dynamic_cast<AstParameterDecl*>(node->parameterList[k])->hasName = true; //It's not necessary
+            // in a, b int the names before a typed name are parsed as types first
+            for (size_t i = 0, rewriteStart = 0; i < node->parameterList.size(); i++) {
+                auto* named = dynamic_cast<AstParameterDecl*>(node->parameterList[i]);
+                if (named->hasName == true) {
+                    for (size_t k = rewriteStart; k < i; k++) {
+                        auto* decl = dynamic_cast<AstParameterDecl*>(node->parameterList[k]);
+                        decl->name = parameterName(decl->type);
+                        decl->type = named->type;
+                        decl->hasName = true;
                     }
                     rewriteStart = i + 1;
                 }
             }
         }
         return node;
-    };
-    parseParameterDecl = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseParameterDecl() {
         AstParameterDecl* node = nullptr;
         if (t.type == OP_VARIADIC) {
-            node = new AstParameterDecl;
+            node = make<AstParameterDecl>();
             node->isVariadic = true;
             t = next(f);
-            node->type = parseType(t);
+            node->type = must(parseType(), "expect type after ...");
         }
-        else if (t.type != OP_RPAREN) {
-            node = new AstParameterDecl;
-            auto*mayIdentOrType = parseType(t);
+        else if (auto* mayIdentOrType = parseType(); mayIdentOrType != nullptr) {
+            node = make<AstParameterDecl>();
             if (t.type != OP_COMMA && t.type != OP_RPAREN) {
                 node->hasName = true;
-                if (t.type == OP_VARIADIC) {
-                    node->isVariadic = true;
-                    t = next(f);
-                }
-                node->name = dynamic_cast<AstTypeName*>(dynamic_cast<AstType*>(mayIdentOrType)->at.typeName)->typeName;
-                node->type = parseType(t);
+                node->name = parameterName(mayIdentOrType);
+                node->isVariadic = accept(OP_VARIADIC);
+                node->type = must(parseType(), "expect parameter type");
             }
             else {
                 node->type = mayIdentOrType;
             }
         }
         return node;
-    };
-    parseResult = [&](Token&t)->AstNode* {
+    }
+    static Symbol parameterName(AstNode* type) {
+        auto* typeName = dynamic_cast<AstTypeName*>(dynamic_cast<AstType*>(type)->at.typeName);
+        if (typeName == nullptr || typeName->packageName != 0) {
+            throw runtime_error("mixed named and unnamed parameters");
+        }
+        return typeName->typeName;
+    }
+    AstNode* parseResult() {
         AstResult* node = nullptr;
-        if (auto*tmp = parseParameter(t); tmp != nullptr) {
-            node = new AstResult;
+        if (auto* tmp = parseParameter(); tmp != nullptr) {
+            node = make<AstResult>();
             node->ar.parameter = tmp;
         }
-        else  if (auto*tmp = parseType(t); tmp != nullptr) {
-            node = new AstResult;
+        else if (auto* tmp = parseType(); tmp != nullptr) {
+            node = make<AstResult>();
             node->ar.type = tmp;
         }
         return node;
-    };
-    parseInterfaceType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseInterfaceType() {
         AstInterfaceType* node = nullptr;
         if (t.type == KW_interface) {
-            node = new AstInterfaceType;
+            node = make<AstInterfaceType>();
             t = next(f);
-            if (t.type == OP_LBRACE) {
-                t = next(f);
-                do {
-                    if (auto*tmp = parseMethodSpec(t); tmp != nullptr) {
-                        node->methodSpec.push_back(tmp);
-                        if (t.type == OP_SEMI) {
-                            t = next(f);
-                        }
-                    }
-                } while (t.type != OP_RBRACE);
-                t = next(f);
+            eat(OP_LBRACE, "left brace { must exist in interface type declaration");
+            while (t.type != OP_RBRACE) {
+                node->methodSpec.push_back(must(parseMethodSpec(), "expect method or interface name"));
+                if (t.type != OP_RBRACE) eat(OP_SEMI, "expect a semicolon after method");
             }
+            t = next(f);
         }
-
         return node;
-    };
-    parseMethodSpec = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseMethodSpec() {
         AstMethodSpec* node = nullptr;
-        if (auto*tmp = parseMethodName(t); tmp != nullptr) {
-            node = new AstMethodSpec;
-            node->ams.named.methodName = tmp;
-            node->ams.named.signature = parseSignature(t);
-        }
-        else  if (auto*tmp = parseTypeName(t); tmp != nullptr) {
-            node = new AstMethodSpec;
-            node->ams.interfaceTypeName = tmp;
-        }
-        return node;
-    };
-    parseMethodName = [&](Token&t)->AstNode* {
-        AstMethodName* node = nullptr;
         if (t.type == TK_ID) {
-            node = new AstMethodName;
-            node->methodName = t.lexeme;
+            node = make<AstMethodSpec>();
+            Token name = t;
             t = next(f);
+            if (t.type == OP_LPAREN) {
+                auto* methodName = make<AstMethodName>();
+                methodName->methodName = name.symbol;
+                node->ams.named.methodName = methodName;
+                node->ams.named.signature = parseSignature();
+            }
+            else {
+                auto* typeName = make<AstTypeName>();
+                typeName->typeName = name.symbol;
+                if (accept(OP_DOT)) {
+                    typeName->packageName = typeName->typeName;
+                    typeName->typeName = eat(TK_ID, "expect type name after package").symbol;
+                }
+                node->ams.interfaceTypeName = typeName;
+            }
         }
         return node;
-    };
-    parseSliceType = [&](Token&t)->AstNode* {
-        AstSliceType* node = nullptr;
-        if (t.type == OP_LBRACKET) {
-            node = new AstSliceType;
-            expect(OP_RBRACKET, "bracket [] must match in slice type declaration");
-            node->elementType = parseType(t);
-        }
-        return node;
-    };
-    parseMapType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseMapType() {
         AstMapType* node = nullptr;
         if (t.type == KW_map) {
-            node = new AstMapType;
+            node = make<AstMapType>();
             t = next(f);
             eat(OP_LBRACKET, "bracket [] must match in map type declaration");
-            node->keyType = parseType(t);
+            node->keyType = must(parseType(), "expect key type of map");
             eat(OP_RBRACKET, "bracket [] must match in map type declaration");
-            node->elementType = parseType(t);
+            node->elementType = must(parseType(), "expect element type of map");
         }
         return node;
-    };
-    parseChannelType = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseChannelType() {
         AstChannelType* node = nullptr;
         if (t.type == KW_chan) {
-            node = new AstChannelType;
+            node = make<AstChannelType>();
             t = next(f);
-            if (t.type == OP_CHAN) {
-                t = next(f);
-                node->elementType = parseType(t);
-            }
-            else {
-                node->elementType = parseType(t);
-            }
+            node->sendOnly = accept(OP_CHAN);
+            node->elementType = must(parseType(), "expect element type of channel");
         }
         else if (t.type == OP_CHAN) {
-            node = new AstChannelType;
-            t = next(f);
-            if (t.type == KW_chan) {
-                node->elementType = parseType(t);
-            }
-        }
-        return node;
-    };
-    parseTypeDecl = [&](Token&t)->AstNode* {
-        AstTypeDecl* node = nullptr;
-        if (t.type == KW_type) {
-            node = new AstTypeDecl;
+            node = make<AstChannelType>();
             t = next(f);
-            if (t.type == OP_LPAREN) {
-                t = next(f);
-                do {
-                    node->typeSpec.push_back(parseTypeSpec(t));
-                    if (t.type == OP_SEMI) {
-                        t = next(f);
-                    }
-                } while (t.type != OP_RPAREN);
-            }
-            else {
-                node->typeSpec.push_back(parseTypeSpec(t));
-            }
+            eat(KW_chan, "expect chan after <-");
+            node->recvOnly = true;
+            node->elementType = must(parseType(), "expect element type of channel");
         }
         return node;
-    };
-    parseTypeSpec = [&](Token&t)->AstNode* {
-        AstTypeSpec* node = nullptr;
-        if (t.type == TK_ID) {
-            node = new AstTypeSpec;
-            node->identifier = t.lexeme;
+    }
+
+    //===------------------------------------------------------------------===//
+    // statements
+    //===------------------------------------------------------------------===//
+    AstNode* parseBlock() {
+        AstBlock* node = nullptr;
+        if (t.type == OP_LBRACE) {
+            node = make<AstBlock>();
             t = next(f);
-            if (t.type == OP_AGN) {
-                t = next(f);
-            }
-            node->type = parseType(t);
+            node->statementList = parseStatementList();
+            eat(OP_RBRACE, "brace {} must match in block");
         }
         return node;
-    };
-    parseVarDecl = [&](Token&t)->AstNode* {
-        AstVarDecl* node = nullptr;
-        if (t.type == KW_var) {
-            node = new AstVarDecl;
-            t = next(f);
-            if (t.type == OP_LPAREN) {
-                do {
-                    node->varSpec.push_back(parseVarSpec(t));
-                    expect(OP_SEMI, "expect a semicolon after each var specification");
-                } while (t.type != OP_RPAREN);
+    }
+    AstNode* parseStatementList() {
+        auto* node = make<AstStatementList>();
+        while (t.type != OP_RBRACE && t.type != KW_case && t.type != KW_default &&
+            t.type != TK_EOF) {
+            size_t slot = openElement(node->statements, EK_STATEMENT);
+            if (auto* tmp = parseStatement(); tmp != nullptr) {
+                node->statements.push_back(tmp);
+                closeElement(slot);
             }
             else {
-                node->varSpec.push_back(parseVarSpec(t));
-            }
-        }
-        return node;
-    };
-    parseVarSpec = [&](Token&t)->AstNode* {
-        AstVarSpec* node = nullptr;
-        if (auto*tmp = parseIdentifierList(t); tmp != nullptr) {
-            node = new AstVarSpec;
-            node->identifierList = tmp;
-            if (auto * tmp1 = parseType(t); tmp1 != nullptr) {
-                node->avs.named.type = tmp1;
-                t = next(f);
-                if (t.type == OP_AGN) {
-                    t = next(f);
-                    node->avs.named.expressionList = parseExpressionList(t);
-                }
+                dropElement();
             }
-            else if (t.type == OP_AGN) {
-                t = next(f);
-                node->avs.expressionList = parseExpressionList(t);
+            if (t.type != OP_RBRACE && t.type != KW_case && t.type != KW_default) {
+                eat(OP_SEMI, "statement should seperate by semicolon");
             }
         }
         return node;
-    };
-    parseFunctionDecl = [&](Token&t)->AstNode* {
-        AstFunctionDecl * node = nullptr;
-        if (t.type == KW_func) {
-            node = new AstFunctionDecl;
-            t = next(f);
-            if (t.type == OP_LPAREN) {
-                node->receiver = parseParameter(t);
-            }
-            node->funcName = t.lexeme;
-            t = next(f);
-            node->signature = parseSignature(t);
-            node->functionBody = parseBlock(t);
-        }
-        return node;
-    };
-    parseBlock = [&](Token&t)->AstNode* {
-        AstBlock * node = nullptr;
-        if (t.type == OP_LBRACE) {
-            node = new AstBlock;
-            t = next(f);
-            if (t.type != OP_RBRACE) {
-                node->statementList = parseStatementList(t);
-            }
-            else {
-                t = next(f);
-            }
-        }
-        return node;
-    };
-    parseStatementList = [&](Token&t)->AstNode* {
-        AstStatementList * node = nullptr;
-        if (auto * tmp = parseStatement(t); tmp != nullptr) {
-            node = new AstStatementList;
-            node->statements.push_back(tmp);
-            if (t.type == OP_SEMI) {
-                t = next(f);
-            }
-            while ((tmp = parseStatement(t))) {
-                node->statements.push_back(tmp);
-                expect(OP_SEMI, "statement should seperate by semicolon");
-            }
-        }
-        return node;
-    };
-    parseStatement = [&](Token&t)->AstNode* {
-        AstStatement * node = nullptr;
-        if (auto*tmp = parseDeclaration(t); tmp != nullptr) {
-            node = new AstStatement;
+    }
+    AstNode* parseStatement() {
+        AstStatement* node = nullptr;
+        if (auto* tmp = parseDeclaration(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.declaration = tmp;
         }
-        else  if (auto*tmp = parseSimpleStmt(t); tmp != nullptr) {
-            node = new AstStatement;
-            node->as.simpleStmt = tmp;
-        }
-        else  if (auto*tmp = parseLabeledStmt(t); tmp != nullptr) {
-            node = new AstStatement;
-            node->as.labeledStmt = tmp;
-        }
-        else  if (auto*tmp = parseGoStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseGoStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.goStmt = tmp;
         }
-        else  if (auto*tmp = parseReturnStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseReturnStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.returnStmt = tmp;
         }
-        else  if (auto*tmp = parseBreakStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseBreakStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.breakStmt = tmp;
         }
-        else  if (auto*tmp = parseContinueStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseContinueStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.continueStmt = tmp;
         }
-        else  if (auto*tmp = parseGotoStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseGotoStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.gotoStmt = tmp;
         }
-        else  if (auto*tmp = parseFallthroughStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseFallthroughStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.fallthroughStmt = tmp;
         }
-        else  if (auto*tmp = parseBlock(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseBlock(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.block = tmp;
         }
-        else  if (auto*tmp = parseIfStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseIfStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.ifStmt = tmp;
         }
-        else  if (auto*tmp = parseSwitchStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseSwitchStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.switchStmt = tmp;
         }
-        else  if (auto*tmp = parseSelectStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseSelectStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.selectStmt = tmp;
         }
-        else  if (auto*tmp = parseForStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseForStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.forStmt = tmp;
         }
-        else  if (auto*tmp = parseDeferStmt(t); tmp != nullptr) {
-            node = new AstStatement;
+        else if (auto* tmp = parseDeferStmt(); tmp != nullptr) {
+            node = make<AstStatement>();
             node->as.deferStmt = tmp;
         }
-        return node;
-    };
-    parseLabeledStmt = [&](Token&t)->AstNode* {
-        AstLabeledStmt * node = nullptr;
-        if (t.type == TK_ID) {
-            node = new AstLabeledStmt;
-            node->identifier = t.lexeme;
-            expect(OP_COLON, "label statement should have a colon");
-            node->statement = parseStatement(t);
+        else if (auto* tmp = parseSimpleStmt(true, false); tmp != nullptr) {
+            node = make<AstStatement>();
+            node->as.simpleStmt = tmp;
         }
         return node;
-    };
-    parseSimpleStmt = [&](Token&t)->AstNode* {
-        AstSimpleStmt * node = nullptr;
-        if (auto* tmp = parseExpressionStmt(t); tmp != nullptr) {
-            node = new AstSimpleStmt;
-            node->ass.expressionStmt = tmp;
+    }
+    // SimpleStmt, which is only known once the expression list it starts with
+    // has been parsed. It is an AstLabeledStmt when labelOk and an
+    // AstRangeClause when rangeOk allow these.
+    AstNode* parseSimpleStmt(bool labelOk = false, bool rangeOk = false) {
+        if (rangeOk && accept(KW_range)) {
+            auto* node = make<AstRangeClause>();
+            node->expression = must(parseExpression(), "expect expression after range");
+            return node;
+        }
+        Token start = t;
+        auto* lhs = parseExpressionList();
+        if (lhs == nullptr) return nullptr;
+        auto* node = make<AstSimpleStmt>(start);
+        switch (t.type) {
+        case OP_SHORTAGN: case OP_AGN: case OP_ADDAGN: case OP_SUBAGN: case OP_MULAGN:
+        case OP_DIVAGN: case OP_MODAGN: case OP_BITANDAGN: case OP_BITORAGN: case OP_BITXORAGN:
+        case OP_LSFTAGN: case OP_RSFTAGN: case OP_ANDXORAGN: {
+            TokenType op = t.type;
+            t = next(f);
+            if (rangeOk && (op == OP_SHORTAGN || op == OP_AGN) && accept(KW_range)) {
+                auto* range = make<AstRangeClause>(start);
+                if (op == OP_SHORTAGN) {
+                    range->arc.identifierList = identifiersOf(lhs);
+                }
+                else {
+                    range->arc.expressionList = lhs;
+                }
+                range->expression = must(parseExpression(), "expect expression after range");
+                return range;
+            }
+            auto* rhs = must(parseExpressionList(), "expect expression on the right side");
+            if (op == OP_SHORTAGN) {
+                auto* shortVarDecl = make<AstShortVarDecl>(start);
+                shortVarDecl->lhs = identifiersOf(lhs);
+                shortVarDecl->rhs = rhs;
+                node->ass.shortVarDecl = shortVarDecl;
+            }
+            else {
+                auto* assignment = make<AstAssignment>(start);
+                assignment->lhs = lhs;
+                assignment->rhs = rhs;
+                assignment->assignOp = op;
+                node->ass.assignment = assignment;
+            }
+            return node;
         }
-        else if (auto* tmp = parseSendStmt(t); tmp != nullptr) {
-            node = new AstSimpleStmt;
-            node->ass.sendStmt = tmp;
+        default:
+            break;
         }
-        else if (auto* tmp = parseIncDecStmt(t); tmp != nullptr) {
-            node = new AstSimpleStmt;
-            node->ass.incDecStmt = tmp;
+        if (lhs->expressionList.size() > 1) throw runtime_error("expect := or = after expression list");
+        auto* expression = lhs->expressionList[0];
+        if (t.type == OP_COLON && labelOk) {
+            if (Symbol name = nameOf(expression); name != 0) {
+                auto* labeledStmt = make<AstLabeledStmt>(start);
+                labeledStmt->identifier = name;
+                t = next(f);
+                labeledStmt->statement = parseStatement();
+                return labeledStmt;
+            }
         }
-        else if (auto* tmp = parseAssignment(t); tmp != nullptr) {
-            node = new AstSimpleStmt;
-            node->ass.assignment = tmp;
+        else if (accept(OP_CHAN)) {
+            auto* sendStmt = make<AstSendStmt>(start);
+            sendStmt->receiver = expression;
+            sendStmt->sender = must(parseExpression(), "expect value to send");
+            node->ass.sendStmt = sendStmt;
+            return node;
         }
-        else if (auto* tmp = parseShortVarDecl(t); tmp != nullptr) {
-            node = new AstSimpleStmt;
-            node->ass.shortVarDecl = tmp;
+        else if (t.type == OP_INC || t.type == OP_DEC) {
+            auto* incDecStmt = make<AstIncDecStmt>(start);
+            incDecStmt->expression = expression;
+            incDecStmt->isInc = t.type == OP_INC;
+            t = next(f);
+            node->ass.incDecStmt = incDecStmt;
+            return node;
         }
+        auto* expressionStmt = make<AstExpressionStmt>(start);
+        expressionStmt->expression = expression;
+        node->ass.expressionStmt = expressionStmt;
         return node;
-    };
-    parseGoStmt = [&](Token&t)->AstNode* {
-        AstGoStmt * node = nullptr;
+    }
+    AstNode* parseGoStmt() {
+        AstGoStmt* node = nullptr;
         if (t.type == KW_go) {
-            node = new AstGoStmt;
-            node->expression = parseExpression(t);
+            node = make<AstGoStmt>();
+            t = next(f);
+            node->expression = must(parseExpression(), "expect function call after go");
         }
         return node;
-    };
-    parseReturnStmt = [&](Token&t)->AstNode* {
-        AstReturnStmt * node = nullptr;
+    }
+    AstNode* parseReturnStmt() {
+        AstReturnStmt* node = nullptr;
         if (t.type == KW_return) {
-            node = new AstReturnStmt;
-            node->expressionList = parseExpressionList(t);
+            node = make<AstReturnStmt>();
+            t = next(f);
+            if (t.type != OP_SEMI && t.type != OP_RBRACE) {
+                node->expressionList = must(parseExpressionList(), "expect return value");
+            }
         }
         return node;
-    };
-    parseBreakStmt = [&](Token&t)->AstNode* {
-        AstBreakStmt * node = nullptr;
+    }
+    AstNode* parseBreakStmt() {
+        AstBreakStmt* node = nullptr;
         if (t.type == KW_break) {
-            node = new AstBreakStmt;
+            node = make<AstBreakStmt>();
             t = next(f);
             if (t.type == TK_ID) {
-                node->label = t.lexeme;
-            }
-            else {
-                node->label = nullptr;
+                node->label = t.symbol;
+                t = next(f);
             }
         }
         return node;
-    };
-    parseContinueStmt = [&](Token&t)->AstNode* {
-        AstContinueStmt * node = nullptr;
+    }
+    AstNode* parseContinueStmt() {
+        AstContinueStmt* node = nullptr;
         if (t.type == KW_continue) {
-            node = new AstContinueStmt;
+            node = make<AstContinueStmt>();
             t = next(f);
             if (t.type == TK_ID) {
-                node->label = t.lexeme;
-            }
-            else {
-                node->label = nullptr;
+                node->label = t.symbol;
+                t = next(f);
             }
         }
         return node;
-    };
-    parseGotoStmt = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseGotoStmt() {
         AstGotoStmt* node = nullptr;
         if (t.type == KW_goto) {
-            node = new AstGotoStmt;
-            node->label = expect(TK_ID, "goto statement must follow a label").lexeme;
+            node = make<AstGotoStmt>();
+            t = next(f);
+            node->label = eat(TK_ID, "goto statement must follow a label").symbol;
         }
         return node;
-    };
-    parseFallthroughStmt = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseFallthroughStmt() {
         AstFallthroughStmt* node = nullptr;
         if (t.type == KW_fallthrough) {
-            node = new AstFallthroughStmt;
+            node = make<AstFallthroughStmt>();
+            t = next(f);
         }
         return node;
-    };
-    parseIfStmt = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseIfStmt() {
         AstIfStmt* node = nullptr;
-        if (t.type == KW_fallthrough) {
-            node = new AstIfStmt;
-            if (auto* tmp = parseSimpleStmt(t); tmp != nullptr) {
-                node->condition = tmp;
-                expect(OP_SEMI, "expect an semicolon in condition part of if");
-            }
-            t = next(f);
-            node->expression = parseExpression(t);
+        if (t.type == KW_if) {
+            node = make<AstIfStmt>();
             t = next(f);
-            node->block = parseBlock(t);
-            t = next(f);
-            if (t.type == KW_else) {
-                t = next(f);
-                if (auto *tmp1 = parseIfStmt(t); tmp1 != nullptr) {
+            int outerLev = exprLev;
+            exprLev = -1;
+            AstNode* condition = t.type != OP_SEMI ? parseSimpleStmt() : nullptr;
+            if (accept(OP_SEMI)) {
+                node->condition = condition;
+                condition = parseSimpleStmt();
+            }
+            node->expression = must(expressionOf(condition), "expect condition of if statement");
+            exprLev = outerLev;
+            node->block = must(parseBlock(), "expect block of if statement");
+            if (accept(KW_else)) {
+                if (auto* tmp1 = parseIfStmt(); tmp1 != nullptr) {
                     node->ais.ifStmt = tmp1;
                 }
-                else if (auto *tmp1 = parseBlock(t); tmp1 != nullptr) {
+                else if (auto* tmp1 = parseBlock(); tmp1 != nullptr) {
                     node->ais.block = tmp1;
                 }
                 else {
@@ -1678,633 +2493,17788 @@ const AstNode* parse(const string & filename) {
             }
         }
         return node;
-    };
-    parseSwitchStmt = [&](Token&t)->AstNode* {
+    }
+    // A type switch keeps its guard x := y.(type) or y.(type) as the simple
+    // statement it was parsed as.
+    AstNode* parseSwitchStmt() {
         AstSwitchStmt* node = nullptr;
         if (t.type == KW_switch) {
-            node = new AstSwitchStmt;
-            if (auto*tmp = parseSimpleStmt(t); tmp != nullptr) {
-                node->condition = tmp;
-                expect(OP_SEMI, "expect semicolon in switch condition");
-                if (auto*tmp1 = parseExpression(t); tmp1 != nullptr) {
-                    node->conditionExpr = tmp1;
-                    t = next(f);
+            node = make<AstSwitchStmt>();
+            t = next(f);
+            int outerLev = exprLev;
+            exprLev = -1;
+            AstNode* tag = nullptr;
+            if (t.type != OP_LBRACE) {
+                tag = t.type != OP_SEMI ? parseSimpleStmt() : nullptr;
+                if (accept(OP_SEMI)) {
+                    node->condition = tag;
+                    tag = t.type != OP_LBRACE ? parseSimpleStmt() : nullptr;
                 }
             }
-            expect(OP_LBRACE, "expect left brace around case clauses");
-            do {
-                if (auto*tmp = parseExprCaseClause(t); tmp != nullptr) {
-                    node->exprCaseClause.push_back(tmp);
-                }
-                t = next(f);
-            } while (t.type != OP_RBRACE);
+            exprLev = outerLev;
+            if (tag != nullptr) {
+                node->isTypeSwitch = isTypeSwitchGuard(tag);
+                node->conditionExpr = node->isTypeSwitch ? tag :
+                    must(expressionOf(tag), "expect expression in switch statement");
+            }
+            eat(OP_LBRACE, "expect left brace around case clauses");
+            while (t.type != OP_RBRACE) {
+                size_t slot = openElement(node->exprCaseClause, EK_CASE_CLAUSE);
+                node->exprCaseClause.push_back(must(parseExprCaseClause(), "expect case or default"));
+                closeElement(slot);
+            }
+            t = next(f);
         }
         return node;
-    };
-    parseExprCaseClause = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseExprCaseClause() {
         AstExprCaseClause* node = nullptr;
-        if (auto*tmp = parseExprSwitchCase(t); tmp != nullptr) {
-            node = new AstExprCaseClause;
+        if (auto* tmp = parseExprSwitchCase(); tmp != nullptr) {
+            node = make<AstExprCaseClause>();
             node->exprSwitchCase = tmp;
-            expect(OP_COLON, "expect colon in case clause of switch");
-            node->statementList = parseStatementList(t);
+            eat(OP_COLON, "expect colon in case clause of switch");
+            node->statementList = parseStatementList();
         }
         return node;
-    };
-    parseExprSwitchCase = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseExprSwitchCase() {
         AstExprSwitchCase* node = nullptr;
         if (t.type == KW_case) {
-            node = new AstExprSwitchCase;
+            node = make<AstExprSwitchCase>();
+            t = next(f);
+            node->expressionList = must(parseExpressionList(), "expect expression after case");
+        }
+        else if (t.type == KW_default) {
+            node = make<AstExprSwitchCase>();
+            node->isDefault = true;
             t = next(f);
-            if (auto*tmp = parseExpressionList(t); tmp != nullptr) {
-                node->expressionList = tmp;
-            }
-            else if (t.type == KW_default) {
-                node->isDefault = true;
-            }
         }
         return node;
-    };
-    parseSelectStmt = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseSelectStmt() {
         AstSelectStmt* node = nullptr;
         if (t.type == KW_select) {
-            node = new AstSelectStmt;
-            expect(OP_LBRACE, "expect left brace in select statement");
-            do {
-                if (auto*tmp = parseCommClause(t); tmp != nullptr) {
-                    node->commClause.push_back(tmp);
-                }
-                t = next(f);
-            } while (t.type != OP_RBRACE);
+            node = make<AstSelectStmt>();
+            t = next(f);
+            eat(OP_LBRACE, "expect left brace in select statement");
+            while (t.type != OP_RBRACE) {
+                size_t slot = openElement(node->commClause, EK_COMM_CLAUSE);
+                node->commClause.push_back(must(parseCommClause(), "expect case or default"));
+                closeElement(slot);
+            }
+            t = next(f);
         }
         return node;
-    };
-    parseCommClause = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseCommClause() {
         AstCommClause* node = nullptr;
-        if (auto*tmp = parseCommCase(t); tmp != nullptr) {
-            node = new AstCommClause;
+        if (auto* tmp = parseCommCase(); tmp != nullptr) {
+            node = make<AstCommClause>();
             node->commCase = tmp;
-            expect(OP_COLON, "expect colon in select case clause");
-            node->statementList = parseStatementList(t);
+            eat(OP_COLON, "expect colon in select case clause");
+            node->statementList = parseStatementList();
         }
         return node;
-    };
-    parseCommCase = [&](Token&t)->AstNode* {
-        AstCommCase*node = nullptr;
-        if (t.type == KW_case) {
-            node = new AstCommCase;
+    }
+    AstNode* parseCommCase() {
+        AstCommCase* node = nullptr;
+        if (t.type == KW_default) {
+            node = make<AstCommCase>();
+            node->isDefault = true;
             t = next(f);
-            if (auto*tmp = parseSendStmt(t); tmp != nullptr) {
-                node->acc.sendStmt = tmp;
-            }
-            else if (auto*tmp = parseRecvStmt(t); tmp != nullptr) {
-                node->acc.recvStmt = tmp;
-            }
-            else if (t.type == KW_default) {
-                node->isDefault = true;
-            }
-        }
-        return node;
-    };
-    parseRecvStmt = [&](Token&t)->AstNode* {
-        AstRecvStmt*node = nullptr;
-        if (auto*tmp = parseExpressionList(t); tmp != nullptr) {
-            node = new AstRecvStmt;
-            node->ars.expressionList = tmp;
-            expect(OP_EQ, "expect =");
-            node->recvExpr = parseExpression(t);
         }
-        else if (auto*tmp = parseIdentifierList(t); tmp != nullptr) {
-            node = new AstRecvStmt;
-            node->ars.identifierList = tmp;
-            expect(OP_SHORTAGN, "expect :=");
-            node->recvExpr = parseExpression(t);
-        }
-        return node;
-    };
-    parseForStmt = [&](Token&t)->AstNode* {
-        AstForStmt* node = nullptr;
-        if (t.type == KW_for) {
-            node = new AstForStmt;
+        else if (t.type == KW_case) {
+            node = make<AstCommCase>();
             t = next(f);
-            if (auto*tmp = parseExpression(t); tmp != nullptr) {
-                node->afs.condition = tmp;
-            }
-            else if (auto*tmp = parseForClause(t); tmp != nullptr) {
-                node->afs.forClause = tmp;
+            auto* lhs = must(parseExpressionList(), "expect send or receive in select case");
+            if (accept(OP_CHAN)) {
+                auto* sendStmt = make<AstSendStmt>();
+                sendStmt->receiver = lhs->expressionList[0];
+                sendStmt->sender = must(parseExpression(), "expect value to send");
+                node->acc.sendStmt = sendStmt;
             }
-            else if (auto*tmp = parseRangeClause(t); tmp != nullptr) {
-                node->afs.rangeClause = tmp;
+            else {
+                auto* recvStmt = make<AstRecvStmt>();
+                if (t.type == OP_SHORTAGN || t.type == OP_AGN) {
+                    if (t.type == OP_SHORTAGN) {
+                        recvStmt->ars.identifierList = identifiersOf(lhs);
+                    }
+                    else {
+                        recvStmt->ars.expressionList = lhs;
+                    }
+                    t = next(f);
+                    recvStmt->recvExpr = must(parseExpression(), "expect receive expression");
+                }
+                else {
+                    recvStmt->recvExpr = lhs->expressionList[0];
+                }
+                node->acc.recvStmt = recvStmt;
             }
-            t = next(f);
-            node->block = parseBlock(t);
-        }
-        return node;
-    };
-    parseForClause = [&](Token&t)->AstNode* {
-        AstForClause * node = nullptr;
-        if (auto*tmp = parseSimpleStmt(t); tmp != nullptr) {
-            node = new AstForClause;
-            node->initStmt = tmp;
-            expect(OP_SEMI, "expect semicolon in for clause");
-            node->condition = parseExpression(t);
-            expect(OP_SEMI, "expect semicolon in for clause");
-            node->postStmt = parseSimpleStmt(t);
         }
         return node;
-    };
-    parseRangeClause = [&](Token&t)->AstNode* {
-        AstRangeClause*node = nullptr;
-        if (auto*tmp = parseExpressionList(t); tmp != nullptr) {
-            node = new AstRangeClause;
-            node->arc.expressionList = tmp;
-            expect(OP_EQ, "expect =");
-            t = next(f);
-        }
-        else if (auto* tmp = parseIdentifierList(t); tmp != nullptr) {
-            node = new AstRangeClause;
-            node->arc.identifierList = tmp;
-            expect(OP_SHORTAGN, "expect :=");
+    }
+    AstNode* parseForStmt() {
+        AstForStmt* node = nullptr;
+        if (t.type == KW_for) {
+            node = make<AstForStmt>();
             t = next(f);
-        }
-        if (t.type == KW_range) {
-            if (node == nullptr) {
-                node = new AstRangeClause;
+            int outerLev = exprLev;
+            exprLev = -1;
+            if (t.type != OP_LBRACE) {
+                AstNode* init = t.type != OP_SEMI ? parseSimpleStmt(false, true) : nullptr;
+                if (auto* range = dynamic_cast<AstRangeClause*>(init); range != nullptr) {
+                    node->afs.rangeClause = range;
+                }
+                else if (accept(OP_SEMI)) {
+                    auto* forClause = make<AstForClause>();
+                    forClause->initStmt = init;
+                    if (t.type != OP_SEMI) {
+                        forClause->condition = must(parseExpression(), "expect condition of for");
+                    }
+                    eat(OP_SEMI, "expect semicolon in for clause");
+                    if (t.type != OP_LBRACE) forClause->postStmt = parseSimpleStmt();
+                    node->afs.forClause = forClause;
+                }
+                else {
+                    node->afs.condition = must(expressionOf(init), "expect condition of for");
+                }
             }
-            t = next(f);
-            node->expression = parseExpression(t);
+            exprLev = outerLev;
+            node->block = must(parseBlock(), "expect block of for statement");
         }
         return node;
-    };
-    parseDeferStmt = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseDeferStmt() {
         AstDeferStmt* node = nullptr;
         if (t.type == KW_defer) {
-            node = new AstDeferStmt;
-            node->expression = parseExpression(t);
-        }
-        return node;
-    };
-    // simple statement
-    //parseEmptyStmt | = [&](Token&t)->AstNode* {
-    //    AstEmptyStmt* node = nullptr;
-    //    return node;
-    //};
-    parseExpressionStmt = [&](Token&t)->AstNode* {
-        AstExpressionStmt* node = nullptr;
-        if (auto*tmp = parseExpression(t); tmp != nullptr) {
-            node = new AstExpressionStmt;
-            node->expression = tmp;
-        }
-        return node;
-    };
-    parseSendStmt = [&](Token&t)->AstNode* {
-        AstSendStmt* node = nullptr;
-        if (auto*tmp = parseExpression(t); tmp != nullptr) {
-            node = new AstSendStmt;
-            node->receiver = tmp;
-            expect(OP_CHAN, "expect a channel symbol");
-            node->sender = parseExpression(t);
-        }
-        return node;
-    };
-    parseIncDecStmt = [&](Token&t)->AstNode* {
-        AstIncDecStmt* node = nullptr;
-        if (auto*tmp = parseExpression(t); tmp != nullptr) {
-            node = new AstIncDecStmt;
-            node->expression = tmp;
+            node = make<AstDeferStmt>();
             t = next(f);
-            if (t.type == OP_INC) {
-                node->isInc = true;
-            }
-            else if (t.type == OP_DEC) {
-                node->isInc = false;
-            }
-            else {
-                throw runtime_error("expect ++/--");
-            }
+            node->expression = must(parseExpression(), "expect function call after defer");
         }
         return node;
-    };
-    parseAssignment = [&](Token&t)->AstNode* {
-        AstAssignment* node = nullptr;
-        if (auto*tmp = parseExpressionList(t); tmp != nullptr) {
-            node = new AstAssignment;
-            node->lhs = tmp;
-            t = next(f);
-            if (t.type == OP_ADD || t.type == OP_SUB ||
-                t.type == OP_BITOR || t.type == OP_XOR ||
-                t.type == OP_MUL || t.type == OP_DIV ||
-                t.type == OP_MOD || t.type == OP_LSHIFT ||
-                t.type == OP_RSHIFT || t.type == OP_BITAND ||
-                t.type == OP_ANDXOR) {
-                node->assignOp = t.type;
-            }
-            expect(OP_EQ, "expect =");
-            node->rhs = parseExpressionList(t);
+    }
+    // The expression of an expression statement, nullptr for other statements.
+    static AstNode* expressionOf(AstNode* simpleStmt) {
+        auto* stmt = dynamic_cast<AstSimpleStmt*>(simpleStmt);
+        if (stmt == nullptr) return nullptr;
+        auto* expressionStmt = dynamic_cast<AstExpressionStmt*>(stmt->ass.expressionStmt);
+        return expressionStmt == nullptr ? nullptr : expressionStmt->expression;
+    }
+    // The identifier an expression consists of, nullptr if it is anything else.
+    static Symbol nameOf(AstNode* expression) {
+        auto* e = dynamic_cast<AstExpression*>(expression);
+        if (e == nullptr || e->ae.named.rhs != nullptr) return 0;
+        auto* u = dynamic_cast<AstUnaryExpr*>(e->ae.unaryExpr);
+        auto* p = u == nullptr ? nullptr : dynamic_cast<AstPrimaryExpr*>(u->aue.primaryExpr);
+        auto* o = p == nullptr ? nullptr : dynamic_cast<AstOperand*>(p->ape.operand);
+        auto* n = o == nullptr ? nullptr : dynamic_cast<AstOperandName*>(o->ao.operandName);
+        return n == nullptr ? 0 : n->operandName;
+    }
+    AstNode* identifiersOf(AstExpressionList* list) {
+        auto* node = make<AstIdentifierList>();
+        for (auto* expression : list->expressionList) {
+            Symbol name = nameOf(expression);
+            if (name == 0) throw runtime_error("non-name on left side of :=");
+            node->identifierList.push_back(name);
         }
         return node;
-    };
-    parseShortVarDecl = [&](Token&t)->AstNode* {
-        AstShortVarDecl* node = nullptr;
-        if (auto*tmp = parseIdentifierList(t); tmp != nullptr) {
-            node = new AstShortVarDecl;
-            node->lhs = tmp;
-            expect(OP_SHORTAGN, "expect := in short assign statement");
-            node->rhs = parseExpressionList(t);
+    }
+    static bool isTypeSwitchGuard(AstNode* simpleStmt) {
+        AstNode* expression = expressionOf(simpleStmt);
+        if (expression == nullptr) {
+            auto* shortVarDecl = dynamic_cast<AstShortVarDecl*>(
+                dynamic_cast<AstSimpleStmt*>(simpleStmt)->ass.shortVarDecl);
+            auto* rhs = shortVarDecl == nullptr ? nullptr :
+                dynamic_cast<AstExpressionList*>(shortVarDecl->rhs);
+            if (rhs == nullptr || rhs->expressionList.size() != 1) return false;
+            expression = rhs->expressionList[0];
         }
-        return node;
-    };
+        auto* e = dynamic_cast<AstExpression*>(expression);
+        if (e->ae.named.rhs != nullptr) return false;
+        auto* u = dynamic_cast<AstUnaryExpr*>(e->ae.unaryExpr);
+        auto* p = dynamic_cast<AstPrimaryExpr*>(u->aue.primaryExpr);
+        auto* assertion = p == nullptr ? nullptr :
+            dynamic_cast<AstTypeAssertion*>(p->ape.typeAssertion.typeAssertion);
+        return assertion != nullptr && assertion->type == nullptr;
+    }
 
-    parseExpression = [&](Token&t)->AstNode* {
-        AstExpression* node = nullptr;
-        if (auto*tmp = parseUnaryExpr(t); tmp != nullptr) {
-            node = new  AstExpression;
-            node->ae.unaryExpr = tmp;
-            if (t.type == OP_OR || t.type == OP_AND || t.type == OP_EQ ||
-                t.type == OP_NE || t.type == OP_LT || t.type == OP_LE ||
-                t.type == OP_GT || t.type == OP_GE || t.type == OP_ADD ||
-                t.type == OP_SUB || t.type == OP_BITOR || t.type == OP_XOR ||
-                t.type == OP_MUL || t.type == OP_DIV || t.type == OP_MOD ||
-                t.type == OP_LSHIFT || t.type == OP_RSHIFT || t.type == OP_BITAND ||
-                t.type == OP_XOR) {
-                node->ae.named.binaryOp = t.type;
-                node->ae.named.lhs = tmp;
-                t = next(f);
-                node->ae.named.rhs = parseExpression(t);
+    //===------------------------------------------------------------------===//
+    // expressions
+    //===------------------------------------------------------------------===//
+    AstExpressionList* parseExpressionList() {
+        AstExpressionList* node = nullptr;
+        if (auto* tmp = parseExpression(); tmp != nullptr) {
+            node = make<AstExpressionList>();
+            node->expressionList.emplace_back(tmp);
+            while (accept(OP_COMMA)) {
+                node->expressionList.emplace_back(must(parseExpression(), "expect expression"));
             }
         }
         return node;
-    };
-    parseUnaryExpr = [&](Token&t)->AstNode* {
+    }
+    // Go's five levels of binary operator precedence, 0 for tokens that are
+    // not binary operators.
+    static int precedenceOf(TokenType type) {
+        switch (type) {
+        case OP_OR:
+            return 1;
+        case OP_AND:
+            return 2;
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            return 3;
+        case OP_ADD: case OP_SUB: case OP_BITOR: case OP_XOR:
+            return 4;
+        case OP_MUL: case OP_DIV: case OP_MOD: case OP_LSHIFT: case OP_RSHIFT:
+        case OP_BITAND: case OP_ANDXOR:
+            return 5;
+        default:
+            return 0;
+        }
+    }
+    AstNode* parseExpression() {
+        return parseBinaryExpr(1);
+    }
+    // Precedence climbing: operators of precedence prec1 or higher are folded
+    // into a left associative tree by the loop, the right operand of each only
+    // takes operators that bind tighter. Recursion is bounded by the number of
+    // levels, not by the number of terms.
+    AstNode* parseBinaryExpr(int prec1) {
+        auto* tmp = parseUnaryExpr();
+        if (tmp == nullptr) return nullptr;
+        auto* x = make<AstExpression>();
+        x->ae.unaryExpr = tmp;
+        for (int prec = precedenceOf(t.type); prec >= prec1; prec = precedenceOf(t.type)) {
+            auto* node = make<AstExpression>();
+            node->ae.named.lhs = x;
+            node->ae.named.binaryOp = t.type;
+            t = next(f);
+            node->ae.named.rhs = must(parseBinaryExpr(prec + 1), "expect operand after operator");
+            x = node;
+        }
+        return x;
+    }
+    AstNode* parseUnaryExpr() {
         AstUnaryExpr* node = nullptr;
         if (t.type == OP_ADD || t.type == OP_SUB || t.type == OP_NOT ||
             t.type == OP_XOR || t.type == OP_MUL || t.type == OP_BITAND || t.type == OP_CHAN) {
-            node = new AstUnaryExpr;
+            node = make<AstUnaryExpr>();
             node->aue.named.unaryOp = t.type;
             t = next(f);
-            node->aue.named.unaryExpr = parseUnaryExpr(t);
+            node->aue.named.unaryExpr = must(parseUnaryExpr(), "expect operand after operator");
         }
-        else if (auto*tmp = parsePrimaryExpr(t); tmp != nullptr) {
-            node = new AstUnaryExpr;
+        else if (auto* tmp = parsePrimaryExpr(); tmp != nullptr) {
+            node = make<AstUnaryExpr>();
             node->aue.primaryExpr = tmp;
         }
         return node;
-    };
-
-    parsePrimaryExpr = [&](Token&t)->AstNode* {
-        AstPrimaryExpr*node = nullptr;
-        if (auto*tmp = parseOperand(t); tmp != nullptr) {
-            node = new AstPrimaryExpr;
-            node->ape.operand = tmp;
-        }
-        else if (auto*tmp = parseConversion(t); tmp != nullptr) {
-            node = new AstPrimaryExpr;
-            node->ape.conversion = tmp;
-        }
-        else if (auto*tmp = parseMethodExpr(t); tmp != nullptr) {
-            node = new AstPrimaryExpr;
-            node->ape.methodExpr = tmp;
+    }
+    // An operand followed by any number of selectors, indexes, slices, type
+    // assertions, calls or the literal value of a composite literal whose type
+    // is a name. Each suffix wraps the expression so far, so chains such as
+    // a.b.c(x)[i].d() are read in one loop without recursion.
+    AstNode* parsePrimaryExpr() {
+        AstPrimaryExpr* x = parseOperand();
+        while (x != nullptr) {
+            AstPrimaryExpr* node = parsePrimarySuffix(x);
+            if (node == nullptr) break;
+            x = node;
         }
-        else if (auto*tmp = parsePrimaryExpr(t); tmp != nullptr) {
-            node = new AstPrimaryExpr;
-            if (auto*tmp1 = parseSelector(t); tmp1 != nullptr) {
-                node->ape.selector.primaryExpr = tmp;
-                node->ape.selector.selector = tmp1;
-            }
-            else if (auto*tmp1 = parseIndex(t); tmp1 != nullptr) {
-                node->ape.index.primaryExpr = tmp;
-                node->ape.index.index = tmp1;
-            }
-            else if (auto*tmp1 = parseSlice(t); tmp1 != nullptr) {
-                node->ape.slice.primaryExpr = tmp;
-                node->ape.slice.slice = tmp1;
+        return x;
+    }
+    // The suffix following x wrapped around it, nullptr if there is none.
+    AstPrimaryExpr* parsePrimarySuffix(AstPrimaryExpr* x) {
+        AstPrimaryExpr* node = nullptr;
+        switch (t.type) {
+        case OP_DOT:
+            t = next(f);
+            node = make<AstPrimaryExpr>();
+            if (t.type == TK_ID) {
+                auto* selector = make<AstSelector>();
+                selector->identifier = t.symbol;
+                t = next(f);
+                node->ape.selector.primaryExpr = x;
+                node->ape.selector.selector = selector;
             }
-            else if (auto*tmp1 = parseTypeAssertion(t); tmp1 != nullptr) {
-                node->ape.typeAssertion.primaryExpr = tmp;
-                node->ape.typeAssertion.typeAssertion = tmp1;
+            else {
+                eat(OP_LPAREN, "expect selector or type assertion");
+                auto* typeAssertion = make<AstTypeAssertion>();
+                if (!accept(KW_type)) {
+                    typeAssertion->type = must(parseType(), "expect type in type assertion");
+                }
+                eat(OP_RPAREN, "expect )");
+                node->ape.typeAssertion.primaryExpr = x;
+                node->ape.typeAssertion.typeAssertion = typeAssertion;
             }
-            else if (auto*tmp1 = parseArgument(t); tmp1 != nullptr) {
-                node->ape.argument.primaryExpr = tmp;
-                node->ape.argument.argument = tmp1;
+            break;
+        case OP_LBRACKET:
+            node = parseIndexOrSlice(x);
+            break;
+        case OP_LPAREN:
+            node = make<AstPrimaryExpr>();
+            node->ape.argument.primaryExpr = x;
+            node->ape.argument.argument = parseArgument();
+            break;
+        case OP_LBRACE:
+            if (auto* typeName = typeNameOf(x); typeName != nullptr && exprLev >= 0) {
+                node = operandOf(literalOf(parseCompositeLit(typeName)));
             }
+            break;
+        default:
+            break;
         }
         return node;
-    };
-    parseSelector = [&](Token&t)->AstNode* {
-        AstSelector*node = nullptr;
-        if (t.type == OP_DOT) {
-            node = new AstSelector;
-            node->identifier = expect(TK_ID, "expect an identifier in selector").lexeme;
-        }
-        return node;
-    };
-    parseIndex = [&](Token&t)->AstNode* {
-        AstIndex*node = nullptr;
-        if (t.type == OP_LBRACKET) {
-            node = new AstIndex;
-            node->expression = parseExpression(t);
-            expect(OP_RBRACKET, "bracket [] must match");
-        }
-        return node;
-    };
-    parseSlice = [&](Token&t)->AstNode* {
-        AstSlice*node = nullptr;
-        if (t.type == OP_LBRACKET) {
-            node = new AstSlice;
-            node->start = parseExpression(t);
-            expect(OP_COLON, "expect colon");
-            node->stop = parseExpression(t);
-            t = next(f);
-            if (t.type == OP_RBRACKET) {
-                t = next(f);
-            }
-            else if (t.type == OP_COLON) {
-                t = next(f);
-                node->step = parseExpression(t);
-                expect(OP_RBRACKET, "bracket [] must match");
+    }
+    AstPrimaryExpr* parseIndexOrSlice(AstPrimaryExpr* x) {
+        auto* node = make<AstPrimaryExpr>();
+        eat(OP_LBRACKET, "expect [");
+        exprLev++;
+        AstNode* index[3] = {};
+        int colons = 0;
+        if (t.type != OP_COLON) index[0] = must(parseExpression(), "expect index");
+        while (colons < 2 && accept(OP_COLON)) {
+            colons++;
+            if (t.type != OP_COLON && t.type != OP_RBRACKET) {
+                index[colons] = must(parseExpression(), "expect slice index");
             }
         }
-        return node;
-    };
-    parseTypeAssertion = [&](Token&t)->AstNode* {
-        AstTypeAssertion*node = nullptr;
-        if (t.type == OP_DOT) {
-            node = new AstTypeAssertion;
-            expect(OP_LPAREN, "expect (");
-            node->type = parseType(t);
-            expect(OP_RPAREN, "expect )");
+        exprLev--;
+        eat(OP_RBRACKET, "bracket [] must match");
+        if (colons == 0) {
+            auto* tmp = make<AstIndex>();
+            tmp->expression = index[0];
+            node->ape.index.primaryExpr = x;
+            node->ape.index.index = tmp;
+        }
+        else {
+            auto* tmp = make<AstSlice>();
+            tmp->start = index[0];
+            tmp->stop = index[1];
+            tmp->step = index[2];
+            node->ape.slice.primaryExpr = x;
+            node->ape.slice.slice = tmp;
         }
         return node;
-    };
-    parseArgument = [&](Token&t)->AstNode* {
-        AstArgument*node = nullptr;
-        if (t.type == OP_LPAREN) {
-            node = new AstArgument;
-            if (auto*tmp = parseExpressionList(t); tmp != nullptr) {
-                node->aa.expressionList = tmp;
-            }
-            else if (auto*tmp = parseType(t); tmp != nullptr) {
-                node->aa.named.type = tmp;
-                t = next(f);
-                if (t.type == OP_COMMA) {
-                    node->aa.named.expressionList = parseExpressionList(t);
-                }
-            }
-            t = next(f);
-            if (t.type == OP_VARIADIC) {
-                node->isVariadic = true;
-                t = next(f);
-            }
-            if (t.type == OP_COMMA) {
-                t = next(f);
-            }
-            if (t.type != OP_RPAREN) {
-                throw runtime_error("expect )");
-            }
+    }
+    AstNode* parseArgument() {
+        auto* node = make<AstArgument>();
+        eat(OP_LPAREN, "expect (");
+        exprLev++;
+        AstExpressionList* list = nullptr;
+        while (t.type != OP_RPAREN) {
+            if (list == nullptr) list = make<AstExpressionList>();
+            list->expressionList.push_back(must(parseExpression(), "expect argument"));
+            node->isVariadic = accept(OP_VARIADIC);
+            if (!accept(OP_COMMA)) break;
         }
+        exprLev--;
+        eat(OP_RPAREN, "expect )");
+        node->aa.expressionList = list;
         return node;
-    };
-    parseOperand = [&](Token&t)->AstNode* {
-        AstOperand*node = nullptr;
-        if (auto * tmp = parseLiteral(t); tmp != nullptr) {
-            node = new AstOperand;
-            node->ao.literal = tmp;
+    }
+    // An operand is a literal, a name, a parenthesized expression or a type
+    // literal, where a type literal may start a composite literal, a function
+    // literal or a conversion. A type that is none of them stands for itself as
+    // the expression of the operand, as in make([]int, n).
+    AstPrimaryExpr* parseOperand() {
+        AstOperand* node = nullptr;
+        if (auto* tmp = parseBasicLit(); tmp != nullptr) {
+            return operandOf(literalOf(tmp));
         }
-        else if (auto *tmp = parseOperandName(t); tmp != nullptr) {
-            node = new AstOperand;
+        else if (auto* tmp = parseOperandName(); tmp != nullptr) {
+            node = make<AstOperand>();
             node->ao.operandName = tmp;
         }
-        else if (t.type == OP_LPAREN) {
-            node = new AstOperand;
-            t = next(f);
-            node->ao.expression = parseExpression(t);
+        else if (accept(OP_LPAREN)) {
+            exprLev++;
+            node = make<AstOperand>();
+            node->ao.expression = must(parseExpression(), "expect expression in parentheses");
+            exprLev--;
             eat(OP_RPAREN, "expect )");
         }
-        return node;
-    };
-    parseOperandName = [&](Token&t)->AstNode* {
-        AstOperandName*node = nullptr;
-        if (t.type == TK_ID) {
-            node = new AstOperandName;
-            string operandName = t.lexeme;
-            t = next(f);
-            if (t.type == OP_DOT) {
-                t = next(f);
-                operandName.operator+=(".").operator+=(t.lexeme);
-                node->operandName = operandName;
-            }
-            else {
-                node->operandName = operandName;
-            }
-        }
-        return node;
-    };
-    parseLiteral = [&](Token&t)->AstNode* {
-        AstLiteral*node = nullptr;
-        if (auto*tmp = parseBasicLit(t); tmp != nullptr) {
-            node = new AstLiteral;
-            node->al.basicLit = tmp;
+        else if (t.type == KW_func) {
+            auto* type = dynamic_cast<AstFunctionType*>(parseFunctionType());
+            if (t.type == OP_LBRACE) return operandOf(literalOf(parseFunctionLit(type)));
+            node = make<AstOperand>();
+            node->ao.expression = typeOf(type);
         }
-        else if (auto*tmp = parseCompositeLit(t); tmp != nullptr) {
-            node = new AstLiteral;
-            node->al.compositeLit = tmp;
+        else if (t.type == OP_LBRACKET || t.type == KW_struct || t.type == KW_map ||
+            t.type == KW_chan || t.type == KW_interface) {
+            AstNode* type = t.type == OP_LBRACKET ? parseArrayOrSliceType(true) : parseTypeLit();
+            if (t.type == OP_LBRACE) return operandOf(literalOf(parseCompositeLit(type)));
+            if (auto* array = dynamic_cast<AstArrayType*>(type); array && !array->length) {
+                throw runtime_error("[...] array type outside of a composite literal");
+            }
+            if (t.type == OP_LPAREN) return parseConversion(typeOf(type));
+            node = make<AstOperand>();
+            node->ao.expression = typeOf(type);
         }
-        else if (auto*tmp = parseFunctionLit(t); tmp != nullptr) {
-            node = new AstLiteral;
-            node->al.functionLit = tmp;
+        if (node == nullptr) return nullptr;
+        auto* primaryExpr = make<AstPrimaryExpr>();
+        primaryExpr->ape.operand = node;
+        return primaryExpr;
+    }
+    AstNode* parseOperandName() {
+        AstOperandName* node = nullptr;
+        if (t.type == TK_ID) {
+            node = make<AstOperandName>();
+            node->operandName = t.symbol;
+            t = next(f);
         }
         return node;
-    };
-    parseBasicLit = [&](Token&t)->AstNode* {
+    }
+    AstNode* parseBasicLit() {
         AstBasicLit* node = nullptr;
         if (t.type == LITERAL_INT || t.type == LITERAL_FLOAT || t.type == LITERAL_IMG ||
             t.type == LITERAL_RUNE || t.type == LITERAL_STR) {
-            node = new AstBasicLit;
+            node = make<AstBasicLit>();
             node->type = t.type;
             node->value = t.lexeme;
             t = next(f);
         }
         return node;
-    };
-    parseCompositeLit = [&](Token&t)->AstNode* {
-        AstCompositeLit* node = nullptr;
-        if (auto*tmp = parseStructType(t); tmp != nullptr) {
-            node = new AstCompositeLit;
-            node->acl.structType = tmp;
-            node->literalValue = parseLiteralValue(t);
-        }
-        else if (t.type == OP_LBRACKET) {
-            node = new AstCompositeLit;
-            t = next(f);
-            if (t.type == OP_VARIADIC) {
+    }
+    AstNode* parseCompositeLit(AstNode* type) {
+        auto* node = make<AstCompositeLit>();
+        if (auto* tmp = dynamic_cast<AstArrayType*>(type); tmp != nullptr) {
+            if (tmp->length == nullptr) {
+                node->acl.automaticLengthArrayType.elementType = tmp->elementType;
                 node->acl.automaticLengthArrayType.automaticLength = true;
-                expect(OP_RBRACKET, "expect ]");
-                t = next(f);
-                node->acl.automaticLengthArrayType.elementType = parseType(t);
             }
             else {
-                if (t.type != OP_RBRACKET) {
-                    node->acl.arrayType.arrayLength = parseExpression(t);
-                }
-                else {
-                    t = next(f);
-                }
-                node->acl.arrayType.elementType = parseType(t);
+                node->acl.arrayType.arrayLength = tmp->length;
+                node->acl.arrayType.elementType = tmp->elementType;
             }
-            node->literalValue = parseLiteralValue(t);
         }
-        else if (auto*tmp = parseSliceType(t); tmp != nullptr) {
-            node = new AstCompositeLit;
-            node->acl.sliceType = tmp;
-            node->literalValue = parseLiteralValue(t);
+        else if (dynamic_cast<AstStructType*>(type) != nullptr) {
+            node->acl.structType = type;
+        }
+        else if (dynamic_cast<AstSliceType*>(type) != nullptr) {
+            node->acl.sliceType = type;
         }
-        else if (auto*tmp = parseMapType(t); tmp != nullptr) {
-            node = new AstCompositeLit;
-            node->acl.mapType = tmp;
-            node->literalValue = parseLiteralValue(t);
+        else if (dynamic_cast<AstMapType*>(type) != nullptr) {
+            node->acl.mapType = type;
         }
-        else if (auto*tmp = parseTypeName(t); tmp != nullptr) {
-            node = new AstCompositeLit;
-            node->acl.typeName = tmp;
-            node->literalValue = parseLiteralValue(t);
+        else if (dynamic_cast<AstTypeName*>(type) != nullptr) {
+            node->acl.typeName = type;
         }
+        else {
+            throw runtime_error("invalid type of composite literal");
+        }
+        node->literalValue = parseLiteralValue();
         return node;
-    };
-    parseLiteralValue = [&](Token&t)->AstNode* {
-        AstLiteralValue*node = nullptr;
+    }
+    AstNode* parseLiteralValue() {
+        AstLiteralValue* node = nullptr;
         if (t.type == OP_LBRACE) {
-            node = new AstLiteralValue;
+            node = make<AstLiteralValue>();
+            t = next(f);
+            exprLev++;
+            // both {a,b} and {a,b,} are legal form
+            while (t.type != OP_RBRACE) {
+                size_t slot = openElement(node->keyedElement, EK_KEYED_ELEMENT);
+                node->keyedElement.push_back(parseKeyedElement());
+                closeElement(slot);
+                if (!accept(OP_COMMA)) break;
+            }
+            exprLev--;
+            eat(OP_RBRACE, "brace {} must match");
+        }
+        return node;
+    }
+    AstNode* parseKeyedElement() {
+        auto* node = make<AstKeyedElement>();
+        AstNode* value = t.type == OP_LBRACE ? parseLiteralValue() :
+            must(parseExpression(), "expect element of composite literal");
+        if (accept(OP_COLON)) {
+            auto* key = make<AstKey>();
+            if (dynamic_cast<AstLiteralValue*>(value) != nullptr) {
+                key->ak.literalValue = value;
+            }
+            else {
+                key->ak.expression = value;
+            }
+            node->key = key;
+            value = t.type == OP_LBRACE ? parseLiteralValue() :
+                must(parseExpression(), "expect element of composite literal");
+        }
+        auto* element = make<AstElement>();
+        if (dynamic_cast<AstLiteralValue*>(value) != nullptr) {
+            element->ae.literalValue = value;
+        }
+        else {
+            element->ae.expression = value;
+        }
+        node->element = element;
+        return node;
+    }
+    AstNode* parseFunctionLit(AstFunctionType* type) {
+        auto* node = make<AstFunctionLit>();
+        node->signature = type->signature;
+        int outerLev = exprLev;
+        exprLev = 0;
+        node->functionBody = parseBlock();
+        exprLev = outerLev;
+        return node;
+    }
+    AstPrimaryExpr* parseConversion(AstNode* type) {
+        auto* node = make<AstConversion>();
+        node->type = type;
+        eat(OP_LPAREN, "expect (");
+        exprLev++;
+        node->expression = must(parseExpression(), "expect expression to convert");
+        accept(OP_COMMA);
+        exprLev--;
+        eat(OP_RPAREN, "expect )");
+        auto* primaryExpr = make<AstPrimaryExpr>();
+        primaryExpr->ape.conversion = node;
+        return primaryExpr;
+    }
+    AstNode* literalOf(AstNode* lit) {
+        auto* node = make<AstLiteral>();
+        node->al.basicLit = lit;
+        return node;
+    }
+    AstPrimaryExpr* operandOf(AstNode* literal) {
+        auto* operand = make<AstOperand>();
+        operand->ao.literal = literal;
+        auto* node = make<AstPrimaryExpr>();
+        node->ape.operand = operand;
+        return node;
+    }
+    AstNode* typeOf(AstNode* typeLit) {
+        auto* node = make<AstType>();
+        node->at.typeLit = typeLit;
+        return node;
+    }
+    // The type name a primary expression spells, name or package.name, which
+    // only turns into a type when a literal value follows it.
+    AstNode* typeNameOf(AstPrimaryExpr* x) {
+        auto nameOf = [](AstNode* primaryExpr) -> Symbol {
+            auto* p = dynamic_cast<AstPrimaryExpr*>(primaryExpr);
+            auto* o = p == nullptr ? nullptr : dynamic_cast<AstOperand*>(p->ape.operand);
+            auto* n = o == nullptr ? nullptr : dynamic_cast<AstOperandName*>(o->ao.operandName);
+            return n == nullptr ? 0 : n->operandName;
+        };
+        Symbol packageName = 0, typeName = nameOf(x);
+        if (typeName == 0) {
+            auto* selector = dynamic_cast<AstSelector*>(x->ape.selector.selector);
+            packageName = selector == nullptr ? 0 : nameOf(x->ape.selector.primaryExpr);
+            if (packageName == 0) return nullptr;
+            typeName = selector->identifier;
+        }
+        auto* node = make<AstTypeName>();
+        node->packageName = packageName;
+        node->typeName = typeName;
+        return node;
+    }
+};
+
+// A parse error located at the token the parser stopped at.
+runtime_error parseError(const string& filename, const Token& t, const runtime_error& e) {
+    return runtime_error(filename + ":" + to_string(t.line) + ":" + to_string(t.column) + ": " +
+        e.what());
+}
+
+// Everything parse() needs lives in its own Parser, so any number of files may
+// be parsed at the same time. The nodes are allocated from the arena and live
+// as long as it does.
+const AstNode* parse(const Source& source, const string& filename, Arena& arena) {
+    Parser parser(source, arena);
+    try {
+        return parser.parseSourceFile();
+    }
+    catch (const runtime_error& e) {
+        throw parseError(filename, parser.t, e);
+    }
+}
+const AstNode* parse(const string & filename, Arena& arena) {
+    Source source(filename);
+    return parse(source, filename, arena);
+}
+
+//===----------------------------------------------------------------------===//
+// lazy function bodies
+//===----------------------------------------------------------------------===//
+// A file parsed for its declarations alone. It lives in the arena of its AST
+// together with its source, where the skipped bodies are parsed later.
+struct LazyFile {
+    string filename;
+    Source source;
+    Arena& arena;
+    LazyFile(const string& filename, Arena& arena)
+        : filename(filename), source(filename), arena(arena) {}
+};
+
+// Parses the package clause, imports and top level declarations of a file but
+// skips the bodies of its functions by brace matching, for passes that need
+// no more than signatures such as dependency scanning or listing the exported
+// API. A malformed body is only reported once it is parsed.
+const AstNode* parseHeaders(const string& filename, Arena& arena) {
+    auto* file = arena.make<LazyFile>(filename, arena);
+    Parser parser(file->source, arena);
+    parser.lazy = file;
+    try {
+        return parser.parseSourceFile();
+    }
+    catch (const runtime_error& e) {
+        throw parseError(filename, parser.t, e);
+    }
+}
+
+// The block of a function body, parsed on first demand when it was skipped.
+// The bodies of one file share its arena, so they are parsed on one thread at a
+// time.
+const AstNode* bodyOf(const AstLazyBlock* body) {
+    if (body->block == nullptr) {
+        auto& file = *body->file;
+        const char* p = file.source.begin + body->begin;
+        Parser parser(file.source, file.arena);
+        parser.f.resume(p, p - (body->column - 1), body->line, -1);
+        try {
+            parser.t = next(parser.f);
+            body->block = parser.parseBlock();
+            if (parser.offset(parser.f.prevEnd) != body->end) {
+                throw runtime_error("function body does not end at its matching brace");
+            }
+        }
+        catch (const runtime_error& e) {
+            throw parseError(file.filename, parser.t, e);
+        }
+    }
+    return body->block;
+}
+
+//===----------------------------------------------------------------------===//
+// incremental reparsing
+//===----------------------------------------------------------------------===//
+// A source file kept open across edits, as an editor or a checker that runs on
+// every save does. Every top level declaration and every element of a composite
+// literal remembers its span, so an edit relexes and reparses only the innermost
+// element or the declarations it touches, together with whatever it inserts
+// between them, and keeps all the other subtrees. An edit whose new text does
+// not parse on its own as what it replaces falls back to parsing the whole file.
+// A kept subtree keeps the lines and columns of the text it was parsed from.
+struct Document {
+    Document(string filename, string text) : filename(move(filename)), text(move(text)) {
+        reparse();
+    }
+    // the AstSourceFile, or nullptr while the text is malformed
+    const AstNode* ast() const { return file; }
+    const string& source() const { return text; }
+    const vector<DeclSpan>& declSpans() const { return spans; }
+    const vector<ElementSpan>& elementSpans() const { return elements; }
+    // how many times the whole text has been parsed, the first time included
+    size_t wholeParses() const { return fullParses; }
+
+    // Replaces the bytes [begin, end) of the text by replacement. Throws like
+    // parse() when the new text is malformed, the document then has no ast
+    // until a later edit makes it well formed again.
+    void edit(size_t begin, size_t end, string_view replacement) {
+        if (begin > end || end > text.size()) throw runtime_error("edit is out of the text");
+        Edit e{ begin, end, long(replacement.size()) - long(end - begin),
+            int(count(replacement.begin(), replacement.end(), '\n') -
+                count(text.begin() + begin, text.begin() + end, '\n')) };
+        // spans [first, last) touch the edit, the gap before first is relexed too
+        size_t first = lower_bound(spans.begin(), spans.end(), begin,
+            [](const DeclSpan& s, size_t p) { return s.end < p; }) - spans.begin();
+        size_t last = upper_bound(spans.begin() + first, spans.end(), end,
+            [](size_t p, const DeclSpan& s) { return p < s.begin; }) - spans.begin();
+        size_t element = last == first + 1 ? innermost(e, spans[first].begin) : npos;
+        int line = element == npos ? 0 : elements[element].line - int(count(text.begin() +
+            elements[element].after, text.begin() + elements[element].begin, '\n'));
+        text.replace(begin, end - begin, replacement);
+        // the replaced subtrees stay in the arena, so it is renewed once they
+        // outweigh the live ones
+        if (file == nullptr || arena->size() > 2 * parsedSize ||
+            (!(element != npos && reparse(element, line, e)) && !reparse(first, last, e))) {
+            reparse();
+        }
+    }
+
+private:
+    // bytes [begin, end) of the old text became delta bytes longer and gained
+    // lines newlines
+    struct Edit {
+        size_t begin, end;
+        long delta;
+        int lines;
+    };
+
+    string filename;
+    string text;
+    unique_ptr<Arena> arena;
+    AstSourceFile* file = nullptr;
+    // the package clause and imports, then one per element of file->topLevelDecl
+    vector<DeclSpan> spans;
+    // in the order of their first tokens, an element before those nested in it
+    vector<ElementSpan> elements;
+    size_t parsedSize = 0;
+    size_t fullParses = 0;
+    static constexpr size_t npos = ~size_t(0);
+
+    void reparse() {
+        file = nullptr;
+        spans.clear();
+        elements.clear();
+        arena = make_unique<Arena>();
+        fullParses++;
+        Source source(text.data(), text.size());
+        Parser parser(source, *arena);
+        parser.spans = &spans;
+        parser.elements = &elements;
+        try {
+            file = static_cast<AstSourceFile*>(parser.parseSourceFile());
+        }
+        catch (const runtime_error& error) {
+            spans.clear();
+            elements.clear();
+            throw parseError(filename, parser.t, error);
+        }
+        parsedSize = arena->size();
+    }
+    // A parser of the new text from begin, which is on the given line, to end.
+    // The source starts at the beginning of that line so columns stay right.
+    struct Region {
+        size_t lineBegin;
+        Source source;
+        Parser parser;
+        Region(const string& text, size_t begin, size_t end, int line, int previous, Arena& arena)
+            : lineBegin(lineStart(text, begin)),
+            source(text.data() + lineBegin, end - lineBegin), parser(source, arena) {
+            parser.f.resume(source.begin + (begin - lineBegin), source.begin, line, previous);
+        }
+        static size_t lineStart(const string& text, size_t p) {
+            size_t newline = p == 0 ? string::npos : text.rfind('\n', p - 1);
+            return newline == string::npos ? 0 : newline + 1;
+        }
+    };
+    // Shifts every span after the edit, and the end of those around it.
+    static void shift(DeclSpan& s, const Edit& e) {
+        if (s.begin >= e.end) {
+            s.begin += e.delta;
+            s.line += e.lines;
+        }
+        if (s.end >= e.end) s.end += e.delta;
+    }
+    static void shift(ElementSpan& s, const Edit& e) {
+        shift(static_cast<DeclSpan&>(s), e);
+        if (s.after >= e.end) s.after += e.delta;
+    }
+    static void moveBy(DeclSpan& s, size_t lineBegin) {
+        s.begin += lineBegin;
+        s.end += lineBegin;
+    }
+    static void moveBy(ElementSpan& s, size_t lineBegin) {
+        moveBy(static_cast<DeclSpan&>(s), lineBegin);
+        s.after += lineBegin;
+    }
+
+    // The innermost element that holds the edit from the end of the token
+    // before it on, npos when there is none after declBegin.
+    size_t innermost(const Edit& e, size_t declBegin) const {
+        size_t i = upper_bound(elements.begin(), elements.end(), e.begin,
+            [](size_t p, const ElementSpan& s) { return p < s.after; }) - elements.begin();
+        while (i > 0 && elements[i - 1].begin >= declBegin) {
+            auto& s = elements[--i];
+            if (s.after <= e.begin && e.end <= s.end) return i;
+        }
+        return npos;
+    }
+    // Reparses element i, whose text now starts on the given line, false when
+    // its new text is not one element of the same kind.
+    bool reparse(size_t i, int line, const Edit& e) {
+        const ElementSpan element = elements[i];
+        Region region(text, element.after, element.end + e.delta, line, -1, *arena);
+        Parser& parser = region.parser;
+        vector<ElementSpan> found;
+        parser.elements = &found;
+        // an element is inside braces, where a '{' after a type opens a literal
+        if (element.kind == EK_KEYED_ELEMENT) parser.exprLev = 1;
+        ElementSpan replacement = element;
+        AstNode* node = nullptr;
+        try {
+            parser.t = next(parser.f);
+            replacement.begin = parser.offset(parser.t.lexeme.data()) + region.lineBegin;
+            replacement.line = parser.t.line;
+            switch (element.kind) {
+            case EK_STATEMENT: node = parser.parseStatement(); break;
+            case EK_KEYED_ELEMENT: node = parser.parseKeyedElement(); break;
+            case EK_CASE_CLAUSE: node = parser.parseExprCaseClause(); break;
+            case EK_COMM_CLAUSE: node = parser.parseCommClause(); break;
+            }
+            replacement.end = parser.offset(parser.f.prevEnd) + region.lineBegin;
+            // nothing but the semicolon the source ends with may follow, the
+            // statements of a clause take it in; a comment after the last
+            // token would run on past the region in the whole text
+            if (node == nullptr || !parser.f.shouldEof || replacement.end != element.end + e.delta ||
+                (parser.t.type != OP_SEMI && parser.t.type != TK_EOF)) {
+                return false;
+            }
+        }
+        catch (const runtime_error&) {
+            return false;
+        }
+
+        (*element.list)[element.index] = node;
+        size_t nested = i + 1;
+        while (nested < elements.size() && elements[nested].begin < element.end) nested++;
+        for (auto& span : spans) shift(span, e);
+        for (auto& span : elements) shift(span, e);
+        for (auto& span : found) moveBy(span, region.lineBegin);
+        elements[i] = replacement;
+        elements.erase(elements.begin() + i + 1, elements.begin() + nested);
+        elements.insert(elements.begin() + i + 1, found.begin(), found.end());
+        return true;
+    }
+
+    // Reparses the text from the end of span first - 1, or from the start of
+    // the text when first is the package clause, up to the start of span last
+    // in place of spans [first, last). False when that text is not a sequence
+    // of whole declarations each followed by a semicolon.
+    bool reparse(size_t first, size_t last, const Edit& e) {
+        // an edit of the comments before the package clause reparses it too
+        if (first == 0) last = max<size_t>(last, 1);
+        size_t from = 0, to = last < spans.size() ? spans[last].begin + e.delta : text.size();
+        int line = 1;
+        if (first != 0) {
+            const DeclSpan& before = spans[first - 1];
+            from = before.end;
+            line = before.line + int(count(text.begin() + before.begin, text.begin() + from, '\n'));
+        }
+
+        Region region(text, from, to, line, first == 0 ? -1 : TK_ID, *arena);
+        Parser& parser = region.parser;
+        vector<DeclSpan> found;
+        vector<ElementSpan> foundElements;
+        vector<AstNode*> decls;
+        AstSourceFile* header = nullptr;
+        parser.spans = &found;
+        parser.elements = &foundElements;
+        try {
+            if (first == 0) {
+                header = static_cast<AstSourceFile*>(parser.parseSourceFile());
+                if (header == nullptr) return false;
+                decls = header->topLevelDecl;
+            }
+            else {
+                parser.t = next(parser.f);
+                parser.eat(OP_SEMI, "expect a semicolon after declaration");
+                while (parser.t.type != TK_EOF) {
+                    if (parser.accept(OP_SEMI)) continue;
+                    size_t begin = parser.offset(parser.t.lexeme.data());
+                    int declLine = parser.t.line;
+                    decls.push_back(parser.must(parser.parseTopLevelDecl(), "expect a declaration"));
+                    parser.mark(begin, declLine);
+                    if (parser.t.type != TK_EOF) parser.eat(OP_SEMI, "expect a semicolon after declaration");
+                }
+            }
+        }
+        catch (const runtime_error&) {
+            return false;
+        }
+        // the source ends with a semicolon of its own, which is only real at
+        // the end of the file
+        if (to != text.size()) {
+            Lexer lexer(region.source);
+            lexer.resume(region.source.begin + (found.empty() ? from - region.lineBegin :
+                found.back().end), region.source.begin, line, TK_ID);
+            if (next(lexer).type != OP_SEMI || lexer.shouldEof) return false;
+        }
+
+        // the elements of the replaced declarations lie between from and to
+        size_t oldTo = to - e.delta;
+        auto firstElement = lower_bound(elements.begin(), elements.end(), from,
+            [](const ElementSpan& s, size_t p) { return s.begin < p; });
+        auto lastElement = lower_bound(firstElement, elements.end(), oldTo,
+            [](const ElementSpan& s, size_t p) { return s.begin < p; });
+        for (auto it = lastElement; it != elements.end(); ++it) shift(*it, e);
+        for (size_t i = last; i < spans.size(); i++) shift(spans[i], e);
+        for (auto& span : found) moveBy(span, region.lineBegin);
+        for (auto& span : foundElements) moveBy(span, region.lineBegin);
+        auto at = elements.erase(firstElement, lastElement);
+        elements.insert(at, foundElements.begin(), foundElements.end());
+
+        // declaration i has span i + 1
+        auto& topLevelDecl = file->topLevelDecl;
+        size_t firstDecl = first == 0 ? 0 : first - 1;
+        topLevelDecl.erase(topLevelDecl.begin() + firstDecl, topLevelDecl.begin() + (last - 1));
+        topLevelDecl.insert(topLevelDecl.begin() + firstDecl, decls.begin(), decls.end());
+        if (header != nullptr) {
+            header->topLevelDecl = move(topLevelDecl);
+            file = header;
+        }
+        spans.erase(spans.begin() + first, spans.begin() + last);
+        spans.insert(spans.begin() + first, found.begin(), found.end());
+        return true;
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// compact AST
+//===----------------------------------------------------------------------===//
+// The tree of one file flattened into a single array of fixed size nodes. Each
+// node is a kind tag, a token and four 32-bit operands which, as nodeKinds says
+// for every kind, are the index of a child node, an interned name, or a list of
+// either kept in Tree::extra. Children come before their parent, and index 0
+// stands for no node, no name and no list alike.
+enum NodeKind : uint8_t {
+    NK_NONE, NK_FILE, NK_IMPORT, NK_CONST_DECL, NK_CONST_SPEC, NK_TYPE_DECL, NK_TYPE_SPEC,
+    NK_VAR_DECL, NK_VAR_SPEC, NK_FUNC_DECL, NK_FIELD,
+    NK_TYPE_NAME, NK_ARRAY_TYPE, NK_SLICE_TYPE, NK_STRUCT_TYPE, NK_POINTER_TYPE, NK_FUNC_TYPE,
+    NK_INTERFACE_TYPE, NK_METHOD_SPEC, NK_MAP_TYPE, NK_CHAN_TYPE,
+    NK_BLOCK, NK_LABELED_STMT, NK_EXPR_STMT, NK_SEND_STMT, NK_INC_DEC_STMT, NK_ASSIGN_STMT,
+    NK_GO_STMT, NK_DEFER_STMT, NK_RETURN_STMT, NK_BRANCH_STMT, NK_IF_STMT, NK_SWITCH_STMT,
+    NK_CASE_CLAUSE, NK_SELECT_STMT, NK_COMM_CLAUSE, NK_FOR_STMT, NK_RANGE_STMT,
+    NK_NAME, NK_BASIC_LIT, NK_COMPOSITE_LIT, NK_KEYED_ELEMENT, NK_FUNC_LIT, NK_SELECTOR,
+    NK_INDEX, NK_SLICE, NK_TYPE_ASSERT, NK_CALL, NK_UNARY, NK_BINARY
+};
+enum OperandRole : uint8_t { R_NONE, R_NODE, R_NAME, R_LIST, R_NAMES };
+struct NodeKindInfo {
+    const char* name;
+    OperandRole operand[4];
+    bool hasToken;
+};
+constexpr NodeKindInfo nodeKinds[] = {
+    { "None", { R_NONE, R_NONE, R_NONE, R_NONE }, false },
+    // package name, imports, declarations
+    { "File", { R_NAME, R_LIST, R_LIST, R_NONE }, false },
+    // path, alias
+    { "Import", { R_NAME, R_NAME, R_NONE, R_NONE }, false },
+    // specs, the index of a spec is its iota
+    { "ConstDecl", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    // names, type, values, no values repeats the ones of the spec before
+    { "ConstSpec", { R_NAMES, R_NODE, R_LIST, R_NONE }, false },
+    { "TypeDecl", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    // name, type, F_ALIAS
+    { "TypeSpec", { R_NAME, R_NODE, R_NONE, R_NONE }, false },
+    { "VarDecl", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    // names, type, values
+    { "VarSpec", { R_NAMES, R_NODE, R_LIST, R_NONE }, false },
+    // name, receiver fields, FuncType, body
+    { "FuncDecl", { R_NAME, R_LIST, R_NODE, R_NODE }, false },
+    // names(none when embedded or unnamed), type, tag, F_VARIADIC
+    { "Field", { R_NAMES, R_NODE, R_NAME, R_NONE }, false },
+    // package, name
+    { "TypeName", { R_NAME, R_NAME, R_NONE, R_NONE }, false },
+    // length(none for [...]), element
+    { "ArrayType", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    { "SliceType", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    { "StructType", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    { "PointerType", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    // parameter fields, result fields
+    { "FuncType", { R_LIST, R_LIST, R_NONE, R_NONE }, false },
+    // MethodSpecs and embedded TypeNames
+    { "InterfaceType", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    { "MethodSpec", { R_NAME, R_NODE, R_NONE, R_NONE }, false },
+    { "MapType", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    // element, F_SEND_ONLY or F_RECV_ONLY
+    { "ChanType", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    { "Block", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    { "LabeledStmt", { R_NAME, R_NODE, R_NONE, R_NONE }, false },
+    { "ExprStmt", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    // channel, value
+    { "SendStmt", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    { "IncDecStmt", { R_NODE, R_NONE, R_NONE, R_NONE }, true },
+    // lhs, rhs, the token is = or op= or :=
+    { "AssignStmt", { R_LIST, R_LIST, R_NONE, R_NONE }, true },
+    { "GoStmt", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    { "DeferStmt", { R_NODE, R_NONE, R_NONE, R_NONE }, false },
+    { "ReturnStmt", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    // label, the token is break, continue, goto or fallthrough
+    { "BranchStmt", { R_NAME, R_NONE, R_NONE, R_NONE }, true },
+    // init, condition, then, else
+    { "IfStmt", { R_NODE, R_NODE, R_NODE, R_NODE }, false },
+    // init, tag or the guard statement of a type switch, clauses, F_TYPE_SWITCH
+    { "SwitchStmt", { R_NODE, R_NODE, R_LIST, R_NONE }, false },
+    // expressions(none for default), body
+    { "CaseClause", { R_LIST, R_LIST, R_NONE, R_NONE }, false },
+    { "SelectStmt", { R_LIST, R_NONE, R_NONE, R_NONE }, false },
+    // send or receive statement(none for default), body
+    { "CommClause", { R_NODE, R_LIST, R_NONE, R_NONE }, false },
+    // init, condition, post, body
+    { "ForStmt", { R_NODE, R_NODE, R_NODE, R_NODE }, false },
+    // key and value, range expression, body, the token is = or := if there are any
+    { "RangeStmt", { R_LIST, R_NODE, R_NODE, R_NONE }, true },
+    { "Name", { R_NAME, R_NONE, R_NONE, R_NONE }, false },
+    // text, the token is the kind of literal
+    { "BasicLit", { R_NAME, R_NONE, R_NONE, R_NONE }, true },
+    // type(none when elided), elements
+    { "CompositeLit", { R_NODE, R_LIST, R_NONE, R_NONE }, false },
+    { "KeyedElement", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    { "FuncLit", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    { "Selector", { R_NODE, R_NAME, R_NONE, R_NONE }, false },
+    { "Index", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    // operand, low, high, max
+    { "Slice", { R_NODE, R_NODE, R_NODE, R_NODE }, false },
+    // operand, type(none for .(type))
+    { "TypeAssert", { R_NODE, R_NODE, R_NONE, R_NONE }, false },
+    // function or type converted to, arguments, F_VARIADIC
+    { "Call", { R_NODE, R_LIST, R_NONE, R_NONE }, false },
+    { "Unary", { R_NODE, R_NONE, R_NONE, R_NONE }, true },
+    { "Binary", { R_NODE, R_NODE, R_NONE, R_NONE }, true },
+};
+static_assert(sizeof(nodeKinds) / sizeof(nodeKinds[0]) == NK_BINARY + 1,
+    "every node kind needs its operand roles");
+enum NodeFlag : uint8_t {
+    F_ALIAS = 1, F_VARIADIC = 2, F_SEND_ONLY = 4, F_RECV_ONLY = 8, F_TYPE_SWITCH = 16
+};
+
+struct Node {
+    NodeKind kind;
+    uint8_t flags;
+    uint16_t token;
+    uint32_t a, b, c, d;
+
+    TokenType op() const { return static_cast<TokenType>(token); }
+    uint32_t operand(int i) const { return i == 0 ? a : i == 1 ? b : i == 2 ? c : d; }
+};
+static_assert(sizeof(Node) == 20, "nodes are packed");
+
+// Where a node starts in its source text.
+struct Position {
+    int line = 0, column = 0;
+};
+
+struct Tree {
+    // a list is its length followed by its elements
+    struct List {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        size_t size() const { return last - first; }
+        uint32_t operator[](size_t i) const { return first[i]; }
+    };
+
+    vector<Node> nodes{ Node{} };
+    vector<uint32_t> extra{ 0 };
+    // by node, apart from the nodes so that those stay packed
+    vector<Position> positions{ Position{} };
+    uint32_t root = 0;
+
+    const Node& operator[](uint32_t i) const { return nodes[i]; }
+    List list(uint32_t i) const { return { &extra[i] + 1, &extra[i] + 1 + extra[i] }; }
+    string_view name(Symbol s) const { return symbols.text(s); }
+    // Call visit with every child node of node i, list elements included.
+    template <class Visit>
+    void forEachChild(uint32_t i, Visit&& visit) const {
+        const Node& n = nodes[i];
+        for (int k = 0; k < 4; k++) {
+            uint32_t x = n.operand(k);
+            if (x == 0) continue;
+            if (nodeKinds[n.kind].operand[k] == R_NODE) {
+                visit(x);
+            }
+            else if (nodeKinds[n.kind].operand[k] == R_LIST) {
+                for (uint32_t child : list(x)) visit(child);
+            }
+        }
+    }
+    size_t size() const {
+        return nodes.size() * (sizeof(Node) + sizeof(Position)) + extra.size() * sizeof(uint32_t);
+    }
+};
+
+// node as a T when that is its exact type. Every kind of AstNode derives from
+// AstNode alone and the compiler is a single binary, so comparing the addresses
+// of the type_infos is enough, which is far cheaper than each of the failed
+// dynamic_casts of a long chain.
+template <class T>
+const T* nodeAs(const AstNode* node) {
+    return node != nullptr && &typeid(*node) == &typeid(T) ? static_cast<const T*>(node) : nullptr;
+}
+
+// Flatten the pointer tree of a source file. The unions of the pointer tree are
+// told apart here, once, by the dynamic type of what they hold.
+struct TreeBuilder {
+    Tree& tree;
+    // the position of the innermost AstNode being converted, which every node
+    // added for it gets
+    Position at;
+
+    uint32_t add(NodeKind kind, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0,
+        TokenType token = TokenType(0), uint8_t flags = 0) {
+        tree.nodes.push_back(Node{ kind, flags, uint16_t(token), a, b, c, d });
+        tree.positions.push_back(at);
+        return uint32_t(tree.nodes.size() - 1);
+    }
+    uint32_t list(const vector<uint32_t>& items) {
+        tree.extra.push_back(uint32_t(items.size()));
+        tree.extra.insert(tree.extra.end(), items.begin(), items.end());
+        return uint32_t(tree.extra.size() - items.size() - 1);
+    }
+    uint32_t list(const vector<AstNode*>& nodes) {
+        vector<uint32_t> items;
+        for (auto* node : nodes) items.push_back(convert(node));
+        return list(items);
+    }
+    // An expression list, statement list or identifier list, none for nullptr.
+    uint32_t list(const AstNode* node) {
+        if (auto* n = nodeAs<AstExpressionList>(node)) return list(n->expressionList);
+        if (auto* n = nodeAs<AstStatementList>(node)) return list(n->statements);
+        return names(node);
+    }
+    uint32_t names(const AstNode* identifierList) {
+        auto* n = nodeAs<AstIdentifierList>(identifierList);
+        if (n == nullptr) return 0;
+        vector<uint32_t> items;
+        items.assign(n->identifierList.begin(), n->identifierList.end());
+        return list(items);
+    }
+    // The identifiers on the left of := as a list of Name nodes.
+    uint32_t nameNodes(const AstNode* identifierList) {
+        vector<uint32_t> items;
+        for (auto& name : nodeAs<AstIdentifierList>(identifierList)->identifierList) {
+            items.push_back(add(NK_NAME, name));
+        }
+        return list(items);
+    }
+    // Parameters written as a, b int share their type, they make one Field.
+    uint32_t fields(const AstNode* parameter) {
+        auto* n = nodeAs<AstParameter>(parameter);
+        if (n == nullptr) return 0;
+        vector<uint32_t> items;
+        for (size_t i = 0; i < n->parameterList.size();) {
+            auto* decl = dynamic_cast<AstParameterDecl*>(n->parameterList[i]);
+            vector<uint32_t> group;
+            size_t k = i;
+            for (; k < n->parameterList.size(); k++) {
+                auto* other = dynamic_cast<AstParameterDecl*>(n->parameterList[k]);
+                if (!decl->hasName || other->type != decl->type) break;
+                group.push_back(other->name);
+            }
+            uint32_t type = convert(decl->type);
+            items.push_back(add(NK_FIELD, group.empty() ? 0 : list(group), type, 0, 0, TokenType(0),
+                decl->isVariadic ? F_VARIADIC : 0));
+            i = max(k, i + 1);
+        }
+        return list(items);
+    }
+    uint32_t results(const AstNode* result) {
+        auto* n = nodeAs<AstResult>(result);
+        if (n == nullptr) return 0;
+        if (dynamic_cast<AstParameter*>(n->ar.parameter) != nullptr) return fields(n->ar.parameter);
+        uint32_t type = convert(n->ar.type);
+        return list(vector<uint32_t>{ add(NK_FIELD, 0, type) });
+    }
+    uint32_t elements(const AstNode* literalValue) {
+        return list(nodeAs<AstLiteralValue>(literalValue)->keyedElement);
+    }
+    uint32_t convert(const AstNode* node) {
+        if (node == nullptr) return 0;
+        Position outer = at;
+        at = { node->line, node->column };
+        uint32_t i = convertNode(node);
+        at = outer;
+        return i;
+    }
+    uint32_t convertNode(const AstNode* node) {
+        // declarations
+        if (auto* n = nodeAs<AstSourceFile>(node)) {
+            Symbol name = dynamic_cast<AstPackageClause*>(n->packageClause)->packageName;
+            vector<uint32_t> imports;
+            for (auto* decl : n->importDecl) {
+                for (auto& [path, alias] : dynamic_cast<AstImportDecl*>(decl)->imports) {
+                    imports.push_back(add(NK_IMPORT, path, alias));
+                }
+            }
+            uint32_t importList = list(imports);
+            return add(NK_FILE, name, importList, list(n->topLevelDecl));
+        }
+        if (auto* n = nodeAs<AstTopLevelDecl>(node)) return convert(n->atld.decl);
+        if (auto* n = nodeAs<AstDeclaration>(node)) return convert(n->ad.constDecl);
+        if (auto* n = nodeAs<AstConstDecl>(node)) {
+            vector<uint32_t> specs;
+            for (size_t i = 0; i < n->identifierList.size(); i++) {
+                uint32_t identifiers = names(n->identifierList[i]);
+                uint32_t type = convert(n->type[i]);
+                specs.push_back(add(NK_CONST_SPEC, identifiers, type, list(n->expressionList[i])));
+            }
+            return add(NK_CONST_DECL, list(specs));
+        }
+        if (auto* n = nodeAs<AstTypeDecl>(node)) return add(NK_TYPE_DECL, list(n->typeSpec));
+        if (auto* n = nodeAs<AstTypeSpec>(node)) {
+            uint32_t type = convert(n->type);
+            return add(NK_TYPE_SPEC, n->identifier, type, 0, 0, TokenType(0),
+                n->isAlias ? F_ALIAS : 0);
+        }
+        if (auto* n = nodeAs<AstVarDecl>(node)) return add(NK_VAR_DECL, list(n->varSpec));
+        if (auto* n = nodeAs<AstVarSpec>(node)) {
+            uint32_t identifiers = names(n->identifierList);
+            if (dynamic_cast<AstType*>(n->avs.named.type) != nullptr) {
+                uint32_t type = convert(n->avs.named.type);
+                return add(NK_VAR_SPEC, identifiers, type, list(n->avs.named.expressionList));
+            }
+            return add(NK_VAR_SPEC, identifiers, 0, list(n->avs.expressionList));
+        }
+        if (auto* n = nodeAs<AstFunctionDecl>(node)) {
+            uint32_t receiver = fields(n->receiver);
+            uint32_t signature = convert(n->signature);
+            uint32_t body = convert(n->functionBody);
+            return add(NK_FUNC_DECL, n->funcName, receiver, signature, body);
+        }
+        // types
+        if (auto* n = nodeAs<AstType>(node)) return convert(n->at.typeName);
+        if (auto* n = nodeAs<AstTypeName>(node)) return add(NK_TYPE_NAME, n->packageName, n->typeName);
+        if (auto* n = nodeAs<AstArrayType>(node)) {
+            uint32_t length = convert(n->length);
+            return add(NK_ARRAY_TYPE, length, convert(n->elementType));
+        }
+        if (auto* n = nodeAs<AstSliceType>(node)) {
+            return add(NK_SLICE_TYPE, convert(n->elementType));
+        }
+        if (auto* n = nodeAs<AstStructType>(node)) {
+            vector<uint32_t> fieldList;
+            for (auto& [field, tag] : n->fields) {
+                uint32_t identifiers = names(field.named.identifierList);
+                uint32_t type = convert(identifiers != 0 ? field.named.type : field.typeName);
+                fieldList.push_back(add(NK_FIELD, identifiers, type, symbols.intern(tag)));
+            }
+            return add(NK_STRUCT_TYPE, list(fieldList));
+        }
+        if (auto* n = nodeAs<AstPointerType>(node)) {
+            return add(NK_POINTER_TYPE, convert(n->baseType));
+        }
+        if (auto* n = nodeAs<AstFunctionType>(node)) return convert(n->signature);
+        if (auto* n = nodeAs<AstSignature>(node)) {
+            uint32_t parameters = fields(n->parameters);
+            return add(NK_FUNC_TYPE, parameters, results(n->result));
+        }
+        if (auto* n = nodeAs<AstInterfaceType>(node)) {
+            return add(NK_INTERFACE_TYPE, list(n->methodSpec));
+        }
+        if (auto* n = nodeAs<AstMethodSpec>(node)) {
+            if (auto* name = dynamic_cast<AstMethodName*>(n->ams.named.methodName)) {
+                return add(NK_METHOD_SPEC, name->methodName, convert(n->ams.named.signature));
+            }
+            return convert(n->ams.interfaceTypeName);
+        }
+        if (auto* n = nodeAs<AstMapType>(node)) {
+            uint32_t key = convert(n->keyType);
+            return add(NK_MAP_TYPE, key, convert(n->elementType));
+        }
+        if (auto* n = nodeAs<AstChannelType>(node)) {
+            return add(NK_CHAN_TYPE, convert(n->elementType), 0, 0, 0, TokenType(0),
+                (n->sendOnly ? F_SEND_ONLY : 0) | (n->recvOnly ? F_RECV_ONLY : 0));
+        }
+        // statements
+        if (auto* n = nodeAs<AstBlock>(node)) return add(NK_BLOCK, list(n->statementList));
+        if (auto* n = nodeAs<AstLazyBlock>(node)) return convert(bodyOf(n));
+        if (auto* n = nodeAs<AstStatement>(node)) return convert(n->as.declaration);
+        if (auto* n = nodeAs<AstSimpleStmt>(node)) return convert(n->ass.expressionStmt);
+        if (auto* n = nodeAs<AstLabeledStmt>(node)) {
+            return add(NK_LABELED_STMT, n->identifier, convert(n->statement));
+        }
+        if (auto* n = nodeAs<AstExpressionStmt>(node)) {
+            return add(NK_EXPR_STMT, convert(n->expression));
+        }
+        if (auto* n = nodeAs<AstSendStmt>(node)) {
+            uint32_t channel = convert(n->receiver);
+            return add(NK_SEND_STMT, channel, convert(n->sender));
+        }
+        if (auto* n = nodeAs<AstIncDecStmt>(node)) {
+            return add(NK_INC_DEC_STMT, convert(n->expression), 0, 0, 0, n->isInc ? OP_INC : OP_DEC);
+        }
+        if (auto* n = nodeAs<AstAssignment>(node)) {
+            uint32_t lhs = list(n->lhs);
+            return add(NK_ASSIGN_STMT, lhs, list(n->rhs), 0, 0, n->assignOp);
+        }
+        if (auto* n = nodeAs<AstShortVarDecl>(node)) {
+            uint32_t lhs = nameNodes(n->lhs);
+            return add(NK_ASSIGN_STMT, lhs, list(n->rhs), 0, 0, OP_SHORTAGN);
+        }
+        if (auto* n = nodeAs<AstGoStmt>(node)) return add(NK_GO_STMT, convert(n->expression));
+        if (auto* n = nodeAs<AstDeferStmt>(node)) {
+            return add(NK_DEFER_STMT, convert(n->expression));
+        }
+        if (auto* n = nodeAs<AstReturnStmt>(node)) {
+            return add(NK_RETURN_STMT, list(n->expressionList));
+        }
+        if (auto* n = nodeAs<AstBreakStmt>(node)) {
+            return add(NK_BRANCH_STMT, n->label, 0, 0, 0, KW_break);
+        }
+        if (auto* n = nodeAs<AstContinueStmt>(node)) {
+            return add(NK_BRANCH_STMT, n->label, 0, 0, 0, KW_continue);
+        }
+        if (auto* n = nodeAs<AstGotoStmt>(node)) {
+            return add(NK_BRANCH_STMT, n->label, 0, 0, 0, KW_goto);
+        }
+        if (nodeAs<AstFallthroughStmt>(node)) {
+            return add(NK_BRANCH_STMT, 0, 0, 0, 0, KW_fallthrough);
+        }
+        if (auto* n = nodeAs<AstIfStmt>(node)) {
+            uint32_t init = convert(n->condition);
+            uint32_t condition = convert(n->expression);
+            uint32_t then = convert(n->block);
+            return add(NK_IF_STMT, init, condition, then, convert(n->ais.block));
+        }
+        if (auto* n = nodeAs<AstSwitchStmt>(node)) {
+            uint32_t init = convert(n->condition);
+            uint32_t tag = convert(n->conditionExpr);
+            return add(NK_SWITCH_STMT, init, tag, list(n->exprCaseClause), 0, TokenType(0),
+                n->isTypeSwitch ? F_TYPE_SWITCH : 0);
+        }
+        if (auto* n = nodeAs<AstExprCaseClause>(node)) {
+            auto* switchCase = dynamic_cast<AstExprSwitchCase*>(n->exprSwitchCase);
+            uint32_t expressions = switchCase->isDefault ? 0 : list(switchCase->expressionList);
+            return add(NK_CASE_CLAUSE, expressions, list(n->statementList));
+        }
+        if (auto* n = nodeAs<AstSelectStmt>(node)) {
+            return add(NK_SELECT_STMT, list(n->commClause));
+        }
+        if (auto* n = nodeAs<AstCommClause>(node)) {
+            auto* commCase = dynamic_cast<AstCommCase*>(n->commCase);
+            uint32_t comm = commCase->isDefault ? 0 : convert(commCase->acc.sendStmt);
+            return add(NK_COMM_CLAUSE, comm, list(n->statementList));
+        }
+        if (auto* n = nodeAs<AstRecvStmt>(node)) {
+            if (dynamic_cast<AstIdentifierList*>(n->ars.identifierList) != nullptr) {
+                uint32_t lhs = nameNodes(n->ars.identifierList);
+                return add(NK_ASSIGN_STMT, lhs, list(vector<uint32_t>{ convert(n->recvExpr) }), 0, 0,
+                    OP_SHORTAGN);
+            }
+            if (n->ars.expressionList != nullptr) {
+                uint32_t lhs = list(n->ars.expressionList);
+                return add(NK_ASSIGN_STMT, lhs, list(vector<uint32_t>{ convert(n->recvExpr) }), 0, 0,
+                    OP_AGN);
+            }
+            return add(NK_EXPR_STMT, convert(n->recvExpr));
+        }
+        if (auto* n = nodeAs<AstForStmt>(node)) {
+            if (auto* clause = dynamic_cast<AstForClause*>(n->afs.forClause)) {
+                uint32_t init = convert(clause->initStmt);
+                uint32_t condition = convert(clause->condition);
+                uint32_t post = convert(clause->postStmt);
+                return add(NK_FOR_STMT, init, condition, post, convert(n->block));
+            }
+            if (auto* range = dynamic_cast<AstRangeClause*>(n->afs.rangeClause)) {
+                uint32_t lhs = 0;
+                TokenType token = TokenType(0);
+                if (dynamic_cast<AstIdentifierList*>(range->arc.identifierList) != nullptr) {
+                    lhs = nameNodes(range->arc.identifierList);
+                    token = OP_SHORTAGN;
+                }
+                else if (range->arc.expressionList != nullptr) {
+                    lhs = list(range->arc.expressionList);
+                    token = OP_AGN;
+                }
+                uint32_t expression = convert(range->expression);
+                return add(NK_RANGE_STMT, lhs, expression, convert(n->block), 0, token);
+            }
+            uint32_t condition = convert(n->afs.condition);
+            return add(NK_FOR_STMT, 0, condition, 0, convert(n->block));
+        }
+        // expressions
+        if (auto* n = nodeAs<AstExpression>(node)) {
+            if (n->ae.named.rhs == nullptr) return convert(n->ae.unaryExpr);
+            uint32_t x = convert(n->ae.named.lhs);
+            return add(NK_BINARY, x, convert(n->ae.named.rhs), 0, 0, n->ae.named.binaryOp);
+        }
+        if (auto* n = nodeAs<AstUnaryExpr>(node)) {
+            if (dynamic_cast<AstPrimaryExpr*>(n->aue.primaryExpr) != nullptr) {
+                return convert(n->aue.primaryExpr);
+            }
+            return add(NK_UNARY, convert(n->aue.named.unaryExpr), 0, 0, 0, n->aue.named.unaryOp);
+        }
+        if (auto* n = nodeAs<AstPrimaryExpr>(node)) {
+            const AstNode* suffix = n->ape.selector.selector;
+            if (auto* s = nodeAs<AstSelector>(suffix)) {
+                return add(NK_SELECTOR, convert(n->ape.selector.primaryExpr), s->identifier);
+            }
+            if (auto* s = nodeAs<AstIndex>(suffix)) {
+                uint32_t x = convert(n->ape.index.primaryExpr);
+                return add(NK_INDEX, x, convert(s->expression));
+            }
+            if (auto* s = nodeAs<AstSlice>(suffix)) {
+                uint32_t x = convert(n->ape.slice.primaryExpr);
+                uint32_t low = convert(s->start);
+                uint32_t high = convert(s->stop);
+                return add(NK_SLICE, x, low, high, convert(s->step));
+            }
+            if (auto* s = nodeAs<AstTypeAssertion>(suffix)) {
+                uint32_t x = convert(n->ape.typeAssertion.primaryExpr);
+                return add(NK_TYPE_ASSERT, x, convert(s->type));
+            }
+            if (auto* s = nodeAs<AstArgument>(suffix)) {
+                uint32_t function = convert(n->ape.argument.primaryExpr);
+                uint32_t arguments = s->aa.expressionList == nullptr ?
+                    list(vector<uint32_t>{}) : list(s->aa.expressionList);
+                return add(NK_CALL, function, arguments, 0, 0, TokenType(0),
+                    s->isVariadic ? F_VARIADIC : 0);
+            }
+            return convert(n->ape.operand);
+        }
+        // a name, a literal, a parenthesized expression or a type
+        if (auto* n = nodeAs<AstOperand>(node)) return convert(n->ao.literal);
+        if (auto* n = nodeAs<AstOperandName>(node)) {
+            return add(NK_NAME, n->operandName);
+        }
+        if (auto* n = nodeAs<AstLiteral>(node)) return convert(n->al.basicLit);
+        if (auto* n = nodeAs<AstBasicLit>(node)) {
+            return add(NK_BASIC_LIT, symbols.intern(n->value), 0, 0, 0, n->type);
+        }
+        if (auto* n = nodeAs<AstCompositeLit>(node)) {
+            uint32_t type = 0;
+            if (dynamic_cast<AstExpression*>(n->acl.arrayType.arrayLength) != nullptr) {
+                uint32_t length = convert(n->acl.arrayType.arrayLength);
+                type = add(NK_ARRAY_TYPE, length, convert(n->acl.arrayType.elementType));
+            }
+            else if (n->acl.automaticLengthArrayType.automaticLength) {
+                type = add(NK_ARRAY_TYPE, 0, convert(n->acl.automaticLengthArrayType.elementType));
+            }
+            else {
+                type = convert(n->acl.typeName);
+            }
+            return add(NK_COMPOSITE_LIT, type, elements(n->literalValue));
+        }
+        if (auto* n = nodeAs<AstLiteralValue>(node)) {
+            return add(NK_COMPOSITE_LIT, 0, list(n->keyedElement));
+        }
+        if (auto* n = nodeAs<AstKeyedElement>(node)) {
+            if (n->key == nullptr) return convert(n->element);
+            uint32_t key = convert(n->key);
+            return add(NK_KEYED_ELEMENT, key, convert(n->element));
+        }
+        if (auto* n = nodeAs<AstKey>(node)) return convert(n->ak.expression);
+        if (auto* n = nodeAs<AstElement>(node)) return convert(n->ae.expression);
+        if (auto* n = nodeAs<AstFunctionLit>(node)) {
+            uint32_t signature = convert(n->signature);
+            return add(NK_FUNC_LIT, signature, convert(n->functionBody));
+        }
+        if (auto* n = nodeAs<AstConversion>(node)) {
+            uint32_t type = convert(n->type);
+            return add(NK_CALL, type, list(vector<uint32_t>{ convert(n->expression) }));
+        }
+        throw runtime_error("node can not be flattened");
+    }
+};
+
+Tree flatten(const AstNode* sourceFile) {
+    Tree tree;
+    TreeBuilder builder{ tree, {} };
+    tree.root = builder.convert(sourceFile);
+    return tree;
+}
+
+// The files of one package, in the order they were given.
+struct Package {
+    Symbol name;
+    vector<const Tree*> files;
+    vector<string> filenames;
+};
+//===----------------------------------------------------------------------===//
+// constant values
+//===----------------------------------------------------------------------===//
+// Go constants are exact: integers of any size, and floats as fractions of
+// them, are folded at compile time. Nearly every integer constant fits 64 bits,
+// so a Constant holds those inline and folds them without allocating. Only an
+// operation that overflows falls back to magnitudes in 32-bit limbs, and its
+// result goes into the arena only when it still does not fit.
+
+// A magnitude, least significant limb first, without leading zero limbs.
+using Limbs = vector<uint32_t>;
+
+struct BigInt {
+    bool negative = false;
+    Limbs limbs;
+};
+
+namespace limbs {
+void trim(Limbs& a) {
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+int compare(const Limbs& a, const Limbs& b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+Limbs add(const Limbs& a, const Limbs& b) {
+    const Limbs& x = a.size() >= b.size() ? a : b;
+    const Limbs& y = a.size() >= b.size() ? b : a;
+    Limbs r(x.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+        uint64_t s = uint64_t(x[i]) + (i < y.size() ? y[i] : 0) + carry;
+        r[i] = uint32_t(s);
+        carry = s >> 32;
+    }
+    r[x.size()] = uint32_t(carry);
+    trim(r);
+    return r;
+}
+// a - b where a >= b
+Limbs sub(const Limbs& a, const Limbs& b) {
+    Limbs r(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t d = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        r[i] = uint32_t(d);
+        borrow = d < 0;
+    }
+    trim(r);
+    return r;
+}
+Limbs mul(const Limbs& a, const Limbs& b) {
+    if (a.empty() || b.empty()) return {};
+    Limbs r(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            uint64_t p = uint64_t(a[i]) * b[j] + r[i + j] + carry;
+            r[i + j] = uint32_t(p);
+            carry = p >> 32;
+        }
+        r[i + b.size()] = uint32_t(carry);
+    }
+    trim(r);
+    return r;
+}
+Limbs shiftLeft(const Limbs& a, uint64_t n) {
+    if (a.empty()) return {};
+    size_t words = n / 32, bits = n % 32;
+    Limbs r(a.size() + words + 1);
+    for (size_t i = 0; i < a.size(); i++) {
+        r[i + words] |= a[i] << bits;
+        if (bits != 0) r[i + words + 1] = a[i] >> (32 - bits);
+    }
+    trim(r);
+    return r;
+}
+Limbs shiftRight(const Limbs& a, uint64_t n) {
+    size_t words = n / 32, bits = n % 32;
+    if (words >= a.size()) return {};
+    Limbs r(a.size() - words);
+    for (size_t i = 0; i < r.size(); i++) {
+        r[i] = a[i + words] >> bits;
+        if (bits != 0 && i + words + 1 < a.size()) r[i] |= a[i + words + 1] << (32 - bits);
+    }
+    trim(r);
+    return r;
+}
+// q = a / b and r = a % b, b not zero, by Knuth's algorithm D.
+void divMod(const Limbs& a, const Limbs& b, Limbs& q, Limbs& r) {
+    if (compare(a, b) < 0) {
+        q.clear();
+        r = a;
+        return;
+    }
+    if (b.size() == 1) {
+        uint64_t rem = 0;
+        q.assign(a.size(), 0);
+        for (size_t i = a.size(); i-- > 0;) {
+            uint64_t cur = rem << 32 | a[i];
+            q[i] = uint32_t(cur / b[0]);
+            rem = cur % b[0];
+        }
+        trim(q);
+        r.clear();
+        if (rem != 0) r.push_back(uint32_t(rem));
+        return;
+    }
+    // scaled so that the top limb of the divisor has its high bit set, which
+    // keeps each estimated quotient limb at most two too large
+    int s = 31 - highestBit(b.back());
+    Limbs u = shiftLeft(a, s), v = shiftLeft(b, s);
+    size_t n = v.size(), m = a.size() - n;
+    u.resize(a.size() + 1);
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t top = uint64_t(u[j + n]) << 32 | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1], rhat = top % v[n - 1];
+        while (qhat > 0xffffffffu || qhat * v[n - 2] > (rhat << 32 | u[j + n - 2])) {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat > 0xffffffffu) break;
+        }
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * v[i] + carry;
+            carry = p >> 32;
+            int64_t d = int64_t(u[i + j]) - borrow - int64_t(p & 0xffffffffu);
+            u[i + j] = uint32_t(d);
+            borrow = d < 0;
+        }
+        int64_t d = int64_t(u[j + n]) - borrow - int64_t(carry);
+        u[j + n] = uint32_t(d);
+        if (d < 0) {
+            // the estimate was one too large, add the divisor back
+            qhat--;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t sum = uint64_t(u[i + j]) + v[i] + c;
+                u[i + j] = uint32_t(sum);
+                c = sum >> 32;
+            }
+            u[j + n] += uint32_t(c);
+        }
+        q[j] = uint32_t(qhat);
+    }
+    trim(q);
+    u.resize(n);
+    trim(u);
+    r = shiftRight(u, s);
+}
+uint64_t bitLength(const Limbs& a) {
+    return a.empty() ? 0 : (a.size() - 1) * 32 + highestBit(a.back()) + 1;
+}
+} // namespace limbs
+
+BigInt bigInt(int64_t v) {
+    BigInt r;
+    r.negative = v < 0;
+    uint64_t m = v < 0 ? 0 - uint64_t(v) : uint64_t(v);
+    if (m != 0) r.limbs.push_back(uint32_t(m));
+    if (m >> 32 != 0) r.limbs.push_back(uint32_t(m >> 32));
+    return r;
+}
+// Whether a fits 64 bits, which it is then stored in.
+bool smallInt(const BigInt& a, int64_t& v) {
+    if (a.limbs.size() > 2) return false;
+    uint64_t m = 0;
+    for (size_t i = a.limbs.size(); i-- > 0;) m = m << 32 | a.limbs[i];
+    if (m > uint64_t(INT64_MAX) + a.negative) return false;
+    v = a.negative ? int64_t(0 - m) : int64_t(m);
+    return true;
+}
+int sign(const BigInt& a) {
+    return a.limbs.empty() ? 0 : a.negative ? -1 : 1;
+}
+BigInt neg(BigInt a) {
+    a.negative = !a.negative && !a.limbs.empty();
+    return a;
+}
+int compare(const BigInt& a, const BigInt& b) {
+    if (a.negative != b.negative) return a.negative ? -1 : 1;
+    int c = limbs::compare(a.limbs, b.limbs);
+    return a.negative ? -c : c;
+}
+BigInt add(const BigInt& a, const BigInt& b) {
+    BigInt r;
+    if (a.negative == b.negative) {
+        r.limbs = limbs::add(a.limbs, b.limbs);
+        r.negative = a.negative;
+    }
+    else if (limbs::compare(a.limbs, b.limbs) >= 0) {
+        r.limbs = limbs::sub(a.limbs, b.limbs);
+        r.negative = a.negative;
+    }
+    else {
+        r.limbs = limbs::sub(b.limbs, a.limbs);
+        r.negative = b.negative;
+    }
+    r.negative = r.negative && !r.limbs.empty();
+    return r;
+}
+BigInt sub(const BigInt& a, const BigInt& b) { return add(a, neg(b)); }
+BigInt mul(const BigInt& a, const BigInt& b) {
+    BigInt r;
+    r.limbs = limbs::mul(a.limbs, b.limbs);
+    r.negative = a.negative != b.negative && !r.limbs.empty();
+    return r;
+}
+// Quotient truncated toward zero and the remainder with the sign of a.
+void quoRem(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r) {
+    limbs::divMod(a.limbs, b.limbs, q.limbs, r.limbs);
+    q.negative = a.negative != b.negative && !q.limbs.empty();
+    r.negative = a.negative && !r.limbs.empty();
+}
+BigInt shiftLeft(const BigInt& a, uint64_t n) {
+    BigInt r;
+    r.limbs = limbs::shiftLeft(a.limbs, n);
+    r.negative = a.negative;
+    return r;
+}
+// Rounds toward negative infinity, as an arithmetic shift does.
+BigInt shiftRight(const BigInt& a, uint64_t n) {
+    BigInt r;
+    if (!a.negative) {
+        r.limbs = limbs::shiftRight(a.limbs, n);
+        return r;
+    }
+    // -((|a| - 1) >> n) - 1
+    r.limbs = limbs::add(limbs::shiftRight(limbs::sub(a.limbs, { 1 }), n), { 1 });
+    r.negative = true;
+    return r;
+}
+// Bitwise operations on the infinite two's complement of a and b.
+template <class Op>
+BigInt bitwise(const BigInt& a, const BigInt& b, Op&& op) {
+    size_t size = max(a.limbs.size(), b.limbs.size()) + 1;
+    auto twos = [&](const BigInt& x) {
+        Limbs r = x.limbs;
+        r.resize(size);
+        if (x.negative) {
+            uint64_t carry = 1;
+            for (auto& limb : r) {
+                uint64_t s = uint64_t(~limb) + carry;
+                limb = uint32_t(s);
+                carry = s >> 32;
+            }
+        }
+        return r;
+    };
+    Limbs x = twos(a), y = twos(b);
+    BigInt r;
+    for (size_t i = 0; i < size; i++) x[i] = op(x[i], y[i]);
+    if (x.back() >> 31) {
+        r.negative = true;
+        uint64_t carry = 1;
+        for (auto& limb : x) {
+            uint64_t s = uint64_t(~limb) + carry;
+            limb = uint32_t(s);
+            carry = s >> 32;
+        }
+    }
+    limbs::trim(x);
+    r.limbs = move(x);
+    return r;
+}
+BigInt gcd(BigInt a, BigInt b) {
+    a.negative = b.negative = false;
+    while (!b.limbs.empty()) {
+        BigInt q, r;
+        quoRem(a, b, q, r);
+        a = move(b);
+        b = move(r);
+    }
+    return a;
+}
+string toString(const BigInt& a) {
+    if (a.limbs.empty()) return "0";
+    string digits;
+    Limbs m = a.limbs, q, r;
+    while (!m.empty()) {
+        limbs::divMod(m, { 1000000000 }, q, r);
+        uint32_t chunk = r.empty() ? 0 : r[0];
+        for (int i = 0; i < 9 && (chunk != 0 || !q.empty()); i++, chunk /= 10) digits += char('0' + chunk % 10);
+        m = move(q);
+    }
+    if (a.negative) digits += '-';
+    return string(digits.rbegin(), digits.rend());
+}
+
+// A fraction in lowest terms, its denominator positive.
+struct Rational {
+    BigInt num, den;
+};
+
+Rational rational(BigInt num, BigInt den) {
+    if (den.negative) {
+        num = neg(move(num));
+        den = neg(move(den));
+    }
+    BigInt g = gcd(num, den);
+    if (g.limbs.size() != 1 || g.limbs[0] != 1) {
+        BigInt r;
+        quoRem(BigInt(num), g, num, r);
+        quoRem(BigInt(den), g, den, r);
+    }
+    return { move(num), move(den) };
+}
+Rational add(const Rational& a, const Rational& b) {
+    return rational(add(mul(a.num, b.den), mul(b.num, a.den)), mul(a.den, b.den));
+}
+Rational sub(const Rational& a, const Rational& b) {
+    return rational(sub(mul(a.num, b.den), mul(b.num, a.den)), mul(a.den, b.den));
+}
+Rational mul(const Rational& a, const Rational& b) {
+    return rational(mul(a.num, b.num), mul(a.den, b.den));
+}
+Rational quo(const Rational& a, const Rational& b) {
+    return rational(mul(a.num, b.den), mul(a.den, b.num));
+}
+int compare(const Rational& a, const Rational& b) {
+    return compare(mul(a.num, b.den), mul(b.num, a.den));
+}
+bool isInteger(const Rational& a) {
+    return a.den.limbs.size() == 1 && a.den.limbs[0] == 1;
+}
+// The magnitude of a rounded to the nearest of the floats with precision
+// significant bits whose least exponent is least, ties to even, as m * 2^e.
+void roundFloat(const Rational& a, int precision, int64_t least, uint64_t& m, int64_t& e) {
+    m = 0;
+    e = 0;
+    int64_t bits = int64_t(limbs::bitLength(a.num.limbs)) - int64_t(limbs::bitLength(a.den.limbs));
+    // |a| < 2^(bits + 1), so it is too small to round up to the least float
+    if (a.num.limbs.empty() || bits + 1 < least) return;
+    Limbs q, r, den;
+    for (e = max(bits - precision, least);; e++) {
+        Limbs num = e < 0 ? limbs::shiftLeft(a.num.limbs, -e) : a.num.limbs;
+        den = e > 0 ? limbs::shiftLeft(a.den.limbs, e) : a.den.limbs;
+        limbs::divMod(num, den, q, r);
+        if (limbs::bitLength(q) <= uint64_t(precision)) break;
+    }
+    for (size_t i = q.size(); i-- > 0;) m = m << 32 | q[i];
+    int half = limbs::compare(limbs::shiftLeft(r, 1), den);
+    if (half > 0 || (half == 0 && (m & 1) != 0)) m++;
+    if (m >> precision != 0) {
+        m >>= 1;
+        e++;
+    }
+}
+// The nearest double, which is infinite when a is too large for one.
+double toDouble(const Rational& a) {
+    int64_t bits = int64_t(limbs::bitLength(a.num.limbs)) - int64_t(limbs::bitLength(a.den.limbs));
+    if (bits > 1100) return a.num.negative ? -HUGE_VAL : HUGE_VAL;
+    uint64_t m;
+    int64_t e;
+    roundFloat(a, 53, -1074, m, e);
+    double d = ldexp(double(m), int(e));
+    return a.num.negative ? -d : d;
+}
+// The value of a as a float32, or a float64 if not single, exactly.
+Rational roundFloat(const Rational& a, bool single) {
+    int64_t bits = int64_t(limbs::bitLength(a.num.limbs)) - int64_t(limbs::bitLength(a.den.limbs));
+    // too large for either, which its caller reports
+    if (bits > 1100) return a;
+    uint64_t m;
+    int64_t e;
+    roundFloat(a, single ? 24 : 53, single ? -149 : -1074, m, e);
+    BigInt num = bigInt(int64_t(m));
+    num.negative = a.num.negative && m != 0;
+    if (e >= 0) return rational(shiftLeft(num, e), bigInt(1));
+    return rational(move(num), shiftLeft(bigInt(1), -e));
+}
+
+enum ConstantKind : uint8_t {
+    // a value that is not folded, e.g. of a literal too large to be worth it
+    CV_UNKNOWN, CV_BOOL, CV_STRING,
+    // an integer fitting 64 bits, and one that does not
+    CV_INT, CV_BIG_INT,
+    CV_FLOAT, CV_COMPLEX
+};
+struct Complex {
+    Rational real, imag;
+};
+// The value of a constant. It is ordered by kind: an integer of a float
+// type or a float of a complex type is represented as the smaller kind until
+// it is converted.
+struct Constant {
+    ConstantKind kind = CV_UNKNOWN;
+    union {
+        // a bool, or an int
+        int64_t small = 0;
+        const BigInt* big;
+        const Rational* ratio;
+        const Complex* complex;
+        const string* text;
+    };
+
+    bool known() const { return kind != CV_UNKNOWN; }
+    bool isInt() const { return kind == CV_INT || kind == CV_BIG_INT; }
+};
+
+Constant constantBool(bool v) {
+    Constant c;
+    c.kind = CV_BOOL;
+    c.small = v;
+    return c;
+}
+Constant constantInt(int64_t v) {
+    Constant c;
+    c.kind = CV_INT;
+    c.small = v;
+    return c;
+}
+Constant constantInt(BigInt v, Arena& arena) {
+    int64_t small;
+    if (smallInt(v, small)) return constantInt(small);
+    Constant c;
+    c.kind = CV_BIG_INT;
+    c.big = arena.make<BigInt>(move(v));
+    return c;
+}
+Constant constantFloat(Rational v, Arena& arena) {
+    Constant c;
+    c.kind = CV_FLOAT;
+    c.ratio = arena.make<Rational>(move(v));
+    return c;
+}
+Constant constantComplex(Rational real, Rational imag, Arena& arena) {
+    Constant c;
+    c.kind = CV_COMPLEX;
+    c.complex = arena.make<Complex>(Complex{ move(real), move(imag) });
+    return c;
+}
+Constant constantString(string v, Arena& arena) {
+    Constant c;
+    c.kind = CV_STRING;
+    c.text = arena.make<string>(move(v));
+    return c;
+}
+
+BigInt toBigInt(const Constant& c) {
+    return c.kind == CV_INT ? bigInt(c.small) : *c.big;
+}
+Rational toRational(const Constant& c) {
+    return c.kind == CV_FLOAT ? *c.ratio : Rational{ toBigInt(c), bigInt(1) };
+}
+Complex toComplex(const Constant& c) {
+    return c.kind == CV_COMPLEX ? *c.complex : Complex{ toRational(c), { bigInt(0), bigInt(1) } };
+}
+
+// c as a value of kind, CV_INT standing for both integer kinds, unknown when
+// it is not representable as one, e.g. a float with a fraction as an integer.
+Constant convertConstant(const Constant& c, ConstantKind kind, Arena& arena) {
+    if (!c.known() || c.kind == kind || (kind == CV_INT && c.isInt())) return c;
+    if (c.kind == CV_BOOL || c.kind == CV_STRING || kind == CV_BOOL || kind == CV_STRING) return {};
+    switch (kind) {
+    case CV_INT: {
+        if (c.kind == CV_COMPLEX && !c.complex->imag.num.limbs.empty()) return {};
+        const Rational& r = c.kind == CV_COMPLEX ? c.complex->real : *c.ratio;
+        return isInteger(r) ? constantInt(r.num, arena) : Constant();
+    }
+    case CV_FLOAT:
+        if (c.kind == CV_COMPLEX) {
+            if (!c.complex->imag.num.limbs.empty()) return {};
+            return constantFloat(c.complex->real, arena);
+        }
+        return constantFloat(toRational(c), arena);
+    case CV_COMPLEX: {
+        Complex v = toComplex(c);
+        return constantComplex(move(v.real), move(v.imag), arena);
+    }
+    default:
+        return {};
+    }
+}
+
+int constantSign(const Constant& c) {
+    switch (c.kind) {
+    case CV_INT: return c.small < 0 ? -1 : c.small > 0;
+    case CV_BIG_INT: return sign(*c.big);
+    case CV_FLOAT: return sign(c.ratio->num);
+    default: return 0;
+    }
+}
+
+bool constantIsZero(const Constant& c) {
+    switch (c.kind) {
+    case CV_INT: return c.small == 0;
+    case CV_FLOAT: return c.ratio->num.limbs.empty();
+    case CV_COMPLEX: return c.complex->real.num.limbs.empty() && c.complex->imag.num.limbs.empty();
+    default: return false;
+    }
+}
+
+// op x, x being a negative, an untyped integer, or an unsigned integer of
+// unsignedBits bits.
+Constant constantUnary(TokenType op, const Constant& x, int unsignedBits, Arena& arena) {
+    switch (x.kind) {
+    case CV_BOOL: return op == OP_NOT ? constantBool(!x.small) : Constant();
+    case CV_INT:
+        if (op == OP_ADD) return x;
+        if (op == OP_SUB && x.small != INT64_MIN) return constantInt(-x.small);
+        if (op == OP_XOR && unsignedBits == 0) return constantInt(~x.small);
+        break;
+    case CV_BIG_INT: break;
+    case CV_FLOAT:
+        if (op == OP_ADD) return x;
+        if (op == OP_SUB) return constantFloat({ neg(x.ratio->num), x.ratio->den }, arena);
+        return {};
+    case CV_COMPLEX:
+        if (op == OP_ADD) return x;
+        if (op == OP_SUB) {
+            auto& c = *x.complex;
+            return constantComplex({ neg(c.real.num), c.real.den }, { neg(c.imag.num), c.imag.den }, arena);
+        }
+        return {};
+    default:
+        return {};
+    }
+    BigInt v = toBigInt(x);
+    switch (op) {
+    case OP_ADD: return x;
+    case OP_SUB: return constantInt(neg(move(v)), arena);
+    case OP_XOR:
+        if (unsignedBits == 0) return constantInt(sub(neg(move(v)), bigInt(1)), arena);
+        // the complement within the width of the type
+        return constantInt(sub(sub(shiftLeft(bigInt(1), unsignedBits), bigInt(1)), v), arena);
+    default: return {};
+    }
+}
+
+// x op y for the arithmetic, logical and bitwise operators, with y not zero for
+// a division. Integers are divided as integers unless integerDivision is false.
+Constant constantBinary(TokenType op, Constant x, Constant y, bool integerDivision, Arena& arena) {
+    if (!x.known() || !y.known()) return {};
+    if (x.kind == CV_BOOL && y.kind == CV_BOOL) {
+        if (op == OP_AND) return constantBool(x.small && y.small);
+        if (op == OP_OR) return constantBool(x.small || y.small);
+        return {};
+    }
+    if (x.kind == CV_STRING && y.kind == CV_STRING) {
+        return op == OP_ADD ? constantString(*x.text + *y.text, arena) : Constant();
+    }
+    if (x.kind == CV_BOOL || x.kind == CV_STRING || y.kind == CV_BOOL || y.kind == CV_STRING) return {};
+    ConstantKind kind = max(x.kind, y.kind);
+    if (kind <= CV_BIG_INT && op == OP_DIV && !integerDivision) kind = CV_FLOAT;
+    if (kind == CV_INT) {
+        int64_t a = x.small, b = y.small, r;
+        switch (op) {
+        case OP_ADD: if (!addOverflows(a, b, r)) return constantInt(r); break;
+        case OP_SUB: if (!subOverflows(a, b, r)) return constantInt(r); break;
+        case OP_MUL: if (!mulOverflows(a, b, r)) return constantInt(r); break;
+        case OP_DIV: if (a != INT64_MIN || b != -1) return constantInt(a / b); break;
+        case OP_MOD: if (a != INT64_MIN || b != -1) return constantInt(a % b); break;
+        case OP_BITAND: return constantInt(a & b);
+        case OP_BITOR: return constantInt(a | b);
+        case OP_XOR: return constantInt(a ^ b);
+        case OP_ANDXOR: return constantInt(a & ~b);
+        default: return {};
+        }
+        kind = CV_BIG_INT;
+    }
+    if (kind == CV_BIG_INT) {
+        BigInt a = toBigInt(x), b = toBigInt(y), q, r;
+        switch (op) {
+        case OP_ADD: return constantInt(add(a, b), arena);
+        case OP_SUB: return constantInt(sub(a, b), arena);
+        case OP_MUL: return constantInt(mul(a, b), arena);
+        case OP_DIV: quoRem(a, b, q, r); return constantInt(move(q), arena);
+        case OP_MOD: quoRem(a, b, q, r); return constantInt(move(r), arena);
+        case OP_BITAND: return constantInt(bitwise(a, b, [](uint32_t p, uint32_t q) { return p & q; }), arena);
+        case OP_BITOR: return constantInt(bitwise(a, b, [](uint32_t p, uint32_t q) { return p | q; }), arena);
+        case OP_XOR: return constantInt(bitwise(a, b, [](uint32_t p, uint32_t q) { return p ^ q; }), arena);
+        case OP_ANDXOR: return constantInt(bitwise(a, b, [](uint32_t p, uint32_t q) { return p & ~q; }), arena);
+        default: return {};
+        }
+    }
+    if (kind == CV_FLOAT) {
+        Rational a = toRational(x), b = toRational(y);
+        switch (op) {
+        case OP_ADD: return constantFloat(add(a, b), arena);
+        case OP_SUB: return constantFloat(sub(a, b), arena);
+        case OP_MUL: return constantFloat(mul(a, b), arena);
+        case OP_DIV: return constantFloat(quo(a, b), arena);
+        default: return {};
+        }
+    }
+    Complex a = toComplex(x), b = toComplex(y);
+    switch (op) {
+    case OP_ADD: return constantComplex(add(a.real, b.real), add(a.imag, b.imag), arena);
+    case OP_SUB: return constantComplex(sub(a.real, b.real), sub(a.imag, b.imag), arena);
+    case OP_MUL:
+        return constantComplex(sub(mul(a.real, b.real), mul(a.imag, b.imag)),
+            add(mul(a.real, b.imag), mul(a.imag, b.real)), arena);
+    case OP_DIV: {
+        Rational d = add(mul(b.real, b.real), mul(b.imag, b.imag));
+        return constantComplex(quo(add(mul(a.real, b.real), mul(a.imag, b.imag)), d),
+            quo(sub(mul(a.imag, b.real), mul(a.real, b.imag)), d), arena);
+    }
+    default:
+        return {};
+    }
+}
+
+// The integer x shifted by n bits, which the caller bounds.
+Constant constantShift(TokenType op, const Constant& x, uint64_t n, Arena& arena) {
+    if (x.kind == CV_INT) {
+        if (op == OP_RSHIFT) return constantInt(n >= 63 ? (x.small < 0 ? -1 : 0) : x.small >> n);
+        if (n < 63 && (x.small >= 0 ? x.small : ~x.small) < int64_t(1) << (62 - n)) {
+            return constantInt(x.small * (int64_t(1) << n));
+        }
+    }
+    else if (x.kind != CV_BIG_INT) {
+        return {};
+    }
+    BigInt v = toBigInt(x);
+    return constantInt(op == OP_LSHIFT ? shiftLeft(v, n) : shiftRight(v, n), arena);
+}
+
+// x op y for the comparison operators, false when either is unknown.
+bool constantCompare(TokenType op, const Constant& x, const Constant& y, bool& known) {
+    known = x.known() && y.known() && (x.kind == CV_BOOL) == (y.kind == CV_BOOL) &&
+        (x.kind == CV_STRING) == (y.kind == CV_STRING);
+    if (!known) return false;
+    int c;
+    if (x.kind == CV_BOOL || x.kind == CV_STRING) {
+        c = x.kind == CV_BOOL ? int(x.small) - int(y.small) : x.text->compare(*y.text);
+    }
+    else if (x.kind == CV_INT && y.kind == CV_INT) {
+        c = x.small < y.small ? -1 : x.small > y.small;
+    }
+    else if (max(x.kind, y.kind) <= CV_BIG_INT) {
+        c = compare(toBigInt(x), toBigInt(y));
+    }
+    else if (max(x.kind, y.kind) == CV_FLOAT) {
+        c = compare(toRational(x), toRational(y));
+    }
+    else {
+        // complex numbers are only equal or not
+        Complex a = toComplex(x), b = toComplex(y);
+        c = compare(a.real, b.real) != 0 || compare(a.imag, b.imag) != 0;
+    }
+    switch (op) {
+    case OP_EQ: return c == 0;
+    case OP_NE: return c != 0;
+    case OP_LT: return c < 0;
+    case OP_LE: return c <= 0;
+    case OP_GT: return c > 0;
+    default: return c >= 0;
+    }
+}
+
+// Whether the integer c fits bits bits, signed or not.
+bool fitsBits(const Constant& c, int bits, bool isSigned) {
+    if (c.kind == CV_INT) {
+        if (!isSigned) return c.small >= 0 && (bits == 64 || c.small >> bits == 0);
+        return bits == 64 || (c.small >= -(int64_t(1) << (bits - 1)) && c.small < int64_t(1) << (bits - 1));
+    }
+    // a big integer fits only an unsigned 64-bit type
+    return !isSigned && bits == 64 && !c.big->negative && c.big->limbs.size() == 2;
+}
+// Whether a float value fits a float of max magnitude max.
+bool fitsFloat(const Rational& r, double max) {
+    return fabs(toDouble(r)) <= max;
+}
+
+string constantString(const Constant& c) {
+    char buffer[64];
+    switch (c.kind) {
+    case CV_BOOL: return c.small ? "true" : "false";
+    case CV_STRING: return "\"" + *c.text + "\"";
+    case CV_INT: return to_string(c.small);
+    case CV_BIG_INT: {
+        string digits = toString(*c.big);
+        size_t sign = c.big->negative, length = digits.size() - sign;
+        if (length <= 24) return digits;
+        // shortened as Go does, to the leading digits and the exponent
+        return digits.substr(0, sign + 1) + "." + digits.substr(sign + 1, 5) + "e+" + to_string(length - 1);
+    }
+    case CV_FLOAT:
+        snprintf(buffer, sizeof(buffer), "%g", toDouble(*c.ratio));
+        return buffer;
+    case CV_COMPLEX:
+        snprintf(buffer, sizeof(buffer), "(%g + %gi)", toDouble(c.complex->real), toDouble(c.complex->imag));
+        return buffer;
+    default:
+        return "unknown";
+    }
+}
+
+//===--- literals ---===//
+
+// a literal exponent beyond this is not worth folding, e.g. 1e1000000
+constexpr int64_t maxLiteralExponent = 10000;
+
+// Value of the digits of an integer or the mantissa of a float literal in
+// base, the digits after a dot counted in fraction.
+BigInt literalDigits(string_view text, int base, int64_t& fraction) {
+    BigInt v;
+    uint64_t small = 0, scale = 1;
+    bool dot = false;
+    fraction = 0;
+    auto flush = [&] {
+        v.limbs = limbs::add(limbs::mul(v.limbs, bigInt(int64_t(scale)).limbs), bigInt(int64_t(small)).limbs);
+        small = 0;
+        scale = 1;
+    };
+    for (char c : text) {
+        if (c == '_') continue;
+        if (c == '.') {
+            dot = true;
+            continue;
+        }
+        int digit = isdigit((unsigned char)c) ? c - '0' : tolower(c) - 'a' + 10;
+        small = small * base + digit;
+        scale *= base;
+        fraction += dot;
+        // scale stays below 2^60, one more digit still fits
+        if (scale >= uint64_t(1) << 55) flush();
+    }
+    flush();
+    return v;
+}
+
+// Value of an integer literal.
+Constant intLiteral(string_view text, Arena& arena) {
+    int base = 10;
+    if (text.size() > 1 && text[0] == '0') {
+        char c = char(tolower(text[1]));
+        base = c == 'x' ? 16 : c == 'b' ? 2 : 8;
+        text.remove_prefix(c == 'x' || c == 'b' || c == 'o' ? 2 : 1);
+    }
+    int64_t fraction;
+    return constantInt(literalDigits(text, base, fraction), arena);
+}
+
+// Value of a decimal or hexadecimal float literal, the mantissa times a power
+// of ten or of two.
+Constant floatLiteral(string_view text, Arena& arena) {
+    bool hex = text.size() > 1 && text[0] == '0' && tolower(text[1]) == 'x';
+    if (hex) text.remove_prefix(2);
+    size_t e = text.find_first_of(hex ? "pP" : "eE");
+    int64_t exponent = 0, fraction;
+    if (e != string_view::npos) {
+        bool negative = text[e + 1] == '-';
+        for (char c : text.substr(e + 1)) {
+            if (isdigit((unsigned char)c)) exponent = min(exponent * 10 + (c - '0'), maxLiteralExponent + 1);
+        }
+        if (negative) exponent = -exponent;
+    }
+    BigInt mantissa = literalDigits(text.substr(0, e), hex ? 16 : 10, fraction);
+    exponent -= hex ? fraction * 4 : fraction;
+    if (exponent > maxLiteralExponent || exponent < -maxLiteralExponent) return {};
+    BigInt scale = bigInt(1);
+    if (hex) {
+        scale = shiftLeft(scale, uint64_t(abs(exponent)));
+    }
+    else {
+        // by squaring
+        BigInt power = bigInt(10);
+        for (uint64_t n = uint64_t(abs(exponent)); n != 0; n >>= 1) {
+            if (n & 1) scale = mul(scale, power);
+            if (n > 1) power = mul(power, power);
+        }
+    }
+    if (exponent >= 0) return constantFloat({ mul(mantissa, scale), bigInt(1) }, arena);
+    return constantFloat(rational(move(mantissa), move(scale)), arena);
+}
+
+// Value of an imaginary literal, its digits decimal even with a leading zero.
+Constant imaginaryLiteral(string_view text, Arena& arena) {
+    text.remove_suffix(1);
+    bool hex = text.size() > 1 && text[0] == '0' && tolower(text[1]) == 'x';
+    bool isFloat = text.find_first_of(hex ? ".pP" : ".eE") != string_view::npos;
+    Constant v;
+    if (isFloat) {
+        v = floatLiteral(text, arena);
+    }
+    else if (text.size() > 1 && text[0] == '0' && strchr("xXbBoO", text[1]) != nullptr) {
+        v = intLiteral(text, arena);
+    }
+    else {
+        int64_t fraction;
+        v = constantInt(literalDigits(text, 10, fraction), arena);
+    }
+    if (!v.known()) return v;
+    return constantComplex({ bigInt(0), bigInt(1) }, toRational(v), arena);
+}
+
+// Decodes the character at p of a rune or interpreted string literal, a code
+// point or, for an octal or hex escape, a byte.
+int64_t literalChar(const unsigned char*& p, bool& isByte) {
+    isByte = false;
+    if (*p != '\\') {
+        if (*p < 0x80) return *p++;
+        int extra = *p >= 0xf0 ? 3 : *p >= 0xe0 ? 2 : 1;
+        int64_t v = *p & (0x3f >> extra);
+        while (extra-- > 0) v = v << 6 | (*++p & 0x3f);
+        p++;
+        return v;
+    }
+    char c = char(*++p);
+    p++;
+    auto digits = [&](int n, int base) {
+        int64_t v = 0;
+        for (int i = 0; i < n; i++, p++) v = v * base + (isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10);
+        return v;
+    };
+    switch (c) {
+    case 'a': return 7;
+    case 'b': return 8;
+    case 'f': return 12;
+    case 'n': return 10;
+    case 'r': return 13;
+    case 't': return 9;
+    case 'v': return 11;
+    case 'x': isByte = true; return digits(2, 16);
+    case 'u': return digits(4, 16);
+    case 'U': return digits(8, 16);
+    default:
+        if (c >= '0' && c <= '7') {
+            p--;
+            isByte = true;
+            return digits(3, 8);
+        }
+        return c;
+    }
+}
+
+// Code point of a rune literal, quotes included.
+int64_t runeValue(string_view text) {
+    auto p = reinterpret_cast<const unsigned char*>(text.data()) + 1;
+    bool isByte;
+    return literalChar(p, isByte);
+}
+
+// Writes code point c in UTF-8 to p, the replacement character when it is no
+// valid code point, returning the number of bytes; without p only counts them.
+int encodeUtf8(char* p, int64_t c) {
+    if (c < 0 || c > 0x10ffff || (c >= 0xd800 && c < 0xe000)) c = 0xfffd;
+    int n = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+    if (p == nullptr) return n;
+    if (n == 1) {
+        p[0] = char(c);
+        return 1;
+    }
+    static const unsigned char lead[] = { 0, 0, 0xc0, 0xe0, 0xf0 };
+    for (int i = n - 1; i > 0; i--, c >>= 6) p[i] = char(0x80 | (c & 0x3f));
+    p[0] = char(lead[n] | c);
+    return n;
+}
+void appendUtf8(string& s, int64_t c) {
+    char p[4];
+    s.append(p, size_t(encodeUtf8(p, c)));
+}
+
+// Value of a string literal, quotes included.
+Constant stringLiteral(string_view text, Arena& arena) {
+    string s;
+    if (text[0] == '`') {
+        // carriage returns are dropped from raw strings
+        for (char c : text.substr(1, text.size() - 2)) {
+            if (c != '\r') s += c;
+        }
+        return constantString(move(s), arena);
+    }
+    auto p = reinterpret_cast<const unsigned char*>(text.data()) + 1;
+    auto end = reinterpret_cast<const unsigned char*>(text.data()) + text.size() - 1;
+    while (p < end) {
+        bool isByte;
+        if (*p != '\\') {
+            s += char(*p++);
+            continue;
+        }
+        int64_t c = literalChar(p, isByte);
+        if (isByte) {
+            s += char(c);
+        }
+        else {
+            appendUtf8(s, c);
+        }
+    }
+    return constantString(move(s), arena);
+}
+
+//===----------------------------------------------------------------------===//
+// semantic analysis
+//===----------------------------------------------------------------------===//
+// Names are resolved and types checked on the compact trees, one package at a
+// time in three phases. Collect declares every package level name in the
+// package scope and every import in its file scope. Resolve gives those objects
+// their types, and constants their values, on first use since they may refer
+// to each other in any order; it also checks package level initializers. Both
+// run on one thread. Check then walks the function bodies, which only read what
+// the first two phases built, so they are checked in parallel.
+enum TypeKind : uint8_t {
+    TY_INVALID,
+    // predeclared types, in the order of their names in basicTypeNames
+    TY_BOOL, TY_INT, TY_INT8, TY_INT16, TY_INT32, TY_INT64, TY_UINT, TY_UINT8, TY_UINT16,
+    TY_UINT32, TY_UINT64, TY_UINTPTR, TY_FLOAT32, TY_FLOAT64, TY_COMPLEX64, TY_COMPLEX128,
+    TY_STRING, TY_UNSAFE_POINTER,
+    // types of untyped constants and of nil
+    TY_UNTYPED_BOOL, TY_UNTYPED_INT, TY_UNTYPED_RUNE, TY_UNTYPED_FLOAT, TY_UNTYPED_COMPLEX,
+    TY_UNTYPED_STRING, TY_UNTYPED_NIL,
+    TY_NAMED, TY_ARRAY, TY_SLICE, TY_STRUCT, TY_POINTER, TY_FUNC, TY_INTERFACE, TY_MAP,
+    TY_CHAN, TY_TUPLE
+};
+constexpr const char* basicTypeNames[] = { "invalid type",
+    "bool", "int", "int8", "int16", "int32", "int64", "uint", "uint8", "uint16",
+    "uint32", "uint64", "uintptr", "float32", "float64", "complex64", "complex128",
+    "string", "unsafe.Pointer",
+    "untyped bool", "untyped int", "untyped rune", "untyped float", "untyped complex",
+    "untyped string", "untyped nil" };
+static_assert(sizeof(basicTypeNames) / sizeof(basicTypeNames[0]) == TY_UNTYPED_NIL + 1,
+    "every basic type needs a name");
+
+inline bool isInteger(TypeKind k) {
+    return (k >= TY_INT && k <= TY_UINTPTR) || k == TY_UNTYPED_INT || k == TY_UNTYPED_RUNE;
+}
+inline bool isUnsigned(TypeKind k) { return k >= TY_UINT && k <= TY_UINTPTR; }
+inline bool isFloat(TypeKind k) { return k == TY_FLOAT32 || k == TY_FLOAT64 || k == TY_UNTYPED_FLOAT; }
+inline bool isComplex(TypeKind k) {
+    return k == TY_COMPLEX64 || k == TY_COMPLEX128 || k == TY_UNTYPED_COMPLEX;
+}
+inline bool isNumeric(TypeKind k) { return isInteger(k) || isFloat(k) || isComplex(k); }
+inline bool isString(TypeKind k) { return k == TY_STRING || k == TY_UNTYPED_STRING; }
+inline bool isBoolean(TypeKind k) { return k == TY_BOOL || k == TY_UNTYPED_BOOL; }
+inline bool isUntyped(TypeKind k) { return k >= TY_UNTYPED_BOOL && k <= TY_UNTYPED_NIL; }
+inline bool isBasic(TypeKind k) { return k <= TY_UNTYPED_NIL; }
+// Bits of an integer type, int, uint and uintptr having 64.
+inline int intBits(TypeKind k) {
+    switch (k) {
+    case TY_INT8: case TY_UINT8: return 8;
+    case TY_INT16: case TY_UINT16: return 16;
+    case TY_INT32: case TY_UINT32: return 32;
+    default: return 64;
+    }
+}
+
+struct Object;
+// Types are compared by kind first, the derived struct of a kind holds the rest.
+// Basic types are the static instances of basicType(), named types live in the
+// arena of the package declaring them and composite types in the type table.
+struct Type {
+    TypeKind kind;
+    // the only instance of its structure, identical to another canonical type
+    // only when it is the same one. Basic and named types always are.
+    bool canonical;
+    // of the structure, set by the type table
+    uint32_t hash = 0;
+    explicit Type(TypeKind kind) : kind(kind), canonical(kind <= TY_NAMED) {}
+};
+struct NamedType : Type {
+    Object* object;
+    // nullptr until the declaration is resolved, never a NamedType
+    const Type* underlying = nullptr;
+    // methods declared with this receiver base type, OB_FUNC objects
+    vector<Object*> methods;
+    explicit NamedType(Object* object) : Type(TY_NAMED), object(object) {}
+};
+struct ArrayType : Type {
+    // -1 when the length is not known, e.g. it comes from an unknown package
+    int64_t length;
+    const Type* elem;
+    ArrayType(int64_t length, const Type* elem) : Type(TY_ARRAY), length(length), elem(elem) {}
+};
+struct SliceType : Type {
+    const Type* elem;
+    explicit SliceType(const Type* elem) : Type(TY_SLICE), elem(elem) {}
+};
+struct PointerType : Type {
+    const Type* base;
+    explicit PointerType(const Type* base) : Type(TY_POINTER), base(base) {}
+};
+struct MapType : Type {
+    const Type* key;
+    const Type* elem;
+    MapType(const Type* key, const Type* elem) : Type(TY_MAP), key(key), elem(elem) {}
+};
+enum ChanDir : uint8_t { CHAN_BOTH, CHAN_SEND, CHAN_RECV };
+struct ChanType : Type {
+    const Type* elem;
+    ChanDir dir;
+    ChanType(const Type* elem, ChanDir dir) : Type(TY_CHAN), elem(elem), dir(dir) {}
+};
+struct StructField {
+    Symbol name;
+    const Type* type;
+    Symbol tag;
+    bool embedded;
+};
+struct StructType : Type {
+    vector<StructField> fields;
+    StructType() : Type(TY_STRUCT) {}
+};
+// Parameters, results, and the values of a call with several results.
+struct TupleType : Type {
+    vector<const Type*> types;
+    TupleType() : Type(TY_TUPLE) {}
+};
+struct FuncType : Type {
+    const TupleType* params;
+    const TupleType* results;
+    // the last parameter is a slice taking the trailing arguments
+    bool variadic;
+    FuncType(const TupleType* params, const TupleType* results, bool variadic)
+        : Type(TY_FUNC), params(params), results(results), variadic(variadic) {}
+};
+struct Method {
+    Symbol name;
+    const FuncType* type;
+};
+struct InterfaceType : Type {
+    // declared methods, and once complete those of embedded interfaces too,
+    // sorted by name. Completing the interface fills them in.
+    mutable vector<Method> methods;
+    vector<const Type*> embedded;
+    mutable enum : uint8_t { INCOMPLETE, COMPLETING, COMPLETE } state = INCOMPLETE;
+    // it embeds an interface of another package, so its methods are not all known
+    mutable bool partial = false;
+    InterfaceType() : Type(TY_INTERFACE) {}
+};
+
+const Type* basicType(TypeKind kind) {
+    static const Type types[] = { Type(TY_INVALID),
+        Type(TY_BOOL), Type(TY_INT), Type(TY_INT8), Type(TY_INT16), Type(TY_INT32),
+        Type(TY_INT64), Type(TY_UINT), Type(TY_UINT8), Type(TY_UINT16), Type(TY_UINT32),
+        Type(TY_UINT64), Type(TY_UINTPTR), Type(TY_FLOAT32), Type(TY_FLOAT64),
+        Type(TY_COMPLEX64), Type(TY_COMPLEX128), Type(TY_STRING), Type(TY_UNSAFE_POINTER),
+        Type(TY_UNTYPED_BOOL), Type(TY_UNTYPED_INT), Type(TY_UNTYPED_RUNE),
+        Type(TY_UNTYPED_FLOAT), Type(TY_UNTYPED_COMPLEX), Type(TY_UNTYPED_STRING),
+        Type(TY_UNTYPED_NIL) };
+    return &types[kind];
+}
+inline const Type* invalidType() { return basicType(TY_INVALID); }
+
+//===----------------------------------------------------------------------===//
+// hash-consed types
+//===----------------------------------------------------------------------===//
+// Composite types are built through the type table, which keeps one instance of
+// every structure. Their components are canonical already, so the table hashes
+// and compares them shallowly and identical() becomes a pointer compare. The
+// table is shared by every package and thread of the compilation and works like
+// the interner: lookups never lock, adding a type takes the writer lock and
+// looks again, and a table outgrown stays alive for readers still probing it.
+// A type with a component that is not canonical, i.e. an interface completed
+// only after every declaration is resolved, is built outside the table and
+// compared structurally.
+struct TypeTable {
+    TypeTable() : table(new Table(1024)) { tables.emplace_back(table.load(memory_order_relaxed)); }
+    TypeTable(const TypeTable&) = delete;
+    TypeTable& operator=(const TypeTable&) = delete;
+
+    const ArrayType* array(int64_t length, const Type* elem) { return intern(ArrayType(length, elem)); }
+    const SliceType* slice(const Type* elem) { return intern(SliceType(elem)); }
+    const PointerType* pointer(const Type* base) { return intern(PointerType(base)); }
+    const MapType* map(const Type* key, const Type* elem) { return intern(MapType(key, elem)); }
+    const ChanType* chan(const Type* elem, ChanDir dir) { return intern(ChanType(elem, dir)); }
+    const TupleType* tuple(vector<const Type*> types) {
+        TupleType t;
+        t.types = move(types);
+        return intern(move(t));
+    }
+    const FuncType* func(const TupleType* params, const TupleType* results, bool variadic) {
+        return intern(FuncType(params, results, variadic));
+    }
+    const StructType* structType(vector<StructField> fields) {
+        StructType t;
+        t.fields = move(fields);
+        return intern(move(t));
+    }
+    // The interface with the complete method set methods, sorted by name.
+    const InterfaceType* interfaceType(vector<Method> methods, bool partial) {
+        InterfaceType t;
+        t.methods = move(methods);
+        t.partial = partial;
+        t.state = InterfaceType::COMPLETE;
+        return intern(move(t));
+    }
+    size_t size() const { return count.load(memory_order_acquire); }
+    size_t bytes() const {
+        lock_guard<mutex> lock(writer);
+        return arena.size();
+    }
+
+private:
+    struct Table {
+        explicit Table(uint32_t capacity) : mask(capacity - 1), slots(new atomic<const Type*>[capacity]) {
+            for (uint32_t i = 0; i < capacity; i++) slots[i].store(nullptr, memory_order_relaxed);
+        }
+        uint32_t mask;
+        unique_ptr<atomic<const Type*>[]> slots;
+    };
+    atomic<Table*> table;
+    vector<unique_ptr<Table>> tables;
+    atomic<size_t> count{ 0 };
+    mutable mutex writer;
+    Arena arena;
+
+    template <class T>
+    const T* intern(T&& probe) {
+        bool canonical = true;
+        components(&probe, [&](const Type* c) { canonical = canonical && c->canonical; });
+        if (!canonical) {
+            lock_guard<mutex> lock(writer);
+            return arena.make<T>(move(probe));
+        }
+        uint32_t hash = hashOf(&probe);
+        if (const Type* t = find(*table.load(memory_order_acquire), &probe, hash)) {
+            return static_cast<const T*>(t);
+        }
+        lock_guard<mutex> lock(writer);
+        Table* t = table.load(memory_order_relaxed);
+        if (const Type* found = find(*t, &probe, hash)) return static_cast<const T*>(found);
+        T* type = arena.make<T>(move(probe));
+        type->canonical = true;
+        type->hash = hash;
+        size_t n = count.load(memory_order_relaxed);
+        if ((n + 1) * 2 > t->mask + 1) t = grow(*t);
+        insert(*t, type);
+        count.store(n + 1, memory_order_release);
+        return type;
+    }
+    // Calls visit with every type t is made of.
+    template <class Visit>
+    static void components(const Type* t, Visit&& visit) {
+        switch (t->kind) {
+        case TY_ARRAY: visit(static_cast<const ArrayType*>(t)->elem); break;
+        case TY_SLICE: visit(static_cast<const SliceType*>(t)->elem); break;
+        case TY_POINTER: visit(static_cast<const PointerType*>(t)->base); break;
+        case TY_MAP:
+            visit(static_cast<const MapType*>(t)->key);
+            visit(static_cast<const MapType*>(t)->elem);
+            break;
+        case TY_CHAN: visit(static_cast<const ChanType*>(t)->elem); break;
+        case TY_TUPLE:
+            for (const Type* e : static_cast<const TupleType*>(t)->types) visit(e);
+            break;
+        case TY_FUNC:
+            visit(static_cast<const FuncType*>(t)->params);
+            visit(static_cast<const FuncType*>(t)->results);
+            break;
+        case TY_STRUCT:
+            for (auto& field : static_cast<const StructType*>(t)->fields) visit(field.type);
+            break;
+        case TY_INTERFACE:
+            for (auto& method : static_cast<const InterfaceType*>(t)->methods) visit(method.type);
+            break;
+        default:
+            break;
+        }
+    }
+    static uint32_t mix(uint32_t h, uint64_t v) {
+        v = (v ^ h) * 0x9e3779b97f4a7c15ull;
+        return uint32_t(v >> 32) ^ uint32_t(v);
+    }
+    static uint32_t hashOf(const Type* t) {
+        uint32_t h = mix(0, t->kind);
+        components(t, [&](const Type* c) { h = mix(h, uintptr_t(c)); });
+        switch (t->kind) {
+        case TY_ARRAY: h = mix(h, uint64_t(static_cast<const ArrayType*>(t)->length)); break;
+        case TY_CHAN: h = mix(h, static_cast<const ChanType*>(t)->dir); break;
+        case TY_FUNC: h = mix(h, static_cast<const FuncType*>(t)->variadic); break;
+        case TY_STRUCT:
+            for (auto& field : static_cast<const StructType*>(t)->fields) {
+                h = mix(h, uint64_t(field.name) << 32 | field.tag);
+                h = mix(h, field.embedded);
+            }
+            break;
+        case TY_INTERFACE:
+            for (auto& method : static_cast<const InterfaceType*>(t)->methods) h = mix(h, method.name);
+            h = mix(h, static_cast<const InterfaceType*>(t)->partial);
+            break;
+        default:
+            break;
+        }
+        return h;
+    }
+    // Whether a and b have the same structure, their components compared by
+    // address.
+    static bool equal(const Type* a, const Type* b) {
+        if (a->kind != b->kind) return false;
+        switch (a->kind) {
+        case TY_ARRAY: {
+            auto* x = static_cast<const ArrayType*>(a);
+            auto* y = static_cast<const ArrayType*>(b);
+            return x->length == y->length && x->elem == y->elem;
+        }
+        case TY_SLICE: return static_cast<const SliceType*>(a)->elem == static_cast<const SliceType*>(b)->elem;
+        case TY_POINTER:
+            return static_cast<const PointerType*>(a)->base == static_cast<const PointerType*>(b)->base;
+        case TY_MAP: {
+            auto* x = static_cast<const MapType*>(a);
+            auto* y = static_cast<const MapType*>(b);
+            return x->key == y->key && x->elem == y->elem;
+        }
+        case TY_CHAN: {
+            auto* x = static_cast<const ChanType*>(a);
+            auto* y = static_cast<const ChanType*>(b);
+            return x->elem == y->elem && x->dir == y->dir;
+        }
+        case TY_TUPLE: return static_cast<const TupleType*>(a)->types == static_cast<const TupleType*>(b)->types;
+        case TY_FUNC: {
+            auto* x = static_cast<const FuncType*>(a);
+            auto* y = static_cast<const FuncType*>(b);
+            return x->params == y->params && x->results == y->results && x->variadic == y->variadic;
+        }
+        case TY_STRUCT: {
+            auto& x = static_cast<const StructType*>(a)->fields;
+            auto& y = static_cast<const StructType*>(b)->fields;
+            return equal_range(x, y, [](const StructField& f, const StructField& g) {
+                return f.name == g.name && f.type == g.type && f.tag == g.tag && f.embedded == g.embedded;
+            });
+        }
+        case TY_INTERFACE: {
+            auto* x = static_cast<const InterfaceType*>(a);
+            auto* y = static_cast<const InterfaceType*>(b);
+            return x->partial == y->partial && equal_range(x->methods, y->methods,
+                [](const Method& m, const Method& n) { return m.name == n.name && m.type == n.type; });
+        }
+        default:
+            return false;
+        }
+    }
+    template <class V, class Equal>
+    static bool equal_range(const V& x, const V& y, Equal&& same) {
+        if (x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); i++) if (!same(x[i], y[i])) return false;
+        return true;
+    }
+    static const Type* find(const Table& t, const Type* probe, uint32_t hash) {
+        for (uint32_t i = hash & t.mask;; i = (i + 1) & t.mask) {
+            const Type* slot = t.slots[i].load(memory_order_acquire);
+            if (slot == nullptr) return nullptr;
+            if (slot->hash == hash && equal(slot, probe)) return slot;
+        }
+    }
+    static void insert(Table& t, const Type* type) {
+        uint32_t i = type->hash & t.mask;
+        while (t.slots[i].load(memory_order_relaxed) != nullptr) i = (i + 1) & t.mask;
+        t.slots[i].store(type, memory_order_release);
+    }
+    Table* grow(const Table& old) {
+        auto* t = new Table((old.mask + 1) * 2);
+        for (uint32_t i = 0; i <= old.mask; i++) {
+            if (const Type* type = old.slots[i].load(memory_order_relaxed)) insert(*t, type);
+        }
+        tables.emplace_back(t);
+        table.store(t, memory_order_release);
+        return t;
+    }
+};
+static TypeTable typeTable;
+
+enum ObjectKind : uint8_t { OB_CONST, OB_TYPE, OB_VAR, OB_FUNC, OB_PACKAGE, OB_BUILTIN, OB_NIL };
+enum BuiltinId : uint8_t {
+    BI_APPEND, BI_CAP, BI_CLOSE, BI_COMPLEX, BI_COPY, BI_DELETE, BI_IMAG, BI_LEN, BI_MAKE,
+    BI_NEW, BI_PANIC, BI_PRINT, BI_PRINTLN, BI_REAL, BI_RECOVER
+};
+constexpr const char* builtinNames[] = { "append", "cap", "close", "complex", "copy", "delete",
+    "imag", "len", "make", "new", "panic", "print", "println", "real", "recover" };
+
+struct FileInfo;
+// A named language entity. Package level objects keep where they are declared
+// and get their type when first resolved, every other object is complete as
+// soon as it is declared.
+struct Object {
+    ObjectKind kind;
+    enum : uint8_t { UNRESOLVED, RESOLVING, RESOLVED } state = RESOLVED;
+    // a method whose receiver is a pointer
+    bool pointerReceiver = false;
+    Symbol name;
+    const Type* type = nullptr;
+    // the value of a constant, the BuiltinId of a builtin as an integer
+    Constant value;
+    // the declaring spec, declaration or Name node in file, none for predeclared
+    // objects. A constant also keeps the spec whose type and values it uses and
+    // its iota, a variable its index among the names of its spec.
+    FileInfo* file = nullptr;
+    uint32_t node = 0;
+    uint32_t valueSpec = 0;
+    uint32_t index = 0;
+    int64_t iota = 0;
+    // the next object declared by the same spec or field
+    Object* next = nullptr;
+    // T or *T for a method, its type is the signature without it
+    const Type* receiver = nullptr;
+
+    Object(ObjectKind kind, Symbol name, const Type* type) : kind(kind), name(name), type(type) {}
+};
+
+// Names declared in one block, an open addressing table from symbols to their
+// objects, which falls back on the scope around it. Symbol 0 is never declared
+// and marks a free slot. Block scopes are cleared and refilled rather than
+// freed, so a function body allocates nothing once its deepest block has been
+// seen.
+struct Scope {
+    const Scope* parent = nullptr;
+
+    Object* lookupLocal(Symbol name) const {
+        if (count == 0) return nullptr;
+        for (uint32_t i = slotOf(name);; i = (i + 1) & mask()) {
+            if (slots[i].name == name) return slots[i].object;
+            if (slots[i].name == 0) return nullptr;
+        }
+    }
+    Object* lookup(Symbol name) const {
+        for (const Scope* s = this; s != nullptr; s = s->parent) {
+            if (Object* object = s->lookupLocal(name)) return object;
+        }
+        return nullptr;
+    }
+    // Declares object under its name, or returns the object already declared
+    // under it.
+    Object* insert(Object* object) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        for (uint32_t i = slotOf(object->name);; i = (i + 1) & mask()) {
+            if (slots[i].name == object->name) return slots[i].object;
+            if (slots[i].name == 0) {
+                slots[i] = { object->name, object };
+                count++;
+                return nullptr;
+            }
+        }
+    }
+    void clear() {
+        if (count != 0) fill(slots.begin(), slots.end(), Slot{ 0, nullptr });
+        count = 0;
+    }
+    template <class Visit>
+    void forEach(Visit&& visit) const {
+        for (auto& slot : slots) if (slot.name != 0) visit(slot.object);
+    }
+
+private:
+    struct Slot {
+        Symbol name;
+        Object* object;
+    };
+    vector<Slot> slots;
+    uint32_t count = 0;
+    int bits = 0;
+
+    uint32_t mask() const { return uint32_t(slots.size() - 1); }
+    uint32_t slotOf(Symbol name) const { return (name * 2654435769u) >> (32 - bits); }
+    void grow() {
+        vector<Slot> old = move(slots);
+        bits = max(bits + 1, 3);
+        slots.assign(size_t(1) << bits, Slot{ 0, nullptr });
+        count = 0;
+        for (auto& slot : old) if (slot.name != 0) insert(slot.object);
+    }
+};
+
+// The predeclared names, the scope around every package scope.
+struct Universe {
+    Scope scope;
+    Object* iota;
+    const NamedType* error;
+    const InterfaceType* empty;
+    Arena arena;
+
+    Universe() {
+        auto declare = [&](ObjectKind kind, const char* name, const Type* type) {
+            auto* object = arena.make<Object>(kind, symbols.intern(name), type);
+            scope.insert(object);
+            return object;
+        };
+        for (int k = TY_BOOL; k <= TY_STRING; k++) {
+            declare(OB_TYPE, basicTypeNames[k], basicType(TypeKind(k)));
+        }
+        declare(OB_TYPE, "byte", basicType(TY_UINT8));
+        declare(OB_TYPE, "rune", basicType(TY_INT32));
+        empty = typeTable.interfaceType({}, false);
+        declare(OB_TYPE, "any", empty);
+
+        auto* errorType = arena.make<NamedType>(declare(OB_TYPE, "error", nullptr));
+        errorType->object->type = errorType;
+        auto* signature = typeTable.func(typeTable.tuple({}), typeTable.tuple({ basicType(TY_STRING) }), false);
+        errorType->underlying = typeTable.interfaceType({ { symbols.intern("Error"), signature } }, false);
+        error = errorType;
+
+        for (auto [name, value] : { pair{ "false", false }, pair{ "true", true } }) {
+            declare(OB_CONST, name, basicType(TY_UNTYPED_BOOL))->value = constantBool(value);
+        }
+        iota = declare(OB_CONST, "iota", basicType(TY_UNTYPED_INT));
+        declare(OB_NIL, "nil", basicType(TY_UNTYPED_NIL));
+        for (int i = 0; i <= BI_RECOVER; i++) {
+            declare(OB_BUILTIN, builtinNames[i], invalidType())->value = constantInt(i);
+        }
+    }
+};
+const Universe& universe() {
+    static Universe u;
+    return u;
+}
+
+inline const Type* underlying(const Type* t) {
+    if (t->kind != TY_NAMED) return t;
+    auto* u = static_cast<const NamedType*>(t)->underlying;
+    return u != nullptr ? u : invalidType();
+}
+template <class T>
+const T* underlyingAs(const Type* t, TypeKind kind) {
+    const Type* u = underlying(t);
+    return u->kind == kind ? static_cast<const T*>(u) : nullptr;
+}
+// Named types and the predeclared ones are defined types, for which type
+// identity is the identity of the declaration.
+inline bool isDefined(const Type* t) { return t->kind == TY_NAMED || t->kind <= TY_UNSAFE_POINTER; }
+
+string typeString(const Type* t) {
+    auto tuple = [](const TupleType* tuple, bool variadic) {
+        string s;
+        for (size_t i = 0; i < tuple->types.size(); i++) {
+            const Type* type = tuple->types[i];
+            if (i != 0) s += ", ";
+            if (variadic && i + 1 == tuple->types.size()) {
+                s += "..." + typeString(static_cast<const SliceType*>(type)->elem);
+            }
+            else {
+                s += typeString(type);
+            }
+        }
+        return s;
+    };
+    switch (t->kind) {
+    case TY_NAMED: return string(symbols.text(static_cast<const NamedType*>(t)->object->name));
+    case TY_ARRAY: {
+        auto* a = static_cast<const ArrayType*>(t);
+        return "[" + (a->length < 0 ? string("?") : to_string(a->length)) + "]" + typeString(a->elem);
+    }
+    case TY_SLICE: return "[]" + typeString(static_cast<const SliceType*>(t)->elem);
+    case TY_POINTER: return "*" + typeString(static_cast<const PointerType*>(t)->base);
+    case TY_MAP: {
+        auto* m = static_cast<const MapType*>(t);
+        return "map[" + typeString(m->key) + "]" + typeString(m->elem);
+    }
+    case TY_CHAN: {
+        auto* c = static_cast<const ChanType*>(t);
+        return string(c->dir == CHAN_SEND ? "chan<- " : c->dir == CHAN_RECV ? "<-chan " : "chan ") +
+            typeString(c->elem);
+    }
+    case TY_STRUCT: {
+        string s = "struct{";
+        for (auto& field : static_cast<const StructType*>(t)->fields) {
+            if (s.size() > 7) s += "; ";
+            if (!field.embedded) s += string(symbols.text(field.name)) + " ";
+            s += typeString(field.type);
+        }
+        return s + "}";
+    }
+    case TY_FUNC: {
+        auto* f = static_cast<const FuncType*>(t);
+        string s = "func(" + tuple(f->params, f->variadic) + ")";
+        if (f->results->types.size() == 1) return s + " " + typeString(f->results->types[0]);
+        if (f->results->types.size() > 1) s += " (" + tuple(f->results, false) + ")";
+        return s;
+    }
+    case TY_INTERFACE: {
+        string s = "interface{";
+        for (auto& method : static_cast<const InterfaceType*>(t)->methods) {
+            if (s.size() > 10) s += "; ";
+            s += string(symbols.text(method.name)) + typeString(method.type).substr(4);
+        }
+        return s + "}";
+    }
+    case TY_TUPLE: return "(" + tuple(static_cast<const TupleType*>(t), false) + ")";
+    default: return basicTypeNames[t->kind];
+    }
+}
+
+// Whether a and b are the same type, type names being the same only when they
+// are the same declaration. Only types built outside the type table need to be
+// compared by their structure.
+bool identical(const Type* a, const Type* b) {
+    if (a == b) return true;
+    if ((a->canonical && b->canonical) || a->kind != b->kind) return false;
+    switch (a->kind) {
+    case TY_ARRAY: {
+        auto* x = static_cast<const ArrayType*>(a);
+        auto* y = static_cast<const ArrayType*>(b);
+        return x->length == y->length && identical(x->elem, y->elem);
+    }
+    case TY_SLICE:
+        return identical(static_cast<const SliceType*>(a)->elem, static_cast<const SliceType*>(b)->elem);
+    case TY_POINTER:
+        return identical(static_cast<const PointerType*>(a)->base, static_cast<const PointerType*>(b)->base);
+    case TY_MAP: {
+        auto* x = static_cast<const MapType*>(a);
+        auto* y = static_cast<const MapType*>(b);
+        return identical(x->key, y->key) && identical(x->elem, y->elem);
+    }
+    case TY_CHAN: {
+        auto* x = static_cast<const ChanType*>(a);
+        auto* y = static_cast<const ChanType*>(b);
+        return x->dir == y->dir && identical(x->elem, y->elem);
+    }
+    case TY_STRUCT: {
+        auto& x = static_cast<const StructType*>(a)->fields;
+        auto& y = static_cast<const StructType*>(b)->fields;
+        if (x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); i++) {
+            if (x[i].name != y[i].name || x[i].tag != y[i].tag || x[i].embedded != y[i].embedded ||
+                !identical(x[i].type, y[i].type)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case TY_FUNC: {
+        auto* x = static_cast<const FuncType*>(a);
+        auto* y = static_cast<const FuncType*>(b);
+        return x->variadic == y->variadic && identical(x->params, y->params) &&
+            identical(x->results, y->results);
+    }
+    case TY_INTERFACE: {
+        auto& x = static_cast<const InterfaceType*>(a)->methods;
+        auto& y = static_cast<const InterfaceType*>(b)->methods;
+        if (x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); i++) {
+            if (x[i].name != y[i].name || !identical(x[i].type, y[i].type)) return false;
+        }
+        return true;
+    }
+    case TY_TUPLE: {
+        auto& x = static_cast<const TupleType*>(a)->types;
+        auto& y = static_cast<const TupleType*>(b)->types;
+        if (x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); i++) if (!identical(x[i], y[i])) return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Whether values of t can be compared with == and used as map keys.
+bool comparable(const Type* t) {
+    const Type* u = underlying(t);
+    switch (u->kind) {
+    case TY_SLICE: case TY_MAP: case TY_FUNC: case TY_UNTYPED_NIL: return false;
+    case TY_ARRAY: return comparable(static_cast<const ArrayType*>(u)->elem);
+    case TY_STRUCT:
+        for (auto& field : static_cast<const StructType*>(u)->fields) {
+            if (!comparable(field.type)) return false;
+        }
+        return true;
+    default: return true;
+    }
+}
+
+// The field or method a selector x.name denotes.
+struct Selection {
+    enum Kind : uint8_t { NONE, FIELD, METHOD, AMBIGUOUS } kind = NONE;
+    const Type* type = nullptr;
+    // a pointer was followed on the way to it, so the field is addressable
+    bool indirect = false;
+    bool pointerReceiver = false;
+    // a type of another package was embedded on the way, which may have it
+    bool partial = false;
+};
+
+void complete(const InterfaceType* t);
+
+// The field or method name of type t, looked up breadth first through embedded
+// fields, so that the shallowest one wins and two at the same depth are
+// ambiguous.
+Selection lookupFieldOrMethod(const Type* t, Symbol name) {
+    struct Entry {
+        const Type* type;
+        bool indirect;
+    };
+    bool indirect = false;
+    if (auto* p = underlyingAs<PointerType>(t, TY_POINTER); p != nullptr && t->kind != TY_NAMED) {
+        t = p->base;
+        indirect = true;
+    }
+    vector<Entry> current{ { t, indirect } }, next;
+    vector<const NamedType*> seen;
+    bool partial = false;
+    while (!current.empty()) {
+        Selection found;
+        int count = 0;
+        for (auto& entry : current) {
+            const Type* type = entry.type;
+            partial = partial || underlying(type)->kind == TY_INVALID;
+            if (type->kind == TY_NAMED) {
+                auto* named = static_cast<const NamedType*>(type);
+                if (find(seen.begin(), seen.end(), named) != seen.end()) continue;
+                seen.push_back(named);
+                for (Object* method : named->methods) {
+                    if (method->name == name) {
+                        count++;
+                        found = { Selection::METHOD, method->type, entry.indirect, method->pointerReceiver };
+                    }
+                }
+                type = underlying(type);
+            }
+            if (type->kind == TY_STRUCT) {
+                for (auto& field : static_cast<const StructType*>(type)->fields) {
+                    if (field.name == name) {
+                        count++;
+                        found = { Selection::FIELD, field.type, entry.indirect, false };
+                    }
+                    if (field.embedded) {
+                        auto* p = underlyingAs<PointerType>(field.type, TY_POINTER);
+                        if (p != nullptr && field.type->kind != TY_NAMED) {
+                            next.push_back({ p->base, true });
+                        }
+                        else {
+                            next.push_back({ field.type, entry.indirect });
+                        }
+                    }
+                }
+            }
+            else if (type->kind == TY_INTERFACE) {
+                auto* i = static_cast<const InterfaceType*>(type);
+                complete(i);
+                partial = partial || i->partial;
+                for (auto& method : i->methods) {
+                    if (method.name == name) {
+                        count++;
+                        found = { Selection::METHOD, method.type, entry.indirect, false };
+                    }
+                }
+            }
+        }
+        if (count == 1) return found;
+        if (count > 1) return { Selection::AMBIGUOUS };
+        swap(current, next);
+        next.clear();
+    }
+    Selection none;
+    none.partial = partial;
+    return none;
+}
+
+// Adds the methods of the embedded interfaces to those of t, sorted by name.
+void complete(const InterfaceType* t) {
+    if (t->state == InterfaceType::COMPLETE) return;
+    if (t->state == InterfaceType::COMPLETING) throw runtime_error("invalid recursive interface");
+    t->state = InterfaceType::COMPLETING;
+    for (const Type* e : t->embedded) {
+        if (e->kind == TY_NAMED && static_cast<const NamedType*>(e)->underlying == nullptr) {
+            t->state = InterfaceType::INCOMPLETE;
+            throw runtime_error("invalid recursive type " + typeString(e));
+        }
+        auto* embedded = underlyingAs<InterfaceType>(e, TY_INTERFACE);
+        if (embedded == nullptr) {
+            if (underlying(e)->kind == TY_INVALID) {
+                t->partial = true;
+                continue;
+            }
+            t->state = InterfaceType::INCOMPLETE;
+            throw runtime_error("interface contains type " + typeString(e) + " which is not an interface");
+        }
+        complete(embedded);
+        t->partial = t->partial || embedded->partial;
+        t->methods.insert(t->methods.end(), embedded->methods.begin(), embedded->methods.end());
+    }
+    stable_sort(t->methods.begin(), t->methods.end(),
+        [](const Method& a, const Method& b) { return a.name < b.name; });
+    for (size_t i = 1; i < t->methods.size(); i++) {
+        if (t->methods[i].name != t->methods[i - 1].name) continue;
+        if (!identical(t->methods[i].type, t->methods[i - 1].type)) {
+            t->state = InterfaceType::INCOMPLETE;
+            throw runtime_error("duplicate method " + string(symbols.text(t->methods[i].name)));
+        }
+        t->methods.erase(t->methods.begin() + i--);
+    }
+    t->state = InterfaceType::COMPLETE;
+}
+
+// Whether t contains a named type that contains itself through struct fields
+// and array elements, which would make it infinitely large. A named type is
+// entered once, state marks those being entered and those done.
+bool containsCycle(const Type* t, unordered_map<const NamedType*, uint8_t>& state) {
+    switch (t->kind) {
+    case TY_NAMED: {
+        auto* named = static_cast<const NamedType*>(t);
+        uint8_t& s = state[named];
+        if (s != 0 || named->underlying == nullptr) return s == 1;
+        s = 1;
+        bool found = containsCycle(named->underlying, state);
+        state[named] = 2;
+        return found;
+    }
+    case TY_ARRAY:
+        return containsCycle(static_cast<const ArrayType*>(t)->elem, state);
+    case TY_STRUCT:
+        for (auto& field : static_cast<const StructType*>(t)->fields) {
+            if (containsCycle(field.type, state)) return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Whether every interface t embeds is declared by now, so that t can be
+// completed.
+bool completable(const InterfaceType* t) {
+    if (t->state == InterfaceType::COMPLETE) return true;
+    // embedded in itself, complete() reports it
+    if (t->state == InterfaceType::COMPLETING) return false;
+    auto state = t->state;
+    t->state = InterfaceType::COMPLETING;
+    bool ok = true;
+    for (const Type* e : t->embedded) {
+        if (e->kind == TY_NAMED && static_cast<const NamedType*>(e)->underlying == nullptr) ok = false;
+        if (auto* i = underlyingAs<InterfaceType>(e, TY_INTERFACE); ok && i != nullptr) ok = completable(i);
+        if (!ok) break;
+    }
+    t->state = state;
+    return ok;
+}
+
+// The first method of iface that t lacks or has with another signature, 0 when
+// t implements iface.
+Symbol missingMethod(const Type* t, const InterfaceType* iface) {
+    complete(iface);
+    if (auto* other = underlyingAs<InterfaceType>(t, TY_INTERFACE)) {
+        complete(other);
+        if (other->partial) return 0;
+        size_t j = 0;
+        for (auto& method : iface->methods) {
+            while (j < other->methods.size() && other->methods[j].name < method.name) j++;
+            if (j == other->methods.size() || other->methods[j].name != method.name ||
+                !identical(other->methods[j].type, method.type)) {
+                return method.name;
+            }
+        }
+        return 0;
+    }
+    for (auto& method : iface->methods) {
+        Selection s = lookupFieldOrMethod(t, method.name);
+        if (s.kind == Selection::NONE && s.partial) continue;
+        if (s.kind != Selection::METHOD || !identical(s.type, method.type) ||
+            (s.pointerReceiver && !s.indirect)) {
+            return method.name;
+        }
+    }
+    return 0;
+}
+
+// What semantic analysis knows about one file of a package.
+struct FileInfo {
+    const Tree* tree = nullptr;
+    string filename;
+    // the imports, its parent is the package scope
+    Scope scope;
+    // a dot import may bring in any name, so an undefined one is no error
+    bool dotImport = false;
+    // by node: the type of every expression and type, the value of every
+    // constant expression, and the object a Name denotes or declares, or the
+    // first one a spec, field, declaration or type switch clause declares
+    vector<const Type*> types;
+    vector<Constant> values;
+    vector<Object*> objects;
+
+    // The position of node n, as an error starts.
+    string where(uint32_t n) const {
+        const Position& p = tree->positions[n];
+        return filename + ":" + to_string(p.line) + ":" + to_string(p.column);
+    }
+};
+
+struct PackageInfo {
+    const Package& package;
+    Scope scope;
+    deque<FileInfo> files;
+    // package level objects in the order they are declared, blank ones too
+    vector<Object*> objects;
+    // function declarations with a receiver, and every one with a body
+    vector<pair<FileInfo*, uint32_t>> methods, bodies;
+    // interfaces built while resolving, completed before bodies are checked
+    vector<const InterfaceType*> interfaces;
+    // types defined by a named type whose underlying type was not known yet
+    vector<pair<NamedType*, const NamedType*>> pending;
+    vector<string> errors;
+    Arena arena;
+    // bodies are checked by tasks, each with an arena for the types and
+    // objects it makes and the errors it finds
+    struct Task {
+        Arena arena;
+        vector<string> errors;
+    };
+    deque<Task> tasks;
+
+    explicit PackageInfo(const Package& package) : package(package) {}
+};
+
+enum OperandMode : uint8_t {
+    M_INVALID, M_NOVALUE, M_VALUE, M_VARIABLE, M_MAPINDEX, M_CONSTANT, M_TYPE, M_BUILTIN
+};
+// The result of checking an expression. An invalid operand stands for one
+// whose error was reported already or that comes from an unknown package, so it
+// is accepted wherever it is used.
+struct Operand {
+    OperandMode mode = M_INVALID;
+    // a map index, type assertion or receive, which may also yield an ok
+    bool commaOk = false;
+    // a call or receive, which may stand alone as a statement
+    bool statement = false;
+    const Type* type = invalidType();
+    // the value of a constant, the BuiltinId of a builtin as an integer
+    Constant value;
+    uint32_t node = 0;
+};
+
+// Checks the declarations and bodies of one package. A checker walks one file
+// at a time, keeping the block scopes it opened in a stack it reuses.
+struct Checker {
+    PackageInfo& package;
+    FileInfo* file;
+    const Tree* tree;
+    Arena& arena;
+    // resolving package level declarations, whose interfaces are completed
+    // only once every declaration is resolved
+    bool resolving;
+    // where the errors found in statements go, each statement with an error
+    // is left for the next one
+    vector<string>& errors;
+    // the innermost node being checked, where an error thrown is reported
+    uint32_t checking = 0;
+
+    Checker(PackageInfo& package, FileInfo& file, Arena& arena, bool resolving, vector<string>& errors)
+        : package(package), file(&file), tree(file.tree), arena(arena), resolving(resolving), errors(errors) {}
+
+    // The error e thrown while checking node n of the file, at the innermost
+    // node it was checking.
+    string errorAt(uint32_t n, const runtime_error& e) const {
+        return file->where(checking != 0 ? checking : n) + ": " + e.what();
+    }
+
+    // Gives a package level object its type, and checks its initializer.
+    static void resolve(PackageInfo& package, Object* object) {
+        if (object->state == Object::RESOLVED) return;
+        if (object->state == Object::RESOLVING) {
+            throw runtime_error(string(object->kind == OB_TYPE ? "invalid recursive type " :
+                "initialization cycle for ") + string(symbols.text(object->name)));
+        }
+        object->state = Object::RESOLVING;
+        Checker checker(package, *object->file, package.arena, true, package.errors);
+        try {
+            checker.declare(object);
+        }
+        catch (const runtime_error& e) {
+            package.errors.push_back(checker.errorAt(object->node, e));
+            if (object->type != nullptr && object->type->kind == TY_NAMED) {
+                auto* named = static_cast<NamedType*>(const_cast<Type*>(object->type));
+                if (named->underlying == nullptr) named->underlying = invalidType();
+            }
+            else {
+                object->type = invalidType();
+            }
+            // the other variables of its spec failed with it
+            for (Object* o = object->kind == OB_VAR ? object->file->objects[object->node] : nullptr;
+                o != nullptr; o = o->next) {
+                if (o->state != Object::RESOLVED) o->type = invalidType();
+                o->state = Object::RESOLVED;
+            }
+        }
+        object->state = Object::RESOLVED;
+    }
+
+    // Adds the method declared by decl to its receiver base type.
+    void method(uint32_t decl) {
+        const Node& d = node(decl);
+        auto receivers = list(d.b);
+        if (receivers.size() != 1) error("method has multiple receivers");
+        uint32_t typeNode = node(receivers[0]).b;
+        bool pointer = node(typeNode).kind == NK_POINTER_TYPE;
+        if (pointer) typeNode = node(typeNode).a;
+        const Node& base = node(typeNode);
+        if (base.kind != NK_TYPE_NAME || base.a != 0) error("invalid receiver type");
+        Object* object = package.scope.lookupLocal(base.b);
+        if (object == nullptr) error("undefined: " + text(base.b));
+        if (object->kind != OB_TYPE) error(text(base.b) + " is not a type");
+        resolve(package, object);
+        file->objects[typeNode] = object;
+        if (object->type->kind != TY_NAMED) error("invalid receiver type " + typeString(object->type));
+        auto* named = static_cast<NamedType*>(const_cast<Type*>(object->type));
+        const Type* u = underlying(named);
+        if (u->kind == TY_POINTER || u->kind == TY_INTERFACE) {
+            error("invalid receiver type " + typeString(named) + " (pointer or interface type)");
+        }
+        auto* m = arena.make<Object>(OB_FUNC, d.a, signature(d.c));
+        m->receiver = pointer ? typeTable.pointer(named) : static_cast<const Type*>(named);
+        m->pointerReceiver = pointer;
+        m->file = file;
+        m->node = decl;
+        file->objects[decl] = m;
+        if (d.a == blank()) return;
+        for (Object* other : named->methods) {
+            if (other->name == d.a) error("method " + typeString(named) + "." + text(d.a) + " already declared");
+        }
+        if (u->kind == TY_STRUCT) {
+            for (auto& field : static_cast<const StructType*>(u)->fields) {
+                if (field.name == d.a) error("field and method with the same name " + text(d.a));
+            }
+        }
+        named->methods.push_back(m);
+    }
+
+    // Checks the body of the function declared by decl.
+    void function(FileInfo& in, uint32_t decl) {
+        file = &in;
+        tree = in.tree;
+        // an error thrown out of the last function leaves its state behind
+        scope = nullptr;
+        depth = 0;
+        current = nullptr;
+        label = 0;
+        iota = -1;
+        checking = decl;
+        const Node& d = node(decl);
+        const Object* object = file->objects[decl];
+        if (object->type->kind != TY_FUNC) return;
+        funcBody(static_cast<const FuncType*>(object->type), object->receiver, d.b, d.c, d.d);
+    }
+
+private:
+    // the function whose body is being checked
+    struct Function {
+        const FuncType* type;
+        bool namedResults;
+        // declared labels and whether a branch uses them, and the gotos seen
+        vector<pair<Symbol, bool>> labels;
+        vector<Symbol> gotos;
+        // enclosing for, switch and select statements, with their labels and
+        // whether they are loops
+        vector<pair<Symbol, bool>> targets;
+    };
+    Function* current = nullptr;
+    // innermost block scope, nullptr outside functions
+    Scope* scope = nullptr;
+    vector<unique_ptr<Scope>> scopes;
+    size_t depth = 0;
+    // iota of the constant declaration being checked
+    int64_t iota = -1;
+    // label of the statement about to be checked
+    Symbol label = 0;
+
+    [[noreturn]] static void error(const string& message) { throw runtime_error(message); }
+    static string text(Symbol s) { return string(symbols.text(s)); }
+    static Symbol blank() {
+        static const Symbol s = symbols.intern("_");
+        return s;
+    }
+    const Node& node(uint32_t n) const { return (*tree)[n]; }
+    Tree::List list(uint32_t l) const { return tree->list(l); }
+
+    void openScope() {
+        if (depth == scopes.size()) scopes.push_back(make_unique<Scope>());
+        Scope* s = scopes[depth++].get();
+        s->clear();
+        s->parent = scope != nullptr ? scope : &file->scope;
+        scope = s;
+    }
+    void closeScope() {
+        depth--;
+        scope = depth == 0 ? nullptr : scopes[depth - 1].get();
+    }
+    Object* lookup(Symbol name) const {
+        return (scope != nullptr ? scope : &file->scope)->lookup(name);
+    }
+    Object* newObject(ObjectKind kind, Symbol name, const Type* type, uint32_t at) {
+        auto* object = arena.make<Object>(kind, name, type);
+        object->file = file;
+        object->node = at;
+        return object;
+    }
+    void declareLocal(Object* object) {
+        if (object->name != blank() && scope->insert(object) != nullptr) {
+            error(text(object->name) + " redeclared in this block");
+        }
+    }
+    // Records the objects a spec or field declares, chained in their order.
+    void chain(uint32_t at, const vector<Object*>& objects) {
+        for (size_t i = 0; i + 1 < objects.size(); i++) objects[i]->next = objects[i + 1];
+        file->objects[at] = objects.empty() ? nullptr : objects[0];
+    }
+
+    //===--- declarations ---===//
+
+    void declare(Object* object) {
+        checking = object->node;
+        const Node& spec = node(object->node);
+        switch (object->kind) {
+        case OB_CONST: {
+            const Node& values = node(object->valueSpec);
+            if (object->valueSpec == 0 || object->index >= list(values.c).size()) {
+                error("missing init expr for const declaration");
+            }
+            iota = object->iota;
+            constant(object, valueOf(list(values.c)[object->index]), values.b);
+            break;
+        }
+        case OB_TYPE:
+            typeSpec(object, spec);
+            break;
+        case OB_VAR: {
+            vector<Object*> objects;
+            for (Object* o = file->objects[object->node]; o != nullptr; o = o->next) objects.push_back(o);
+            variables(objects, spec);
+            break;
+        }
+        case OB_FUNC:
+            object->type = signature(spec.c);
+            break;
+        default:
+            break;
+        }
+    }
+    void constant(Object* object, Operand x, uint32_t typeNode) {
+        const Type* type = typeNode != 0 ? typeOf(typeNode) : nullptr;
+        if (x.mode == M_INVALID || (type != nullptr && type->kind == TY_INVALID)) {
+            object->type = invalidType();
+            return;
+        }
+        if (x.mode != M_CONSTANT) error("const initializer is not a constant");
+        if (type != nullptr) {
+            if (!isBasic(underlying(type)->kind)) error("invalid constant type " + typeString(type));
+            assign(x, type, "constant declaration");
+        }
+        object->type = x.type;
+        object->value = x.value;
+    }
+    void typeSpec(Object* object, const Node& spec) {
+        if (spec.flags & F_ALIAS) {
+            object->type = typeOf(spec.b);
+            return;
+        }
+        auto* named = arena.make<NamedType>(object);
+        object->type = named;
+        if (object->state == Object::RESOLVING) object->state = Object::RESOLVED;
+        if (scope != nullptr) declareLocal(object);
+        const Type* type = typeOf(spec.b);
+        if (type->kind == TY_NAMED && static_cast<const NamedType*>(type)->underlying == nullptr) {
+            // a package level type defined by one whose declaration is still
+            // being resolved gets its underlying type once that is done
+            if (scope != nullptr) error("invalid recursive type " + text(object->name));
+            package.pending.push_back({ named, static_cast<const NamedType*>(type) });
+            return;
+        }
+        named->underlying = underlying(type);
+        if (scope != nullptr) {
+            unordered_map<const NamedType*, uint8_t> state;
+            if (containsCycle(named, state)) {
+                named->underlying = invalidType();
+                error("invalid recursive type " + text(object->name));
+            }
+        }
+    }
+    // The variables a VarSpec declares, in order, get their types. Package
+    // level variables of one spec are all resolved together.
+    void variables(const vector<Object*>& objects, const Node& spec) {
+        const Type* type = spec.b != 0 ? typeOf(spec.b) : nullptr;
+        auto values = list(spec.c);
+        for (Object* o : objects) {
+            o->type = type;
+            if (o->state == Object::UNRESOLVED) o->state = Object::RESOLVING;
+        }
+        if (values.size() == 0) {
+            if (type == nullptr) error("missing type or init expr");
+        }
+        else {
+            vector<Operand> operands = assignValues(spec.c, objects.size());
+            for (size_t i = 0; i < objects.size(); i++) {
+                if (type != nullptr) {
+                    assign(operands[i], type, "variable declaration");
+                }
+                else {
+                    objects[i]->type = defaultValue(operands[i], "variable declaration");
+                }
+            }
+        }
+        for (Object* o : objects) o->state = Object::RESOLVED;
+    }
+
+    //===--- types ---===//
+
+    const Type* typeOf(uint32_t n) {
+        uint32_t outer = checking;
+        checking = n;
+        const Type* type = typeKind(n);
+        checking = outer;
+        return type;
+    }
+    const Type* typeKind(uint32_t n) {
+        const Node& t = node(n);
+        const Type* type = nullptr;
+        switch (t.kind) {
+        case NK_TYPE_NAME:
+            type = typeName(n, t.a, t.b);
+            break;
+        case NK_ARRAY_TYPE:
+            if (t.a == 0) error("invalid use of [...] array (outside a composite literal)");
+            {
+                int64_t length = arrayLength(t.a);
+                type = typeTable.array(length, typeOf(t.b));
+            }
+            break;
+        case NK_SLICE_TYPE:
+            type = typeTable.slice(typeOf(t.a));
+            break;
+        case NK_POINTER_TYPE:
+            type = typeTable.pointer(typeOf(t.a));
+            break;
+        case NK_MAP_TYPE: {
+            const Type* key = typeOf(t.a);
+            bool pending = key->kind == TY_NAMED && static_cast<const NamedType*>(key)->underlying == nullptr;
+            if (!pending && !comparable(key)) error("invalid map key type " + typeString(key));
+            type = typeTable.map(key, typeOf(t.b));
+            break;
+        }
+        case NK_CHAN_TYPE:
+            type = typeTable.chan(typeOf(t.a), t.flags & F_SEND_ONLY ? CHAN_SEND :
+                t.flags & F_RECV_ONLY ? CHAN_RECV : CHAN_BOTH);
+            break;
+        case NK_STRUCT_TYPE:
+            type = structType(t);
+            break;
+        case NK_FUNC_TYPE:
+            return signature(n);
+        case NK_INTERFACE_TYPE:
+            type = interfaceType(t);
+            break;
+        default: {
+            Operand x = expr(n);
+            if (x.mode != M_INVALID && x.mode != M_TYPE) error("expression is not a type");
+            type = x.type;
+            break;
+        }
+        }
+        file->types[n] = type;
+        return type;
+    }
+    const Type* typeName(uint32_t n, Symbol packageName, Symbol name) {
+        if (packageName != 0) {
+            Object* p = lookup(packageName);
+            if (p == nullptr && file->dotImport) return invalidType();
+            if (p == nullptr || p->kind != OB_PACKAGE) error("undefined: " + text(packageName));
+            file->objects[n] = p;
+            return invalidType();
+        }
+        Object* object = lookup(name);
+        if (object == nullptr) {
+            if (file->dotImport) return invalidType();
+            error("undefined: " + text(name));
+        }
+        if (object->kind != OB_TYPE) error(text(name) + " is not a type");
+        resolve(package, object);
+        file->objects[n] = object;
+        return object->type;
+    }
+    int64_t arrayLength(uint32_t n) {
+        Operand x = valueOf(n);
+        if (x.mode == M_INVALID) return -1;
+        if (x.mode != M_CONSTANT) error("array length must be constant");
+        if (!isInteger(underlying(x.type)->kind) && x.type->kind != TY_UNTYPED_FLOAT &&
+            x.type->kind != TY_UNTYPED_COMPLEX) {
+            error("array length must be integer");
+        }
+        if (!x.value.known()) return -1;
+        Constant length = convertConstant(x.value, CV_INT, arena);
+        if (!length.known()) error("array length " + constantString(x.value) + " must be integer");
+        if (constantSign(length) < 0 || !fitsBits(length, 64, true)) {
+            error("invalid array length " + constantString(length));
+        }
+        return length.small;
+    }
+    const Type* structType(const Node& t) {
+        vector<StructField> fields;
+        for (uint32_t f : list(t.a)) {
+            const Node& field = node(f);
+            const Type* fieldType = typeOf(field.b);
+            auto add = [&](Symbol name, bool embedded) {
+                for (auto& other : fields) {
+                    if (other.name == name && name != blank()) error("duplicate field " + text(name));
+                }
+                fields.push_back({ name, fieldType, field.c, embedded });
+            };
+            if (field.a != 0) {
+                for (Symbol name : list(field.a)) add(name, false);
+                continue;
+            }
+            uint32_t typeNode = field.b;
+            if (node(typeNode).kind == NK_POINTER_TYPE) typeNode = node(typeNode).a;
+            if (node(typeNode).kind != NK_TYPE_NAME) error("embedded field type must be a type name");
+            add(node(typeNode).b, true);
+        }
+        return typeTable.structType(move(fields));
+    }
+    const FuncType* signature(uint32_t n) {
+        const Node& t = node(n);
+        vector<const Type*> params, results;
+        bool variadic = false;
+        auto fields = [&](uint32_t l, vector<const Type*>& tuple, bool parameters) {
+            auto items = list(l);
+            for (size_t i = 0; i < items.size(); i++) {
+                const Node& field = node(items[i]);
+                const Type* type = typeOf(field.b);
+                if (field.flags & F_VARIADIC) {
+                    if (!parameters || i + 1 != items.size()) {
+                        error("can only use ... with final parameter in list");
+                    }
+                    type = typeTable.slice(type);
+                    variadic = true;
+                }
+                size_t names = field.a != 0 ? list(field.a).size() : 1;
+                tuple.insert(tuple.end(), names, type);
+            }
+        };
+        fields(t.a, params, true);
+        fields(t.b, results, false);
+        auto* type = typeTable.func(typeTable.tuple(move(params)), typeTable.tuple(move(results)), variadic);
+        file->types[n] = type;
+        return type;
+    }
+    // An interface is canonical once its method set is complete, one that
+    // embeds an interface still being declared is completed after all others.
+    const Type* interfaceType(const Node& t) {
+        InterfaceType type;
+        for (uint32_t m : list(t.a)) {
+            if (node(m).kind == NK_METHOD_SPEC) {
+                if (node(m).a == blank()) error("methods must have a unique non-blank name");
+                type.methods.push_back({ node(m).a, signature(node(m).b) });
+            }
+            else {
+                type.embedded.push_back(typeOf(m));
+            }
+        }
+        if (resolving && !completable(&type)) {
+            auto* pending = arena.make<InterfaceType>(move(type));
+            package.interfaces.push_back(pending);
+            return pending;
+        }
+        complete(&type);
+        return typeTable.interfaceType(move(type.methods), type.partial);
+    }
+
+    //===--- assignability and conversions ---===//
+
+    // The type an untyped value gets when nothing else says which.
+    static const Type* defaultType(const Type* t) {
+        switch (t->kind) {
+        case TY_UNTYPED_BOOL: return basicType(TY_BOOL);
+        case TY_UNTYPED_INT: return basicType(TY_INT);
+        case TY_UNTYPED_RUNE: return basicType(TY_INT32);
+        case TY_UNTYPED_FLOAT: return basicType(TY_FLOAT64);
+        case TY_UNTYPED_COMPLEX: return basicType(TY_COMPLEX128);
+        case TY_UNTYPED_STRING: return basicType(TY_STRING);
+        default: return t;
+        }
+    }
+    // The type of a variable initialized by x.
+    const Type* defaultValue(Operand& x, const char* context) {
+        if (x.type->kind == TY_UNTYPED_NIL) error(string("use of untyped nil in ") + context);
+        setType(x, defaultType(x.type));
+        return x.type;
+    }
+    void setType(Operand& x, const Type* t) {
+        x.type = t;
+        if (x.mode == M_CONSTANT) represent(x);
+        if (x.node != 0) {
+            file->types[x.node] = t;
+            if (x.mode == M_CONSTANT) file->values[x.node] = x.value;
+        }
+    }
+    // Converts the value of the constant x to the representation of its
+    // numeric type, which it must fit. An untyped one keeps an integer or float
+    // value exactly until it gets a type.
+    void represent(Operand& x) {
+        TypeKind k = underlying(x.type)->kind;
+        if (!x.value.known() || !isNumeric(k)) return;
+        ConstantKind kind = isInteger(k) ? CV_INT : isFloat(k) ? CV_FLOAT : CV_COMPLEX;
+        if (isUntyped(k) && (x.value.isInt() || x.value.kind <= kind)) return;
+        Constant v = convertConstant(x.value, kind, arena);
+        if (!v.known()) {
+            error("constant " + constantString(x.value) + (kind == CV_INT ? " truncated to integer" :
+                " truncated to real"));
+        }
+        if (isUntyped(k)) {
+            x.value = v;
+            return;
+        }
+        // a typed float is rounded to its precision, as every operation on
+        // one is
+        bool fits, single = k == TY_FLOAT32 || k == TY_COMPLEX64;
+        double max = single ? FLT_MAX : DBL_MAX;
+        if (kind == CV_INT) {
+            fits = fitsBits(v, intBits(k), !isUnsigned(k));
+        }
+        else if (kind == CV_FLOAT) {
+            v = constantFloat(roundFloat(*v.ratio, single), arena);
+            fits = fitsFloat(*v.ratio, max);
+        }
+        else {
+            v = constantComplex(roundFloat(v.complex->real, single), roundFloat(v.complex->imag, single), arena);
+            fits = fitsFloat(v.complex->real, max) && fitsFloat(v.complex->imag, max);
+        }
+        if (!fits) error("constant " + constantString(v) + " overflows " + typeString(x.type));
+        x.value = v;
+    }
+    // Whether the untyped x can become a t, which it then does.
+    bool convertUntyped(Operand& x, const Type* t) {
+        const Type* u = underlying(t);
+        TypeKind k = x.type->kind, target = u->kind;
+        if (target == TY_INVALID) return true;
+        if (isUntyped(target)) {
+            if (isNumeric(k) && isNumeric(target)) setType(x, basicType(max(k, target)));
+            return k == target || (isNumeric(k) && isNumeric(target));
+        }
+        bool ok;
+        if (k == TY_UNTYPED_NIL) {
+            ok = target == TY_POINTER || target == TY_SLICE || target == TY_MAP || target == TY_CHAN ||
+                target == TY_FUNC || target == TY_INTERFACE || target == TY_UNSAFE_POINTER;
+        }
+        else if (target == TY_INTERFACE) {
+            ok = static_cast<const InterfaceType*>(u)->methods.empty() &&
+                (complete(static_cast<const InterfaceType*>(u)), static_cast<const InterfaceType*>(u)->methods.empty());
+            if (ok) {
+                setType(x, defaultType(x.type));
+                return true;
+            }
+        }
+        else if (k == TY_UNTYPED_BOOL) {
+            ok = isBoolean(target);
+        }
+        else if (k == TY_UNTYPED_STRING) {
+            ok = isString(target);
+        }
+        else {
+            ok = isNumeric(target);
+        }
+        if (ok) setType(x, t);
+        return ok;
+    }
+    bool assignable(Operand& x, const Type* t) {
+        if (x.mode == M_INVALID || t->kind == TY_INVALID) return true;
+        if (isUntyped(x.type->kind)) return convertUntyped(x, t);
+        const Type* v = x.type;
+        if (identical(v, t)) return true;
+        const Type* vu = underlying(v);
+        const Type* tu = underlying(t);
+        if (vu->kind == TY_INVALID || tu->kind == TY_INVALID) return true;
+        if ((!isDefined(v) || !isDefined(t)) && identical(vu, tu)) return true;
+        if (tu->kind == TY_INTERFACE && missingMethod(v, static_cast<const InterfaceType*>(tu)) == 0) {
+            return true;
+        }
+        if (vu->kind == TY_CHAN && tu->kind == TY_CHAN && static_cast<const ChanType*>(vu)->dir == CHAN_BOTH &&
+            (!isDefined(v) || !isDefined(t)) &&
+            identical(static_cast<const ChanType*>(vu)->elem, static_cast<const ChanType*>(tu)->elem)) {
+            return true;
+        }
+        return false;
+    }
+    void assign(Operand& x, const Type* t, const char* context) {
+        if (assignable(x, t)) return;
+        string message = "cannot use value of type " + typeString(x.type) + " as " + typeString(t) +
+            " value in " + context;
+        if (auto* iface = underlyingAs<InterfaceType>(t, TY_INTERFACE); iface != nullptr && !isUntyped(x.type->kind)) {
+            message += ": missing method " + text(missingMethod(x.type, iface));
+        }
+        if (x.node != 0) checking = x.node;
+        error(message);
+    }
+    bool convertible(Operand& x, const Type* t) {
+        if (assignable(x, t)) return true;
+        const Type* vu = underlying(x.type);
+        const Type* tu = underlying(t);
+        TypeKind v = vu->kind, k = tu->kind;
+        if (identical(vu, tu)) return true;
+        if (v == TY_POINTER && k == TY_POINTER && x.type->kind != TY_NAMED && t->kind != TY_NAMED &&
+            identical(underlying(static_cast<const PointerType*>(vu)->base),
+                underlying(static_cast<const PointerType*>(tu)->base))) {
+            return true;
+        }
+        if ((isInteger(v) || isFloat(v)) && (isInteger(k) || isFloat(k))) return true;
+        if (isComplex(v) && isComplex(k)) return true;
+        auto bytesOrRunes = [](const Type* t) {
+            if (t->kind != TY_SLICE) return false;
+            TypeKind e = underlying(static_cast<const SliceType*>(t)->elem)->kind;
+            return e == TY_UINT8 || e == TY_INT32;
+        };
+        if (isString(k) && (isInteger(v) || bytesOrRunes(vu))) return true;
+        if (isString(v) && bytesOrRunes(tu)) return true;
+        // a slice to an array or a pointer to one
+        if (v == TY_SLICE) {
+            const Type* array = k == TY_POINTER ? underlying(static_cast<const PointerType*>(tu)->base) : tu;
+            if (array->kind == TY_ARRAY && identical(static_cast<const SliceType*>(vu)->elem,
+                static_cast<const ArrayType*>(array)->elem)) {
+                return true;
+            }
+        }
+        if (v == TY_UNSAFE_POINTER && (k == TY_POINTER || k == TY_UINTPTR)) return true;
+        if (k == TY_UNSAFE_POINTER && (v == TY_POINTER || v == TY_UINTPTR)) return true;
+        return false;
+    }
+
+    //===--- expressions ---===//
+
+    Operand invalid(uint32_t n) {
+        Operand x;
+        x.node = n;
+        return x;
+    }
+    // Whether the type of an operand, or the base of its pointer type, is one
+    // whose declaration failed or that comes from another package. Errors about
+    // its fields, methods or operators would only repeat the first one.
+    static bool broken(const Type* t) {
+        const Type* u = underlying(t);
+        if (u->kind == TY_POINTER) u = underlying(static_cast<const PointerType*>(u)->base);
+        return u->kind == TY_INVALID;
+    }
+    // n as a single value, hint is the type an elided composite literal has
+    Operand valueOf(uint32_t n, const Type* hint = nullptr) {
+        Operand x = expr(n, hint);
+        single(x);
+        return x;
+    }
+    void single(const Operand& x) {
+        if (x.node != 0 && (x.mode == M_TYPE || x.mode == M_BUILTIN || x.mode == M_NOVALUE ||
+            x.type->kind == TY_TUPLE)) {
+            checking = x.node;
+        }
+        switch (x.mode) {
+        case M_TYPE: error(typeString(x.type) + " (type) is not an expression");
+        case M_BUILTIN: error(string(builtinNames[x.value.small]) + " (built-in) must be called");
+        case M_NOVALUE: error("function call (no value) used as value");
+        default:
+            if (x.type->kind == TY_TUPLE) error("multiple-value in single-value context");
+        }
+    }
+    Operand expr(uint32_t n, const Type* hint = nullptr) {
+        uint32_t outer = checking;
+        checking = n;
+        Operand x = exprKind(n, hint);
+        checking = outer;
+        x.node = n;
+        if (x.type->kind == TY_INVALID && x.mode != M_BUILTIN && x.mode != M_NOVALUE) x.mode = M_INVALID;
+        if (x.mode != M_INVALID) file->types[n] = x.type;
+        if (x.mode == M_CONSTANT) file->values[n] = x.value;
+        return x;
+    }
+    Operand exprKind(uint32_t n, const Type* hint) {
+        const Node& e = node(n);
+        switch (e.kind) {
+        case NK_NAME: return name(n);
+        case NK_BASIC_LIT: return basicLit(e);
+        case NK_COMPOSITE_LIT: return compositeLit(n, hint);
+        case NK_FUNC_LIT: {
+            const FuncType* type = signature(e.a);
+            funcBody(type, nullptr, 0, e.a, e.b);
+            return value(M_VALUE, type);
+        }
+        case NK_SELECTOR: return selector(e);
+        case NK_INDEX: return index(e);
+        case NK_SLICE: return slice(e);
+        case NK_TYPE_ASSERT: return typeAssert(e);
+        case NK_CALL: return call(e);
+        case NK_UNARY: return unary(e);
+        case NK_BINARY: {
+            Operand x = valueOf(e.a);
+            Operand y = valueOf(e.b);
+            return binary(x, y, e.op());
+        }
+        case NK_TYPE_NAME: case NK_ARRAY_TYPE: case NK_SLICE_TYPE: case NK_STRUCT_TYPE:
+        case NK_POINTER_TYPE: case NK_FUNC_TYPE: case NK_INTERFACE_TYPE: case NK_MAP_TYPE:
+        case NK_CHAN_TYPE: {
+            const Type* type = typeOf(n);
+            return type->kind == TY_INVALID ? invalid(n) : value(M_TYPE, type);
+        }
+        default:
+            error(string("unexpected ") + nodeKinds[e.kind].name + " in expression");
+        }
+    }
+    static Operand value(OperandMode mode, const Type* type) {
+        Operand x;
+        x.mode = mode;
+        x.type = type;
+        return x;
+    }
+    static Operand constantValue(const Type* type, Constant v = Constant()) {
+        Operand x = value(M_CONSTANT, type);
+        x.value = v;
+        return x;
+    }
+    Operand name(uint32_t n) {
+        Symbol s = node(n).a;
+        if (s == blank()) error("cannot use _ as value");
+        Object* object = lookup(s);
+        if (object == nullptr) {
+            if (file->dotImport) return invalid(n);
+            error("undefined: " + text(s));
+        }
+        resolve(package, object);
+        file->objects[n] = object;
+        if (object->type == nullptr || (object->type->kind == TY_INVALID && object->kind != OB_BUILTIN)) {
+            return invalid(n);
+        }
+        switch (object->kind) {
+        case OB_VAR: return value(M_VARIABLE, object->type);
+        case OB_CONST:
+            if (object == universe().iota) {
+                if (iota < 0) error("cannot use iota outside constant declaration");
+                return constantValue(object->type, constantInt(iota));
+            }
+            return constantValue(object->type, object->value);
+        case OB_TYPE: return value(M_TYPE, object->type);
+        case OB_FUNC: return value(M_VALUE, object->type);
+        case OB_BUILTIN: {
+            Operand x = value(M_BUILTIN, invalidType());
+            x.value = object->value;
+            return x;
+        }
+        case OB_NIL: return value(M_VALUE, object->type);
+        default: error("use of package " + text(s) + " without selector");
+        }
+    }
+    Operand basicLit(const Node& e) {
+        string_view literal = symbols.text(e.a);
+        switch (e.op()) {
+        case LITERAL_INT: return constantValue(basicType(TY_UNTYPED_INT), intLiteral(literal, arena));
+        case LITERAL_FLOAT: return constantValue(basicType(TY_UNTYPED_FLOAT), floatLiteral(literal, arena));
+        case LITERAL_IMG: return constantValue(basicType(TY_UNTYPED_COMPLEX), imaginaryLiteral(literal, arena));
+        case LITERAL_RUNE: return constantValue(basicType(TY_UNTYPED_RUNE), constantInt(runeValue(literal)));
+        default: return constantValue(basicType(TY_UNTYPED_STRING), stringLiteral(literal, arena));
+        }
+    }
+    Operand compositeLit(uint32_t n, const Type* hint) {
+        const Node& c = node(n);
+        auto elements = list(c.b);
+        const Type* type = nullptr;
+        const Type* result = nullptr;
+        if (c.a == 0) {
+            if (hint == nullptr) error("invalid composite literal type: missing type");
+            type = result = hint;
+            // &T{...} elided to {...} in a literal of *T elements
+            if (auto* p = underlyingAs<PointerType>(hint, TY_POINTER)) type = p->base;
+        }
+        else if (node(c.a).kind == NK_ARRAY_TYPE && node(c.a).a == 0) {
+            // [...]T, the length is the number of elements
+            const Type* elem = typeOf(node(c.a).b);
+            int64_t length = indexedElements(elements, elem, -1);
+            type = result = typeTable.array(length, elem);
+            file->types[c.a] = type;
+            return value(M_VALUE, type);
+        }
+        else {
+            type = result = typeOf(c.a);
+        }
+        const Type* u = underlying(type);
+        switch (u->kind) {
+        case TY_STRUCT: {
+            auto& fields = static_cast<const StructType*>(u)->fields;
+            if (elements.size() == 0) break;
+            if (node(elements[0]).kind == NK_KEYED_ELEMENT) {
+                vector<Symbol> seen;
+                for (uint32_t e : elements) {
+                    const Node& keyed = node(e);
+                    if (keyed.kind != NK_KEYED_ELEMENT) error("mixture of field:value and value elements in struct literal");
+                    if (node(keyed.a).kind != NK_NAME) error("invalid field name in struct literal");
+                    Symbol name = node(keyed.a).a;
+                    auto field = find_if(fields.begin(), fields.end(),
+                        [name](const StructField& f) { return f.name == name; });
+                    if (field == fields.end()) error("unknown field " + text(name) + " in struct literal");
+                    if (find(seen.begin(), seen.end(), name) != seen.end()) {
+                        error("duplicate field name " + text(name) + " in struct literal");
+                    }
+                    seen.push_back(name);
+                    element(keyed.b, field->type, "struct literal");
+                }
+                break;
+            }
+            for (size_t i = 0; i < elements.size(); i++) {
+                if (node(elements[i]).kind == NK_KEYED_ELEMENT) {
+                    error("mixture of field:value and value elements in struct literal");
+                }
+                if (i >= fields.size()) error("too many values in struct literal");
+                element(elements[i], fields[i].type, "struct literal");
+            }
+            if (elements.size() < fields.size()) error("too few values in struct literal");
+            break;
+        }
+        case TY_ARRAY: {
+            auto* array = static_cast<const ArrayType*>(u);
+            indexedElements(elements, array->elem, array->length);
+            break;
+        }
+        case TY_SLICE:
+            indexedElements(elements, static_cast<const SliceType*>(u)->elem, -1);
+            break;
+        case TY_MAP: {
+            auto* map = static_cast<const MapType*>(u);
+            for (uint32_t e : elements) {
+                const Node& keyed = node(e);
+                if (keyed.kind != NK_KEYED_ELEMENT) error("missing key in map literal");
+                element(keyed.a, map->key, "map literal");
+                element(keyed.b, map->elem, "map literal");
+            }
+            break;
+        }
+        case TY_INVALID:
+            // the type is unknown, its field names can not be looked up
+            for (uint32_t e : elements) {
+                const Node& keyed = node(e);
+                if (keyed.kind != NK_KEYED_ELEMENT) {
+                    element(e, invalidType(), "");
+                    continue;
+                }
+                if (node(keyed.a).kind != NK_NAME) element(keyed.a, invalidType(), "");
+                element(keyed.b, invalidType(), "");
+            }
+            return invalid(n);
+        default:
+            error("invalid composite literal type " + typeString(type));
+        }
+        return value(M_VALUE, result);
+    }
+    // Checks the elements of an array or slice literal, returns one more than
+    // the largest index.
+    int64_t indexedElements(Tree::List elements, const Type* elem, int64_t length) {
+        int64_t index = 0, count = 0;
+        for (uint32_t e : elements) {
+            uint32_t valueNode = e;
+            if (node(e).kind == NK_KEYED_ELEMENT) {
+                Operand key = valueOf(node(e).a);
+                if (key.mode != M_INVALID) {
+                    if (key.mode != M_CONSTANT || !isInteger(underlying(key.type)->kind)) {
+                        error("index must be non-negative integer constant");
+                    }
+                    Constant v = convertConstant(key.value, CV_INT, arena);
+                    if (v.known()) index = v.kind == CV_INT ? v.small : -1;
+                }
+                valueNode = node(e).b;
+            }
+            if (index < 0) error("index must be non-negative integer constant");
+            if (length >= 0 && index >= length) {
+                error("array index " + to_string(index) + " out of bounds [0:" + to_string(length) + "]");
+            }
+            element(valueNode, elem, "array or slice literal");
+            count = max(count, ++index);
+        }
+        return count;
+    }
+    // An element of a composite literal, which is a literal of type t itself
+    // when its type is elided.
+    void element(uint32_t n, const Type* t, const char* context) {
+        if (node(n).kind == NK_COMPOSITE_LIT && node(n).a == 0) {
+            expr(n, t);
+            return;
+        }
+        Operand x = valueOf(n);
+        assign(x, t, context);
+    }
+    Operand selector(const Node& s) {
+        Symbol name = s.b;
+        if (node(s.a).kind == NK_NAME) {
+            // a name exported by another package, which is not known
+            Object* object = lookup(node(s.a).a);
+            if (object != nullptr && object->kind == OB_PACKAGE) {
+                file->objects[s.a] = object;
+                return invalid(0);
+            }
+        }
+        Operand x = expr(s.a);
+        if (x.mode == M_INVALID) return x;
+        if (x.mode == M_TYPE) {
+            // a method expression T.m, a function taking the receiver first
+            Selection sel = lookupFieldOrMethod(x.type, name);
+            if (sel.kind == Selection::NONE && sel.partial) return invalid(0);
+            if (sel.kind != Selection::METHOD) {
+                error(typeString(x.type) + "." + text(name) + " undefined (type " + typeString(x.type) +
+                    " has no method " + text(name) + ")");
+            }
+            if (sel.pointerReceiver && !sel.indirect) {
+                error("invalid method expression " + typeString(x.type) + "." + text(name) +
+                    " (needs pointer receiver (*" + typeString(x.type) + ")." + text(name) + ")");
+            }
+            auto* method = static_cast<const FuncType*>(sel.type);
+            vector<const Type*> params{ x.type };
+            params.insert(params.end(), method->params->types.begin(), method->params->types.end());
+            return value(M_VALUE, typeTable.func(typeTable.tuple(move(params)), method->results, method->variadic));
+        }
+        single(x);
+        Selection sel = lookupFieldOrMethod(x.type, name);
+        switch (sel.kind) {
+        case Selection::FIELD:
+            return value(x.mode == M_VARIABLE || sel.indirect ? M_VARIABLE : M_VALUE, sel.type);
+        case Selection::METHOD:
+            if (sel.pointerReceiver && !sel.indirect && x.mode != M_VARIABLE) {
+                error("cannot call pointer method " + text(name) + " on " + typeString(x.type));
+            }
+            return value(M_VALUE, sel.type);
+        case Selection::AMBIGUOUS:
+            error("ambiguous selector " + text(name));
+        default:
+            if (sel.partial || broken(x.type)) return invalid(0);
+            error("value of type " + typeString(x.type) + " has no field or method " + text(name));
+        }
+    }
+    // An integer index, less than length when that is known.
+    void checkIndex(uint32_t n, int64_t length) {
+        if (n == 0) return;
+        Operand x = valueOf(n);
+        if (x.mode == M_INVALID) return;
+        if (isUntyped(x.type->kind) && x.mode == M_CONSTANT) convertUntyped(x, basicType(TY_INT));
+        if (!isInteger(underlying(x.type)->kind)) error("invalid index of type " + typeString(x.type));
+        if (x.mode == M_CONSTANT && x.value.kind == CV_INT) {
+            if (x.value.small < 0) error("invalid index (index must be non-negative)");
+            if (length >= 0 && x.value.small >= length) {
+                error("index " + to_string(x.value.small) + " out of bounds [0:" + to_string(length) + "]");
+            }
+        }
+    }
+    Operand index(const Node& e) {
+        Operand x = valueOf(e.a);
+        if (x.mode == M_INVALID || broken(x.type)) {
+            expr(e.b);
+            return invalid(0);
+        }
+        const Type* u = underlying(x.type);
+        if (u->kind == TY_POINTER) {
+            if (auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY)) {
+                u = a;
+                x.mode = M_VARIABLE;
+            }
+        }
+        switch (u->kind) {
+        case TY_STRING: case TY_UNTYPED_STRING:
+            checkIndex(e.b, -1);
+            return value(M_VALUE, basicType(TY_UINT8));
+        case TY_ARRAY: {
+            auto* array = static_cast<const ArrayType*>(u);
+            checkIndex(e.b, array->length);
+            return value(x.mode == M_VARIABLE ? M_VARIABLE : M_VALUE, array->elem);
+        }
+        case TY_SLICE:
+            checkIndex(e.b, -1);
+            return value(M_VARIABLE, static_cast<const SliceType*>(u)->elem);
+        case TY_MAP: {
+            auto* map = static_cast<const MapType*>(u);
+            Operand key = valueOf(e.b);
+            assign(key, map->key, "map index");
+            Operand v = value(M_MAPINDEX, map->elem);
+            v.commaOk = true;
+            return v;
+        }
+        default:
+            error("invalid operation: cannot index value of type " + typeString(x.type));
+        }
+    }
+    Operand slice(const Node& e) {
+        Operand x = valueOf(e.a);
+        if (x.mode == M_INVALID || broken(x.type)) {
+            for (uint32_t i : { e.b, e.c, e.d }) if (i != 0) expr(i);
+            return invalid(0);
+        }
+        const Type* u = underlying(x.type);
+        const Type* result = x.type;
+        int64_t length = -1;
+        if (u->kind == TY_POINTER) {
+            if (auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY)) {
+                u = a;
+                x.mode = M_VARIABLE;
+            }
+        }
+        switch (u->kind) {
+        case TY_STRING: case TY_UNTYPED_STRING:
+            if (e.d != 0) error("invalid operation: 3-index slice of string");
+            result = defaultType(x.type);
+            break;
+        case TY_ARRAY:
+            if (x.mode != M_VARIABLE) error("invalid operation: slice of unaddressable value");
+            // slice bounds may be equal to the length
+            length = static_cast<const ArrayType*>(u)->length;
+            if (length >= 0) length++;
+            result = typeTable.slice(static_cast<const ArrayType*>(u)->elem);
+            break;
+        case TY_SLICE:
+            break;
+        default:
+            error("cannot slice value of type " + typeString(x.type));
+        }
+        for (uint32_t i : { e.b, e.c, e.d }) checkIndex(i, length);
+        return value(M_VALUE, result);
+    }
+    Operand typeAssert(const Node& e) {
+        if (e.b == 0) error("use of .(type) outside type switch");
+        Operand x = valueOf(e.a);
+        const Type* t = typeOf(e.b);
+        Operand v = value(M_VALUE, t);
+        v.commaOk = true;
+        if (x.mode == M_INVALID) return v;
+        auto* iface = underlyingAs<InterfaceType>(x.type, TY_INTERFACE);
+        if (iface == nullptr) {
+            error("invalid operation: value of non-interface type " + typeString(x.type) + " on left of .(" +
+                typeString(t) + ")");
+        }
+        if (t->kind != TY_INVALID && underlying(t)->kind != TY_INTERFACE) {
+            if (Symbol missing = missingMethod(t, iface)) {
+                error("impossible type assertion: " + typeString(t) + " does not implement " +
+                    typeString(x.type) + " (missing method " + text(missing) + ")");
+            }
+        }
+        return v;
+    }
+    // The operands of a list of count values: one per expression, the results
+    // of a single call, or a comma-ok expression and its ok.
+    vector<Operand> assignValues(uint32_t l, size_t count) {
+        auto items = list(l);
+        vector<Operand> values;
+        if (items.size() == 1 && count > 1) {
+            Operand x = expr(items[0]);
+            if (x.mode == M_INVALID) return vector<Operand>(count, x);
+            if (x.mode == M_VALUE && x.type->kind == TY_TUPLE) {
+                for (const Type* t : static_cast<const TupleType*>(x.type)->types) {
+                    values.push_back(value(M_VALUE, t));
+                }
+            }
+            else if (x.commaOk && count == 2) {
+                values.push_back(x);
+                values.back().node = 0;
+                values.push_back(value(M_VALUE, basicType(TY_UNTYPED_BOOL)));
+            }
+            else {
+                single(x);
+                values.push_back(x);
+            }
+        }
+        else {
+            for (uint32_t item : items) values.push_back(valueOf(item));
+        }
+        if (values.size() != count) {
+            error("assignment mismatch: " + to_string(count) + " variables but " + to_string(values.size()) +
+                " values");
+        }
+        return values;
+    }
+    Operand call(const Node& c) {
+        auto args = list(c.b);
+        Operand f = expr(c.a);
+        Operand result;
+        if (f.mode != M_TYPE && f.mode != M_BUILTIN && broken(f.type)) f.mode = M_INVALID;
+        switch (f.mode) {
+        case M_INVALID:
+            for (uint32_t arg : args) expr(arg);
+            result = invalid(0);
+            break;
+        case M_TYPE:
+            if (args.size() != 1 || (c.flags & F_VARIADIC)) {
+                error("conversion to " + typeString(f.type) + " needs exactly one argument");
+            }
+            return conversion(args[0], f.type);
+        case M_BUILTIN:
+            result = builtin(BuiltinId(f.value.small), args, c.flags & F_VARIADIC);
+            break;
+        default: {
+            single(f);
+            auto* type = underlyingAs<FuncType>(f.type, TY_FUNC);
+            if (type == nullptr) error("invalid operation: cannot call non-function of type " + typeString(f.type));
+            arguments(type, args, c.flags & F_VARIADIC);
+            auto& results = type->results->types;
+            result = results.empty() ? value(M_NOVALUE, invalidType()) :
+                value(M_VALUE, results.size() == 1 ? results[0] : type->results);
+            break;
+        }
+        }
+        result.statement = true;
+        return result;
+    }
+    void arguments(const FuncType* type, Tree::List args, bool dots) {
+        auto& params = type->params->types;
+        vector<Operand> values;
+        if (args.size() == 1) {
+            Operand x = expr(args[0]);
+            if (x.mode == M_VALUE && x.type->kind == TY_TUPLE && !dots) {
+                for (const Type* t : static_cast<const TupleType*>(x.type)->types) {
+                    values.push_back(value(M_VALUE, t));
+                }
+            }
+            else {
+                single(x);
+                values.push_back(x);
+            }
+        }
+        else {
+            for (uint32_t arg : args) values.push_back(valueOf(arg));
+        }
+        size_t fixed = type->variadic ? params.size() - 1 : params.size();
+        if (dots && !type->variadic) error("cannot use ... in call to non-variadic function");
+        if (values.size() < fixed || (dots && values.size() != params.size())) {
+            error("not enough arguments in call to function of type " + typeString(type));
+        }
+        if ((!type->variadic && values.size() > params.size()) || (dots && values.size() > params.size())) {
+            error("too many arguments in call to function of type " + typeString(type));
+        }
+        for (size_t i = 0; i < values.size(); i++) {
+            const Type* param = i < fixed || dots ? params[min(i, params.size() - 1)] :
+                static_cast<const SliceType*>(params.back())->elem;
+            assign(values[i], param, "argument");
+        }
+    }
+    Operand conversion(uint32_t arg, const Type* t) {
+        Operand x = valueOf(arg);
+        if (x.mode == M_INVALID) return value(M_VALUE, t);
+        bool constant = x.mode == M_CONSTANT && isBasic(underlying(t)->kind);
+        if (isUntyped(x.type->kind) && x.type->kind != TY_UNTYPED_NIL && isBasic(underlying(t)->kind)) {
+            TypeKind k = x.type->kind, target = underlying(t)->kind;
+            bool ok = (isNumeric(k) && isNumeric(target)) || (k == TY_UNTYPED_BOOL && isBoolean(target)) ||
+                (k == TY_UNTYPED_STRING && isString(target)) || (isInteger(k) && isString(target)) ||
+                target == TY_INVALID;
+            if (!ok) error("cannot convert constant of type " + typeString(x.type) + " to " + typeString(t));
+        }
+        else if (!convertible(x, t)) {
+            error("cannot convert value of type " + typeString(x.type) + " to " + typeString(t));
+        }
+        if (!constant) return value(M_VALUE, t);
+        Operand r = constantValue(t, x.value);
+        if (isString(underlying(t)->kind) && x.value.isInt()) {
+            // the UTF-8 of the code point
+            string s;
+            appendUtf8(s, x.value.kind == CV_INT ? x.value.small : -1);
+            r.value = constantString(move(s), arena);
+        }
+        represent(r);
+        return r;
+    }
+    // Whether evaluating n calls a function or receives from a channel, so that
+    // len(n) is not a constant.
+    bool callsOrReceives(uint32_t n) const {
+        const Node& e = node(n);
+        if (e.kind == NK_CALL || (e.kind == NK_UNARY && e.op() == OP_CHAN)) return true;
+        bool found = false;
+        tree->forEachChild(n, [&](uint32_t child) { found = found || callsOrReceives(child); });
+        return found;
+    }
+    Operand builtin(BuiltinId id, Tree::List args, bool dots) {
+        static const pair<uint8_t, uint8_t> arity[] = { { 1, 255 }, { 1, 1 }, { 1, 1 }, { 2, 2 },
+            { 2, 2 }, { 2, 2 }, { 1, 1 }, { 1, 1 }, { 1, 3 }, { 1, 1 }, { 1, 1 }, { 0, 255 }, { 0, 255 },
+            { 1, 1 }, { 0, 0 } };
+        string name = builtinNames[id];
+        if (args.size() < arity[id].first) error("not enough arguments for " + name);
+        if (args.size() > arity[id].second) error("too many arguments for " + name);
+        if (dots && id != BI_APPEND) error("invalid use of ... with built-in " + name);
+        // make and new take a type first
+        if (id == BI_MAKE || id == BI_NEW) {
+            Operand t = expr(args[0]);
+            if (t.mode == M_INVALID) {
+                for (size_t i = 1; i < args.size(); i++) valueOf(args[i]);
+                return value(M_VALUE, invalidType());
+            }
+            if (t.mode != M_TYPE) error(name + " needs a type as its first argument");
+            if (id == BI_NEW) return value(M_VALUE, typeTable.pointer(t.type));
+            TypeKind k = underlying(t.type)->kind;
+            size_t least = k == TY_SLICE ? 2 : 1;
+            if (k != TY_SLICE && k != TY_MAP && k != TY_CHAN && k != TY_INVALID) {
+                error("invalid argument: cannot make " + typeString(t.type));
+            }
+            if (args.size() < least) error("not enough arguments for make " + typeString(t.type));
+            if (args.size() > least + 1) error("too many arguments for make " + typeString(t.type));
+            for (size_t i = 1; i < args.size(); i++) checkIndex(args[i], -1);
+            return value(M_VALUE, t.type);
+        }
+        vector<Operand> x;
+        for (uint32_t arg : args) x.push_back(valueOf(arg));
+        for (auto& operand : x) {
+            if (operand.mode == M_INVALID) {
+                Operand result = invalid(0);
+                if (id == BI_LEN || id == BI_CAP || id == BI_COPY) result = value(M_VALUE, basicType(TY_INT));
+                if (id == BI_APPEND) result = value(M_VALUE, x[0].type);
+                if (id == BI_PANIC || id == BI_PRINT || id == BI_PRINTLN || id == BI_CLOSE || id == BI_DELETE) {
+                    result = value(M_NOVALUE, invalidType());
+                }
+                if (x[0].mode == M_INVALID && id == BI_APPEND) result = invalid(0);
+                result.statement = id != BI_LEN && id != BI_CAP && id != BI_APPEND;
+                return result;
+            }
+        }
+        auto under = [&](size_t i) { return underlying(x[i].type); };
+        Operand result = value(M_NOVALUE, invalidType());
+        switch (id) {
+        case BI_APPEND: {
+            if (x[0].type->kind == TY_UNTYPED_NIL) error("first argument to append must be a typed slice");
+            auto* s = underlyingAs<SliceType>(x[0].type, TY_SLICE);
+            if (s == nullptr) error("invalid argument: first argument to append must be a slice");
+            if (dots) {
+                if (x.size() != 2) error("can only use ... with final argument");
+                bool bytes = underlying(s->elem)->kind == TY_UINT8 && isString(under(1)->kind);
+                if (!bytes) assign(x[1], x[0].type, "append");
+            }
+            else {
+                for (size_t i = 1; i < x.size(); i++) assign(x[i], s->elem, "append");
+            }
+            return value(M_VALUE, x[0].type);
+        }
+        case BI_CAP: case BI_LEN: {
+            const Type* u = under(0);
+            if (u->kind == TY_POINTER) {
+                if (auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY)) u = a;
+            }
+            bool ok = u->kind == TY_ARRAY || u->kind == TY_SLICE || u->kind == TY_CHAN ||
+                (id == BI_LEN && (isString(u->kind) || u->kind == TY_MAP));
+            if (!ok) error("invalid argument: value of type " + typeString(x[0].type) + " for " + name);
+            if (isString(u->kind) && x[0].mode == M_CONSTANT) {
+                if (x[0].value.kind != CV_STRING) return constantValue(basicType(TY_INT));
+                return constantValue(basicType(TY_INT), constantInt(int64_t(x[0].value.text->size())));
+            }
+            if (u->kind == TY_ARRAY && !callsOrReceives(args[0])) {
+                int64_t length = static_cast<const ArrayType*>(u)->length;
+                return constantValue(basicType(TY_INT), length >= 0 ? constantInt(length) : Constant());
+            }
+            return value(M_VALUE, basicType(TY_INT));
+        }
+        case BI_CLOSE: {
+            auto* c = underlyingAs<ChanType>(x[0].type, TY_CHAN);
+            if (c == nullptr) error("invalid operation: non-chan argument to close");
+            if (c->dir == CHAN_RECV) error("invalid operation: cannot close receive-only channel");
+            break;
+        }
+        case BI_COMPLEX: {
+            if (isUntyped(x[0].type->kind) && !isUntyped(x[1].type->kind)) convertUntyped(x[0], x[1].type);
+            if (isUntyped(x[1].type->kind) && !isUntyped(x[0].type->kind)) convertUntyped(x[1], x[0].type);
+            TypeKind a = under(0)->kind, b = under(1)->kind;
+            if (!(isNumeric(a) && !isComplex(a) && isNumeric(b) && !isComplex(b))) {
+                error("invalid operation: complex arguments must be floating-point numbers");
+            }
+            if (isUntyped(a) && isUntyped(b)) {
+                if (x[0].mode == M_CONSTANT && x[1].mode == M_CONSTANT) {
+                    Constant real = convertConstant(x[0].value, CV_FLOAT, arena);
+                    Constant imag = convertConstant(x[1].value, CV_FLOAT, arena);
+                    if (!real.known() || !imag.known()) return constantValue(basicType(TY_UNTYPED_COMPLEX));
+                    return constantValue(basicType(TY_UNTYPED_COMPLEX),
+                        constantComplex(*real.ratio, *imag.ratio, arena));
+                }
+                return value(M_VALUE, basicType(TY_COMPLEX128));
+            }
+            if (!identical(x[0].type, x[1].type)) error("invalid operation: mismatched types in complex");
+            return value(M_VALUE, basicType(a == TY_FLOAT32 ? TY_COMPLEX64 : TY_COMPLEX128));
+        }
+        case BI_COPY: {
+            auto* dst = underlyingAs<SliceType>(x[0].type, TY_SLICE);
+            if (dst == nullptr) error("invalid argument: copy expects slice arguments");
+            bool ok = (under(1)->kind == TY_SLICE &&
+                identical(static_cast<const SliceType*>(under(1))->elem, dst->elem)) ||
+                (isString(under(1)->kind) && underlying(dst->elem)->kind == TY_UINT8);
+            if (!ok) error("invalid argument: arguments to copy have different element types");
+            result = value(M_VALUE, basicType(TY_INT));
+            break;
+        }
+        case BI_DELETE: {
+            auto* m = underlyingAs<MapType>(x[0].type, TY_MAP);
+            if (m == nullptr) error("invalid argument: first argument to delete must be a map");
+            assign(x[1], m->key, "argument to delete");
+            break;
+        }
+        case BI_IMAG: case BI_REAL: {
+            TypeKind k = under(0)->kind;
+            if (!isNumeric(k) || (!isComplex(k) && !isUntyped(k))) {
+                error("invalid argument: " + name + " expects a complex number");
+            }
+            if (isUntyped(k)) {
+                if (x[0].mode == M_CONSTANT) {
+                    Constant c = convertConstant(x[0].value, CV_COMPLEX, arena);
+                    if (!c.known()) return constantValue(basicType(TY_UNTYPED_FLOAT));
+                    return constantValue(basicType(TY_UNTYPED_FLOAT),
+                        constantFloat(id == BI_REAL ? c.complex->real : c.complex->imag, arena));
+                }
+                return value(M_VALUE, basicType(TY_FLOAT64));
+            }
+            return value(M_VALUE, basicType(k == TY_COMPLEX64 ? TY_FLOAT32 : TY_FLOAT64));
+        }
+        case BI_PANIC:
+            assign(x[0], universe().empty, "argument to panic");
+            break;
+        case BI_PRINT: case BI_PRINTLN:
+            for (auto& operand : x) {
+                if (operand.type->kind == TY_UNTYPED_NIL) error("use of untyped nil in argument to " + name);
+                defaultValue(operand, "argument");
+            }
+            break;
+        case BI_RECOVER:
+            result = value(M_VALUE, universe().empty);
+            break;
+        default:
+            break;
+        }
+        result.statement = true;
+        return result;
+    }
+    Operand unary(const Node& e) {
+        TokenType op = e.op();
+        if (op == OP_MUL) {
+            Operand x = expr(e.a);
+            if (x.mode == M_INVALID) return x;
+            if (x.mode == M_TYPE) return value(M_TYPE, typeTable.pointer(x.type));
+            single(x);
+            if (underlying(x.type)->kind == TY_INVALID) return invalid(0);
+            if (x.type->kind == TY_UNTYPED_NIL) error("invalid operation: cannot indirect nil");
+            auto* p = underlyingAs<PointerType>(x.type, TY_POINTER);
+            if (p == nullptr) error("invalid operation: cannot indirect value of type " + typeString(x.type));
+            return value(M_VARIABLE, p->base);
+        }
+        if (op == OP_BITAND) {
+            bool literal = node(e.a).kind == NK_COMPOSITE_LIT;
+            Operand x = valueOf(e.a);
+            if (x.mode == M_INVALID) return x;
+            if (x.mode != M_VARIABLE && !literal) error("invalid operation: cannot take address of value");
+            return value(M_VALUE, typeTable.pointer(x.type));
+        }
+        Operand x = valueOf(e.a);
+        if (x.mode == M_INVALID || broken(x.type)) return invalid(0);
+        TypeKind k = underlying(x.type)->kind;
+        if (op == OP_CHAN) {
+            auto* c = underlyingAs<ChanType>(x.type, TY_CHAN);
+            if (c == nullptr) error("invalid operation: cannot receive from non-channel " + typeString(x.type));
+            if (c->dir == CHAN_SEND) error("invalid operation: cannot receive from send-only channel");
+            Operand v = value(M_VALUE, c->elem);
+            v.commaOk = true;
+            v.statement = true;
+            return v;
+        }
+        bool ok = op == OP_NOT ? isBoolean(k) : op == OP_XOR ? isInteger(k) : isNumeric(k);
+        if (!ok) {
+            error("invalid operation: operator " + string(operators[op - OP_ADD]) + " not defined on value of type " +
+                typeString(x.type));
+        }
+        if (x.mode != M_CONSTANT) return value(M_VALUE, x.type);
+        Operand r = constantValue(x.type, constantUnary(op, x.value, isUnsigned(k) ? intBits(k) : 0, arena));
+        represent(r);
+        return r;
+    }
+    // Gives an untyped operand the type of the other one, or two untyped
+    // numeric operands the larger of their kinds.
+    void match(Operand& x, Operand& y) {
+        bool ux = isUntyped(x.type->kind), uy = isUntyped(y.type->kind);
+        auto mismatch = [&] {
+            error("invalid operation: mismatched types " + typeString(x.type) + " and " + typeString(y.type));
+        };
+        if (ux && !uy) {
+            if (!convertUntyped(x, y.type)) mismatch();
+        }
+        else if (!ux && uy) {
+            if (!convertUntyped(y, x.type)) mismatch();
+        }
+        else if (ux && uy && isNumeric(x.type->kind) && isNumeric(y.type->kind)) {
+            const Type* t = basicType(max(x.type->kind, y.type->kind));
+            x.type = y.type = t;
+        }
+    }
+    Operand binary(Operand x, Operand y, TokenType op) {
+        if (x.mode == M_INVALID || y.mode == M_INVALID) return invalid(0);
+        if (op == OP_LSHIFT || op == OP_RSHIFT) return shift(x, y, op);
+        if (op == OP_EQ || op == OP_NE || op == OP_LT || op == OP_LE || op == OP_GT || op == OP_GE) {
+            return compare(x, y, op);
+        }
+        match(x, y);
+        if (!identical(x.type, y.type)) {
+            error("invalid operation: mismatched types " + typeString(x.type) + " and " + typeString(y.type));
+        }
+        TypeKind k = underlying(x.type)->kind;
+        bool ok = false;
+        switch (op) {
+        case OP_ADD: ok = isNumeric(k) || isString(k); break;
+        case OP_SUB: case OP_MUL: case OP_DIV: ok = isNumeric(k); break;
+        case OP_MOD: case OP_BITAND: case OP_BITOR: case OP_XOR: case OP_ANDXOR: ok = isInteger(k); break;
+        case OP_AND: case OP_OR: ok = isBoolean(k); break;
+        default: break;
+        }
+        if (!ok && k != TY_INVALID) {
+            error("invalid operation: operator " + string(operators[op - OP_ADD]) + " not defined on value of type " +
+                typeString(x.type));
+        }
+        // a constant divisor must not be zero for an integer or a constant
+        bool zero = y.mode == M_CONSTANT && constantIsZero(y.value) && (isInteger(k) || x.mode == M_CONSTANT);
+        if ((op == OP_DIV || op == OP_MOD) && zero) error("invalid operation: division by zero");
+        if (x.mode != M_CONSTANT || y.mode != M_CONSTANT) return value(M_VALUE, x.type);
+        Operand r = constantValue(x.type, constantBinary(op, x.value, y.value, isInteger(k), arena));
+        represent(r);
+        return r;
+    }
+    Operand shift(Operand& x, Operand& y, TokenType op) {
+        if (y.mode == M_CONSTANT && constantSign(y.value) < 0) error("invalid operation: negative shift count");
+        if (y.mode == M_CONSTANT && isUntyped(y.type->kind)) {
+            if (!isNumeric(y.type->kind)) error("invalid operation: shift count must be integer");
+            Constant count = convertConstant(y.value, CV_INT, arena);
+            if (y.value.known() && !count.known()) {
+                error("invalid operation: shift count " + constantString(y.value) + " truncated to integer");
+            }
+            y.value = count;
+            y.type = basicType(TY_UINT);
+        }
+        if (!isInteger(underlying(y.type)->kind)) {
+            error("invalid operation: shift count type " + typeString(y.type) + ", must be integer");
+        }
+        TypeKind k = x.type->kind;
+        const Type* t = x.type;
+        if (isUntyped(k) && x.mode == M_CONSTANT) {
+            if (!isNumeric(k)) error("invalid operation: shifted operand must be integer");
+            // a shifted untyped constant is an integer
+            t = basicType(k == TY_UNTYPED_RUNE ? TY_UNTYPED_RUNE : TY_UNTYPED_INT);
+            Constant v = convertConstant(x.value, CV_INT, arena);
+            if (x.value.known() && !v.known()) {
+                error("invalid operation: shifted operand " + constantString(x.value) + " must be integer");
+            }
+            x.value = v;
+            if (y.mode != M_CONSTANT) return value(M_VALUE, t);
+        }
+        else if (!isInteger(underlying(x.type)->kind)) {
+            error("invalid operation: shifted operand of type " + typeString(x.type) + " must be integer");
+        }
+        if (x.mode != M_CONSTANT || y.mode != M_CONSTANT) return value(M_VALUE, t);
+        Operand r = constantValue(t);
+        if (x.value.known() && y.value.known()) {
+            // as Go bounds it, a shift beyond the exponent range of a float64
+            const int64_t shiftBound = 1023 - 1 + 52;
+            if (y.value.kind != CV_INT || y.value.small > shiftBound) {
+                error("invalid operation: invalid shift count " + constantString(y.value));
+            }
+            r.value = constantShift(op, x.value, uint64_t(y.value.small), arena);
+        }
+        represent(r);
+        return r;
+    }
+    Operand compare(Operand& x, Operand& y, TokenType op) {
+        bool nilX = x.type->kind == TY_UNTYPED_NIL, nilY = y.type->kind == TY_UNTYPED_NIL;
+        match(x, y);
+        if (!assignable(x, y.type) && !assignable(y, x.type)) {
+            error("invalid operation: mismatched types " + typeString(x.type) + " and " + typeString(y.type));
+        }
+        const Type* t = nilX ? y.type : x.type;
+        bool ok;
+        if (op == OP_EQ || op == OP_NE) {
+            ok = nilX || nilY ? !(nilX && nilY) : comparable(x.type) && comparable(y.type);
+        }
+        else {
+            TypeKind k = underlying(t)->kind;
+            ok = isInteger(k) || isFloat(k) || isString(k);
+        }
+        if (!ok) {
+            error("invalid operation: operator " + string(operators[op - OP_ADD]) + " not defined on value of type " +
+                typeString(t));
+        }
+        if (x.mode == M_CONSTANT && y.mode == M_CONSTANT) {
+            bool known, v = constantCompare(op, x.value, y.value, known);
+            return constantValue(basicType(TY_UNTYPED_BOOL), known ? constantBool(v) : Constant());
+        }
+        return value(M_VALUE, basicType(TY_UNTYPED_BOOL));
+    }
+
+    //===--- statements ---===//
+
+    void funcBody(const FuncType* type, const Type* receiverType, uint32_t receiver, uint32_t signatureNode,
+        uint32_t body) {
+        const Node& sig = node(signatureNode);
+        bool named = false;
+        for (uint32_t field : list(sig.b)) named = named || node(field).a != 0;
+        Function function{ type, named, {}, {}, {} };
+        Function* outer = current;
+        Symbol outerLabel = label;
+        int64_t outerIota = iota;
+        current = &function;
+        iota = -1;
+        openScope();
+        if (receiver != 0) {
+            for (uint32_t field : list(receiver)) declareFields(field, receiverType);
+        }
+        auto declareTuple = [&](uint32_t fields, const TupleType* tuple) {
+            size_t k = 0;
+            for (uint32_t field : list(fields)) {
+                size_t names = node(field).a != 0 ? list(node(field).a).size() : 1;
+                declareFields(field, tuple->types[k]);
+                k += names;
+            }
+        };
+        declareTuple(sig.a, type->params);
+        declareTuple(sig.b, type->results);
+        stmtList(node(body).a);
+        if (!type->results->types.empty() && !lastTerminates(node(body).a)) error("missing return");
+        for (Symbol target : function.gotos) {
+            auto l = find_if(function.labels.begin(), function.labels.end(),
+                [target](auto& l) { return l.first == target; });
+            if (l == function.labels.end()) error("label " + text(target) + " not defined");
+            l->second = true;
+        }
+        for (auto& [name, used] : function.labels) {
+            if (!used) error("label " + text(name) + " defined and not used");
+        }
+        closeScope();
+        current = outer;
+        label = outerLabel;
+        iota = outerIota;
+    }
+    void declareFields(uint32_t field, const Type* type) {
+        vector<Object*> objects;
+        if (node(field).a != 0) {
+            for (Symbol name : list(node(field).a)) {
+                objects.push_back(newObject(OB_VAR, name, type, field));
+                declareLocal(objects.back());
+            }
+        }
+        chain(field, objects);
+    }
+    // Checks the statements of a list, each whatever errors the ones before it
+    // had.
+    void stmtList(uint32_t l, bool fallthroughOk = false) {
+        auto statements = list(l);
+        Scope* outerScope = scope;
+        size_t outerDepth = depth, targets = current->targets.size();
+        Function* function = current;
+        uint32_t outer = checking;
+        for (size_t i = 0; i < statements.size(); i++) {
+            uint32_t s = statements[i];
+            try {
+                if (node(s).kind == NK_BRANCH_STMT && node(s).op() == KW_fallthrough) {
+                    checking = s;
+                    if (!fallthroughOk || i + 1 != statements.size()) error("fallthrough statement out of place");
+                    checking = outer;
+                    continue;
+                }
+                stmt(s);
+            }
+            catch (const runtime_error& e) {
+                errors.push_back(errorAt(s, e));
+                // back to the state before s, whatever it opened left behind
+                scope = outerScope;
+                depth = outerDepth;
+                current = function;
+                current->targets.resize(targets);
+                checking = outer;
+                label = 0;
+                iota = -1;
+                declareFailed(s);
+            }
+        }
+    }
+    // Declares the names the failed statement s declares as invalid, so that
+    // their uses are no errors of their own.
+    void declareFailed(uint32_t s) {
+        auto fail = [&](ObjectKind kind, Symbol name, uint32_t at) {
+            if (name == blank() || scope->lookupLocal(name) != nullptr) return;
+            declareLocal(newObject(kind, name, invalidType(), at));
+        };
+        const Node& n = node(s);
+        switch (n.kind) {
+        case NK_ASSIGN_STMT:
+            if (n.op() != OP_SHORTAGN) break;
+            for (uint32_t lhs : list(n.a)) if (node(lhs).kind == NK_NAME) fail(OB_VAR, node(lhs).a, lhs);
+            break;
+        case NK_VAR_DECL: case NK_CONST_DECL:
+            for (uint32_t spec : list(n.a)) {
+                for (Symbol name : list(node(spec).a)) fail(n.kind == NK_VAR_DECL ? OB_VAR : OB_CONST, name, spec);
+            }
+            break;
+        case NK_TYPE_DECL:
+            for (uint32_t spec : list(n.a)) fail(OB_TYPE, node(spec).a, spec);
+            break;
+        default:
+            break;
+        }
+    }
+    void pushTarget(Symbol labeled, bool loop) { current->targets.push_back({ labeled, loop }); }
+    void popTarget() { current->targets.pop_back(); }
+    void markLabel(Symbol name) {
+        for (auto& l : current->labels) if (l.first == name) l.second = true;
+    }
+    void stmt(uint32_t n) {
+        const Node& s = node(n);
+        // the label of this statement when it is the body of a labeled one
+        Symbol labeled = label;
+        label = 0;
+        uint32_t outer = checking;
+        checking = n;
+        switch (s.kind) {
+        case NK_BLOCK:
+            openScope();
+            stmtList(s.a);
+            closeScope();
+            break;
+        case NK_CONST_DECL: localConsts(s); break;
+        case NK_TYPE_DECL:
+            for (uint32_t spec : list(s.a)) {
+                Object* object = newObject(OB_TYPE, node(spec).a, nullptr, spec);
+                file->objects[spec] = object;
+                if (node(spec).flags & F_ALIAS) {
+                    typeSpec(object, node(spec));
+                    declareLocal(object);
+                }
+                else {
+                    typeSpec(object, node(spec));
+                }
+            }
+            break;
+        case NK_VAR_DECL:
+            for (uint32_t spec : list(s.a)) {
+                vector<Object*> objects;
+                for (Symbol name : list(node(spec).a)) objects.push_back(newObject(OB_VAR, name, nullptr, spec));
+                variables(objects, node(spec));
+                chain(spec, objects);
+                for (Object* o : objects) declareLocal(o);
+            }
+            break;
+        case NK_LABELED_STMT:
+            for (auto& l : current->labels) {
+                if (l.first == s.a) error("label " + text(s.a) + " already defined");
+            }
+            current->labels.push_back({ s.a, s.a == blank() });
+            label = s.a;
+            stmt(s.b);
+            break;
+        case NK_EXPR_STMT: {
+            Operand x = expr(s.a);
+            if (x.mode != M_INVALID && !x.statement) error("expression is not used");
+            break;
+        }
+        case NK_SEND_STMT: {
+            Operand ch = valueOf(s.a);
+            Operand v = valueOf(s.b);
+            if (ch.mode == M_INVALID || broken(ch.type)) break;
+            auto* c = underlyingAs<ChanType>(ch.type, TY_CHAN);
+            if (c == nullptr) error("invalid operation: cannot send to non-channel " + typeString(ch.type));
+            if (c->dir == CHAN_RECV) error("invalid operation: cannot send to receive-only channel");
+            assign(v, c->elem, "send");
+            break;
+        }
+        case NK_INC_DEC_STMT: {
+            Operand x = assignee(s.a);
+            if (x.mode != M_INVALID && !isNumeric(underlying(x.type)->kind)) {
+                error("invalid operation: " + string(s.op() == OP_INC ? "++" : "--") + " of non-numeric type " +
+                    typeString(x.type));
+            }
+            break;
+        }
+        case NK_ASSIGN_STMT: assignStmt(s); break;
+        case NK_GO_STMT: case NK_DEFER_STMT: {
+            const char* what = s.kind == NK_GO_STMT ? "go" : "defer";
+            if (node(s.a).kind != NK_CALL) error(string("expression in ") + what + " must be function call");
+            Operand x = expr(s.a);
+            if (x.mode != M_INVALID && !x.statement) error(string(what) + " requires function call, not conversion");
+            break;
+        }
+        case NK_RETURN_STMT: returnStmt(s); break;
+        case NK_BRANCH_STMT: branchStmt(s); break;
+        case NK_IF_STMT:
+            openScope();
+            if (s.a != 0) stmt(s.a);
+            condition(s.b, "if");
+            stmt(s.c);
+            if (s.d != 0) stmt(s.d);
+            closeScope();
+            break;
+        case NK_SWITCH_STMT:
+            if (s.flags & F_TYPE_SWITCH) {
+                typeSwitch(s, labeled);
+            }
+            else {
+                exprSwitch(s, labeled);
+            }
+            break;
+        case NK_SELECT_STMT:
+            pushTarget(labeled, false);
+            for (uint32_t clause : list(s.a)) {
+                const Node& c = node(clause);
+                openScope();
+                if (c.a != 0) {
+                    const Node& comm = node(c.a);
+                    uint32_t receive = comm.kind == NK_EXPR_STMT ? comm.a :
+                        comm.kind == NK_ASSIGN_STMT ? list(comm.b)[0] : 0;
+                    bool ok = comm.kind == NK_SEND_STMT ||
+                        (receive != 0 && node(receive).kind == NK_UNARY && node(receive).op() == OP_CHAN);
+                    if (!ok) error("select case must be receive, send or assign recv");
+                    stmt(c.a);
+                }
+                stmtList(c.b);
+                closeScope();
+            }
+            popTarget();
+            break;
+        case NK_FOR_STMT:
+            openScope();
+            if (s.a != 0) stmt(s.a);
+            if (s.b != 0) condition(s.b, "for");
+            if (s.c != 0) stmt(s.c);
+            pushTarget(labeled, true);
+            stmt(s.d);
+            popTarget();
+            closeScope();
+            break;
+        case NK_RANGE_STMT: rangeStmt(s, labeled); break;
+        default:
+            error(string("unexpected ") + nodeKinds[s.kind].name + " in statement list");
+        }
+        checking = outer;
+    }
+    void condition(uint32_t n, const char* what) {
+        Operand x = valueOf(n);
+        if (x.mode != M_INVALID && !isBoolean(underlying(x.type)->kind)) {
+            checking = n;
+            error(string("non-boolean condition in ") + what + " statement");
+        }
+    }
+    void localConsts(const Node& s) {
+        uint32_t valueSpec = 0;
+        int64_t i = 0;
+        for (uint32_t spec : list(s.a)) {
+            if (node(spec).c != 0) valueSpec = spec;
+            if (valueSpec == 0) error("missing init expr for const declaration");
+            auto values = list(node(valueSpec).c);
+            auto names = list(node(spec).a);
+            if (node(spec).c != 0 && values.size() > names.size()) error("extra init expr");
+            vector<Object*> objects;
+            iota = i++;
+            for (size_t k = 0; k < names.size(); k++) {
+                if (k >= values.size()) error("missing init expr for const declaration");
+                objects.push_back(newObject(OB_CONST, names[k], nullptr, spec));
+                constant(objects.back(), valueOf(values[k]), node(valueSpec).b);
+            }
+            iota = -1;
+            chain(spec, objects);
+            for (Object* o : objects) declareLocal(o);
+        }
+    }
+    // The left hand side of an assignment, invalid for the blank identifier.
+    Operand assignee(uint32_t n) {
+        if (node(n).kind == NK_NAME && node(n).a == blank()) return invalid(n);
+        Operand x = expr(n);
+        if (x.mode == M_INVALID || x.mode == M_VARIABLE || x.mode == M_MAPINDEX) return x;
+        single(x);
+        error("cannot assign to value of type " + typeString(x.type));
+    }
+    void assignStmt(const Node& s) {
+        auto lhs = list(s.a);
+        if (s.op() == OP_SHORTAGN) {
+            shortVarDecl(lhs, s.b);
+            return;
+        }
+        if (s.op() != OP_AGN) {
+            // x op= y
+            static const pair<TokenType, TokenType> ops[] = { { OP_ADDAGN, OP_ADD }, { OP_SUBAGN, OP_SUB },
+                { OP_MULAGN, OP_MUL }, { OP_DIVAGN, OP_DIV }, { OP_MODAGN, OP_MOD },
+                { OP_BITANDAGN, OP_BITAND }, { OP_BITORAGN, OP_BITOR }, { OP_BITXORAGN, OP_XOR },
+                { OP_LSFTAGN, OP_LSHIFT }, { OP_RSFTAGN, OP_RSHIFT }, { OP_ANDXORAGN, OP_ANDXOR } };
+            TokenType op = find_if(begin(ops), end(ops), [&](auto& p) { return p.first == s.op(); })->second;
+            if (lhs.size() != 1 || list(s.b).size() != 1) error("assignment operation requires single-valued expressions");
+            Operand x = assignee(lhs[0]);
+            Operand y = valueOf(list(s.b)[0]);
+            if (node(lhs[0]).kind == NK_NAME && node(lhs[0]).a == blank()) error("cannot use _ as value");
+            Operand r = binary(x, y, op);
+            assign(r, x.type, "assignment");
+            return;
+        }
+        vector<Operand> targets;
+        for (uint32_t l : lhs) targets.push_back(assignee(l));
+        vector<Operand> values = assignValues(s.b, lhs.size());
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (targets[i].mode == M_INVALID) {
+                if (node(lhs[i]).kind == NK_NAME && node(lhs[i]).a == blank()) {
+                    defaultValue(values[i], "assignment");
+                }
+                continue;
+            }
+            assign(values[i], targets[i].type, "assignment");
+        }
+    }
+    void shortVarDecl(Tree::List lhs, uint32_t rhs) {
+        vector<Operand> values = assignValues(rhs, lhs.size());
+        vector<Object*> fresh;
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (node(lhs[i]).kind != NK_NAME) error("non-name on left side of :=");
+            Symbol name = node(lhs[i]).a;
+            for (size_t k = 0; k < i; k++) {
+                if (node(lhs[k]).a == name && name != blank()) error(text(name) + " repeated on left side of :=");
+            }
+            if (name == blank()) {
+                defaultValue(values[i], "assignment");
+                continue;
+            }
+            if (Object* old = scope->lookupLocal(name); old != nullptr && old->kind == OB_VAR) {
+                file->objects[lhs[i]] = old;
+                assign(values[i], old->type, "assignment");
+                continue;
+            }
+            Object* object = newObject(OB_VAR, name, nullptr, lhs[i]);
+            object->type = values[i].mode == M_INVALID ? invalidType() : defaultValue(values[i], "assignment");
+            file->objects[lhs[i]] = object;
+            file->types[lhs[i]] = object->type;
+            fresh.push_back(object);
+        }
+        if (fresh.empty()) error("no new variables on left side of :=");
+        for (Object* o : fresh) declareLocal(o);
+    }
+    void returnStmt(const Node& s) {
+        auto& results = current->type->results->types;
+        auto values = list(s.a);
+        if (values.size() == 0) {
+            if (!results.empty() && !current->namedResults) error("not enough return values");
+            return;
+        }
+        if (results.empty()) error("too many return values");
+        vector<Operand> operands;
+        try {
+            operands = assignValues(s.a, results.size());
+        }
+        catch (const runtime_error& e) {
+            if (strncmp(e.what(), "assignment mismatch", 19) != 0) throw;
+            error(values.size() > results.size() ? "too many return values" : "not enough return values");
+        }
+        for (size_t i = 0; i < results.size(); i++) assign(operands[i], results[i], "return statement");
+    }
+    void branchStmt(const Node& s) {
+        auto& targets = current->targets;
+        switch (s.op()) {
+        case KW_break:
+            if (s.a == 0) {
+                if (targets.empty()) error("break is not in a loop, switch, or select");
+                break;
+            }
+            if (find_if(targets.begin(), targets.end(), [&](auto& t) { return t.first == s.a; }) == targets.end()) {
+                error("invalid break label " + text(s.a));
+            }
+            markLabel(s.a);
+            break;
+        case KW_continue:
+            if (s.a == 0) {
+                if (find_if(targets.begin(), targets.end(), [](auto& t) { return t.second; }) == targets.end()) {
+                    error("continue is not in a loop");
+                }
+                break;
+            }
+            if (find_if(targets.begin(), targets.end(), [&](auto& t) { return t.first == s.a && t.second; }) ==
+                targets.end()) {
+                error("invalid continue label " + text(s.a));
+            }
+            markLabel(s.a);
+            break;
+        case KW_goto:
+            current->gotos.push_back(s.a);
+            break;
+        default:
+            error("fallthrough statement out of place");
+        }
+    }
+    void exprSwitch(const Node& s, Symbol labeled) {
+        openScope();
+        if (s.a != 0) stmt(s.a);
+        Operand tag;
+        bool hasTag = s.b != 0;
+        if (hasTag) {
+            tag = valueOf(s.b);
+            if (tag.mode != M_INVALID) defaultValue(tag, "switch expression");
+        }
+        pushTarget(labeled, false);
+        auto clauses = list(s.c);
+        bool defaultSeen = false;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            const Node& c = node(clauses[i]);
+            if (c.a == 0) {
+                if (defaultSeen) error("multiple defaults in switch");
+                defaultSeen = true;
+            }
+            for (uint32_t e : list(c.a)) {
+                Operand x = valueOf(e);
+                if (!hasTag) {
+                    if (x.mode != M_INVALID && !isBoolean(underlying(x.type)->kind)) {
+                        error("invalid case in switch (mismatched types " + typeString(x.type) + " and bool)");
+                    }
+                }
+                else if (x.mode != M_INVALID && tag.mode != M_INVALID) {
+                    Operand y = tag;
+                    compare(x, y, OP_EQ);
+                }
+            }
+            openScope();
+            stmtList(c.b, i + 1 != clauses.size());
+            closeScope();
+        }
+        popTarget();
+        closeScope();
+    }
+    void typeSwitch(const Node& s, Symbol labeled) {
+        openScope();
+        if (s.a != 0) stmt(s.a);
+        const Node& guard = node(s.b);
+        Symbol bound = 0;
+        uint32_t assertion = guard.a;
+        if (guard.kind == NK_ASSIGN_STMT) {
+            bound = node(list(guard.a)[0]).a;
+            assertion = list(guard.b)[0];
+        }
+        Operand x = valueOf(node(assertion).a);
+        const InterfaceType* iface = nullptr;
+        if (x.mode != M_INVALID) {
+            iface = underlyingAs<InterfaceType>(x.type, TY_INTERFACE);
+            if (iface == nullptr) error("value of type " + typeString(x.type) + " is not an interface");
+        }
+        pushTarget(labeled, false);
+        bool defaultSeen = false;
+        for (uint32_t clause : list(s.c)) {
+            const Node& c = node(clause);
+            if (c.a == 0) {
+                if (defaultSeen) error("multiple defaults in switch");
+                defaultSeen = true;
+            }
+            const Type* single = nullptr;
+            auto cases = list(c.a);
+            for (uint32_t e : cases) {
+                const Type* t;
+                if (node(e).kind == NK_NAME && lookup(node(e).a) != nullptr && lookup(node(e).a)->kind == OB_NIL) {
+                    t = basicType(TY_UNTYPED_NIL);
+                    file->objects[e] = lookup(node(e).a);
+                }
+                else {
+                    t = typeOf(e);
+                }
+                if (iface != nullptr && t->kind != TY_INVALID && t->kind != TY_UNTYPED_NIL &&
+                    underlying(t)->kind != TY_INTERFACE) {
+                    if (Symbol missing = missingMethod(t, iface)) {
+                        error("impossible type switch case: " + typeString(t) + " does not implement " +
+                            typeString(x.type) + " (missing method " + text(missing) + ")");
+                    }
+                }
+                single = t;
+            }
+            openScope();
+            if (bound != 0 && bound != blank()) {
+                const Type* t = cases.size() == 1 && single->kind != TY_UNTYPED_NIL ? single : x.type;
+                Object* object = newObject(OB_VAR, bound, t, clause);
+                file->objects[clause] = object;
+                declareLocal(object);
+            }
+            stmtList(c.b);
+            closeScope();
+        }
+        popTarget();
+        closeScope();
+    }
+    void rangeStmt(const Node& s, Symbol labeled) {
+        openScope();
+        Operand x = valueOf(s.b);
+        const Type* key = invalidType();
+        const Type* elem = invalidType();
+        bool single = false;
+        if (x.mode != M_INVALID && !broken(x.type)) {
+            const Type* u = underlying(x.type);
+            if (u->kind == TY_POINTER) {
+                if (auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY)) u = a;
+            }
+            switch (u->kind) {
+            case TY_STRING: case TY_UNTYPED_STRING:
+                key = basicType(TY_INT);
+                elem = basicType(TY_INT32);
+                break;
+            case TY_ARRAY:
+                key = basicType(TY_INT);
+                elem = static_cast<const ArrayType*>(u)->elem;
+                break;
+            case TY_SLICE:
+                key = basicType(TY_INT);
+                elem = static_cast<const SliceType*>(u)->elem;
+                break;
+            case TY_MAP:
+                key = static_cast<const MapType*>(u)->key;
+                elem = static_cast<const MapType*>(u)->elem;
+                break;
+            case TY_CHAN:
+                if (static_cast<const ChanType*>(u)->dir == CHAN_SEND) {
+                    error("invalid operation: range over send-only channel");
+                }
+                key = static_cast<const ChanType*>(u)->elem;
+                single = true;
+                break;
+            default:
+                if (!isInteger(u->kind)) error("cannot range over value of type " + typeString(x.type));
+                key = defaultType(x.type);
+                single = true;
+                break;
+            }
+        }
+        auto lhs = list(s.a);
+        if (lhs.size() > 2 || (single && lhs.size() > 1)) error("range clause permits at most " +
+            string(single ? "one iteration variable" : "two iteration variables"));
+        const Type* types[] = { key, elem };
+        if (s.op() == OP_SHORTAGN) {
+            vector<Object*> fresh;
+            for (size_t i = 0; i < lhs.size(); i++) {
+                if (node(lhs[i]).kind != NK_NAME) error("non-name on left side of :=");
+                Object* object = newObject(OB_VAR, node(lhs[i]).a, types[i], lhs[i]);
+                file->objects[lhs[i]] = object;
+                file->types[lhs[i]] = types[i];
+                fresh.push_back(object);
+            }
+            for (Object* o : fresh) declareLocal(o);
+        }
+        else {
+            for (size_t i = 0; i < lhs.size(); i++) {
+                Operand target = assignee(lhs[i]);
+                Operand v = value(M_VALUE, types[i]);
+                if (target.mode != M_INVALID && types[i]->kind != TY_INVALID) assign(v, target.type, "range");
+            }
+        }
+        pushTarget(labeled, true);
+        stmt(s.c);
+        popTarget();
+        closeScope();
+    }
+
+    //===--- terminating statements ---===//
+
+    bool lastTerminates(uint32_t l) const {
+        auto statements = list(l);
+        return statements.size() != 0 && terminates(statements[statements.size() - 1], 0);
+    }
+    bool terminates(uint32_t n, Symbol label) const {
+        const Node& s = node(n);
+        switch (s.kind) {
+        case NK_RETURN_STMT: return true;
+        case NK_BRANCH_STMT: return s.op() == KW_goto;
+        case NK_EXPR_STMT: {
+            const Node& e = node(s.a);
+            if (e.kind != NK_CALL || node(e.a).kind != NK_NAME) return false;
+            Object* callee = file->objects[e.a];
+            return callee != nullptr && callee->kind == OB_BUILTIN && callee->value.small == BI_PANIC;
+        }
+        case NK_BLOCK: return lastTerminates(s.a);
+        case NK_IF_STMT: return s.d != 0 && terminates(s.c, 0) && terminates(s.d, 0);
+        case NK_LABELED_STMT: return terminates(s.b, s.a);
+        case NK_FOR_STMT: return s.b == 0 && !breaks(s.d, label, false);
+        case NK_SWITCH_STMT: case NK_SELECT_STMT: {
+            bool defaultSeen = s.kind == NK_SELECT_STMT;
+            for (uint32_t clause : list(s.kind == NK_SWITCH_STMT ? s.c : s.a)) {
+                const Node& c = node(clause);
+                if (c.a == 0) defaultSeen = true;
+                auto body = list(c.b);
+                if (breaks(c.b, label, false, true)) return false;
+                if (body.size() == 0) return false;
+                const Node& last = node(body[body.size() - 1]);
+                if (last.kind == NK_BRANCH_STMT && last.op() == KW_fallthrough) continue;
+                if (!terminates(body[body.size() - 1], 0)) return false;
+            }
+            return defaultSeen;
+        }
+        default: return false;
+        }
+    }
+    // Whether a break in n leaves the statement labeled label, an unlabeled one
+    // does unless nested in another for, switch or select.
+    bool breaks(uint32_t n, Symbol label, bool nested, bool isList = false) const {
+        if (isList) {
+            for (uint32_t s : list(n)) if (breaks(s, label, nested)) return true;
+            return false;
+        }
+        const Node& s = node(n);
+        if (s.kind == NK_BRANCH_STMT && s.op() == KW_break) {
+            return s.a == 0 ? !nested : s.a == label && label != 0;
+        }
+        if (s.kind == NK_FUNC_LIT) return false;
+        bool inner = nested || s.kind == NK_FOR_STMT || s.kind == NK_RANGE_STMT ||
+            s.kind == NK_SWITCH_STMT || s.kind == NK_SELECT_STMT;
+        bool found = false;
+        tree->forEachChild(n, [&](uint32_t child) { found = found || breaks(child, label, inner); });
+        return found;
+    }
+};
+
+// The first phase: declares the imports of every file in its file scope and the
+// package level names of every file in the package scope.
+void collect(PackageInfo& info) {
+    static const Symbol dot = symbols.intern("."), blank = symbols.intern("_"),
+        init = symbols.intern("init");
+    info.scope.parent = &universe().scope;
+    for (size_t i = 0; i < info.package.files.size(); i++) {
+        FileInfo& file = info.files.emplace_back();
+        file.tree = info.package.files[i];
+        file.filename = info.package.filenames[i];
+        file.scope.parent = &info.scope;
+        file.types.assign(file.tree->nodes.size(), nullptr);
+        file.values.assign(file.tree->nodes.size(), Constant());
+        file.objects.assign(file.tree->nodes.size(), nullptr);
+        const Tree& tree = *file.tree;
+        auto error = [&](uint32_t at, const string& message) {
+            info.errors.push_back(file.where(at) + ": " + message);
+        };
+        auto declare = [&](ObjectKind kind, Symbol name, uint32_t at) {
+            auto* object = info.arena.make<Object>(kind, name, nullptr);
+            object->state = Object::UNRESOLVED;
+            object->file = &file;
+            object->node = at;
+            info.objects.push_back(object);
+            if (name != blank && name != init && info.scope.insert(object) != nullptr) {
+                error(at, string(symbols.text(name)) + " redeclared in this block");
+            }
+            return object;
+        };
+        const Node& root = tree[tree.root];
+        for (uint32_t import : tree.list(root.b)) {
+            Symbol path = tree[import].a, alias = tree[import].b;
+            if (alias == dot) file.dotImport = true;
+            if (alias == dot || alias == blank) continue;
+            string_view text = symbols.text(path);
+            Symbol name = alias != 0 ? alias : symbols.intern(text.substr(text.rfind('/') + 1));
+            auto* object = info.arena.make<Object>(OB_PACKAGE, name, invalidType());
+            object->file = &file;
+            object->node = import;
+            file.objects[import] = object;
+            if (file.scope.insert(object) != nullptr) {
+                error(import, string(symbols.text(name)) + " redeclared in this block");
+            }
+        }
+        for (uint32_t decl : tree.list(root.c)) {
+            const Node& d = tree[decl];
+            vector<Object*> objects;
+            switch (d.kind) {
+            case NK_CONST_DECL: {
+                uint32_t valueSpec = 0;
+                int64_t iota = 0;
+                for (uint32_t spec : tree.list(d.a)) {
+                    if (tree[spec].c != 0) valueSpec = spec;
+                    auto names = tree.list(tree[spec].a);
+                    if (tree[spec].c != 0 && tree.list(tree[spec].c).size() > names.size()) {
+                        error(spec, "extra init expr");
+                    }
+                    objects.clear();
+                    for (uint32_t k = 0; k < names.size(); k++) {
+                        Object* object = declare(OB_CONST, names[k], spec);
+                        object->valueSpec = valueSpec;
+                        object->index = k;
+                        object->iota = iota;
+                        objects.push_back(object);
+                    }
+                    for (size_t k = 0; k + 1 < objects.size(); k++) objects[k]->next = objects[k + 1];
+                    file.objects[spec] = objects.empty() ? nullptr : objects[0];
+                    iota++;
+                }
+                break;
+            }
+            case NK_TYPE_DECL:
+                for (uint32_t spec : tree.list(d.a)) file.objects[spec] = declare(OB_TYPE, tree[spec].a, spec);
+                break;
+            case NK_VAR_DECL:
+                for (uint32_t spec : tree.list(d.a)) {
+                    objects.clear();
+                    uint32_t k = 0;
+                    for (Symbol name : tree.list(tree[spec].a)) {
+                        objects.push_back(declare(OB_VAR, name, spec));
+                        objects.back()->index = k++;
+                    }
+                    for (size_t j = 0; j + 1 < objects.size(); j++) objects[j]->next = objects[j + 1];
+                    file.objects[spec] = objects.empty() ? nullptr : objects[0];
+                }
+                break;
+            case NK_FUNC_DECL:
+                if (d.b != 0) {
+                    info.methods.push_back({ &file, decl });
+                }
+                else {
+                    file.objects[decl] = declare(OB_FUNC, d.a, decl);
+                    const Node& type = tree[d.c];
+                    if (d.a == init && ((type.a != 0 && tree.list(type.a).size() != 0) ||
+                        (type.b != 0 && tree.list(type.b).size() != 0))) {
+                        error(decl, "func init must have no arguments and no return values");
+                    }
+                }
+                if (d.d != 0) info.bodies.push_back({ &file, decl });
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    // imports are in the file block, which may not redeclare package names
+    for (auto& file : info.files) {
+        file.scope.forEach([&](Object* import) {
+            if (info.scope.lookupLocal(import->name) != nullptr) {
+                info.errors.push_back(file.where(import->node) + ": " + string(symbols.text(import->name)) +
+                    " already declared through import of package");
+            }
+        });
+    }
+}
+
+// The second phase: attaches methods to their receiver types, then resolves
+// every package level object in the order they are declared.
+void resolve(PackageInfo& info) {
+    for (auto [file, decl] : info.methods) {
+        Checker checker(info, *file, info.arena, true, info.errors);
+        try {
+            checker.method(decl);
+        }
+        catch (const runtime_error& e) {
+            info.errors.push_back(checker.errorAt(decl, e));
+            auto* failed = info.arena.make<Object>(OB_FUNC, file->tree->nodes[decl].a, invalidType());
+            failed->file = file;
+            failed->node = decl;
+            file->objects[decl] = failed;
+        }
+    }
+    for (Object* object : info.objects) Checker::resolve(info, object);
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (auto& [named, definedBy] : info.pending) {
+            if (named->underlying == nullptr && definedBy->underlying != nullptr) {
+                named->underlying = definedBy->underlying;
+                progress = true;
+            }
+        }
+    }
+    for (auto& [named, definedBy] : info.pending) {
+        if (named->underlying != nullptr) continue;
+        info.errors.push_back(named->object->file->where(named->object->node) + ": invalid recursive type " +
+            string(symbols.text(named->object->name)));
+        named->underlying = invalidType();
+    }
+    unordered_map<const NamedType*, uint8_t> state;
+    for (Object* object : info.objects) {
+        if (object->kind != OB_TYPE || object->type->kind != TY_NAMED) continue;
+        auto* named = static_cast<NamedType*>(const_cast<Type*>(object->type));
+        if (named->object == object && containsCycle(named, state)) {
+            info.errors.push_back(object->file->where(object->node) + ": invalid recursive type " +
+                string(symbols.text(object->name)));
+            named->underlying = invalidType();
+        }
+    }
+    for (const InterfaceType* i : info.interfaces) {
+        try {
+            complete(i);
+        }
+        catch (const runtime_error& e) {
+            info.errors.push_back(info.files.front().filename + ": " + e.what());
+            i->state = InterfaceType::COMPLETE;
+        }
+    }
+}
+
+// The third phase: checks every function body on pool, a task checking a run of
+// them with an arena of its own.
+void checkBodies(PackageInfo& info, ThreadPool& pool) {
+    size_t tasks = min(info.bodies.size(), size_t(pool.size()) * 4);
+    for (size_t t = 0; t < tasks; t++) {
+        auto& task = info.tasks.emplace_back();
+        size_t begin = info.bodies.size() * t / tasks, end = info.bodies.size() * (t + 1) / tasks;
+        pool.submit([&info, &task, begin, end] {
+            Checker checker(info, *info.bodies[begin].first, task.arena, false, task.errors);
+            for (size_t i = begin; i < end; i++) {
+                auto [file, decl] = info.bodies[i];
+                try {
+                    checker.function(*file, decl);
+                }
+                catch (const runtime_error& e) {
+                    task.errors.push_back(checker.errorAt(decl, e));
+                }
+            }
+        });
+    }
+}
+
+// Errors of every phase, those of declarations first, then those of bodies.
+vector<string> errorsOf(const PackageInfo& info) {
+    vector<string> errors = info.errors;
+    for (auto& task : info.tasks) errors.insert(errors.end(), task.errors.begin(), task.errors.end());
+    return errors;
+}
+
+//===----------------------------------------------------------------------===//
+// SSA intermediate representation
+//===----------------------------------------------------------------------===//
+// Checked function bodies are lowered to a typed SSA form, which every later
+// pass works on. A function keeps its values and its blocks in two arrays
+// indexed by dense ids, value 0 standing for none, and the operands of all its
+// values in a third one, so a pass walks contiguous memory and never chases
+// pointers. A block lists the ids of its values in order, phis first and its
+// terminator last.
+// A local variable is an SSA value as long as it is neither a struct nor an
+// array, its address is never taken and no closure captures it, every other one
+// is allocated and used through loads and stores. Phis are placed while the
+// body is lowered, as in Braun et al., "Simple and Efficient Construction of
+// Static Single Assignment Form": a variable read in a block whose predecessors
+// are not all known yet gets an incomplete phi, completed when the block is
+// sealed, and phis that merge a single value are replaced by it.
+
+enum Op : uint8_t {
+    IR_INVALID,
+    // aux holds the bits of a boolean, integer or float constant, the index of a
+    // string in Function::strings, and nothing for the zero value of the type
+    IR_CONST, IR_STRING, IR_ZERO,
+    // parameter aux, the receiver being the first, and the address of variable
+    // aux a closure captured
+    IR_PARAM, IR_FREE_VAR,
+    // the address of global aux of the module, and function aux as a value
+    IR_GLOBAL, IR_FUNC,
+    // function aux closed over the addresses of the variables it captures
+    IR_MAKE_CLOSURE,
+    // an imported entity named by the symbol aux, and the address of member aux
+    // of a value whose type is not known; both come from packages that are not
+    // compiled along
+    IR_EXTERN, IR_SELECT,
+    // an operand for every predecessor of its block, in their order
+    IR_PHI,
+    // arithmetic, logic and comparison of operands of the same type
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD, IR_AND, IR_OR, IR_XOR, IR_AND_NOT, IR_SHL, IR_SHR,
+    IR_NEG, IR_COMPL, IR_NOT,
+    IR_EQ, IR_NE, IR_LT, IR_LE, IR_GT, IR_GE,
+    // the operand as a value of the type, as an interface, as the asserted type
+    IR_CONVERT, IR_MAKE_INTERFACE, IR_TYPE_ASSERT,
+    // a new zeroed variable, on the heap when V_HEAP
+    IR_ALLOC, IR_LOAD, IR_STORE,
+    // the address of field aux of the struct pointed to, and of an element of
+    // the array pointed to or of a slice
+    IR_FIELD_ADDR, IR_INDEX_ADDR,
+    // field aux of a struct value, an element of an array value or a byte of a
+    // string, and element aux of a tuple
+    IR_FIELD, IR_INDEX, IR_EXTRACT,
+    // the bits of aux tell which of low, high and max follow the operand of a
+    // slice expression
+    IR_LEN, IR_CAP, IR_SLICE, IR_MAKE_SLICE, IR_APPEND, IR_COPY,
+    // the rune of a string at an index and the index after it
+    IR_STRING_NEXT,
+    IR_MAKE_MAP, IR_MAP_INDEX, IR_MAP_UPDATE, IR_MAP_DELETE,
+    // an iterator over a map, and its next entry: whether there is one, its key
+    // and its value
+    IR_MAP_ITER, IR_MAP_NEXT,
+    IR_MAKE_CHAN, IR_SEND, IR_RECV, IR_CLOSE,
+    // a select: for every case its channel, and the value for a send, the
+    // cases that send being the bits of aux. It gives the case chosen, -1 for
+    // the default, whether a receive got a value rather than the channel being
+    // closed, then the value of every receive
+    IR_CHOOSE,
+    // calls of function aux of the module, of the imported function named by the
+    // symbol aux, of a function value, and of method aux of an interface value
+    IR_CALL, IR_CALL_EXTERN, IR_CALL_VALUE, IR_CALL_METHOD,
+    // print, println when aux is 1, recover, and the deferred calls run before
+    // a return
+    IR_PRINT, IR_RECOVER, IR_RUN_DEFERS,
+    // terminators, a branch goes to its first successor when its operand is true
+    IR_JUMP, IR_BRANCH, IR_RETURN, IR_PANIC
+};
+constexpr const char* opNames[] = { "Invalid",
+    "Const", "String", "Zero", "Param", "FreeVar", "Global", "Func", "MakeClosure", "Extern", "Select",
+    "Phi", "Add", "Sub", "Mul", "Div", "Mod", "And", "Or", "Xor", "AndNot", "Shl", "Shr",
+    "Neg", "Compl", "Not", "Eq", "Ne", "Lt", "Le", "Gt", "Ge",
+    "Convert", "MakeInterface", "TypeAssert", "Alloc", "Load", "Store", "FieldAddr", "IndexAddr",
+    "Field", "Index", "Extract", "Len", "Cap", "Slice", "MakeSlice", "Append", "Copy", "StringNext",
+    "MakeMap", "MapIndex", "MapUpdate", "MapDelete", "MapIter", "MapNext",
+    "MakeChan", "Send", "Recv", "Close", "Choose", "Call", "CallExtern", "CallValue", "CallMethod",
+    "Print", "Recover", "RunDefers", "Jump", "Branch", "Return", "Panic" };
+static_assert(sizeof(opNames) / sizeof(opNames[0]) == IR_PANIC + 1, "every op needs a name");
+inline bool isTerminator(Op op) { return op >= IR_JUMP; }
+
+enum ValueFlag : uint8_t {
+    // IR_ALLOC: the variable may outlive the call
+    V_HEAP = 1,
+    // IR_MAP_INDEX, IR_TYPE_ASSERT, IR_RECV: a tuple of the result and whether
+    // there is one
+    V_COMMA_OK = 2,
+    // a call run by a new goroutine, or deferred to the return
+    V_GO = 4,
+    V_DEFER = 8,
+    // IR_APPEND: the elements of the last operand are appended
+    V_SPREAD = 16,
+    // IR_CHOOSE: there is a default case, so it never blocks
+    V_DEFAULT = 32,
+};
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+constexpr BlockId noBlock = UINT32_MAX;
+
+struct Value {
+    Op op = IR_INVALID;
+    uint8_t flags = 0;
+    uint16_t argCount = 0;
+    // the first operand in Function::operands
+    uint32_t args = 0;
+    BlockId block = 0;
+    // none for values that only have an effect
+    const Type* type = nullptr;
+    int64_t aux = 0;
+};
+static_assert(sizeof(Value) == 32, "two values should share a cache line");
+
+struct Block {
+    vector<ValueId> values;
+    vector<BlockId> preds, succs;
+};
+
+struct Function {
+    string name;
+    const FuncType* type = nullptr;
+    // T or *T of a method, which is parameter 0
+    const Type* receiver = nullptr;
+    vector<Value> values{ Value{} };
+    vector<ValueId> operands;
+    // block 0 is the entry, none are left for a function declared without body
+    vector<Block> blocks;
+    vector<string> strings;
+    // the address of each named result kept in memory, 0 for the others, which
+    // is what a function returns when a deferred call recovers from a panic
+    vector<ValueId> namedResults;
+    // the closures of its body, moved into the module once every body is lowered
+    vector<unique_ptr<Function>> closures;
+    // by value, the statement or expression it was lowered from, line 0 when
+    // none; an initializer draws from several files
+    struct Source {
+        uint32_t file = 0;
+        Position at;
+    };
+    vector<Source> sources{ Source{} };
+    vector<string> files;
+
+    // The position of value v as go build -gcflags=-m prints it, empty when unknown.
+    string where(ValueId v) const {
+        const Source& s = sources[v];
+        if (s.at.line == 0) return "";
+        return files[s.file] + ":" + to_string(s.at.line) + ":" + to_string(s.at.column);
+    }
+
+    struct Operands {
+        const ValueId* first;
+        const ValueId* last;
+        const ValueId* begin() const { return first; }
+        const ValueId* end() const { return last; }
+        size_t size() const { return last - first; }
+        ValueId operator[](size_t i) const { return first[i]; }
+    };
+    Operands args(ValueId v) const {
+        const ValueId* first = operands.data() + values[v].args;
+        return { first, first + values[v].argCount };
+    }
+};
+
+// Every function of a compilation. Functions are numbered as their packages
+// and declarations come, the closures follow once all bodies are lowered.
+struct Module {
+    deque<Function> functions;
+    struct Global {
+        string name;
+        const Type* type;
+    };
+    vector<Global> globals;
+    unordered_map<const Object*, uint32_t> functionIndex, globalIndex;
+    // the function initializing each package, in order, and main.main
+    vector<uint32_t> inits;
+    uint32_t entry = UINT32_MAX;
+    vector<string> errors;
+};
+
+// A field or method a selector reaches: the indices of the embedded fields on
+// the way, then the field itself for a FIELD.
+struct Member {
+    enum Kind : uint8_t { NONE, FIELD, METHOD, INTERFACE_METHOD } kind = NONE;
+    vector<uint32_t> path;
+    const Object* method = nullptr;
+    // the method of an interface, by its place in the complete method set
+    uint32_t index = 0;
+};
+
+// Looks up name like lookupFieldOrMethod does, keeping the path to it. The
+// checker has rejected ambiguous selectors, so the first one found at the
+// shallowest depth is the one.
+Member findMember(const Type* t, Symbol name) {
+    struct Entry {
+        const Type* type;
+        vector<uint32_t> path;
+    };
+    if (auto* p = underlyingAs<PointerType>(t, TY_POINTER); p != nullptr && t->kind != TY_NAMED) t = p->base;
+    vector<Entry> current{ { t, {} } }, next;
+    vector<const NamedType*> seen;
+    while (!current.empty()) {
+        for (auto& entry : current) {
+            const Type* type = entry.type;
+            Member found;
+            found.path = entry.path;
+            if (type->kind == TY_NAMED) {
+                auto* named = static_cast<const NamedType*>(type);
+                if (find(seen.begin(), seen.end(), named) != seen.end()) continue;
+                seen.push_back(named);
+                for (Object* method : named->methods) {
+                    if (method->name != name) continue;
+                    found.kind = Member::METHOD;
+                    found.method = method;
+                    return found;
+                }
+                type = underlying(type);
+            }
+            if (type->kind == TY_STRUCT) {
+                auto& fields = static_cast<const StructType*>(type)->fields;
+                for (uint32_t i = 0; i < fields.size(); i++) {
+                    if (fields[i].name == name) {
+                        found.kind = Member::FIELD;
+                        found.path.push_back(i);
+                        return found;
+                    }
+                    if (!fields[i].embedded) continue;
+                    const Type* embedded = fields[i].type;
+                    if (auto* p = underlyingAs<PointerType>(embedded, TY_POINTER); p != nullptr && embedded->kind != TY_NAMED) {
+                        embedded = p->base;
+                    }
+                    next.push_back({ embedded, entry.path });
+                    next.back().path.push_back(i);
+                }
+            }
+            else if (type->kind == TY_INTERFACE) {
+                auto* i = static_cast<const InterfaceType*>(type);
+                complete(i);
+                for (uint32_t k = 0; k < i->methods.size(); k++) {
+                    if (i->methods[k].name != name) continue;
+                    found.kind = Member::INTERFACE_METHOD;
+                    found.index = k;
+                    return found;
+                }
+            }
+        }
+        swap(current, next);
+        next.clear();
+    }
+    return {};
+}
+
+// The type an untyped value gets where no other is asked for.
+const Type* concreteType(const Type* t) {
+    switch (t->kind) {
+    case TY_UNTYPED_BOOL: return basicType(TY_BOOL);
+    case TY_UNTYPED_INT: return basicType(TY_INT);
+    case TY_UNTYPED_RUNE: return basicType(TY_INT32);
+    case TY_UNTYPED_FLOAT: return basicType(TY_FLOAT64);
+    case TY_UNTYPED_COMPLEX: return basicType(TY_COMPLEX128);
+    case TY_UNTYPED_STRING: return basicType(TY_STRING);
+    default: return t;
+    }
+}
+
+// The smallest node in the subtree of n, whose nodes are numbered contiguously
+// up to n itself since the tree is flattened children first.
+uint32_t firstNode(const Tree& tree, uint32_t n) {
+    uint32_t first = n;
+    tree.forEachChild(n, [&](uint32_t child) { first = min(first, firstNode(tree, child)); });
+    return first;
+}
+
+// Adds the variable whose address taking &n takes, if any, to out: that of n or
+// of the array or struct value n is part of.
+void markAddressed(const FileInfo& file, uint32_t n, unordered_set<const Object*>& out) {
+    const Tree& tree = *file.tree;
+    for (;;) {
+        const Node& e = tree[n];
+        if (e.kind == NK_NAME) {
+            if (Object* o = file.objects[n]; o != nullptr && o->kind == OB_VAR) out.insert(o);
+            return;
+        }
+        if ((e.kind != NK_SELECTOR && e.kind != NK_INDEX) || file.types[e.a] == nullptr) return;
+        TypeKind k = underlying(file.types[e.a])->kind;
+        // past a pointer or a slice the variable is not the one addressed
+        if (e.kind == NK_SELECTOR ? k == TY_POINTER : k != TY_ARRAY) return;
+        n = e.a;
+    }
+}
+
+// Adds the variables the subtree of n needs in memory to out: those whose
+// address is taken, and those that a function literal in [lo, hi) refers to
+// while they are declared outside of it.
+void findEscaping(const FileInfo& file, uint32_t n, uint32_t lo, uint32_t hi, unordered_set<const Object*>& out) {
+    const Tree& tree = *file.tree;
+    const Node& e = tree[n];
+    switch (e.kind) {
+    case NK_NAME: {
+        Object* o = file.objects[n];
+        if (hi != 0 && o != nullptr && o->kind == OB_VAR && o->file == &file && (o->node < lo || o->node >= hi)) {
+            out.insert(o);
+        }
+        break;
+    }
+    case NK_UNARY:
+        if (e.op() == OP_BITAND) markAddressed(file, e.a, out);
+        break;
+    case NK_SLICE:
+        if (file.types[e.a] != nullptr && underlying(file.types[e.a])->kind == TY_ARRAY) markAddressed(file, e.a, out);
+        break;
+    case NK_CALL: {
+        // a method with a pointer receiver called on a variable
+        const Node& s = tree[e.a];
+        if (s.kind != NK_SELECTOR || file.types[s.a] == nullptr || underlying(file.types[s.a])->kind == TY_POINTER) break;
+        Member m = findMember(file.types[s.a], s.b);
+        if (m.kind == Member::METHOD && m.method->pointerReceiver) markAddressed(file, s.a, out);
+        break;
+    }
+    case NK_FUNC_LIT:
+        lo = firstNode(tree, n);
+        hi = n;
+        break;
+    default:
+        break;
+    }
+    tree.forEachChild(n, [&](uint32_t child) { findEscaping(file, child, lo, hi, out); });
+}
+
+// Lowers one function body, or the initializers of a package, into fn.
+struct Lowerer {
+    Module& module;
+    Function& fn;
+    FileInfo* file;
+    const Tree* tree;
+    const unordered_set<const Object*>& escaping;
+    // where closures go, those of the outermost function
+    vector<unique_ptr<Function>>& closures;
+    Arena arena;
+    // the statement or expression being lowered, the source of what it emits
+    uint32_t at = 0;
+
+    Lowerer(Module& module, Function& fn, FileInfo* file, const unordered_set<const Object*>& escaping,
+        vector<unique_ptr<Function>>& closures)
+        : module(module), fn(fn), file(file), tree(file->tree), escaping(escaping), closures(closures) {}
+
+    // The function literal or declaration with the signature, receiver and body
+    // given, a literal capturing the variables free.
+    void lowerFunction(uint32_t signature, uint32_t receiver, uint32_t body, const vector<const Object*>& free) {
+        start(newBlock());
+        seal(current);
+        for (size_t i = 0; i < free.size(); i++) {
+            write(variable(free[i]), emit(IR_FREE_VAR, typeTable.pointer(free[i]->type), {}, int64_t(i)));
+        }
+        int64_t index = 0;
+        auto parameters = [&](uint32_t fields, const vector<const Type*>& types) {
+            size_t k = 0;
+            for (uint32_t field : list(fields)) {
+                const Object* o = file->objects[field];
+                size_t names = node(field).a != 0 ? list(node(field).a).size() : 1;
+                at = field;
+                for (size_t i = 0; i < names; i++, k++) {
+                    ValueId p = emit(IR_PARAM, types[k], {}, index++);
+                    if (o == nullptr) continue;
+                    declare(o, p);
+                    o = o->next;
+                }
+            }
+        };
+        if (receiver != 0) parameters(receiver, { fn.receiver });
+        const Node& sig = node(signature);
+        parameters(sig.a, fn.type->params->types);
+        at = 0;
+        for (uint32_t field : list(sig.b)) {
+            for (const Object* o = file->objects[field]; o != nullptr; o = o->next) {
+                declare(o, 0);
+                results.push_back(o);
+                fn.namedResults.push_back(inMemory(o) ? read(variable(o)) : 0);
+            }
+        }
+        scanBody(body);
+        stmtList(node(body).a);
+        if (current != noBlock) returnValues({});
+        finish();
+    }
+    // Assigns the initial values of the package level variables of specs, then
+    // calls the init functions.
+    void initializer(const vector<pair<FileInfo*, uint32_t>>& specs, const vector<uint32_t>& inits) {
+        start(newBlock());
+        seal(current);
+        for (auto [in, spec] : specs) {
+            file = in;
+            tree = in->tree;
+            const Node& s = node(spec);
+            if (s.c == 0) continue;
+            vector<ValueId> values = valuesOf(s.c, list(s.a).size());
+            size_t i = 0;
+            for (const Object* o = file->objects[spec]; o != nullptr; o = o->next, i++) {
+                auto global = module.globalIndex.find(o);
+                if (global == module.globalIndex.end()) continue;
+                ValueId address = emit(IR_GLOBAL, typeTable.pointer(o->type), {}, global->second);
+                emit(IR_STORE, nullptr, { address, coerce(values[i], o->type) });
+            }
+        }
+        for (uint32_t init : inits) emit(IR_CALL, nullptr, {}, init);
+        terminate(IR_RETURN, {});
+        finish();
+    }
+
+private:
+    // An operand that is a pointer to the place holding a value of type, or the
+    // value itself when it is not addressable.
+    struct Ref {
+        ValueId v;
+        bool pointer;
+        const Type* type;
+    };
+    // The target of an assignment.
+    struct LValue {
+        enum Kind : uint8_t { BLANK, VARIABLE, ADDRESS, MAP } kind;
+        const Type* type;
+        const Object* object = nullptr;
+        ValueId v = 0, key = 0;
+    };
+    // an enclosing for, switch or select, continueTo is none for the last two
+    struct Target {
+        Symbol label;
+        BlockId breakTo, continueTo;
+    };
+
+    BlockId current = noBlock;
+    vector<bool> sealed;
+    // the incomplete phis of every block, with their variables
+    vector<vector<pair<uint32_t, ValueId>>> incomplete;
+    // the value of a variable at the end of a block, keyed by both
+    unordered_map<uint64_t, ValueId> defs;
+    unordered_map<const Object*, uint32_t> variables;
+    vector<const Type*> variableTypes;
+    // the value a removed phi was replaced by, 0 for the others
+    vector<ValueId> forward{ 0 };
+    vector<Target> targets;
+    // blocks of the labels a goto refers to, sealed once the body is done
+    unordered_map<Symbol, BlockId> labels;
+    BlockId fallthroughTo = noBlock;
+    // the label of the statement about to be lowered
+    Symbol label = 0;
+    // the body has defer statements
+    bool defers = false;
+    vector<const Object*> results;
+
+    [[noreturn]] static void error(const string& message) { throw runtime_error(message); }
+    static Symbol blank() {
+        static const Symbol s = symbols.intern("_");
+        return s;
+    }
+    const Node& node(uint32_t n) const { return (*tree)[n]; }
+    Tree::List list(uint32_t l) const { return tree->list(l); }
+    const Type* typeOf(uint32_t n) const {
+        const Type* t = file->types[n];
+        return t == nullptr ? invalidType() : concreteType(t);
+    }
+    const Type* typeOfValue(ValueId v) const { return fn.values[v].type; }
+    bool isGlobal(const Object* o) const { return module.globalIndex.count(o) != 0; }
+    bool inMemory(const Object* o) const {
+        TypeKind k = underlying(o->type)->kind;
+        return escaping.count(o) != 0 || k == TY_STRUCT || k == TY_ARRAY;
+    }
+    // The import path of the package n names, 0 when it names none.
+    Symbol importOf(uint32_t n) const {
+        if (node(n).kind != NK_NAME) return 0;
+        const Object* o = file->objects[n];
+        return o != nullptr && o->kind == OB_PACKAGE ? o->file->tree->nodes[o->node].a : 0;
+    }
+    Symbol externName(Symbol path, Symbol name) const {
+        return symbols.intern(string(symbols.text(path)) + "." + string(symbols.text(name)));
+    }
+    // Whether n denotes a type, i.e. a call of it is a conversion.
+    bool isType(uint32_t n) const {
+        const Node& e = node(n);
+        switch (e.kind) {
+        case NK_NAME: return file->objects[n] != nullptr && file->objects[n]->kind == OB_TYPE;
+        case NK_UNARY: return e.op() == OP_MUL && isType(e.a);
+        case NK_TYPE_NAME: case NK_ARRAY_TYPE: case NK_SLICE_TYPE: case NK_STRUCT_TYPE: case NK_POINTER_TYPE:
+        case NK_FUNC_TYPE: case NK_INTERFACE_TYPE: case NK_MAP_TYPE: case NK_CHAN_TYPE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    //===--- values and blocks ---===//
+
+    BlockId newBlock() {
+        fn.blocks.emplace_back();
+        sealed.push_back(false);
+        incomplete.emplace_back();
+        return BlockId(fn.blocks.size() - 1);
+    }
+    void start(BlockId b) { current = b; }
+    // Code that follows a jump is unreachable, it goes to a block of its own
+    // that is dropped when the body is done.
+    void ensureBlock() {
+        if (current != noBlock) return;
+        start(newBlock());
+        seal(current);
+    }
+    void edge(BlockId from, BlockId to) {
+        fn.blocks[from].succs.push_back(to);
+        fn.blocks[to].preds.push_back(from);
+    }
+    ValueId add(BlockId b, Op op, const Type* type, const ValueId* args, size_t count, int64_t aux, uint8_t flags) {
+        if (count > UINT16_MAX) error("too many operands");
+        ValueId v = ValueId(fn.values.size());
+        fn.values.push_back({ op, flags, uint16_t(count), uint32_t(fn.operands.size()), b, type, aux });
+        fn.operands.insert(fn.operands.end(), args, args + count);
+        fn.sources.push_back(source());
+        forward.push_back(0);
+        return v;
+    }
+    Function::Source source() {
+        if (at == 0) return {};
+        auto f = find(fn.files.begin(), fn.files.end(), file->filename);
+        if (f == fn.files.end()) f = fn.files.insert(f, file->filename);
+        return { uint32_t(f - fn.files.begin()), tree->positions[at] };
+    }
+    ValueId emit(Op op, const Type* type, initializer_list<ValueId> args = {}, int64_t aux = 0, uint8_t flags = 0) {
+        ensureBlock();
+        ValueId v = add(current, op, type, args.begin(), args.size(), aux, flags);
+        fn.blocks[current].values.push_back(v);
+        return v;
+    }
+    ValueId emit(Op op, const Type* type, const vector<ValueId>& args, int64_t aux = 0, uint8_t flags = 0) {
+        ensureBlock();
+        ValueId v = add(current, op, type, args.data(), args.size(), aux, flags);
+        fn.blocks[current].values.push_back(v);
+        return v;
+    }
+    // Puts v into block b right after its phis.
+    void insertAfterPhis(BlockId b, ValueId v) {
+        auto& values = fn.blocks[b].values;
+        auto at = find_if(values.begin(), values.end(), [&](ValueId x) { return fn.values[x].op != IR_PHI; });
+        values.insert(at, v);
+    }
+    void terminate(Op op, const vector<ValueId>& args) {
+        emit(op, nullptr, args);
+        current = noBlock;
+    }
+    void jump(BlockId to) {
+        if (current == noBlock) return;
+        emit(IR_JUMP, nullptr);
+        edge(current, to);
+        current = noBlock;
+    }
+    void branch(ValueId condition, BlockId yes, BlockId no) {
+        emit(IR_BRANCH, nullptr, { condition });
+        edge(current, yes);
+        edge(current, no);
+        current = noBlock;
+    }
+    ValueId constant(const Constant& c, const Type* t) {
+        TypeKind k = underlying(t)->kind;
+        if (c.kind == CV_STRING) {
+            fn.strings.push_back(*c.text);
+            return emit(IR_STRING, t, {}, int64_t(fn.strings.size() - 1));
+        }
+        if (c.kind == CV_BOOL) return emit(IR_CONST, t, {}, c.small);
+        if (isComplex(k)) error("complex numbers are not supported");
+        if (isFloat(k)) {
+            Constant f = convertConstant(c, CV_FLOAT, arena);
+            if (!f.known()) return emit(IR_ZERO, t);
+            double d = toDouble(*f.ratio);
+            if (k == TY_FLOAT32) d = float(d);
+            int64_t bits;
+            memcpy(&bits, &d, sizeof bits);
+            return emit(IR_CONST, t, {}, bits);
+        }
+        Constant i = convertConstant(c, CV_INT, arena);
+        if (!i.known()) return emit(IR_ZERO, t);
+        if (i.kind == CV_INT) return emit(IR_CONST, t, {}, i.small);
+        // the value of a typed constant fits 64 bits
+        auto& limbs = i.big->limbs;
+        uint64_t bits = (limbs.size() > 0 ? limbs[0] : 0) | uint64_t(limbs.size() > 1 ? limbs[1] : 0) << 32;
+        return emit(IR_CONST, t, {}, int64_t(i.big->negative ? 0 - bits : bits));
+    }
+    ValueId intConstant(int64_t v) { return constant(constantInt(v), basicType(TY_INT)); }
+
+    //===--- variables ---===//
+
+    uint32_t variable(const Object* o) {
+        auto [it, fresh] = variables.try_emplace(o, uint32_t(variableTypes.size()));
+        if (fresh) variableTypes.push_back(inMemory(o) ? typeTable.pointer(o->type) : o->type);
+        return it->second;
+    }
+    uint32_t temporary(const Type* t) {
+        variableTypes.push_back(t);
+        return uint32_t(variableTypes.size() - 1);
+    }
+    static uint64_t key(uint32_t var, BlockId b) { return uint64_t(var) << 32 | b; }
+    void write(uint32_t var, ValueId v) {
+        ensureBlock();
+        defs[key(var, current)] = v;
+    }
+    ValueId read(uint32_t var) {
+        ensureBlock();
+        return readVariable(var, current);
+    }
+    ValueId resolve(ValueId v) const {
+        while (forward[v] != 0) v = forward[v];
+        return v;
+    }
+    ValueId readVariable(uint32_t var, BlockId b) {
+        if (auto it = defs.find(key(var, b)); it != defs.end()) return resolve(it->second);
+        ValueId v;
+        if (!sealed[b]) {
+            v = newPhi(var, b);
+            incomplete[b].push_back({ var, v });
+        }
+        else if (fn.blocks[b].preds.size() == 1) {
+            v = readVariable(var, fn.blocks[b].preds[0]);
+        }
+        else if (fn.blocks[b].preds.empty()) {
+            // read before it is written, which only unreachable code does
+            v = add(b, IR_ZERO, variableTypes[var], nullptr, 0, 0, 0);
+            insertAfterPhis(b, v);
+        }
+        else {
+            v = newPhi(var, b);
+            defs[key(var, b)] = v;
+            v = addPhiOperands(var, v);
+        }
+        defs[key(var, b)] = v;
+        return v;
+    }
+    ValueId newPhi(uint32_t var, BlockId b) {
+        ValueId v = add(b, IR_PHI, variableTypes[var], nullptr, 0, 0, 0);
+        insertAfterPhis(b, v);
+        return v;
+    }
+    ValueId addPhiOperands(uint32_t var, ValueId phi) {
+        BlockId b = fn.values[phi].block;
+        vector<ValueId> args;
+        for (size_t i = 0; i < fn.blocks[b].preds.size(); i++) args.push_back(readVariable(var, fn.blocks[b].preds[i]));
+        if (args.size() > UINT16_MAX) error("too many operands");
+        fn.values[phi].args = uint32_t(fn.operands.size());
+        fn.values[phi].argCount = uint16_t(args.size());
+        fn.operands.insert(fn.operands.end(), args.begin(), args.end());
+        return removeTrivialPhi(phi);
+    }
+    // Replaces phi by the only value it merges besides itself, if there is one.
+    ValueId removeTrivialPhi(ValueId phi) {
+        ValueId same = 0;
+        for (size_t i = 0; i < fn.values[phi].argCount; i++) {
+            ValueId v = resolve(fn.operands[fn.values[phi].args + i]);
+            if (v == same || v == phi) continue;
+            if (same != 0) return phi;
+            same = v;
+        }
+        if (same == 0) {
+            // the block is unreachable, or the variable never written
+            BlockId b = fn.values[phi].block;
+            same = add(b, IR_ZERO, fn.values[phi].type, nullptr, 0, 0, 0);
+            insertAfterPhis(b, same);
+        }
+        fn.values[phi].op = IR_INVALID;
+        forward[phi] = same;
+        return same;
+    }
+    void seal(BlockId b) {
+        for (size_t i = 0; i < incomplete[b].size(); i++) {
+            auto [var, phi] = incomplete[b][i];
+            addPhiOperands(var, phi);
+        }
+        incomplete[b].clear();
+        sealed[b] = true;
+    }
+    // Declares local o with the value v, or its zero value when v is 0.
+    void declare(const Object* o, ValueId v) {
+        uint32_t var = variable(o);
+        if (!inMemory(o)) {
+            write(var, v != 0 ? v : emit(IR_ZERO, o->type));
+            return;
+        }
+        // a variable is allocated where it is declared
+        uint32_t outer = at;
+        if (o->file == file && o->node != 0) at = o->node;
+        ValueId address = emit(IR_ALLOC, typeTable.pointer(o->type), {}, 0, escaping.count(o) != 0 ? V_HEAP : 0);
+        at = outer;
+        if (v != 0) emit(IR_STORE, nullptr, { address, v });
+        write(var, address);
+    }
+    ValueId addressOf(const Object* o) {
+        if (auto global = module.globalIndex.find(o); global != module.globalIndex.end()) {
+            return emit(IR_GLOBAL, typeTable.pointer(o->type), {}, global->second);
+        }
+        return read(variable(o));
+    }
+    ValueId load(const Object* o) {
+        if (isGlobal(o) || inMemory(o)) return emit(IR_LOAD, o->type, { addressOf(o) });
+        return read(variable(o));
+    }
+    void storeLocal(const Object* o, ValueId v) {
+        if (isGlobal(o) || inMemory(o)) {
+            emit(IR_STORE, nullptr, { addressOf(o), v });
+            return;
+        }
+        write(variable(o), v);
+    }
+
+    // Drops the blocks that can not be reached and the phis that turned out to
+    // merge a single value, then numbers the blocks and values that are left
+    // densely, the values in the order of their blocks.
+    void finish() {
+        for (BlockId b = 0; b < fn.blocks.size(); b++) {
+            if (!sealed[b]) seal(b);
+        }
+        vector<bool> live(fn.blocks.size());
+        vector<BlockId> work{ 0 };
+        live[0] = true;
+        while (!work.empty()) {
+            BlockId b = work.back();
+            work.pop_back();
+            for (BlockId s : fn.blocks[b].succs) {
+                if (!live[s]) {
+                    live[s] = true;
+                    work.push_back(s);
+                }
+            }
+        }
+        for (BlockId b = 0; b < fn.blocks.size(); b++) {
+            if (!live[b]) continue;
+            auto& preds = fn.blocks[b].preds;
+            if (all_of(preds.begin(), preds.end(), [&](BlockId p) { return live[p]; })) continue;
+            for (ValueId v : fn.blocks[b].values) {
+                if (fn.values[v].op != IR_PHI) continue;
+                uint32_t kept = 0;
+                for (size_t i = 0; i < preds.size(); i++) {
+                    if (live[preds[i]]) fn.operands[fn.values[v].args + kept++] = fn.operands[fn.values[v].args + i];
+                }
+                fn.values[v].argCount = uint16_t(kept);
+            }
+            preds.erase(remove_if(preds.begin(), preds.end(), [&](BlockId p) { return !live[p]; }), preds.end());
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (BlockId b = 0; b < fn.blocks.size(); b++) {
+                if (!live[b]) continue;
+                for (size_t i = 0; i < fn.blocks[b].values.size(); i++) {
+                    ValueId v = fn.blocks[b].values[i];
+                    if (fn.values[v].op == IR_PHI && removeTrivialPhi(v) != v) changed = true;
+                }
+            }
+        }
+        vector<BlockId> blockIds(fn.blocks.size(), noBlock);
+        vector<ValueId> valueIds(fn.values.size(), 0);
+        BlockId blockCount = 0;
+        ValueId valueCount = 1;
+        for (BlockId b = 0; b < fn.blocks.size(); b++) {
+            if (!live[b]) continue;
+            blockIds[b] = blockCount++;
+            for (ValueId v : fn.blocks[b].values) {
+                if (fn.values[v].op != IR_INVALID) valueIds[v] = valueCount++;
+            }
+        }
+        vector<Value> values{ Value{} };
+        vector<Function::Source> sources{ Function::Source{} };
+        vector<ValueId> operands;
+        vector<Block> blocks;
+        values.reserve(valueCount);
+        sources.reserve(valueCount);
+        operands.reserve(fn.operands.size());
+        for (BlockId b = 0; b < fn.blocks.size(); b++) {
+            if (!live[b]) continue;
+            Block& block = blocks.emplace_back();
+            for (ValueId v : fn.blocks[b].values) {
+                if (fn.values[v].op == IR_INVALID) continue;
+                Value value = fn.values[v];
+                value.block = blockIds[b];
+                value.args = uint32_t(operands.size());
+                for (size_t i = 0; i < value.argCount; i++) {
+                    operands.push_back(valueIds[resolve(fn.operands[fn.values[v].args + i])]);
+                }
+                values.push_back(value);
+                sources.push_back(fn.sources[v]);
+                block.values.push_back(valueIds[v]);
+            }
+            for (BlockId p : fn.blocks[b].preds) block.preds.push_back(blockIds[p]);
+            for (BlockId s : fn.blocks[b].succs) block.succs.push_back(blockIds[s]);
+        }
+        fn.values = move(values);
+        fn.sources = move(sources);
+        fn.operands = move(operands);
+        fn.blocks = move(blocks);
+    }
+
+    //===--- expressions ---===//
+
+    ValueId expr(uint32_t n) {
+        uint32_t outer = at;
+        at = n;
+        ValueId v = exprKind(n);
+        at = outer;
+        return v;
+    }
+    ValueId exprKind(uint32_t n) {
+        const Node& e = node(n);
+        if (file->values[n].known()) return constant(file->values[n], typeOf(n));
+        switch (e.kind) {
+        case NK_NAME: return name(n);
+        case NK_COMPOSITE_LIT: return compositeLit(n);
+        case NK_FUNC_LIT: return closure(n);
+        case NK_SELECTOR: {
+            if (Symbol path = importOf(e.a)) return emit(IR_EXTERN, invalidType(), {}, externName(path, e.b));
+            Member m = findMember(typeOf(e.a), e.b);
+            if (m.kind == Member::METHOD || m.kind == Member::INTERFACE_METHOD) {
+                error("method values are not supported");
+            }
+            return load(place(n));
+        }
+        case NK_INDEX: {
+            const Type* u = underlying(typeOf(e.a));
+            if (u->kind == TY_MAP) return mapIndex(e, 0);
+            if (isString(u->kind)) return emit(IR_INDEX, typeOf(n), { expr(e.a), expr(e.b) });
+            return load(place(n));
+        }
+        case NK_SLICE: {
+            // an array is sliced where it is
+            Ref x = underlying(typeOf(e.a))->kind == TY_ARRAY ? place(e.a) : Ref{ expr(e.a), false, typeOf(e.a) };
+            vector<ValueId> args{ x.v };
+            int64_t bounds = 0;
+            const uint32_t parts[] = { e.b, e.c, e.d };
+            for (int i = 0; i < 3; i++) {
+                if (parts[i] == 0) continue;
+                args.push_back(expr(parts[i]));
+                bounds |= int64_t(1) << i;
+            }
+            return emit(IR_SLICE, typeOf(n), args, bounds);
+        }
+        case NK_TYPE_ASSERT: return emit(IR_TYPE_ASSERT, typeOf(n), { expr(e.a) });
+        case NK_CALL: {
+            ValueId v = call(n, 0);
+            if (v == 0 || typeOfValue(v) == nullptr) error("function call (no value) used as value");
+            return v;
+        }
+        case NK_UNARY: {
+            switch (e.op()) {
+            case OP_BITAND: {
+                if (node(e.a).kind == NK_COMPOSITE_LIT) {
+                    ValueId a = emit(IR_ALLOC, typeOf(n), {}, 0, V_HEAP);
+                    fill(a, e.a, typeOf(e.a));
+                    return a;
+                }
+                Ref r = place(e.a);
+                if (!r.pointer) error("cannot take the address of a value");
+                return r.v;
+            }
+            case OP_MUL: return emit(IR_LOAD, typeOf(n), { expr(e.a) });
+            case OP_CHAN: return emit(IR_RECV, typeOf(n), { expr(e.a) });
+            case OP_SUB: return emit(IR_NEG, typeOf(n), { expr(e.a) });
+            case OP_XOR: return emit(IR_COMPL, typeOf(n), { expr(e.a) });
+            case OP_NOT: return emit(IR_NOT, typeOf(n), { expr(e.a) });
+            default: return expr(e.a);
+            }
+        }
+        case NK_BINARY: {
+            TokenType op = e.op();
+            if (op == OP_AND || op == OP_OR) return logical(n);
+            ValueId x = expr(e.a);
+            ValueId y = expr(e.b);
+            if (op == OP_EQ || op == OP_NE || op == OP_LT || op == OP_LE || op == OP_GT || op == OP_GE) {
+                return compare(op, x, y, typeOf(n));
+            }
+            return emit(arithmetic(op), typeOf(n), { x, y });
+        }
+        default:
+            error(string("unexpected ") + nodeKinds[e.kind].name + " in expression");
+        }
+    }
+    static Op arithmetic(TokenType op) {
+        switch (op) {
+        case OP_ADD: case OP_ADDAGN: case OP_INC: return IR_ADD;
+        case OP_SUB: case OP_SUBAGN: case OP_DEC: return IR_SUB;
+        case OP_MUL: case OP_MULAGN: return IR_MUL;
+        case OP_DIV: case OP_DIVAGN: return IR_DIV;
+        case OP_MOD: case OP_MODAGN: return IR_MOD;
+        case OP_BITAND: case OP_BITANDAGN: return IR_AND;
+        case OP_BITOR: case OP_BITORAGN: return IR_OR;
+        case OP_XOR: case OP_BITXORAGN: return IR_XOR;
+        case OP_ANDXOR: case OP_ANDXORAGN: return IR_AND_NOT;
+        case OP_LSHIFT: case OP_LSFTAGN: return IR_SHL;
+        default: return IR_SHR;
+        }
+    }
+    ValueId compare(TokenType op, ValueId x, ValueId y, const Type* type) {
+        // a value compared with an interface is boxed first
+        bool ix = underlying(typeOfValue(x))->kind == TY_INTERFACE, iy = underlying(typeOfValue(y))->kind == TY_INTERFACE;
+        if (ix && !iy) y = coerce(y, typeOfValue(x));
+        if (iy && !ix) x = coerce(x, typeOfValue(y));
+        static const pair<TokenType, Op> ops[] = { { OP_EQ, IR_EQ }, { OP_NE, IR_NE }, { OP_LT, IR_LT },
+            { OP_LE, IR_LE }, { OP_GT, IR_GT }, { OP_GE, IR_GE } };
+        return emit(find_if(begin(ops), end(ops), [&](auto& p) { return p.first == op; })->second, type, { x, y });
+    }
+    // v as a value of type t where it is assigned to one: boxed into an
+    // interface, or as it is when the representation does not change.
+    ValueId coerce(ValueId v, const Type* t) {
+        const Type* from = typeOfValue(v);
+        if (from == nullptr || t == nullptr || underlying(t)->kind != TY_INTERFACE || identical(from, t)) return v;
+        if (underlying(from)->kind == TY_INVALID) return v;
+        return emit(underlying(from)->kind == TY_INTERFACE ? IR_CONVERT : IR_MAKE_INTERFACE, t, { v });
+    }
+    ValueId name(uint32_t n) {
+        const Object* o = file->objects[n];
+        // from a dot import
+        if (o == nullptr) return emit(IR_EXTERN, invalidType(), {}, node(n).a);
+        if (o->kind == OB_VAR) return load(o);
+        if (o->kind == OB_FUNC) {
+            auto f = module.functionIndex.find(o);
+            if (f != module.functionIndex.end()) return emit(IR_FUNC, o->type, {}, f->second);
+        }
+        return emit(IR_ZERO, typeOf(n));
+    }
+    ValueId load(const Ref& r) { return r.pointer ? emit(IR_LOAD, r.type, { r.v }) : r.v; }
+    Ref place(uint32_t n) {
+        const Node& e = node(n);
+        const Type* t = typeOf(n);
+        switch (e.kind) {
+        case NK_NAME: {
+            const Object* o = file->objects[n];
+            if (o != nullptr && o->kind == OB_VAR && (isGlobal(o) || inMemory(o))) return { addressOf(o), true, o->type };
+            break;
+        }
+        case NK_UNARY:
+            if (e.op() == OP_MUL) return { expr(e.a), true, t };
+            break;
+        case NK_SELECTOR: {
+            if (importOf(e.a) != 0) break;
+            Member m = findMember(typeOf(e.a), e.b);
+            if (m.kind == Member::FIELD) return follow(place(e.a), m.path);
+            if (m.kind == Member::NONE) return { emit(IR_SELECT, typeTable.pointer(t), { expr(e.a) }, e.b), true, t };
+            break;
+        }
+        case NK_INDEX: {
+            const Type* u = underlying(typeOf(e.a));
+            if (u->kind == TY_MAP || isString(u->kind)) break;
+            if (u->kind == TY_ARRAY) {
+                Ref a = place(e.a);
+                ValueId i = expr(e.b);
+                if (a.pointer) return { emit(IR_INDEX_ADDR, typeTable.pointer(t), { a.v, i }), true, t };
+                return { emit(IR_INDEX, t, { a.v, i }), false, t };
+            }
+            // a slice, a pointer to an array or a value of unknown type
+            ValueId x = expr(e.a);
+            return { emit(IR_INDEX_ADDR, typeTable.pointer(t), { x, expr(e.b) }), true, t };
+        }
+        default:
+            break;
+        }
+        return { expr(n), false, t };
+    }
+    // The field index of the struct r is, or points to.
+    Ref field(Ref r, uint32_t index) {
+        if (auto* p = underlyingAs<PointerType>(r.type, TY_POINTER)) r = { load(r), true, p->base };
+        auto* s = underlyingAs<StructType>(r.type, TY_STRUCT);
+        const Type* t = s->fields[index].type;
+        if (r.pointer) return { emit(IR_FIELD_ADDR, typeTable.pointer(t), { r.v }, index), true, t };
+        return { emit(IR_FIELD, t, { r.v }, index), false, t };
+    }
+    Ref follow(Ref r, const vector<uint32_t>& path) {
+        for (uint32_t index : path) r = field(r, index);
+        return r;
+    }
+    ValueId mapIndex(const Node& e, uint8_t flags) {
+        auto* m = underlyingAs<MapType>(typeOf(e.a), TY_MAP);
+        ValueId x = expr(e.a);
+        ValueId key = coerce(expr(e.b), m->key);
+        const Type* t = flags & V_COMMA_OK ? typeTable.tuple({ m->elem, basicType(TY_BOOL) }) : m->elem;
+        return emit(IR_MAP_INDEX, t, { x, key }, 0, flags);
+    }
+    ValueId logical(uint32_t n) {
+        const Type* t = typeOf(n);
+        BlockId yes = newBlock(), no = newBlock(), done = newBlock();
+        uint32_t result = temporary(t);
+        condition(n, yes, no);
+        seal(yes);
+        seal(no);
+        start(yes);
+        write(result, constant(constantBool(true), t));
+        jump(done);
+        start(no);
+        write(result, constant(constantBool(false), t));
+        jump(done);
+        seal(done);
+        start(done);
+        return read(result);
+    }
+    // Branches to yes or no on the boolean n, && and || by control flow alone.
+    void condition(uint32_t n, BlockId yes, BlockId no) {
+        const Node& e = node(n);
+        if (!file->values[n].known()) {
+            if (e.kind == NK_BINARY && (e.op() == OP_AND || e.op() == OP_OR)) {
+                BlockId next = newBlock();
+                if (e.op() == OP_AND) {
+                    condition(e.a, next, no);
+                }
+                else {
+                    condition(e.a, yes, next);
+                }
+                seal(next);
+                start(next);
+                condition(e.b, yes, no);
+                return;
+            }
+            if (e.kind == NK_UNARY && e.op() == OP_NOT) {
+                condition(e.a, no, yes);
+                return;
+            }
+        }
+        branch(expr(n), yes, no);
+    }
+    ValueId compositeLit(uint32_t n) {
+        const Type* t = typeOf(n);
+        const Type* u = underlying(t);
+        switch (u->kind) {
+        case TY_POINTER: {
+            // &T{...} with T elided
+            ValueId a = emit(IR_ALLOC, t, {}, 0, V_HEAP);
+            fill(a, n, static_cast<const PointerType*>(u)->base);
+            return a;
+        }
+        case TY_STRUCT: case TY_ARRAY: {
+            ValueId a = emit(IR_ALLOC, typeTable.pointer(t));
+            fill(a, n, t);
+            return emit(IR_LOAD, t, { a });
+        }
+        case TY_SLICE: {
+            ValueId length = intConstant(literalLength(n));
+            ValueId s = emit(IR_MAKE_SLICE, t, { length, length });
+            fillElements(s, n, static_cast<const SliceType*>(u)->elem);
+            return s;
+        }
+        case TY_MAP: {
+            auto* m = static_cast<const MapType*>(u);
+            auto elements = list(node(n).b);
+            ValueId v = emit(IR_MAKE_MAP, t, { intConstant(int64_t(elements.size())) });
+            for (uint32_t e : elements) {
+                ValueId key = coerce(expr(node(e).a), m->key);
+                emit(IR_MAP_UPDATE, nullptr, { v, key, coerce(expr(node(e).b), m->elem) });
+            }
+            return v;
+        }
+        default:
+            // of a type that is not known, its elements are still evaluated
+            for (uint32_t e : list(node(n).b)) expr(node(e).kind == NK_KEYED_ELEMENT ? node(e).b : e);
+            return emit(IR_ZERO, t);
+        }
+    }
+    // Stores the elements of literal n into the struct or array of type t that
+    // a points to.
+    void fill(ValueId a, uint32_t n, const Type* t) {
+        const Type* u = underlying(t);
+        if (u->kind != TY_STRUCT) {
+            if (u->kind == TY_ARRAY) fillElements(a, n, static_cast<const ArrayType*>(u)->elem);
+            return;
+        }
+        auto& fields = static_cast<const StructType*>(u)->fields;
+        auto elements = list(node(n).b);
+        for (uint32_t i = 0; i < elements.size(); i++) {
+            uint32_t e = elements[i], index = i;
+            if (node(e).kind == NK_KEYED_ELEMENT) {
+                Symbol name = node(node(e).a).a;
+                index = uint32_t(find_if(fields.begin(), fields.end(), [&](auto& f) { return f.name == name; }) -
+                    fields.begin());
+                e = node(e).b;
+            }
+            const Type* ft = fields[index].type;
+            ValueId v = coerce(expr(e), ft);
+            emit(IR_STORE, nullptr, { emit(IR_FIELD_ADDR, typeTable.pointer(ft), { a }, index), v });
+        }
+    }
+    // The constant index of keyed element e of an array or slice literal.
+    int64_t elementIndex(uint32_t e) {
+        return convertConstant(file->values[node(e).a], CV_INT, arena).small;
+    }
+    int64_t literalLength(uint32_t n) {
+        int64_t index = 0, length = 0;
+        for (uint32_t e : list(node(n).b)) {
+            if (node(e).kind == NK_KEYED_ELEMENT) index = elementIndex(e);
+            length = max(length, ++index);
+        }
+        return length;
+    }
+    // Stores the elements of literal n into the slice or the array pointed to
+    // by base.
+    void fillElements(ValueId base, uint32_t n, const Type* elem) {
+        int64_t index = 0;
+        for (uint32_t e : list(node(n).b)) {
+            uint32_t value = e;
+            if (node(e).kind == NK_KEYED_ELEMENT) {
+                index = elementIndex(e);
+                value = node(e).b;
+            }
+            ValueId v = coerce(expr(value), elem);
+            ValueId p = emit(IR_INDEX_ADDR, typeTable.pointer(elem), { base, intConstant(index++) });
+            emit(IR_STORE, nullptr, { p, v });
+        }
+    }
+    // The variables function literal n refers to that are declared outside of
+    // it, in the order of their first use.
+    void freeVariables(uint32_t n, uint32_t lo, uint32_t hi, vector<const Object*>& out) const {
+        if (node(n).kind == NK_NAME) {
+            const Object* o = file->objects[n];
+            if (o != nullptr && o->kind == OB_VAR && !isGlobal(o) && o->file == file && (o->node < lo || o->node >= hi) &&
+                find(out.begin(), out.end(), o) == out.end()) {
+                out.push_back(o);
+            }
+        }
+        tree->forEachChild(n, [&](uint32_t child) { freeVariables(child, lo, hi, out); });
+    }
+    ValueId closure(uint32_t n) {
+        const Node& e = node(n);
+        vector<const Object*> free;
+        freeVariables(n, firstNode(*tree, n), n, free);
+        auto inner = make_unique<Function>();
+        inner->name = fn.name + ".func" + to_string(++closureCount);
+        inner->type = static_cast<const FuncType*>(typeOf(n));
+        Lowerer lowerer(module, *inner, file, escaping, closures);
+        lowerer.lowerFunction(e.a, 0, e.b, free);
+        closures.push_back(move(inner));
+        vector<ValueId> captured;
+        for (const Object* o : free) captured.push_back(addressOf(o));
+        return emit(IR_MAKE_CLOSURE, typeOf(n), captured, int64_t(closures.size() - 1));
+    }
+    uint32_t closureCount = 0;
+
+    //===--- calls ---===//
+
+    static const Type* resultOf(const FuncType* type) {
+        auto& results = type->results->types;
+        if (results.empty()) return nullptr;
+        return results.size() == 1 ? results[0] : type->results;
+    }
+    // A call, run by a new goroutine or deferred when flags say so. Its value
+    // has no type when the function returns nothing.
+    ValueId call(uint32_t n, uint8_t flags) {
+        const Node& c = node(n);
+        auto args = list(c.b);
+        bool dots = c.flags & F_VARIADIC;
+        if (isType(c.a)) return conversion(args[0], typeOf(n));
+        const Node& callee = node(c.a);
+        const Object* object = callee.kind == NK_NAME ? file->objects[c.a] : nullptr;
+        if (object != nullptr && object->kind == OB_BUILTIN) {
+            if (flags != 0) error("go and defer of built-in functions are not supported");
+            return builtin(n, BuiltinId(object->value.small));
+        }
+        if (callee.kind == NK_SELECTOR) {
+            if (Symbol path = importOf(callee.a)) {
+                return emit(IR_CALL_EXTERN, invalidType(), arguments(nullptr, args, dots), externName(path, callee.b), flags);
+            }
+            Member m = findMember(typeOf(callee.a), callee.b);
+            if (m.kind == Member::METHOD) {
+                auto f = module.functionIndex.find(m.method);
+                if (f != module.functionIndex.end() && m.method->type->kind == TY_FUNC) {
+                    auto* type = static_cast<const FuncType*>(m.method->type);
+                    vector<ValueId> values{ receiver(callee.a, m) };
+                    for (ValueId v : arguments(type, args, dots)) values.push_back(v);
+                    return emit(IR_CALL, resultOf(type), values, f->second, flags);
+                }
+            }
+            else if (m.kind == Member::INTERFACE_METHOD) {
+                Ref r = follow(place(callee.a), m.path);
+                auto* iface = static_cast<const InterfaceType*>(underlying(r.type));
+                const FuncType* type = iface->methods[m.index].type;
+                vector<ValueId> values{ load(r) };
+                for (ValueId v : arguments(type, args, dots)) values.push_back(v);
+                return emit(IR_CALL_METHOD, resultOf(type), values, m.index, flags);
+            }
+        }
+        if (object != nullptr && object->kind == OB_FUNC && object->type->kind == TY_FUNC) {
+            auto f = module.functionIndex.find(object);
+            if (f != module.functionIndex.end()) {
+                auto* type = static_cast<const FuncType*>(object->type);
+                return emit(IR_CALL, resultOf(type), arguments(type, args, dots), f->second, flags);
+            }
+        }
+        ValueId f = expr(c.a);
+        auto* type = underlyingAs<FuncType>(typeOfValue(f), TY_FUNC);
+        vector<ValueId> values{ f };
+        for (ValueId v : arguments(type, args, dots)) values.push_back(v);
+        return emit(IR_CALL_VALUE, type != nullptr ? resultOf(type) : invalidType(), values, 0, flags);
+    }
+    // The receiver method m wants from x: the value, or its address for a
+    // pointer receiver.
+    ValueId receiver(uint32_t x, const Member& m) {
+        Ref r = follow(place(x), m.path);
+        bool pointer = underlying(r.type)->kind == TY_POINTER;
+        if (m.method->pointerReceiver) {
+            if (pointer) return load(r);
+            if (r.pointer) return r.v;
+            ValueId a = emit(IR_ALLOC, typeTable.pointer(r.type), {}, 0, V_HEAP);
+            emit(IR_STORE, nullptr, { a, r.v });
+            return a;
+        }
+        if (pointer) r = { load(r), true, static_cast<const PointerType*>(underlying(r.type))->base };
+        return load(r);
+    }
+    // The arguments of a call of a function of type, the trailing ones of a
+    // variadic function packed into a slice. Without a type they are taken as
+    // they come.
+    vector<ValueId> arguments(const FuncType* type, Tree::List args, bool dots) {
+        vector<ValueId> values;
+        if (args.size() == 1 && node(args[0]).kind == NK_CALL) {
+            ValueId v = call(args[0], 0);
+            if (const Type* t = typeOfValue(v); t != nullptr && t->kind == TY_TUPLE) {
+                auto& types = static_cast<const TupleType*>(t)->types;
+                for (size_t i = 0; i < types.size(); i++) values.push_back(emit(IR_EXTRACT, types[i], { v }, int64_t(i)));
+            }
+            else {
+                values.push_back(v);
+            }
+        }
+        else {
+            for (uint32_t arg : args) values.push_back(expr(arg));
+        }
+        if (type == nullptr) return values;
+        auto& params = type->params->types;
+        size_t fixed = type->variadic && !dots ? params.size() - 1 : params.size();
+        vector<ValueId> result;
+        for (size_t i = 0; i < min(fixed, values.size()); i++) result.push_back(coerce(values[i], params[i]));
+        if (type->variadic && !dots) {
+            auto* slice = static_cast<const SliceType*>(params.back());
+            vector<ValueId> rest;
+            for (size_t i = fixed; i < values.size(); i++) rest.push_back(coerce(values[i], slice->elem));
+            result.push_back(sliceOf(slice, rest));
+        }
+        return result;
+    }
+    ValueId sliceOf(const SliceType* t, const vector<ValueId>& elements) {
+        if (elements.empty()) return emit(IR_ZERO, t);
+        ValueId length = intConstant(int64_t(elements.size()));
+        ValueId s = emit(IR_MAKE_SLICE, t, { length, length });
+        for (size_t i = 0; i < elements.size(); i++) {
+            ValueId p = emit(IR_INDEX_ADDR, typeTable.pointer(t->elem), { s, intConstant(int64_t(i)) });
+            emit(IR_STORE, nullptr, { p, elements[i] });
+        }
+        return s;
+    }
+    ValueId conversion(uint32_t arg, const Type* t) {
+        ValueId v = expr(arg);
+        if (underlying(t)->kind == TY_INTERFACE) return coerce(v, t);
+        if (identical(typeOfValue(v), t)) return v;
+        return emit(IR_CONVERT, t, { v });
+    }
+    ValueId toInt(ValueId v) {
+        const Type* t = basicType(TY_INT);
+        return typeOfValue(v) == t ? v : emit(IR_CONVERT, t, { v });
+    }
+    ValueId builtin(uint32_t n, BuiltinId id) {
+        const Node& c = node(n);
+        auto args = list(c.b);
+        const Type* t = typeOf(n);
+        switch (id) {
+        case BI_LEN: return emit(IR_LEN, t, { expr(args[0]) });
+        case BI_CAP: return emit(IR_CAP, t, { expr(args[0]) });
+        case BI_APPEND: {
+            vector<ValueId> values{ expr(args[0]) };
+            if (c.flags & F_VARIADIC) {
+                values.push_back(expr(args[1]));
+                return emit(IR_APPEND, t, values, 0, V_SPREAD);
+            }
+            auto* slice = underlyingAs<SliceType>(t, TY_SLICE);
+            for (size_t i = 1; i < args.size(); i++) {
+                ValueId v = expr(args[i]);
+                values.push_back(slice != nullptr ? coerce(v, slice->elem) : v);
+            }
+            return emit(IR_APPEND, t, values);
+        }
+        case BI_COPY: return emit(IR_COPY, basicType(TY_INT), { expr(args[0]), expr(args[1]) });
+        case BI_DELETE: {
+            ValueId m = expr(args[0]);
+            auto* type = underlyingAs<MapType>(typeOfValue(m), TY_MAP);
+            ValueId key = expr(args[1]);
+            return emit(IR_MAP_DELETE, nullptr, { m, type != nullptr ? coerce(key, type->key) : key });
+        }
+        case BI_MAKE: {
+            vector<ValueId> sizes;
+            for (size_t i = 1; i < args.size(); i++) sizes.push_back(toInt(expr(args[i])));
+            switch (underlying(t)->kind) {
+            case TY_SLICE:
+                if (sizes.size() == 1) sizes.push_back(sizes[0]);
+                return emit(IR_MAKE_SLICE, t, sizes);
+            case TY_MAP:
+                if (sizes.empty()) sizes.push_back(intConstant(0));
+                return emit(IR_MAKE_MAP, t, sizes);
+            case TY_CHAN:
+                if (sizes.empty()) sizes.push_back(intConstant(0));
+                return emit(IR_MAKE_CHAN, t, sizes);
+            default:
+                return emit(IR_ZERO, t);
+            }
+        }
+        case BI_NEW: return emit(IR_ALLOC, t, {}, 0, V_HEAP);
+        case BI_PANIC: {
+            ValueId v = coerce(expr(args[0]), typeTable.interfaceType({}, false));
+            terminate(IR_PANIC, { v });
+            return 0;
+        }
+        case BI_PRINT: case BI_PRINTLN: {
+            vector<ValueId> values;
+            for (uint32_t arg : args) values.push_back(expr(arg));
+            return emit(IR_PRINT, nullptr, values, id == BI_PRINTLN);
+        }
+        case BI_RECOVER: return emit(IR_RECOVER, t);
+        case BI_CLOSE: return emit(IR_CLOSE, nullptr, { expr(args[0]) });
+        default:
+            error("complex numbers are not supported");
+        }
+    }
+    // The values of expression list l assigned to count targets, which may all
+    // come from a single call or comma-ok expression.
+    vector<ValueId> valuesOf(uint32_t l, size_t count) {
+        auto exprs = list(l);
+        vector<ValueId> values;
+        if (exprs.size() == count) {
+            for (uint32_t e : exprs) values.push_back(expr(e));
+            return values;
+        }
+        const Node& e = node(exprs[0]);
+        ValueId tuple;
+        if (e.kind == NK_INDEX && underlying(typeOf(e.a))->kind == TY_MAP) {
+            tuple = mapIndex(e, V_COMMA_OK);
+        }
+        else if (e.kind == NK_TYPE_ASSERT) {
+            tuple = emit(IR_TYPE_ASSERT, typeTable.tuple({ typeOf(exprs[0]), basicType(TY_BOOL) }), { expr(e.a) }, 0,
+                V_COMMA_OK);
+        }
+        else if (e.kind == NK_UNARY && e.op() == OP_CHAN) {
+            tuple = emit(IR_RECV, typeTable.tuple({ typeOf(exprs[0]), basicType(TY_BOOL) }), { expr(e.a) }, 0,
+                V_COMMA_OK);
+        }
+        else {
+            tuple = call(exprs[0], 0);
+        }
+        const Type* t = typeOfValue(tuple);
+        for (size_t i = 0; i < count; i++) {
+            const Type* type = t != nullptr && t->kind == TY_TUPLE ? static_cast<const TupleType*>(t)->types[i] :
+                invalidType();
+            values.push_back(emit(IR_EXTRACT, type, { tuple }, int64_t(i)));
+        }
+        return values;
+    }
+
+    //===--- statements ---===//
+
+    // Notes the defer statements and goto targets of the body, not counting
+    // those of function literals in it.
+    void scanBody(uint32_t n) {
+        const Node& s = node(n);
+        if (s.kind == NK_FUNC_LIT) return;
+        if (s.kind == NK_DEFER_STMT) defers = true;
+        if (s.kind == NK_BRANCH_STMT && s.op() == KW_goto && labels.count(s.a) == 0) labels[s.a] = newBlock();
+        tree->forEachChild(n, [&](uint32_t child) { scanBody(child); });
+    }
+    void stmtList(uint32_t l) {
+        for (uint32_t s : list(l)) stmt(s);
+    }
+    void stmt(uint32_t n) {
+        uint32_t outer = at;
+        at = n;
+        stmtKind(n);
+        at = outer;
+    }
+    void stmtKind(uint32_t n) {
+        const Node& s = node(n);
+        Symbol labeled = label;
+        label = 0;
+        switch (s.kind) {
+        case NK_BLOCK: stmtList(s.a); break;
+        case NK_CONST_DECL: case NK_TYPE_DECL: break;
+        case NK_VAR_DECL:
+            for (uint32_t spec : list(s.a)) {
+                const Node& v = node(spec);
+                vector<ValueId> values;
+                if (v.c != 0) values = valuesOf(v.c, list(v.a).size());
+                size_t i = 0;
+                for (const Object* o = file->objects[spec]; o != nullptr; o = o->next, i++) {
+                    declare(o, values.empty() ? 0 : coerce(values[i], o->type));
+                }
+            }
+            break;
+        case NK_LABELED_STMT:
+            if (auto l = labels.find(s.a); l != labels.end()) {
+                jump(l->second);
+                start(l->second);
+            }
+            label = s.a;
+            stmt(s.b);
+            break;
+        case NK_EXPR_STMT:
+            if (node(s.a).kind == NK_CALL) {
+                call(s.a, 0);
+            }
+            else {
+                expr(s.a);
+            }
+            break;
+        case NK_SEND_STMT: {
+            ValueId ch = expr(s.a);
+            ValueId v = expr(s.b);
+            auto* type = underlyingAs<ChanType>(typeOfValue(ch), TY_CHAN);
+            emit(IR_SEND, nullptr, { ch, type != nullptr ? coerce(v, type->elem) : v });
+            break;
+        }
+        case NK_INC_DEC_STMT: {
+            LValue l = lvalue(s.a);
+            ValueId x = read(l);
+            store(l, emit(arithmetic(s.op()), l.type, { x, constant(constantInt(1), l.type) }));
+            break;
+        }
+        case NK_ASSIGN_STMT: assign(s); break;
+        case NK_GO_STMT: call(s.a, V_GO); break;
+        case NK_DEFER_STMT: call(s.a, V_DEFER); break;
+        case NK_RETURN_STMT: {
+            vector<ValueId> values;
+            if (s.a != 0 && list(s.a).size() != 0) {
+                auto& types = fn.type->results->types;
+                values = valuesOf(s.a, types.size());
+                for (size_t i = 0; i < types.size(); i++) values[i] = coerce(values[i], types[i]);
+            }
+            returnValues(values);
+            break;
+        }
+        case NK_BRANCH_STMT:
+            switch (s.op()) {
+            case KW_break: jump(target(s.a, false).breakTo); break;
+            case KW_continue: jump(target(s.a, true).continueTo); break;
+            case KW_goto: jump(labels.at(s.a)); break;
+            default: jump(fallthroughTo); break;
+            }
+            break;
+        case NK_IF_STMT: {
+            if (s.a != 0) stmt(s.a);
+            BlockId then = newBlock(), otherwise = s.d != 0 ? newBlock() : noBlock, done = newBlock();
+            condition(s.b, then, s.d != 0 ? otherwise : done);
+            seal(then);
+            start(then);
+            stmt(s.c);
+            jump(done);
+            if (s.d != 0) {
+                seal(otherwise);
+                start(otherwise);
+                stmt(s.d);
+                jump(done);
+            }
+            seal(done);
+            start(done);
+            break;
+        }
+        case NK_SWITCH_STMT:
+            if (s.flags & F_TYPE_SWITCH) {
+                typeSwitch(s, labeled);
+            }
+            else {
+                exprSwitch(s, labeled);
+            }
+            break;
+        case NK_SELECT_STMT: selectStmt(s, labeled); break;
+        case NK_FOR_STMT: forStmt(s, labeled); break;
+        case NK_RANGE_STMT: rangeStmt(s, labeled); break;
+        default:
+            error(string("unexpected ") + nodeKinds[s.kind].name + " in statement list");
+        }
+    }
+    const Target& target(Symbol name, bool loop) const {
+        for (size_t i = targets.size(); i-- > 0;) {
+            const Target& t = targets[i];
+            if (name != 0 ? t.label == name : !loop || t.continueTo != noBlock) return t;
+        }
+        error("branch target not found");
+    }
+    // Returns values, or the named results when there are none. The deferred
+    // calls run first, after the values are stored into the named results they
+    // may change.
+    void returnValues(vector<ValueId> values) {
+        if (defers) {
+            if (!values.empty() && !results.empty()) {
+                for (size_t i = 0; i < results.size(); i++) storeLocal(results[i], values[i]);
+                values.clear();
+            }
+            emit(IR_RUN_DEFERS, nullptr);
+        }
+        if (values.empty()) {
+            for (const Object* o : results) values.push_back(load(o));
+        }
+        terminate(IR_RETURN, values);
+    }
+    LValue lvalue(uint32_t n) {
+        const Node& e = node(n);
+        if (e.kind == NK_NAME && e.a == blank()) return { LValue::BLANK, invalidType() };
+        if (e.kind == NK_NAME) {
+            const Object* o = file->objects[n];
+            if (o != nullptr && o->kind == OB_VAR && !isGlobal(o) && !inMemory(o)) return { LValue::VARIABLE, o->type, o };
+        }
+        if (e.kind == NK_INDEX) {
+            if (auto* m = underlyingAs<MapType>(typeOf(e.a), TY_MAP)) {
+                ValueId x = expr(e.a);
+                return { LValue::MAP, m->elem, nullptr, x, coerce(expr(e.b), m->key) };
+            }
+        }
+        Ref r = place(n);
+        if (!r.pointer) error("cannot assign to a value");
+        return { LValue::ADDRESS, r.type, nullptr, r.v };
+    }
+    ValueId read(const LValue& l) {
+        switch (l.kind) {
+        case LValue::VARIABLE: return read(variable(l.object));
+        case LValue::ADDRESS: return emit(IR_LOAD, l.type, { l.v });
+        case LValue::MAP: return emit(IR_MAP_INDEX, l.type, { l.v, l.key });
+        default: error("cannot use _ as value");
+        }
+    }
+    void store(const LValue& l, ValueId v) {
+        v = coerce(v, l.type);
+        switch (l.kind) {
+        case LValue::VARIABLE: write(variable(l.object), v); break;
+        case LValue::ADDRESS: emit(IR_STORE, nullptr, { l.v, v }); break;
+        case LValue::MAP: emit(IR_MAP_UPDATE, nullptr, { l.v, l.key, v }); break;
+        default: break;
+        }
+    }
+    void assign(const Node& s) {
+        auto lhs = list(s.a);
+        if (s.op() == OP_SHORTAGN) {
+            vector<ValueId> values = valuesOf(s.b, lhs.size());
+            for (size_t i = 0; i < lhs.size(); i++) {
+                const Object* o = file->objects[lhs[i]];
+                if (o == nullptr) continue;
+                ValueId v = coerce(values[i], o->type);
+                if (o->node == lhs[i]) {
+                    declare(o, v);
+                }
+                else {
+                    storeLocal(o, v);
+                }
+            }
+            return;
+        }
+        if (s.op() != OP_AGN) {
+            LValue l = lvalue(lhs[0]);
+            ValueId x = read(l);
+            ValueId y = expr(list(s.b)[0]);
+            store(l, emit(arithmetic(s.op()), l.type, { x, y }));
+            return;
+        }
+        // the operands of the left are evaluated first, then the right, then
+        // the assignments are made
+        vector<LValue> targets;
+        for (uint32_t l : lhs) targets.push_back(lvalue(l));
+        vector<ValueId> values = valuesOf(s.b, lhs.size());
+        for (size_t i = 0; i < lhs.size(); i++) store(targets[i], values[i]);
+    }
+    // The loop shared by for and range statements: the header tests, the body
+    // runs and the step goes back to the header. header and step may be empty.
+    template <class Header, class Body, class Step>
+    void loop(Symbol labeled, Header&& header, Body&& body, Step&& step) {
+        BlockId head = newBlock(), entry = newBlock(), post = newBlock(), exit = newBlock();
+        jump(head);
+        start(head);
+        header(entry, exit);
+        jump(entry);
+        seal(entry);
+        start(entry);
+        targets.push_back({ labeled, exit, post });
+        body();
+        targets.pop_back();
+        jump(post);
+        seal(post);
+        start(post);
+        step();
+        jump(head);
+        seal(head);
+        seal(exit);
+        start(exit);
+    }
+    void forStmt(const Node& s, Symbol labeled) {
+        if (s.a != 0) stmt(s.a);
+        // each iteration has its own copy of the variables the init statement
+        // declares, which only shows for those in memory
+        vector<const Object*> copied;
+        if (s.a != 0 && node(s.a).kind == NK_ASSIGN_STMT && node(s.a).op() == OP_SHORTAGN) {
+            for (uint32_t l : list(node(s.a).a)) {
+                const Object* o = file->objects[l];
+                if (o != nullptr && o->node == l && inMemory(o)) copied.push_back(o);
+            }
+        }
+        loop(labeled,
+            [&](BlockId body, BlockId exit) {
+                if (s.b != 0) condition(s.b, body, exit);
+            },
+            [&] { stmt(s.d); },
+            [&] {
+                for (const Object* o : copied) {
+                    ValueId old = read(variable(o));
+                    ValueId v = emit(IR_LOAD, o->type, { old });
+                    declare(o, v);
+                }
+                if (s.c != 0) stmt(s.c);
+            });
+    }
+    void rangeStmt(const Node& s, Symbol labeled) {
+        auto lhs = list(s.a);
+        bool define = s.op() == OP_SHORTAGN;
+        // gives iteration variable i the value v
+        auto bind = [&](size_t i, ValueId v) {
+            if (i >= lhs.size()) return;
+            if (!define) {
+                store(lvalue(lhs[i]), v);
+                return;
+            }
+            if (const Object* o = file->objects[lhs[i]]) declare(o, coerce(v, o->type));
+        };
+        const Type* t = typeOf(s.b);
+        const Type* u = underlying(t);
+        if (u->kind == TY_POINTER) u = underlying(static_cast<const PointerType*>(u)->base);
+        const Type* intType = basicType(TY_INT);
+        if (isInteger(u->kind) || isString(u->kind) || u->kind == TY_SLICE || u->kind == TY_ARRAY) {
+            Ref x = { 0, false, t };
+            ValueId length;
+            if (isInteger(u->kind)) {
+                length = expr(s.b);
+                intType = typeOfValue(length);
+            }
+            else {
+                // an array is iterated where it is, not copied
+                x = u->kind == TY_ARRAY && underlying(t)->kind == TY_ARRAY ? place(s.b) : Ref{ expr(s.b), false, t };
+                length = u->kind == TY_ARRAY ? intConstant(static_cast<const ArrayType*>(u)->length) :
+                    emit(IR_LEN, intType, { x.v });
+            }
+            uint32_t index = temporary(intType), next = temporary(intType);
+            write(index, constant(constantInt(0), intType));
+            loop(labeled,
+                [&](BlockId body, BlockId exit) {
+                    branch(emit(IR_LT, basicType(TY_BOOL), { read(index), length }), body, exit);
+                },
+                [&] {
+                    ValueId i = read(index);
+                    if (isString(u->kind)) {
+                        auto* decoded = typeTable.tuple({ basicType(TY_INT32), intType });
+                        ValueId rune = emit(IR_STRING_NEXT, decoded, { x.v, i });
+                        write(next, emit(IR_EXTRACT, intType, { rune }, 1));
+                        bind(0, i);
+                        bind(1, emit(IR_EXTRACT, basicType(TY_INT32), { rune }, 0));
+                    }
+                    else {
+                        write(next, emit(IR_ADD, intType, { i, constant(constantInt(1), intType) }));
+                        bind(0, i);
+                        if (lhs.size() > 1) bind(1, element(x, i, u));
+                    }
+                    stmt(s.c);
+                },
+                [&] { write(index, read(next)); });
+            return;
+        }
+        if (u->kind == TY_CHAN) {
+            ValueId ch = expr(s.b);
+            const Type* elem = static_cast<const ChanType*>(u)->elem;
+            ValueId received = 0;
+            loop(labeled,
+                [&](BlockId body, BlockId exit) {
+                    received = emit(IR_RECV, typeTable.tuple({ elem, basicType(TY_BOOL) }), { ch }, 0, V_COMMA_OK);
+                    branch(emit(IR_EXTRACT, basicType(TY_BOOL), { received }, 1), body, exit);
+                },
+                [&] {
+                    bind(0, emit(IR_EXTRACT, elem, { received }, 0));
+                    stmt(s.c);
+                },
+                [] {});
+            return;
+        }
+        // a map, or a value of unknown type iterated the same way
+        const Type* key = invalidType();
+        const Type* value = invalidType();
+        if (u->kind == TY_MAP) {
+            key = static_cast<const MapType*>(u)->key;
+            value = static_cast<const MapType*>(u)->elem;
+        }
+        ValueId iterator = emit(IR_MAP_ITER, basicType(TY_UNSAFE_POINTER), { expr(s.b) });
+        ValueId entry = 0;
+        loop(labeled,
+            [&](BlockId body, BlockId exit) {
+                entry = emit(IR_MAP_NEXT, typeTable.tuple({ basicType(TY_BOOL), key, value }), { iterator });
+                branch(emit(IR_EXTRACT, basicType(TY_BOOL), { entry }, 0), body, exit);
+            },
+            [&] {
+                bind(0, emit(IR_EXTRACT, key, { entry }, 1));
+                if (lhs.size() > 1) bind(1, emit(IR_EXTRACT, value, { entry }, 2));
+                stmt(s.c);
+            },
+            [] {});
+    }
+    // Element i of the array or slice x, where u is the underlying type of the
+    // array or of the slice.
+    ValueId element(const Ref& x, ValueId i, const Type* u) {
+        const Type* elem = u->kind == TY_ARRAY ? static_cast<const ArrayType*>(u)->elem :
+            static_cast<const SliceType*>(u)->elem;
+        if (u->kind == TY_ARRAY && !x.pointer && underlying(x.type)->kind == TY_ARRAY) {
+            return emit(IR_INDEX, elem, { x.v, i });
+        }
+        return emit(IR_LOAD, elem, { emit(IR_INDEX_ADDR, typeTable.pointer(elem), { x.v, i }) });
+    }
+    void exprSwitch(const Node& s, Symbol labeled) {
+        if (s.a != 0) stmt(s.a);
+        ValueId tag = s.b != 0 ? expr(s.b) : 0;
+        auto clauses = list(s.c);
+        vector<BlockId> bodies;
+        for (size_t i = 0; i < clauses.size(); i++) bodies.push_back(newBlock());
+        BlockId done = newBlock(), otherwise = done;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            const Node& c = node(clauses[i]);
+            if (c.a == 0) otherwise = bodies[i];
+            for (uint32_t e : list(c.a)) {
+                BlockId next = newBlock();
+                if (tag != 0) {
+                    branch(compare(OP_EQ, tag, expr(e), basicType(TY_BOOL)), bodies[i], next);
+                }
+                else {
+                    condition(e, bodies[i], next);
+                }
+                seal(next);
+                start(next);
+            }
+        }
+        jump(otherwise);
+        clauseBodies(clauses, bodies, done, labeled, {});
+    }
+    void typeSwitch(const Node& s, Symbol labeled) {
+        if (s.a != 0) stmt(s.a);
+        const Node& guard = node(s.b);
+        uint32_t assertion = guard.kind == NK_ASSIGN_STMT ? list(guard.b)[0] : guard.a;
+        ValueId x = expr(node(assertion).a);
+        const Type* xt = typeOfValue(x);
+        auto clauses = list(s.c);
+        vector<BlockId> bodies;
+        for (size_t i = 0; i < clauses.size(); i++) bodies.push_back(newBlock());
+        // the value of the variable a clause of a single type binds
+        vector<ValueId> bound(clauses.size());
+        BlockId done = newBlock(), otherwise = done;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            const Node& c = node(clauses[i]);
+            if (c.a == 0) otherwise = bodies[i];
+            auto cases = list(c.a);
+            for (uint32_t e : cases) {
+                ValueId matches;
+                if (file->objects[e] != nullptr && file->objects[e]->kind == OB_NIL) {
+                    matches = emit(IR_EQ, basicType(TY_BOOL), { x, emit(IR_ZERO, xt) });
+                }
+                else {
+                    const Type* t = file->types[e] != nullptr ? file->types[e] : invalidType();
+                    ValueId asserted = emit(IR_TYPE_ASSERT, typeTable.tuple({ t, basicType(TY_BOOL) }), { x }, 0, V_COMMA_OK);
+                    if (cases.size() == 1) bound[i] = emit(IR_EXTRACT, t, { asserted }, 0);
+                    matches = emit(IR_EXTRACT, basicType(TY_BOOL), { asserted }, 1);
+                }
+                BlockId next = newBlock();
+                branch(matches, bodies[i], next);
+                seal(next);
+                start(next);
+            }
+        }
+        jump(otherwise);
+        clauseBodies(clauses, bodies, done, labeled, [&](size_t i) {
+            if (const Object* o = file->objects[clauses[i]]) declare(o, coerce(bound[i] != 0 ? bound[i] : x, o->type));
+        });
+    }
+    // The cases are evaluated in order, then one whose communication can
+    // proceed is chosen and its clause runs, binding what it received.
+    void selectStmt(const Node& s, Symbol labeled) {
+        auto clauses = list(s.a);
+        const Type* intType = basicType(TY_INT);
+        vector<ValueId> operands;
+        vector<const Type*> types{ intType, basicType(TY_BOOL) };
+        // by clause, the case and where its value is in the result
+        vector<int64_t> cases(clauses.size(), -1);
+        vector<size_t> received(clauses.size(), 0);
+        int64_t sends = 0, count = 0;
+        uint8_t flags = 0;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            const Node& c = node(clauses[i]);
+            if (c.a == 0) {
+                flags |= V_DEFAULT;
+                continue;
+            }
+            if (count == 63) error("select statements with more than 63 cases are not supported");
+            cases[i] = count++;
+            const Node& comm = node(c.a);
+            if (comm.kind == NK_SEND_STMT) {
+                ValueId ch = expr(comm.a);
+                ValueId v = expr(comm.b);
+                auto* type = underlyingAs<ChanType>(typeOfValue(ch), TY_CHAN);
+                operands.insert(operands.end(), { ch, type != nullptr ? coerce(v, type->elem) : v });
+                sends |= int64_t(1) << cases[i];
+                continue;
+            }
+            uint32_t receive = comm.kind == NK_EXPR_STMT ? comm.a : list(comm.b)[0];
+            ValueId ch = expr(node(receive).a);
+            auto* type = underlyingAs<ChanType>(typeOfValue(ch), TY_CHAN);
+            operands.push_back(ch);
+            received[i] = types.size();
+            types.push_back(type != nullptr ? type->elem : invalidType());
+        }
+        auto* tuple = typeTable.tuple(types);
+        ValueId chosen = emit(IR_CHOOSE, tuple, operands, sends, flags);
+        ValueId index = emit(IR_EXTRACT, intType, { chosen }, 0);
+        vector<BlockId> bodies;
+        for (size_t i = 0; i < clauses.size(); i++) bodies.push_back(newBlock());
+        BlockId done = newBlock(), otherwise = done;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            if (cases[i] < 0) {
+                otherwise = bodies[i];
+                continue;
+            }
+            BlockId next = newBlock();
+            branch(emit(IR_EQ, basicType(TY_BOOL), { index, constant(constantInt(cases[i]), intType) }), bodies[i], next);
+            seal(next);
+            start(next);
+        }
+        jump(otherwise);
+        clauseBodies(clauses, bodies, done, labeled, [&](size_t i) {
+            const Node& c = node(clauses[i]);
+            if (c.a == 0 || node(c.a).kind != NK_ASSIGN_STMT) return;
+            const Node& comm = node(c.a);
+            auto lhs = list(comm.a);
+            ValueId values[] = { emit(IR_EXTRACT, types[received[i]], { chosen }, int64_t(received[i])),
+                emit(IR_EXTRACT, basicType(TY_BOOL), { chosen }, 1) };
+            for (size_t k = 0; k < lhs.size() && k < 2; k++) {
+                if (comm.op() == OP_SHORTAGN) {
+                    const Object* o = file->objects[lhs[k]];
+                    if (o == nullptr) continue;
+                    if (o->node == lhs[k]) {
+                        declare(o, coerce(values[k], o->type));
+                    }
+                    else {
+                        storeLocal(o, coerce(values[k], o->type));
+                    }
+                }
+                else {
+                    store(lvalue(lhs[k]), values[k]);
+                }
+            }
+        });
+    }
+    // Lowers the bodies of the clauses of a switch, clause i into bodies[i],
+    // each starting with what enter(i) does.
+    void clauseBodies(Tree::List clauses, const vector<BlockId>& bodies, BlockId done, Symbol labeled,
+        const function<void(size_t)>& enter) {
+        targets.push_back({ labeled, done, noBlock });
+        BlockId outerFallthrough = fallthroughTo;
+        for (size_t i = 0; i < clauses.size(); i++) {
+            seal(bodies[i]);
+            start(bodies[i]);
+            if (enter) enter(i);
+            fallthroughTo = i + 1 < clauses.size() ? bodies[i + 1] : noBlock;
+            stmtList(node(clauses[i]).b);
+            jump(done);
+        }
+        fallthroughTo = outerFallthrough;
+        targets.pop_back();
+        seal(done);
+        start(done);
+    }
+};
+
+// The package level variables of info in the order they are initialized: a
+// variable after those its initializer refers to, directly or through the
+// functions it calls, and otherwise in the order of declaration. Each comes as
+// the spec declaring it.
+vector<pair<FileInfo*, uint32_t>> initOrder(PackageInfo& info) {
+    vector<pair<FileInfo*, uint32_t>> specs;
+    unordered_map<const Object*, size_t> specOf;
+    for (Object* o : info.objects) {
+        if (o->kind != OB_VAR) continue;
+        if (specs.empty() || specs.back() != make_pair(o->file, o->node)) specs.push_back({ o->file, o->node });
+        specOf[o] = specs.size() - 1;
+    }
+    vector<pair<FileInfo*, uint32_t>> order;
+    vector<uint8_t> state(specs.size());
+    function<void(size_t)> visit = [&](size_t i) {
+        if (state[i] != 0) return;
+        state[i] = 1;
+        unordered_set<const Object*> seen;
+        function<void(const FileInfo&, uint32_t)> refer = [&](const FileInfo& file, uint32_t n) {
+            const Node& e = file.tree->nodes[n];
+            if (e.kind == NK_NAME && file.objects[n] != nullptr && seen.insert(file.objects[n]).second) {
+                const Object* o = file.objects[n];
+                if (auto spec = specOf.find(o); spec != specOf.end()) visit(spec->second);
+                if (o->kind == OB_FUNC && o->file != nullptr && o->file->tree->nodes[o->node].d != 0) {
+                    refer(*o->file, o->file->tree->nodes[o->node].d);
+                }
+            }
+            file.tree->forEachChild(n, [&](uint32_t child) { refer(file, child); });
+        };
+        auto [file, spec] = specs[i];
+        if (uint32_t values = file->tree->nodes[spec].c) {
+            for (uint32_t v : file->tree->list(values)) refer(*file, v);
+        }
+        state[i] = 2;
+        order.push_back(specs[i]);
+    };
+    for (size_t i = 0; i < specs.size(); i++) visit(i);
+    return order;
+}
+
+// Lowers every function of the checked packages into module, the bodies in
+// parallel on pool. Functions get the names their symbols will have: pkg.f,
+// pkg.T.m, pkg.(*T).m, pkg.init.N for the init functions and pkg.init for the
+// initializer of the package, and pkg.f.funcN for the closures of f.
+void lower(deque<PackageInfo>& infos, Module& module, ThreadPool& pool) {
+    static const Symbol blank = symbols.intern("_"), init = symbols.intern("init"), main = symbols.intern("main");
+    struct Job {
+        Function* fn;
+        PackageInfo* info;
+        FileInfo* file;
+        // the function declaration, none for the initializer of the package
+        uint32_t decl;
+        vector<uint32_t> inits;
+        vector<string> errors;
+    };
+    deque<Job> jobs;
+    for (auto& info : infos) {
+        string package(symbols.text(info.package.name));
+        for (Object* o : info.objects) {
+            if (o->kind != OB_VAR || o->name == blank) continue;
+            module.globalIndex[o] = uint32_t(module.globals.size());
+            module.globals.push_back({ package + "." + string(symbols.text(o->name)), o->type });
+        }
+        vector<uint32_t> inits;
+        for (auto& file : info.files) {
+            const Tree& tree = *file.tree;
+            for (uint32_t decl : tree.list(tree[tree.root].c)) {
+                const Node& d = tree[decl];
+                const Object* o = file.objects[decl];
+                if (d.kind != NK_FUNC_DECL || o == nullptr || o->type == nullptr || o->type->kind != TY_FUNC) continue;
+                uint32_t index = uint32_t(module.functions.size());
+                Function& fn = module.functions.emplace_back();
+                string name(symbols.text(d.a));
+                if (o->receiver != nullptr) {
+                    name = (o->receiver->kind == TY_POINTER ? "(" + typeString(o->receiver) + ")" :
+                        typeString(o->receiver)) + "." + name;
+                }
+                else if (d.a == init) {
+                    name += "." + to_string(inits.size());
+                    inits.push_back(index);
+                }
+                else if (d.a == main && info.package.name == main) {
+                    module.entry = index;
+                }
+                fn.name = package + "." + name;
+                fn.type = static_cast<const FuncType*>(o->type);
+                fn.receiver = o->receiver;
+                module.functionIndex[o] = index;
+                if (d.d != 0) jobs.push_back({ &fn, &info, &file, decl, {}, {} });
+            }
+        }
+        module.inits.push_back(uint32_t(module.functions.size()));
+        Function& initializer = module.functions.emplace_back();
+        initializer.name = package + ".init";
+        initializer.type = typeTable.func(typeTable.tuple({}), typeTable.tuple({}), false);
+        if (!info.files.empty()) jobs.push_back({ &initializer, &info, &info.files.front(), 0, move(inits), {} });
+    }
+    for (auto& job : jobs) {
+        pool.submit([&job, &module] {
+            try {
+                unordered_set<const Object*> escaping;
+                if (job.decl == 0) {
+                    auto specs = initOrder(*job.info);
+                    for (auto [file, spec] : specs) findEscaping(*file, spec, 0, 0, escaping);
+                    Lowerer(module, *job.fn, job.file, escaping, job.fn->closures).initializer(specs, job.inits);
+                    return;
+                }
+                const Node& d = job.file->tree->nodes[job.decl];
+                findEscaping(*job.file, job.decl, 0, 0, escaping);
+                Lowerer(module, *job.fn, job.file, escaping, job.fn->closures).lowerFunction(d.c, d.b, d.d, {});
+            }
+            catch (const runtime_error& e) {
+                job.errors.push_back(job.file->filename + ": " + job.fn->name + ": " + e.what());
+            }
+        });
+    }
+    pool.wait();
+    for (auto& job : jobs) module.errors.insert(module.errors.end(), job.errors.begin(), job.errors.end());
+    // closures follow all declared functions, those of each function together
+    size_t declared = module.functions.size();
+    for (size_t i = 0; i < declared; i++) {
+        Function& fn = module.functions[i];
+        int64_t base = int64_t(module.functions.size());
+        auto relocate = [base](Function& f) {
+            for (auto& v : f.values) {
+                if (v.op == IR_MAKE_CLOSURE) v.aux += base;
+            }
+        };
+        relocate(fn);
+        for (auto& closure : fn.closures) {
+            relocate(*closure);
+            module.functions.push_back(move(*closure));
+        }
+        fn.closures.clear();
+    }
+}
+
+// The immediate dominator of every block of f, the entry being its own, after
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm". Blocks the
+// entry does not reach get noBlock.
+vector<BlockId> dominators(const Function& f) {
+    size_t n = f.blocks.size();
+    vector<BlockId> order, number(n, noBlock), idom(n, noBlock);
+    if (n == 0) return idom;
+    // reverse postorder, walked with an explicit stack of blocks and the next
+    // successor of each
+    vector<pair<BlockId, size_t>> stack{ { 0, 0 } };
+    vector<bool> visited(n);
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        if (next < f.blocks[b].succs.size()) {
+            BlockId s = f.blocks[b].succs[next++];
+            if (!visited[s]) {
+                visited[s] = true;
+                stack.push_back({ s, 0 });
+            }
+            continue;
+        }
+        order.push_back(b);
+        stack.pop_back();
+    }
+    reverse(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); i++) number[order[i]] = BlockId(i);
+    idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); i++) {
+            BlockId b = order[i], dom = noBlock;
+            for (BlockId p : f.blocks[b].preds) {
+                if (idom[p] == noBlock) continue;
+                if (dom == noBlock) {
+                    dom = p;
+                    continue;
+                }
+                BlockId x = p, y = dom;
+                while (x != y) {
+                    while (number[x] > number[y]) x = idom[x];
+                    while (number[y] > number[x]) y = idom[y];
+                }
+                dom = x;
+            }
+            if (idom[b] != dom) {
+                idom[b] = dom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+// Checks what every pass relies on: blocks end in exactly one terminator with
+// as many successors as it needs, edges are recorded at both ends, phis come
+// first with an operand for each predecessor, and every operand is defined
+// once, in a block dominating its use or, for a phi, the predecessor it comes
+// from. Throws on the first violation.
+void verify(const Function& f) {
+    auto fail = [&](const string& message) { throw runtime_error(f.name + ": invalid SSA: " + message); };
+    if (f.blocks.empty()) return;
+    vector<BlockId> idom = dominators(f);
+    auto dominates = [&](BlockId a, BlockId b) {
+        while (b != a && idom[b] != b) b = idom[b];
+        return b == a;
+    };
+    vector<uint32_t> position(f.values.size(), UINT32_MAX);
+    for (BlockId b = 0; b < f.blocks.size(); b++) {
+        const Block& block = f.blocks[b];
+        string where = "b" + to_string(b) + ": ";
+        if (idom[b] == noBlock) fail(where + "unreachable");
+        if (block.values.empty() || !isTerminator(f.values[block.values.back()].op)) fail(where + "no terminator");
+        bool phis = true;
+        for (uint32_t i = 0; i < block.values.size(); i++) {
+            ValueId v = block.values[i];
+            const Value& value = f.values[v];
+            if (v == 0 || v >= f.values.size() || position[v] != UINT32_MAX) fail(where + "value listed twice");
+            if (value.block != b) fail(where + "v" + to_string(v) + " is of another block");
+            if (isTerminator(value.op) && i + 1 != block.values.size()) fail(where + "terminator in the middle");
+            if (value.op == IR_PHI && !phis) fail(where + "phi after other values");
+            if (value.op == IR_PHI && value.argCount != block.preds.size()) fail(where + "phi operands do not match");
+            phis = phis && value.op == IR_PHI;
+            position[v] = i;
+        }
+        Op op = f.values[block.values.back()].op;
+        size_t succs = op == IR_JUMP ? 1 : op == IR_BRANCH ? 2 : 0;
+        if (block.succs.size() != succs) fail(where + "wrong number of successors");
+        for (BlockId s : block.succs) {
+            auto& preds = f.blocks[s].preds;
+            if (count(preds.begin(), preds.end(), b) != count(block.succs.begin(), block.succs.end(), s)) {
+                fail(where + "edge to b" + to_string(s) + " not recorded");
+            }
+        }
+        for (BlockId p : block.preds) {
+            auto& succs = f.blocks[p].succs;
+            if (find(succs.begin(), succs.end(), b) == succs.end()) fail(where + "edge from b" + to_string(p) + " not recorded");
+        }
+    }
+    for (ValueId v = 1; v < f.values.size(); v++) {
+        const Value& value = f.values[v];
+        if (position[v] == UINT32_MAX) fail("v" + to_string(v) + " is in no block");
+        auto args = f.args(v);
+        for (size_t i = 0; i < args.size(); i++) {
+            ValueId a = args[i];
+            if (a == 0 || a >= f.values.size()) fail("v" + to_string(v) + " has an undefined operand");
+            BlockId def = f.values[a].block, use = value.block;
+            bool ok = value.op == IR_PHI ? dominates(def, f.blocks[use].preds[i]) :
+                def == use ? position[a] < position[v] : dominates(def, use);
+            if (!ok) fail("v" + to_string(a) + " does not dominate its use by v" + to_string(v));
+        }
+    }
+}
+
+struct Layout {
+    int64_t size, align;
+};
+Layout layoutOf(const Type* t);
+
+// Finds the allocations whose address never outlives the call and moves them
+// off the heap into the frame. An address escapes when it is stored, returned,
+// put in an interface, a closure, a map or a channel, appended as an element,
+// passed to a go or deferred call, to a function without body or a function
+// value, or to a parameter that leaks; the addresses and slices derived from
+// it escape with it. A phi may merge it with the address of an earlier run of
+// its allocation when that is in a loop, which shares one slot of the frame,
+// so it escapes there too. Parameters leak by the same rules, found for the
+// whole module at once: none leaks until shown to.
+struct EscapeAnalysis {
+    // larger variables stay on the heap, which keeps frames small
+    static constexpr int64_t maxFrameBytes = 64 * 1024;
+
+    Module& module;
+    // by function and parameter
+    vector<vector<bool>> leaks;
+    // of the function at hand: the values using each value, the blocks on a
+    // cycle, and the values an escape check has reached
+    vector<vector<ValueId>> users;
+    vector<int8_t> cyclic;
+    vector<uint32_t> seen;
+    uint32_t stamp = 0;
+
+    explicit EscapeAnalysis(Module& module) : module(module), leaks(module.functions.size()) {}
+
+    // Whether a value of type t may be an address derived from an allocation;
+    // parameters of other types never leak one.
+    static bool holdsAddress(const Type* t) {
+        TypeKind k = underlying(t)->kind;
+        return k == TY_POINTER || k == TY_SLICE || k == TY_UNSAFE_POINTER || k == TY_UINTPTR;
+    }
+    void prepare(const Function& f) {
+        users.assign(f.values.size(), {});
+        seen.assign(f.values.size(), 0);
+        stamp = 0;
+        cyclic.assign(f.blocks.size(), -1);
+        for (auto& block : f.blocks) {
+            for (ValueId v : block.values) {
+                for (ValueId a : f.args(v)) users[a].push_back(v);
+            }
+        }
+    }
+    // Whether block b can be reached again once left.
+    bool onCycle(const Function& f, BlockId b) {
+        if (cyclic[b] >= 0) return cyclic[b];
+        vector<bool> reached(f.blocks.size());
+        vector<BlockId> work(f.blocks[b].succs.begin(), f.blocks[b].succs.end());
+        while (!work.empty() && !reached[b]) {
+            BlockId s = work.back();
+            work.pop_back();
+            if (reached[s]) continue;
+            reached[s] = true;
+            work.insert(work.end(), f.blocks[s].succs.begin(), f.blocks[s].succs.end());
+        }
+        cyclic[b] = reached[b];
+        return reached[b];
+    }
+    // Why the address v of f may outlive the call, empty when it does not, and
+    // the use it escapes by. A phi merges runs of v when loop.
+    string escapes(const Function& f, ValueId v, bool loop, ValueId& by) {
+        stamp++;
+        seen[v] = stamp;
+        vector<ValueId> work{ v };
+        while (!work.empty()) {
+            ValueId a = work.back();
+            work.pop_back();
+            for (ValueId u : users[a]) {
+                const Value& x = f.values[u];
+                auto args = f.args(u);
+                string reason;
+                bool derived = false;
+                switch (x.op) {
+                case IR_LOAD: case IR_LEN: case IR_CAP: case IR_COPY: case IR_EQ: case IR_NE: case IR_PRINT:
+                case IR_MAP_INDEX: case IR_MAP_DELETE:
+                    break;
+                case IR_STORE:
+                    if (args[1] == a) reason = "stored";
+                    break;
+                case IR_FIELD_ADDR: case IR_INDEX_ADDR: case IR_FIELD: case IR_INDEX: case IR_EXTRACT:
+                case IR_SLICE: case IR_CONVERT:
+                    derived = true;
+                    break;
+                case IR_APPEND:
+                    // the elements of a spread operand are copied
+                    for (size_t i = 1; i < args.size(); i++) {
+                        if (args[i] == a && !(i + 1 == args.size() && (x.flags & V_SPREAD))) reason = "appended";
+                    }
+                    derived = args[0] == a;
+                    break;
+                case IR_PHI:
+                    if (loop) reason = "merged with an earlier iteration";
+                    derived = true;
+                    break;
+                case IR_CALL: {
+                    const Function& callee = module.functions[x.aux];
+                    if (x.flags & (V_GO | V_DEFER)) {
+                        reason = x.flags & V_GO ? "passed to a go statement" : "passed to a deferred call";
+                        break;
+                    }
+                    auto& params = leaks[x.aux];
+                    for (size_t i = 0; i < args.size() && reason.empty(); i++) {
+                        if (args[i] != a) continue;
+                        if (callee.blocks.empty()) reason = "passed to " + callee.name + ", which has no body";
+                        else if (i < params.size() && params[i]) reason = "leaks from parameter " + to_string(i) + " of " + callee.name;
+                    }
+                    break;
+                }
+                case IR_RETURN: reason = "returned"; break;
+                case IR_MAKE_INTERFACE: reason = "converted to an interface"; break;
+                case IR_MAKE_CLOSURE: reason = "captured by a closure"; break;
+                case IR_SEND: case IR_CHOOSE: reason = "sent on a channel"; break;
+                case IR_MAP_UPDATE: reason = "stored in a map"; break;
+                default: reason = string("used by ") + opNames[x.op]; break;
+                }
+                if (!reason.empty()) {
+                    by = u;
+                    return reason;
+                }
+                if (derived && seen[u] != stamp) {
+                    seen[u] = stamp;
+                    work.push_back(u);
+                }
+            }
+        }
+        return "";
+    }
+
+    // Runs the analysis, returning how many allocations it moved off the heap.
+    // notes gets a line for every leaking parameter and every allocation on
+    // the heap before, then the count, when not null.
+    size_t run(vector<string>* notes) {
+        for (uint32_t i = 0; i < module.functions.size(); i++) {
+            const Function& f = module.functions[i];
+            for (ValueId v = 1; v < f.values.size(); v++) {
+                if (f.values[v].op == IR_PARAM) leaks[i].resize(max(leaks[i].size(), size_t(f.values[v].aux) + 1));
+            }
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (uint32_t i = 0; i < module.functions.size(); i++) {
+                const Function& f = module.functions[i];
+                if (f.blocks.empty()) continue;
+                prepare(f);
+                for (auto& block : f.blocks) {
+                    for (ValueId v : block.values) {
+                        const Value& x = f.values[v];
+                        ValueId by;
+                        if (x.op != IR_PARAM || leaks[i][x.aux] || !holdsAddress(x.type) || escapes(f, v, false, by).empty()) continue;
+                        leaks[i][x.aux] = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        size_t moved = 0, allocations = 0;
+        for (uint32_t i = 0; i < module.functions.size(); i++) {
+            Function& f = module.functions[i];
+            if (f.blocks.empty()) continue;
+            prepare(f);
+            for (auto& block : f.blocks) {
+                for (ValueId v : block.values) {
+                    Value& x = f.values[v];
+                    if (x.op != IR_PARAM && x.op != IR_ALLOC) continue;
+                    // as go build -gcflags=-m puts it, the position of the value
+                    // first and that of the use it escapes by after the reason
+                    string name = f.name + ": v" + to_string(v) + " = " + opNames[x.op] + " <" + typeString(x.type) + ">";
+                    if (string at = f.where(v); !at.empty()) name = at + ": " + name;
+                    auto use = [&](ValueId by) {
+                        string at = f.where(by);
+                        return (at.empty() ? "" : " at " + at) + " (v" + to_string(by) + ")";
+                    };
+                    if (x.op == IR_PARAM && leaks[i][x.aux]) {
+                        ValueId by;
+                        string reason = escapes(f, v, false, by);
+                        if (notes != nullptr) notes->push_back(name + " leaks: " + reason + use(by));
+                    }
+                    if (x.op != IR_ALLOC || !(x.flags & V_HEAP)) continue;
+                    allocations++;
+                    string reason;
+                    ValueId by = 0;
+                    if (layoutOf(static_cast<const PointerType*>(underlying(x.type))->base).size > maxFrameBytes) {
+                        reason = "too large for the frame";
+                    }
+                    else {
+                        reason = escapes(f, v, onCycle(f, x.block), by);
+                    }
+                    if (reason.empty()) {
+                        x.flags &= ~V_HEAP;
+                        moved++;
+                    }
+                    if (notes == nullptr) continue;
+                    notes->push_back(name + (reason.empty() ? " does not escape" :
+                        " escapes to the heap: " + reason + (by != 0 ? use(by) : "")));
+                }
+            }
+        }
+        if (notes != nullptr) notes->push_back(to_string(moved) + " of " + to_string(allocations) + " heap allocations moved to the frame");
+        return moved;
+    }
+};
+
+// Moves the allocations of module that do not escape off the heap, returning
+// how many it moved, and explaining every decision in notes when not null.
+size_t escape(Module& module, vector<string>* notes = nullptr) {
+    return EscapeAnalysis(module).run(notes);
+}
+
+// The text of a string constant as Go would quote it.
+string quoted(const string& s) {
+    string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        }
+        else if (c == '\n') {
+            out += "\\n";
+        }
+        else if (c == '\t') {
+            out += "\\t";
+        }
+        else if (c < 0x20 || c == 0x7f) {
+            char escaped[5];
+            snprintf(escaped, sizeof escaped, "\\x%02x", c);
+            out += escaped;
+        }
+        else {
+            out += char(c);
+        }
+    }
+    return out + "\"";
+}
+
+// f as text, one line per block and value:
+//   main.fib func(int) int
+//   b0:
+//       v1 = Param <int> 0
+//       v2 = Const <int> 2
+//       v3 = Lt <bool> v1 v2
+//       Branch v3 -> b1 b2
+// Values that only have an effect have no name. A block lists its
+// predecessors after its label.
+string functionString(const Module& module, const Function& f) {
+    string out = f.name + " " + (f.type != nullptr ? typeString(f.type) : "") + "\n";
+    auto structOf = [](const Type* t) {
+        if (auto* p = underlyingAs<PointerType>(t, TY_POINTER)) t = p->base;
+        return underlyingAs<StructType>(t, TY_STRUCT);
+    };
+    for (BlockId b = 0; b < f.blocks.size(); b++) {
+        const Block& block = f.blocks[b];
+        out += "b" + to_string(b) + ":";
+        if (!block.preds.empty()) {
+            out += " <-";
+            for (BlockId p : block.preds) out += " b" + to_string(p);
+        }
+        out += "\n";
+        for (ValueId v : block.values) {
+            const Value& value = f.values[v];
+            out += "    ";
+            if (value.type != nullptr) out += "v" + to_string(v) + " = ";
+            out += opNames[value.op];
+            if (value.type != nullptr) out += " <" + typeString(value.type) + ">";
+            for (ValueId a : f.args(v)) out += " v" + to_string(a);
+            string aux;
+            switch (value.op) {
+            case IR_CONST: {
+                TypeKind k = underlying(value.type)->kind;
+                if (isBoolean(k)) {
+                    aux = value.aux ? "true" : "false";
+                }
+                else if (isFloat(k)) {
+                    double d;
+                    memcpy(&d, &value.aux, sizeof d);
+                    char text[32];
+                    snprintf(text, sizeof text, "%g", d);
+                    aux = text;
+                }
+                else {
+                    aux = isUnsigned(k) ? to_string(uint64_t(value.aux)) : to_string(value.aux);
+                }
+                break;
+            }
+            case IR_STRING: aux = quoted(f.strings[value.aux]); break;
+            case IR_PARAM: case IR_FREE_VAR: case IR_EXTRACT: aux = to_string(value.aux); break;
+            case IR_FIELD: case IR_FIELD_ADDR:
+                if (auto* s = structOf(f.values[f.args(v)[0]].type)) {
+                    Symbol name = s->fields[value.aux].name;
+                    aux = name != 0 ? string(symbols.text(name)) : to_string(value.aux);
+                }
+                break;
+            case IR_GLOBAL: aux = module.globals[value.aux].name; break;
+            case IR_FUNC: case IR_CALL: case IR_MAKE_CLOSURE:
+                aux = size_t(value.aux) < module.functions.size() ? module.functions[value.aux].name : to_string(value.aux);
+                break;
+            case IR_EXTERN: case IR_CALL_EXTERN: case IR_SELECT: aux = string(symbols.text(Symbol(value.aux))); break;
+            case IR_CALL_METHOD:
+                if (auto* i = underlyingAs<InterfaceType>(f.values[f.args(v)[0]].type, TY_INTERFACE)) {
+                    aux = string(symbols.text(i->methods[value.aux].name));
+                }
+                break;
+            case IR_PRINT:
+                if (value.aux) aux = "newline";
+                break;
+            case IR_SLICE: aux = to_string(value.aux); break;
+            case IR_CHOOSE:
+                for (size_t i = 0, c = 0; i < f.args(v).size(); i++, c++) {
+                    aux += (value.aux >> c & 1) ? "s" : "r";
+                    if (value.aux >> c & 1) i++;
+                }
+                break;
+            default: break;
+            }
+            if (!aux.empty()) out += " " + aux;
+            static const pair<uint8_t, const char*> flags[] = { { V_HEAP, "heap" }, { V_COMMA_OK, "commaok" },
+                { V_GO, "go" }, { V_DEFER, "defer" }, { V_SPREAD, "spread" }, { V_DEFAULT, "default" } };
+            for (auto [flag, name] : flags) {
+                if (value.flags & flag) out += string(" ") + name;
+            }
+            if (!block.succs.empty() && v == block.values.back()) {
+                out += " ->";
+                for (BlockId s : block.succs) out += " b" + to_string(s);
+            }
+            out += "\n";
+        }
+    }
+    return out;
+}
+
+//===----------------------------------------------------------------------===//
+// x86-64 code generation
+//===----------------------------------------------------------------------===//
+// The functions main.main and the package initializers reach are compiled to
+// GNU assembler text for x86-64, which cc assembles and links with the C
+// runtime below. Calls follow Go's ABI0: the arguments and then the results
+// are passed on the stack, each at a multiple of 8 bytes and the receiver
+// first, and a closure gets its context in rax. A callee saves rbx, rbp and
+// r12-r15, while rax, rcx, rdx and r11 are the scratch registers of the code
+// generator, which no value is ever allocated to.
+// Booleans, numbers and pointers live in registers picked by linear scan, as
+// in Poletto and Sarkar, "Linear Scan Register Allocation": the interval of a
+// value is the hull of the positions it is live at, one live across a call
+// only gets a callee saved register, and when none is left the interval that
+// ends last is spilled to the frame as a whole. Strings, slices, interfaces,
+// structs, arrays and tuples always live in memory, each value in a slot of
+// its own. Without optimization every value gets a slot and is loaded and
+// stored around each operation, the baseline the native benchmarks measure.
+
+enum Register : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+constexpr const char* registerNames[4][16] = {
+    { "%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil",
+        "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b" },
+    { "%ax", "%cx", "%dx", "%bx", "%sp", "%bp", "%si", "%di",
+        "%r8w", "%r9w", "%r10w", "%r11w", "%r12w", "%r13w", "%r14w", "%r15w" },
+    { "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+        "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d" },
+    { "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+        "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15" } };
+constexpr Register calleeSaved[] = { RBX, R12, R13, R14, R15 };
+constexpr Register callerSaved[] = { RSI, RDI, R8, R9, R10 };
+constexpr Register argumentRegisters[] = { RDI, RSI, RDX, RCX, R8, R9 };
+
+// The name of register r as an operand of size bytes.
+string reg(int r, int64_t size = 8) {
+    return registerNames[size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3][r];
+}
+inline int64_t align8(int64_t n) { return (n + 7) & ~int64_t(7); }
+
+// The size and alignment of values of type t in memory, those of amd64.
+Layout layoutOf(const Type* t) {
+    const Type* u = underlying(concreteType(t));
+    switch (u->kind) {
+    case TY_BOOL: case TY_INT8: case TY_UINT8: return { 1, 1 };
+    case TY_INT16: case TY_UINT16: return { 2, 2 };
+    case TY_INT32: case TY_UINT32: case TY_FLOAT32: return { 4, 4 };
+    case TY_COMPLEX64: return { 8, 4 };
+    case TY_COMPLEX128: case TY_STRING: case TY_INTERFACE: return { 16, 8 };
+    case TY_SLICE: return { 24, 8 };
+    case TY_ARRAY: {
+        auto* a = static_cast<const ArrayType*>(u);
+        Layout elem = layoutOf(a->elem);
+        return { elem.size * max<int64_t>(a->length, 0), elem.align };
+    }
+    case TY_STRUCT: {
+        int64_t size = 0, align = 1;
+        for (auto& field : static_cast<const StructType*>(u)->fields) {
+            Layout l = layoutOf(field.type);
+            size = (size + l.align - 1) / l.align * l.align + l.size;
+            align = max(align, l.align);
+        }
+        return { (size + align - 1) / align * align, align };
+    }
+    case TY_TUPLE: {
+        // the elements of a tuple sit like results do, each at a multiple of 8
+        int64_t size = 0;
+        for (const Type* e : static_cast<const TupleType*>(u)->types) size += align8(layoutOf(e).size);
+        return { size, 8 };
+    }
+    default:
+        return { 8, 8 };
+    }
+}
+int64_t fieldOffset(const StructType* s, size_t index) {
+    int64_t offset = 0;
+    for (size_t i = 0; i <= index; i++) {
+        Layout l = layoutOf(s->fields[i].type);
+        offset = (offset + l.align - 1) / l.align * l.align;
+        if (i < index) offset += l.size;
+    }
+    return offset;
+}
+int64_t tupleOffset(const TupleType* t, size_t index) {
+    int64_t offset = 0;
+    for (size_t i = 0; i < index; i++) offset += align8(layoutOf(t->types[i]).size);
+    return offset;
+}
+inline TypeKind kindOf(const Type* t) { return underlying(concreteType(t))->kind; }
+// Values of these types are kept in memory and handled by address.
+bool isAggregate(const Type* t) {
+    switch (kindOf(t)) {
+    case TY_STRING: case TY_SLICE: case TY_INTERFACE: case TY_STRUCT: case TY_ARRAY: case TY_TUPLE:
+    case TY_COMPLEX64: case TY_COMPLEX128:
+        return true;
+    default:
+        return false;
+    }
+}
+// An interface holds a value of these types itself rather than a pointer to it.
+bool isPointerShaped(const Type* t) {
+    TypeKind k = kindOf(t);
+    return k == TY_POINTER || k == TY_UNSAFE_POINTER || k == TY_MAP || k == TY_CHAN || k == TY_FUNC;
+}
+// Whether method m is one fmt formats values with, Error or String taking
+// nothing and returning a string. Error goes first when a type has both.
+bool isFormatMethod(const Object* m) {
+    auto* f = static_cast<const FuncType*>(m->type);
+    string_view name = symbols.text(m->name);
+    return (name == "Error" || name == "String") && f->params->types.empty() && f->results->types.size() == 1 &&
+        identical(f->results->types[0], basicType(TY_STRING));
+}
+
+// Where the arguments and the results of a call sit, off the start of the
+// argument area.
+struct Signature {
+    vector<int64_t> params, results;
+    int64_t argsSize = 0, size = 0;
+    Signature(const Type* receiver, const FuncType* type) {
+        auto add = [this](vector<int64_t>& offsets, const Type* t) {
+            offsets.push_back(size);
+            size += align8(layoutOf(t).size);
+        };
+        if (receiver != nullptr) add(params, receiver);
+        for (const Type* t : type->params->types) add(params, t);
+        argsSize = size;
+        for (const Type* t : type->results->types) add(results, t);
+    }
+};
+
+// A memory operand, an offset off a base register or off a symbol.
+struct Mem {
+    int base;
+    int64_t offset;
+    string symbol;
+    Mem(int base = RBP, int64_t offset = 0, string symbol = "") : base(base), offset(offset), symbol(move(symbol)) {}
+    Mem plus(int64_t n) const {
+        Mem m = *this;
+        m.offset += n;
+        return m;
+    }
+    string str() const {
+        string displacement = offset != 0 ? to_string(offset) : "";
+        if (!symbol.empty()) return symbol + (offset != 0 ? "+" + displacement : "") + "(%rip)";
+        return displacement + "(" + reg(base) + ")";
+    }
+};
+
+// The symbol of the Go entity name, bytes other than letters, digits, '_' and
+// '.' escaped in hex.
+string symbolName(const string& name) {
+    string s = "go.";
+    for (unsigned char c : name) {
+        if (isalnum(c) || c == '_' || c == '.') {
+            s += char(c);
+            continue;
+        }
+        char hex[4];
+        snprintf(hex, sizeof hex, "_%02x", c);
+        s += hex;
+    }
+    return s;
+}
+
+struct AsmWriter {
+    string out;
+
+    void ins(const string& s) {
+        out += '\t';
+        out += s;
+        out += '\n';
+    }
+    void label(const string& l) { out += l + ":\n"; }
+    static const char* suffix(int64_t size) { return size == 1 ? "b" : size == 2 ? "w" : size == 4 ? "l" : "q"; }
+    // Copies size bytes through rax, a large block in a loop that uses rcx,
+    // rdx and r11 as well. src must not be based on rdx, nor dst on rcx.
+    void copy(const Mem& dst, const Mem& src, int64_t size) {
+        if (size > 128) {
+            ins("lea " + src.str() + ", %rcx");
+            ins("lea " + dst.str() + ", %rdx");
+            ins("mov $" + to_string(size / 8) + ", %r11");
+            label("9");
+            ins("mov (%rcx), %rax");
+            ins("mov %rax, (%rdx)");
+            ins("add $8, %rcx");
+            ins("add $8, %rdx");
+            ins("dec %r11");
+            ins("jnz 9b");
+            copy(Mem{ RDX }, Mem{ RCX }, size % 8);
+            return;
+        }
+        for (int64_t offset = 0; offset < size;) {
+            int64_t chunk = size - offset >= 8 ? 8 : size - offset >= 4 ? 4 : size - offset >= 2 ? 2 : 1;
+            ins(string("mov") + suffix(chunk) + " " + src.plus(offset).str() + ", " + reg(RAX, chunk));
+            ins(string("mov") + suffix(chunk) + " " + reg(RAX, chunk) + ", " + dst.plus(offset).str());
+            offset += chunk;
+        }
+    }
+    // Zeroes size bytes, a large block in a loop using rax, rdx and r11.
+    void zero(const Mem& dst, int64_t size) {
+        if (size > 128) {
+            ins("lea " + dst.str() + ", %rdx");
+            ins("xor %eax, %eax");
+            ins("mov $" + to_string(size / 8) + ", %r11");
+            label("9");
+            ins("mov %rax, (%rdx)");
+            ins("add $8, %rdx");
+            ins("dec %r11");
+            ins("jnz 9b");
+            zero(Mem{ RDX }, size % 8);
+            return;
+        }
+        for (int64_t offset = 0; offset < size;) {
+            int64_t chunk = size - offset >= 8 ? 8 : size - offset >= 4 ? 4 : size - offset >= 2 ? 2 : 1;
+            ins(string("mov") + suffix(chunk) + " $0, " + dst.plus(offset).str());
+            offset += chunk;
+        }
+    }
+    // Loads a value of type t from memory into register r, widened to 64 bits
+    // as its signedness says.
+    void loadFrom(const Type* t, const string& mem, int r) {
+        TypeKind k = kindOf(t);
+        bool sign = isInteger(k) && !isUnsigned(k);
+        switch (layoutOf(t).size) {
+        case 1: ins((sign ? "movsbq " : "movzbl ") + mem + ", " + reg(r, sign ? 8 : 4)); break;
+        case 2: ins((sign ? "movswq " : "movzwl ") + mem + ", " + reg(r, sign ? 8 : 4)); break;
+        case 4: ins((sign ? "movslq " : "movl ") + mem + ", " + reg(r, sign ? 8 : 4)); break;
+        default: ins("mov " + mem + ", " + reg(r)); break;
+        }
+    }
+    void storeTo(const Type* t, int r, const string& mem) {
+        int64_t size = layoutOf(t).size;
+        ins(string("mov") + suffix(size) + " " + reg(r, size) + ", " + mem);
+    }
+    // Brings the 64 bits of register r back to a value of the integer type t,
+    // sign or zero extended.
+    void normalize(const Type* t, int r) {
+        switch (kindOf(t)) {
+        case TY_INT8: ins("movsbq " + reg(r, 1) + ", " + reg(r)); break;
+        case TY_UINT8: ins("movzbl " + reg(r, 1) + ", " + reg(r, 4)); break;
+        case TY_INT16: ins("movswq " + reg(r, 2) + ", " + reg(r)); break;
+        case TY_UINT16: ins("movzwl " + reg(r, 2) + ", " + reg(r, 4)); break;
+        case TY_INT32: ins("movslq " + reg(r, 4) + ", " + reg(r)); break;
+        case TY_UINT32: ins("movl " + reg(r, 4) + ", " + reg(r, 4)); break;
+        default: break;
+        }
+    }
+};
+
+struct FunctionCompiler;
+
+// Compiles a module function by function as they are reached, with the
+// type descriptors, strings and method wrappers the code refers to.
+struct CodeGenerator {
+    const Module& module;
+    bool optimize;
+    string text, rodata, data;
+    vector<string> errors;
+    vector<bool> queued, wrapped, referenced;
+    vector<uint32_t> pending, wrappers;
+    unordered_map<const Type*, uint32_t> typeIds;
+    vector<const Type*> types;
+    map<string, string> strings, bytes;
+    int64_t zeroSize = 8;
+
+    CodeGenerator(const Module& module, bool optimize)
+        : module(module), optimize(optimize), queued(module.functions.size()), wrapped(module.functions.size()),
+        referenced(module.functions.size()) {}
+
+    string functionSymbol(uint32_t f) {
+        if (!queued[f]) {
+            queued[f] = true;
+            pending.push_back(f);
+        }
+        return symbolName(module.functions[f].name);
+    }
+    // The function as a value, a closure without captured variables.
+    string closureSymbol(uint32_t f) {
+        referenced[f] = true;
+        return functionSymbol(f) + "..f";
+    }
+    // A value method taking a pointer to its receiver, as interfaces call it.
+    string wrapperSymbol(uint32_t f) {
+        if (!wrapped[f]) {
+            wrapped[f] = true;
+            wrappers.push_back(f);
+        }
+        return functionSymbol(f) + "..deref";
+    }
+    string bytesSymbol(const string& s) {
+        auto [it, fresh] = bytes.try_emplace(s, ".Lbytes" + to_string(bytes.size()));
+        if (fresh) {
+            rodata += it->second + ":\n\t.ascii \"";
+            for (unsigned char c : s) {
+                if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+                    rodata += char(c);
+                    continue;
+                }
+                char escaped[8];
+                snprintf(escaped, sizeof escaped, "\\%03o", c);
+                rodata += escaped;
+            }
+            rodata += "\"\n";
+        }
+        return it->second;
+    }
+    // A string constant, its pointer and length.
+    string stringSymbol(const string& s) {
+        auto [it, fresh] = strings.try_emplace(s, ".Lstring" + to_string(strings.size()));
+        if (fresh) {
+            data += "\t.balign 8\n" + it->second + ":\n\t.quad " + (s.empty() ? "0" : bytesSymbol(s)) + ", " +
+                to_string(s.size()) + "\n";
+        }
+        return it->second;
+    }
+    // The descriptor of type t the runtime hashes, compares, prints and
+    // asserts values of t with, one per identical type.
+    string typeSymbol(const Type* t) {
+        t = concreteType(t);
+        auto it = typeIds.find(t);
+        if (it == typeIds.end()) {
+            uint32_t id = uint32_t(types.size());
+            for (uint32_t i = 0; i < types.size() && !t->canonical; i++) {
+                if (identical(types[i], t)) id = i;
+            }
+            if (id == types.size()) types.push_back(t);
+            it = typeIds.emplace(t, id).first;
+        }
+        return "go..type." + to_string(it->second);
+    }
+
+    void emitType(uint32_t id);
+    void emitWrapper(uint32_t f);
+    string generate();
+};
+
+// Compiles one function to assembly.
+struct FunctionCompiler : AsmWriter {
+    enum ValueClass : uint8_t {
+        // no value, or one of a type native code does not have
+        VC_NONE,
+        // a constant or an address, computed where it is used
+        VC_REMAT,
+        // in a register, or in a slot when spilled
+        VC_SCALAR,
+        // in memory, at the address home() gives
+        VC_MEMORY,
+    };
+
+    CodeGenerator& gen;
+    const Module& module;
+    const Function& f;
+    uint32_t index;
+    bool optimize;
+    string prefix;
+    Signature signature;
+    vector<ValueClass> classes;
+    vector<int> registers;
+    // the frame offset of a spilled scalar or of a value in memory, of the
+    // variable an alloc makes and of the copy of a phi in memory
+    vector<int64_t> slots, variables, shadows;
+    vector<uint32_t> uses;
+    // a comparison the branch right after it tests on the flags
+    vector<bool> fused;
+    vector<BlockId> order;
+    vector<pair<int, int64_t>> saved;
+    int64_t frameSize = 0, contextSlot = 0, outgoing = 0, tempBase = 0, tempCursor = 0, tempMax = 0;
+    uint32_t labelCount = 0;
+    bool boundsUsed = false, divideUsed = false;
+    struct Stub {
+        string label;
+        BlockId from, to;
+    };
+    vector<Stub> stubs;
+
+    FunctionCompiler(CodeGenerator& gen, uint32_t index)
+        : gen(gen), module(gen.module), f(gen.module.functions[index]), index(index), optimize(gen.optimize),
+        prefix(".L" + to_string(index) + "_"), signature(f.receiver, f.type) {}
+
+    [[noreturn]] static void unsupported(const string& what) { throw runtime_error(what + " is not supported natively"); }
+    const Type* typeOf(ValueId v) const { return f.values[v].type; }
+    string newLabel() { return prefix + to_string(labelCount++); }
+    string blockLabel(BlockId b) const { return prefix + "b" + to_string(b); }
+    int64_t frameSlot(int64_t size) {
+        frameSize += align8(max<int64_t>(size, 8));
+        return -frameSize;
+    }
+    // Scratch memory of the value being compiled, reused by the next one.
+    Mem temp(int64_t size) {
+        tempCursor += align8(max<int64_t>(size, 8));
+        tempMax = max(tempMax, tempCursor);
+        return Mem{ RBP, -(tempBase + tempCursor) };
+    }
+
+    //===--- operands ---===//
+
+    ValueClass classify(ValueId v) const {
+        const Value& x = f.values[v];
+        if (x.type == nullptr || x.type->kind == TY_INVALID) return VC_NONE;
+        if (isAggregate(x.type)) return VC_MEMORY;
+        if (optimize && (x.op == IR_CONST || x.op == IR_ZERO || x.op == IR_GLOBAL || x.op == IR_FUNC)) return VC_REMAT;
+        return VC_SCALAR;
+    }
+    // The bits of constant v as it sits in a register, a float32 in the low
+    // 32 bits of its own format rather than as the double the IR keeps.
+    int64_t bits(ValueId v) const {
+        const Value& x = f.values[v];
+        if (x.op != IR_CONST) return 0;
+        if (kindOf(x.type) != TY_FLOAT32) return x.aux;
+        double d;
+        memcpy(&d, &x.aux, sizeof d);
+        float single = float(d);
+        uint32_t b;
+        memcpy(&b, &single, sizeof b);
+        return b;
+    }
+    bool constant(ValueId v, int64_t& c) const {
+        const Value& x = f.values[v];
+        if (classes[v] != VC_REMAT || (x.op != IR_CONST && x.op != IR_ZERO)) return false;
+        c = bits(v);
+        return true;
+    }
+    // The memory value v is in.
+    Mem home(ValueId v) {
+        const Value& x = f.values[v];
+        if (classes[v] != VC_MEMORY) unsupported("a value of type " + typeString(x.type));
+        if (x.op == IR_STRING) return Mem{ RBP, 0, gen.stringSymbol(f.strings[x.aux]) };
+        if (x.op == IR_ZERO) {
+            gen.zeroSize = max(gen.zeroSize, layoutOf(x.type).size);
+            return Mem{ RBP, 0, "go..zero" };
+        }
+        return Mem{ RBP, slots[v] };
+    }
+    // The constant or address v computes, an immediate or scratch.
+    string rematerialize(ValueId v, int scratch) {
+        const Value& x = f.values[v];
+        if (x.op == IR_GLOBAL || x.op == IR_FUNC) {
+            string symbol = x.op == IR_FUNC ? gen.closureSymbol(uint32_t(x.aux)) :
+                symbolName(module.globals[x.aux].name);
+            ins("lea " + symbol + "(%rip), " + reg(scratch));
+            return reg(scratch);
+        }
+        int64_t c = bits(v);
+        if (c == int32_t(c)) return "$" + to_string(c);
+        ins("movabs $" + to_string(c) + ", " + reg(scratch));
+        return reg(scratch);
+    }
+    // A 64 bit operand holding scalar v: an immediate, its register or its
+    // slot, or scratch after v is computed into it.
+    string operand(ValueId v, int scratch) {
+        const Value& x = f.values[v];
+        switch (classes[v]) {
+        case VC_REMAT:
+            return rematerialize(v, scratch);
+        case VC_SCALAR:
+            return registers[v] >= 0 ? reg(registers[v]) : Mem{ RBP, slots[v] }.str();
+        default:
+            unsupported(x.type != nullptr ? "a value of type " + typeString(x.type) : "a value of " + string(opNames[x.op]));
+        }
+    }
+    static bool isMemory(const string& operand) { return operand.find('(') != string::npos; }
+    void load(ValueId v, int r) {
+        string s = operand(v, r);
+        if (s != reg(r)) ins("mov " + s + ", " + reg(r));
+    }
+    // The register holding v, scratch if it has none.
+    int inRegister(ValueId v, int scratch) {
+        if (classes[v] == VC_SCALAR && registers[v] >= 0) return registers[v];
+        load(v, scratch);
+        return scratch;
+    }
+    // Where v is best computed: its own register, or rax.
+    int target(ValueId v) const { return classes[v] == VC_SCALAR && registers[v] >= 0 ? registers[v] : RAX; }
+    // Gives scalar v the 64 bit operand source.
+    void assign(ValueId v, const string& source) {
+        if (classes[v] == VC_NONE) return;
+        if (classes[v] != VC_SCALAR) unsupported("a value of " + string(opNames[f.values[v].op]));
+        if (registers[v] >= 0) {
+            if (source != reg(registers[v])) ins("mov " + source + ", " + reg(registers[v]));
+            return;
+        }
+        string slot = Mem{ RBP, slots[v] }.str();
+        if (isMemory(source)) {
+            ins("mov " + source + ", %rax");
+            ins("mov %rax, " + slot);
+            return;
+        }
+        ins("movq " + source + ", " + slot);
+    }
+    void store(ValueId v, int r) { assign(v, reg(r)); }
+    // Memory holding v, a scalar being stored to scratch memory first.
+    Mem addressOf(ValueId v) {
+        if (classes[v] == VC_MEMORY) return home(v);
+        Mem m = temp(8);
+        ins("mov " + reg(inRegister(v, RAX)) + ", " + m.str());
+        return m;
+    }
+    // Writes scalar or memory value v to memory of its type.
+    void storeValue(ValueId v, const Mem& dst) {
+        const Type* t = typeOf(v);
+        if (classes[v] == VC_MEMORY) {
+            copy(dst, home(v), layoutOf(t).size);
+            return;
+        }
+        storeTo(t, inRegister(v, RAX), dst.str());
+    }
+    // Reads a value of type t from memory src into v.
+    void loadValue(ValueId v, const Mem& src) {
+        const Type* t = typeOf(v);
+        if (classes[v] == VC_MEMORY) {
+            copy(home(v), src, layoutOf(t).size);
+            return;
+        }
+        int r = target(v);
+        loadFrom(t, src.str(), r);
+        store(v, r);
+    }
+    void loadFloat(ValueId v, int xmm) {
+        string x = "%xmm" + to_string(xmm);
+        bool single = kindOf(typeOf(v)) == TY_FLOAT32;
+        string s = operand(v, RAX);
+        if (isMemory(s)) {
+            ins((single ? "movss " : "movsd ") + s + ", " + x);
+            return;
+        }
+        if (s[0] == '$') {
+            ins("mov " + s + ", %rax");
+            s = "%rax";
+        }
+        ins("movq " + s + ", " + x);
+    }
+    // Stores the float in xmm0 into v.
+    void storeFloat(ValueId v) {
+        if (kindOf(typeOf(v)) == TY_FLOAT32) {
+            ins("movd %xmm0, %eax");
+        }
+        else {
+            ins("movq %xmm0, %rax");
+        }
+        store(v, RAX);
+    }
+
+    //===--- runtime calls ---===//
+
+    // An argument of a call of the runtime: a scalar value, an operand, or the
+    // address of memory.
+    struct Arg {
+        enum Kind : uint8_t { VALUE, OPERAND, ADDRESS } kind;
+        ValueId v;
+        string text;
+    };
+    static Arg value(ValueId v) { return { Arg::VALUE, v, "" }; }
+    static Arg immediate(int64_t n) { return { Arg::OPERAND, 0, "$" + to_string(n) }; }
+    static Arg address(const Mem& m) { return { Arg::ADDRESS, 0, m.str() }; }
+    static Arg symbol(const string& s) { return { Arg::ADDRESS, 0, s + "(%rip)" }; }
+    void push(const Arg& a) {
+        switch (a.kind) {
+        case Arg::VALUE: ins("pushq " + operand(a.v, RAX)); break;
+        case Arg::OPERAND: ins("pushq " + a.text); break;
+        case Arg::ADDRESS:
+            ins("lea " + a.text + ", %rax");
+            ins("pushq %rax");
+            break;
+        }
+    }
+    // Calls C function name of the runtime. The arguments are all pushed before
+    // the first is popped into its register, so none is overwritten before it
+    // is read.
+    void callRuntime(const string& name, const vector<Arg>& args) {
+        size_t inRegisters = min<size_t>(args.size(), 6), onStack = args.size() - inRegisters;
+        size_t padding = onStack % 2;
+        if (padding != 0) ins("sub $8, %rsp");
+        for (size_t i = args.size(); i-- > inRegisters;) push(args[i]);
+        for (size_t i = 0; i < inRegisters; i++) push(args[i]);
+        for (size_t i = inRegisters; i-- > 0;) ins("popq " + reg(argumentRegisters[i]));
+        ins("call " + name + "@PLT");
+        if (onStack + padding != 0) ins("add $" + to_string(8 * (onStack + padding)) + ", %rsp");
+    }
+    // Whether v calls a function, which clobbers the caller saved registers.
+    bool callsOut(ValueId v) const {
+        const Value& x = f.values[v];
+        auto args = f.args(v);
+        switch (x.op) {
+        case IR_CALL: case IR_CALL_EXTERN: case IR_CALL_VALUE: case IR_CALL_METHOD: case IR_MAKE_CLOSURE:
+        case IR_SLICE: case IR_MAKE_SLICE: case IR_APPEND: case IR_COPY: case IR_STRING_NEXT:
+        case IR_MAKE_MAP: case IR_MAP_INDEX: case IR_MAP_UPDATE: case IR_MAP_DELETE: case IR_MAP_ITER: case IR_MAP_NEXT:
+        case IR_PRINT:
+            return true;
+        case IR_ALLOC: return x.flags & V_HEAP;
+        case IR_MAKE_INTERFACE: return !isPointerShaped(typeOf(args[0]));
+        case IR_TYPE_ASSERT: {
+            const Type* t = x.flags & V_COMMA_OK ? static_cast<const TupleType*>(x.type)->types[0] : x.type;
+            return kindOf(t) == TY_INTERFACE;
+        }
+        case IR_ADD: return kindOf(x.type) == TY_STRING;
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            return classes[args[0]] == VC_MEMORY && classes[args[1]] == VC_MEMORY;
+        case IR_CONVERT: return (kindOf(x.type) == TY_STRING && kindOf(typeOf(args[0])) != TY_STRING) ||
+            (kindOf(x.type) == TY_SLICE && kindOf(typeOf(args[0])) == TY_STRING);
+        default:
+            return false;
+        }
+    }
+
+    //===--- register allocation ---===//
+
+    // Blocks in reverse postorder, so a block comes after its dominators. The
+    // successors are visited last to first, which puts the first one, the body
+    // of a loop or the then branch of an if, right after its block.
+    void layoutBlocks() {
+        vector<pair<BlockId, size_t>> stack{ { 0, 0 } };
+        vector<bool> visited(f.blocks.size());
+        visited[0] = true;
+        while (!stack.empty()) {
+            auto& [b, next] = stack.back();
+            auto& succs = f.blocks[b].succs;
+            if (next < succs.size()) {
+                BlockId s = succs[succs.size() - ++next];
+                if (!visited[s]) {
+                    visited[s] = true;
+                    stack.push_back({ s, 0 });
+                }
+                continue;
+            }
+            order.push_back(b);
+            stack.pop_back();
+        }
+        reverse(order.begin(), order.end());
+    }
+    // The operand of phi v for the edge from block pred.
+    ValueId phiOperand(ValueId v, BlockId pred) const {
+        auto& preds = f.blocks[f.values[v].block].preds;
+        return f.args(v)[find(preds.begin(), preds.end(), pred) - preds.begin()];
+    }
+    void allocate() {
+        size_t n = f.values.size(), words = (n + 63) / 64;
+        vector<uint32_t> position(n), blockEnd(f.blocks.size()), clobbers;
+        uint32_t p = 0;
+        for (BlockId b : order) {
+            for (ValueId v : f.blocks[b].values) {
+                position[v] = p;
+                if (callsOut(v)) clobbers.push_back(p);
+                p += 2;
+            }
+            blockEnd[b] = p - 2;
+        }
+        auto scalar = [&](ValueId v) { return classes[v] == VC_SCALAR; };
+        // liveness of the scalars at block boundaries, a phi being defined at
+        // the start of its block and its operands used at the end of the
+        // predecessors
+        vector<vector<uint64_t>> gen(f.blocks.size(), vector<uint64_t>(words)), kill = gen, in = gen, out = gen;
+        auto has = [](const vector<uint64_t>& set, ValueId v) { return (set[v / 64] >> (v % 64)) & 1; };
+        auto set = [](vector<uint64_t>& set, ValueId v) { set[v / 64] |= uint64_t(1) << (v % 64); };
+        for (BlockId b = 0; b < f.blocks.size(); b++) {
+            for (ValueId v : f.blocks[b].values) {
+                if (f.values[v].op != IR_PHI) {
+                    for (ValueId a : f.args(v)) {
+                        if (scalar(a) && !has(kill[b], a)) set(gen[b], a);
+                    }
+                }
+                if (scalar(v)) set(kill[b], v);
+            }
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = order.size(); i-- > 0;) {
+                BlockId b = order[i];
+                vector<uint64_t> live(words);
+                for (BlockId s : f.blocks[b].succs) {
+                    for (size_t w = 0; w < words; w++) live[w] |= in[s][w];
+                    for (ValueId v : f.blocks[s].values) {
+                        if (f.values[v].op != IR_PHI) break;
+                        ValueId a = phiOperand(v, b);
+                        if (scalar(a)) set(live, a);
+                    }
+                }
+                for (size_t w = 0; w < words; w++) {
+                    uint64_t live_in = gen[b][w] | (live[w] & ~kill[b][w]);
+                    if (live[w] != out[b][w] || live_in != in[b][w]) changed = true;
+                    out[b][w] = live[w];
+                    in[b][w] = live_in;
+                }
+            }
+        }
+        vector<uint32_t> start(n), end(n);
+        for (ValueId v = 1; v < n; v++) start[v] = end[v] = position[v];
+        for (BlockId b : order) {
+            for (ValueId v : f.blocks[b].values) {
+                if (f.values[v].op == IR_PHI) continue;
+                for (ValueId a : f.args(v)) end[a] = max(end[a], position[v]);
+            }
+            for (BlockId s : f.blocks[b].succs) {
+                for (ValueId v : f.blocks[s].values) {
+                    if (f.values[v].op != IR_PHI) break;
+                    ValueId a = phiOperand(v, b);
+                    end[a] = max(end[a], blockEnd[b] + 1);
+                }
+            }
+            for (size_t w = 0; w < words; w++) {
+                for (uint64_t bits = out[b][w]; bits != 0; bits &= bits - 1) {
+                    ValueId v = ValueId(w * 64 + lowestBit64(bits));
+                    end[v] = max(end[v], blockEnd[b] + 1);
+                }
+            }
+        }
+        // an operand of a phi is best computed right into the register of the
+        // phi, which leaves nothing to move on the edge
+        vector<ValueId> intervals, hints(n);
+        for (ValueId v = 1; v < n; v++) {
+            if (scalar(v) && !fused[v]) intervals.push_back(v);
+            if (f.values[v].op == IR_PHI) {
+                for (ValueId a : f.args(v)) hints[a] = v;
+            }
+        }
+        stable_sort(intervals.begin(), intervals.end(), [&](ValueId a, ValueId b) { return start[a] < start[b]; });
+        vector<int> free(callerSaved, callerSaved + size(callerSaved));
+        free.insert(free.end(), calleeSaved, calleeSaved + size(calleeSaved));
+        auto isCalleeSaved = [](int r) { return find(std::begin(calleeSaved), std::end(calleeSaved), r) != std::end(calleeSaved); };
+        vector<ValueId> active;
+        vector<bool> used(16);
+        for (ValueId v : intervals) {
+            // an operand used last by v itself is free for its result, every
+            // value reading its operands before it writes its register
+            for (size_t i = 0; i < active.size();) {
+                if (end[active[i]] > start[v]) {
+                    i++;
+                    continue;
+                }
+                free.push_back(registers[active[i]]);
+                active.erase(active.begin() + i);
+            }
+            auto clobber = upper_bound(clobbers.begin(), clobbers.end(), start[v]);
+            bool acrossCall = clobber != clobbers.end() && *clobber < end[v];
+            // a short interval takes a caller saved register first, which costs
+            // no save in the prologue
+            auto allowed = [&](int r) { return !acrossCall || isCalleeSaved(r); };
+            auto pick = free.end();
+            if (hints[v] != 0 && registers[hints[v]] >= 0 && allowed(registers[hints[v]])) {
+                pick = find(free.begin(), free.end(), registers[hints[v]]);
+            }
+            if (pick == free.end()) pick = find_if(free.begin(), free.end(), allowed);
+            if (pick != free.end()) {
+                registers[v] = *pick;
+                free.erase(pick);
+                active.push_back(v);
+                continue;
+            }
+            ValueId victim = 0;
+            for (ValueId a : active) {
+                if ((!acrossCall || isCalleeSaved(registers[a])) && (victim == 0 || end[a] > end[victim])) victim = a;
+            }
+            if (victim == 0 || end[victim] <= end[v]) continue;
+            registers[v] = registers[victim];
+            registers[victim] = -1;
+            replace(active.begin(), active.end(), victim, v);
+        }
+        for (ValueId v = 1; v < n; v++) {
+            if (registers[v] >= 0) used[registers[v]] = true;
+        }
+        for (int r : calleeSaved) {
+            if (used[r]) saved.push_back({ r, 0 });
+        }
+    }
+
+    //===--- values ---===//
+
+    void binary(ValueId v, const char* mnemonic) {
+        auto args = f.args(v);
+        int d = target(v);
+        if (classes[args[1]] == VC_SCALAR && registers[args[1]] == d) d = RAX;
+        load(args[0], d);
+        ins(string(mnemonic) + " " + operand(args[1], RCX) + ", " + reg(d));
+        normalize(typeOf(v), d);
+        store(v, d);
+    }
+    void floatBinary(ValueId v, const char* mnemonic) {
+        auto args = f.args(v);
+        loadFloat(args[0], 0);
+        loadFloat(args[1], 1);
+        ins(string(mnemonic) + (kindOf(typeOf(v)) == TY_FLOAT32 ? "ss" : "sd") + " %xmm1, %xmm0");
+        storeFloat(v);
+    }
+    void shift(ValueId v) {
+        auto args = f.args(v);
+        const Type* t = typeOf(v);
+        bool arithmetic = f.values[v].op == IR_SHR && !isUnsigned(kindOf(t));
+        const char* mnemonic = f.values[v].op == IR_SHL ? "shl" : arithmetic ? "sar" : "shr";
+        int d = target(v);
+        if (classes[args[1]] == VC_SCALAR && registers[args[1]] == d) d = RAX;
+        int64_t count;
+        if (constant(args[1], count)) {
+            load(args[0], d);
+            if (uint64_t(count) < 64) {
+                ins(string(mnemonic) + " $" + to_string(count) + ", " + reg(d));
+            }
+            else if (arithmetic) {
+                ins("sar $63, " + reg(d));
+            }
+            else {
+                ins("xor " + reg(d, 4) + ", " + reg(d, 4));
+            }
+        }
+        else {
+            // counts of 64 and more shift every bit out
+            load(args[1], RCX);
+            load(args[0], d);
+            string small = newLabel(), done = newLabel();
+            ins("cmp $63, %rcx");
+            ins("jbe " + small);
+            if (arithmetic) {
+                ins("mov $63, %ecx");
+            }
+            else {
+                ins("xor " + reg(d, 4) + ", " + reg(d, 4));
+                ins("jmp " + done);
+            }
+            label(small);
+            ins(string(mnemonic) + " %cl, " + reg(d));
+            label(done);
+        }
+        normalize(t, d);
+        store(v, d);
+    }
+    void divide(ValueId v) {
+        auto args = f.args(v);
+        const Type* t = typeOf(v);
+        bool mod = f.values[v].op == IR_MOD, sign = !isUnsigned(kindOf(t));
+        int64_t c;
+        if (constant(args[1], c) && c > 0 && (c & (c - 1)) == 0) {
+            int k = lowestBit64(uint64_t(c));
+            int d = target(v);
+            load(args[0], d);
+            if (!sign) {
+                if (mod) {
+                    ins(c - 1 == int32_t(c - 1) ? "and $" + to_string(c - 1) + ", " + reg(d) :
+                        "movabs $" + to_string(c - 1) + ", %rcx\n\tand %rcx, " + reg(d));
+                }
+                else if (k > 0) {
+                    ins("shr $" + to_string(k) + ", " + reg(d));
+                }
+            }
+            else if (k > 0) {
+                // rounds toward zero by adding c - 1 to a negative dividend
+                ins("mov " + reg(d) + ", %rcx");
+                ins("sar $63, %rcx");
+                ins("shr $" + to_string(64 - k) + ", %rcx");
+                if (mod) {
+                    ins("add %rcx, " + reg(d));
+                    ins(c - 1 == int32_t(c - 1) ? "and $" + to_string(c - 1) + ", " + reg(d) :
+                        "movabs $" + to_string(c - 1) + ", %rdx\n\tand %rdx, " + reg(d));
+                    ins("sub %rcx, " + reg(d));
+                }
+                else {
+                    ins("add %rcx, " + reg(d));
+                    ins("sar $" + to_string(k) + ", " + reg(d));
+                }
+            }
+            else if (mod) {
+                ins("xor " + reg(d, 4) + ", " + reg(d, 4));
+            }
+            normalize(t, d);
+            store(v, d);
+            return;
+        }
+        load(args[1], RCX);
+        load(args[0], RAX);
+        // only a divisor known not to be zero skips the check, one known to
+        // be zero always panics
+        if (!constant(args[1], c)) {
+            ins("test %rcx, %rcx");
+            ins("je " + prefix + "divide");
+            divideUsed = true;
+        }
+        else if (c == 0) {
+            ins("jmp " + prefix + "divide");
+            divideUsed = true;
+        }
+        if (sign) {
+            // the quotient of the most negative number by -1 overflows, which
+            // idiv traps on and Go wraps
+            string normal = newLabel(), done = newLabel();
+            ins("cmp $-1, %rcx");
+            ins("jne " + normal);
+            ins(mod ? "xor %eax, %eax" : "neg %rax");
+            ins("jmp " + done);
+            label(normal);
+            ins("cqo");
+            ins("idiv %rcx");
+            if (mod) ins("mov %rdx, %rax");
+            label(done);
+        }
+        else {
+            ins("xor %edx, %edx");
+            ins("div %rcx");
+            if (mod) ins("mov %rdx, %rax");
+        }
+        normalize(t, RAX);
+        store(v, RAX);
+    }
+    static bool isComparison(Op op) { return op >= IR_EQ && op <= IR_GE; }
+    bool fusable(ValueId v) const {
+        auto args = f.args(v);
+        if (!isComparison(f.values[v].op) || classes[args[0]] == VC_MEMORY || classes[args[0]] == VC_NONE) return false;
+        return !isFloat(kindOf(typeOf(args[0]))) || (f.values[v].op != IR_EQ && f.values[v].op != IR_NE);
+    }
+    // Compares the scalar operands of v and returns the condition code that
+    // holds when v is true.
+    string compareScalars(ValueId v) {
+        auto args = f.args(v);
+        Op op = f.values[v].op;
+        TypeKind k = kindOf(typeOf(args[0]));
+        if (isFloat(k)) {
+            loadFloat(args[0], 0);
+            loadFloat(args[1], 1);
+            string mnemonic = k == TY_FLOAT32 ? "ucomiss " : "ucomisd ";
+            // unordered operands set the carry flag, so only above and above or
+            // equal are false for NaN
+            ins(mnemonic + (op == IR_LT || op == IR_LE ? "%xmm0, %xmm1" : "%xmm1, %xmm0"));
+            return op == IR_LT || op == IR_GT ? "a" : op == IR_LE || op == IR_GE ? "ae" : op == IR_EQ ? "e" : "ne";
+        }
+        string x = operand(args[0], RAX);
+        if (x[0] != '%') {
+            ins("mov " + x + ", %rax");
+            x = "%rax";
+        }
+        ins("cmp " + operand(args[1], RCX) + ", " + x);
+        bool sign = isInteger(k) && !isUnsigned(k);
+        switch (op) {
+        case IR_EQ: return "e";
+        case IR_NE: return "ne";
+        case IR_LT: return sign ? "l" : "b";
+        case IR_LE: return sign ? "le" : "be";
+        case IR_GT: return sign ? "g" : "a";
+        default: return sign ? "ge" : "ae";
+        }
+    }
+    static string inverse(const string& cc) {
+        static const pair<const char*, const char*> pairs[] = { { "e", "ne" }, { "l", "ge" }, { "le", "g" },
+            { "b", "ae" }, { "be", "a" } };
+        for (auto [a, b] : pairs) {
+            if (cc == a) return b;
+            if (cc == b) return a;
+        }
+        return cc;
+    }
+    void compare(ValueId v) {
+        auto args = f.args(v);
+        Op op = f.values[v].op;
+        const Type* t = typeOf(args[0]);
+        TypeKind k = kindOf(t);
+        if (classes[args[0]] != VC_MEMORY || classes[args[1]] != VC_MEMORY) {
+            if (isFloat(k) && (op == IR_EQ || op == IR_NE)) {
+                loadFloat(args[0], 0);
+                loadFloat(args[1], 1);
+                ins(string(k == TY_FLOAT32 ? "ucomiss" : "ucomisd") + " %xmm1, %xmm0");
+                ins(op == IR_EQ ? "sete %al" : "setne %al");
+                ins(op == IR_EQ ? "setnp %cl" : "setp %cl");
+                ins(op == IR_EQ ? "and %cl, %al" : "or %cl, %al");
+            }
+            else {
+                ins("set" + compareScalars(v) + " %al");
+            }
+            ins("movzbl %al, %eax");
+            store(v, RAX);
+            return;
+        }
+        ValueId nil = f.values[args[0]].op == IR_ZERO ? args[0] : f.values[args[1]].op == IR_ZERO ? args[1] : 0;
+        if (k == TY_SLICE && nil != 0) {
+            // a slice is only compared with nil, which its pointer tells
+            ins("cmpq $0, " + home(nil == args[0] ? args[1] : args[0]).str());
+            ins(op == IR_EQ ? "sete %al" : "setne %al");
+            ins("movzbl %al, %eax");
+            store(v, RAX);
+            return;
+        }
+        if (k == TY_STRING) {
+            callRuntime("g5_string_compare", { address(home(args[0])), address(home(args[1])) });
+            static const pair<Op, const char*> codes[] = { { IR_EQ, "e" }, { IR_NE, "ne" }, { IR_LT, "l" },
+                { IR_LE, "le" }, { IR_GT, "g" }, { IR_GE, "ge" } };
+            ins("cmp $0, %rax");
+            ins(string("set") + find_if(begin(codes), end(codes), [&](auto& c) { return c.first == op; })->second + " %al");
+        }
+        else {
+            if (k == TY_INTERFACE) {
+                callRuntime("g5_interface_equal", { address(home(args[0])), address(home(args[1])) });
+            }
+            else {
+                callRuntime("g5_equal", { symbol(gen.typeSymbol(t)), address(home(args[0])), address(home(args[1])) });
+            }
+            ins("test %rax, %rax");
+            ins(op == IR_EQ ? "setne %al" : "sete %al");
+        }
+        ins("movzbl %al, %eax");
+        store(v, RAX);
+    }
+    void convert(ValueId v) {
+        ValueId x = f.args(v)[0];
+        const Type* to = typeOf(v);
+        const Type* from = typeOf(x);
+        TypeKind tk = kindOf(to), fk = kindOf(from);
+        auto elemKind = [](const Type* t) { return kindOf(static_cast<const SliceType*>(underlying(t))->elem); };
+        if (tk == TY_STRING && fk != TY_STRING) {
+            if (fk == TY_SLICE) {
+                callRuntime(elemKind(from) == TY_UINT8 ? "g5_string_from_bytes" : "g5_string_from_runes",
+                    { address(home(v)), address(home(x)) });
+            }
+            else {
+                callRuntime("g5_string_from_rune", { address(home(v)), value(x) });
+            }
+            return;
+        }
+        if (tk == TY_SLICE && fk == TY_STRING) {
+            callRuntime(elemKind(to) == TY_UINT8 ? "g5_bytes_from_string" : "g5_runes_from_string",
+                { address(home(v)), address(home(x)) });
+            return;
+        }
+        if (classes[v] == VC_MEMORY) {
+            // the same representation, an interface converted to another
+            // interface among them
+            copy(home(v), home(x), layoutOf(to).size);
+            return;
+        }
+        if (isFloat(tk) && isFloat(fk)) {
+            loadFloat(x, 0);
+            if (tk != fk) ins(tk == TY_FLOAT32 ? "cvtsd2ss %xmm0, %xmm0" : "cvtss2sd %xmm0, %xmm0");
+            storeFloat(v);
+            return;
+        }
+        if (isFloat(tk)) {
+            string suffix = tk == TY_FLOAT32 ? "ss" : "sd";
+            load(x, RAX);
+            if (fk == TY_UINT64 || fk == TY_UINT || fk == TY_UINTPTR) {
+                // halved so it converts as a signed number, keeping the low bit
+                // for the rounding, and doubled back
+                string large = newLabel(), done = newLabel();
+                ins("test %rax, %rax");
+                ins("js " + large);
+                ins("cvtsi2" + suffix + "q %rax, %xmm0");
+                ins("jmp " + done);
+                label(large);
+                ins("mov %rax, %rcx");
+                ins("shr %rcx");
+                ins("and $1, %eax");
+                ins("or %rax, %rcx");
+                ins("cvtsi2" + suffix + "q %rcx, %xmm0");
+                ins("add" + suffix + " %xmm0, %xmm0");
+                label(done);
+            }
+            else {
+                ins("cvtsi2" + suffix + "q %rax, %xmm0");
+            }
+            storeFloat(v);
+            return;
+        }
+        if (isFloat(fk)) {
+            loadFloat(x, 0);
+            if (fk == TY_FLOAT32) ins("cvtss2sd %xmm0, %xmm0");
+            if (tk == TY_UINT64 || tk == TY_UINT || tk == TY_UINTPTR) {
+                string large = newLabel(), done = newLabel();
+                ins("movabs $0x43e0000000000000, %rcx");
+                ins("movq %rcx, %xmm1");
+                ins("ucomisd %xmm1, %xmm0");
+                ins("jae " + large);
+                ins("cvttsd2si %xmm0, %rax");
+                ins("jmp " + done);
+                label(large);
+                ins("subsd %xmm1, %xmm0");
+                ins("cvttsd2si %xmm0, %rax");
+                ins("btc $63, %rax");
+                label(done);
+            }
+            else {
+                ins("cvttsd2si %xmm0, %rax");
+            }
+            normalize(to, RAX);
+            store(v, RAX);
+            return;
+        }
+        int d = target(v);
+        load(x, d);
+        if (isInteger(tk)) normalize(to, d);
+        store(v, d);
+    }
+    // Leaves the address of element i of memory of elements of size bytes at
+    // base in register out, with i in rcx.
+    void element(int base, int64_t size, int out) {
+        if (size == 1 || size == 2 || size == 4 || size == 8) {
+            ins("lea (" + reg(base) + ",%rcx," + to_string(size) + "), " + reg(out));
+            return;
+        }
+        ins("imul $" + to_string(size) + ", %rcx, %rcx");
+        ins("lea (" + reg(base) + ",%rcx), " + reg(out));
+    }
+    // Loads index i into rcx and checks it against length, panicking when it is
+    // out of range.
+    void checkIndex(ValueId i, const string& length) {
+        load(i, RCX);
+        int64_t c, n;
+        if (constant(i, c) && length[0] == '$' && (n = stoll(length.substr(1)), uint64_t(c) < uint64_t(n))) return;
+        ins("mov " + length + ", %rdx");
+        ins("cmp %rdx, %rcx");
+        ins("jae " + prefix + "bounds");
+        boundsUsed = true;
+    }
+    // The Interface values of args in scratch memory, for the runtime to print.
+    // An interface is passed as itself unless wrap is set, as print wants it.
+    Mem interfaces(const vector<ValueId>& args, bool wrap) {
+        Mem array = temp(16 * int64_t(args.size()));
+        for (size_t i = 0; i < args.size(); i++) {
+            ValueId a = args[i];
+            const Type* t = typeOf(a);
+            Mem e = array.plus(16 * int64_t(i));
+            if (t->kind == TY_UNTYPED_NIL) {
+                zero(e, 16);
+                continue;
+            }
+            if (kindOf(t) == TY_INTERFACE && !wrap) {
+                copy(e, home(a), 16);
+                continue;
+            }
+            if (classes[a] == VC_MEMORY) {
+                ins("lea " + home(a).str() + ", %rax");
+            }
+            else if (isPointerShaped(t)) {
+                load(a, RAX);
+            }
+            else {
+                Mem m = addressOf(a);
+                ins("lea " + m.str() + ", %rax");
+            }
+            ins("mov %rax, " + e.plus(8).str());
+            ins("lea " + gen.typeSymbol(t) + "(%rip), %rax");
+            ins("mov %rax, " + e.str());
+        }
+        return array;
+    }
+    // Puts the arguments of a call into the outgoing area, from the first
+    // offset on.
+    void marshal(const vector<ValueId>& args, const vector<int64_t>& offsets) {
+        for (size_t i = 0; i < args.size(); i++) {
+            ValueId a = args[i];
+            Mem dst{ RSP, offsets[i] };
+            if (classes[a] == VC_MEMORY) {
+                copy(dst, home(a), layoutOf(typeOf(a)).size);
+                continue;
+            }
+            string s = operand(a, RAX);
+            if (isMemory(s)) {
+                ins("mov " + s + ", %rax");
+                s = "%rax";
+            }
+            ins("movq " + s + ", " + dst.str());
+        }
+    }
+    void results(ValueId v, int64_t offset) {
+        if (typeOf(v) == nullptr || classes[v] == VC_NONE) return;
+        Mem src{ RSP, offset };
+        if (classes[v] == VC_MEMORY) {
+            copy(home(v), src, layoutOf(typeOf(v)).size);
+        }
+        else {
+            assign(v, src.str());
+        }
+    }
+    void call(ValueId v) {
+        const Value& x = f.values[v];
+        auto args = f.args(v);
+        if (x.flags & (V_GO | V_DEFER)) unsupported(x.flags & V_GO ? "the go statement" : "the defer statement");
+        switch (x.op) {
+        case IR_CALL: {
+            const Function& callee = module.functions[x.aux];
+            Signature s(callee.receiver, callee.type);
+            marshal(vector<ValueId>(args.begin(), args.end()), s.params);
+            ins("call " + gen.functionSymbol(uint32_t(x.aux)));
+            results(v, s.argsSize);
+            break;
+        }
+        case IR_CALL_VALUE: {
+            auto* type = underlyingAs<FuncType>(typeOf(args[0]), TY_FUNC);
+            if (type == nullptr) unsupported("a call of a value of unknown type");
+            Signature s(nullptr, type);
+            marshal(vector<ValueId>(args.begin() + 1, args.end()), s.params);
+            load(args[0], RAX);
+            ins("call *(%rax)");
+            results(v, s.argsSize);
+            break;
+        }
+        case IR_CALL_METHOD: {
+            auto* iface = underlyingAs<InterfaceType>(typeOf(args[0]), TY_INTERFACE);
+            complete(iface);
+            const Method& m = iface->methods[x.aux];
+            Signature s(basicType(TY_UNSAFE_POINTER), m.type);
+            Mem receiver = home(args[0]);
+            ins("mov " + receiver.plus(8).str() + ", %rax");
+            ins("mov %rax, (%rsp)");
+            marshal(vector<ValueId>(args.begin() + 1, args.end()), vector<int64_t>(s.params.begin() + 1, s.params.end()));
+            string name(symbols.text(m.name));
+            callRuntime("g5_find_method", { address(receiver), symbol(gen.bytesSymbol(name)), immediate(int64_t(name.size())) });
+            ins("call *%rax");
+            results(v, s.argsSize);
+            break;
+        }
+        default: {
+            string name(symbols.text(Symbol(x.aux)));
+            static const pair<const char*, int> printers[] = { { "fmt.Print", 0 }, { "fmt.Println", 1 }, { "fmt.Printf", 2 } };
+            for (auto [printer, mode] : printers) {
+                if (name != printer) continue;
+                vector<ValueId> values(args.begin(), args.end());
+                Mem array = interfaces(values, false);
+                callRuntime("g5_fmt", { immediate(mode), address(array), immediate(int64_t(values.size())) });
+                return;
+            }
+            if (name == "os.Exit" && args.size() == 1) {
+                callRuntime("g5_exit", { value(args[0]) });
+                return;
+            }
+            unsupported(name);
+        }
+        }
+    }
+    void instruction(ValueId v) {
+        const Value& x = f.values[v];
+        auto args = f.args(v);
+        const Type* t = x.type;
+        switch (x.op) {
+        case IR_CONST: case IR_ZERO: case IR_GLOBAL: case IR_FUNC:
+            if (classes[v] == VC_SCALAR) assign(v, rematerialize(v, RAX));
+            break;
+        case IR_STRING: case IR_PHI:
+            break;
+        case IR_PARAM:
+            if (classes[v] == VC_SCALAR && registers[v] >= 0) {
+                ins("mov " + Mem{ RBP, 16 + signature.params[x.aux] }.str() + ", " + reg(registers[v]));
+            }
+            break;
+        case IR_FREE_VAR:
+            ins("mov " + Mem{ RBP, contextSlot }.str() + ", %rax");
+            ins("mov " + to_string(8 * (x.aux + 1)) + "(%rax), %rax");
+            store(v, RAX);
+            break;
+        case IR_MAKE_CLOSURE: {
+            Mem captured = temp(8 * int64_t(args.size()));
+            for (size_t i = 0; i < args.size(); i++) {
+                ins("mov " + reg(inRegister(args[i], RAX)) + ", " + captured.plus(8 * int64_t(i)).str());
+            }
+            callRuntime("g5_make_closure", { symbol(gen.functionSymbol(uint32_t(x.aux))),
+                immediate(int64_t(args.size())), address(captured) });
+            store(v, RAX);
+            break;
+        }
+        case IR_ADD:
+            if (kindOf(t) == TY_STRING) {
+                callRuntime("g5_concat", { address(home(v)), address(home(args[0])), address(home(args[1])) });
+                break;
+            }
+            if (isFloat(kindOf(t))) {
+                floatBinary(v, "add");
+                break;
+            }
+            binary(v, "add");
+            break;
+        case IR_SUB: case IR_MUL:
+            if (isFloat(kindOf(t))) {
+                floatBinary(v, x.op == IR_SUB ? "sub" : "mul");
+                break;
+            }
+            binary(v, x.op == IR_SUB ? "sub" : "imul");
+            break;
+        case IR_DIV: case IR_MOD:
+            if (isFloat(kindOf(t))) {
+                floatBinary(v, "div");
+                break;
+            }
+            divide(v);
+            break;
+        case IR_AND: binary(v, "and"); break;
+        case IR_OR: binary(v, "or"); break;
+        case IR_XOR: binary(v, "xor"); break;
+        case IR_AND_NOT: {
+            load(args[1], RCX);
+            ins("not %rcx");
+            load(args[0], RAX);
+            ins("and %rcx, %rax");
+            store(v, RAX);
+            break;
+        }
+        case IR_SHL: case IR_SHR: shift(v); break;
+        case IR_NEG: case IR_COMPL: case IR_NOT: {
+            int d = target(v);
+            load(args[0], d);
+            if (x.op == IR_NOT) {
+                ins("xor $1, " + reg(d));
+            }
+            else if (isFloat(kindOf(t))) {
+                ins(kindOf(t) == TY_FLOAT32 ? "xor $0x80000000, " + reg(d, 4) : "btc $63, " + reg(d));
+            }
+            else {
+                ins((x.op == IR_NEG ? "neg " : "not ") + reg(d));
+                normalize(t, d);
+            }
+            store(v, d);
+            break;
+        }
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            if (!fused[v]) compare(v);
+            break;
+        case IR_CONVERT: convert(v); break;
+        case IR_MAKE_INTERFACE: {
+            ValueId a = args[0];
+            Mem d = home(v);
+            if (typeOf(a)->kind == TY_UNTYPED_NIL) {
+                zero(d, 16);
+                break;
+            }
+            if (isPointerShaped(typeOf(a))) {
+                load(a, RAX);
+            }
+            else {
+                Mem m = addressOf(a);
+                callRuntime("g5_box", { immediate(layoutOf(typeOf(a)).size), address(m) });
+            }
+            ins("mov %rax, " + d.plus(8).str());
+            ins("lea " + gen.typeSymbol(typeOf(a)) + "(%rip), %rax");
+            ins("mov %rax, " + d.str());
+            break;
+        }
+        case IR_TYPE_ASSERT: {
+            bool commaOk = x.flags & V_COMMA_OK;
+            const Type* asserted = commaOk ? static_cast<const TupleType*>(t)->types[0] : t;
+            Mem from = home(args[0]);
+            string type = gen.typeSymbol(asserted);
+            if (kindOf(asserted) == TY_INTERFACE) {
+                callRuntime("g5_assert_interface", { address(home(v)), address(from), symbol(type), immediate(commaOk) });
+                break;
+            }
+            string fail = newLabel(), done = newLabel();
+            ins("mov " + from.str() + ", %rax");
+            ins("lea " + type + "(%rip), %rcx");
+            ins("cmp %rcx, %rax");
+            ins("jne " + fail);
+            if (isAggregate(asserted)) {
+                ins("mov " + from.plus(8).str() + ", %rcx");
+                copy(home(v), Mem{ RCX }, layoutOf(asserted).size);
+            }
+            else {
+                if (isPointerShaped(asserted)) {
+                    ins("mov " + from.plus(8).str() + ", %rax");
+                }
+                else {
+                    ins("mov " + from.plus(8).str() + ", %rcx");
+                    loadFrom(asserted, "(%rcx)", RAX);
+                }
+                if (commaOk) {
+                    ins("mov %rax, " + home(v).str());
+                }
+                else {
+                    store(v, RAX);
+                }
+            }
+            if (commaOk) ins("movq $1, " + home(v).plus(align8(layoutOf(asserted).size)).str());
+            ins("jmp " + done);
+            label(fail);
+            if (commaOk) {
+                zero(home(v), layoutOf(t).size);
+            }
+            else {
+                ins("mov %rax, %rdi");
+                ins("lea " + type + "(%rip), %rsi");
+                ins("call g5_panic_assert@PLT");
+            }
+            label(done);
+            break;
+        }
+        case IR_ALLOC: {
+            int64_t size = layoutOf(static_cast<const PointerType*>(underlying(t))->base).size;
+            if (x.flags & V_HEAP) {
+                callRuntime("g5_alloc", { immediate(size) });
+                store(v, RAX);
+                break;
+            }
+            Mem variable{ RBP, variables[v] };
+            zero(variable, align8(max<int64_t>(size, 8)));
+            int d = target(v);
+            ins("lea " + variable.str() + ", " + reg(d));
+            store(v, d);
+            break;
+        }
+        case IR_LOAD:
+            loadValue(v, Mem{ inRegister(args[0], RCX) });
+            break;
+        case IR_STORE:
+            if (classes[args[1]] == VC_MEMORY) {
+                copy(Mem{ inRegister(args[0], RDX) }, home(args[1]), layoutOf(typeOf(args[1])).size);
+                break;
+            }
+            {
+                int64_t c;
+                Mem dst{ inRegister(args[0], RCX) };
+                int64_t size = layoutOf(typeOf(args[1])).size;
+                if (constant(args[1], c) && (size == 8 ? c == int32_t(c) : true)) {
+                    ins(string("mov") + suffix(size) + " $" + to_string(size == 8 ? c : size == 4 ? int64_t(int32_t(c)) :
+                        size == 2 ? int64_t(int16_t(c)) : int64_t(int8_t(c))) + ", " + dst.str());
+                    break;
+                }
+                storeTo(typeOf(args[1]), inRegister(args[1], RAX), dst.str());
+            }
+            break;
+        case IR_FIELD_ADDR: {
+            auto* s = underlyingAs<StructType>(static_cast<const PointerType*>(underlying(typeOf(args[0])))->base, TY_STRUCT);
+            int64_t offset = fieldOffset(s, size_t(x.aux));
+            int d = target(v);
+            int base = inRegister(args[0], d);
+            ins("lea " + Mem{ base, offset }.str() + ", " + reg(d));
+            store(v, d);
+            break;
+        }
+        case IR_INDEX_ADDR: {
+            const Type* base = underlying(typeOf(args[0]));
+            const Type* elem = static_cast<const PointerType*>(underlying(t))->base;
+            int64_t size = layoutOf(elem).size;
+            int d = target(v);
+            if (base->kind == TY_POINTER) {
+                auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(base)->base, TY_ARRAY);
+                if (a == nullptr) unsupported("indexing " + typeString(base));
+                checkIndex(args[1], "$" + to_string(a->length));
+                element(inRegister(args[0], RAX), size, d);
+            }
+            else {
+                Mem s = home(args[0]);
+                checkIndex(args[1], s.plus(8).str());
+                ins("mov " + s.str() + ", %rax");
+                element(RAX, size, d);
+            }
+            store(v, d);
+            break;
+        }
+        case IR_FIELD: {
+            auto* s = underlyingAs<StructType>(typeOf(args[0]), TY_STRUCT);
+            loadValue(v, home(args[0]).plus(fieldOffset(s, size_t(x.aux))));
+            break;
+        }
+        case IR_EXTRACT: {
+            auto* tuple = static_cast<const TupleType*>(typeOf(args[0]));
+            if (classes[args[0]] != VC_MEMORY || tuple->kind != TY_TUPLE) unsupported("a result of " + string(opNames[f.values[args[0]].op]));
+            loadValue(v, home(args[0]).plus(tupleOffset(tuple, size_t(x.aux))));
+            break;
+        }
+        case IR_INDEX: {
+            Mem s = home(args[0]);
+            if (kindOf(typeOf(args[0])) == TY_STRING) {
+                checkIndex(args[1], s.plus(8).str());
+                ins("mov " + s.str() + ", %rax");
+                ins("movzbl (%rax,%rcx), %eax");
+                store(v, RAX);
+                break;
+            }
+            auto* a = underlyingAs<ArrayType>(typeOf(args[0]), TY_ARRAY);
+            checkIndex(args[1], "$" + to_string(a->length));
+            ins("lea " + s.str() + ", %rax");
+            element(RAX, layoutOf(t).size, RCX);
+            loadValue(v, Mem{ RCX });
+            break;
+        }
+        case IR_LEN: case IR_CAP: {
+            const Type* u = underlying(typeOf(args[0]));
+            if (u->kind == TY_POINTER) u = underlying(static_cast<const PointerType*>(u)->base);
+            if (u->kind == TY_ARRAY) {
+                assign(v, "$" + to_string(static_cast<const ArrayType*>(u)->length));
+            }
+            else if (u->kind == TY_MAP) {
+                string done = newLabel();
+                int d = target(v);
+                load(args[0], d);
+                ins("test " + reg(d) + ", " + reg(d));
+                ins("jz " + done);
+                ins("mov 8(" + reg(d) + "), " + reg(d));
+                label(done);
+                store(v, d);
+            }
+            else if (u->kind == TY_STRING || u->kind == TY_SLICE) {
+                assign(v, home(args[0]).plus(x.op == IR_LEN ? 8 : 16).str());
+            }
+            else {
+                unsupported(string(x.op == IR_LEN ? "len" : "cap") + " of " + typeString(u));
+            }
+            break;
+        }
+        case IR_SLICE: {
+            const Type* u = underlying(typeOf(args[0]));
+            vector<Arg> call{ address(home(v)) };
+            int64_t elemSize = 1;
+            if (u->kind == TY_POINTER) {
+                auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY);
+                if (a == nullptr) unsupported("slicing " + typeString(u));
+                elemSize = layoutOf(a->elem).size;
+                call.push_back(value(args[0]));
+                call.push_back(immediate(a->length));
+                call.push_back(immediate(a->length));
+            }
+            else {
+                Mem s = home(args[0]);
+                if (u->kind == TY_SLICE) elemSize = layoutOf(static_cast<const SliceType*>(u)->elem).size;
+                call.push_back({ Arg::OPERAND, 0, s.str() });
+                call.push_back({ Arg::OPERAND, 0, s.plus(8).str() });
+                call.push_back({ Arg::OPERAND, 0, s.plus(u->kind == TY_SLICE ? 16 : 8).str() });
+            }
+            call.push_back(immediate(elemSize));
+            size_t next = 1;
+            for (int i = 0; i < 3; i++) call.push_back(x.aux & (1 << i) ? value(args[next++]) : immediate(0));
+            call.push_back(immediate(x.aux));
+            call.push_back(immediate(u->kind == TY_STRING));
+            callRuntime("g5_slice", call);
+            break;
+        }
+        case IR_MAKE_SLICE: {
+            int64_t size = layoutOf(static_cast<const SliceType*>(underlying(t))->elem).size;
+            callRuntime("g5_make_slice", { address(home(v)), immediate(size), value(args[0]), value(args[1]) });
+            break;
+        }
+        case IR_APPEND: {
+            const Type* elem = static_cast<const SliceType*>(underlying(t))->elem;
+            int64_t size = layoutOf(elem).size;
+            if (x.flags & V_SPREAD) {
+                Mem s = home(args[1]);
+                callRuntime("g5_append", { address(home(v)), address(home(args[0])), immediate(size),
+                    { Arg::OPERAND, 0, s.str() }, { Arg::OPERAND, 0, s.plus(8).str() } });
+                break;
+            }
+            if (args.size() == 1) {
+                copy(home(v), home(args[0]), 24);
+                break;
+            }
+            Mem elems = temp(size * int64_t(args.size() - 1));
+            for (size_t i = 1; i < args.size(); i++) storeValue(args[i], elems.plus(size * int64_t(i - 1)));
+            callRuntime("g5_append", { address(home(v)), address(home(args[0])), immediate(size), address(elems),
+                immediate(int64_t(args.size() - 1)) });
+            break;
+        }
+        case IR_COPY: {
+            int64_t size = layoutOf(static_cast<const SliceType*>(underlying(typeOf(args[0])))->elem).size;
+            callRuntime("g5_copy", { address(home(args[0])), address(home(args[1])), immediate(size) });
+            store(v, RAX);
+            break;
+        }
+        case IR_STRING_NEXT: {
+            // an ASCII byte is its own rune, the runtime decodes the others
+            Mem s = home(args[0]), out = home(v);
+            string slow = newLabel(), done = newLabel();
+            load(args[1], RCX);
+            ins("mov " + s.str() + ", %rax");
+            ins("movzbl (%rax,%rcx), %edx");
+            ins("cmp $0x80, %edx");
+            ins("jae " + slow);
+            ins("mov %edx, " + out.str());
+            ins("lea 1(%rcx), %rax");
+            ins("mov %rax, " + out.plus(8).str());
+            ins("jmp " + done);
+            label(slow);
+            callRuntime("g5_decode_rune", { address(out), address(s), value(args[1]) });
+            label(done);
+            break;
+        }
+        case IR_MAKE_MAP:
+            callRuntime("g5_make_map", { symbol(gen.typeSymbol(t)), value(args[0]) });
+            store(v, RAX);
+            break;
+        case IR_MAP_INDEX: {
+            auto* m = underlyingAs<MapType>(typeOf(args[0]), TY_MAP);
+            Mem out = classes[v] == VC_MEMORY ? home(v) : temp(8);
+            Mem key = addressOf(args[1]);
+            callRuntime("g5_map_index", { address(out), symbol(gen.typeSymbol(m)), value(args[0]), address(key),
+                immediate((x.flags & V_COMMA_OK) != 0) });
+            if (classes[v] != VC_MEMORY) loadValue(v, out);
+            break;
+        }
+        case IR_MAP_UPDATE: {
+            Mem key = addressOf(args[1]);
+            Mem value = addressOf(args[2]);
+            callRuntime("g5_map_update", { this->value(args[0]), address(key), address(value) });
+            break;
+        }
+        case IR_MAP_DELETE: {
+            Mem key = addressOf(args[1]);
+            callRuntime("g5_map_delete", { value(args[0]), address(key) });
+            break;
+        }
+        case IR_MAP_ITER:
+            callRuntime("g5_map_iter", { value(args[0]) });
+            store(v, RAX);
+            break;
+        case IR_MAP_NEXT:
+            callRuntime("g5_map_next", { address(home(v)), value(args[0]) });
+            break;
+        case IR_CALL: case IR_CALL_EXTERN: case IR_CALL_VALUE: case IR_CALL_METHOD: call(v); break;
+        case IR_PRINT: {
+            Mem array = interfaces(vector<ValueId>(args.begin(), args.end()), true);
+            callRuntime("g5_print", { immediate(x.aux), address(array), immediate(int64_t(args.size())) });
+            break;
+        }
+        case IR_RECOVER:
+            // without deferred calls nothing is ever recovered
+            zero(home(v), 16);
+            break;
+        case IR_RUN_DEFERS: unsupported("the defer statement");
+        case IR_MAKE_CHAN: case IR_SEND: case IR_RECV: case IR_CLOSE: case IR_CHOOSE: unsupported("a channel operation");
+        case IR_EXTERN: case IR_SELECT: unsupported(string(symbols.text(Symbol(x.aux))));
+        default: unsupported(opNames[x.op]);
+        }
+    }
+
+    //===--- control flow ---===//
+
+    string str(int r, int64_t slot) const { return r >= 0 ? reg(r) : Mem{ RBP, slot }.str(); }
+    // Gives the phis of block to their operands from block from, as a parallel
+    // copy: the values in memory first, then the scalars, in an order that
+    // reads every place before it is overwritten, with rax breaking cycles.
+    void phiMoves(BlockId from, BlockId to) {
+        vector<pair<ValueId, ValueId>> memory;
+        struct Move {
+            int dstReg;
+            int64_t dstSlot;
+            ValueId remat;
+            int srcReg;
+            int64_t srcSlot;
+        };
+        vector<Move> moves;
+        for (ValueId v : f.blocks[to].values) {
+            if (f.values[v].op != IR_PHI) break;
+            ValueId a = phiOperand(v, from);
+            if (a == v || classes[v] == VC_NONE) continue;
+            if (classes[v] == VC_MEMORY) {
+                memory.push_back({ v, a });
+                continue;
+            }
+            Move m{ registers[v], slots[v], 0, -1, 0 };
+            if (classes[a] == VC_REMAT) {
+                m.remat = a;
+            }
+            else {
+                if (classes[a] != VC_SCALAR) unsupported("a value of type " + typeString(typeOf(a)));
+                m.srcReg = registers[a];
+                m.srcSlot = slots[a];
+                if (m.srcReg == m.dstReg && (m.srcReg >= 0 || m.srcSlot == m.dstSlot)) continue;
+            }
+            moves.push_back(m);
+        }
+        bool shadowed = any_of(memory.begin(), memory.end(), [&](auto& p) {
+            return f.values[p.second].op == IR_PHI && f.values[p.second].block == to;
+        });
+        for (auto [v, a] : memory) copy(shadowed ? Mem{ RBP, shadows[v] } : home(v), home(a), layoutOf(typeOf(v)).size);
+        if (shadowed) {
+            for (auto [v, a] : memory) copy(home(v), Mem{ RBP, shadows[v] }, layoutOf(typeOf(v)).size);
+        }
+        auto same = [](int r, int64_t slot, int r2, int64_t slot2) { return r == r2 && (r >= 0 || slot == slot2); };
+        while (!moves.empty()) {
+            size_t ready = moves.size();
+            for (size_t i = 0; i < moves.size() && ready == moves.size(); i++) {
+                bool blocked = false;
+                for (size_t j = 0; j < moves.size(); j++) {
+                    if (j != i && moves[j].remat == 0 && same(moves[j].srcReg, moves[j].srcSlot, moves[i].dstReg, moves[i].dstSlot)) {
+                        blocked = true;
+                    }
+                }
+                if (!blocked) ready = i;
+            }
+            if (ready == moves.size()) {
+                Move& m = moves[0];
+                ins("mov " + str(m.dstReg, m.dstSlot) + ", %rax");
+                for (auto& other : moves) {
+                    if (other.remat == 0 && same(other.srcReg, other.srcSlot, m.dstReg, m.dstSlot)) {
+                        other.srcReg = RAX;
+                    }
+                }
+                continue;
+            }
+            Move m = moves[ready];
+            moves.erase(moves.begin() + ready);
+            string src = m.remat != 0 ? operand(m.remat, RDX) : str(m.srcReg, m.srcSlot), dst = str(m.dstReg, m.dstSlot);
+            if (isMemory(src) && isMemory(dst)) {
+                ins("mov " + src + ", %rdx");
+                src = "%rdx";
+            }
+            ins((src[0] == '$' ? "movq " : "mov ") + src + ", " + dst);
+        }
+    }
+    bool hasPhis(BlockId b) const {
+        return !f.blocks[b].values.empty() && f.values[f.blocks[b].values[0]].op == IR_PHI;
+    }
+    void terminator(size_t at, ValueId v) {
+        BlockId b = order[at];
+        const Value& x = f.values[v];
+        auto args = f.args(v);
+        string next = at + 1 < order.size() ? blockLabel(order[at + 1]) : "";
+        switch (x.op) {
+        case IR_JUMP: {
+            BlockId to = f.blocks[b].succs[0];
+            phiMoves(b, to);
+            if (blockLabel(to) != next) ins("jmp " + blockLabel(to));
+            break;
+        }
+        case IR_BRANCH: {
+            string targets[2];
+            for (int i = 0; i < 2; i++) {
+                BlockId to = f.blocks[b].succs[i];
+                if (hasPhis(to)) {
+                    targets[i] = newLabel();
+                    stubs.push_back({ targets[i], b, to });
+                }
+                else {
+                    targets[i] = blockLabel(to);
+                }
+            }
+            int64_t c;
+            ValueId condition = args[0];
+            if (constant(condition, c)) {
+                ins("jmp " + targets[c ? 0 : 1]);
+                break;
+            }
+            string cc = "ne";
+            if (fused[condition]) {
+                cc = compareScalars(condition);
+            }
+            else {
+                string s = operand(condition, RAX);
+                ins(isMemory(s) ? "cmpb $0, " + s : "test " + s + ", " + s);
+            }
+            if (targets[0] == next) {
+                ins("j" + inverse(cc) + " " + targets[1]);
+                break;
+            }
+            ins("j" + cc + " " + targets[0]);
+            if (targets[1] != next) ins("jmp " + targets[1]);
+            break;
+        }
+        case IR_RETURN: {
+            for (size_t i = 0; i < args.size(); i++) {
+                Mem dst{ RBP, 16 + signature.results[i] };
+                ValueId a = args[i];
+                if (classes[a] == VC_MEMORY) {
+                    copy(dst, home(a), layoutOf(typeOf(a)).size);
+                    continue;
+                }
+                string s = operand(a, RAX);
+                if (isMemory(s)) {
+                    ins("mov " + s + ", %rax");
+                    s = "%rax";
+                }
+                ins("movq " + s + ", " + dst.str());
+            }
+            for (auto [r, slot] : saved) ins("mov " + Mem{ RBP, slot }.str() + ", " + reg(r));
+            ins("leave");
+            ins("ret");
+            break;
+        }
+        default:
+            callRuntime("g5_panic", { address(home(args[0])) });
+            break;
+        }
+    }
+
+    string compile() {
+        if (f.blocks.empty()) throw runtime_error("function without body");
+        size_t n = f.values.size();
+        classes.resize(n);
+        registers.assign(n, -1);
+        slots.assign(n, 0);
+        variables.assign(n, 0);
+        shadows.assign(n, 0);
+        uses.assign(n, 0);
+        fused.assign(n, false);
+        bool closure = false;
+        for (ValueId v = 1; v < n; v++) {
+            classes[v] = classify(v);
+            for (ValueId a : f.args(v)) uses[a]++;
+            closure = closure || f.values[v].op == IR_FREE_VAR;
+        }
+        layoutBlocks();
+        for (auto& block : f.blocks) {
+            size_t count = block.values.size();
+            if (!optimize || count < 2 || f.values[block.values.back()].op != IR_BRANCH) continue;
+            ValueId c = block.values[count - 2];
+            if (f.args(block.values.back())[0] == c && uses[c] == 1 && fusable(c)) fused[c] = true;
+        }
+        if (optimize) allocate();
+        for (auto& [r, slot] : saved) slot = frameSlot(8);
+        if (closure) contextSlot = frameSlot(8);
+        for (ValueId v = 1; v < n; v++) {
+            const Value& x = f.values[v];
+            if ((classes[v] == VC_SCALAR && registers[v] < 0) || classes[v] == VC_MEMORY) {
+                if (x.op == IR_PARAM) {
+                    slots[v] = 16 + signature.params[x.aux];
+                }
+                else if ((x.op != IR_STRING && x.op != IR_ZERO) || classes[v] == VC_SCALAR) {
+                    slots[v] = frameSlot(classes[v] == VC_MEMORY ? layoutOf(x.type).size : 8);
+                }
+                if (x.op == IR_PHI && classes[v] == VC_MEMORY) shadows[v] = frameSlot(layoutOf(x.type).size);
+            }
+            if (x.op == IR_ALLOC && !(x.flags & V_HEAP)) {
+                variables[v] = frameSlot(layoutOf(static_cast<const PointerType*>(underlying(x.type))->base).size);
+            }
+            auto args = f.args(v);
+            if (x.op == IR_CALL && !(x.flags & (V_GO | V_DEFER))) {
+                const Function& callee = module.functions[x.aux];
+                outgoing = max(outgoing, Signature(callee.receiver, callee.type).size);
+            }
+            else if (x.op == IR_CALL_VALUE) {
+                if (auto* type = underlyingAs<FuncType>(typeOf(args[0]), TY_FUNC)) outgoing = max(outgoing, Signature(nullptr, type).size);
+            }
+            else if (x.op == IR_CALL_METHOD) {
+                if (auto* iface = underlyingAs<InterfaceType>(typeOf(args[0]), TY_INTERFACE)) {
+                    complete(iface);
+                    outgoing = max(outgoing, Signature(basicType(TY_UNSAFE_POINTER), iface->methods[x.aux].type).size);
+                }
+            }
+        }
+        tempBase = frameSize;
+        for (size_t at = 0; at < order.size(); at++) {
+            BlockId b = order[at];
+            label(blockLabel(b));
+            for (ValueId v : f.blocks[b].values) {
+                tempCursor = 0;
+                if (isTerminator(f.values[v].op)) {
+                    terminator(at, v);
+                }
+                else {
+                    instruction(v);
+                }
+            }
+        }
+        for (size_t i = 0; i < stubs.size(); i++) {
+            label(stubs[i].label);
+            tempCursor = 0;
+            phiMoves(stubs[i].from, stubs[i].to);
+            ins("jmp " + blockLabel(stubs[i].to));
+        }
+        if (boundsUsed) {
+            label(prefix + "bounds");
+            ins("mov %rcx, %rdi");
+            ins("mov %rdx, %rsi");
+            ins("call g5_panic_index@PLT");
+        }
+        if (divideUsed) {
+            label(prefix + "divide");
+            ins("call g5_panic_divide@PLT");
+        }
+        string body = move(out);
+        string symbol = gen.functionSymbol(index);
+        out = "\n\t.p2align 4\n\t.type " + symbol + ", @function\n" + symbol + ":\n";
+        ins("push %rbp");
+        ins("mov %rsp, %rbp");
+        int64_t frame = (tempBase + tempMax + outgoing + 15) & ~int64_t(15);
+        if (frame != 0) ins("sub $" + to_string(frame) + ", %rsp");
+        for (auto [r, slot] : saved) ins("mov " + reg(r) + ", " + Mem{ RBP, slot }.str());
+        if (closure) ins("mov %rax, " + Mem{ RBP, contextSlot }.str());
+        return out + body;
+    }
+};
+
+void CodeGenerator::emitType(uint32_t id) {
+    const Type* t = types[id];
+    const Type* u = underlying(t);
+    int kind = 0;
+    switch (u->kind) {
+    case TY_BOOL: kind = 1; break;
+    case TY_FLOAT32: case TY_FLOAT64: kind = 4; break;
+    case TY_STRING: kind = 5; break;
+    case TY_POINTER: case TY_UNSAFE_POINTER: kind = 6; break;
+    case TY_SLICE: kind = 7; break;
+    case TY_ARRAY: kind = 8; break;
+    case TY_STRUCT: kind = 9; break;
+    case TY_MAP: kind = 10; break;
+    case TY_CHAN: kind = 11; break;
+    case TY_FUNC: kind = 12; break;
+    case TY_INTERFACE: kind = 13; break;
+    case TY_TUPLE: kind = 14; break;
+    default: kind = isInteger(u->kind) ? isUnsigned(u->kind) ? 3 : 2 : 0; break;
+    }
+    string elem = "0", key = "0", fields = "0", methods = "0";
+    int64_t length = 0;
+    switch (u->kind) {
+    case TY_POINTER: elem = typeSymbol(static_cast<const PointerType*>(u)->base); break;
+    case TY_SLICE: elem = typeSymbol(static_cast<const SliceType*>(u)->elem); break;
+    case TY_CHAN: elem = typeSymbol(static_cast<const ChanType*>(u)->elem); break;
+    case TY_ARRAY:
+        elem = typeSymbol(static_cast<const ArrayType*>(u)->elem);
+        length = static_cast<const ArrayType*>(u)->length;
+        break;
+    case TY_MAP:
+        key = typeSymbol(static_cast<const MapType*>(u)->key);
+        elem = typeSymbol(static_cast<const MapType*>(u)->elem);
+        break;
+    case TY_STRUCT: {
+        auto* s = static_cast<const StructType*>(u);
+        length = int64_t(s->fields.size());
+        string table;
+        for (size_t i = 0; i < s->fields.size(); i++) {
+            string name(symbols.text(s->fields[i].name));
+            table += "\t.quad " + typeSymbol(s->fields[i].type) + ", " + to_string(fieldOffset(s, i)) + ", " +
+                bytesSymbol(name) + ", " + to_string(name.size()) + "\n";
+        }
+        if (!table.empty()) {
+            fields = "go..type." + to_string(id) + ".fields";
+            data += "\t.balign 8\n" + fields + ":\n" + table;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    // the methods interface values of t call, or those an interface type asks
+    // for, sorted by name
+    vector<pair<string, string>> entries;
+    // and the one fmt calls
+    const Object* formatter = nullptr;
+    string format = "0";
+    auto methodsOf = [&](const NamedType* named, bool pointer) {
+        for (Object* m : named->methods) {
+            auto f = module.functionIndex.find(m);
+            if (f == module.functionIndex.end()) continue;
+            if (m->pointerReceiver && !pointer) continue;
+            string fn = m->pointerReceiver || (!pointer && isPointerShaped(named)) ? functionSymbol(f->second) :
+                wrapperSymbol(f->second);
+            entries.push_back({ string(symbols.text(m->name)), fn });
+            if (isFormatMethod(m) && (formatter == nullptr || symbols.text(m->name) == "Error")) {
+                formatter = m;
+                format = fn;
+            }
+        }
+    };
+    if (t->kind == TY_NAMED && u->kind != TY_INTERFACE) methodsOf(static_cast<const NamedType*>(t), false);
+    if (u->kind == TY_POINTER) {
+        const Type* base = static_cast<const PointerType*>(u)->base;
+        if (base->kind == TY_NAMED && kindOf(base) != TY_INTERFACE && kindOf(base) != TY_POINTER) {
+            methodsOf(static_cast<const NamedType*>(base), true);
+        }
+    }
+    if (u->kind == TY_INTERFACE) {
+        auto* iface = static_cast<const InterfaceType*>(u);
+        complete(iface);
+        for (auto& m : iface->methods) entries.push_back({ string(symbols.text(m.name)), "0" });
+    }
+    sort(entries.begin(), entries.end());
+    if (!entries.empty()) {
+        methods = "go..type." + to_string(id) + ".methods";
+        data += "\t.balign 8\n" + methods + ":\n";
+        for (auto& [name, fn] : entries) {
+            data += "\t.quad " + bytesSymbol(name) + ", " + to_string(name.size()) + ", " + fn + "\n";
+        }
+    }
+    string name = typeString(t);
+    data += "\t.balign 8\ngo..type." + to_string(id) + ":\n\t.quad " + to_string(kind) + ", " +
+        to_string(layoutOf(t).size) + ", " + bytesSymbol(name) + ", " + to_string(name.size()) + ", " + elem + ", " +
+        key + ", " + to_string(length) + ", " + fields + ", " + methods + ", " + to_string(entries.size()) + ", " + format +
+        "\n";
+}
+
+// The value method f called with a pointer to its receiver: the receiver is
+// copied from where it points to, the arguments and results moved along.
+void CodeGenerator::emitWrapper(uint32_t f) {
+    const Function& fn = module.functions[f];
+    Signature inner(fn.receiver, fn.type);
+    int64_t receiver = align8(layoutOf(fn.receiver).size), rest = inner.argsSize - receiver;
+    AsmWriter w;
+    string symbol = wrapperSymbol(f);
+    w.out = "\n\t.p2align 4\n\t.type " + symbol + ", @function\n" + symbol + ":\n";
+    w.ins("push %rbp");
+    w.ins("mov %rsp, %rbp");
+    w.ins("sub $" + to_string((inner.size + 15) & ~int64_t(15)) + ", %rsp");
+    w.ins("mov 16(%rbp), %rcx");
+    w.copy(Mem{ RSP }, Mem{ RCX }, layoutOf(fn.receiver).size);
+    w.copy(Mem{ RSP, receiver }, Mem{ RBP, 24 }, rest);
+    w.ins("call " + functionSymbol(f));
+    w.copy(Mem{ RBP, 24 + rest }, Mem{ RSP, inner.argsSize }, inner.size - inner.argsSize);
+    w.ins("leave");
+    w.ins("ret");
+    text += w.out;
+}
+
+string CodeGenerator::generate() {
+    if (module.entry == UINT32_MAX) throw runtime_error("function main is undeclared in the main package");
+    AsmWriter entry;
+    entry.out = "\n\t.globl g5_entry\n\t.p2align 4\n\t.type g5_entry, @function\ng5_entry:\n";
+    entry.ins("push %rbp");
+    entry.ins("mov %rsp, %rbp");
+    for (uint32_t init : module.inits) entry.ins("call " + functionSymbol(init));
+    entry.ins("call " + functionSymbol(module.entry));
+    entry.ins("pop %rbp");
+    entry.ins("ret");
+    // g5_call_method(fn, data, out) calls the method fn of an interface
+    // holding data, one returning a string to out, for the runtime
+    entry.out += "\n\t.globl g5_call_method\n\t.p2align 4\n\t.type g5_call_method, @function\ng5_call_method:\n";
+    entry.ins("push %rbp");
+    entry.ins("mov %rsp, %rbp");
+    entry.ins("push %rdx");
+    entry.ins("sub $24, %rsp");
+    entry.ins("mov %rsi, (%rsp)");
+    entry.ins("call *%rdi");
+    entry.ins("mov -8(%rbp), %rdx");
+    entry.copy(Mem{ RDX }, Mem{ RSP, 8 }, 16);
+    entry.ins("leave");
+    entry.ins("ret");
+    size_t typesDone = 0, wrappersDone = 0;
+    while (!pending.empty() || typesDone < types.size() || wrappersDone < wrappers.size()) {
+        if (!pending.empty()) {
+            uint32_t f = pending.back();
+            pending.pop_back();
+            try {
+                text += FunctionCompiler(*this, f).compile();
+            }
+            catch (const runtime_error& e) {
+                errors.push_back(module.functions[f].name + ": " + e.what());
+            }
+        }
+        else if (typesDone < types.size()) {
+            emitType(uint32_t(typesDone++));
+        }
+        else {
+            emitWrapper(wrappers[wrappersDone++]);
+        }
+    }
+    if (!errors.empty()) {
+        string message;
+        for (auto& error : errors) message += (message.empty() ? "" : "\n") + error;
+        throw runtime_error(message);
+    }
+    for (uint32_t f = 0; f < module.functions.size(); f++) {
+        if (referenced[f]) data += "\t.balign 8\n" + functionSymbol(f) + "..f:\n\t.quad " + functionSymbol(f) + "\n";
+    }
+    string bss = "\t.balign 16\ngo..zero:\n\t.zero " + to_string(zeroSize) + "\n";
+    for (auto& global : module.globals) {
+        bss += "\t.balign 8\n" + symbolName(global.name) + ":\n\t.zero " + to_string(max<int64_t>(layoutOf(global.type).size, 1)) + "\n";
+    }
+    return "\t.text" + text + entry.out + "\n\t.section .rodata\n" + rodata + "\n\t.data\n" + data + "\n\t.bss\n" + bss +
+        "\n\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+// The assembly of the functions the entry of module reaches. Without optimize
+// every value lives in the frame, there is no immediate operand nor a branch
+// on the flags of a comparison.
+string assembly(const Module& module, bool optimize) {
+    return CodeGenerator(module, optimize).generate();
+}
+
+// The runtime native programs link with, compiled along with their assembly.
+const char* nativeRuntime = R"runtime(
+// The runtime native programs are linked with. Generated code calls it with
+// the C calling convention, aggregates by address and results through out.
+#include <ctype.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    K_BOOL = 1, K_INT, K_UINT, K_FLOAT, K_STRING, K_POINTER, K_SLICE, K_ARRAY, K_STRUCT,
+    K_MAP, K_CHAN, K_FUNC, K_INTERFACE, K_TUPLE
+};
+typedef struct Type Type;
+typedef struct { const char* name; int64_t length; void* fn; } Method;
+typedef struct { const Type* type; int64_t offset; const char* name; int64_t nameLength; } Field;
+struct Type {
+    int64_t kind, size;
+    const char* name;
+    int64_t nameLength;
+    const Type* elem;
+    const Type* key;
+    // of an array, or the number of fields
+    int64_t length;
+    const Field* fields;
+    const Method* methods;
+    int64_t methodCount;
+    // the Error or else String method fmt formats values with
+    void* format;
+};
+typedef struct { const char* ptr; int64_t len; } String;
+typedef struct { char* ptr; int64_t len, cap; } Slice;
+typedef struct { const Type* type; void* data; } Interface;
+
+static void fail(const char* format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+static void fail(const char* format, ...) {
+    fflush(stdout);
+    va_list args;
+    va_start(args, format);
+    fputs("panic: ", stderr);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputs("\n", stderr);
+    exit(2);
+}
+
+void* g5_alloc(int64_t size) {
+    void* p = calloc(1, size > 0 ? size : 1);
+    if (p == NULL) fail("out of memory");
+    return p;
+}
+void* g5_box(int64_t size, const void* value) {
+    void* p = g5_alloc(size);
+    memcpy(p, value, size);
+    return p;
+}
+static int pointerShaped(const Type* t) {
+    return t->kind == K_POINTER || t->kind == K_MAP || t->kind == K_CHAN || t->kind == K_FUNC;
+}
+// The address of the value an interface holds.
+static const void* valueOf(const Interface* i) { return pointerShaped(i->type) ? (const void*)&i->data : i->data; }
+
+//===--- strings ---===//
+
+void g5_concat(String* out, const String* a, const String* b) {
+    if (a->len == 0 || b->len == 0) {
+        *out = a->len == 0 ? *b : *a;
+        return;
+    }
+    char* p = g5_alloc(a->len + b->len);
+    memcpy(p, a->ptr, a->len);
+    memcpy(p + a->len, b->ptr, b->len);
+    out->ptr = p;
+    out->len = a->len + b->len;
+}
+int64_t g5_string_compare(const String* a, const String* b) {
+    int c = memcmp(a->ptr, b->ptr, a->len < b->len ? a->len : b->len);
+    if (c != 0) return c < 0 ? -1 : 1;
+    return a->len < b->len ? -1 : a->len > b->len;
+}
+static int encodeRune(char* p, int32_t r) {
+    uint32_t c = (uint32_t)r;
+    if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) c = 0xfffd;
+    if (c < 0x80) {
+        p[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        p[0] = (char)(0xc0 | c >> 6);
+        p[1] = (char)(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000) {
+        p[0] = (char)(0xe0 | c >> 12);
+        p[1] = (char)(0x80 | (c >> 6 & 0x3f));
+        p[2] = (char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    p[0] = (char)(0xf0 | c >> 18);
+    p[1] = (char)(0x80 | (c >> 12 & 0x3f));
+    p[2] = (char)(0x80 | (c >> 6 & 0x3f));
+    p[3] = (char)(0x80 | (c & 0x3f));
+    return 4;
+}
+// The rune at p and its length in bytes, U+FFFD and 1 when it is not valid.
+static int32_t decodeRune(const unsigned char* p, int64_t n, int* size) {
+    *size = 1;
+    if (p[0] < 0x80) return p[0];
+    int length = p[0] >= 0xf0 ? 4 : p[0] >= 0xe0 ? 3 : p[0] >= 0xc0 ? 2 : 0;
+    if (length == 0 || length > n || p[0] > 0xf4) return 0xfffd;
+    int32_t r = p[0] & (0x7f >> length);
+    for (int i = 1; i < length; i++) {
+        if ((p[i] & 0xc0) != 0x80) return 0xfffd;
+        r = r << 6 | (p[i] & 0x3f);
+    }
+    static const int32_t least[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (r < least[length] || (r >= 0xd800 && r <= 0xdfff) || r > 0x10ffff) return 0xfffd;
+    *size = length;
+    return r;
+}
+void g5_decode_rune(int64_t* out, const String* s, int64_t i) {
+    int size;
+    int32_t r = decodeRune((const unsigned char*)s->ptr + i, s->len - i, &size);
+    memcpy(out, &r, sizeof r);
+    out[1] = i + size;
+}
+void g5_string_from_rune(String* out, int64_t r) {
+    char* p = g5_alloc(4);
+    out->len = encodeRune(p, r != (int32_t)r ? 0xfffd : (int32_t)r);
+    out->ptr = p;
+}
+void g5_string_from_bytes(String* out, const Slice* s) {
+    char* p = g5_alloc(s->len);
+    memcpy(p, s->ptr, s->len);
+    out->ptr = p;
+    out->len = s->len;
+}
+void g5_bytes_from_string(Slice* out, const String* s) {
+    out->ptr = g5_alloc(s->len);
+    memcpy(out->ptr, s->ptr, s->len);
+    out->len = out->cap = s->len;
+}
+void g5_string_from_runes(String* out, const Slice* s) {
+    char* p = g5_alloc(s->len * 4);
+    int64_t n = 0;
+    for (int64_t i = 0; i < s->len; i++) n += encodeRune(p + n, ((int32_t*)s->ptr)[i]);
+    out->ptr = p;
+    out->len = n;
+}
+void g5_runes_from_string(Slice* out, const String* s) {
+    int32_t* p = g5_alloc(s->len * 4);
+    int64_t n = 0;
+    for (int64_t i = 0; i < s->len; n++) {
+        int size;
+        p[n] = decodeRune((const unsigned char*)s->ptr + i, s->len - i, &size);
+        i += size;
+    }
+    out->ptr = (char*)p;
+    out->len = out->cap = n;
+}
+
+//===--- slices ---===//
+
+// s[lo:hi:max] of a slice, an array or, when string is set, of a string, the
+// bits of mask telling which indices are given.
+void g5_slice(Slice* out, char* ptr, int64_t len, int64_t cap, int64_t elemSize, int64_t lo, int64_t hi,
+    int64_t max, int64_t mask, int64_t string) {
+    if (!(mask & 1)) lo = 0;
+    if (!(mask & 2)) hi = len;
+    if (!(mask & 4)) max = cap;
+    if (string ? (uint64_t)hi > (uint64_t)len : (uint64_t)max > (uint64_t)cap || (uint64_t)hi > (uint64_t)max) {
+        fail("runtime error: slice bounds out of range [:%lld] with capacity %lld", (long long)hi, (long long)cap);
+    }
+    if ((uint64_t)lo > (uint64_t)hi) fail("runtime error: slice bounds out of range [%lld:%lld]", (long long)lo, (long long)hi);
+    out->ptr = ptr + lo * elemSize;
+    out->len = hi - lo;
+    if (!string) out->cap = max - lo;
+}
+void g5_make_slice(Slice* out, int64_t elemSize, int64_t len, int64_t cap) {
+    if (len < 0 || len > cap) fail("runtime error: makeslice: len out of range");
+    out->ptr = g5_alloc(cap * elemSize);
+    out->len = len;
+    out->cap = cap;
+}
+void g5_append(Slice* out, const Slice* s, int64_t elemSize, const char* elems, int64_t count) {
+    Slice r = *s;
+    if (r.len + count > r.cap) {
+        int64_t cap = r.cap < 256 ? r.cap * 2 : r.cap + r.cap / 4;
+        if (cap < r.len + count) cap = r.len + count;
+        char* p = g5_alloc(cap * elemSize);
+        memcpy(p, r.ptr, r.len * elemSize);
+        r.ptr = p;
+        r.cap = cap;
+    }
+    memmove(r.ptr + r.len * elemSize, elems, count * elemSize);
+    r.len += count;
+    *out = r;
+}
+int64_t g5_copy(const Slice* dst, const Slice* src, int64_t elemSize) {
+    int64_t n = dst->len < src->len ? dst->len : src->len;
+    memmove(dst->ptr, src->ptr, n * elemSize);
+    return n;
+}
+
+//===--- equality and hashing ---===//
+
+int64_t g5_equal(const Type* t, const void* a, const void* b);
+int64_t g5_interface_equal(const Interface* a, const Interface* b) {
+    if (a->type != b->type) return 0;
+    if (a->type == NULL) return 1;
+    if (a->type->kind == K_SLICE || a->type->kind == K_MAP || a->type->kind == K_FUNC) {
+        fail("runtime error: comparing uncomparable type %.*s", (int)a->type->nameLength, a->type->name);
+    }
+    return g5_equal(a->type, valueOf(a), valueOf(b));
+}
+int64_t g5_equal(const Type* t, const void* a, const void* b) {
+    switch (t->kind) {
+    case K_FLOAT:
+        return t->size == 4 ? *(const float*)a == *(const float*)b : *(const double*)a == *(const double*)b;
+    case K_STRING: {
+        const String *x = a, *y = b;
+        return x->len == y->len && memcmp(x->ptr, y->ptr, x->len) == 0;
+    }
+    case K_INTERFACE: return g5_interface_equal(a, b);
+    case K_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) {
+            if (!g5_equal(t->elem, (const char*)a + i * t->elem->size, (const char*)b + i * t->elem->size)) return 0;
+        }
+        return 1;
+    case K_STRUCT:
+        for (int64_t i = 0; i < t->length; i++) {
+            const Field* f = &t->fields[i];
+            if (!g5_equal(f->type, (const char*)a + f->offset, (const char*)b + f->offset)) return 0;
+        }
+        return 1;
+    default:
+        return memcmp(a, b, t->size) == 0;
+    }
+}
+static uint64_t hashBytes(uint64_t h, const void* p, int64_t n) {
+    for (int64_t i = 0; i < n; i++) h = (h ^ ((const unsigned char*)p)[i]) * 0x100000001b3ull;
+    return h;
+}
+static uint64_t hashOf(const Type* t, const void* p, uint64_t h) {
+    switch (t->kind) {
+    case K_FLOAT: {
+        double d = t->size == 4 ? *(const float*)p : *(const double*)p;
+        if (d == 0) d = 0;
+        return hashBytes(h, &d, sizeof d);
+    }
+    case K_STRING: return hashBytes(h, ((const String*)p)->ptr, ((const String*)p)->len);
+    case K_INTERFACE: {
+        const Interface* i = p;
+        return i->type == NULL ? h : hashOf(i->type, valueOf(i), hashBytes(h, &i->type, sizeof i->type));
+    }
+    case K_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) h = hashOf(t->elem, (const char*)p + i * t->elem->size, h);
+        return h;
+    case K_STRUCT:
+        for (int64_t i = 0; i < t->length; i++) h = hashOf(t->fields[i].type, (const char*)p + t->fields[i].offset, h);
+        return h;
+    default:
+        return hashBytes(h, p, t->size);
+    }
+}
+
+//===--- maps ---===//
+
+// Open addressing with linear probing, entries kept in insertion order in a
+// separate array so iteration and growth need not rehash the slots.
+typedef struct {
+    const Type* type;
+    int64_t count, used, capacity;
+    // entry index + 1 by slot, 0 for free
+    int64_t* slots;
+    // a live flag, the key and the value of each entry, each at a multiple of 8
+    char* entries;
+    int64_t entrySize, valueOffset;
+} Map;
+static int64_t align8(int64_t n) { return (n + 7) & ~7; }
+static char* entryAt(const Map* m, int64_t i) { return m->entries + i * m->entrySize; }
+void* g5_make_map(const Type* type, int64_t hint) {
+    Map* m = g5_alloc(sizeof(Map));
+    m->type = type;
+    m->valueOffset = 8 + align8(type->key->size);
+    m->entrySize = m->valueOffset + align8(type->elem->size);
+    m->capacity = 8;
+    while (m->capacity < hint * 2) m->capacity *= 2;
+    m->slots = g5_alloc(m->capacity * sizeof(int64_t));
+    m->entries = g5_alloc(m->capacity / 2 * m->entrySize);
+    return m;
+}
+int64_t g5_map_len(const Map* m) { return m == NULL ? 0 : m->count; }
+// The slot of key, or of the free one it would go to.
+static int64_t find(const Map* m, const void* key) {
+    const Type* k = m->type->key;
+    uint64_t mask = m->capacity - 1, i = hashOf(k, key, 0xcbf29ce484222325ull) & mask;
+    for (;; i = (i + 1) & mask) {
+        int64_t e = m->slots[i];
+        if (e == 0) return i;
+        char* entry = entryAt(m, e - 1);
+        if (*(int64_t*)entry && g5_equal(k, entry + 8, key)) return i;
+    }
+}
+static void grow(Map* m) {
+    Map old = *m;
+    m->capacity *= 2;
+    m->slots = g5_alloc(m->capacity * sizeof(int64_t));
+    m->entries = g5_alloc(m->capacity / 2 * m->entrySize);
+    m->used = 0;
+    for (int64_t i = 0; i < old.used; i++) {
+        char* entry = entryAt(&old, i);
+        if (!*(int64_t*)entry) continue;
+        memcpy(entryAt(m, m->used), entry, m->entrySize);
+        m->slots[find(m, entry + 8)] = ++m->used;
+    }
+    free(old.slots);
+    free(old.entries);
+}
+void g5_map_index(char* out, const Type* type, const Map* m, const void* key, int64_t commaOk) {
+    const char* value = NULL;
+    if (m != NULL && m->count != 0) {
+        int64_t e = m->slots[find(m, key)];
+        if (e != 0) value = entryAt(m, e - 1) + m->valueOffset;
+    }
+    if (value != NULL) {
+        memcpy(out, value, type->elem->size);
+    }
+    else {
+        memset(out, 0, type->elem->size);
+    }
+    if (commaOk) out[align8(type->elem->size)] = value != NULL;
+}
+void g5_map_update(Map* m, const void* key, const void* value) {
+    if (m == NULL) fail("assignment to entry in nil map");
+    int64_t slot = find(m, key);
+    if (m->slots[slot] == 0) {
+        if (m->used + 1 > m->capacity / 2) {
+            grow(m);
+            slot = find(m, key);
+        }
+        char* entry = entryAt(m, m->used);
+        *(int64_t*)entry = 1;
+        memcpy(entry + 8, key, m->type->key->size);
+        m->slots[slot] = ++m->used;
+        m->count++;
+    }
+    memcpy(entryAt(m, m->slots[slot] - 1) + m->valueOffset, value, m->type->elem->size);
+}
+void g5_map_delete(Map* m, const void* key) {
+    if (m == NULL || m->count == 0) return;
+    int64_t slot = find(m, key);
+    if (m->slots[slot] == 0) return;
+    // the entry stays as a tombstone, its slot keeps probing chains intact
+    *(int64_t*)entryAt(m, m->slots[slot] - 1) = 0;
+    m->count--;
+}
+typedef struct { Map* map; int64_t next; } Iterator;
+void* g5_map_iter(Map* m) {
+    Iterator* it = g5_alloc(sizeof(Iterator));
+    it->map = m;
+    return it;
+}
+// The tuple of whether there is a next entry, its key and its value.
+void g5_map_next(char* out, Iterator* it) {
+    Map* m = it->map;
+    while (m != NULL && it->next < m->used) {
+        char* entry = entryAt(m, it->next++);
+        if (!*(int64_t*)entry) continue;
+        out[0] = 1;
+        memcpy(out + 8, entry + 8, m->entrySize - 8);
+        return;
+    }
+    out[0] = 0;
+}
+
+//===--- interfaces and closures ---===//
+
+void* g5_make_closure(void* fn, int64_t count, void* const* captured) {
+    void** c = g5_alloc((count + 1) * sizeof(void*));
+    c[0] = fn;
+    memcpy(c + 1, captured, count * sizeof(void*));
+    return c;
+}
+static const Method* lookup(const Type* t, const char* name, int64_t length) {
+    int64_t lo = 0, hi = t->methodCount;
+    while (lo < hi) {
+        int64_t mid = (lo + hi) / 2;
+        const Method* m = &t->methods[mid];
+        int c = memcmp(m->name, name, m->length < length ? m->length : length);
+        if (c == 0) c = m->length < length ? -1 : m->length > length;
+        if (c == 0) return m;
+        if (c < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+void* g5_find_method(const Interface* i, const char* name, int64_t length) {
+    if (i->type == NULL) fail("runtime error: invalid memory address or nil pointer dereference");
+    const Method* m = lookup(i->type, name, length);
+    if (m == NULL) fail("method %.*s not found", (int)length, name);
+    return m->fn;
+}
+void g5_panic_assert(const Type* have, const Type* want) {
+    if (have == NULL) fail("interface conversion: interface is nil, not %.*s", (int)want->nameLength, want->name);
+    fail("interface conversion: interface {} is %.*s, not %.*s", (int)have->nameLength, have->name,
+        (int)want->nameLength, want->name);
+}
+// x.(I) for an interface type I, out being an Interface or a tuple of it and
+// whether x implements I.
+void g5_assert_interface(Interface* out, const Interface* x, const Type* want, int64_t commaOk) {
+    int ok = x->type != NULL;
+    const char* missing = NULL;
+    for (int64_t i = 0; ok && i < want->methodCount; i++) {
+        if (lookup(x->type, want->methods[i].name, want->methods[i].length) == NULL) {
+            ok = 0;
+            missing = want->methods[i].name;
+        }
+    }
+    if (!ok && !commaOk) {
+        if (missing == NULL) g5_panic_assert(x->type, want);
+        fail("interface conversion: %.*s is not %.*s: missing method %s", (int)x->type->nameLength, x->type->name,
+            (int)want->nameLength, want->name, missing);
+    }
+    out[0] = ok ? *x : (Interface){ NULL, NULL };
+    if (commaOk) *(int64_t*)&out[1] = ok;
+}
+
+//===--- printing ---===//
+
+typedef struct {
+    char* p;
+    int64_t length, capacity;
+} Buffer;
+static void put(Buffer* b, const char* s, int64_t n) {
+    if (b->length + n > b->capacity) {
+        b->capacity = b->capacity * 2 + n;
+        b->p = realloc(b->p, b->capacity);
+        if (b->p == NULL) fail("out of memory");
+    }
+    memcpy(b->p + b->length, s, n);
+    b->length += n;
+}
+static void putText(Buffer* b, const char* s) { put(b, s, strlen(s)); }
+static void putFormat(Buffer* b, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void putFormat(Buffer* b, const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof text, format, args);
+    va_end(args);
+    put(b, text, n < (int)sizeof text ? n : (int)sizeof text - 1);
+}
+static int64_t intOf(const Type* t, const void* p) {
+    switch (t->size) {
+    case 1: return t->kind == K_INT ? (int64_t)*(const int8_t*)p : (int64_t)*(const uint8_t*)p;
+    case 2: return t->kind == K_INT ? (int64_t)*(const int16_t*)p : (int64_t)*(const uint16_t*)p;
+    case 4: return t->kind == K_INT ? (int64_t)*(const int32_t*)p : (int64_t)*(const uint32_t*)p;
+    default: return *(const int64_t*)p;
+    }
+}
+// The shortest decimal form of d that reads back as the same float of the
+// given size, formatted as %v does.
+static void writeFloat(Buffer* b, double d, int64_t size) {
+    if (isnan(d)) {
+        putText(b, "NaN");
+        return;
+    }
+    if (isinf(d)) {
+        putText(b, d > 0 ? "+Inf" : "-Inf");
+        return;
+    }
+    char digits[40];
+    int precision = 1;
+    for (; precision < 17; precision++) {
+        snprintf(digits, sizeof digits, "%.*e", precision - 1, d);
+        double back = strtod(digits, NULL);
+        if (size == 4 ? (float)back == (float)d : back == d) break;
+    }
+    snprintf(digits, sizeof digits, "%.*e", precision - 1, d);
+    int exponent = atoi(strchr(digits, 'e') + 1);
+    if (exponent < -4 || exponent >= 6) {
+        // Go drops trailing zeros of the mantissa, which %e never has here
+        putText(b, digits);
+        return;
+    }
+    int decimals = precision - 1 - exponent;
+    putFormat(b, "%.*f", decimals > 0 ? decimals : 0, d);
+}
+// The order fmt prints the keys of maps in: false before true, numbers and
+// strings ascending, NaN first, pointers by address, and arrays, structs and
+// interfaces element by element, interfaces by their type first.
+static int compareKeys(const Type* t, const void* a, const void* b) {
+    switch (t->kind) {
+    case K_BOOL: return *(const char*)a - *(const char*)b;
+    case K_INT: {
+        int64_t x = intOf(t, a), y = intOf(t, b);
+        return x < y ? -1 : x > y;
+    }
+    case K_UINT: {
+        uint64_t x = intOf(t, a), y = intOf(t, b);
+        return x < y ? -1 : x > y;
+    }
+    case K_FLOAT: {
+        double x = t->size == 4 ? *(const float*)a : *(const double*)a;
+        double y = t->size == 4 ? *(const float*)b : *(const double*)b;
+        if (isnan(x) || isnan(y)) return !isnan(x) - !isnan(y);
+        return x < y ? -1 : x > y;
+    }
+    case K_STRING: {
+        const String* x = a;
+        const String* y = b;
+        int c = memcmp(x->ptr, y->ptr, x->len < y->len ? x->len : y->len);
+        return c != 0 ? c : x->len < y->len ? -1 : x->len > y->len;
+    }
+    case K_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) {
+            int c = compareKeys(t->elem, (const char*)a + i * t->elem->size, (const char*)b + i * t->elem->size);
+            if (c != 0) return c;
+        }
+        return 0;
+    case K_STRUCT:
+        for (int64_t i = 0; i < t->length; i++) {
+            const Field* f = &t->fields[i];
+            int c = compareKeys(f->type, (const char*)a + f->offset, (const char*)b + f->offset);
+            if (c != 0) return c;
+        }
+        return 0;
+    case K_INTERFACE: {
+        const Interface* x = a;
+        const Interface* y = b;
+        if (x->type == NULL || y->type == NULL) return (x->type != NULL) - (y->type != NULL);
+        if (x->type != y->type) return (uintptr_t)x->type < (uintptr_t)y->type ? -1 : 1;
+        return compareKeys(x->type, valueOf(x), valueOf(y));
+    }
+    default: {
+        uintptr_t x = *(const uintptr_t*)a, y = *(const uintptr_t*)b;
+        return x < y ? -1 : x > y;
+    }
+    }
+}
+// the key type of the map whose entries are being sorted
+static const Type* sortedKey;
+static int compareEntries(const void* a, const void* b) {
+    return compareKeys(sortedKey, *(const char* const*)a + 8, *(const char* const*)b + 8);
+}
+static void writeString(Buffer* b, const String* s, int verb) {
+    if (verb == 'q') {
+        putText(b, "\"");
+        for (int64_t i = 0; i < s->len; i++) {
+            unsigned char c = s->ptr[i];
+            if (c == '"' || c == '\\') {
+                putFormat(b, "\\%c", c);
+            }
+            else if (c == '\n') {
+                putText(b, "\\n");
+            }
+            else if (c < 0x20) {
+                putFormat(b, "\\x%02x", c);
+            }
+            else {
+                put(b, (const char*)&c, 1);
+            }
+        }
+        putText(b, "\"");
+    }
+    else if (verb == 'x' || verb == 'X') {
+        for (int64_t i = 0; i < s->len; i++) putFormat(b, verb == 'x' ? "%02x" : "%02X", (unsigned char)s->ptr[i]);
+    }
+    else {
+        put(b, s->ptr, s->len);
+    }
+}
+void g5_call_method(void* fn, const void* data, String* out);
+static void writeValue(Buffer* b, const Type* t, const void* p, int verb, int methods);
+static void writeInterface(Buffer* b, const Interface* i, int verb, int methods) {
+    if (i->type == NULL) {
+        putText(b, "<nil>");
+        return;
+    }
+    writeValue(b, i->type, valueOf(i), verb, methods);
+}
+// Writes the value at p like fmt does for %v, or %d, %s, %x, %c, %q, %t, and
+// for %+v when verb is 'F'. With methods, a value whose type has an Error or
+// String method is written as what it returns, unless it is a nil pointer;
+// fmt cannot call those of unexported fields.
+static void writeValue(Buffer* b, const Type* t, const void* p, int verb, int methods) {
+    if (methods && t->format != NULL && strchr("vsqxXF", verb) != NULL &&
+        !(pointerShaped(t) && *(void* const*)p == NULL)) {
+        String s;
+        g5_call_method(t->format, pointerShaped(t) ? *(void* const*)p : p, &s);
+        writeString(b, &s, verb);
+        return;
+    }
+    switch (t->kind) {
+    case K_BOOL: putText(b, *(const char*)p ? "true" : "false"); break;
+    case K_INT: case K_UINT: {
+        int64_t v = intOf(t, p);
+        if (verb == 'c') {
+            char rune[4];
+            put(b, rune, encodeRune(rune, (int32_t)v));
+        }
+        else if (verb == 'x') {
+            if (t->kind == K_INT && v < 0) {
+                putFormat(b, "-%llx", (unsigned long long)-v);
+            }
+            else {
+                putFormat(b, "%llx", (unsigned long long)v);
+            }
+        }
+        else if (verb == 'q') {
+            char rune[4];
+            putText(b, "'");
+            put(b, rune, encodeRune(rune, (int32_t)v));
+            putText(b, "'");
+        }
+        else {
+            putFormat(b, t->kind == K_INT ? "%lld" : "%llu", (long long)v);
+        }
+        break;
+    }
+    case K_FLOAT: writeFloat(b, t->size == 4 ? *(const float*)p : *(const double*)p, t->size); break;
+    case K_STRING: writeString(b, p, verb); break;
+    case K_POINTER: case K_CHAN: case K_FUNC: case K_MAP:
+        if (t->kind == K_MAP && verb != 'p') {
+            const Map* m = *(Map* const*)p;
+            int64_t n = 0;
+            const char** entries = malloc((m != NULL ? m->count : 0) * sizeof(char*) + 1);
+            for (int64_t i = 0; m != NULL && i < m->used; i++) {
+                if (*(const int64_t*)entryAt(m, i)) entries[n++] = entryAt(m, i);
+            }
+            sortedKey = t->key;
+            qsort(entries, n, sizeof(char*), compareEntries);
+            putText(b, "map[");
+            for (int64_t i = 0; i < n; i++) {
+                if (i > 0) putText(b, " ");
+                writeValue(b, t->key, entries[i] + 8, verb, methods);
+                putText(b, ":");
+                writeValue(b, t->elem, entries[i] + m->valueOffset, verb, methods);
+            }
+            putText(b, "]");
+            free(entries);
+        }
+        else if (*(void* const*)p == NULL) {
+            putText(b, "<nil>");
+        }
+        else if (t->kind == K_POINTER && t->elem != NULL && (t->elem->kind == K_STRUCT || t->elem->kind == K_ARRAY)) {
+            putText(b, "&");
+            writeValue(b, t->elem, *(void* const*)p, verb, methods);
+        }
+        else {
+            putFormat(b, "%p", *(void* const*)p);
+        }
+        break;
+    case K_SLICE: case K_ARRAY: {
+        const char* elems = t->kind == K_SLICE ? ((const Slice*)p)->ptr : p;
+        int64_t n = t->kind == K_SLICE ? ((const Slice*)p)->len : t->length;
+        putText(b, "[");
+        for (int64_t i = 0; i < n; i++) {
+            if (i > 0) putText(b, " ");
+            writeValue(b, t->elem, elems + i * t->elem->size, verb, methods);
+        }
+        putText(b, "]");
+        break;
+    }
+    case K_STRUCT:
+        putText(b, "{");
+        for (int64_t i = 0; i < t->length; i++) {
+            if (i > 0) putText(b, " ");
+            if (verb == 'F') {
+                put(b, t->fields[i].name, t->fields[i].nameLength);
+                putText(b, ":");
+            }
+            writeValue(b, t->fields[i].type, (const char*)p + t->fields[i].offset, verb,
+                methods && isupper((unsigned char)t->fields[i].name[0]));
+        }
+        putText(b, "}");
+        break;
+    case K_INTERFACE: writeInterface(b, p, verb, methods); break;
+    default: putText(b, "?"); break;
+    }
+}
+// Printf with the verbs %v %d %s %q %x %c %t %f %e %g %p %T and %%, widths,
+// precisions and the - + 0 space flags.
+static void writeFormatted(Buffer* b, const Interface* args, int64_t count) {
+    const String* format = args[0].data;
+    int64_t next = 1;
+    for (int64_t i = 0; i < format->len; i++) {
+        char c = format->ptr[i];
+        if (c != '%' || i + 1 == format->len) {
+            put(b, &c, 1);
+            continue;
+        }
+        char spec[32] = "%";
+        int n = 1;
+        while (++i < format->len && strchr("-+ 0#", format->ptr[i]) != NULL && n < 8) spec[n++] = format->ptr[i];
+        while (i < format->len && (isdigit((unsigned char)format->ptr[i]) || format->ptr[i] == '.') && n < 24) {
+            spec[n++] = format->ptr[i++];
+        }
+        if (i == format->len) break;
+        char verb = format->ptr[i];
+        if (verb == '%') {
+            putText(b, "%");
+            continue;
+        }
+        if (next >= count) {
+            putFormat(b, "%%!%c(MISSING)", verb);
+            continue;
+        }
+        const Interface* arg = &args[next++];
+        const Type* t = arg->type;
+        if (verb == 'T') {
+            if (t == NULL) {
+                putText(b, "<nil>");
+            }
+            else {
+                put(b, t->name, t->nameLength);
+            }
+            continue;
+        }
+        Buffer value = { 0 };
+        if (t != NULL && t->kind == K_FLOAT && strchr("feEgG", verb) != NULL) {
+            spec[n++] = verb;
+            spec[n] = 0;
+            double d = t->size == 4 ? *(const float*)valueOf(arg) : *(const double*)valueOf(arg);
+            putFormat(&value, spec, d);
+            put(b, value.p, value.length);
+            free(value.p);
+            continue;
+        }
+        // %x of a value with a String method is that of what it returns
+        if (t != NULL && (t->kind == K_INT || t->kind == K_UINT) &&
+            (verb == 'd' || t->format == NULL && (verb == 'x' || verb == 'X'))) {
+            memcpy(spec + n, "ll", 2);
+            spec[n + 2] = t->kind == K_INT && verb == 'd' ? 'd' : verb == 'd' ? 'u' : verb;
+            spec[n + 3] = 0;
+            putFormat(&value, spec, (long long)intOf(t, valueOf(arg)));
+            put(b, value.p, value.length);
+            free(value.p);
+            continue;
+        }
+        writeInterface(&value, arg, verb == 'v' && memchr(spec, '+', n) != NULL ? 'F' : verb, 1);
+        // the width and the - flag apply to the text as a whole
+        spec[n++] = 's';
+        spec[n] = 0;
+        char* text = malloc(value.length + 1);
+        memcpy(text, value.p, value.length);
+        text[value.length] = 0;
+        putFormat(b, spec, text);
+        free(text);
+        free(value.p);
+    }
+}
+enum { PRINT, PRINTLN, PRINTF };
+static int isString(const Interface* i) { return i->type != NULL && i->type->kind == K_STRING; }
+// fmt.Print, Println and Printf of the arguments, to standard output.
+void g5_fmt(int64_t mode, const Interface* args, int64_t count) {
+    Buffer b = { 0 };
+    if (mode == PRINTF) {
+        writeFormatted(&b, args, count);
+    }
+    else {
+        for (int64_t i = 0; i < count; i++) {
+            // Print only separates operands when neither is a string
+            if (i > 0 && (mode == PRINTLN || (!isString(&args[i]) && !isString(&args[i - 1])))) putText(&b, " ");
+            writeInterface(&b, &args[i], 'v', 1);
+        }
+        if (mode == PRINTLN) putText(&b, "\n");
+    }
+    fwrite(b.p, 1, b.length, stdout);
+    free(b.p);
+}
+// The print and println builtins, to standard error.
+void g5_print(int64_t newline, const Interface* args, int64_t count) {
+    fflush(stdout);
+    Buffer b = { 0 };
+    for (int64_t i = 0; i < count; i++) {
+        if (i > 0 && newline) putText(&b, " ");
+        const Type* t = args[i].type;
+        if (t != NULL && t->kind == K_FLOAT) {
+            // as +1.500000e+000, the exponent having three digits
+            char text[64];
+            snprintf(text, sizeof text, "%+e", t->size == 4 ? *(const float*)args[i].data : *(const double*)args[i].data);
+            char* e = strchr(text, 'e');
+            if (e != NULL && strlen(e + 2) < 3) memmove(e + 3, e + 2, strlen(e + 2) + 1), e[2] = '0';
+            putText(&b, text);
+        }
+        else if (t != NULL && t->kind == K_INTERFACE) {
+            const Interface* x = args[i].data;
+            putFormat(&b, "(%p,%p)", (void*)x->type, x->data);
+        }
+        else if (t != NULL && t->kind == K_SLICE) {
+            putFormat(&b, "[%lld/%lld]%p", (long long)((const Slice*)args[i].data)->len,
+                (long long)((const Slice*)args[i].data)->cap, ((const Slice*)args[i].data)->ptr);
+        }
+        else {
+            writeInterface(&b, &args[i], 'v', 0);
+        }
+    }
+    if (newline) putText(&b, "\n");
+    fwrite(b.p, 1, b.length, stderr);
+    free(b.p);
+}
+
+//===--- panics ---===//
+
+void g5_panic(const Interface* v) {
+    Buffer b = { 0 };
+    writeInterface(&b, v, 'v', 0);
+    put(&b, "", 1);
+    fail("%s", b.p);
+}
+void g5_panic_index(int64_t i, int64_t length) {
+    fail("runtime error: index out of range [%lld] with length %lld", (long long)i, (long long)length);
+}
+void g5_panic_divide(void) { fail("runtime error: integer divide by zero"); }
+void g5_exit(int64_t code) {
+    fflush(stdout);
+    exit((int)code);
+}
+
+static void fault(int signal) {
+    (void)signal;
+    static const char message[] = "panic: runtime error: invalid memory address or nil pointer dereference\n";
+    fflush(stdout);
+    if (write(2, message, sizeof message - 1) < 0) _exit(2);
+    _exit(2);
+}
+
+// Runs the package initializers and main.main.
+void g5_entry(void);
+int main(void) {
+    signal(SIGSEGV, fault);
+    signal(SIGBUS, fault);
+    g5_entry();
+    fflush(stdout);
+    return 0;
+}
+)runtime";
+
+string shellQuoted(const string& s) {
+    string quoted = "'";
+    for (char c : s) quoted += c == '\'' ? string("'\\''") : string(1, c);
+    return quoted + "'";
+}
+
+// Assembles text and links it with the runtime into the executable output, with
+// the C compiler $CC names, cc by default.
+void link(const string& text, const string& output) {
+    static atomic<uint32_t> count{ 0 };
+    auto directory = filesystem::temp_directory_path() / ("g5-" +
+        to_string(chrono::steady_clock::now().time_since_epoch().count()) + "-" + to_string(count++));
+    filesystem::create_directories(directory);
+    string assemblyFile = (directory / "main.s").string(), runtimeFile = (directory / "runtime.c").string();
+    ofstream(assemblyFile) << text;
+    ofstream(runtimeFile) << nativeRuntime;
+    const char* cc = getenv("CC");
+    string command = string(cc != nullptr && *cc != 0 ? cc : "cc") + " -O2 -o " + shellQuoted(output) + " " +
+        shellQuoted(assemblyFile) + " " + shellQuoted(runtimeFile) + " -lm";
+    int status = system(command.c_str());
+    filesystem::remove_all(directory);
+    if (status != 0) throw runtime_error("linking failed: " + command);
+}
+
+//===----------------------------------------------------------------------===//
+// Bytecode interpreter
+//===----------------------------------------------------------------------===//
+// runtime() runs a module right away, without an assembler or a linker. The
+// functions main.main and the package initializers reach are translated to a
+// register bytecode, which a loop executes by jumping from the handler of one
+// instruction straight to the handler of the next through a table of label
+// addresses, where the compiler has computed goto, and by a switch elsewhere.
+// A register is a 64 bit word of the frame of a function, an operand the index
+// of one. Every SSA value has registers of its own, as many as its type takes
+// in memory with the layout of the native code: a boolean or a number sits in
+// one word sign or zero extended, so its low bytes are the value as memory
+// holds it, and strings, slices, interfaces, structs and arrays take as many
+// words as they are long. Constants are registers too, copied into the frame
+// from an image when the function is entered. The arguments and the results
+// of a call are the last registers of the caller, which are the first ones of
+// the callee, in the places ABI0 gives them.
+// The frames of a goroutine are stacked in segments that never move, as the
+// variables of a frame may be pointed to. A call that does not fit in its
+// segment goes on in the next one, twice as large, copying its arguments and
+// later its results over.
+
+struct RType;
+struct GoString {
+    const char* ptr;
+    int64_t len;
+};
+struct GoSlice {
+    char* ptr;
+    int64_t len, cap;
+};
+struct GoInterface {
+    const RType* type;
+    void* data;
+};
+
+// How a value of a type is read from memory into registers: a word, a narrow
+// integer that is extended, or bytes copied for a value of several words.
+enum LoadKind : uint8_t { LD_WORD, LD_S8, LD_U8, LD_S16, LD_U16, LD_S32, LD_U32, LD_BYTES };
+
+LoadKind loadKind(const Type* t) {
+    switch (kindOf(t)) {
+    case TY_INT8: return LD_S8;
+    case TY_BOOL: case TY_UINT8: return LD_U8;
+    case TY_INT16: return LD_S16;
+    case TY_UINT16: return LD_U16;
+    case TY_INT32: return LD_S32;
+    case TY_UINT32: case TY_FLOAT32: return LD_U32;
+    default: return isAggregate(t) ? LD_BYTES : LD_WORD;
+    }
+}
+// The registers a value of type t takes.
+inline uint32_t wordsOf(const Type* t) { return uint32_t(max<int64_t>(align8(layoutOf(t).size), 8) / 8); }
+// Extends the narrow integer in the low bytes of v.
+inline uint64_t extend(uint64_t v, LoadKind kind) {
+    switch (kind) {
+    case LD_S8: return uint64_t(int64_t(int8_t(v)));
+    case LD_U8: return uint8_t(v);
+    case LD_S16: return uint64_t(int64_t(int16_t(v)));
+    case LD_U16: return uint16_t(v);
+    case LD_S32: return uint64_t(int64_t(int32_t(v)));
+    case LD_U32: return uint32_t(v);
+    default: return v;
+    }
+}
+// Reads a value of kind and size bytes at p into the registers at d.
+inline void loadAs(uint64_t* d, const void* p, LoadKind kind, int64_t size) {
+    if (kind == LD_BYTES) {
+        memcpy(d, p, size_t(size));
+        return;
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, kind == LD_WORD ? 8 : kind <= LD_U8 ? 1 : kind <= LD_U16 ? 2 : 4);
+    *d = extend(v, kind);
+}
+
+// A type at run time, one for all identical types, so that interfaces holding
+// values of the same type hold the same pointer.
+struct RType {
+    const Type* type;
+    // of the underlying type
+    TypeKind kind;
+    LoadKind load;
+    bool pointerShaped;
+    int64_t size;
+    const RType* elem = nullptr;
+    const RType* key = nullptr;
+    int64_t length = 0;
+    struct Field {
+        const RType* type;
+        int64_t offset;
+        Symbol name;
+    };
+    vector<Field> fields;
+    // the methods an interface holding the type calls, or the ones an
+    // interface type asks for, by name. An indirect method gets a copy of the
+    // receiver the data word points to, the others the data word itself.
+    struct Method {
+        Symbol name;
+        uint32_t function;
+        bool indirect;
+        LoadKind load;
+        int64_t size;
+    };
+    vector<Method> methods;
+    // the Error or else String method fmt formats values with
+    const Method* format = nullptr;
+    string name;
+
+    const Method* method(Symbol s) const {
+        auto it = lower_bound(methods.begin(), methods.end(), s, [](const Method& m, Symbol s) { return m.name < s; });
+        return it != methods.end() && it->name == s ? &*it : nullptr;
+    }
+};
+
+// os.Exit or a fatal error ending the program, and a run-time error, which
+// panics with its message as a string.
+struct ProgramExit {
+    int code;
+    string message;
+};
+struct RuntimeFault {
+    string message;
+};
+[[noreturn]] void runtimeError(const string& message) { throw RuntimeFault{ "runtime error: " + message }; }
+
+//===--- heap ---===//
+
+// Go values live in a heap the collector frees, in an address range reserved
+// up front, so that a word is a pointer into it when it falls in the range
+// and the span covering it holds an object there. Spans are runs of pages cut
+// into objects of one size class, those without pointers in spans of their
+// own that are never scanned; objects larger than the largest class get a
+// span each. A thread allocates from spans it caches by class, so the lock of
+// a class is only taken once a span runs out.
+// A span keeps a bit per object that was live after it was last swept, and
+// hands out the objects without one in address order, the objects before
+// freeIndex being the ones taken since. Sweeping makes the mark bits the new
+// live bits. It happens once a collection has marked, lazily as threads need
+// spans of a class and in the background for the rest, and spans must be
+// swept before they hand out objects again.
+struct Span {
+    uintptr_t start;
+    size_t pages;
+    uint32_t size, count;
+    // the class times two plus one without pointers, 0 for a large object
+    uint32_t sizeClass;
+    bool noscan, needZero;
+    // the collection it was last swept for
+    uint32_t sweepGeneration;
+    atomic<uint32_t> freeIndex{ 0 };
+    vector<uint64_t> liveBits;
+    unique_ptr<atomic<uint64_t>[]> markBits;
+    // in the spans of its class
+    size_t position;
+
+    bool allocated(uint32_t i) const {
+        return i < freeIndex.load(memory_order_acquire) || liveBits[i >> 6] >> (i & 63) & 1;
+    }
+    // The next free object, marked when the collector is marking, or none
+    // once the span is full.
+    void* take(bool black) {
+        uint32_t i = freeIndex.load(memory_order_relaxed);
+        while (i < count) {
+            uint64_t used = liveBits[i >> 6] | ((uint64_t(1) << (i & 63)) - 1);
+            if (used != ~uint64_t(0)) {
+                i = (i & ~63u) + uint32_t(lowestBit64(~used));
+                break;
+            }
+            i = (i & ~63u) + 64;
+        }
+        if (i >= count) {
+            freeIndex.store(count, memory_order_release);
+            return nullptr;
+        }
+        if (black) markBits[i >> 6].fetch_or(uint64_t(1) << (i & 63), memory_order_relaxed);
+        void* p = reinterpret_cast<void*>(start + uintptr_t(i) * size);
+        if (needZero) memset(p, 0, size);
+        freeIndex.store(i + 1, memory_order_release);
+        return p;
+    }
+};
+
+struct HeapCache;
+
+// The heap. Marking is on while the collector marks: allocated objects are
+// marked at once, and write barriers shade what a store overwrites.
+struct Heap {
+    static constexpr size_t pageShift = 13, pageSize = size_t(1) << pageShift, maxSmall = 32768, classCount = 42;
+
+    // by class: the object size and the pages of a span
+    vector<uint32_t> classSizes{ 0 };
+    vector<uint32_t> classPages{ 0 };
+    uint8_t smallClasses[maxSmall / 1024 * 8 + 1], largeClasses[maxSmall / 128 + 1];
+
+    char* arena = nullptr;
+    size_t arenaPages = 0;
+    atomic<size_t> usedPages{ 0 };
+    // the span of every page in use
+    atomic<Span*>* pageMap = nullptr;
+    mutex pageLock;
+    // pages not in a span by address, how many and whether the system zeroed
+    // them, and the same by length
+    map<uintptr_t, pair<size_t, bool>> freeRuns;
+    multimap<size_t, uintptr_t> freeBySize;
+    // owns every span made, the freed ones wait in spareSpans for reuse
+    deque<Span> allSpans;
+    vector<Span*> spareSpans;
+
+    // the spans of a class, those with free objects, and those to sweep
+    struct Central {
+        mutex lock;
+        vector<Span*> spans, partial, unswept;
+    };
+    unique_ptr<Central[]> centrals;
+
+    atomic<bool> marking{ false };
+    uint32_t sweepGeneration = 0;
+    // bytes taken since the last collection plus those it found live, the
+    // amount that starts the next one, and the live bytes the last sweep found
+    atomic<int64_t> allocated{ 0 }, trigger{ int64_t(4) << 20 }, swept{ 0 };
+    // bytes in spans, and the most there were
+    atomic<int64_t> footprint{ 0 }, peakFootprint{ 0 };
+    // the percentage the heap grows by over what was live before collecting
+    // again, GOGC, or negative for never
+    int growth = 100;
+    // the C library allocating instead, which nothing frees, to compare with
+    bool systemMalloc = false;
+    // a collection wanted, for the collector of the scheduler running
+    atomic<bool> requested{ false };
+    mutex requestLock;
+    condition_variable requestChanged;
+    // what the collections took, in nanoseconds the world was stopped
+    atomic<int64_t> collections{ 0 }, pauseTotal{ 0 }, pauseMax{ 0 };
+    // the most bytes a collection found live
+    atomic<int64_t> peakLive{ 0 };
+    // objects marked and not scanned yet
+    mutex greyLock;
+    vector<uintptr_t> grey;
+    mutex cachesLock;
+    vector<HeapCache*> caches;
+
+    Heap() {
+        for (uint32_t size = 8; size <= maxSmall;) {
+            classSizes.push_back(size);
+            classPages.push_back(uint32_t((max<size_t>(size_t(size) * 8, pageSize) + pageSize - 1) / pageSize));
+            uint32_t step = size < 16 ? 8 : size < 128 ? 16 : (uint32_t(1) << highestBit(size)) / 4;
+            size += step;
+        }
+        for (size_t i = 0, c = 1; i < sizeof smallClasses; i++) {
+            while (classSizes[c] < i * 8) c++;
+            smallClasses[i] = uint8_t(c);
+        }
+        for (size_t i = 0, c = 1; i < sizeof largeClasses; i++) {
+            while (classSizes[c] < i * 128) c++;
+            largeClasses[i] = uint8_t(c);
+        }
+        if (classSizes.size() != classCount) throw logic_error("size classes miscounted");
+        centrals = make_unique<Central[]>(classCount * 2);
+        if (const char* gogc = getenv("GOGC")) growth = strcmp(gogc, "off") == 0 ? -1 : atoi(gogc);
+        if (growth < 0) trigger = INT64_MAX;
+        // as much address space as the system grants, which only backs the
+        // pages touched
+        for (size_t bytes = size_t(1) << 36; arena == nullptr && bytes >= (size_t(1) << 28); bytes /= 2) {
+            arena = static_cast<char*>(reserve(bytes));
+            if (arena == nullptr) continue;
+            arenaPages = bytes / pageSize;
+            pageMap = static_cast<atomic<Span*>*>(reserve(arenaPages * sizeof(atomic<Span*>)));
+            if (pageMap == nullptr) {
+                release(arena, bytes);
+                arena = nullptr;
+            }
+        }
+        if (arena == nullptr) throw bad_alloc();
+    }
+    static void* reserve(size_t bytes) {
+#ifndef _WIN32
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+#else
+        return calloc(1, bytes);
+#endif
+    }
+    static void release(void* p, size_t bytes) {
+#ifndef _WIN32
+        munmap(p, bytes);
+#else
+        (void)bytes;
+        free(p);
+#endif
+    }
+    uint32_t classOf(size_t size) const {
+        return size <= 1024 ? smallClasses[(size + 7) >> 3] : largeClasses[(size + 127) >> 7];
+    }
+    // The span holding address p, or none.
+    Span* spanOf(uintptr_t p) const {
+        uintptr_t offset = p - uintptr_t(arena);
+        if (offset >= usedPages.load(memory_order_acquire) * pageSize) return nullptr;
+        return pageMap[offset >> pageShift].load(memory_order_acquire);
+    }
+
+    Span* newSpan(uint32_t sizeClass, size_t pages, uint32_t size);
+    void freeSpan(Span* s);
+    Span* refill(uint32_t sizeClass);
+    void* allocateLarge(size_t size, bool scan);
+    void sweep(Span* s, Central& central);
+    bool sweepSome(uint32_t sizeClass);
+    void sweepAll();
+    void endMarking();
+    void sweepDone();
+    void counted(int64_t bytes);
+
+    // Marks the object word points into, if it is one not marked yet,
+    // queueing it to scan onto work.
+    void shade(uint64_t word, vector<uintptr_t>& work) {
+        Span* s = spanOf(uintptr_t(word));
+        if (s == nullptr) return;
+        uint32_t i = uint32_t((uintptr_t(word) - s->start) / s->size);
+        if (i >= s->count || !s->allocated(i)) return;
+        atomic<uint64_t>& bits = s->markBits[i >> 6];
+        uint64_t bit = uint64_t(1) << (i & 63);
+        if (bits.load(memory_order_relaxed) & bit || bits.fetch_or(bit, memory_order_relaxed) & bit) return;
+        if (!s->noscan) work.push_back(s->start + uintptr_t(i) * s->size);
+    }
+    // The words are read while goroutines may store to them, in which case
+    // the write barrier shades what they held.
+    G5_RACY void shadeRange(const void* p, size_t bytes, vector<uintptr_t>& work) {
+        auto* words = static_cast<const volatile uint64_t*>(p);
+        for (size_t i = 0; i < bytes / 8; i++) shade(words[i], work);
+    }
+    // Scans the objects on work and those they lead to, or limit of them,
+    // saying whether it got to the end.
+    bool drain(vector<uintptr_t>& work, size_t limit = SIZE_MAX) {
+        for (; !work.empty(); limit--) {
+            if (limit == 0) return false;
+            uintptr_t p = work.back();
+            work.pop_back();
+            shadeRange(reinterpret_cast<const void*>(p), spanOf(p)->size, work);
+        }
+        return true;
+    }
+};
+Heap heap;
+
+// The spans a thread allocates from by class, and the objects its write
+// barriers shaded. A thread makes its cache when it first allocates, and
+// reaches it through a plain pointer, which costs less than a thread local
+// object that has to be constructed.
+struct HeapCache {
+    Span* spans[Heap::classCount * 2] = {};
+    vector<uintptr_t> grey;
+
+    HeapCache();
+    ~HeapCache();
+    // Hands the spans back to their classes and the shaded objects to the
+    // collector, the caches lock being held.
+    void flush() {
+        for (Span*& s : spans) {
+            if (s == nullptr) continue;
+            Heap::Central& central = heap.centrals[s->sizeClass];
+            lock_guard<mutex> guard(central.lock);
+            if (s->sweepGeneration == heap.sweepGeneration && s->freeIndex < s->count) central.partial.push_back(s);
+            s = nullptr;
+        }
+        if (!grey.empty()) {
+            lock_guard<mutex> guard(heap.greyLock);
+            heap.grey.insert(heap.grey.end(), grey.begin(), grey.end());
+            grey.clear();
+        }
+    }
+};
+thread_local HeapCache* heapCache = nullptr;
+
+HeapCache::HeapCache() {
+    lock_guard<mutex> guard(heap.cachesLock);
+    heap.caches.push_back(this);
+    heapCache = this;
+}
+HeapCache::~HeapCache() {
+    lock_guard<mutex> guard(heap.cachesLock);
+    flush();
+    heap.caches.erase(find(heap.caches.begin(), heap.caches.end(), this));
+    heapCache = nullptr;
+}
+
+// The cache of the calling thread.
+HeapCache& threadCache() {
+    if (heapCache == nullptr) {
+        static thread_local HeapCache cache;
+    }
+    return *heapCache;
+}
+
+// A span of pages for objects of size, marked as taken in the page map.
+Span* Heap::newSpan(uint32_t sizeClass, size_t pages, uint32_t size) {
+    Span* s;
+    bool zeroed;
+    {
+        lock_guard<mutex> guard(pageLock);
+        auto run = freeBySize.lower_bound(pages);
+        uintptr_t start;
+        if (run != freeBySize.end()) {
+            start = run->second;
+            size_t length = run->first;
+            freeBySize.erase(run);
+            zeroed = freeRuns[start].second;
+            freeRuns.erase(start);
+            if (length > pages) {
+                freeRuns[start + pages * pageSize] = { length - pages, zeroed };
+                freeBySize.insert({ length - pages, start + pages * pageSize });
+            }
+        }
+        else {
+            if (usedPages + pages > arenaPages) throw bad_alloc();
+            start = uintptr_t(arena) + usedPages * pageSize;
+            usedPages += pages;
+            zeroed = true;
+        }
+        if (!spareSpans.empty()) {
+            s = spareSpans.back();
+            spareSpans.pop_back();
+        }
+        else {
+            s = &allSpans.emplace_back();
+        }
+        s->start = start;
+    }
+    s->pages = pages;
+    s->size = size;
+    // a large object may not fill its pages, or be larger than size says
+    s->count = sizeClass == 0 ? 1 : uint32_t(pages * pageSize / size);
+    s->sizeClass = sizeClass;
+    s->noscan = sizeClass & 1;
+    s->needZero = !zeroed;
+    s->sweepGeneration = sweepGeneration;
+    s->freeIndex.store(0, memory_order_relaxed);
+    s->liveBits.assign((s->count + 63) / 64, 0);
+    s->markBits = make_unique<atomic<uint64_t>[]>((s->count + 63) / 64);
+    for (size_t i = 0; i < (s->count + 63) / 64; i++) s->markBits[i].store(0, memory_order_relaxed);
+    size_t first = (s->start - uintptr_t(arena)) >> pageShift;
+    for (size_t i = 0; i < pages; i++) pageMap[first + i].store(s, memory_order_release);
+    int64_t bytes = footprint.fetch_add(int64_t(pages * pageSize)) + int64_t(pages * pageSize);
+    int64_t peak = peakFootprint.load();
+    while (bytes > peak && !peakFootprint.compare_exchange_weak(peak, bytes)) {}
+    return s;
+}
+
+// Gives the pages of s back, joined with the free pages around them. Long
+// runs go back to the system, which zeroes them.
+void Heap::freeSpan(Span* s) {
+    size_t first = (s->start - uintptr_t(arena)) >> pageShift;
+    for (size_t i = 0; i < s->pages; i++) pageMap[first + i].store(nullptr, memory_order_relaxed);
+    footprint -= int64_t(s->pages * pageSize);
+    lock_guard<mutex> guard(pageLock);
+    uintptr_t start = s->start;
+    size_t pages = s->pages;
+    bool zeroed = false;
+    auto unlink = [&](map<uintptr_t, pair<size_t, bool>>::iterator run) {
+        auto range = freeBySize.equal_range(run->second.first);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == run->first) {
+                freeBySize.erase(it);
+                break;
+            }
+        }
+        freeRuns.erase(run);
+    };
+    auto next = freeRuns.find(start + pages * pageSize);
+    if (next != freeRuns.end()) {
+        pages += next->second.first;
+        unlink(next);
+    }
+    auto previous = freeRuns.lower_bound(start);
+    if (previous != freeRuns.begin() && (--previous)->first + previous->second.first * pageSize == start) {
+        start = previous->first;
+        pages += previous->second.first;
+        unlink(previous);
+    }
+#ifndef _WIN32
+    if (pages >= 64) zeroed = madvise(reinterpret_cast<void*>(start), pages * pageSize, MADV_DONTNEED) == 0;
+#endif
+    freeRuns[start] = { pages, zeroed };
+    freeBySize.insert({ pages, start });
+    s->markBits.reset();
+    spareSpans.push_back(s);
+}
+
+// Counts bytes taken, and has the collector start once there are enough.
+void Heap::counted(int64_t bytes) {
+    if (allocated.fetch_add(bytes, memory_order_relaxed) + bytes < trigger.load(memory_order_relaxed)) return;
+    if (requested.exchange(true)) return;
+    lock_guard<mutex> guard(requestLock);
+    requestChanged.notify_one();
+}
+
+// A span of class sizeClass with a free object for a thread to cache: a swept
+// one with room left, one swept here, or a new one.
+Span* Heap::refill(uint32_t sizeClass) {
+    Central& central = centrals[sizeClass];
+    Span* s = nullptr;
+    {
+        lock_guard<mutex> guard(central.lock);
+        while (s == nullptr) {
+            if (!central.partial.empty()) {
+                s = central.partial.back();
+                central.partial.pop_back();
+            }
+            else if (!central.unswept.empty()) {
+                Span* next = central.unswept.back();
+                central.unswept.pop_back();
+                sweep(next, central);
+                if (!central.partial.empty() && central.partial.back() == next) {
+                    central.partial.pop_back();
+                    s = next;
+                }
+            }
+            else {
+                uint32_t c = sizeClass / 2;
+                s = newSpan(sizeClass, classPages[c], classSizes[c]);
+                s->position = central.spans.size();
+                central.spans.push_back(s);
+            }
+        }
+    }
+    uint32_t used = 0;
+    for (uint32_t i = s->freeIndex; i < s->count; i++) used += s->liveBits[i >> 6] >> (i & 63) & 1;
+    counted(int64_t(s->count - s->freeIndex - used) * s->size);
+    return s;
+}
+
+void* Heap::allocateLarge(size_t size, bool scan) {
+    Central& central = centrals[0];
+    size_t pages = (size + pageSize - 1) / pageSize;
+    Span* s;
+    {
+        lock_guard<mutex> guard(central.lock);
+        s = newSpan(0, pages, uint32_t(min<size_t>(pages * pageSize, UINT32_MAX)));
+        s->noscan = !scan;
+        s->position = central.spans.size();
+        central.spans.push_back(s);
+    }
+    void* p = s->take(marking.load(memory_order_relaxed));
+    counted(int64_t(pages * pageSize));
+    return p;
+}
+
+// Frees the objects of s nothing marked, the lock of its class being held:
+// its marks become what is live, and it joins the spans with room, or goes
+// when nothing in it is.
+void Heap::sweep(Span* s, Central& central) {
+    size_t words = (s->count + 63) / 64;
+    int64_t live = 0;
+    for (size_t i = 0; i < words; i++) {
+        s->liveBits[i] = s->markBits[i].load(memory_order_relaxed);
+        s->markBits[i].store(0, memory_order_relaxed);
+        live += bitCount64(s->liveBits[i]);
+    }
+    s->sweepGeneration = sweepGeneration;
+    if (live == 0) {
+        central.spans.back()->position = s->position;
+        central.spans[s->position] = central.spans.back();
+        central.spans.pop_back();
+        freeSpan(s);
+        return;
+    }
+    swept += live * s->size;
+    allocated += live * s->size;
+    s->freeIndex.store(0, memory_order_relaxed);
+    s->needZero = true;
+    if (live < s->count) central.partial.push_back(s);
+}
+
+// Sweeps a span of class sizeClass, if any is left to.
+bool Heap::sweepSome(uint32_t sizeClass) {
+    Central& central = centrals[sizeClass];
+    lock_guard<mutex> guard(central.lock);
+    if (central.unswept.empty()) return false;
+    Span* s = central.unswept.back();
+    central.unswept.pop_back();
+    sweep(s, central);
+    return true;
+}
+
+void Heap::sweepAll() {
+    for (uint32_t c = 0; c < classCount * 2; c++) {
+        while (sweepSome(c)) {}
+    }
+}
+
+// Ends marking once nothing is left to, with the world stopped: the threads
+// give their spans back, and every span is to be swept for this collection.
+// A thread ending gives its cache back under the caches lock too, and only
+// marks what it shaded if it does before this.
+void Heap::endMarking() {
+    {
+        lock_guard<mutex> guard(cachesLock);
+        for (HeapCache* cache : caches) cache->flush();
+        lock_guard<mutex> greyGuard(greyLock);
+        drain(grey);
+        marking = false;
+        sweepGeneration++;
+    }
+    allocated = 0;
+    swept = 0;
+    // the next collection is due once what the sweep finds live is known
+    trigger = INT64_MAX;
+    for (uint32_t c = 0; c < classCount * 2; c++) {
+        Central& central = centrals[c];
+        lock_guard<mutex> guard(central.lock);
+        central.partial.clear();
+        central.unswept = central.spans;
+    }
+}
+
+// Sets when the next collection starts, once the last one has swept.
+void Heap::sweepDone() {
+    int64_t live = swept.load(), peak = peakLive.load();
+    while (live > peak && !peakLive.compare_exchange_weak(peak, live)) {}
+    if (growth >= 0) trigger = max(int64_t(4) << 20, live + live / 100 * growth);
+}
+
+void* heapAllocateSlow(size_t size, bool scan) {
+    if (heap.systemMalloc) {
+        void* p = calloc(1, size != 0 ? size : 1);
+        if (p == nullptr) throw bad_alloc();
+        return p;
+    }
+    if (size > Heap::maxSmall) return heap.allocateLarge(size, scan);
+    uint32_t sizeClass = heap.classOf(size) * 2 + !scan;
+    Span*& s = threadCache().spans[sizeClass];
+    if (s != nullptr) {
+        if (void* p = s->take(heap.marking.load(memory_order_relaxed))) return p;
+    }
+    s = heap.refill(sizeClass);
+    return s->take(heap.marking.load(memory_order_relaxed));
+}
+
+// Memory for Go values, zeroed, scanned for pointers by the collector unless
+// scan is false. Most come from a span the thread has cached.
+inline void* heapAllocate(size_t size, bool scan = true) {
+    if (size <= Heap::maxSmall && heapCache != nullptr) {
+        if (Span* s = heapCache->spans[heap.classOf(size) * 2 + !scan]) {
+            if (void* p = s->take(heap.marking.load(memory_order_relaxed))) return p;
+        }
+    }
+    return heapAllocateSlow(size, scan);
+}
+
+// While the collector marks, shades the values bytes at p hold before a store
+// overwrites them, so that everything reachable when marking started stays
+// reachable for it.
+inline void writeBarrier(const void* p, size_t bytes) {
+    if (!heap.marking.load(memory_order_relaxed)) return;
+    // pointers are aligned, so only the whole words stored to can hold one
+    uintptr_t first = (uintptr_t(p) + 7) & ~uintptr_t(7), last = (uintptr_t(p) + bytes) & ~uintptr_t(7);
+    if (first >= last) return;
+    vector<uintptr_t>& grey = threadCache().grey;
+    heap.shadeRange(reinterpret_cast<const void*>(first), last - first, grey);
+    if (grey.size() >= 256) {
+        lock_guard<mutex> guard(heap.greyLock);
+        heap.grey.insert(heap.grey.end(), grey.begin(), grey.end());
+        grey.clear();
+    }
+}
+
+struct Goroutine;
+struct Scheduler;
+
+// Collects the heap on a thread of its own while a scheduler runs, once the
+// heap has grown by GOGC percent since the last collection. It marks what
+// was reachable when marking started, which is also what the goroutines can
+// reach until it ends: the world stops while the roots are shaded, and
+// again once nothing is left to mark, and in between the goroutines run,
+// marking what they allocate and shading what their stores overwrite. Every
+// word of a frame or an object is taken for a pointer, as neither says where
+// its pointers are. The spans are swept afterwards, by the collector and by
+// threads needing objects of a class before it gets to it.
+struct Collector {
+    explicit Collector(Scheduler& scheduler) : scheduler(scheduler), worker([this] { loop(); }) {}
+    ~Collector() {
+        {
+            lock_guard<mutex> guard(heap.requestLock);
+            quit = true;
+        }
+        heap.requestChanged.notify_all();
+        worker.join();
+    }
+
+private:
+    // at most the objects scanned with the world stopped while marking is
+    // not done, about a millisecond
+    static constexpr size_t pauseWork = 20000;
+
+    void loop();
+    void collect();
+    void shadeRoots(vector<uintptr_t>& work);
+    void shadeGoroutine(const Goroutine& g, vector<uintptr_t>& work);
+    template <class F> void stopped(F phase);
+
+    Scheduler& scheduler;
+    bool quit = false;
+    thread worker;
+};
+
+//===--- values ---===//
+
+bool equalValues(const RType* t, const void* a, const void* b);
+inline const void* valueOf(const GoInterface& i) { return i.type->pointerShaped ? &i.data : i.data; }
+bool equalInterfaces(const GoInterface& a, const GoInterface& b) {
+    if (a.type != b.type) return false;
+    if (a.type == nullptr) return true;
+    if (a.type->kind == TY_SLICE || a.type->kind == TY_MAP || a.type->kind == TY_FUNC) {
+        runtimeError("comparing uncomparable type " + a.type->name);
+    }
+    return equalValues(a.type, valueOf(a), valueOf(b));
+}
+bool equalValues(const RType* t, const void* a, const void* b) {
+    switch (t->kind) {
+    case TY_FLOAT32: return *static_cast<const float*>(a) == *static_cast<const float*>(b);
+    case TY_FLOAT64: return *static_cast<const double*>(a) == *static_cast<const double*>(b);
+    case TY_COMPLEX64:
+        return static_cast<const float*>(a)[0] == static_cast<const float*>(b)[0] &&
+            static_cast<const float*>(a)[1] == static_cast<const float*>(b)[1];
+    case TY_COMPLEX128:
+        return static_cast<const double*>(a)[0] == static_cast<const double*>(b)[0] &&
+            static_cast<const double*>(a)[1] == static_cast<const double*>(b)[1];
+    case TY_STRING: {
+        auto* x = static_cast<const GoString*>(a);
+        auto* y = static_cast<const GoString*>(b);
+        return x->len == y->len && memcmp(x->ptr, y->ptr, size_t(x->len)) == 0;
+    }
+    case TY_INTERFACE: return equalInterfaces(*static_cast<const GoInterface*>(a), *static_cast<const GoInterface*>(b));
+    case TY_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) {
+            int64_t offset = i * t->elem->size;
+            if (!equalValues(t->elem, static_cast<const char*>(a) + offset, static_cast<const char*>(b) + offset)) return false;
+        }
+        return true;
+    case TY_STRUCT:
+        for (auto& f : t->fields) {
+            if (!equalValues(f.type, static_cast<const char*>(a) + f.offset, static_cast<const char*>(b) + f.offset)) return false;
+        }
+        return true;
+    default:
+        return memcmp(a, b, size_t(t->size)) == 0;
+    }
+}
+inline uint64_t hashBytes(uint64_t h, const void* p, int64_t n) {
+    for (int64_t i = 0; i < n; i++) h = (h ^ static_cast<const unsigned char*>(p)[i]) * 0x100000001b3ull;
+    return h;
+}
+uint64_t hashValue(const RType* t, const void* p, uint64_t h) {
+    switch (t->kind) {
+    case TY_FLOAT32: case TY_FLOAT64: {
+        // +0 and -0 are equal keys
+        double d = t->kind == TY_FLOAT32 ? *static_cast<const float*>(p) : *static_cast<const double*>(p);
+        if (d == 0) d = 0;
+        return hashBytes(h, &d, sizeof d);
+    }
+    case TY_STRING: return hashBytes(h, static_cast<const GoString*>(p)->ptr, static_cast<const GoString*>(p)->len);
+    case TY_INTERFACE: {
+        auto* i = static_cast<const GoInterface*>(p);
+        if (i->type != nullptr && (i->type->kind == TY_SLICE || i->type->kind == TY_MAP || i->type->kind == TY_FUNC)) {
+            runtimeError("hash of unhashable type " + i->type->name);
+        }
+        return i->type == nullptr ? h : hashValue(i->type, valueOf(*i), hashBytes(h, &i->type, sizeof i->type));
+    }
+    case TY_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) h = hashValue(t->elem, static_cast<const char*>(p) + i * t->elem->size, h);
+        return h;
+    case TY_STRUCT:
+        for (auto& f : t->fields) h = hashValue(f.type, static_cast<const char*>(p) + f.offset, h);
+        return h;
+    default:
+        return hashBytes(h, p, t->size);
+    }
+}
+
+// A map: open addressing with linear probing over indices of the entries,
+// which are kept in insertion order, so iterating and growing never rehash
+// an entry twice. An entry is a live word, then the key and the value, each
+// in whole words.
+struct GoMap {
+    const RType* key;
+    const RType* elem;
+    int64_t count = 0, used = 0, capacity = 8;
+    // entry index + 1 by slot, 0 for free
+    uint32_t* slots;
+    uint64_t* entries;
+    uint32_t entryWords, valueWord;
+
+    GoMap(const RType* key, const RType* elem, int64_t hint)
+        : key(key), elem(elem), entryWords(uint32_t(1 + align8(key->size) / 8 + align8(elem->size) / 8)),
+        valueWord(uint32_t(1 + align8(key->size) / 8)) {
+        while (capacity < hint * 2) capacity *= 2;
+        allocate();
+    }
+    void allocate() {
+        slots = static_cast<uint32_t*>(heapAllocate(size_t(capacity) * sizeof(uint32_t), false));
+        entries = static_cast<uint64_t*>(heapAllocate(size_t(capacity / 2 * entryWords) * 8));
+    }
+    uint64_t* entry(int64_t i) const { return entries + i * entryWords; }
+    // The slot of k, or the free one it would go to.
+    int64_t find(const void* k) const {
+        uint64_t mask = uint64_t(capacity - 1), i = hashValue(key, k, 0xcbf29ce484222325ull) & mask;
+        for (;; i = (i + 1) & mask) {
+            uint32_t e = slots[i];
+            if (e == 0) return int64_t(i);
+            uint64_t* x = entry(e - 1);
+            if (x[0] != 0 && equalValues(key, x + 1, k)) return int64_t(i);
+        }
+    }
+    void grow() {
+        uint64_t* oldEntries = entries;
+        int64_t oldUsed = used;
+        capacity *= 2;
+        writeBarrier(&slots, sizeof slots + sizeof entries);
+        allocate();
+        used = 0;
+        for (int64_t i = 0; i < oldUsed; i++) {
+            uint64_t* x = oldEntries + i * entryWords;
+            if (x[0] == 0) continue;
+            memcpy(entry(used), x, entryWords * 8);
+            slots[find(x + 1)] = uint32_t(++used);
+        }
+    }
+    const uint64_t* lookup(const void* k) const {
+        if (count == 0) return nullptr;
+        uint32_t e = slots[find(k)];
+        return e != 0 ? entry(e - 1) + valueWord : nullptr;
+    }
+    uint64_t* insert(const void* k) {
+        int64_t slot = find(k);
+        if (slots[slot] == 0) {
+            if (used + 1 > capacity / 2) {
+                grow();
+                slot = find(k);
+            }
+            uint64_t* x = entry(used);
+            x[0] = 1;
+            memcpy(x + 1, k, size_t(key->size));
+            slots[slot] = uint32_t(++used);
+            count++;
+        }
+        return entry(slots[slot] - 1) + valueWord;
+    }
+    void erase(const void* k) {
+        if (count == 0) return;
+        int64_t slot = find(k);
+        if (slots[slot] == 0) return;
+        // the entry stays as a tombstone, its slot keeps probe chains intact
+        entry(slots[slot] - 1)[0] = 0;
+        count--;
+    }
+};
+struct GoMapIterator {
+    GoMap* map;
+    int64_t next;
+};
+
+// The rune at p and its length in bytes, U+FFFD and 1 when it is not valid.
+int32_t decodeUtf8(const unsigned char* p, int64_t n, int& size) {
+    size = 1;
+    if (p[0] < 0x80) return p[0];
+    int length = p[0] >= 0xf0 ? 4 : p[0] >= 0xe0 ? 3 : p[0] >= 0xc0 ? 2 : 0;
+    if (length == 0 || length > n || p[0] > 0xf4) return 0xfffd;
+    int32_t r = p[0] & (0x7f >> length);
+    for (int i = 1; i < length; i++) {
+        if ((p[i] & 0xc0) != 0x80) return 0xfffd;
+        r = r << 6 | (p[i] & 0x3f);
+    }
+    static const int32_t least[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (r < least[length] || (r >= 0xd800 && r <= 0xdfff) || r > 0x10ffff) return 0xfffd;
+    size = length;
+    return r;
+}
+GoString heapString(const string& s) {
+    char* p = static_cast<char*>(heapAllocate(s.size(), false));
+    memcpy(p, s.data(), s.size());
+    return { p, int64_t(s.size()) };
+}
+
+//===--- formatting ---===//
+
+void appendFormat(string& out, const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof text, format, args);
+    va_end(args);
+    out.append(text, size_t(min<int>(max(n, 0), int(sizeof text) - 1)));
+}
+inline int64_t intValue(const RType* t, const void* p) {
+    uint64_t v;
+    loadAs(&v, p, t->load, t->size);
+    return int64_t(v);
+}
+// The shortest decimal form of d that reads back as the same float of its
+// size, the way %v formats it.
+void formatFloat(string& out, double d, bool single) {
+    if (std::isnan(d)) {
+        out += "NaN";
+        return;
+    }
+    if (std::isinf(d)) {
+        out += d > 0 ? "+Inf" : "-Inf";
+        return;
+    }
+    char digits[40];
+    int precision = 1;
+    for (; precision < 17; precision++) {
+        snprintf(digits, sizeof digits, "%.*e", precision - 1, d);
+        double back = strtod(digits, nullptr);
+        if (single ? float(back) == float(d) : back == d) break;
+    }
+    snprintf(digits, sizeof digits, "%.*e", precision - 1, d);
+    int exponent = atoi(strchr(digits, 'e') + 1);
+    if (exponent < -4 || exponent >= 6) {
+        out += digits;
+        return;
+    }
+    appendFormat(out, "%.*f", max(precision - 1 - exponent, 0), d);
+}
+// The order fmt prints the keys of maps in: false before true, numbers and
+// strings ascending, NaN first, pointers by address, and arrays, structs and
+// interfaces element by element, interfaces by their type first.
+int compareKeys(const RType* t, const void* a, const void* b) {
+    auto order = [](auto x, auto y) { return x < y ? -1 : x > y ? 1 : 0; };
+    auto floats = [&](double x, double y) {
+        return std::isnan(x) || std::isnan(y) ? order(!std::isnan(x), !std::isnan(y)) : order(x, y);
+    };
+    switch (t->kind) {
+    case TY_BOOL: return order(*static_cast<const uint8_t*>(a), *static_cast<const uint8_t*>(b));
+    case TY_FLOAT32: return floats(*static_cast<const float*>(a), *static_cast<const float*>(b));
+    case TY_FLOAT64: return floats(*static_cast<const double*>(a), *static_cast<const double*>(b));
+    case TY_COMPLEX64: case TY_COMPLEX128: {
+        bool single = t->kind == TY_COMPLEX64;
+        for (int i = 0; i < 2; i++) {
+            int c = single ? floats(static_cast<const float*>(a)[i], static_cast<const float*>(b)[i]) :
+                floats(static_cast<const double*>(a)[i], static_cast<const double*>(b)[i]);
+            if (c != 0) return c;
+        }
+        return 0;
+    }
+    case TY_STRING: {
+        auto* x = static_cast<const GoString*>(a);
+        auto* y = static_cast<const GoString*>(b);
+        return order(string_view(x->ptr, size_t(x->len)), string_view(y->ptr, size_t(y->len)));
+    }
+    case TY_ARRAY:
+        for (int64_t i = 0; i < t->length; i++) {
+            int64_t offset = i * t->elem->size;
+            int c = compareKeys(t->elem, static_cast<const char*>(a) + offset, static_cast<const char*>(b) + offset);
+            if (c != 0) return c;
+        }
+        return 0;
+    case TY_STRUCT:
+        for (auto& f : t->fields) {
+            int c = compareKeys(f.type, static_cast<const char*>(a) + f.offset, static_cast<const char*>(b) + f.offset);
+            if (c != 0) return c;
+        }
+        return 0;
+    case TY_INTERFACE: {
+        auto* x = static_cast<const GoInterface*>(a);
+        auto* y = static_cast<const GoInterface*>(b);
+        if (x->type == nullptr || y->type == nullptr) return order(x->type != nullptr, y->type != nullptr);
+        if (x->type != y->type) return order(uintptr_t(x->type), uintptr_t(y->type));
+        return compareKeys(x->type, valueOf(*x), valueOf(*y));
+    }
+    default:
+        if (isInteger(t->kind)) {
+            int64_t x = intValue(t, a), y = intValue(t, b);
+            return isUnsigned(t->kind) ? order(uint64_t(x), uint64_t(y)) : order(x, y);
+        }
+        return order(*static_cast<const uintptr_t*>(a), *static_cast<const uintptr_t*>(b));
+    }
+}
+void formatString(string& out, const char* s, int64_t n, char verb) {
+    if (verb == 'q') {
+        out += '"';
+        for (int64_t i = 0; i < n; i++) {
+            unsigned char c = s[i];
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += char(c);
+            }
+            else if (c == '\n') {
+                out += "\\n";
+            }
+            else if (c < 0x20) {
+                appendFormat(out, "\\x%02x", c);
+            }
+            else {
+                out += char(c);
+            }
+        }
+        out += '"';
+    }
+    else if (verb == 'x' || verb == 'X') {
+        for (int64_t i = 0; i < n; i++) appendFormat(out, verb == 'x' ? "%02x" : "%02X", (unsigned char)s[i]);
+    }
+    else {
+        out.append(s, size_t(n));
+    }
+}
+// What the Error or String method of type t returns for the value at p, the
+// formatting of the values that have one being left to it.
+using FormatMethod = function<string(const RType* t, const void* p)>;
+void formatValue(string& out, const RType* t, const void* p, char verb, const FormatMethod* methods);
+void formatInterface(string& out, const GoInterface& i, char verb, const FormatMethod* methods = nullptr) {
+    if (i.type == nullptr) {
+        out += "<nil>";
+        return;
+    }
+    formatValue(out, i.type, valueOf(i), verb, methods);
+}
+// Formats the value at p like fmt does for %v, or %d, %s, %x, %c, %q, %t, and
+// for %+v when verb is 'F'. With methods, a value whose type has an Error or
+// String method is formatted as what it returns, unless it is a nil pointer;
+// fmt cannot call those of unexported fields.
+void formatValue(string& out, const RType* t, const void* p, char verb, const FormatMethod* methods) {
+    if (methods != nullptr && t->format != nullptr && strchr("vsqxXF", verb) != nullptr &&
+        !(t->pointerShaped && *static_cast<void* const*>(p) == nullptr)) {
+        string s = (*methods)(t, p);
+        formatString(out, s.data(), int64_t(s.size()), verb);
+        return;
+    }
+    switch (t->kind) {
+    case TY_BOOL: out += *static_cast<const uint8_t*>(p) ? "true" : "false"; break;
+    case TY_FLOAT32: formatFloat(out, *static_cast<const float*>(p), true); break;
+    case TY_FLOAT64: formatFloat(out, *static_cast<const double*>(p), false); break;
+    case TY_COMPLEX64: case TY_COMPLEX128: {
+        bool single = t->kind == TY_COMPLEX64;
+        double re = single ? static_cast<const float*>(p)[0] : static_cast<const double*>(p)[0];
+        double im = single ? static_cast<const float*>(p)[1] : static_cast<const double*>(p)[1];
+        out += "(";
+        formatFloat(out, re, single);
+        if (!(im < 0) && !std::isnan(im) && !std::isinf(im)) out += "+";
+        formatFloat(out, im, single);
+        out += "i)";
+        break;
+    }
+    case TY_STRING: {
+        auto* s = static_cast<const GoString*>(p);
+        formatString(out, s->ptr, s->len, verb);
+        break;
+    }
+    case TY_MAP:
+        if (verb != 'p') {
+            auto* m = *static_cast<GoMap* const*>(p);
+            vector<const uint64_t*> entries;
+            for (int64_t i = 0; m != nullptr && i < m->used; i++) {
+                if (m->entry(i)[0] != 0) entries.push_back(m->entry(i));
+            }
+            sort(entries.begin(), entries.end(), [&](auto a, auto b) { return compareKeys(t->key, a + 1, b + 1) < 0; });
+            out += "map[";
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (i > 0) out += ' ';
+                formatValue(out, t->key, entries[i] + 1, verb, methods);
+                out += ':';
+                formatValue(out, t->elem, entries[i] + m->valueWord, verb, methods);
+            }
+            out += ']';
+            break;
+        }
+        [[fallthrough]];
+    case TY_POINTER: case TY_UNSAFE_POINTER: case TY_CHAN: case TY_FUNC: {
+        void* q = *static_cast<void* const*>(p);
+        if (q == nullptr) {
+            out += "<nil>";
+        }
+        else if (t->kind == TY_POINTER && (t->elem->kind == TY_STRUCT || t->elem->kind == TY_ARRAY) && verb != 'p') {
+            out += '&';
+            formatValue(out, t->elem, q, verb, methods);
+        }
+        else {
+            appendFormat(out, "%p", q);
+        }
+        break;
+    }
+    case TY_SLICE: case TY_ARRAY: {
+        auto* s = static_cast<const GoSlice*>(p);
+        const char* elems = t->kind == TY_SLICE ? s->ptr : static_cast<const char*>(p);
+        int64_t n = t->kind == TY_SLICE ? s->len : t->length;
+        out += '[';
+        for (int64_t i = 0; i < n; i++) {
+            if (i > 0) out += ' ';
+            formatValue(out, t->elem, elems + i * t->elem->size, verb, methods);
+        }
+        out += ']';
+        break;
+    }
+    case TY_STRUCT:
+        out += '{';
+        for (size_t i = 0; i < t->fields.size(); i++) {
+            if (i > 0) out += ' ';
+            if (verb == 'F') {
+                out += symbols.text(t->fields[i].name);
+                out += ':';
+            }
+            bool exported = isupper((unsigned char)symbols.text(t->fields[i].name)[0]) != 0;
+            formatValue(out, t->fields[i].type, static_cast<const char*>(p) + t->fields[i].offset, verb,
+                exported ? methods : nullptr);
+        }
+        out += '}';
+        break;
+    case TY_INTERFACE: formatInterface(out, *static_cast<const GoInterface*>(p), verb, methods); break;
+    default: {
+        if (!isInteger(t->kind)) {
+            out += '?';
+            break;
+        }
+        int64_t v = intValue(t, p);
+        bool sign = !isUnsigned(t->kind);
+        if (verb == 'c' || verb == 'q') {
+            if (verb == 'q') out += '\'';
+            appendUtf8(out, v);
+            if (verb == 'q') out += '\'';
+        }
+        else if (verb == 'x') {
+            if (sign && v < 0) {
+                appendFormat(out, "-%llx", (unsigned long long)-uint64_t(v));
+            }
+            else {
+                appendFormat(out, "%llx", (unsigned long long)v);
+            }
+        }
+        else {
+            appendFormat(out, sign ? "%lld" : "%llu", (long long)v);
+        }
+        break;
+    }
+    }
+}
+// Printf with the verbs %v %d %s %q %x %c %t %f %e %g %p %T and %%, widths,
+// precisions and the - + 0 space # flags.
+void formatPrintf(string& out, const GoString& format, const GoInterface* args, int64_t count,
+    const FormatMethod* methods) {
+    int64_t next = 0;
+    for (int64_t i = 0; i < format.len; i++) {
+        char c = format.ptr[i];
+        if (c != '%' || i + 1 == format.len) {
+            out += c;
+            continue;
+        }
+        char spec[32] = "%";
+        int n = 1;
+        while (++i < format.len && strchr("-+ 0#", format.ptr[i]) != nullptr && n < 8) spec[n++] = format.ptr[i];
+        while (i < format.len && (isdigit((unsigned char)format.ptr[i]) || format.ptr[i] == '.') && n < 24) {
+            spec[n++] = format.ptr[i++];
+        }
+        if (i == format.len) break;
+        char verb = format.ptr[i];
+        if (verb == '%') {
+            out += '%';
+            continue;
+        }
+        if (next >= count) {
+            appendFormat(out, "%%!%c(MISSING)", verb);
+            continue;
+        }
+        const GoInterface& arg = args[next++];
+        const RType* t = arg.type;
+        if (verb == 'T') {
+            out += t == nullptr ? "<nil>" : t->name;
+            continue;
+        }
+        if (t != nullptr && (t->kind == TY_FLOAT32 || t->kind == TY_FLOAT64) && strchr("feEgG", verb) != nullptr) {
+            spec[n++] = verb;
+            spec[n] = 0;
+            appendFormat(out, spec, t->kind == TY_FLOAT32 ? *static_cast<const float*>(arg.data) : *static_cast<const double*>(arg.data));
+            continue;
+        }
+        // %x of a value with a String method is that of what it returns
+        if (t != nullptr && isInteger(t->kind) &&
+            (verb == 'd' || (t->format == nullptr && (verb == 'x' || verb == 'X')))) {
+            memcpy(spec + n, "ll", 2);
+            spec[n + 2] = verb != 'd' ? verb : isUnsigned(t->kind) ? 'u' : 'd';
+            spec[n + 3] = 0;
+            appendFormat(out, spec, (long long)intValue(t, arg.data));
+            continue;
+        }
+        string value;
+        formatInterface(value, arg, verb == 'v' && memchr(spec, '+', size_t(n)) != nullptr ? 'F' : verb, methods);
+        // the width and the - flag apply to the text as a whole
+        spec[n++] = 's';
+        spec[n] = 0;
+        if (n == 2) {
+            out += value;
+            continue;
+        }
+        char text[512];
+        snprintf(text, sizeof text, spec, value.c_str());
+        out += text;
+    }
+}
+
+//===--- bytecode ---===//
+
+// The operands of an instruction follow it, its registers first, then its
+// immediates.
+enum Bytecode : uint32_t {
+    // d a, d a, d a, d a n, d n, and d a setting d to the address of a
+    BC_MOV, BC_MOV2, BC_MOV3, BC_MOVN, BC_ZERO, BC_LEA,
+    // d a b on the 64 bits of the registers, ADDI d a adding immediate c, and
+    // EXT d a kind narrowing a into d as the load kind says
+    BC_ADD, BC_SUB, BC_MUL, BC_AND, BC_OR, BC_XOR, BC_ANDNOT, BC_ADDI,
+    BC_DIV, BC_DIVU, BC_MOD, BC_MODU, BC_SHL, BC_SHR, BC_SAR,
+    BC_NEG, BC_COMPL, BC_NOT, BC_EXT,
+    BC_FADD, BC_FSUB, BC_FMUL, BC_FDIV, BC_FNEG,
+    BC_FADD32, BC_FSUB32, BC_FMUL32, BC_FDIV32, BC_FNEG32,
+    BC_EQ, BC_NE, BC_LT, BC_LE, BC_LTU, BC_LEU,
+    BC_FEQ, BC_FNE, BC_FLT, BC_FLE, BC_FEQ32, BC_FNE32, BC_FLT32, BC_FLE32,
+    // target, c target, c target, and a b target comparing a with b
+    BC_JMP, BC_JT, BC_JF, BC_JEQ, BC_JNE, BC_JLT, BC_JLE, BC_JLTU, BC_JLEU,
+    // d a code, a conversion between integers and floats of cvtNames
+    BC_CVT,
+    // d p, d p kind, d p size; p a, p a size, p a size; d slot words, d size
+    BC_LD, BC_LDX, BC_LDN, BC_ST, BC_STX, BC_STN, BC_ALLOCA, BC_NEW,
+    // d p offset, d p i length size, d s i size, d a offset kind size,
+    // d a i length size kind, d s i, and d a offset size storing a into the
+    // memory of the registers at d
+    BC_FIELDADDR, BC_INDEXADDR, BC_SLICEADDR, BC_FLD, BC_INDEXARR, BC_INDEXSTR, BC_FST,
+    // d a b, d a b condition, d s i, d a code
+    BC_CONCAT, BC_SCMP, BC_STRNEXT, BC_CVTSTR,
+    // d x lo hi max mask kind size length, d len cap size, d s elems count
+    // size, d s t size, d dst src size
+    BC_SLICE, BC_MKSLICE, BC_APPEND, BC_APPENDS, BC_COPY,
+    // d hint type, d m key commaok words, m key value, m key, d m, d m, d it
+    BC_MKMAP, BC_MAPGET, BC_MAPSET, BC_MAPDEL, BC_MAPLEN, BC_MAPITER, BC_MAPNEXT,
+    // d size type, c x, d c commaok, c, d c cap, and d count default then
+    // send c x for every case, x being where a receive puts its value
+    BC_MKCHAN, BC_SEND, BC_RECV, BC_CLOSE, BC_CHANLEN, BC_SELECT,
+    // d x type, d x type source commaok, d x type source commaok, d a b type,
+    // d a b
+    BC_MKIFACE, BC_ASSERT, BC_ASSERTI, BC_EQT, BC_IEQ,
+    // d function count and the captured addresses, d index
+    BC_CLOSURE, BC_FREEVAR,
+    // out function, f out, i out name cache, out extern count, out target kind
+    // words name for both DEFER and GO, -, -, x, d, out count newline, -
+    BC_CALL, BC_CALLV, BC_CALLM, BC_CALLX, BC_DEFER, BC_GO, BC_RUNDEFERS, BC_RET, BC_PANIC, BC_RECOVER, BC_PRINT,
+    BC_UNWIND,
+};
+constexpr const char* bytecodeNames[] = { "mov", "mov2", "mov3", "movn", "zero", "lea",
+    "add", "sub", "mul", "and", "or", "xor", "andnot", "addi", "div", "divu", "mod", "modu", "shl", "shr", "sar",
+    "neg", "compl", "not", "ext", "fadd", "fsub", "fmul", "fdiv", "fneg", "fadd32", "fsub32", "fmul32", "fdiv32", "fneg32",
+    "eq", "ne", "lt", "le", "ltu", "leu", "feq", "fne", "flt", "fle", "feq32", "fne32", "flt32", "fle32",
+    "jmp", "jt", "jf", "jeq", "jne", "jlt", "jle", "jltu", "jleu", "cvt",
+    "ld", "ldx", "ldn", "st", "stx", "stn", "alloca", "new",
+    "fieldaddr", "indexaddr", "sliceaddr", "fld", "indexarr", "indexstr", "fst",
+    "concat", "scmp", "strnext", "cvtstr", "slice", "mkslice", "append", "appends", "copy",
+    "mkmap", "mapget", "mapset", "mapdel", "maplen", "mapiter", "mapnext",
+    "mkchan", "send", "recv", "close", "chanlen", "select",
+    "mkiface", "assert", "asserti", "eqt", "ieq", "closure", "freevar",
+    "call", "callv", "callm", "callx", "defer", "go", "rundefers", "ret", "panic", "recover", "print", "unwind" };
+static_assert(sizeof(bytecodeNames) / sizeof(bytecodeNames[0]) == BC_UNWIND + 1, "every bytecode needs a name");
+
+// The conversions of BC_CVT, by code.
+enum Conversion : uint32_t {
+    CV_INT_F64, CV_UINT_F64, CV_INT_F32, CV_UINT_F32, CV_F64_INT, CV_F64_UINT, CV_F32_INT, CV_F32_UINT,
+    CV_F32_F64, CV_F64_F32
+};
+// The string conversions of BC_CVTSTR, by code.
+enum StringConversion : uint32_t { SC_RUNE, SC_BYTES, SC_RUNES, SC_TO_BYTES, SC_TO_RUNES };
+// The functions of other packages the interpreter implements, by id.
+enum Extern : uint32_t { EX_PRINT, EX_PRINTLN, EX_PRINTF, EX_EXIT, EX_GOSCHED };
+
+// A compiled function. Its frame holds the arguments and the results, then
+// the values of its body, its local variables, the constants, and last the
+// arguments of the calls it makes, which are the start of the callee frame.
+struct Code {
+    const Function* function;
+    vector<uint32_t> code;
+    // copied to the frame from constantBase on when the function is entered
+    vector<uint64_t> constants;
+    uint32_t constantBase = 0, outBase = 0, frameWords = 0, argsWords = 0, resultWords = 0;
+    // where a function whose deferred call recovered goes on, with the
+    // remaining deferred calls, or none without defer statements
+    uint32_t recovery = UINT32_MAX;
+    // the method a BC_CALLM found last, which is the one of a dynamic type
+    // when it lies among the methods of that type; goroutines on other
+    // threads may replace it at any time
+    mutable deque<atomic<const RType::Method*>> caches;
+};
+
+struct Interpreter;
+
+// Translates one function to bytecode.
+struct BytecodeCompiler {
+    // tags of registers whose place is only known once the body is done
+    static constexpr uint32_t CONSTANT = 1u << 31, ZEROS = 1u << 30, OUT = 1u << 29, INDEX = OUT - 1;
+
+    Interpreter& interp;
+    const Module& module;
+    const Function& f;
+    Code& c;
+    Signature signature;
+    vector<uint32_t> registers, uses;
+    vector<bool> fused;
+    unordered_map<uint64_t, uint32_t> constantIndex;
+    unordered_map<string, uint32_t> stringIndex;
+    uint32_t cursor = 0, zeroWords = 0, outWords = 0;
+    // operands to place once the body is done, and jumps to blocks
+    vector<uint32_t> tagged;
+    vector<pair<uint32_t, BlockId>> jumps;
+    vector<uint32_t> blockStart;
+    struct Stub {
+        uint32_t jump;
+        BlockId from, to;
+    };
+    vector<Stub> stubs;
+
+    BytecodeCompiler(Interpreter& interp, const Module& module, uint32_t index, Code& c)
+        : interp(interp), module(module), f(module.functions[index]), c(c), signature(f.receiver, f.type) {}
+
+    [[noreturn]] static void unsupported(const string& what) { throw runtime_error(what + " is not supported by the interpreter"); }
+    const Type* typeOf(ValueId v) const { return f.values[v].type; }
+    static uint32_t wordsIn(const Type* t) { return uint32_t(align8(layoutOf(t).size) / 8); }
+
+    //===--- registers ---===//
+
+    uint32_t constant(uint64_t bits) {
+        auto [it, fresh] = constantIndex.try_emplace(bits, uint32_t(c.constants.size()));
+        if (fresh) c.constants.push_back(bits);
+        return CONSTANT | it->second;
+    }
+    uint32_t constant(const void* p) { return constant(uint64_t(uintptr_t(p))); }
+    uint32_t stringConstant(const string& s) {
+        auto [it, fresh] = stringIndex.try_emplace(s, uint32_t(c.constants.size()));
+        if (fresh) {
+            GoString g = heapString(s);
+            c.constants.push_back(uint64_t(uintptr_t(g.ptr)));
+            c.constants.push_back(uint64_t(g.len));
+        }
+        return CONSTANT | it->second;
+    }
+    uint32_t zeros(uint32_t words) {
+        zeroWords = max(zeroWords, words);
+        return ZEROS;
+    }
+    // Out area words from offset on, for the arguments of a call or scratch.
+    uint32_t out(uint32_t offset, uint32_t words) {
+        outWords = max(outWords, offset + words);
+        return OUT | offset;
+    }
+    uint32_t reg(ValueId v) const {
+        if (registers[v] == UINT32_MAX) unsupported("a value of type " + (typeOf(v) ? typeString(typeOf(v)) : string("none")));
+        return registers[v];
+    }
+    void assign();
+
+    //===--- emission ---===//
+
+    void operand(uint32_t r) {
+        if (r & (CONSTANT | ZEROS | OUT)) tagged.push_back(uint32_t(c.code.size()));
+        c.code.push_back(r);
+    }
+    void emit(Bytecode op, initializer_list<uint32_t> regs, initializer_list<uint32_t> immediates = {}) {
+        c.code.push_back(op);
+        for (uint32_t r : regs) operand(r);
+        c.code.insert(c.code.end(), immediates.begin(), immediates.end());
+    }
+    // Copies words registers from a to d.
+    void move(uint32_t d, uint32_t a, uint32_t words) {
+        if (words == 0 || d == a) return;
+        if (words <= 3) {
+            emit(words == 1 ? BC_MOV : words == 2 ? BC_MOV2 : BC_MOV3, { d, a });
+            return;
+        }
+        emit(BC_MOVN, { d, a }, { words });
+    }
+    // Brings register d, holding the 64 bits of a result of type t, back to a
+    // narrow integer of t.
+    void narrow(const Type* t, uint32_t d) {
+        LoadKind k = loadKind(t);
+        if (k != LD_WORD && k != LD_BYTES && isInteger(kindOf(t))) emit(BC_EXT, { d, d }, { k });
+    }
+    // Jumps hold the distance from the start of their instruction.
+    void jump(Bytecode op, initializer_list<uint32_t> regs, BlockId to) {
+        emit(op, regs, { uint32_t(c.code.size()) });
+        jumps.push_back({ uint32_t(c.code.size() - 1), to });
+    }
+
+    void compile();
+    void load(uint32_t d, uint32_t p, const Type* t);
+    void store(uint32_t p, uint32_t x, const Type* t);
+    void instruction(ValueId v);
+    void arithmetic(ValueId v);
+    void compare(ValueId v);
+    void convert(ValueId v);
+    void call(ValueId v);
+    uint32_t marshal(ValueId v);
+    uint32_t interfaces(const Function::Operands& args, size_t first, bool wrap);
+    void edge(BlockId from, BlockId to);
+    void branch(BlockId b, ValueId v, BlockId next);
+};
+
+//===--- execution ---===//
+
+// A goroutine outgrowing the stack limit, which is fatal.
+struct StackOverflow {};
+
+struct GoChannel;
+
+// The state of a goroutine: its stack segments, the calls under way and their
+// deferred calls, the panics unwinding it, and where it goes on when it runs
+// next.
+struct Goroutine {
+    enum CallFlag : uint8_t {
+        // the callee frame starts a segment, its results go back to resultsTo
+        CF_SEGMENT = 1,
+        // a deferred call run by a panic, which recover stops
+        CF_RECOVERABLE = 2,
+    };
+    // where a call returns to, none for the one a goroutine starts with
+    struct CallInfo {
+        const Code* code;
+        const uint32_t* pc;
+        uint64_t* fp;
+        uint64_t* ctx;
+        uint64_t* resultsTo;
+        uint8_t flags;
+    };
+    // a call made later, deferred or the one a go statement starts
+    struct Deferred {
+        // of the frame that deferred it, the number of calls under way
+        size_t depth;
+        const Code* code;
+        uint64_t* ctx;
+        // a function of another package, its arguments being interfaces
+        uint32_t external;
+        vector<uint64_t> args;
+    };
+    struct Panic {
+        GoInterface value;
+        // of the frame it has unwound to
+        size_t depth;
+        bool recovered;
+    };
+    struct Segment {
+        unique_ptr<uint64_t[]> words;
+        size_t size;
+    };
+    // waiting on a channel for a case of a select, or for the one send or
+    // receive, in the queue of its senders or receivers
+    struct Waiter {
+        Goroutine* g;
+        GoChannel* channel;
+        // the value sent, or where the value received goes
+        uint64_t* data;
+        Waiter* prev;
+        Waiter* next;
+        int32_t index;
+        bool send, linked;
+    };
+    static constexpr size_t firstSegment = 256, stackLimit = (size_t(1) << 30) / 8;
+
+    vector<Segment> segments;
+    size_t segment = 0, stackWords = 0;
+    uint64_t* limit = nullptr;
+    vector<CallInfo> calls;
+    vector<Deferred> defers;
+    vector<Panic> panics;
+    // the call it starts with, then where it stopped, no code before it runs
+    Deferred start;
+    const Code* code = nullptr;
+    const uint32_t* pc = nullptr;
+    uint64_t* fp = nullptr;
+    uint64_t* ctx = nullptr;
+    // the arguments of a method called through an interface, being put
+    // together
+    vector<uint64_t> staging;
+    // Blocked on channels, kept to reuse. The first channel to wake it sets
+    // the case it woke for; an unbuffered channel hands the value over as it
+    // does, the others have it try again.
+    vector<Waiter> waiters;
+    atomic<int32_t> wokenBy{ -1 };
+    bool handed = false, received = false;
+    // for the order select looks at its cases in
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+    // The start of the first segment, which a goroutine only gets once it
+    // runs, so that those waiting their turn stay small.
+    uint64_t* base() {
+        if (segments.empty()) segments.push_back({ make_unique<uint64_t[]>(firstSegment), firstSegment });
+        stackWords = segments[0].size;
+        segment = 0;
+        limit = segments[0].words.get() + segments[0].size;
+        return segments[0].words.get();
+    }
+    // Readies a finished goroutine for another go statement, its first
+    // segment handed back for the next goroutine to run.
+    Segment reset() {
+        Segment first = segments.empty() ? Segment{} : move(segments[0]);
+        segments.clear();
+        segment = 0;
+        calls.clear();
+        defers.clear();
+        panics.clear();
+        start = {};
+        code = nullptr;
+        waiters.clear();
+        return first;
+    }
+    // The frame of callee at, or at the start of the next segment when it
+    // does not fit, the arguments copied there from args. The call returns
+    // as info says.
+    uint64_t* enter(const Code* callee, uint64_t* at, const uint64_t* args, size_t argWords, CallInfo info) {
+        if (at + callee->frameWords > limit) {
+            size_t need = callee->frameWords;
+            if (++segment == segments.size() || segments[segment].size < need) {
+                size_t size = max(segments[segment - 1].size * 2, need);
+                if (stackWords + size > stackLimit) throw StackOverflow{};
+                if (segment == segments.size()) segments.emplace_back();
+                stackWords += size - segments[segment].size;
+                segments[segment] = { make_unique<uint64_t[]>(size), size };
+            }
+            if (args == nullptr) {
+                args = at;
+                argWords = callee->argsWords;
+            }
+            // the results of the call a goroutine starts with go nowhere
+            if (info.resultsTo == nullptr && info.code != nullptr) info.resultsTo = at + callee->argsWords;
+            info.flags |= CF_SEGMENT;
+            at = segments[segment].words.get();
+            limit = at + segments[segment].size;
+        }
+        if (args != nullptr) memmove(at, args, argWords * 8);
+        if (info.resultsTo == at + callee->argsWords) info.resultsTo = nullptr;
+        calls.push_back(info);
+        if (!callee->constants.empty()) {
+            memcpy(at + callee->constantBase, callee->constants.data(), callee->constants.size() * 8);
+        }
+        return at;
+    }
+    // Pops the call under way, its results copied to where the caller wants.
+    CallInfo leave(const Code* code, uint64_t* fp) {
+        CallInfo info = calls.back();
+        if (info.resultsTo != nullptr) memmove(info.resultsTo, fp + code->argsWords, code->resultWords * 8);
+        if (info.flags & CF_SEGMENT) {
+            segment--;
+            limit = segments[segment].words.get() + segments[segment].size;
+        }
+        calls.pop_back();
+        return info;
+    }
+};
+
+// How a goroutine stopped running.
+enum Stop : uint8_t { ST_DONE, ST_YIELDED, ST_PARKED };
+
+// The goroutines waiting on a channel to send or to receive, first come first
+// woken. The count is read without the lock.
+struct WaitQueue {
+    Goroutine::Waiter* first = nullptr;
+    Goroutine::Waiter* last = nullptr;
+    atomic<int32_t> count{ 0 };
+
+    void push(Goroutine::Waiter* w) {
+        w->prev = last;
+        w->next = nullptr;
+        (last != nullptr ? last->next : first) = w;
+        last = w;
+        w->linked = true;
+        count.fetch_add(1, memory_order_relaxed);
+    }
+    void remove(Goroutine::Waiter* w) {
+        (w->prev != nullptr ? w->prev->next : first) = w->next;
+        (w->next != nullptr ? w->next->prev : last) = w->prev;
+        w->linked = false;
+        count.fetch_sub(1, memory_order_relaxed);
+    }
+    // The first goroutine in the queue nothing has woken yet, taken off it
+    // and claimed for the case of its waiter. Those woken already go too.
+    Goroutine::Waiter* claim() {
+        while (Goroutine::Waiter* w = first) {
+            remove(w);
+            int32_t none = -1;
+            if (w->g->wokenBy.compare_exchange_strong(none, w->index)) return w;
+        }
+        return nullptr;
+    }
+};
+
+// A channel. The values of a buffered one are in a ring that sends and
+// receives use without the lock: every slot has a sequence number, followed by
+// the value, which says whose turn the slot is, twice the position of the
+// send that fills it next, or one more for the receive that empties it. The lock guards the goroutines waiting and the
+// closing. A goroutine only waits once it has counted itself in a queue and
+// looked at the ring again, and the one that gets past the ring without the
+// lock looks at that count afterwards, so no wake-up is missed. An unbuffered
+// channel hands the value from one goroutine to the other under the lock.
+struct GoChannel {
+    const RType* elem;
+    int64_t capacity;
+    uint32_t words;
+    atomic<bool> closed{ false };
+    uint64_t* ring = nullptr;
+    // the positions of the next send and receive, a cache line apart
+    atomic<uint64_t> sendx{ 0 };
+    char sendPad[56];
+    atomic<uint64_t> recvx{ 0 };
+    char recvPad[56];
+    mutex lock;
+    WaitQueue senders, receivers;
+
+    GoChannel(const RType* elem, int64_t capacity)
+        : elem(elem), capacity(capacity), words(uint32_t(align8(elem->size) / 8)) {
+        if (capacity == 0) return;
+        ring = static_cast<uint64_t*>(heapAllocate(size_t(capacity) * (1 + words) * 8));
+        for (int64_t i = 0; i < capacity; i++) new (slot(uint64_t(i))) atomic<uint64_t>(uint64_t(i) * 2);
+    }
+    atomic<uint64_t>* slot(uint64_t position) {
+        return reinterpret_cast<atomic<uint64_t>*>(ring + position % uint64_t(capacity) * (1 + words));
+    }
+    // the value of the slot, plain words after its sequence number
+    uint64_t* valueAt(uint64_t position) { return ring + position % uint64_t(capacity) * (1 + words) + 1; }
+    // Puts the value at value in the ring unless it is full.
+    bool push(const uint64_t* value) {
+        uint64_t position = sendx.load(memory_order_relaxed);
+        for (;;) {
+            atomic<uint64_t>* s = slot(position);
+            int64_t turn = int64_t(s->load(memory_order_acquire) - position * 2);
+            if (turn == 0) {
+                if (sendx.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                    writeBarrier(valueAt(position), words * 8);
+                    memcpy(valueAt(position), value, words * 8);
+                    s->store(position * 2 + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0) {
+                return false;
+            }
+            else {
+                position = sendx.load(memory_order_relaxed);
+            }
+        }
+    }
+    // Takes the first value of the ring to value unless it is empty.
+    bool pop(uint64_t* value) {
+        uint64_t position = recvx.load(memory_order_relaxed);
+        for (;;) {
+            atomic<uint64_t>* s = slot(position);
+            int64_t turn = int64_t(s->load(memory_order_acquire) - (position * 2 + 1));
+            if (turn == 0) {
+                if (recvx.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                    memcpy(value, valueAt(position), words * 8);
+                    s->store((position + uint64_t(capacity)) * 2, memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0) {
+                return false;
+            }
+            else {
+                position = recvx.load(memory_order_relaxed);
+            }
+        }
+    }
+    int64_t length() const {
+        int64_t n = int64_t(sendx.load(memory_order_relaxed) - recvx.load(memory_order_relaxed));
+        return min(max<int64_t>(n, 0), capacity);
+    }
+};
+
+struct Scheduler;
+
+// Compiles the functions main.main and the package initializers reach, then
+// runs them.
+struct Interpreter {
+    const Module& module;
+    // by function, none for those not reached
+    vector<unique_ptr<Code>> codes;
+    vector<uint32_t> pending;
+    vector<string> errors;
+    unordered_map<const Type*, RType*> typeIndex;
+    deque<RType> types;
+    vector<void*> globals;
+    vector<uint64_t*> functionValues;
+    const RType* stringType;
+    // standard output and error when capturing, otherwise they are written
+    // through at once as Go does; nothing is written once the program has
+    // ended
+    string output;
+    bool capture = false, ended = false;
+    mutex outputLock;
+    // threads running goroutines, GOMAXPROCS or one per core
+    int workers = defaultWorkers();
+    Scheduler* scheduler = nullptr;
+
+    explicit Interpreter(const Module& module)
+        : module(module), codes(module.functions.size()), globals(module.globals.size()),
+        functionValues(module.functions.size()) {
+        stringType = rtype(basicType(TY_STRING));
+    }
+
+    uint32_t function(uint32_t f) {
+        if (codes[f] == nullptr) {
+            codes[f] = make_unique<Code>();
+            codes[f]->function = &module.functions[f];
+            pending.push_back(f);
+        }
+        return f;
+    }
+    void* global(uint32_t g) {
+        if (globals[g] == nullptr) globals[g] = heapAllocate(size_t(layoutOf(module.globals[g].type).size));
+        return globals[g];
+    }
+    // Function f as a value, a closure without captured variables.
+    uint64_t* functionValue(uint32_t f) {
+        if (functionValues[f] == nullptr) {
+            functionValues[f] = static_cast<uint64_t*>(heapAllocate(8));
+            functionValues[f][0] = uint64_t(uintptr_t(codes[function(f)].get()));
+        }
+        return functionValues[f];
+    }
+    const RType* rtype(const Type* t);
+    void compile();
+
+    // The value a run-time error panics with.
+    GoInterface faultValue(const string& message) {
+        auto* s = static_cast<GoString*>(heapAllocate(sizeof(GoString)));
+        *s = heapString(message);
+        return { stringType, s };
+    }
+    static int defaultWorkers() {
+        const char* n = getenv("GOMAXPROCS");
+        if (n != nullptr && atoi(n) > 0) return atoi(n);
+        return max(1, int(thread::hardware_concurrency()));
+    }
+    void write(FILE* stream, const string& text);
+    bool end(const string& message);
+    void external(Goroutine& g, uint32_t id, const GoInterface* args, int64_t count);
+    string callFormat(Goroutine& g, const RType* t, const void* p);
+    void print(const GoInterface* args, int64_t count, bool newline);
+    const Code* method(const GoInterface& receiver, Symbol name, const RType::Method*& m);
+    Goroutine::Deferred deferred(Goroutine& g, const uint32_t* pc, uint64_t* fp);
+    void deferredExternal(Goroutine& g);
+    void start(Goroutine& g, const Code* entry, uint64_t* ctx, const vector<uint64_t>& args);
+    bool send(Goroutine& g, GoChannel* c, const uint64_t* value);
+    bool receive(Goroutine& g, GoChannel* c, uint64_t* value, bool& ok);
+    void close(GoChannel* c);
+    bool select(Goroutine& g, const uint32_t* pc, uint64_t* fp);
+    Stop execute(Goroutine& g);
+    int run();
+};
+
+//===--- translation ---===//
+
+const RType* Interpreter::rtype(const Type* t) {
+    t = concreteType(t);
+    auto it = typeIndex.find(t);
+    if (it != typeIndex.end()) return it->second;
+    for (auto& r : types) {
+        if (t->canonical || !identical(r.type, t)) continue;
+        typeIndex.emplace(t, &r);
+        return &r;
+    }
+    // registered before it is filled in, for the types that refer to it
+    RType& r = types.emplace_back();
+    typeIndex.emplace(t, &r);
+    const Type* u = underlying(t);
+    r.type = t;
+    r.kind = u->kind;
+    r.load = loadKind(t);
+    r.pointerShaped = isPointerShaped(t);
+    r.size = layoutOf(t).size;
+    r.name = typeString(t);
+    switch (u->kind) {
+    case TY_ARRAY:
+        r.elem = rtype(static_cast<const ArrayType*>(u)->elem);
+        r.length = static_cast<const ArrayType*>(u)->length;
+        break;
+    case TY_SLICE: r.elem = rtype(static_cast<const SliceType*>(u)->elem); break;
+    case TY_POINTER: r.elem = rtype(static_cast<const PointerType*>(u)->base); break;
+    case TY_CHAN: r.elem = rtype(static_cast<const ChanType*>(u)->elem); break;
+    case TY_MAP:
+        r.key = rtype(static_cast<const MapType*>(u)->key);
+        r.elem = rtype(static_cast<const MapType*>(u)->elem);
+        break;
+    case TY_STRUCT: {
+        auto* s = static_cast<const StructType*>(u);
+        for (size_t i = 0; i < s->fields.size(); i++) {
+            r.fields.push_back({ rtype(s->fields[i].type), fieldOffset(s, i), s->fields[i].name });
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    const Object* format = nullptr;
+    auto methodsOf = [&](const NamedType* named, bool pointer) {
+        for (Object* m : named->methods) {
+            auto f = module.functionIndex.find(m);
+            if (f == module.functionIndex.end() || (m->pointerReceiver && !pointer)) continue;
+            bool indirect = !m->pointerReceiver && (pointer || !isPointerShaped(named));
+            r.methods.push_back({ m->name, function(f->second), indirect, loadKind(named), layoutOf(named).size });
+            if (isFormatMethod(m) && (format == nullptr || symbols.text(m->name) == "Error")) format = m;
+        }
+    };
+    if (t->kind == TY_NAMED && u->kind != TY_INTERFACE) methodsOf(static_cast<const NamedType*>(t), false);
+    if (u->kind == TY_POINTER) {
+        const Type* base = static_cast<const PointerType*>(u)->base;
+        if (base->kind == TY_NAMED && kindOf(base) != TY_INTERFACE && kindOf(base) != TY_POINTER) {
+            methodsOf(static_cast<const NamedType*>(base), true);
+        }
+    }
+    if (u->kind == TY_INTERFACE) {
+        auto* iface = static_cast<const InterfaceType*>(u);
+        complete(iface);
+        for (auto& m : iface->methods) r.methods.push_back({ m.name, UINT32_MAX, false, LD_WORD, 0 });
+    }
+    sort(r.methods.begin(), r.methods.end(), [](auto& a, auto& b) { return a.name < b.name; });
+    if (format != nullptr) r.format = r.method(format->name);
+    return &r;
+}
+
+void Interpreter::compile() {
+    if (module.entry == UINT32_MAX) throw runtime_error("function main is undeclared in the main package");
+    for (uint32_t init : module.inits) function(init);
+    function(module.entry);
+    while (!pending.empty()) {
+        uint32_t f = pending.back();
+        pending.pop_back();
+        try {
+            BytecodeCompiler(*this, module, f, *codes[f]).compile();
+        }
+        catch (const runtime_error& e) {
+            errors.push_back(module.functions[f].name + ": " + e.what());
+        }
+    }
+    if (!errors.empty()) {
+        string message;
+        for (auto& error : errors) message += (message.empty() ? "" : "\n") + error;
+        throw runtime_error(message);
+    }
+}
+
+void BytecodeCompiler::assign() {
+    size_t n = f.values.size();
+    registers.assign(n, UINT32_MAX);
+    cursor = uint32_t(signature.size / 8);
+    for (ValueId v = 1; v < n; v++) {
+        const Value& x = f.values[v];
+        const Type* t = x.type;
+        if (t == nullptr || t->kind == TY_INVALID) continue;
+        if (t->kind == TY_UNTYPED_NIL) {
+            registers[v] = zeros(3);
+            continue;
+        }
+        switch (x.op) {
+        case IR_CONST: {
+            if (isComplex(kindOf(t))) unsupported("complex numbers");
+            uint64_t bits = uint64_t(x.aux);
+            if (kindOf(t) == TY_FLOAT32) {
+                double d;
+                memcpy(&d, &x.aux, sizeof d);
+                float single = float(d);
+                uint32_t b;
+                memcpy(&b, &single, sizeof b);
+                bits = b;
+            }
+            registers[v] = constant(extend(bits, loadKind(t)));
+            break;
+        }
+        case IR_STRING: registers[v] = stringConstant(f.strings[x.aux]); break;
+        case IR_ZERO: registers[v] = zeros(wordsOf(t)); break;
+        case IR_GLOBAL: registers[v] = constant(interp.global(uint32_t(x.aux))); break;
+        case IR_FUNC: registers[v] = constant(interp.functionValue(uint32_t(x.aux))); break;
+        case IR_PARAM: registers[v] = uint32_t(signature.params[x.aux] / 8); break;
+        default:
+            registers[v] = cursor;
+            cursor += wordsOf(t);
+            break;
+        }
+    }
+}
+
+void BytecodeCompiler::compile() {
+    if (f.blocks.empty()) throw runtime_error("function without body");
+    assign();
+    size_t n = f.values.size();
+    uses.assign(n, 0);
+    fused.assign(n, false);
+    vector<uint32_t> variables(n, 0);
+    bool defers = false;
+    for (ValueId v = 1; v < n; v++) {
+        const Value& x = f.values[v];
+        for (ValueId a : f.args(v)) uses[a]++;
+        if (x.op == IR_ALLOC && !(x.flags & V_HEAP)) {
+            variables[v] = cursor;
+            cursor += wordsOf(static_cast<const PointerType*>(underlying(x.type))->base);
+        }
+        // a function that ends in a panic has deferred calls but no
+        // RunDefers, it still returns when one of them recovers
+        defers = defers || x.op == IR_RUN_DEFERS || (x.op >= IR_CALL && x.op <= IR_CALL_METHOD && (x.flags & V_DEFER));
+    }
+    for (auto& block : f.blocks) {
+        size_t count = block.values.size();
+        if (count < 2 || f.values[block.values.back()].op != IR_BRANCH) continue;
+        ValueId c = block.values[count - 2];
+        const Value& x = f.values[c];
+        if (f.args(block.values.back())[0] != c || uses[c] != 1 || x.op < IR_EQ || x.op > IR_GE) continue;
+        const Type* t = typeOf(f.args(c)[0]);
+        fused[c] = !isAggregate(t) && !isFloat(kindOf(t));
+    }
+    blockStart.assign(f.blocks.size(), 0);
+    for (BlockId b = 0; b < f.blocks.size(); b++) {
+        blockStart[b] = uint32_t(c.code.size());
+        BlockId next = b + 1 < f.blocks.size() ? b + 1 : noBlock;
+        for (ValueId v : f.blocks[b].values) {
+            const Value& x = f.values[v];
+            auto args = f.args(v);
+            switch (x.op) {
+            case IR_ALLOC:
+                if (x.flags & V_HEAP) {
+                    emit(BC_NEW, { reg(v) }, { uint32_t(layoutOf(static_cast<const PointerType*>(underlying(x.type))->base).size) });
+                }
+                else {
+                    uint32_t words = wordsOf(static_cast<const PointerType*>(underlying(x.type))->base);
+                    emit(BC_ALLOCA, { reg(v) }, { variables[v], words });
+                }
+                break;
+            case IR_JUMP: {
+                BlockId to = f.blocks[b].succs[0];
+                edge(b, to);
+                if (to != next) jump(BC_JMP, {}, to);
+                break;
+            }
+            case IR_BRANCH: branch(b, v, next); break;
+            case IR_RETURN:
+                for (size_t i = 0; i < args.size(); i++) {
+                    move(uint32_t(signature.results[i] / 8), reg(args[i]), wordsIn(f.type->results->types[i]));
+                }
+                emit(BC_RET, {});
+                break;
+            case IR_PANIC: emit(BC_PANIC, { reg(args[0]) }); break;
+            default: instruction(v); break;
+            }
+        }
+    }
+    for (auto& stub : stubs) {
+        c.code[stub.jump] = uint32_t(c.code.size()) - c.code[stub.jump];
+        edge(stub.from, stub.to);
+        jump(BC_JMP, {}, stub.to);
+    }
+    if (defers) {
+        // the named results as the deferred calls leave them, zero for the
+        // others
+        c.recovery = uint32_t(c.code.size());
+        emit(BC_RUNDEFERS, {});
+        auto& results = f.type->results->types;
+        for (size_t i = 0; i < results.size(); i++) {
+            uint32_t d = uint32_t(signature.results[i] / 8), words = wordsIn(results[i]);
+            if (i < f.namedResults.size() && f.namedResults[i] != 0) {
+                load(d, reg(f.namedResults[i]), results[i]);
+            }
+            else if (words > 0) {
+                emit(BC_ZERO, { d }, { words });
+            }
+        }
+        emit(BC_RET, {});
+    }
+    for (auto [at, to] : jumps) c.code[at] = blockStart[to] - c.code[at];
+    c.argsWords = uint32_t(signature.argsSize / 8);
+    c.resultWords = uint32_t((signature.size - signature.argsSize) / 8);
+    c.constantBase = cursor;
+    uint32_t zeroBase = cursor + uint32_t(c.constants.size());
+    c.constants.resize(c.constants.size() + zeroWords);
+    c.outBase = zeroBase + zeroWords;
+    c.frameWords = c.outBase + outWords;
+    for (uint32_t at : tagged) {
+        uint32_t r = c.code[at];
+        c.code[at] = (r & CONSTANT ? c.constantBase : r & ZEROS ? zeroBase : c.outBase) + (r & INDEX);
+    }
+}
+
+void BytecodeCompiler::load(uint32_t d, uint32_t p, const Type* t) {
+    LoadKind k = loadKind(t);
+    if (k == LD_WORD) {
+        emit(BC_LD, { d, p });
+    }
+    else if (k == LD_BYTES) {
+        emit(BC_LDN, { d, p }, { uint32_t(layoutOf(t).size) });
+    }
+    else {
+        emit(BC_LDX, { d, p }, { k });
+    }
+}
+
+void BytecodeCompiler::store(uint32_t p, uint32_t x, const Type* t) {
+    int64_t size = layoutOf(t).size;
+    if (loadKind(t) == LD_WORD) {
+        emit(BC_ST, { p, x });
+    }
+    else if (size == 1 || size == 2 || size == 4) {
+        emit(BC_STX, { p, x }, { uint32_t(size) });
+    }
+    else {
+        emit(BC_STN, { p, x }, { uint32_t(size) });
+    }
+}
+
+void BytecodeCompiler::instruction(ValueId v) {
+    const Value& x = f.values[v];
+    auto args = f.args(v);
+    const Type* t = x.type;
+    switch (x.op) {
+    case IR_CONST: case IR_STRING: case IR_ZERO: case IR_PARAM: case IR_GLOBAL: case IR_FUNC: case IR_PHI:
+        break;
+    case IR_FREE_VAR: emit(BC_FREEVAR, { reg(v) }, { uint32_t(x.aux) }); break;
+    case IR_MAKE_CLOSURE:
+        emit(BC_CLOSURE, { reg(v) }, { interp.function(uint32_t(x.aux)), uint32_t(args.size()) });
+        for (ValueId a : args) operand(reg(a));
+        break;
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_AND_NOT: case IR_SHL: case IR_SHR: case IR_NEG: case IR_COMPL: case IR_NOT:
+        arithmetic(v);
+        break;
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        if (!fused[v]) compare(v);
+        break;
+    case IR_CONVERT: convert(v); break;
+    case IR_MAKE_INTERFACE: {
+        const Type* from = typeOf(args[0]);
+        if (from->kind == TY_UNTYPED_NIL) {
+            emit(BC_ZERO, { reg(v) }, { 2 });
+        }
+        else if (kindOf(from) == TY_INTERFACE) {
+            move(reg(v), reg(args[0]), 2);
+        }
+        else {
+            emit(BC_MKIFACE, { reg(v), reg(args[0]), constant(interp.rtype(from)) });
+        }
+        break;
+    }
+    case IR_TYPE_ASSERT: {
+        bool commaOk = x.flags & V_COMMA_OK;
+        const Type* asserted = commaOk ? static_cast<const TupleType*>(t)->types[0] : t;
+        emit(kindOf(asserted) == TY_INTERFACE ? BC_ASSERTI : BC_ASSERT,
+            { reg(v), reg(args[0]), constant(interp.rtype(asserted)), constant(interp.rtype(typeOf(args[0]))) }, { commaOk });
+        break;
+    }
+    case IR_ALLOC: break;
+    case IR_LOAD: load(reg(v), reg(args[0]), t); break;
+    case IR_STORE:
+        store(reg(args[0]), reg(args[1]), static_cast<const PointerType*>(underlying(typeOf(args[0])))->base);
+        break;
+    case IR_FIELD_ADDR: {
+        auto* s = underlyingAs<StructType>(static_cast<const PointerType*>(underlying(typeOf(args[0])))->base, TY_STRUCT);
+        emit(BC_FIELDADDR, { reg(v), reg(args[0]) }, { uint32_t(fieldOffset(s, size_t(x.aux))) });
+        break;
+    }
+    case IR_INDEX_ADDR: {
+        const Type* base = underlying(typeOf(args[0]));
+        uint32_t size = uint32_t(layoutOf(static_cast<const PointerType*>(underlying(t))->base).size);
+        if (base->kind == TY_POINTER) {
+            auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(base)->base, TY_ARRAY);
+            if (a == nullptr) unsupported("indexing " + typeString(base));
+            emit(BC_INDEXADDR, { reg(v), reg(args[0]), reg(args[1]) }, { uint32_t(a->length), size });
+        }
+        else {
+            emit(BC_SLICEADDR, { reg(v), reg(args[0]), reg(args[1]) }, { size });
+        }
+        break;
+    }
+    case IR_FIELD: {
+        auto* s = underlyingAs<StructType>(typeOf(args[0]), TY_STRUCT);
+        emit(BC_FLD, { reg(v), reg(args[0]) },
+            { uint32_t(fieldOffset(s, size_t(x.aux))), loadKind(t), uint32_t(layoutOf(t).size) });
+        break;
+    }
+    case IR_EXTRACT: {
+        auto* tuple = static_cast<const TupleType*>(typeOf(args[0]));
+        if (tuple->kind != TY_TUPLE) unsupported("a result of " + string(opNames[f.values[args[0]].op]));
+        move(reg(v), reg(args[0]) + uint32_t(tupleOffset(tuple, size_t(x.aux)) / 8), wordsIn(t));
+        break;
+    }
+    case IR_INDEX:
+        if (kindOf(typeOf(args[0])) == TY_STRING) {
+            emit(BC_INDEXSTR, { reg(v), reg(args[0]), reg(args[1]) });
+        }
+        else {
+            auto* a = underlyingAs<ArrayType>(typeOf(args[0]), TY_ARRAY);
+            emit(BC_INDEXARR, { reg(v), reg(args[0]), reg(args[1]) },
+                { uint32_t(a->length), uint32_t(layoutOf(t).size), loadKind(t) });
+        }
+        break;
+    case IR_LEN: case IR_CAP: {
+        const Type* u = underlying(typeOf(args[0]));
+        if (u->kind == TY_POINTER) u = underlying(static_cast<const PointerType*>(u)->base);
+        if (u->kind == TY_ARRAY) {
+            emit(BC_MOV, { reg(v), constant(uint64_t(static_cast<const ArrayType*>(u)->length)) });
+        }
+        else if (u->kind == TY_MAP) {
+            emit(BC_MAPLEN, { reg(v), reg(args[0]) });
+        }
+        else if (u->kind == TY_CHAN) {
+            emit(BC_CHANLEN, { reg(v), reg(args[0]) }, { x.op == IR_CAP });
+        }
+        else if (u->kind == TY_STRING || u->kind == TY_SLICE) {
+            emit(BC_MOV, { reg(v), reg(args[0]) + (x.op == IR_LEN ? 1 : 2) });
+        }
+        else {
+            unsupported(string(x.op == IR_LEN ? "len" : "cap") + " of " + typeString(u));
+        }
+        break;
+    }
+    case IR_SLICE: {
+        const Type* u = underlying(typeOf(args[0]));
+        uint32_t kind = 0, size = 1, length = 0;
+        if (u->kind == TY_POINTER) {
+            auto* a = underlyingAs<ArrayType>(static_cast<const PointerType*>(u)->base, TY_ARRAY);
+            if (a == nullptr) unsupported("slicing " + typeString(u));
+            kind = 2;
+            size = uint32_t(layoutOf(a->elem).size);
+            length = uint32_t(a->length);
+        }
+        else if (u->kind == TY_SLICE) {
+            size = uint32_t(layoutOf(static_cast<const SliceType*>(u)->elem).size);
+        }
+        else {
+            kind = 1;
+        }
+        uint32_t bounds[3];
+        size_t next = 1;
+        for (int i = 0; i < 3; i++) bounds[i] = x.aux & (1 << i) ? reg(args[next++]) : constant(uint64_t(0));
+        emit(BC_SLICE, { reg(v), reg(args[0]), bounds[0], bounds[1], bounds[2] }, { uint32_t(x.aux), kind, size, length });
+        break;
+    }
+    case IR_MAKE_SLICE: {
+        uint32_t size = uint32_t(layoutOf(static_cast<const SliceType*>(underlying(t))->elem).size);
+        emit(BC_MKSLICE, { reg(v), reg(args[0]), reg(args[1]) }, { size });
+        break;
+    }
+    case IR_APPEND: {
+        uint32_t size = uint32_t(layoutOf(static_cast<const SliceType*>(underlying(t))->elem).size);
+        if (x.flags & V_SPREAD) {
+            emit(BC_APPENDS, { reg(v), reg(args[0]), reg(args[1]) }, { size });
+        }
+        else if (args.size() == 1) {
+            move(reg(v), reg(args[0]), 3);
+        }
+        else if (args.size() == 2) {
+            // the low bytes of the registers of a value are the value
+            emit(BC_APPEND, { reg(v), reg(args[0]), reg(args[1]) }, { 1, size });
+        }
+        else {
+            uint32_t count = uint32_t(args.size() - 1), elems = out(0, uint32_t(align8(int64_t(size) * count) / 8));
+            for (uint32_t i = 0; i < count; i++) emit(BC_FST, { elems, reg(args[i + 1]) }, { i * size, size });
+            emit(BC_APPEND, { reg(v), reg(args[0]), elems }, { count, size });
+        }
+        break;
+    }
+    case IR_COPY: {
+        uint32_t size = uint32_t(layoutOf(static_cast<const SliceType*>(underlying(typeOf(args[0])))->elem).size);
+        emit(BC_COPY, { reg(v), reg(args[0]), reg(args[1]) }, { size });
+        break;
+    }
+    case IR_STRING_NEXT: emit(BC_STRNEXT, { reg(v), reg(args[0]), reg(args[1]) }); break;
+    case IR_MAKE_MAP: emit(BC_MKMAP, { reg(v), reg(args[0]), constant(interp.rtype(t)) }); break;
+    case IR_MAP_INDEX: {
+        uint32_t words = wordsIn(static_cast<const MapType*>(underlying(typeOf(args[0])))->elem);
+        emit(BC_MAPGET, { reg(v), reg(args[0]), reg(args[1]) }, { (x.flags & V_COMMA_OK) != 0, words });
+        break;
+    }
+    case IR_MAP_UPDATE: emit(BC_MAPSET, { reg(args[0]), reg(args[1]), reg(args[2]) }); break;
+    case IR_MAP_DELETE: emit(BC_MAPDEL, { reg(args[0]), reg(args[1]) }); break;
+    case IR_MAP_ITER: emit(BC_MAPITER, { reg(v), reg(args[0]) }); break;
+    case IR_MAP_NEXT: emit(BC_MAPNEXT, { reg(v), reg(args[0]) }); break;
+    case IR_CALL: case IR_CALL_EXTERN: case IR_CALL_VALUE: case IR_CALL_METHOD: call(v); break;
+    case IR_PRINT: {
+        uint32_t array = interfaces(args, 0, true);
+        emit(BC_PRINT, { array }, { uint32_t(args.size()), uint32_t(x.aux) });
+        break;
+    }
+    case IR_RECOVER: emit(BC_RECOVER, { reg(v) }); break;
+    case IR_RUN_DEFERS: emit(BC_RUNDEFERS, {}); break;
+    case IR_MAKE_CHAN:
+        emit(BC_MKCHAN, { reg(v), args.size() != 0 ? reg(args[0]) : constant(uint64_t(0)), constant(interp.rtype(t)) });
+        break;
+    case IR_SEND: emit(BC_SEND, { reg(args[0]), reg(args[1]) }); break;
+    case IR_RECV: emit(BC_RECV, { reg(v), reg(args[0]) }, { (x.flags & V_COMMA_OK) != 0 }); break;
+    case IR_CLOSE: emit(BC_CLOSE, { reg(args[0]) }); break;
+    case IR_CHOOSE: {
+        auto* tuple = static_cast<const TupleType*>(t);
+        c.code.push_back(BC_SELECT);
+        operand(reg(v));
+        size_t count = c.code.size();
+        c.code.push_back(0);
+        c.code.push_back((x.flags & V_DEFAULT) != 0);
+        size_t received = 2;
+        for (size_t i = 0; i < args.size(); c.code[count]++) {
+            bool send = x.aux >> c.code[count] & 1;
+            c.code.push_back(send);
+            operand(reg(args[i++]));
+            operand(send ? reg(args[i++]) : reg(v) + uint32_t(tupleOffset(tuple, received++) / 8));
+        }
+        break;
+    }
+    case IR_EXTERN: case IR_SELECT: unsupported(string(symbols.text(Symbol(x.aux))));
+    default: unsupported(opNames[x.op]);
+    }
+}
+
+void BytecodeCompiler::arithmetic(ValueId v) {
+    const Value& x = f.values[v];
+    auto args = f.args(v);
+    const Type* t = x.type;
+    TypeKind k = kindOf(t);
+    uint32_t d = reg(v), a = reg(args[0]), b = args.size() > 1 ? reg(args[1]) : 0;
+    if (x.op == IR_ADD && k == TY_STRING) {
+        emit(BC_CONCAT, { d, a, b });
+        return;
+    }
+    if (isComplex(k)) unsupported("complex arithmetic");
+    if (isFloat(k)) {
+        bool single = k == TY_FLOAT32;
+        Bytecode op;
+        switch (x.op) {
+        case IR_ADD: op = single ? BC_FADD32 : BC_FADD; break;
+        case IR_SUB: op = single ? BC_FSUB32 : BC_FSUB; break;
+        case IR_MUL: op = single ? BC_FMUL32 : BC_FMUL; break;
+        case IR_DIV: op = single ? BC_FDIV32 : BC_FDIV; break;
+        case IR_NEG: emit(single ? BC_FNEG32 : BC_FNEG, { d, a }); return;
+        default: unsupported(string(opNames[x.op]) + " of floats");
+        }
+        emit(op, { d, a, b });
+        return;
+    }
+    if (x.op == IR_NOT) {
+        emit(BC_NOT, { d, a });
+        return;
+    }
+    // an addition of a small constant, as loops count
+    if (x.op == IR_ADD || x.op == IR_SUB) {
+        for (int i = x.op == IR_ADD ? 0 : 1; i < 2; i++) {
+            const Value& c = f.values[args[i]];
+            int64_t n = x.op == IR_SUB ? -c.aux : c.aux;
+            if (c.op != IR_CONST || n != int32_t(n)) continue;
+            emit(BC_ADDI, { d, reg(args[1 - i]) }, { uint32_t(int32_t(n)) });
+            narrow(t, d);
+            return;
+        }
+    }
+    bool sign = !isUnsigned(k);
+    Bytecode op;
+    switch (x.op) {
+    case IR_ADD: op = BC_ADD; break;
+    case IR_SUB: op = BC_SUB; break;
+    case IR_MUL: op = BC_MUL; break;
+    case IR_DIV: op = sign ? BC_DIV : BC_DIVU; break;
+    case IR_MOD: op = sign ? BC_MOD : BC_MODU; break;
+    case IR_AND: op = BC_AND; break;
+    case IR_OR: op = BC_OR; break;
+    case IR_XOR: op = BC_XOR; break;
+    case IR_AND_NOT: op = BC_ANDNOT; break;
+    case IR_SHL: op = BC_SHL; break;
+    case IR_SHR: op = sign ? BC_SAR : BC_SHR; break;
+    case IR_NEG: op = BC_NEG; break;
+    default: op = BC_COMPL; break;
+    }
+    if (op == BC_NEG || op == BC_COMPL) {
+        emit(op, { d, a });
+    }
+    else {
+        emit(op, { d, a, b });
+    }
+    // the other operations keep a narrow integer in range
+    if (op == BC_ADD || op == BC_SUB || op == BC_MUL || op == BC_DIV || op == BC_SHL || op == BC_NEG || op == BC_COMPL) {
+        narrow(t, d);
+    }
+}
+
+void BytecodeCompiler::compare(ValueId v) {
+    const Value& x = f.values[v];
+    auto args = f.args(v);
+    uint32_t d = reg(v), a = reg(args[0]), b = reg(args[1]);
+    const Type* t = typeOf(args[0])->kind != TY_UNTYPED_NIL ? typeOf(args[0]) : typeOf(args[1]);
+    TypeKind k = kindOf(t);
+    Op op = x.op;
+    if (k == TY_STRING) {
+        emit(BC_SCMP, { d, a, b }, { uint32_t(op - IR_EQ) });
+        return;
+    }
+    if (k == TY_INTERFACE || k == TY_STRUCT || k == TY_ARRAY || isComplex(k)) {
+        if (k == TY_INTERFACE) {
+            emit(BC_IEQ, { d, a, b });
+        }
+        else {
+            emit(BC_EQT, { d, a, b, constant(interp.rtype(t)) });
+        }
+        if (op == IR_NE) emit(BC_NOT, { d, d });
+        return;
+    }
+    // a greater operand is swapped for a lesser one
+    if (op == IR_GT || op == IR_GE) {
+        swap(a, b);
+        op = op == IR_GT ? IR_LT : IR_LE;
+    }
+    bool sign = !isUnsigned(k);
+    Bytecode bc;
+    if (isFloat(k)) {
+        bool single = k == TY_FLOAT32;
+        bc = op == IR_EQ ? (single ? BC_FEQ32 : BC_FEQ) : op == IR_NE ? (single ? BC_FNE32 : BC_FNE) :
+            op == IR_LT ? (single ? BC_FLT32 : BC_FLT) : (single ? BC_FLE32 : BC_FLE);
+    }
+    else {
+        // slices, maps and functions are only compared with nil, which their
+        // first word tells
+        bc = op == IR_EQ ? BC_EQ : op == IR_NE ? BC_NE : op == IR_LT ? (sign ? BC_LT : BC_LTU) : (sign ? BC_LE : BC_LEU);
+    }
+    emit(bc, { d, a, b });
+}
+
+void BytecodeCompiler::convert(ValueId v) {
+    ValueId x = f.args(v)[0];
+    const Type* to = typeOf(v);
+    const Type* from = typeOf(x);
+    TypeKind tk = kindOf(to), fk = kindOf(from);
+    uint32_t d = reg(v), a = reg(x);
+    auto elemKind = [](const Type* t) { return kindOf(static_cast<const SliceType*>(underlying(t))->elem); };
+    if (tk == TY_STRING && fk != TY_STRING) {
+        StringConversion code = fk != TY_SLICE ? SC_RUNE : elemKind(from) == TY_UINT8 ? SC_BYTES : SC_RUNES;
+        emit(BC_CVTSTR, { d, a }, { code });
+        return;
+    }
+    if (tk == TY_SLICE && fk == TY_STRING) {
+        emit(BC_CVTSTR, { d, a }, { elemKind(to) == TY_UINT8 ? SC_TO_BYTES : SC_TO_RUNES });
+        return;
+    }
+    if (tk == TY_INTERFACE && fk != TY_INTERFACE) {
+        emit(BC_MKIFACE, { d, a, constant(interp.rtype(from)) });
+        return;
+    }
+    if (isAggregate(to)) {
+        // the same representation, an interface converted to another
+        // interface among them
+        move(d, a, wordsIn(to));
+        return;
+    }
+    if (isFloat(tk) && isFloat(fk)) {
+        if (tk == fk) {
+            move(d, a, 1);
+        }
+        else {
+            emit(BC_CVT, { d, a }, { tk == TY_FLOAT32 ? CV_F64_F32 : CV_F32_F64 });
+        }
+        return;
+    }
+    if (isFloat(tk)) {
+        bool single = tk == TY_FLOAT32, sign = !isUnsigned(fk);
+        emit(BC_CVT, { d, a }, { single ? (sign ? CV_INT_F32 : CV_UINT_F32) : (sign ? CV_INT_F64 : CV_UINT_F64) });
+        return;
+    }
+    if (isFloat(fk)) {
+        bool single = fk == TY_FLOAT32, sign = !isUnsigned(tk);
+        emit(BC_CVT, { d, a }, { single ? (sign ? CV_F32_INT : CV_F32_UINT) : (sign ? CV_F64_INT : CV_F64_UINT) });
+        narrow(to, d);
+        return;
+    }
+    LoadKind k = loadKind(to);
+    if (isInteger(tk) && k != LD_WORD) {
+        emit(BC_EXT, { d, a }, { k });
+        return;
+    }
+    move(d, a, 1);
+}
+
+// The values of args from first on as interfaces in the out area, for the
+// formatting functions. An interface is passed as itself unless wrap is set,
+// as print wants it.
+uint32_t BytecodeCompiler::interfaces(const Function::Operands& args, size_t first, bool wrap) {
+    uint32_t array = out(0, uint32_t(2 * (args.size() - first)));
+    for (size_t i = first; i < args.size(); i++) {
+        ValueId a = args[i];
+        const Type* t = typeOf(a);
+        uint32_t e = array + uint32_t(2 * (i - first));
+        if (t->kind == TY_UNTYPED_NIL) {
+            emit(BC_ZERO, { e }, { 2 });
+        }
+        else if (kindOf(t) == TY_INTERFACE && !wrap) {
+            move(e, reg(a), 2);
+        }
+        else {
+            emit(BC_MOV, { e, constant(interp.rtype(t)) });
+            emit(isPointerShaped(t) ? BC_MOV : BC_LEA, { e + 1, reg(a) });
+        }
+    }
+    return array;
+}
+
+// Puts the arguments of the call v into the out area, where signature says,
+// and returns the words they take.
+uint32_t BytecodeCompiler::marshal(ValueId v) {
+    const Value& x = f.values[v];
+    auto args = f.args(v);
+    const Type* receiver = nullptr;
+    const FuncType* type;
+    size_t first = 0;
+    if (x.op == IR_CALL) {
+        receiver = module.functions[x.aux].receiver;
+        type = module.functions[x.aux].type;
+    }
+    else if (x.op == IR_CALL_VALUE) {
+        type = underlyingAs<FuncType>(typeOf(args[0]), TY_FUNC);
+        if (type == nullptr) unsupported("a call of a value of unknown type");
+        first = 1;
+    }
+    else {
+        auto* iface = underlyingAs<InterfaceType>(typeOf(args[0]), TY_INTERFACE);
+        complete(iface);
+        receiver = basicType(TY_UNSAFE_POINTER);
+        type = iface->methods[x.aux].type;
+        move(out(0, 1), reg(args[0]) + 1, 1);
+    }
+    Signature s(receiver, type);
+    out(0, uint32_t(s.size / 8));
+    size_t param = x.op == IR_CALL_METHOD ? 1 : 0;
+    for (size_t i = first + param; i < args.size(); i++, param++) {
+        int64_t end = param + 1 < s.params.size() ? s.params[param + 1] : s.argsSize;
+        move(OUT | uint32_t(s.params[param] / 8), reg(args[i]), uint32_t((end - s.params[param]) / 8));
+    }
+    return uint32_t(s.argsSize / 8);
+}
+
+void BytecodeCompiler::call(ValueId v) {
+    const Value& x = f.values[v];
+    auto args = f.args(v);
+    // a go statement saves the call as a defer statement does
+    bool deferred = x.flags & (V_DEFER | V_GO);
+    Bytecode later = x.flags & V_GO ? BC_GO : BC_DEFER;
+    if (x.op == IR_CALL_EXTERN) {
+        string name(symbols.text(Symbol(x.aux)));
+        static const pair<const char*, Extern> externs[] = { { "fmt.Print", EX_PRINT }, { "fmt.Println", EX_PRINTLN },
+            { "fmt.Printf", EX_PRINTF }, { "os.Exit", EX_EXIT }, { "runtime.Gosched", EX_GOSCHED } };
+        auto it = find_if(std::begin(externs), std::end(externs), [&](auto& e) { return name == e.first; });
+        if (it == std::end(externs) || (it->second == EX_EXIT && args.size() != 1) ||
+            (it->second == EX_GOSCHED && args.size() != 0)) {
+            unsupported(name);
+        }
+        uint32_t array = interfaces(args, 0, false);
+        if (deferred) {
+            emit(later, { array, constant(uint64_t(it->second)) }, { 3, uint32_t(2 * args.size()), 0 });
+        }
+        else {
+            emit(BC_CALLX, { array }, { it->second, uint32_t(args.size()) });
+        }
+        return;
+    }
+    uint32_t words = marshal(v), base = out(0, 0);
+    switch (x.op) {
+    case IR_CALL:
+        if (deferred) {
+            emit(later, { base, constant(interp.codes[interp.function(uint32_t(x.aux))].get()) }, { 0, words, 0 });
+            return;
+        }
+        emit(BC_CALL, { base }, { interp.function(uint32_t(x.aux)) });
+        break;
+    case IR_CALL_VALUE:
+        if (deferred) {
+            emit(later, { base, reg(args[0]) }, { 1, words, 0 });
+            return;
+        }
+        emit(BC_CALLV, { reg(args[0]), base });
+        break;
+    default: {
+        auto* iface = underlyingAs<InterfaceType>(typeOf(args[0]), TY_INTERFACE);
+        Symbol name = iface->methods[x.aux].name;
+        if (deferred) {
+            emit(later, { base, reg(args[0]) }, { 2, words, name });
+            return;
+        }
+        emit(BC_CALLM, { reg(args[0]), base }, { name, uint32_t(c.caches.size()) });
+        c.caches.emplace_back(nullptr);
+        break;
+    }
+    }
+    if (registers[v] != UINT32_MAX) {
+        uint32_t results = wordsIn(typeOf(v));
+        move(reg(v), out(words, results), results);
+    }
+}
+
+// Gives the phis of block to their operands from block from. The operands
+// are copied through the out area first when one is a phi of the block.
+void BytecodeCompiler::edge(BlockId from, BlockId to) {
+    auto& preds = f.blocks[to].preds;
+    size_t index = size_t(find(preds.begin(), preds.end(), from) - preds.begin());
+    vector<pair<ValueId, ValueId>> moves;
+    bool overlap = false;
+    for (ValueId v : f.blocks[to].values) {
+        if (f.values[v].op != IR_PHI) break;
+        ValueId a = f.args(v)[index];
+        if (a == v || registers[v] == UINT32_MAX) continue;
+        moves.push_back({ v, a });
+        overlap = overlap || (f.values[a].op == IR_PHI && f.values[a].block == to);
+    }
+    if (!overlap) {
+        for (auto [v, a] : moves) move(reg(v), reg(a), wordsIn(typeOf(v)));
+        return;
+    }
+    uint32_t offset = 0;
+    for (auto [v, a] : moves) {
+        uint32_t words = wordsIn(typeOf(v));
+        move(out(offset, words), reg(a), words);
+        offset += words;
+    }
+    offset = 0;
+    for (auto [v, a] : moves) {
+        uint32_t words = wordsIn(typeOf(v));
+        move(reg(v), OUT | offset, words);
+        offset += words;
+    }
+}
+
+void BytecodeCompiler::branch(BlockId b, ValueId v, BlockId next) {
+    ValueId condition = f.args(v)[0];
+    BlockId targets[2] = { f.blocks[b].succs[0], f.blocks[b].succs[1] };
+    const Value& test = f.values[condition];
+    if (test.op == IR_CONST || targets[0] == targets[1]) {
+        BlockId to = targets[test.op == IR_CONST && test.aux == 0 ? 1 : 0];
+        edge(b, to);
+        if (to != next) jump(BC_JMP, {}, to);
+        return;
+    }
+    auto hasPhis = [&](BlockId to) {
+        auto& values = f.blocks[to].values;
+        return !values.empty() && f.values[values[0]].op == IR_PHI;
+    };
+    // Jumps when the condition is sense, to block to or to a stub of the edge.
+    auto jumpIf = [&](bool sense, BlockId to, bool stub) {
+        uint32_t start = uint32_t(c.code.size());
+        if (fused[condition]) {
+            auto args = f.args(condition);
+            uint32_t x = reg(args[0]), y = reg(args[1]);
+            Op op = test.op;
+            if (!sense) {
+                static const Op inverse[] = { IR_NE, IR_EQ, IR_GE, IR_GT, IR_LE, IR_LT };
+                op = inverse[op - IR_EQ];
+            }
+            if (op == IR_GT || op == IR_GE) {
+                swap(x, y);
+                op = op == IR_GT ? IR_LT : IR_LE;
+            }
+            bool sign = !isUnsigned(kindOf(typeOf(args[0])));
+            Bytecode bc = op == IR_EQ ? BC_JEQ : op == IR_NE ? BC_JNE : op == IR_LT ? (sign ? BC_JLT : BC_JLTU) :
+                (sign ? BC_JLE : BC_JLEU);
+            emit(bc, { x, y }, { start });
+        }
+        else {
+            emit(sense ? BC_JT : BC_JF, { reg(condition) }, { start });
+        }
+        uint32_t at = uint32_t(c.code.size() - 1);
+        if (stub) {
+            stubs.push_back({ at, b, to });
+        }
+        else {
+            jumps.push_back({ at, to });
+        }
+    };
+    bool phis[2] = { hasPhis(targets[0]), hasPhis(targets[1]) };
+    if (!phis[0] && !phis[1] && targets[1] == next) {
+        jumpIf(true, targets[0], false);
+        return;
+    }
+    jumpIf(false, targets[1], phis[1]);
+    edge(b, targets[0]);
+    if (targets[0] != next) jump(BC_JMP, {}, targets[0]);
+}
+
+//===--- run time ---===//
+
+void Interpreter::write(FILE* stream, const string& text) {
+    lock_guard<mutex> guard(outputLock);
+    if (ended) return;
+    if (capture) {
+        output += text;
+        return;
+    }
+    fwrite(text.data(), 1, text.size(), stream);
+    fflush(stream);
+}
+
+// Ends the program with message to standard error, unless a goroutine on
+// another thread has ended it first. Output written later is dropped.
+bool Interpreter::end(const string& message) {
+    lock_guard<mutex> guard(outputLock);
+    if (ended) return false;
+    if (capture) {
+        output += message;
+    }
+    else if (!message.empty()) {
+        fwrite(message.data(), 1, message.size(), stderr);
+    }
+    ended = true;
+    return true;
+}
+
+// fmt.Print, Println and Printf, os.Exit, and runtime.Gosched, which only
+// yields when called directly. The Error and String methods fmt calls run on
+// g, whose state is saved.
+void Interpreter::external(Goroutine& g, uint32_t id, const GoInterface* args, int64_t count) {
+    auto isString = [](const GoInterface& i) { return i.type != nullptr && i.type->kind == TY_STRING; };
+    FormatMethod methods = [&](const RType* t, const void* p) { return callFormat(g, t, p); };
+    string text;
+    switch (id) {
+    case EX_PRINTF:
+        formatPrintf(text, *static_cast<const GoString*>(valueOf(args[0])), args + 1, count - 1, &methods);
+        break;
+    case EX_EXIT: throw ProgramExit{ int(intValue(args[0].type, valueOf(args[0]))), {} };
+    case EX_GOSCHED: return;
+    default:
+        for (int64_t i = 0; i < count; i++) {
+            // Print only separates operands when neither is a string
+            if (i > 0 && (id == EX_PRINTLN || (!isString(args[i]) && !isString(args[i - 1])))) text += ' ';
+            formatInterface(text, args[i], 'v', &methods);
+        }
+        if (id == EX_PRINTLN) text += '\n';
+        break;
+    }
+    write(stdout, text);
+}
+
+// The print and println builtins, to standard error.
+void Interpreter::print(const GoInterface* args, int64_t count, bool newline) {
+    string text;
+    for (int64_t i = 0; i < count; i++) {
+        if (i > 0 && newline) text += ' ';
+        const RType* t = args[i].type;
+        if (t != nullptr && (t->kind == TY_FLOAT32 || t->kind == TY_FLOAT64)) {
+            // as +1.500000e+000, the exponent having three digits
+            char number[64];
+            snprintf(number, sizeof number, "%+e",
+                t->kind == TY_FLOAT32 ? *static_cast<const float*>(args[i].data) : *static_cast<const double*>(args[i].data));
+            char* e = strchr(number, 'e');
+            if (e != nullptr && strlen(e + 2) < 3) {
+                memmove(e + 3, e + 2, strlen(e + 2) + 1);
+                e[2] = '0';
+            }
+            text += number;
+        }
+        else if (t != nullptr && t->kind == TY_INTERFACE) {
+            auto* x = static_cast<const GoInterface*>(args[i].data);
+            appendFormat(text, "(%p,%p)", static_cast<const void*>(x->type), x->data);
+        }
+        else if (t != nullptr && t->kind == TY_SLICE) {
+            auto* s = static_cast<const GoSlice*>(args[i].data);
+            appendFormat(text, "[%lld/%lld]%p", (long long)s->len, (long long)s->cap, static_cast<void*>(s->ptr));
+        }
+        else {
+            formatInterface(text, args[i], 'v');
+        }
+    }
+    if (newline) text += '\n';
+    write(stderr, text);
+}
+
+// The method name of the dynamic type of receiver, which m is set to.
+const Code* Interpreter::method(const GoInterface& receiver, Symbol name, const RType::Method*& m) {
+    if (receiver.type == nullptr) runtimeError("invalid memory address or nil pointer dereference");
+    m = receiver.type->method(name);
+    if (m == nullptr) runtimeError(receiver.type->name + " has no method " + string(symbols.text(name)));
+    return codes[m->function].get();
+}
+
+//===--- scheduling ---===//
+
+// Runs goroutines M:N on worker threads, the calling thread being the first.
+// Every worker owns a deque of runnable goroutines: it pushes the goroutines
+// it starts or wakes at the back, takes its next one from the back, and steals
+// half of another deque from the front once its own runs dry. A goroutine that
+// used up its time slice goes to the global queue, which workers look at
+// first every few goroutines, along with the front of their own, so that none
+// waits for long. The other threads only start with the first go statement.
+// Once every worker sleeps with goroutines left, they all wait on channels.
+// The collector stops the world between goroutines: a worker is in it while
+// it runs them, and leaves it to sleep and when asked to stop, at which point
+// the goroutine it runs yields.
+struct Scheduler {
+    // With untilIdle, the program ends once every goroutine is done rather
+    // than when main.main returns.
+    Scheduler(Interpreter& interp, int workerCount, bool untilIdle) : interp(interp), untilIdle(untilIdle) {
+        for (int i = 0; i < max(workerCount, 1); i++) {
+            workers.push_back(make_unique<Worker>());
+            workers.back()->index = size_t(i);
+        }
+        interp.scheduler = this;
+    }
+    ~Scheduler() {
+        stop();
+        interp.scheduler = nullptr;
+    }
+    int run();
+    void spawn(Goroutine::Deferred call);
+    // Queues g, parked on a channel, to run again.
+    void ready(Goroutine* g) { push(*current, g); }
+    // Lets the world stop when it is to, for a goroutine that yields where
+    // it cannot go back to the queues.
+    void safePoint() {
+        if (!stopping.load(memory_order_relaxed)) return;
+        leaveWorld();
+        enterWorld();
+    }
+    int size() const { return int(workers.size()); }
+
+    // when main.main returned
+    chrono::steady_clock::time_point mainDone;
+    // set while the world is to stop
+    static atomic<bool> stopping;
+
+private:
+    friend struct Collector;
+    struct Worker {
+        size_t index;
+        mutex lock;
+        deque<Goroutine*> runnable;
+        // the goroutines this worker made, and finished ones and their stacks
+        // to reuse
+        vector<unique_ptr<Goroutine>> owned;
+        vector<Goroutine*> free;
+        vector<Goroutine::Segment> stacks;
+        uint32_t ticks = 0;
+    };
+    static constexpr uint32_t globalInterval = 61;
+    static thread_local Worker* current;
+
+    Goroutine* allocate(Worker& w) {
+        if (!w.free.empty()) {
+            Goroutine* g = w.free.back();
+            w.free.pop_back();
+            return g;
+        }
+        w.owned.push_back(make_unique<Goroutine>());
+        return w.owned.back().get();
+    }
+    void push(Worker& w, Goroutine* g) {
+        {
+            lock_guard<mutex> guard(w.lock);
+            w.runnable.push_back(g);
+        }
+        queued++;
+        wake();
+    }
+    void inject(Goroutine* g) {
+        {
+            lock_guard<mutex> guard(globalLock);
+            global.push_back(g);
+        }
+        queued++;
+        wake();
+    }
+    // A worker going to sleep counts itself before it looks at queued again,
+    // and a goroutine is counted in queued before sleeping is looked at, so
+    // one of them sees the other.
+    void wake() {
+        if (sleeping == 0) return;
+        lock_guard<mutex> guard(idleLock);
+        idle.notify_one();
+    }
+    Goroutine* take(Worker& w);
+    void work(Worker& w);
+    void finish(Worker& w, Goroutine* g);
+    void end(int code, const string& message);
+    void stop() {
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+    void enterWorld() {
+        unique_lock<mutex> guard(worldLock);
+        worldChanged.wait(guard, [] { return !stopping; });
+        running++;
+    }
+    void leaveWorld() {
+        lock_guard<mutex> guard(worldLock);
+        if (--running == 0) worldChanged.notify_all();
+    }
+    // Waits for every worker to leave the world, once they are asked to.
+    void stopTheWorld() {
+        unique_lock<mutex> guard(worldLock);
+        stopping = true;
+        worldChanged.wait(guard, [this] { return running == 0; });
+    }
+    void startTheWorld() {
+        lock_guard<mutex> guard(worldLock);
+        stopping = false;
+        worldChanged.notify_all();
+    }
+
+    Interpreter& interp;
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    once_flag started;
+    bool untilIdle;
+    mutex globalLock, idleLock;
+    deque<Goroutine*> global;
+    condition_variable idle;
+    // goroutines in the queues, and those not done yet
+    atomic<int64_t> queued{ 0 }, live{ 0 };
+    // workers asleep, and those that started working
+    atomic<int> sleeping{ 0 }, working{ 0 };
+    atomic<bool> finished{ false };
+    // the package initializers, then main.main, called in turn by the main
+    // goroutine
+    vector<const Code*> mainCalls;
+    size_t mainStep = 0;
+    Goroutine* mainGoroutine = nullptr;
+    int status = 0;
+    mutex worldLock;
+    condition_variable worldChanged;
+    // workers in the world
+    int running = 0;
+};
+thread_local Scheduler::Worker* Scheduler::current = nullptr;
+atomic<bool> Scheduler::stopping{ false };
+
+// Runs the main goroutine, and the goroutines it starts, until the program
+// ends, returning its exit status.
+int Scheduler::run() {
+    Worker& w = *workers[0];
+    current = &w;
+    for (uint32_t init : interp.module.inits) mainCalls.push_back(interp.codes[init].get());
+    mainCalls.push_back(interp.codes[interp.module.entry].get());
+    mainGoroutine = allocate(w);
+    mainGoroutine->start = { 0, mainCalls[0], nullptr, UINT32_MAX, {} };
+    live++;
+    push(w, mainGoroutine);
+    Collector collector(*this);
+    work(w);
+    stop();
+    current = nullptr;
+    return status;
+}
+
+// A new goroutine making call, queued on the worker of the goroutine that
+// starts it.
+void Scheduler::spawn(Goroutine::Deferred call) {
+    call_once(started, [this] {
+        for (size_t i = 1; i < workers.size(); i++) {
+            threads.emplace_back([this, i] {
+                current = workers[i].get();
+                work(*current);
+            });
+        }
+    });
+    Worker& w = *current;
+    Goroutine* g = allocate(w);
+    g->start = move(call);
+    live++;
+    push(w, g);
+}
+
+Goroutine* Scheduler::take(Worker& w) {
+    Goroutine* g = nullptr;
+    auto pop = [&](mutex& lock, deque<Goroutine*>& q, bool back) {
+        lock_guard<mutex> guard(lock);
+        if (q.empty()) return false;
+        g = back ? q.back() : q.front();
+        back ? q.pop_back() : q.pop_front();
+        return true;
+    };
+    bool fair = ++w.ticks % globalInterval == 0;
+    bool found = (fair && (pop(globalLock, global, false) || pop(w.lock, w.runnable, false))) ||
+        pop(w.lock, w.runnable, true) || pop(globalLock, global, false);
+    for (size_t i = 1; !found && i < workers.size(); i++) {
+        Worker& victim = *workers[(w.index + i) % workers.size()];
+        vector<Goroutine*> stolen;
+        {
+            lock_guard<mutex> guard(victim.lock);
+            size_t half = (victim.runnable.size() + 1) / 2;
+            stolen.assign(victim.runnable.begin(), victim.runnable.begin() + ptrdiff_t(half));
+            victim.runnable.erase(victim.runnable.begin(), victim.runnable.begin() + ptrdiff_t(half));
+        }
+        if (stolen.empty()) continue;
+        g = stolen.back();
+        stolen.pop_back();
+        lock_guard<mutex> guard(w.lock);
+        w.runnable.insert(w.runnable.end(), stolen.begin(), stolen.end());
+        found = true;
+    }
+    if (found) queued--;
+    return g;
+}
+
+void Scheduler::work(Worker& w) {
+    working++;
+    enterWorld();
+    while (!finished) {
+        if (stopping.load(memory_order_relaxed)) {
+            leaveWorld();
+            enterWorld();
+        }
+        Goroutine* g = take(w);
+        if (g == nullptr) {
+            leaveWorld();
+            unique_lock<mutex> guard(idleLock);
+            // with no goroutine running or queued, those left can never be
+            // woken
+            if (++sleeping == working && queued == 0 && live > 0 && !finished) {
+                sleeping--;
+                guard.unlock();
+                end(2, "fatal error: all goroutines are asleep - deadlock!\n");
+                enterWorld();
+                continue;
+            }
+            idle.wait(guard, [this] { return finished || queued > 0; });
+            sleeping--;
+            guard.unlock();
+            enterWorld();
+            continue;
+        }
+        Stop stop = ST_DONE;
+        try {
+            if (g->code == nullptr && g->start.code == nullptr) {
+                // a function of another package, which needs no stack
+                interp.external(*g, g->start.external, reinterpret_cast<const GoInterface*>(g->start.args.data()),
+                    int64_t(g->start.args.size() / 2));
+            }
+            else {
+                if (g->code == nullptr) {
+                    if (g->segments.empty() && !w.stacks.empty()) {
+                        g->segments.push_back(move(w.stacks.back()));
+                        w.stacks.pop_back();
+                    }
+                    interp.start(*g, g->start.code, g->start.ctx, g->start.args);
+                }
+                stop = interp.execute(*g);
+            }
+        }
+        catch (const ProgramExit& e) {
+            end(e.code, e.message);
+            continue;
+        }
+        catch (const StackOverflow&) {
+            end(2, "runtime: goroutine stack exceeds " + to_string(Goroutine::stackLimit * 8) +
+                "-byte limit\nfatal error: stack overflow\n");
+            continue;
+        }
+        catch (const RuntimeFault& e) {
+            g->panics.push_back({ interp.faultValue(e.message), 0, false });
+        }
+        if (stop == ST_DONE) {
+            finish(w, g);
+        }
+        else if (stop == ST_YIELDED) {
+            inject(g);
+        }
+    }
+    leaveWorld();
+}
+
+// Ends the program when g panicked or was the main goroutine, and keeps g for
+// another go statement otherwise.
+void Scheduler::finish(Worker& w, Goroutine* g) {
+    if (!g->panics.empty()) {
+        string text;
+        for (size_t i = 0; i < g->panics.size(); i++) {
+            text += i > 0 ? "\tpanic: " : "panic: ";
+            formatInterface(text, g->panics[i].value, 'v');
+            text += g->panics[i].recovered ? " [recovered]\n" : "\n";
+        }
+        end(2, text);
+        return;
+    }
+    if (g == mainGoroutine) {
+        if (++mainStep < mainCalls.size()) {
+            g->code = nullptr;
+            g->start.code = mainCalls[mainStep];
+            push(w, g);
+            return;
+        }
+        mainDone = chrono::steady_clock::now();
+        if (!untilIdle) {
+            end(0, "");
+            return;
+        }
+    }
+    Goroutine::Segment stack = g->reset();
+    if (stack.words != nullptr) w.stacks.push_back(move(stack));
+    w.free.push_back(g);
+    if (--live == 0 && untilIdle) end(0, "");
+}
+
+void Scheduler::end(int code, const string& message) {
+    if (interp.end(message)) status = code;
+    lock_guard<mutex> guard(idleLock);
+    finished = true;
+    idle.notify_all();
+}
+
+//===--- collection ---===//
+
+void Collector::loop() {
+    for (;;) {
+        {
+            unique_lock<mutex> guard(heap.requestLock);
+            heap.requestChanged.wait(guard, [this] { return quit || heap.requested; });
+            if (quit) return;
+        }
+        collect();
+    }
+}
+
+void Collector::collect() {
+    vector<uintptr_t> work;
+    heap.sweepAll();
+    stopped([&] {
+        heap.grey.clear();
+        heap.marking = true;
+        shadeRoots(work);
+    });
+    for (int round = 0;; round++) {
+        for (;;) {
+            heap.drain(work);
+            lock_guard<mutex> guard(heap.greyLock);
+            if (heap.grey.empty()) break;
+            work.swap(heap.grey);
+        }
+        // what the write barriers shaded since is marked with the world
+        // stopped if there is little of it, and concurrently again otherwise
+        bool done = false;
+        stopped([&] {
+            {
+                lock_guard<mutex> guard(heap.cachesLock);
+                for (HeapCache* cache : heap.caches) {
+                    work.insert(work.end(), cache->grey.begin(), cache->grey.end());
+                    cache->grey.clear();
+                }
+            }
+            if (!heap.drain(work, round < 8 ? pauseWork : SIZE_MAX)) return;
+            heap.endMarking();
+            done = true;
+        });
+        if (done) break;
+    }
+    heap.requested = false;
+    heap.sweepAll();
+    heap.sweepDone();
+    heap.collections++;
+}
+
+// Runs phase with the world stopped, counting the time it stood still.
+template <class F> void Collector::stopped(F phase) {
+    auto start = chrono::steady_clock::now();
+    scheduler.stopTheWorld();
+    phase();
+    // the goroutines run again as soon as the world starts, maybe before
+    // this thread does
+    int64_t pause = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    scheduler.startTheWorld();
+    heap.pauseTotal += pause;
+    int64_t longest = heap.pauseMax.load();
+    while (pause > longest && !heap.pauseMax.compare_exchange_weak(longest, pause)) {}
+}
+
+// Shades what the interpreter and every goroutine hold.
+void Collector::shadeRoots(vector<uintptr_t>& work) {
+    Interpreter& interp = scheduler.interp;
+    for (void* p : interp.globals) heap.shade(uint64_t(uintptr_t(p)), work);
+    for (uint64_t* p : interp.functionValues) heap.shade(uint64_t(uintptr_t(p)), work);
+    for (auto& c : interp.codes) {
+        if (c != nullptr) heap.shadeRange(c->constants.data(), c->constants.size() * 8, work);
+    }
+    for (auto& w : scheduler.workers) {
+        for (auto& g : w->owned) shadeGoroutine(*g, work);
+    }
+}
+
+// The frames of g in the segments in use, and the values it keeps outside.
+void Collector::shadeGoroutine(const Goroutine& g, vector<uintptr_t>& work) {
+    for (size_t i = 0; i < g.segments.size() && i <= g.segment; i++) {
+        heap.shadeRange(g.segments[i].words.get(), g.segments[i].size * 8, work);
+    }
+    heap.shade(uint64_t(uintptr_t(g.ctx)), work);
+    for (const Goroutine::CallInfo& call : g.calls) heap.shade(uint64_t(uintptr_t(call.ctx)), work);
+    auto deferred = [&](const Goroutine::Deferred& d) {
+        heap.shade(uint64_t(uintptr_t(d.ctx)), work);
+        heap.shadeRange(d.args.data(), d.args.size() * 8, work);
+    };
+    deferred(g.start);
+    for (const Goroutine::Deferred& d : g.defers) deferred(d);
+    for (const Goroutine::Panic& p : g.panics) heap.shade(uint64_t(uintptr_t(p.value.data)), work);
+    heap.shadeRange(g.staging.data(), g.staging.size() * 8, work);
+    for (const Goroutine::Waiter& w : g.waiters) heap.shade(uint64_t(uintptr_t(w.channel)), work);
+}
+
+//===--- channel operations ---===//
+
+namespace {
+
+// A goroutine waiting in q of buffered channel c, taken off it to try again
+// after a send or receive that went by without the lock, or none.
+Goroutine* wakeWaiting(GoChannel* c, WaitQueue& q) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (q.count.load(memory_order_relaxed) == 0) return nullptr;
+    lock_guard<mutex> guard(c->lock);
+    Goroutine::Waiter* w = q.claim();
+    return w != nullptr ? w->g : nullptr;
+}
+
+// Queues g on channel c, whose lock is held, for case index.
+void wait(Goroutine& g, GoChannel* c, bool send, uint64_t* data, int32_t index) {
+    g.waiters.push_back({ &g, c, data, nullptr, nullptr, index, send, false });
+    (send ? c->senders : c->receivers).push(&g.waiters.back());
+}
+
+// Takes g off the queues it still waits in, their locks being held or taken
+// here, and forgets what woke it. The channel that woke it took it off its
+// queue already.
+void stopWaiting(Goroutine& g, bool locked) {
+    int32_t woken = g.wokenBy.load(memory_order_relaxed);
+    for (Goroutine::Waiter& w : g.waiters) {
+        if (w.index == woken) continue;
+        WaitQueue& q = w.send ? w.channel->senders : w.channel->receivers;
+        if (locked) {
+            if (w.linked) q.remove(&w);
+            continue;
+        }
+        lock_guard<mutex> guard(w.channel->lock);
+        if (w.linked) q.remove(&w);
+    }
+    g.waiters.clear();
+    g.wokenBy.store(-1, memory_order_relaxed);
+    g.handed = g.received = false;
+}
+
+}
+
+// Sends the value at value on c for goroutine g, or returns false for g to
+// wait, the send running again once g is woken.
+bool Interpreter::send(Goroutine& g, GoChannel* c, const uint64_t* value) {
+    if (g.wokenBy.load(memory_order_relaxed) >= 0) {
+        bool handed = g.handed;
+        stopWaiting(g, false);
+        if (handed) return true;
+    }
+    // a nil channel blocks forever
+    if (c == nullptr) return false;
+    if (c->closed.load(memory_order_relaxed)) throw RuntimeFault{ "send on closed channel" };
+    if (c->capacity > 0 && c->push(value)) {
+        if (Goroutine* r = wakeWaiting(c, c->receivers)) scheduler->ready(r);
+        return true;
+    }
+    unique_lock<mutex> guard(c->lock);
+    if (c->closed.load(memory_order_relaxed)) throw RuntimeFault{ "send on closed channel" };
+    auto* data = const_cast<uint64_t*>(value);
+    if (c->capacity == 0) {
+        Goroutine::Waiter* w = c->receivers.claim();
+        if (w == nullptr) {
+            wait(g, c, true, data, 0);
+            return false;
+        }
+        memcpy(w->data, value, c->words * 8);
+        w->g->handed = w->g->received = true;
+        guard.unlock();
+        scheduler->ready(w->g);
+        return true;
+    }
+    wait(g, c, true, data, 0);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!c->push(value)) return false;
+    stopWaiting(g, true);
+    guard.unlock();
+    if (Goroutine* r = wakeWaiting(c, c->receivers)) scheduler->ready(r);
+    return true;
+}
+
+// Receives a value from c into value for goroutine g, ok saying whether one
+// was sent rather than c closed, or returns false for g to wait.
+bool Interpreter::receive(Goroutine& g, GoChannel* c, uint64_t* value, bool& ok) {
+    if (g.wokenBy.load(memory_order_relaxed) >= 0) {
+        bool handed = g.handed;
+        ok = g.received;
+        stopWaiting(g, false);
+        if (handed) return true;
+    }
+    if (c == nullptr) return false;
+    ok = true;
+    if (c->capacity > 0 && c->pop(value)) {
+        if (Goroutine* s = wakeWaiting(c, c->senders)) scheduler->ready(s);
+        return true;
+    }
+    unique_lock<mutex> guard(c->lock);
+    if (c->capacity == 0) {
+        if (Goroutine::Waiter* w = c->senders.claim()) {
+            memcpy(value, w->data, c->words * 8);
+            w->g->handed = true;
+            guard.unlock();
+            scheduler->ready(w->g);
+            return true;
+        }
+    }
+    else {
+        wait(g, c, false, value, 0);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (c->pop(value)) {
+            stopWaiting(g, true);
+            guard.unlock();
+            if (Goroutine* s = wakeWaiting(c, c->senders)) scheduler->ready(s);
+            return true;
+        }
+    }
+    if (c->closed.load(memory_order_relaxed)) {
+        stopWaiting(g, true);
+        memset(value, 0, c->words * 8);
+        ok = false;
+        return true;
+    }
+    if (c->capacity == 0) wait(g, c, false, value, 0);
+    return false;
+}
+
+// Closes c, waking every goroutine waiting on it to try again.
+void Interpreter::close(GoChannel* c) {
+    if (c == nullptr) throw RuntimeFault{ "close of nil channel" };
+    vector<Goroutine*> woken;
+    {
+        lock_guard<mutex> guard(c->lock);
+        if (c->closed.load(memory_order_relaxed)) throw RuntimeFault{ "close of closed channel" };
+        c->closed.store(true, memory_order_relaxed);
+        for (WaitQueue* q : { &c->receivers, &c->senders }) {
+            while (Goroutine::Waiter* w = q->claim()) woken.push_back(w->g);
+        }
+    }
+    for (Goroutine* w : woken) scheduler->ready(w);
+}
+
+// The select of the BC_SELECT at pc for goroutine g, which sets the case it
+// chose and whether a receive got a value, or returns false for g to wait on
+// all of its channels. The cases are tried in a random order, with their
+// channels locked in the order of their addresses.
+bool Interpreter::select(Goroutine& g, const uint32_t* pc, uint64_t* fp) {
+    struct Case {
+        GoChannel* channel;
+        uint64_t* data;
+        bool send;
+    };
+    struct Locks {
+        GoChannel* channels[64];
+        size_t size = 0;
+        ~Locks() { unlock(); }
+        void unlock() {
+            while (size > 0) channels[--size]->lock.unlock();
+        }
+    };
+    uint32_t count = pc[2];
+    Case cases[64];
+    uint8_t order[64];
+    GoChannel* sorted[64];
+    size_t channels = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t* p = pc + 4 + i * 3;
+        GoChannel* c = reinterpret_cast<GoChannel*>(fp[p[1]]);
+        cases[i] = { c, fp + p[2], p[0] != 0 };
+        g.seed ^= g.seed << 13;
+        g.seed ^= g.seed >> 7;
+        g.seed ^= g.seed << 17;
+        uint32_t j = uint32_t(g.seed % (i + 1));
+        order[i] = order[j];
+        order[j] = uint8_t(i);
+        if (c == nullptr) continue;
+        size_t k = channels;
+        while (k > 0 && uintptr_t(sorted[k - 1]) > uintptr_t(c)) k--;
+        if (k > 0 && sorted[k - 1] == c) continue;
+        memmove(sorted + k + 1, sorted + k, (channels - k) * sizeof(GoChannel*));
+        sorted[k] = c;
+        channels++;
+    }
+    int32_t woken = g.wokenBy.load(memory_order_relaxed);
+    bool handed = g.handed, ok = g.received;
+    if (woken >= 0) stopWaiting(g, false);
+    int64_t chosen = handed ? woken : -1;
+    if (!handed) {
+        Locks held;
+        for (size_t i = 0; i < channels; i++) {
+            sorted[i]->lock.lock();
+            held.channels[held.size++] = sorted[i];
+        }
+        // Whether case i goes on now, which it then does. Once g waits, only
+        // the ring of a buffered channel can have changed.
+        Goroutine* wake = nullptr;
+        auto attempt = [&](uint32_t i, bool waiting) {
+            Case& x = cases[i];
+            GoChannel* c = x.channel;
+            if (c == nullptr || (waiting && c->capacity == 0)) return false;
+            if (x.send && c->closed.load(memory_order_relaxed)) throw RuntimeFault{ "send on closed channel" };
+            ok = true;
+            if (c->capacity == 0) {
+                if (Goroutine::Waiter* w = (x.send ? c->receivers : c->senders).claim()) {
+                    memcpy(x.send ? w->data : x.data, x.send ? x.data : w->data, c->words * 8);
+                    w->g->handed = true;
+                    w->g->received = x.send;
+                    wake = w->g;
+                    return true;
+                }
+            }
+            else if (x.send ? c->push(x.data) : c->pop(x.data)) {
+                if (waiting) stopWaiting(g, true);
+                if (Goroutine::Waiter* w = (x.send ? c->receivers : c->senders).claim()) wake = w->g;
+                return true;
+            }
+            if (x.send || !c->closed.load(memory_order_relaxed)) return false;
+            if (waiting) stopWaiting(g, true);
+            memset(x.data, 0, c->words * 8);
+            ok = false;
+            return true;
+        };
+        for (uint32_t k = 0; k < count && chosen < 0; k++) {
+            if (attempt(order[k], false)) chosen = order[k];
+        }
+        if (chosen < 0 && pc[3] == 0) {
+            g.waiters.reserve(count);
+            for (uint32_t i = 0; i < count; i++) {
+                if (cases[i].channel != nullptr) wait(g, cases[i].channel, cases[i].send, cases[i].data, int32_t(i));
+            }
+            atomic_thread_fence(memory_order_seq_cst);
+            for (uint32_t k = 0; k < count && chosen < 0; k++) {
+                if (attempt(order[k], true)) chosen = order[k];
+            }
+            if (chosen < 0) return false;
+        }
+        held.unlock();
+        if (wake != nullptr) scheduler->ready(wake);
+        // a buffered channel woke g to try again, but the value or the room
+        // it found may be for another goroutine
+        if (woken >= 0 && chosen != woken && cases[woken].channel->capacity > 0) {
+            GoChannel* c = cases[woken].channel;
+            if (Goroutine* other = wakeWaiting(c, cases[woken].send ? c->senders : c->receivers)) {
+                scheduler->ready(other);
+            }
+        }
+    }
+    fp[pc[1]] = uint64_t(chosen);
+    fp[pc[1] + 1] = ok;
+    return true;
+}
+
+namespace {
+
+inline double asDouble(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+inline uint64_t doubleBits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof bits);
+    return bits;
+}
+inline float asFloat(uint64_t bits) {
+    float f;
+    uint32_t low = uint32_t(bits);
+    memcpy(&f, &low, sizeof f);
+    return f;
+}
+inline uint64_t floatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    return bits;
+}
+// Float to integer conversions as the amd64 instructions do them, out of
+// range values giving the smallest int64.
+inline int64_t toInt(double d) {
+    return d >= -9223372036854775808.0 && d < 9223372036854775808.0 ? int64_t(d) : INT64_MIN;
+}
+inline uint64_t toUint(double d) {
+    if (d < 9223372036854775808.0) return uint64_t(toInt(d));
+    return d < 18446744073709551616.0 ? uint64_t(d) : uint64_t(INT64_MIN);
+}
+
+[[noreturn]] void nilDereference() { runtimeError("invalid memory address or nil pointer dereference"); }
+[[noreturn]] void indexOutOfRange(int64_t i, int64_t length) {
+    runtimeError("index out of range [" + to_string(i) + "] with length " + to_string(length));
+}
+
+}
+
+// The call a BC_DEFER or BC_GO at pc saves, its arguments copied now and the
+// function it calls found.
+Goroutine::Deferred Interpreter::deferred(Goroutine& g, const uint32_t* pc, uint64_t* fp) {
+    uint32_t kind = pc[3], words = pc[4];
+    uint64_t* target = fp + pc[2];
+    Goroutine::Deferred d{ g.calls.size(), nullptr, nullptr, UINT32_MAX, vector<uint64_t>(fp + pc[1], fp + pc[1] + words) };
+    if (kind == 0) {
+        d.code = reinterpret_cast<const Code*>(*target);
+    }
+    else if (kind == 1) {
+        d.ctx = reinterpret_cast<uint64_t*>(*target);
+        if (d.ctx == nullptr) nilDereference();
+        d.code = reinterpret_cast<const Code*>(d.ctx[0]);
+    }
+    else if (kind == 2) {
+        auto* receiver = reinterpret_cast<const GoInterface*>(target);
+        const RType::Method* m;
+        d.code = method(*receiver, Symbol(pc[5]), m);
+        if (m->indirect) {
+            uint32_t receiverWords = uint32_t(max<int64_t>(align8(m->size), 8) / 8);
+            vector<uint64_t> args(receiverWords);
+            loadAs(args.data(), receiver->data, m->load, m->size);
+            args.insert(args.end(), d.args.begin() + 1, d.args.end());
+            d.args = move(args);
+        }
+    }
+    else {
+        // the values of interfaces made for the call may be in the frame,
+        // which is gone by then
+        d.external = uint32_t(*target);
+        auto* args = reinterpret_cast<GoInterface*>(d.args.data());
+        for (uint32_t i = 0; i < words / 2; i++) {
+            if (args[i].type == nullptr || args[i].type->pointerShaped) continue;
+            void* box = heapAllocate(size_t(args[i].type->size));
+            memcpy(box, args[i].data, size_t(args[i].type->size));
+            args[i].data = box;
+        }
+    }
+    return d;
+}
+
+// Makes the deferred call of g to a function of another package, the last
+// one, which leaves g.defers first. Out of execute, where the jumps between
+// handlers would skip its destructor.
+void Interpreter::deferredExternal(Goroutine& g) {
+    Goroutine::Deferred d = move(g.defers.back());
+    g.defers.pop_back();
+    external(g, d.external, reinterpret_cast<const GoInterface*>(d.args.data()), int64_t(d.args.size() / 2));
+}
+
+// Readies g to call entry with args, ctx being its closure.
+void Interpreter::start(Goroutine& g, const Code* entry, uint64_t* ctx, const vector<uint64_t>& args) {
+    g.fp = g.enter(entry, g.base(), args.empty() ? nullptr : args.data(), args.size(),
+        { nullptr, nullptr, nullptr, nullptr, nullptr, 0 });
+    g.code = entry;
+    g.pc = entry->code.data();
+    g.ctx = ctx;
+}
+
+// What method t->format returns for the value at p, called on g above the
+// frame it stopped in as fmt calls it, before g goes on. A panic in it is
+// shown in its place, as fmt does; it cannot block as g waits for it.
+string Interpreter::callFormat(Goroutine& g, const RType* t, const void* p) {
+    const RType::Method* m = t->format;
+    const void* data = t->pointerShaped ? *static_cast<void* const*>(p) : p;
+    vector<uint64_t> args(m->indirect ? size_t(max<int64_t>(align8(m->size), 8) / 8) : 1);
+    if (m->indirect) {
+        loadAs(args.data(), data, m->load, m->size);
+    }
+    else {
+        args[0] = uint64_t(uintptr_t(data));
+    }
+    const Code* callee = codes[m->function].get();
+    const Code* code = g.code;
+    const uint32_t* pc = g.pc;
+    uint64_t* fp = g.fp;
+    uint64_t* ctx = g.ctx;
+    size_t panics = g.panics.size();
+    // the caller's closure stays where the collector finds it
+    uint64_t* at = g.enter(callee, code != nullptr ? fp + code->frameWords : g.base(), args.data(), args.size(),
+        { nullptr, nullptr, nullptr, ctx, nullptr, 0 });
+    g.code = callee;
+    g.pc = callee->code.data();
+    g.fp = at;
+    g.ctx = nullptr;
+    Stop stop;
+    while ((stop = execute(g)) == ST_YIELDED) scheduler->safePoint();
+    if (stop == ST_PARKED) {
+        throw ProgramExit{ 2, "fatal error: " + t->name + "." + string(symbols.text(m->name)) + " blocked in fmt\n" };
+    }
+    g.code = code;
+    g.pc = pc;
+    g.fp = fp;
+    g.ctx = ctx;
+    string text;
+    if (g.panics.size() > panics) {
+        text = "%!v(PANIC=" + string(symbols.text(m->name)) + " method: ";
+        formatInterface(text, g.panics.back().value, 'v');
+        text += ')';
+        g.panics.resize(panics);
+        return text;
+    }
+    auto* result = reinterpret_cast<const GoString*>(at + callee->argsWords);
+    return string(result->ptr, size_t(result->len));
+}
+
+// Runs goroutine g from where it stopped until the call it started with
+// returns or a panic unwinds it, which then stays in g.panics, until it
+// yields to the other goroutines, or until it parks on a channel to run the
+// instruction again once woken. It yields by itself once it has taken
+// timeSlice jumps back and calls.
+Stop Interpreter::execute(Goroutine& g) {
+    static const uint32_t unwind[] = { BC_UNWIND };
+    static constexpr int32_t timeSlice = 1 << 14;
+    const Code* code = g.code;
+    const uint32_t* pc = g.pc;
+    uint64_t* fp = g.fp;
+    uint64_t* ctx = g.ctx;
+    int32_t budget = timeSlice;
+#define R(i) fp[pc[i]]
+#define W(i) (&fp[pc[i]])
+#define SAVE() (g.code = code, g.pc = pc, g.fp = fp, g.ctx = ctx)
+#define YIELD() do { SAVE(); return ST_YIELDED; } while (0)
+#define PREEMPT() do { if (--budget < 0 || Scheduler::stopping.load(memory_order_relaxed)) YIELD(); } while (0)
+#define JUMP(k) do { int32_t offset = int32_t(pc[k]); pc += offset; if (offset < 0) PREEMPT(); } while (0)
+#if defined(__GNUC__)
+    static const void* const labels[] = {
+        &&L_BC_MOV, &&L_BC_MOV2, &&L_BC_MOV3, &&L_BC_MOVN, &&L_BC_ZERO, &&L_BC_LEA, &&L_BC_ADD, &&L_BC_SUB, &&L_BC_MUL,
+        &&L_BC_AND, &&L_BC_OR, &&L_BC_XOR, &&L_BC_ANDNOT, &&L_BC_ADDI, &&L_BC_DIV, &&L_BC_DIVU, &&L_BC_MOD, &&L_BC_MODU,
+        &&L_BC_SHL, &&L_BC_SHR, &&L_BC_SAR, &&L_BC_NEG, &&L_BC_COMPL, &&L_BC_NOT, &&L_BC_EXT, &&L_BC_FADD, &&L_BC_FSUB,
+        &&L_BC_FMUL, &&L_BC_FDIV, &&L_BC_FNEG, &&L_BC_FADD32, &&L_BC_FSUB32, &&L_BC_FMUL32, &&L_BC_FDIV32,
+        &&L_BC_FNEG32, &&L_BC_EQ, &&L_BC_NE, &&L_BC_LT, &&L_BC_LE, &&L_BC_LTU, &&L_BC_LEU, &&L_BC_FEQ, &&L_BC_FNE,
+        &&L_BC_FLT, &&L_BC_FLE, &&L_BC_FEQ32, &&L_BC_FNE32, &&L_BC_FLT32, &&L_BC_FLE32, &&L_BC_JMP, &&L_BC_JT,
+        &&L_BC_JF, &&L_BC_JEQ, &&L_BC_JNE, &&L_BC_JLT, &&L_BC_JLE, &&L_BC_JLTU, &&L_BC_JLEU, &&L_BC_CVT, &&L_BC_LD,
+        &&L_BC_LDX, &&L_BC_LDN, &&L_BC_ST, &&L_BC_STX, &&L_BC_STN, &&L_BC_ALLOCA, &&L_BC_NEW, &&L_BC_FIELDADDR,
+        &&L_BC_INDEXADDR, &&L_BC_SLICEADDR, &&L_BC_FLD, &&L_BC_INDEXARR, &&L_BC_INDEXSTR, &&L_BC_FST, &&L_BC_CONCAT,
+        &&L_BC_SCMP, &&L_BC_STRNEXT, &&L_BC_CVTSTR, &&L_BC_SLICE, &&L_BC_MKSLICE, &&L_BC_APPEND, &&L_BC_APPENDS,
+        &&L_BC_COPY, &&L_BC_MKMAP, &&L_BC_MAPGET, &&L_BC_MAPSET, &&L_BC_MAPDEL, &&L_BC_MAPLEN, &&L_BC_MAPITER,
+        &&L_BC_MAPNEXT, &&L_BC_MKCHAN, &&L_BC_SEND, &&L_BC_RECV, &&L_BC_CLOSE, &&L_BC_CHANLEN, &&L_BC_SELECT,
+        &&L_BC_MKIFACE, &&L_BC_ASSERT, &&L_BC_ASSERTI, &&L_BC_EQT, &&L_BC_IEQ, &&L_BC_CLOSURE,
+        &&L_BC_FREEVAR, &&L_BC_CALL, &&L_BC_CALLV, &&L_BC_CALLM, &&L_BC_CALLX, &&L_BC_DEFER, &&L_BC_GO, &&L_BC_RUNDEFERS,
+        &&L_BC_RET, &&L_BC_PANIC, &&L_BC_RECOVER, &&L_BC_PRINT, &&L_BC_UNWIND
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == BC_UNWIND + 1, "every bytecode needs a label");
+#define CASE(op) case op: L_##op:
+#define NEXT() goto *labels[*pc]
+#else
+#define CASE(op) case op:
+#define NEXT() continue
+#endif
+    for (;;) {
+        try {
+#if defined(__GNUC__)
+            NEXT();
+#endif
+            for (;;) {
+                switch (Bytecode(*pc)) {
+                CASE(BC_MOV) R(1) = R(2); pc += 3; NEXT();
+                CASE(BC_MOV2) {
+                    uint64_t a = W(2)[0], b = W(2)[1];
+                    W(1)[0] = a;
+                    W(1)[1] = b;
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MOV3) {
+                    uint64_t a = W(2)[0], b = W(2)[1], c = W(2)[2];
+                    W(1)[0] = a;
+                    W(1)[1] = b;
+                    W(1)[2] = c;
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MOVN) memmove(W(1), W(2), size_t(pc[3]) * 8); pc += 4; NEXT();
+                CASE(BC_ZERO) memset(W(1), 0, size_t(pc[2]) * 8); pc += 3; NEXT();
+                CASE(BC_LEA) R(1) = uint64_t(uintptr_t(W(2))); pc += 3; NEXT();
+                CASE(BC_ADD) R(1) = R(2) + R(3); pc += 4; NEXT();
+                CASE(BC_SUB) R(1) = R(2) - R(3); pc += 4; NEXT();
+                CASE(BC_MUL) R(1) = R(2) * R(3); pc += 4; NEXT();
+                CASE(BC_AND) R(1) = R(2) & R(3); pc += 4; NEXT();
+                CASE(BC_OR) R(1) = R(2) | R(3); pc += 4; NEXT();
+                CASE(BC_XOR) R(1) = R(2) ^ R(3); pc += 4; NEXT();
+                CASE(BC_ANDNOT) R(1) = R(2) & ~R(3); pc += 4; NEXT();
+                CASE(BC_ADDI) R(1) = R(2) + uint64_t(int64_t(int32_t(pc[3]))); pc += 4; NEXT();
+                CASE(BC_DIV) {
+                    int64_t a = int64_t(R(2)), b = int64_t(R(3));
+                    if (b == 0) runtimeError("integer divide by zero");
+                    R(1) = b == -1 ? 0 - uint64_t(a) : uint64_t(a / b);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_DIVU) {
+                    if (R(3) == 0) runtimeError("integer divide by zero");
+                    R(1) = R(2) / R(3);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_MOD) {
+                    int64_t a = int64_t(R(2)), b = int64_t(R(3));
+                    if (b == 0) runtimeError("integer divide by zero");
+                    R(1) = b == -1 ? 0 : uint64_t(a % b);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_MODU) {
+                    if (R(3) == 0) runtimeError("integer divide by zero");
+                    R(1) = R(2) % R(3);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_SHL) R(1) = R(3) >= 64 ? 0 : R(2) << R(3); pc += 4; NEXT();
+                CASE(BC_SHR) R(1) = R(3) >= 64 ? 0 : R(2) >> R(3); pc += 4; NEXT();
+                CASE(BC_SAR) R(1) = uint64_t(int64_t(R(2)) >> (R(3) >= 64 ? 63 : R(3))); pc += 4; NEXT();
+                CASE(BC_NEG) R(1) = 0 - R(2); pc += 3; NEXT();
+                CASE(BC_COMPL) R(1) = ~R(2); pc += 3; NEXT();
+                CASE(BC_NOT) R(1) = R(2) ^ 1; pc += 3; NEXT();
+                CASE(BC_EXT) R(1) = extend(R(2), LoadKind(pc[3])); pc += 4; NEXT();
+                CASE(BC_FADD) R(1) = doubleBits(asDouble(R(2)) + asDouble(R(3))); pc += 4; NEXT();
+                CASE(BC_FSUB) R(1) = doubleBits(asDouble(R(2)) - asDouble(R(3))); pc += 4; NEXT();
+                CASE(BC_FMUL) R(1) = doubleBits(asDouble(R(2)) * asDouble(R(3))); pc += 4; NEXT();
+                CASE(BC_FDIV) R(1) = doubleBits(asDouble(R(2)) / asDouble(R(3))); pc += 4; NEXT();
+                CASE(BC_FNEG) R(1) = R(2) ^ uint64_t(1) << 63; pc += 3; NEXT();
+                CASE(BC_FADD32) R(1) = floatBits(asFloat(R(2)) + asFloat(R(3))); pc += 4; NEXT();
+                CASE(BC_FSUB32) R(1) = floatBits(asFloat(R(2)) - asFloat(R(3))); pc += 4; NEXT();
+                CASE(BC_FMUL32) R(1) = floatBits(asFloat(R(2)) * asFloat(R(3))); pc += 4; NEXT();
+                CASE(BC_FDIV32) R(1) = floatBits(asFloat(R(2)) / asFloat(R(3))); pc += 4; NEXT();
+                CASE(BC_FNEG32) R(1) = R(2) ^ uint64_t(1) << 31; pc += 3; NEXT();
+                CASE(BC_EQ) R(1) = R(2) == R(3); pc += 4; NEXT();
+                CASE(BC_NE) R(1) = R(2) != R(3); pc += 4; NEXT();
+                CASE(BC_LT) R(1) = int64_t(R(2)) < int64_t(R(3)); pc += 4; NEXT();
+                CASE(BC_LE) R(1) = int64_t(R(2)) <= int64_t(R(3)); pc += 4; NEXT();
+                CASE(BC_LTU) R(1) = R(2) < R(3); pc += 4; NEXT();
+                CASE(BC_LEU) R(1) = R(2) <= R(3); pc += 4; NEXT();
+                CASE(BC_FEQ) R(1) = asDouble(R(2)) == asDouble(R(3)); pc += 4; NEXT();
+                CASE(BC_FNE) R(1) = asDouble(R(2)) != asDouble(R(3)); pc += 4; NEXT();
+                CASE(BC_FLT) R(1) = asDouble(R(2)) < asDouble(R(3)); pc += 4; NEXT();
+                CASE(BC_FLE) R(1) = asDouble(R(2)) <= asDouble(R(3)); pc += 4; NEXT();
+                CASE(BC_FEQ32) R(1) = asFloat(R(2)) == asFloat(R(3)); pc += 4; NEXT();
+                CASE(BC_FNE32) R(1) = asFloat(R(2)) != asFloat(R(3)); pc += 4; NEXT();
+                CASE(BC_FLT32) R(1) = asFloat(R(2)) < asFloat(R(3)); pc += 4; NEXT();
+                CASE(BC_FLE32) R(1) = asFloat(R(2)) <= asFloat(R(3)); pc += 4; NEXT();
+                CASE(BC_JMP) JUMP(1); NEXT();
+                CASE(BC_JT) if (R(1) != 0) JUMP(2); else pc += 3; NEXT();
+                CASE(BC_JF) if (R(1) == 0) JUMP(2); else pc += 3; NEXT();
+                CASE(BC_JEQ) if (R(1) == R(2)) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_JNE) if (R(1) != R(2)) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_JLT) if (int64_t(R(1)) < int64_t(R(2))) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_JLE) if (int64_t(R(1)) <= int64_t(R(2))) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_JLTU) if (R(1) < R(2)) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_JLEU) if (R(1) <= R(2)) JUMP(3); else pc += 4; NEXT();
+                CASE(BC_CVT) {
+                    uint64_t a = R(2), d = 0;
+                    switch (Conversion(pc[3])) {
+                    case CV_INT_F64: d = doubleBits(double(int64_t(a))); break;
+                    case CV_UINT_F64: d = doubleBits(double(a)); break;
+                    case CV_INT_F32: d = floatBits(float(int64_t(a))); break;
+                    case CV_UINT_F32: d = floatBits(float(a)); break;
+                    case CV_F64_INT: d = uint64_t(toInt(asDouble(a))); break;
+                    case CV_F64_UINT: d = toUint(asDouble(a)); break;
+                    case CV_F32_INT: d = uint64_t(toInt(asFloat(a))); break;
+                    case CV_F32_UINT: d = toUint(asFloat(a)); break;
+                    case CV_F32_F64: d = doubleBits(asFloat(a)); break;
+                    case CV_F64_F32: d = floatBits(float(asDouble(a))); break;
+                    }
+                    R(1) = d;
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_LD) {
+                    if (R(2) == 0) nilDereference();
+                    memcpy(W(1), reinterpret_cast<const void*>(R(2)), 8);
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_LDX) {
+                    if (R(2) == 0) nilDereference();
+                    loadAs(W(1), reinterpret_cast<const void*>(R(2)), LoadKind(pc[3]), 0);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_LDN) {
+                    if (R(2) == 0) nilDereference();
+                    memmove(W(1), reinterpret_cast<const void*>(R(2)), pc[3]);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_ST) {
+                    if (R(1) == 0) nilDereference();
+                    writeBarrier(reinterpret_cast<void*>(R(1)), 8);
+                    memcpy(reinterpret_cast<void*>(R(1)), W(2), 8);
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_STX) CASE(BC_STN) {
+                    if (R(1) == 0) nilDereference();
+                    writeBarrier(reinterpret_cast<void*>(R(1)), pc[3]);
+                    memmove(reinterpret_cast<void*>(R(1)), W(2), pc[3]);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_ALLOCA) {
+                    uint64_t* slot = fp + pc[2];
+                    memset(slot, 0, size_t(pc[3]) * 8);
+                    R(1) = uint64_t(uintptr_t(slot));
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_NEW) R(1) = uint64_t(uintptr_t(heapAllocate(pc[2]))); pc += 3; NEXT();
+                CASE(BC_FIELDADDR) {
+                    if (R(2) == 0) nilDereference();
+                    R(1) = R(2) + pc[3];
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_INDEXADDR) {
+                    if (R(2) == 0) nilDereference();
+                    if (R(3) >= pc[4]) indexOutOfRange(int64_t(R(3)), pc[4]);
+                    R(1) = R(2) + R(3) * pc[5];
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_SLICEADDR) {
+                    auto* s = reinterpret_cast<const GoSlice*>(W(2));
+                    if (R(3) >= uint64_t(s->len)) indexOutOfRange(int64_t(R(3)), s->len);
+                    R(1) = uint64_t(uintptr_t(s->ptr)) + R(3) * pc[4];
+                    pc += 5;
+                    NEXT();
+                }
+                CASE(BC_FLD) {
+                    uint64_t value;
+                    const char* field = reinterpret_cast<const char*>(W(2)) + pc[3];
+                    if (pc[4] == LD_BYTES) {
+                        memmove(W(1), field, pc[5]);
+                    }
+                    else {
+                        loadAs(&value, field, LoadKind(pc[4]), 0);
+                        R(1) = value;
+                    }
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_INDEXARR) {
+                    if (R(3) >= pc[4]) indexOutOfRange(int64_t(R(3)), pc[4]);
+                    const char* elem = reinterpret_cast<const char*>(W(2)) + R(3) * pc[5];
+                    if (pc[6] == LD_BYTES) {
+                        memmove(W(1), elem, pc[5]);
+                    }
+                    else {
+                        uint64_t value;
+                        loadAs(&value, elem, LoadKind(pc[6]), 0);
+                        R(1) = value;
+                    }
+                    pc += 7;
+                    NEXT();
+                }
+                CASE(BC_INDEXSTR) {
+                    auto* s = reinterpret_cast<const GoString*>(W(2));
+                    if (R(3) >= uint64_t(s->len)) indexOutOfRange(int64_t(R(3)), s->len);
+                    R(1) = uint8_t(s->ptr[R(3)]);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_FST) memmove(reinterpret_cast<char*>(W(1)) + pc[3], W(2), pc[4]); pc += 5; NEXT();
+                CASE(BC_CONCAT) {
+                    GoString a = *reinterpret_cast<const GoString*>(W(2)), b = *reinterpret_cast<const GoString*>(W(3));
+                    GoString r = a.len == 0 ? b : a;
+                    if (a.len != 0 && b.len != 0) {
+                        char* p = static_cast<char*>(heapAllocate(size_t(a.len + b.len), false));
+                        memcpy(p, a.ptr, size_t(a.len));
+                        memcpy(p + a.len, b.ptr, size_t(b.len));
+                        r = { p, a.len + b.len };
+                    }
+                    *reinterpret_cast<GoString*>(W(1)) = r;
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_SCMP) {
+                    auto* a = reinterpret_cast<const GoString*>(W(2));
+                    auto* b = reinterpret_cast<const GoString*>(W(3));
+                    uint32_t condition = pc[4];
+                    bool r;
+                    if (condition <= 1) {
+                        r = (a->len == b->len && memcmp(a->ptr, b->ptr, size_t(a->len)) == 0) == (condition == 0);
+                    }
+                    else {
+                        int c = memcmp(a->ptr, b->ptr, size_t(min(a->len, b->len)));
+                        if (c == 0) c = a->len < b->len ? -1 : a->len > b->len;
+                        r = condition == 2 ? c < 0 : condition == 3 ? c <= 0 : condition == 4 ? c > 0 : c >= 0;
+                    }
+                    R(1) = r;
+                    pc += 5;
+                    NEXT();
+                }
+                CASE(BC_STRNEXT) {
+                    auto* s = reinterpret_cast<const GoString*>(W(2));
+                    int64_t i = int64_t(R(3));
+                    int size;
+                    int32_t r = decodeUtf8(reinterpret_cast<const unsigned char*>(s->ptr) + i, s->len - i, size);
+                    W(1)[0] = uint64_t(int64_t(r));
+                    W(1)[1] = uint64_t(i + size);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_CVTSTR) {
+                    // built in the heap: a local with a destructor would
+                    // outlive the jump to the next handler
+                    switch (StringConversion(pc[3])) {
+                    case SC_RUNE: {
+                        int64_t r = int64_t(R(2));
+                        char text[4];
+                        int n = encodeUtf8(text, r != int32_t(r) ? 0xfffd : r);
+                        char* p = static_cast<char*>(heapAllocate(size_t(n), false));
+                        memcpy(p, text, size_t(n));
+                        *reinterpret_cast<GoString*>(W(1)) = { p, n };
+                        break;
+                    }
+                    case SC_BYTES: {
+                        auto* s = reinterpret_cast<const GoSlice*>(W(2));
+                        char* p = static_cast<char*>(heapAllocate(size_t(s->len), false));
+                        memcpy(p, s->ptr, size_t(s->len));
+                        *reinterpret_cast<GoString*>(W(1)) = { p, s->len };
+                        break;
+                    }
+                    case SC_RUNES: {
+                        auto* s = reinterpret_cast<const GoSlice*>(W(2));
+                        auto* runes = reinterpret_cast<const int32_t*>(s->ptr);
+                        int64_t n = 0;
+                        for (int64_t i = 0; i < s->len; i++) n += encodeUtf8(nullptr, runes[i]);
+                        char* p = static_cast<char*>(heapAllocate(size_t(n), false));
+                        for (int64_t i = 0, at = 0; i < s->len; i++) at += encodeUtf8(p + at, runes[i]);
+                        *reinterpret_cast<GoString*>(W(1)) = { p, n };
+                        break;
+                    }
+                    case SC_TO_BYTES: {
+                        GoString s = *reinterpret_cast<const GoString*>(W(2));
+                        char* p = static_cast<char*>(heapAllocate(size_t(s.len), false));
+                        memcpy(p, s.ptr, size_t(s.len));
+                        *reinterpret_cast<GoSlice*>(W(1)) = { p, s.len, s.len };
+                        break;
+                    }
+                    case SC_TO_RUNES: {
+                        GoString s = *reinterpret_cast<const GoString*>(W(2));
+                        auto* p = static_cast<int32_t*>(heapAllocate(size_t(s.len) * 4, false));
+                        int64_t n = 0;
+                        for (int64_t i = 0; i < s.len; n++) {
+                            int size;
+                            p[n] = decodeUtf8(reinterpret_cast<const unsigned char*>(s.ptr) + i, s.len - i, size);
+                            i += size;
+                        }
+                        *reinterpret_cast<GoSlice*>(W(1)) = { reinterpret_cast<char*>(p), n, n };
+                        break;
+                    }
+                    }
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_SLICE) {
+                    // s[lo:hi:max] of a slice, a string or a pointer to an array
+                    uint32_t mask = pc[6], kind = pc[7];
+                    int64_t size = pc[8], len, cap;
+                    char* ptr;
+                    if (kind == 2) {
+                        ptr = reinterpret_cast<char*>(R(2));
+                        if (ptr == nullptr) nilDereference();
+                        len = cap = pc[9];
+                    }
+                    else {
+                        auto* s = reinterpret_cast<const GoSlice*>(W(2));
+                        ptr = s->ptr;
+                        len = s->len;
+                        cap = kind == 1 ? s->len : s->cap;
+                    }
+                    uint64_t lo = mask & 1 ? R(3) : 0, hi = mask & 2 ? R(4) : uint64_t(len), max = mask & 4 ? R(5) : uint64_t(cap);
+                    if (kind == 1 ? hi > uint64_t(len) : max > uint64_t(cap) || hi > max) {
+                        runtimeError("slice bounds out of range [:" + to_string(int64_t(hi)) + "] with capacity " + to_string(cap));
+                    }
+                    if (lo > hi) runtimeError("slice bounds out of range [" + to_string(int64_t(lo)) + ":" + to_string(int64_t(hi)) + "]");
+                    W(1)[0] = uint64_t(uintptr_t(ptr + int64_t(lo) * size));
+                    W(1)[1] = hi - lo;
+                    if (kind != 1) W(1)[2] = max - lo;
+                    pc += 10;
+                    NEXT();
+                }
+                CASE(BC_MKSLICE) {
+                    int64_t len = int64_t(R(2)), cap = int64_t(R(3)), size = pc[4];
+                    if (len < 0 || len > cap) runtimeError("makeslice: len out of range");
+                    if (size != 0 && cap > (int64_t(1) << 40) / size) runtimeError("makeslice: cap out of range");
+                    *reinterpret_cast<GoSlice*>(W(1)) = { static_cast<char*>(heapAllocate(size_t(cap * size))), len, cap };
+                    pc += 5;
+                    NEXT();
+                }
+                CASE(BC_APPEND) CASE(BC_APPENDS) {
+                    GoSlice r = *reinterpret_cast<const GoSlice*>(W(2));
+                    bool spread = *pc == BC_APPENDS;
+                    int64_t size = pc[spread ? 4 : 5];
+                    int64_t count = spread ? reinterpret_cast<const GoSlice*>(W(3))->len : pc[4];
+                    const char* elems = spread ? reinterpret_cast<const GoSlice*>(W(3))->ptr : reinterpret_cast<const char*>(W(3));
+                    if (r.len + count > r.cap) {
+                        int64_t cap = r.cap < 256 ? r.cap * 2 : r.cap + r.cap / 4;
+                        if (cap < r.len + count) cap = r.len + count;
+                        char* p = static_cast<char*>(heapAllocate(size_t(cap * size)));
+                        if (r.len != 0) memcpy(p, r.ptr, size_t(r.len * size));
+                        r.ptr = p;
+                        r.cap = cap;
+                    }
+                    else {
+                        writeBarrier(r.ptr + r.len * size, size_t(count * size));
+                    }
+                    memmove(r.ptr + r.len * size, elems, size_t(count * size));
+                    r.len += count;
+                    *reinterpret_cast<GoSlice*>(W(1)) = r;
+                    pc += spread ? 5 : 6;
+                    NEXT();
+                }
+                CASE(BC_COPY) {
+                    auto* dst = reinterpret_cast<const GoSlice*>(W(2));
+                    auto* src = reinterpret_cast<const GoSlice*>(W(3));
+                    int64_t n = min(dst->len, src->len);
+                    writeBarrier(dst->ptr, size_t(n * pc[4]));
+                    memmove(dst->ptr, src->ptr, size_t(n * pc[4]));
+                    R(1) = uint64_t(n);
+                    pc += 5;
+                    NEXT();
+                }
+                CASE(BC_MKMAP) {
+                    auto* t = reinterpret_cast<const RType*>(R(3));
+                    int64_t hint = max<int64_t>(int64_t(R(2)), 0);
+                    R(1) = uint64_t(uintptr_t(new (heapAllocate(sizeof(GoMap))) GoMap(t->key, t->elem, hint)));
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_MAPGET) {
+                    auto* m = reinterpret_cast<const GoMap*>(R(2));
+                    const uint64_t* value = m != nullptr ? m->lookup(W(3)) : nullptr;
+                    if (value != nullptr) {
+                        loadAs(W(1), value, m->elem->load, m->elem->size);
+                    }
+                    else {
+                        memset(W(1), 0, max<size_t>(pc[5], 1) * 8);
+                    }
+                    if (pc[4]) W(1)[pc[5]] = value != nullptr;
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_MAPSET) {
+                    auto* m = reinterpret_cast<GoMap*>(R(1));
+                    if (m == nullptr) throw RuntimeFault{ "assignment to entry in nil map" };
+                    uint64_t* value = m->insert(W(2));
+                    writeBarrier(value, size_t(m->elem->size));
+                    memmove(value, W(3), size_t(m->elem->size));
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_MAPDEL) {
+                    if (auto* m = reinterpret_cast<GoMap*>(R(1))) m->erase(W(2));
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MAPLEN) {
+                    auto* m = reinterpret_cast<const GoMap*>(R(2));
+                    R(1) = m != nullptr ? uint64_t(m->count) : 0;
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MAPITER) {
+                    auto* it = static_cast<GoMapIterator*>(heapAllocate(sizeof(GoMapIterator)));
+                    *it = { reinterpret_cast<GoMap*>(R(2)), 0 };
+                    R(1) = uint64_t(uintptr_t(it));
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MAPNEXT) {
+                    auto* it = reinterpret_cast<GoMapIterator*>(R(2));
+                    GoMap* m = it->map;
+                    while (m != nullptr && it->next < m->used && m->entry(it->next)[0] == 0) it->next++;
+                    if (m == nullptr || it->next >= m->used) {
+                        R(1) = 0;
+                    }
+                    else {
+                        const uint64_t* e = m->entry(it->next++);
+                        W(1)[0] = 1;
+                        loadAs(W(1) + 1, e + 1, m->key->load, m->key->size);
+                        loadAs(W(1) + m->valueWord, e + m->valueWord, m->elem->load, m->elem->size);
+                    }
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_MKCHAN) {
+                    auto* t = reinterpret_cast<const RType*>(R(3));
+                    int64_t size = int64_t(R(2));
+                    if (size < 0 || size > (int64_t(1) << 40) / max<int64_t>(t->elem->size + 8, 8)) {
+                        runtimeError("makechan: size out of range");
+                    }
+                    R(1) = uint64_t(uintptr_t(new (heapAllocate(sizeof(GoChannel))) GoChannel(t->elem, size)));
+                    pc += 4;
+                    NEXT();
+                }
+                // a goroutine that has to wait on a channel stops at the
+                // instruction, which finds out what woke it when it runs again
+                CASE(BC_SEND) {
+                    SAVE();
+                    if (!send(g, reinterpret_cast<GoChannel*>(R(1)), W(2))) return ST_PARKED;
+                    pc += 3;
+                    NEXT();
+                }
+                CASE(BC_RECV) {
+                    SAVE();
+                    auto* c = reinterpret_cast<GoChannel*>(R(2));
+                    bool ok;
+                    if (!receive(g, c, W(1), ok)) return ST_PARKED;
+                    if (pc[3]) W(1)[c->words] = ok;
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_CLOSE) close(reinterpret_cast<GoChannel*>(R(1))); pc += 2; NEXT();
+                CASE(BC_CHANLEN) {
+                    auto* c = reinterpret_cast<const GoChannel*>(R(2));
+                    R(1) = c == nullptr ? 0 : uint64_t(pc[3] ? c->capacity : c->length());
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_SELECT) {
+                    SAVE();
+                    if (!select(g, pc, fp)) return ST_PARKED;
+                    pc += 4 + pc[2] * 3;
+                    NEXT();
+                }
+                CASE(BC_MKIFACE) {
+                    auto* t = reinterpret_cast<const RType*>(R(3));
+                    void* data;
+                    if (t->pointerShaped) {
+                        data = reinterpret_cast<void*>(R(2));
+                    }
+                    else {
+                        data = heapAllocate(size_t(t->size));
+                        memcpy(data, W(2), size_t(t->size));
+                    }
+                    *reinterpret_cast<GoInterface*>(W(1)) = { t, data };
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_ASSERT) {
+                    GoInterface x = *reinterpret_cast<const GoInterface*>(W(2));
+                    auto* t = reinterpret_cast<const RType*>(R(3));
+                    size_t words = size_t(align8(t->size) / 8);
+                    if (x.type == t) {
+                        loadAs(W(1), valueOf(x), t->load, t->size);
+                    }
+                    else if (pc[5]) {
+                        memset(W(1), 0, max<size_t>(words, 1) * 8);
+                    }
+                    else {
+                        auto* source = reinterpret_cast<const RType*>(R(4));
+                        runtimeError("interface conversion: " + (x.type == nullptr ? string("interface") : source->name) +
+                            " is " + (x.type == nullptr ? string("nil") : x.type->name) + ", not " + t->name);
+                    }
+                    if (pc[5]) W(1)[words] = x.type == t;
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_ASSERTI) {
+                    GoInterface x = *reinterpret_cast<const GoInterface*>(W(2));
+                    auto* t = reinterpret_cast<const RType*>(R(3));
+                    const RType::Method* missing = nullptr;
+                    for (auto& m : t->methods) {
+                        if (x.type != nullptr && x.type->method(m.name) != nullptr) continue;
+                        missing = &m;
+                        break;
+                    }
+                    bool ok = x.type != nullptr && missing == nullptr;
+                    if (!ok && !pc[5]) {
+                        if (x.type == nullptr) runtimeError("interface conversion: interface is nil, not " + t->name);
+                        runtimeError("interface conversion: " + x.type->name + " is not " + t->name + ": missing method " +
+                            string(symbols.text(missing->name)));
+                    }
+                    *reinterpret_cast<GoInterface*>(W(1)) = ok ? x : GoInterface{ nullptr, nullptr };
+                    if (pc[5]) W(1)[2] = ok;
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_EQT) {
+                    R(1) = equalValues(reinterpret_cast<const RType*>(R(4)), W(2), W(3));
+                    pc += 5;
+                    NEXT();
+                }
+                CASE(BC_IEQ) {
+                    R(1) = equalInterfaces(*reinterpret_cast<const GoInterface*>(W(2)), *reinterpret_cast<const GoInterface*>(W(3)));
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_CLOSURE) {
+                    uint32_t count = pc[3];
+                    auto* closure = static_cast<uint64_t*>(heapAllocate((size_t(count) + 1) * 8));
+                    closure[0] = uint64_t(uintptr_t(codes[pc[2]].get()));
+                    for (uint32_t i = 0; i < count; i++) closure[i + 1] = R(4 + i);
+                    R(1) = uint64_t(uintptr_t(closure));
+                    pc += 4 + count;
+                    NEXT();
+                }
+                CASE(BC_FREEVAR) R(1) = ctx[pc[2] + 1]; pc += 3; NEXT();
+                CASE(BC_CALL) {
+                    const Code* callee = codes[pc[2]].get();
+                    fp = g.enter(callee, W(1), nullptr, 0, { code, pc + 3, fp, ctx, nullptr, 0 });
+                    code = callee;
+                    pc = callee->code.data();
+                    ctx = nullptr;
+                    PREEMPT();
+                    NEXT();
+                }
+                CASE(BC_CALLV) {
+                    auto* closure = reinterpret_cast<uint64_t*>(R(1));
+                    if (closure == nullptr) nilDereference();
+                    auto* callee = reinterpret_cast<const Code*>(closure[0]);
+                    fp = g.enter(callee, W(2), nullptr, 0, { code, pc + 3, fp, ctx, nullptr, 0 });
+                    code = callee;
+                    pc = callee->code.data();
+                    ctx = closure;
+                    PREEMPT();
+                    NEXT();
+                }
+                CASE(BC_CALLM) {
+                    auto* receiver = reinterpret_cast<const GoInterface*>(W(1));
+                    auto& cache = code->caches[pc[4]];
+                    const RType::Method* m = cache.load(memory_order_relaxed);
+                    const RType* t = receiver->type;
+                    if (t == nullptr || uintptr_t(m) - uintptr_t(t->methods.data()) >= t->methods.size() * sizeof(*m)) {
+                        method(*receiver, Symbol(pc[3]), m);
+                        cache.store(m, memory_order_relaxed);
+                    }
+                    const Code* callee = codes[m->function].get();
+                    uint64_t* out = W(2);
+                    Goroutine::CallInfo info{ code, pc + 5, fp, ctx, nullptr, 0 };
+                    if (m->indirect) {
+                        // the receiver the data word points to, then the
+                        // other arguments
+                        uint32_t receiverWords = uint32_t(max<int64_t>(align8(m->size), 8) / 8);
+                        uint32_t rest = callee->argsWords - receiverWords;
+                        g.staging.resize(callee->argsWords);
+                        loadAs(g.staging.data(), receiver->data, m->load, m->size);
+                        memcpy(g.staging.data() + receiverWords, out + 1, size_t(rest) * 8);
+                        info.resultsTo = out + 1 + rest;
+                        fp = g.enter(callee, out, g.staging.data(), callee->argsWords, info);
+                    }
+                    else {
+                        fp = g.enter(callee, out, nullptr, 0, info);
+                    }
+                    code = callee;
+                    pc = callee->code.data();
+                    ctx = nullptr;
+                    PREEMPT();
+                    NEXT();
+                }
+                CASE(BC_CALLX) {
+                    uint32_t id = pc[2];
+                    SAVE();
+                    external(g, id, reinterpret_cast<const GoInterface*>(W(1)), pc[3]);
+                    pc += 4;
+                    if (id == EX_GOSCHED) YIELD();
+                    NEXT();
+                }
+                CASE(BC_DEFER) {
+                    // the call is made when the function returns or panics
+                    g.defers.push_back(deferred(g, pc, fp));
+                    pc += 6;
+                    NEXT();
+                }
+                CASE(BC_GO) scheduler->spawn(deferred(g, pc, fp)); pc += 6; NEXT();
+                CASE(BC_RUNDEFERS) {
+                    if (g.defers.empty() || g.defers.back().depth != g.calls.size()) {
+                        pc += 1;
+                        NEXT();
+                    }
+                    if (g.defers.back().code == nullptr) {
+                        SAVE();
+                        deferredExternal(g);
+                        NEXT();
+                    }
+                    // the call leaves g.defers once its arguments are in its
+                    // frame, nothing with a destructor outliving the jump
+                    const Goroutine::Deferred& d = g.defers.back();
+                    fp = g.enter(d.code, fp + code->outBase, d.args.data(), d.args.size(), { code, pc, fp, ctx, nullptr, 0 });
+                    code = d.code;
+                    pc = d.code->code.data();
+                    ctx = d.ctx;
+                    g.defers.pop_back();
+                    NEXT();
+                }
+                CASE(BC_RET) {
+                    Goroutine::CallInfo info = g.leave(code, fp);
+                    if (info.code == nullptr) return ST_DONE;
+                    code = info.code;
+                    pc = info.pc;
+                    fp = info.fp;
+                    ctx = info.ctx;
+                    NEXT();
+                }
+                CASE(BC_PANIC) {
+                    GoInterface value = *reinterpret_cast<const GoInterface*>(W(1));
+                    if (value.type == nullptr) value = faultValue("panic called with nil argument");
+                    g.panics.push_back({ value, g.calls.size(), false });
+                    pc = unwind;
+                    NEXT();
+                }
+                CASE(BC_RECOVER) {
+                    // only a call deferred by the frame a panic unwinds
+                    // stops it
+                    auto* value = reinterpret_cast<GoInterface*>(W(1));
+                    *value = {};
+                    if ((g.calls.back().flags & Goroutine::CF_RECOVERABLE) && !g.panics.empty() &&
+                        !g.panics.back().recovered && g.panics.back().depth + 1 == g.calls.size()) {
+                        g.panics.back().recovered = true;
+                        *value = g.panics.back().value;
+                    }
+                    pc += 2;
+                    NEXT();
+                }
+                CASE(BC_PRINT) {
+                    print(reinterpret_cast<const GoInterface*>(W(1)), pc[2], pc[3] != 0);
+                    pc += 4;
+                    NEXT();
+                }
+                CASE(BC_UNWIND) {
+                    Goroutine::Panic& p = g.panics.back();
+                    size_t depth = g.calls.size();
+                    if (p.recovered) {
+                        // the function returns as from its deferred calls
+                        while (!g.panics.empty() && g.panics.back().depth >= depth) g.panics.pop_back();
+                        pc = code->code.data() + code->recovery;
+                        NEXT();
+                    }
+                    if (!g.defers.empty() && g.defers.back().depth == depth) {
+                        if (g.defers.back().code == nullptr) {
+                            SAVE();
+                            deferredExternal(g);
+                            NEXT();
+                        }
+                        const Goroutine::Deferred& d = g.defers.back();
+                        fp = g.enter(d.code, fp + code->outBase, d.args.data(), d.args.size(),
+                            { code, pc, fp, ctx, nullptr, Goroutine::CF_RECOVERABLE });
+                        code = d.code;
+                        pc = d.code->code.data();
+                        ctx = d.ctx;
+                        g.defers.pop_back();
+                        NEXT();
+                    }
+                    Goroutine::CallInfo info = g.leave(code, fp);
+                    if (info.code == nullptr) return ST_DONE;
+                    p.depth--;
+                    code = info.code;
+                    fp = info.fp;
+                    ctx = info.ctx;
+                    NEXT();
+                }
+                }
+#if !defined(__GNUC__)
+                throw runtime_error("invalid bytecode " + to_string(*pc));
+#endif
+            }
+        }
+        catch (const RuntimeFault& e) {
+            g.panics.push_back({ faultValue(e.message), g.calls.size(), false });
+            pc = unwind;
+        }
+    }
+#undef R
+#undef W
+#undef SAVE
+#undef YIELD
+#undef PREEMPT
+#undef JUMP
+#undef CASE
+#undef NEXT
+}
+
+int Interpreter::run() {
+    compile();
+    Scheduler scheduler(*this, workers, false);
+    return scheduler.run();
+}
+
+// Runs the program of module, returning its exit status.
+int runtime(const Module& module) {
+    Interpreter interp(module);
+    return interp.run();
+}
+
+//===----------------------------------------------------------------------===//
+// debug auxiliary functions, they are not part of 5 functions
+//===----------------------------------------------------------------------===//
+// Heap allocations made by the current thread, benchmarks read it to report
+// how many allocations a phase costs. Counting replaces the global operator
+// new and delete, all of their unaligned forms so that every pair matches, and
+// is only built with G5_COUNT_ALLOCATIONS; otherwise the count stays 0.
+#ifdef G5_COUNT_ALLOCATIONS
+constexpr bool countingAllocations = true;
+static thread_local size_t allocationCount = 0;
+static void* countedAllocate(size_t size) noexcept {
+    allocationCount++;
+    return malloc(size == 0 ? 1 : size);
+}
+void* operator new(size_t size) {
+    if (void* p = countedAllocate(size)) return p;
+    throw bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (void* p = countedAllocate(size)) return p;
+    throw bad_alloc();
+}
+void* operator new(size_t size, const nothrow_t&) noexcept { return countedAllocate(size); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return countedAllocate(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+#else
+constexpr bool countingAllocations = false;
+constexpr size_t allocationCount = 0;
+#endif
+// Tells that the allocation columns of a benchmark are left at 0.
+void noteAllocationCounting() {
+    if (!countingAllocations) fprintf(stdout, "allocations are counted in builds with G5_COUNT_ALLOCATIONS only\n");
+}
+
+void printLex(const string & filename) {
+    Source source(filename);
+    Lexer f(source);
+    while (f.lastToken != TK_EOF) {
+        auto t = next(f);
+        fprintf(stdout, "<%d,%.*s,%d,%d>\n", t.type, int(t.lexeme.size()), t.lexeme.data(),
+            t.line, t.column);
+    }
+}
+
+// Print the tree below node one node per line with children indented under
+// their parent. Nodes that only wrap another node are not printed, members of
+// the untagged unions are told apart by their dynamic type.
+void printAst(const AstNode* node, int depth = 0) {
+    if (node == nullptr) return;
+    auto line = [depth](const string& text) {
+        fprintf(stdout, "%*s%s\n", depth * 2, "", text.c_str());
+    };
+    auto child = [depth](const AstNode* c) { printAst(c, depth + 1); };
+    auto optional = [depth](const AstNode* c) {
+        if (c == nullptr) fprintf(stdout, "%*snil\n", depth * 2 + 2, "");
+        printAst(c, depth + 1);
+    };
+    auto children = [&child](const vector<AstNode*>& v) {
+        for (auto* c : v) child(c);
+    };
+    auto name = [](Symbol s) { return string(symbols.text(s)); };
+    auto names = [&name](const vector<Symbol>& v) {
+        string s;
+        for (Symbol symbol : v) s += (s.empty() ? "" : ", ") + name(symbol);
+        return s;
+    };
+    auto op = [](TokenType type) { return string(operators[type - OP_ADD]); };
+
+    if (auto* n = dynamic_cast<const AstSourceFile*>(node)) {
+        line("SourceFile " + name(dynamic_cast<AstPackageClause*>(n->packageClause)->packageName));
+        children(n->importDecl);
+        children(n->topLevelDecl);
+    }
+    else if (auto* n = dynamic_cast<const AstImportDecl*>(node)) {
+        line("ImportDecl");
+        for (auto& [path, alias] : n->imports) {
+            fprintf(stdout, "%*s\"%s\" %s\n", depth * 2 + 2, "", name(path).c_str(), name(alias).c_str());
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstTopLevelDecl*>(node)) printAst(n->atld.decl, depth);
+    else if (auto* n = dynamic_cast<const AstDeclaration*>(node)) printAst(n->ad.constDecl, depth);
+    else if (auto* n = dynamic_cast<const AstConstDecl*>(node)) {
+        line("ConstDecl");
+        for (size_t i = 0; i < n->identifierList.size(); i++) {
+            fprintf(stdout, "%*sConstSpec %s\n", depth * 2 + 2, "",
+                names(dynamic_cast<AstIdentifierList*>(n->identifierList[i])->identifierList).c_str());
+            printAst(n->type[i], depth + 2);
+            printAst(n->expressionList[i], depth + 2);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstTypeDecl*>(node)) {
+        line("TypeDecl");
+        children(n->typeSpec);
+    }
+    else if (auto* n = dynamic_cast<const AstTypeSpec*>(node)) {
+        line("TypeSpec " + name(n->identifier) + (n->isAlias ? " =" : ""));
+        child(n->type);
+    }
+    else if (auto* n = dynamic_cast<const AstVarDecl*>(node)) {
+        line("VarDecl");
+        children(n->varSpec);
+    }
+    else if (auto* n = dynamic_cast<const AstVarSpec*>(node)) {
+        line("VarSpec " + names(dynamic_cast<AstIdentifierList*>(n->identifierList)->identifierList));
+        if (dynamic_cast<AstType*>(n->avs.named.type) != nullptr) {
+            child(n->avs.named.type);
+            child(n->avs.named.expressionList);
+        }
+        else {
+            child(n->avs.expressionList);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstFunctionDecl*>(node)) {
+        line("FunctionDecl " + name(n->funcName));
+        if (n->receiver != nullptr) {
+            fprintf(stdout, "%*sReceiver\n", depth * 2 + 2, "");
+            printAst(n->receiver, depth + 2);
+        }
+        child(n->signature);
+        child(n->functionBody);
+    }
+    else if (auto* n = dynamic_cast<const AstSignature*>(node)) {
+        line("Signature");
+        child(n->parameters);
+        child(n->result);
+    }
+    else if (auto* n = dynamic_cast<const AstParameter*>(node)) {
+        line("Parameters");
+        children(n->parameterList);
+    }
+    else if (auto* n = dynamic_cast<const AstParameterDecl*>(node)) {
+        line("ParameterDecl" + (n->hasName ? " " + name(n->name) : "") + (n->isVariadic ? " ..." : ""));
+        child(n->type);
+    }
+    else if (auto* n = dynamic_cast<const AstResult*>(node)) printAst(n->ar.type, depth);
+    else if (auto* n = dynamic_cast<const AstType*>(node)) printAst(n->at.typeName, depth);
+    else if (auto* n = dynamic_cast<const AstTypeName*>(node)) {
+        line("TypeName " + (n->packageName != 0 ? name(n->packageName) + "." : "") + name(n->typeName));
+    }
+    else if (auto* n = dynamic_cast<const AstArrayType*>(node)) {
+        line("ArrayType");
+        child(n->length);
+        child(n->elementType);
+    }
+    else if (auto* n = dynamic_cast<const AstSliceType*>(node)) {
+        line("SliceType");
+        child(n->elementType);
+    }
+    else if (auto* n = dynamic_cast<const AstStructType*>(node)) {
+        line("StructType");
+        for (auto& [field, tag] : n->fields) {
+            if (auto* list = dynamic_cast<AstIdentifierList*>(field.named.identifierList)) {
+                fprintf(stdout, "%*sField %s %s\n", depth * 2 + 2, "",
+                    names(list->identifierList).c_str(), tag.c_str());
+                printAst(field.named.type, depth + 2);
+            }
+            else {
+                fprintf(stdout, "%*sEmbeddedField %s\n", depth * 2 + 2, "", tag.c_str());
+                printAst(field.typeName, depth + 2);
+            }
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstPointerType*>(node)) {
+        line("PointerType");
+        child(n->baseType);
+    }
+    else if (auto* n = dynamic_cast<const AstFunctionType*>(node)) {
+        line("FunctionType");
+        child(n->signature);
+    }
+    else if (auto* n = dynamic_cast<const AstInterfaceType*>(node)) {
+        line("InterfaceType");
+        children(n->methodSpec);
+    }
+    else if (auto* n = dynamic_cast<const AstMethodSpec*>(node)) {
+        if (auto* method = dynamic_cast<AstMethodName*>(n->ams.named.methodName)) {
+            line("MethodSpec " + name(method->methodName));
+            child(n->ams.named.signature);
+        }
+        else {
+            line("EmbeddedInterface");
+            child(n->ams.interfaceTypeName);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstMapType*>(node)) {
+        line("MapType");
+        child(n->keyType);
+        child(n->elementType);
+    }
+    else if (auto* n = dynamic_cast<const AstChannelType*>(node)) {
+        line(string("ChannelType") + (n->sendOnly ? " chan<-" : "") + (n->recvOnly ? " <-chan" : ""));
+        child(n->elementType);
+    }
+    else if (auto* n = dynamic_cast<const AstBlock*>(node)) {
+        line("Block");
+        child(n->statementList);
+    }
+    else if (auto* n = dynamic_cast<const AstLazyBlock*>(node)) {
+        printAst(bodyOf(n), depth);
+    }
+    else if (auto* n = dynamic_cast<const AstStatementList*>(node)) {
+        for (auto* c : n->statements) printAst(c, depth);
+    }
+    else if (auto* n = dynamic_cast<const AstStatement*>(node)) printAst(n->as.declaration, depth);
+    else if (auto* n = dynamic_cast<const AstSimpleStmt*>(node)) printAst(n->ass.expressionStmt, depth);
+    else if (auto* n = dynamic_cast<const AstLabeledStmt*>(node)) {
+        line("LabeledStmt " + name(n->identifier));
+        child(n->statement);
+    }
+    else if (auto* n = dynamic_cast<const AstExpressionStmt*>(node)) {
+        line("ExpressionStmt");
+        child(n->expression);
+    }
+    else if (auto* n = dynamic_cast<const AstSendStmt*>(node)) {
+        line("SendStmt");
+        child(n->receiver);
+        child(n->sender);
+    }
+    else if (auto* n = dynamic_cast<const AstIncDecStmt*>(node)) {
+        line(n->isInc ? "IncDecStmt ++" : "IncDecStmt --");
+        child(n->expression);
+    }
+    else if (auto* n = dynamic_cast<const AstAssignment*>(node)) {
+        line("Assignment " + op(n->assignOp));
+        child(n->lhs);
+        child(n->rhs);
+    }
+    else if (auto* n = dynamic_cast<const AstShortVarDecl*>(node)) {
+        line("ShortVarDecl");
+        child(n->lhs);
+        child(n->rhs);
+    }
+    else if (auto* n = dynamic_cast<const AstGoStmt*>(node)) {
+        line("GoStmt");
+        child(n->expression);
+    }
+    else if (auto* n = dynamic_cast<const AstDeferStmt*>(node)) {
+        line("DeferStmt");
+        child(n->expression);
+    }
+    else if (auto* n = dynamic_cast<const AstReturnStmt*>(node)) {
+        line("ReturnStmt");
+        child(n->expressionList);
+    }
+    else if (auto* n = dynamic_cast<const AstBreakStmt*>(node)) line("BreakStmt " + name(n->label));
+    else if (auto* n = dynamic_cast<const AstContinueStmt*>(node)) line("ContinueStmt " + name(n->label));
+    else if (auto* n = dynamic_cast<const AstGotoStmt*>(node)) line("GotoStmt " + name(n->label));
+    else if (dynamic_cast<const AstFallthroughStmt*>(node)) line("FallthroughStmt");
+    else if (auto* n = dynamic_cast<const AstIfStmt*>(node)) {
+        line("IfStmt");
+        optional(n->condition);
+        child(n->expression);
+        child(n->block);
+        child(n->ais.block);
+    }
+    else if (auto* n = dynamic_cast<const AstSwitchStmt*>(node)) {
+        line(n->isTypeSwitch ? "SwitchStmt type" : "SwitchStmt");
+        optional(n->condition);
+        optional(n->conditionExpr);
+        children(n->exprCaseClause);
+    }
+    else if (auto* n = dynamic_cast<const AstExprCaseClause*>(node)) {
+        auto* switchCase = dynamic_cast<AstExprSwitchCase*>(n->exprSwitchCase);
+        line(switchCase->isDefault ? "DefaultClause" : "CaseClause");
+        child(switchCase->expressionList);
+        child(n->statementList);
+    }
+    else if (auto* n = dynamic_cast<const AstSelectStmt*>(node)) {
+        line("SelectStmt");
+        children(n->commClause);
+    }
+    else if (auto* n = dynamic_cast<const AstCommClause*>(node)) {
+        auto* commCase = dynamic_cast<AstCommCase*>(n->commCase);
+        line(commCase->isDefault ? "DefaultClause" : "CommClause");
+        child(commCase->acc.sendStmt);
+        child(n->statementList);
+    }
+    else if (auto* n = dynamic_cast<const AstRecvStmt*>(node)) {
+        line("RecvStmt");
+        child(n->ars.expressionList);
+        child(n->recvExpr);
+    }
+    else if (auto* n = dynamic_cast<const AstForStmt*>(node)) {
+        line("ForStmt");
+        child(n->afs.condition);
+        child(n->block);
+    }
+    else if (auto* n = dynamic_cast<const AstForClause*>(node)) {
+        line("ForClause");
+        optional(n->initStmt);
+        optional(n->condition);
+        optional(n->postStmt);
+    }
+    else if (auto* n = dynamic_cast<const AstRangeClause*>(node)) {
+        line("RangeClause");
+        child(n->arc.expressionList);
+        child(n->expression);
+    }
+    else if (auto* n = dynamic_cast<const AstIdentifierList*>(node)) {
+        line("IdentifierList " + names(n->identifierList));
+    }
+    else if (auto* n = dynamic_cast<const AstExpressionList*>(node)) {
+        line("ExpressionList");
+        children(n->expressionList);
+    }
+    else if (auto* n = dynamic_cast<const AstExpression*>(node)) {
+        if (n->ae.named.rhs == nullptr) {
+            printAst(n->ae.unaryExpr, depth);
+        }
+        else {
+            line("BinaryExpr " + op(n->ae.named.binaryOp));
+            child(n->ae.named.lhs);
+            child(n->ae.named.rhs);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstUnaryExpr*>(node)) {
+        if (dynamic_cast<AstPrimaryExpr*>(n->aue.primaryExpr) != nullptr) {
+            printAst(n->aue.primaryExpr, depth);
+        }
+        else {
+            line("UnaryExpr " + op(n->aue.named.unaryOp));
+            child(n->aue.named.unaryExpr);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstPrimaryExpr*>(node)) {
+        const AstNode* suffix = n->ape.selector.selector;
+        if (auto* s = dynamic_cast<const AstSelector*>(suffix)) {
+            line("Selector " + name(s->identifier));
+            child(n->ape.selector.primaryExpr);
+        }
+        else if (auto* s = dynamic_cast<const AstIndex*>(suffix)) {
+            line("Index");
+            child(n->ape.index.primaryExpr);
+            child(s->expression);
+        }
+        else if (auto* s = dynamic_cast<const AstSlice*>(suffix)) {
+            line("Slice");
+            child(n->ape.slice.primaryExpr);
+            optional(s->start);
+            optional(s->stop);
+            optional(s->step);
+        }
+        else if (auto* s = dynamic_cast<const AstTypeAssertion*>(suffix)) {
+            line(s->type == nullptr ? "TypeAssertion type" : "TypeAssertion");
+            child(n->ape.typeAssertion.primaryExpr);
+            child(s->type);
+        }
+        else if (auto* s = dynamic_cast<const AstArgument*>(suffix)) {
+            line(s->isVariadic ? "Call ..." : "Call");
+            child(n->ape.argument.primaryExpr);
+            child(s->aa.expressionList);
+        }
+        else {
+            printAst(n->ape.operand, depth);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstOperand*>(node)) {
+        if (dynamic_cast<AstExpression*>(n->ao.expression) != nullptr) {
+            line("Paren");
+            child(n->ao.expression);
+        }
+        else {
+            printAst(n->ao.literal, depth);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstOperandName*>(node)) line("Name " + name(n->operandName));
+    else if (auto* n = dynamic_cast<const AstLiteral*>(node)) printAst(n->al.basicLit, depth);
+    else if (auto* n = dynamic_cast<const AstBasicLit*>(node)) line("BasicLit " + n->value);
+    else if (auto* n = dynamic_cast<const AstCompositeLit*>(node)) {
+        line("CompositeLit");
+        if (dynamic_cast<AstExpression*>(n->acl.arrayType.arrayLength) != nullptr) {
+            fprintf(stdout, "%*sArrayType\n", depth * 2 + 2, "");
+            printAst(n->acl.arrayType.arrayLength, depth + 2);
+            printAst(n->acl.arrayType.elementType, depth + 2);
+        }
+        else if (n->acl.automaticLengthArrayType.automaticLength) {
+            fprintf(stdout, "%*sArrayType ...\n", depth * 2 + 2, "");
+            printAst(n->acl.automaticLengthArrayType.elementType, depth + 2);
+        }
+        else {
+            child(n->acl.typeName);
+        }
+        child(n->literalValue);
+    }
+    else if (auto* n = dynamic_cast<const AstLiteralValue*>(node)) {
+        line("LiteralValue");
+        children(n->keyedElement);
+    }
+    else if (auto* n = dynamic_cast<const AstKeyedElement*>(node)) {
+        if (n->key == nullptr) {
+            printAst(n->element, depth);
+        }
+        else {
+            line("KeyedElement");
+            child(n->key);
+            child(n->element);
+        }
+    }
+    else if (auto* n = dynamic_cast<const AstKey*>(node)) printAst(n->ak.expression, depth);
+    else if (auto* n = dynamic_cast<const AstElement*>(node)) printAst(n->ae.expression, depth);
+    else if (auto* n = dynamic_cast<const AstFunctionLit*>(node)) {
+        line("FunctionLit");
+        child(n->signature);
+        child(n->functionBody);
+    }
+    else if (auto* n = dynamic_cast<const AstConversion*>(node)) {
+        line("Conversion");
+        child(n->type);
+        child(n->expression);
+    }
+    else {
+        line("?");
+    }
+}
+
+// Print the compact tree below node i like printAst does, names and flags on
+// the line of their node.
+void printTree(const Tree& tree, uint32_t i, int depth = 0) {
+    const Node& n = tree[i];
+    const NodeKindInfo& info = nodeKinds[n.kind];
+    string text = info.name;
+    if (info.hasToken && n.kind != NK_BASIC_LIT) {
+        text += " " + string(n.op() < OP_ADD ? keywords[n.op()] : operators[n.op() - OP_ADD]);
+    }
+    for (int k = 0; k < 4; k++) {
+        if (info.operand[k] == R_NAME && n.operand(k) != 0) {
+            text += " " + string(tree.name(n.operand(k)));
+        }
+        else if (info.operand[k] == R_NAMES && n.operand(k) != 0) {
+            string names;
+            for (uint32_t id : tree.list(n.operand(k))) {
+                names += (names.empty() ? "" : ", ") + string(tree.name(id));
+            }
+            text += " " + names;
+        }
+    }
+    if (n.flags & F_ALIAS) text += " =";
+    if (n.flags & F_VARIADIC) text += " ...";
+    if (n.flags & F_SEND_ONLY) text += " chan<-";
+    if (n.flags & F_RECV_ONLY) text += " <-chan";
+    if (n.flags & F_TYPE_SWITCH) text += " type";
+    fprintf(stdout, "%*s%s\n", depth * 2, "", text.c_str());
+    tree.forEachChild(i, [&](uint32_t child) { printTree(tree, child, depth + 1); });
+}
+
+// Check that a flattened file is a tree in post order: every node but the
+// unused first one is reached exactly once from the root, and only from a
+// parent that comes after it.
+void checkTree(const vector<string>& filenames) {
+    size_t totalNodes = 0, files = 0;
+    for (auto& filename : filenames) {
+        Arena arena;
+        auto* ast = parse(filename, arena);
+        if (ast == nullptr) continue;
+        Tree tree = flatten(ast);
+        vector<bool> seen(tree.nodes.size());
+        size_t reached = 0;
+        auto visit = [&](uint32_t i, auto& self) -> void {
+            if (i == 0 || i >= tree.nodes.size() || seen[i] || tree[i].kind == NK_NONE) {
+                throw runtime_error(filename + ": node " + to_string(i) + " is reached twice or is invalid");
+            }
+            seen[i] = true;
+            reached++;
+            const Node& n = tree[i];
+            for (int k = 0; k < 4; k++) {
+                auto role = nodeKinds[n.kind].operand[k];
+                if ((role == R_LIST || role == R_NAMES) && n.operand(k) >= tree.extra.size()) {
+                    throw runtime_error(filename + ": list of node " + to_string(i) + " is out of range");
+                }
+            }
+            tree.forEachChild(i, [&](uint32_t child) {
+                if (child >= i) {
+                    throw runtime_error(filename + ": node " + to_string(i) + " comes before its child");
+                }
+                self(child, self);
+            });
+        };
+        visit(tree.root, visit);
+        if (reached != tree.nodes.size() - 1 || tree.root != tree.nodes.size() - 1) {
+            throw runtime_error(filename + ": " + to_string(tree.nodes.size() - 1 - reached) +
+                " nodes are not reached from the root");
+        }
+        totalNodes += reached;
+        files++;
+    }
+    fprintf(stdout, "%zu files flatten to %zu nodes in post order\n", files, totalNodes);
+}
+
+// Children of a node of the pointer tree, found by its dynamic type and, for
+// the unions, by the dynamic type of what they hold.
+template <class Visit>
+void forEachChild(const AstNode* node, Visit&& visit) {
+    auto each = [&visit](const vector<AstNode*>& v) {
+        for (auto* c : v) visit(c);
+    };
+    if (auto* n = nodeAs<AstSourceFile>(node)) {
+        visit(n->packageClause);
+        each(n->importDecl);
+        each(n->topLevelDecl);
+    }
+    else if (auto* n = nodeAs<AstTopLevelDecl>(node)) visit(n->atld.decl);
+    else if (auto* n = nodeAs<AstDeclaration>(node)) visit(n->ad.constDecl);
+    else if (auto* n = nodeAs<AstConstDecl>(node)) {
+        each(n->identifierList);
+        each(n->type);
+        each(n->expressionList);
+    }
+    else if (auto* n = nodeAs<AstTypeDecl>(node)) each(n->typeSpec);
+    else if (auto* n = nodeAs<AstTypeSpec>(node)) visit(n->type);
+    else if (auto* n = nodeAs<AstVarDecl>(node)) each(n->varSpec);
+    else if (auto* n = nodeAs<AstVarSpec>(node)) {
+        visit(n->identifierList);
+        visit(n->avs.named.type);
+        if (dynamic_cast<AstType*>(n->avs.named.type) != nullptr) visit(n->avs.named.expressionList);
+    }
+    else if (auto* n = nodeAs<AstFunctionDecl>(node)) {
+        visit(n->receiver);
+        visit(n->signature);
+        visit(n->functionBody);
+    }
+    else if (auto* n = nodeAs<AstSignature>(node)) {
+        visit(n->parameters);
+        visit(n->result);
+    }
+    else if (auto* n = nodeAs<AstParameter>(node)) each(n->parameterList);
+    else if (auto* n = nodeAs<AstParameterDecl>(node)) visit(n->type);
+    else if (auto* n = nodeAs<AstResult>(node)) visit(n->ar.type);
+    else if (auto* n = nodeAs<AstType>(node)) visit(n->at.typeName);
+    else if (auto* n = nodeAs<AstArrayType>(node)) {
+        visit(n->length);
+        visit(n->elementType);
+    }
+    else if (auto* n = nodeAs<AstSliceType>(node)) visit(n->elementType);
+    else if (auto* n = nodeAs<AstStructType>(node)) {
+        for (auto& field : n->fields) {
+            visit(get<0>(field).named.identifierList);
+            if (dynamic_cast<AstIdentifierList*>(get<0>(field).named.identifierList) != nullptr) {
+                visit(get<0>(field).named.type);
+            }
+        }
+    }
+    else if (auto* n = nodeAs<AstPointerType>(node)) visit(n->baseType);
+    else if (auto* n = nodeAs<AstFunctionType>(node)) visit(n->signature);
+    else if (auto* n = nodeAs<AstInterfaceType>(node)) each(n->methodSpec);
+    else if (auto* n = nodeAs<AstMethodSpec>(node)) {
+        visit(n->ams.named.methodName);
+        if (dynamic_cast<AstMethodName*>(n->ams.named.methodName) != nullptr) {
+            visit(n->ams.named.signature);
+        }
+    }
+    else if (auto* n = nodeAs<AstMapType>(node)) {
+        visit(n->keyType);
+        visit(n->elementType);
+    }
+    else if (auto* n = nodeAs<AstChannelType>(node)) visit(n->elementType);
+    else if (auto* n = nodeAs<AstBlock>(node)) visit(n->statementList);
+    else if (auto* n = nodeAs<AstLazyBlock>(node)) visit(bodyOf(n));
+    else if (auto* n = nodeAs<AstStatementList>(node)) each(n->statements);
+    else if (auto* n = nodeAs<AstStatement>(node)) visit(n->as.declaration);
+    else if (auto* n = nodeAs<AstSimpleStmt>(node)) visit(n->ass.expressionStmt);
+    else if (auto* n = nodeAs<AstLabeledStmt>(node)) visit(n->statement);
+    else if (auto* n = nodeAs<AstExpressionStmt>(node)) visit(n->expression);
+    else if (auto* n = nodeAs<AstSendStmt>(node)) {
+        visit(n->receiver);
+        visit(n->sender);
+    }
+    else if (auto* n = nodeAs<AstIncDecStmt>(node)) visit(n->expression);
+    else if (auto* n = nodeAs<AstAssignment>(node)) {
+        visit(n->lhs);
+        visit(n->rhs);
+    }
+    else if (auto* n = nodeAs<AstShortVarDecl>(node)) {
+        visit(n->lhs);
+        visit(n->rhs);
+    }
+    else if (auto* n = nodeAs<AstGoStmt>(node)) visit(n->expression);
+    else if (auto* n = nodeAs<AstDeferStmt>(node)) visit(n->expression);
+    else if (auto* n = nodeAs<AstReturnStmt>(node)) visit(n->expressionList);
+    else if (auto* n = nodeAs<AstIfStmt>(node)) {
+        visit(n->condition);
+        visit(n->expression);
+        visit(n->block);
+        visit(n->ais.block);
+    }
+    else if (auto* n = nodeAs<AstSwitchStmt>(node)) {
+        visit(n->condition);
+        visit(n->conditionExpr);
+        each(n->exprCaseClause);
+    }
+    else if (auto* n = nodeAs<AstExprCaseClause>(node)) {
+        visit(n->exprSwitchCase);
+        visit(n->statementList);
+    }
+    else if (auto* n = nodeAs<AstExprSwitchCase>(node)) visit(n->expressionList);
+    else if (auto* n = nodeAs<AstSelectStmt>(node)) each(n->commClause);
+    else if (auto* n = nodeAs<AstCommClause>(node)) {
+        visit(n->commCase);
+        visit(n->statementList);
+    }
+    else if (auto* n = nodeAs<AstCommCase>(node)) visit(n->acc.sendStmt);
+    else if (auto* n = nodeAs<AstRecvStmt>(node)) {
+        visit(n->ars.expressionList);
+        visit(n->recvExpr);
+    }
+    else if (auto* n = nodeAs<AstForStmt>(node)) {
+        visit(n->afs.condition);
+        visit(n->block);
+    }
+    else if (auto* n = nodeAs<AstForClause>(node)) {
+        visit(n->initStmt);
+        visit(n->condition);
+        visit(n->postStmt);
+    }
+    else if (auto* n = nodeAs<AstRangeClause>(node)) {
+        visit(n->arc.expressionList);
+        visit(n->expression);
+    }
+    else if (auto* n = nodeAs<AstExpressionList>(node)) each(n->expressionList);
+    else if (auto* n = nodeAs<AstExpression>(node)) {
+        visit(n->ae.named.lhs);
+        visit(n->ae.named.rhs);
+    }
+    else if (auto* n = nodeAs<AstUnaryExpr>(node)) visit(n->aue.primaryExpr);
+    else if (auto* n = nodeAs<AstPrimaryExpr>(node)) {
+        visit(n->ape.selector.primaryExpr);
+        visit(n->ape.selector.selector);
+    }
+    else if (auto* n = nodeAs<AstIndex>(node)) visit(n->expression);
+    else if (auto* n = nodeAs<AstSlice>(node)) {
+        visit(n->start);
+        visit(n->stop);
+        visit(n->step);
+    }
+    else if (auto* n = nodeAs<AstTypeAssertion>(node)) visit(n->type);
+    else if (auto* n = nodeAs<AstArgument>(node)) visit(n->aa.expressionList);
+    else if (auto* n = nodeAs<AstOperand>(node)) visit(n->ao.literal);
+    else if (auto* n = nodeAs<AstLiteral>(node)) visit(n->al.basicLit);
+    else if (auto* n = nodeAs<AstCompositeLit>(node)) {
+        visit(n->acl.arrayType.arrayLength);
+        if (dynamic_cast<AstExpression*>(n->acl.arrayType.arrayLength) != nullptr) {
+            visit(n->acl.arrayType.elementType);
+        }
+        visit(n->literalValue);
+    }
+    else if (auto* n = nodeAs<AstLiteralValue>(node)) each(n->keyedElement);
+    else if (auto* n = nodeAs<AstKeyedElement>(node)) {
+        visit(n->key);
+        visit(n->element);
+    }
+    else if (auto* n = nodeAs<AstKey>(node)) visit(n->ak.expression);
+    else if (auto* n = nodeAs<AstElement>(node)) visit(n->ae.expression);
+    else if (auto* n = nodeAs<AstFunctionLit>(node)) {
+        visit(n->signature);
+        visit(n->functionBody);
+    }
+    else if (auto* n = nodeAs<AstConversion>(node)) {
+        visit(n->type);
+        visit(n->expression);
+    }
+}
+
+// Visit every node of each file over and over, once through the pointer tree
+// and once through the compact tree, both as a recursive walk from the root and,
+// for the compact tree, as a scan of its node array. Every visit counts names.
+void benchTree(const vector<string>& filenames) {
+    fprintf(stdout, "%-40s %8s %8s %9s %9s %10s %10s %10s\n", "", "pointer", "compact",
+        "pointer", "compact", "pointer", "compact", "compact");
+    fprintf(stdout, "%-40s %8s %8s %9s %9s %10s %10s %10s\n", "file", "nodes", "nodes", "bytes",
+        "bytes", "walk ns", "walk ns", "scan ns");
+    for (auto& filename : filenames) {
+        Arena arena;
+        auto* ast = parse(filename, arena);
+        if (ast == nullptr) continue;
+        Tree tree = flatten(ast);
+        size_t nodes = 0, names = 0;
+        auto walkAst = [&](const AstNode* node, auto& self) -> void {
+            if (node == nullptr) return;
+            nodes++;
+            if (nodeAs<AstOperandName>(node) != nullptr) names++;
+            forEachChild(node, [&](const AstNode* child) { self(child, self); });
+        };
+        auto walkTree = [&](uint32_t i, auto& self) -> void {
+            nodes++;
+            if (tree[i].kind == NK_NAME) names++;
+            tree.forEachChild(i, [&](uint32_t child) { self(child, self); });
+        };
+        auto scanTree = [&] {
+            for (auto& n : tree.nodes) {
+                nodes++;
+                if (n.kind == NK_NAME) names++;
+            }
+        };
+        auto measure = [&](auto&& pass) {
+            size_t rounds = 0;
+            auto start = chrono::steady_clock::now();
+            double seconds = 0;
             do {
-                t = next(f);
-                if (t.type == OP_RBRACE) {
-                    // it's necessary since both {a,b} or {a,b,} are legal form
-                    break;
+                nodes = names = 0;
+                pass();
+                rounds++;
+                seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            } while (seconds < 0.2 || rounds < 3);
+            return seconds / rounds * 1e9;
+        };
+        double astTime = measure([&] { walkAst(ast, walkAst); });
+        size_t astNodes = nodes;
+        double treeTime = measure([&] { walkTree(tree.root, walkTree); });
+        double scanTime = measure(scanTree);
+        fprintf(stdout, "%-40s %8zu %8zu %9zu %9zu %10.0f %10.0f %10.0f\n", filename.c_str(),
+            astNodes, tree.nodes.size() - 1, arena.size(), tree.size(), astTime, treeTime, scanTime);
+    }
+}
+
+// Lex every file repeatedly until it has been busy for a while and report the
+// throughput and the heap allocations of one pass, the source is loaded once
+// so only next() is measured.
+void benchLex(const vector<string>& filenames) {
+    size_t totalBytes = 0;
+    double totalSeconds = 0;
+    noteAllocationCounting();
+    fprintf(stdout, "%-40s %10s %8s %8s %10s\n", "file", "bytes", "tokens", "allocs", "MB/s");
+    for (auto& filename : filenames) {
+        Source source(filename);
+        Lexer f(source);
+        size_t bytes = source.end - source.begin, tokens = 0, allocs = 0, rounds = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            f.rewind();
+            tokens = 0;
+            allocs = allocationCount;
+            while (f.lastToken != TK_EOF) {
+                next(f);
+                tokens++;
+            }
+            allocs = allocationCount - allocs;
+            rounds++;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2 || rounds < 3);
+        totalBytes += bytes * rounds;
+        totalSeconds += seconds;
+        fprintf(stdout, "%-40s %10zu %8zu %8zu %10.1f\n", filename.c_str(), bytes, tokens,
+            allocs, bytes * rounds / seconds / 1e6);
+    }
+    fprintf(stdout, "%-40s %10s %8s %8s %10.1f\n", "total", "", "", "",
+        totalBytes / totalSeconds / 1e6);
+}
+
+// Parse every file repeatedly from a Source loaded once and report the
+// throughput in tokens and lines per second and the heap allocations of one
+// parse, most of which are the strings and vectors inside the nodes.
+void benchParse(const vector<string>& filenames) {
+    size_t totalTokens = 0, totalLines = 0;
+    double totalSeconds = 0;
+    noteAllocationCounting();
+    fprintf(stdout, "%-40s %8s %8s %8s %10s %10s\n", "file", "lines", "tokens", "allocs",
+        "Mtokens/s", "Klines/s");
+    for (auto& filename : filenames) {
+        Source source(filename);
+        size_t lines = count(source.begin, source.end, '\n'), tokens = 0, allocs = 0, rounds = 0;
+        Lexer f(source);
+        while (f.lastToken != TK_EOF) {
+            next(f);
+            tokens++;
+        }
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            Arena arena;
+            Parser parser(source, arena);
+            allocs = allocationCount;
+            parser.parseSourceFile();
+            allocs = allocationCount - allocs;
+            rounds++;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2 || rounds < 3);
+        totalTokens += tokens * rounds;
+        totalLines += lines * rounds;
+        totalSeconds += seconds;
+        fprintf(stdout, "%-40s %8zu %8zu %8zu %10.2f %10.1f\n", filename.c_str(), lines, tokens,
+            allocs, tokens * rounds / seconds / 1e6, lines * rounds / seconds / 1e3);
+    }
+    fprintf(stdout, "%-40s %8s %8s %8s %10.2f %10.1f\n", "total", "", "", "",
+        totalTokens / totalSeconds / 1e6, totalLines / totalSeconds / 1e3);
+}
+
+// The function declarations of a file, which is what a pass over the headers
+// looks at.
+template <class Visit>
+void forEachFunction(const AstNode* sourceFile, Visit&& visit) {
+    auto* file = nodeAs<AstSourceFile>(sourceFile);
+    if (file == nullptr) return;
+    for (auto* decl : file->topLevelDecl) {
+        if (auto* n = nodeAs<AstFunctionDecl>(nodeAs<AstTopLevelDecl>(decl)->atld.decl)) visit(n);
+    }
+}
+
+// Check that parsing the headers and then every skipped body on demand gives
+// the tree of parsing the files in one go, with each skipping kernel.
+void checkLazy(const vector<string>& filenames) {
+    size_t skipped = 0;
+    auto saved = skipKernel;
+    for (auto& scanner : availableScanners()) {
+        skipKernel = scanner.skip;
+        skipped = 0;
+        for (auto& filename : filenames) {
+            Arena eagerArena, lazyArena;
+            auto* eager = parse(filename, eagerArena);
+            auto* lazy = parseHeaders(filename, lazyArena);
+            if (eager == nullptr || lazy == nullptr) continue;
+            forEachFunction(lazy, [&](const AstFunctionDecl* n) {
+                auto* body = nodeAs<AstLazyBlock>(n->functionBody);
+                if (body != nullptr && body->block != nullptr) {
+                    throw runtime_error(filename + ": a body is parsed before it is asked for");
+                }
+                skipped += body != nullptr;
+            });
+            Tree a = flatten(eager), b = flatten(lazy);
+            if (a.root != b.root || a.extra != b.extra || a.nodes.size() != b.nodes.size() ||
+                memcmp(a.nodes.data(), b.nodes.data(), a.nodes.size() * sizeof(Node)) != 0) {
+                skipKernel = saved;
+                throw runtime_error(filename + ": bodies skipped by the " + scanner.name +
+                    " kernel and parsed on demand differ from the eager parse");
+            }
+        }
+    }
+    skipKernel = saved;
+    fprintf(stdout, "%zu files, %zu function bodies skipped and parsed on demand\n",
+        filenames.size(), skipped);
+}
+
+// Throughput of parsing whole files against parsing their headers and listing
+// the exported functions, then what parsing every body on demand adds.
+void benchLazy(const vector<string>& filenames) {
+    auto measure = [&](auto&& pass) {
+        size_t rounds = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            pass();
+            rounds++;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2 || rounds < 3);
+        return seconds / rounds;
+    };
+    size_t bytes = 0, exported = 0, functions = 0;
+    for (auto& filename : filenames) {
+        Source source(filename);
+        bytes += source.end - source.begin;
+    }
+    double eager = measure([&] {
+        for (auto& filename : filenames) {
+            Arena arena;
+            parse(filename, arena);
+        }
+    });
+    double headers = measure([&] {
+        exported = functions = 0;
+        for (auto& filename : filenames) {
+            Arena arena;
+            forEachFunction(parseHeaders(filename, arena), [&](const AstFunctionDecl* n) {
+                exported += isupper((unsigned char)symbols.text(n->funcName)[0]) != 0;
+                functions++;
+            });
+        }
+    });
+    double demand = measure([&] {
+        for (auto& filename : filenames) {
+            Arena arena;
+            forEachFunction(parseHeaders(filename, arena), [](const AstFunctionDecl* n) {
+                if (auto* body = nodeAs<AstLazyBlock>(n->functionBody)) bodyOf(body);
+            });
+        }
+    });
+    fprintf(stdout, "%zu files, %zu bytes, %zu functions of which %zu exported\n",
+        filenames.size(), bytes, functions, exported);
+    fprintf(stdout, "%-28s %10s %10s\n", "", "MB/s", "speedup");
+    fprintf(stdout, "%-28s %10.1f %10.2f\n", "whole files", bytes / eager / 1e6, 1.0);
+    fprintf(stdout, "%-28s %10.1f %10.2f\n", "headers only", bytes / headers / 1e6,
+        eager / headers);
+    fprintf(stdout, "%-28s %10.1f %10.2f\n", "headers, then every body", bytes / demand / 1e6,
+        eager / demand);
+}
+
+// The imports and the exported API of each file from its headers alone, as
+// go doc lists them without signatures: no function body is parsed.
+void printApi(const vector<string>& filenames) {
+    auto exported = [](Symbol s) { return isupper((unsigned char)symbols.text(s)[0]) != 0; };
+    // the base type of a receiver and whether it is a pointer
+    auto receiverOf = [](const AstNode* receiver, bool& pointer) -> Symbol {
+        auto* list = nodeAs<AstParameter>(receiver);
+        if (list == nullptr || list->parameterList.size() != 1) return 0;
+        auto* type = nodeAs<AstType>(nodeAs<AstParameterDecl>(list->parameterList[0])->type);
+        pointer = false;
+        if (auto* p = nodeAs<AstPointerType>(type->at.typeLit)) {
+            pointer = true;
+            type = nodeAs<AstType>(p->baseType);
+        }
+        auto* name = type != nullptr ? nodeAs<AstTypeName>(type->at.typeName) : nullptr;
+        return name != nullptr && name->packageName == 0 ? name->typeName : 0;
+    };
+    for (auto& filename : filenames) {
+        Arena arena;
+        auto* file = nodeAs<AstSourceFile>(parseHeaders(filename, arena));
+        if (file == nullptr) continue;
+        fprintf(stdout, "%s: package %s\n", filename.c_str(),
+            string(symbols.text(nodeAs<AstPackageClause>(file->packageClause)->packageName)).c_str());
+        auto line = [](const char* kind, Symbol s) {
+            fprintf(stdout, "  %s %s\n", kind, string(symbols.text(s)).c_str());
+        };
+        for (auto* decl : file->importDecl) {
+            for (auto& [path, alias] : nodeAs<AstImportDecl>(decl)->imports) {
+                fprintf(stdout, "  import %s%s\"%s\"\n", string(symbols.text(alias)).c_str(), alias != 0 ? " " : "",
+                    string(symbols.text(path)).c_str());
+            }
+        }
+        for (auto* top : file->topLevelDecl) {
+            const AstNode* decl = nodeAs<AstTopLevelDecl>(top)->atld.decl;
+            if (auto* n = nodeAs<AstFunctionDecl>(decl)) {
+                bool pointer = false;
+                Symbol base = receiverOf(n->receiver, pointer);
+                if (!exported(n->funcName) || (n->receiver != nullptr && (base == 0 || !exported(base)))) continue;
+                if (n->receiver == nullptr) {
+                    line("func", n->funcName);
+                }
+                else {
+                    fprintf(stdout, "  func (%s%s) %s\n", pointer ? "*" : "", string(symbols.text(base)).c_str(),
+                        string(symbols.text(n->funcName)).c_str());
+                }
+                continue;
+            }
+            auto* d = nodeAs<AstDeclaration>(decl);
+            if (auto* n = nodeAs<AstConstDecl>(d->ad.constDecl)) {
+                for (auto* names : n->identifierList) {
+                    for (Symbol s : nodeAs<AstIdentifierList>(names)->identifierList) {
+                        if (exported(s)) line("const", s);
+                    }
+                }
+            }
+            else if (auto* n = nodeAs<AstTypeDecl>(d->ad.typeDecl)) {
+                for (auto* spec : n->typeSpec) {
+                    Symbol s = nodeAs<AstTypeSpec>(spec)->identifier;
+                    if (exported(s)) line("type", s);
+                }
+            }
+            else if (auto* n = nodeAs<AstVarDecl>(d->ad.varDecl)) {
+                for (auto* spec : n->varSpec) {
+                    auto* names = nodeAs<AstIdentifierList>(nodeAs<AstVarSpec>(spec)->identifierList);
+                    for (Symbol s : names->identifierList) {
+                        if (exported(s)) line("var", s);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Compare keyword lookup by the perfect hash against the linear scan over
+// keywords[] it replaced, using every identifier and keyword in the files.
+void benchKeyword(const vector<string>& filenames) {
+    vector<string_view> words;
+    vector<unique_ptr<Source>> sources;
+    for (auto& filename : filenames) {
+        sources.push_back(make_unique<Source>(filename));
+        Lexer f(*sources.back());
+        while (f.lastToken != TK_EOF) {
+            auto t = next(f);
+            if (t.type == TK_ID || t.type <= KW_var) words.push_back(t.lexeme);
+        }
+    }
+    auto linearScan = [](string_view lexeme) {
+        for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+            if (keywords[i] == lexeme) return static_cast<TokenType>(i);
+        return TK_ID;
+    };
+    auto measure = [&](const char* name, auto lookup) {
+        size_t rounds = 0, checksum = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            for (auto w : words) checksum += lookup(w);
+            rounds++;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2 || rounds < 3);
+        fprintf(stdout, "%-12s %8.2f ns/lookup (checksum %zu)\n", name,
+            seconds * 1e9 / (rounds * words.size()), checksum / rounds);
+    };
+    for (auto w : words) {
+        if (linearScan(w) != lookupKeyword(w)) {
+            throw runtime_error("keyword lookup mismatch on " + string(w));
+        }
+    }
+    fprintf(stdout, "%zu identifiers and keywords\n", words.size());
+    measure("linear scan", linearScan);
+    measure("perfect hash", lookupKeyword);
+}
+
+// Check that every scanning kernel the cpu supports lexes the files into the
+// same tokens, then compare their throughput.
+void benchScan(const vector<string>& filenames) {
+    auto& scanners = availableScanners();
+    auto saved = lexKernel;
+    fprintf(stdout, "%-40s", "file");
+    for (auto& scanner : scanners) fprintf(stdout, " %8s", scanner.name);
+    fprintf(stdout, "   (MB/s)\n");
+    for (auto& filename : filenames) {
+        Source source(filename);
+        Lexer f(source);
+        vector<Token> expected;
+        for (auto& scanner : scanners) {
+            lexKernel = scanner.lex;
+            f.rewind();
+            for (size_t i = 0; f.lastToken != TK_EOF; i++) {
+                auto t = next(f);
+                if (&scanner == &scanners.front()) {
+                    expected.push_back(t);
                 }
-                node->keyedElement.push_back(parseKeyedElement(t));
-            } while (t.type != OP_RBRACE);
-            eat(OP_RBRACE, "brace {} must match");
+                else if (i >= expected.size() || t.type != expected[i].type ||
+                    t.lexeme != expected[i].lexeme || t.line != expected[i].line ||
+                    t.column != expected[i].column) {
+                    lexKernel = saved;
+                    throw runtime_error(string(scanner.name) + " kernel differs from scalar in " +
+                        filename + " at token " + to_string(i));
+                }
+            }
         }
-        return node;
+        fprintf(stdout, "%-40s", filename.c_str());
+        for (auto& scanner : scanners) {
+            lexKernel = scanner.lex;
+            size_t bytes = source.end - source.begin, rounds = 0;
+            auto start = chrono::steady_clock::now();
+            double seconds = 0;
+            do {
+                f.rewind();
+                while (f.lastToken != TK_EOF) next(f);
+                rounds++;
+                seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            } while (seconds < 0.2 || rounds < 3);
+            fprintf(stdout, " %8.1f", bytes * rounds / seconds / 1e6);
+        }
+        fprintf(stdout, "\n");
+    }
+    lexKernel = saved;
+}
+
+// Lex and parse the files on several threads at once, every thread takes the
+// files in a different order, and check each result against a sequential run.
+void checkReentrant(const vector<string>& filenames) {
+    auto run = [](const string& filename) {
+        string result;
+        Source source(filename);
+        Lexer f(source);
+        while (f.lastToken != TK_EOF) {
+            auto t = next(f);
+            result += to_string(t.type) + "," + string(t.lexeme) + "," + to_string(t.line) + "," +
+                to_string(t.column) + "\n";
+        }
+        try {
+            Arena arena;
+            auto* ast = dynamic_cast<const AstSourceFile*>(parse(filename, arena));
+            result += ast == nullptr ? "no package clause" :
+                "package " + string(symbols.text(dynamic_cast<AstPackageClause*>(ast->packageClause)->packageName));
+        }
+        catch (const runtime_error& e) {
+            result += e.what();
+        }
+        return result;
     };
-    parseKeyedElement = [&](Token&t)->AstNode* {
-        AstKeyedElement*node = nullptr;
-        if (auto*tmp = parseKey(t); tmp != nullptr) {
-            node = new AstKeyedElement;
-            node->element = tmp;
-            if (t.type == OP_COLON) {
-                node->key = tmp;
-                t = next(f);
-                if (auto*tmp1 = parseElement(t); tmp1 != nullptr) {
-                    node->element = tmp1;
+    vector<string> expected;
+    for (auto& filename : filenames) expected.push_back(run(filename));
+
+    const int threadCount = max(4u, thread::hardware_concurrency());
+    vector<thread> threads;
+    vector<string> failures(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back([&, i] {
+            for (size_t k = 0; k < filenames.size(); k++) {
+                size_t file = (k + i) % filenames.size();
+                if (run(filenames[file]) != expected[file]) {
+                    failures[i] = filenames[file];
+                    return;
                 }
             }
+        });
+    }
+    for (auto& t : threads) t.join();
+    for (auto& failure : failures) {
+        if (!failure.empty()) {
+            throw runtime_error("concurrent lexing or parsing differs on " + failure);
         }
-        return node;
+    }
+    fprintf(stdout, "%zu files on %d threads match the sequential run\n", filenames.size(),
+        threadCount);
+}
+
+// Fully parenthesized form of an expression made of names, basic literals,
+// operators, selectors, indexes and calls, used to check the shape of
+// expression trees.
+string expressionString(const AstNode* node) {
+    if (auto* n = dynamic_cast<const AstExpression*>(node)) {
+        if (n->ae.named.rhs == nullptr) return expressionString(n->ae.unaryExpr);
+        return "(" + expressionString(n->ae.named.lhs) + " " +
+            string(operators[n->ae.named.binaryOp - OP_ADD]) + " " +
+            expressionString(n->ae.named.rhs) + ")";
+    }
+    if (auto* n = dynamic_cast<const AstUnaryExpr*>(node)) {
+        if (dynamic_cast<AstPrimaryExpr*>(n->aue.primaryExpr) != nullptr) {
+            return expressionString(n->aue.primaryExpr);
+        }
+        return "(" + string(operators[n->aue.named.unaryOp - OP_ADD]) +
+            expressionString(n->aue.named.unaryExpr) + ")";
+    }
+    if (auto* n = dynamic_cast<const AstPrimaryExpr*>(node)) {
+        const AstNode* suffix = n->ape.selector.selector;
+        if (auto* s = dynamic_cast<const AstSelector*>(suffix)) {
+            return "(" + expressionString(n->ape.selector.primaryExpr) + "." +
+                string(symbols.text(s->identifier)) + ")";
+        }
+        if (auto* s = dynamic_cast<const AstIndex*>(suffix)) {
+            return "(" + expressionString(n->ape.index.primaryExpr) + "[" +
+                expressionString(s->expression) + "])";
+        }
+        if (auto* s = dynamic_cast<const AstArgument*>(suffix)) {
+            string arguments;
+            if (auto* list = dynamic_cast<const AstExpressionList*>(s->aa.expressionList)) {
+                for (auto* e : list->expressionList) {
+                    arguments += (arguments.empty() ? "" : ", ") + expressionString(e);
+                }
+            }
+            return "(" + expressionString(n->ape.argument.primaryExpr) + "(" + arguments + "))";
+        }
+        return expressionString(n->ape.operand);
+    }
+    if (auto* n = dynamic_cast<const AstOperand*>(node)) return expressionString(n->ao.operandName);
+    if (auto* n = dynamic_cast<const AstOperandName*>(node)) return string(symbols.text(n->operandName));
+    if (auto* n = dynamic_cast<const AstLiteral*>(node)) return expressionString(n->al.basicLit);
+    if (auto* n = dynamic_cast<const AstBasicLit*>(node)) return n->value;
+    return "?";
+}
+
+// Parse text as a single expression.
+const AstNode* parseExpression(const string& text, Arena& arena) {
+    Source source(text.data(), text.size());
+    Parser parser(source, arena);
+    parser.t = next(parser.f);
+    auto* node = parser.parseExpression();
+    parser.accept(OP_SEMI);
+    if (parser.t.type != TK_EOF) throw runtime_error("trailing tokens after " + text);
+    return node;
+}
+
+// Check that binary operators group by Go's precedence levels and associate to
+// the left, that suffixes apply left to right, and that chains of many thousand
+// terms or suffixes parse without deep recursion.
+void checkExpression(const vector<string>&) {
+    const pair<const char*, const char*> cases[] = {
+        { "a*b+c", "((a * b) + c)" },
+        { "a+b*c", "(a + (b * c))" },
+        { "a-b-c", "((a - b) - c)" },
+        { "a/b*c%d", "(((a / b) * c) % d)" },
+        { "-a*b", "((-a) * b)" },
+        { "x<<2+1", "((x << 2) + 1)" },
+        { "*p&^m|n", "(((*p) &^ m) | n)" },
+        { "a<b==c", "((a < b) == c)" },
+        { "a||b&&c==d+e*f", "(a || (b && (c == (d + (e * f)))))" },
+        { "a*b+c*d<e-f||g&&!h", "((((a * b) + (c * d)) < (e - f)) || (g && (!h)))" },
+        { "(a+b)*c", "((a + b) * c)" },
+        { "a.b.c(x)[i].d()", "((((((a.b).c)(x))[i]).d)())" },
+        { "-f(x).y*g()[0]", "((-((f(x)).y)) * ((g())[0]))" },
     };
-    parseKey = [&](Token&t)->AstNode* {
-        AstKey*node = nullptr;
-        if (auto*tmp = parseFieldName(t); tmp != nullptr) {
-            node = new AstKey;
-            node->ak.fieldName = tmp;
+    for (auto& [text, expected] : cases) {
+        Arena arena;
+        string result = expressionString(parseExpression(text, arena));
+        if (result != expected) {
+            throw runtime_error(string(text) + " parsed as " + result + ", expect " + expected);
         }
-        else if (auto*tmp = parseLiteralValue(t); tmp != nullptr) {
-            node = new AstKey;
-            node->ak.literalValue = tmp;
+    }
+
+    const int terms = 200000;
+    const char* ops[] = { "+", "*", "-", "<<", "|", "/", "==", "&&", "||" };
+    string text = "x0";
+    for (int i = 1; i < terms; i++) text += string(" ") + ops[i % 9] + " x" + to_string(i);
+    Arena arena;
+    auto* root = parseExpression(text, arena);
+    // Walk the left spine of the top level || chain.
+    int orTerms = 1;
+    for (auto* e = dynamic_cast<const AstExpression*>(root); e->ae.named.binaryOp == OP_OR;
+        e = dynamic_cast<const AstExpression*>(e->ae.named.lhs)) {
+        orTerms++;
+    }
+    if (orTerms != (terms - 1) / 9 + 1) throw runtime_error("long chain grouped wrongly");
+
+    const int links = 10000;
+    string chain = "a";
+    for (int i = 0; i < links; i++) chain += ".b(x)[i]";
+    auto* primary = dynamic_cast<const AstPrimaryExpr*>(dynamic_cast<const AstUnaryExpr*>(
+        dynamic_cast<const AstExpression*>(parseExpression(chain, arena))->ae.unaryExpr)
+        ->aue.primaryExpr);
+    // Every link is an index of a call of a selector, innermost first.
+    int suffixes = 0;
+    while (dynamic_cast<const AstOperand*>(primary->ape.operand) == nullptr) {
+        const AstNode* suffix = primary->ape.selector.selector;
+        bool expected = suffixes % 3 == 0 ? dynamic_cast<const AstIndex*>(suffix) != nullptr :
+            suffixes % 3 == 1 ? dynamic_cast<const AstArgument*>(suffix) != nullptr :
+            dynamic_cast<const AstSelector*>(suffix) != nullptr;
+        if (!expected) throw runtime_error("long suffix chain grouped wrongly");
+        primary = dynamic_cast<const AstPrimaryExpr*>(primary->ape.selector.primaryExpr);
+        suffixes++;
+    }
+    if (suffixes != links * 3) throw runtime_error("long suffix chain lost suffixes");
+    fprintf(stdout, "%zu expressions, a chain of %d terms and a chain of %d suffixes parse "
+        "as expected\n", sizeof(cases) / sizeof(cases[0]), terms, suffixes);
+}
+
+// Intern the same names on several threads at once, each thread in a different
+// order, and check that every thread gets the same symbol for a name and that
+// the symbol reads back as the name.
+void checkInterner(const vector<string>&) {
+    const int names = 200000;
+    const int threadCount = max(4u, thread::hardware_concurrency());
+    vector<vector<Symbol>> results(threadCount, vector<Symbol>(names));
+    vector<thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back([&, i] {
+            for (int k = 0; k < names; k++) {
+                int name = (k * 7919 + i * 104729) % names;
+                results[i][name] = symbols.intern("name" + to_string(name));
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    for (int k = 0; k < names; k++) {
+        for (int i = 1; i < threadCount; i++) {
+            if (results[i][k] != results[0][k]) {
+                throw runtime_error("threads got different symbols for name" + to_string(k));
+            }
         }
-        else if (auto*tmp = parseExpression(t); tmp != nullptr) {
-            node = new AstKey;
-            node->ak.expression = tmp;
+        if (symbols.text(results[0][k]) != "name" + to_string(k)) {
+            throw runtime_error("symbol of name" + to_string(k) + " reads back wrong");
         }
-        return node;
+    }
+    fprintf(stdout, "%d names interned on %d threads agree\n", names, threadCount);
+}
+
+// Edits every file at pseudo random places and checks, after each edit and
+// after undoing it, that the document has the tree and spans of parsing its
+// text from scratch, or fails with the same error.
+void checkIncremental(const vector<string>& filenames) {
+    static const char* const snippets[] = { "", " ", "\n", "x", "0", ".", ";", "{", "}", "(",
+        "/*", "//", "\"", "`", "\nfunc added(x int) { return }\n", "\nvar added, more = 1, \"s\"\n",
+        "\ntype added struct{ x int }\n", "}\n\nfunc added() {" };
+    uint32_t seed = 1;
+    auto pick = [&](size_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+    size_t edits = 0, wholeParses = 0;
+    for (auto& filename : filenames) {
+        Source file(filename);
+        Document document(filename, string(file.begin, file.end));
+        auto edit = [&](size_t begin, size_t end, const string& replacement) {
+            string error, expected;
+            try {
+                document.edit(begin, end, replacement);
+            }
+            catch (const runtime_error& e) {
+                error = e.what();
+            }
+            Arena arena;
+            vector<DeclSpan> spans;
+            vector<ElementSpan> elements;
+            const AstNode* ast = nullptr;
+            Source source(document.source().data(), document.source().size());
+            Parser parser(source, arena);
+            parser.spans = &spans;
+            parser.elements = &elements;
+            try {
+                ast = parser.parseSourceFile();
+            }
+            catch (const runtime_error& e) {
+                expected = parseError(filename, parser.t, e).what();
+                spans.clear();
+                elements.clear();
+            }
+            string where = filename + ": edit " + to_string(edits) + " at " + to_string(begin);
+            if (error != expected) {
+                throw runtime_error(where + " fails with \"" + error + "\" instead of \"" + expected + "\"");
+            }
+            bool same = (ast == nullptr) == (document.ast() == nullptr);
+            if (same && ast != nullptr) {
+                Tree a = flatten(ast), b = flatten(document.ast());
+                same = a.root == b.root && a.extra == b.extra && a.nodes.size() == b.nodes.size() &&
+                    memcmp(a.nodes.data(), b.nodes.data(), a.nodes.size() * sizeof(Node)) == 0;
+            }
+            if (!same) throw runtime_error(where + " leaves a tree that differs from parsing it again");
+            auto spanAt = [](auto& a, auto& b) {
+                return a.begin == b.begin && a.end == b.end && a.line == b.line;
+            };
+            auto compare = [&](auto& spans, auto& kept, auto&& equal) {
+                for (size_t i = 0; i < max(spans.size(), kept.size()); i++) {
+                    if (i >= spans.size() || i >= kept.size() || !equal(spans[i], kept[i])) {
+                        throw runtime_error(where + " leaves span " + to_string(i) + " out of place");
+                    }
+                }
+            };
+            compare(spans, document.declSpans(), spanAt);
+            compare(elements, document.elementSpans(), [&](auto& a, auto& b) {
+                return spanAt(a, b) && a.after == b.after && a.index == b.index;
+            });
+            edits++;
+        };
+        size_t parses = document.wholeParses();
+        for (int i = 0; i < 200; i++) {
+            size_t length = document.source().size();
+            size_t begin = pick(length + 1), end = min(length, begin + pick(12));
+            string removed = document.source().substr(begin, end - begin);
+            string inserted = snippets[pick(size(snippets))];
+            edit(begin, end, inserted);
+            edit(begin, begin + inserted.size(), removed);
+        }
+        wholeParses += document.wholeParses() - parses;
+    }
+    fprintf(stdout, "%zu edits of %zu files, %zu of them parsed the whole file\n", edits,
+        filenames.size(), wholeParses);
+}
+
+// Latency of an edit on every line of the files, typing a blank before its
+// first token and deleting it again, next to that of parsing the whole file.
+void benchIncremental(const vector<string>& filenames) {
+    using clock = chrono::steady_clock;
+    auto us = [](clock::duration d) { return chrono::duration<double, micro>(d).count(); };
+    for (auto& filename : filenames) {
+        Source file(filename);
+        string text(file.begin, file.end);
+        const int rounds = 50;
+        auto start = clock::now();
+        for (int r = 0; r < rounds; r++) {
+            Arena arena;
+            Source source(text.data(), text.size());
+            parse(source, filename, arena);
+        }
+        double whole = us(clock::now() - start) / rounds;
+
+        Document document(filename, text);
+        // before the first token of every line that is not blank
+        vector<size_t> places;
+        for (size_t p = 0; p < text.size(); p = text.find('\n', p) + 1) {
+            size_t first = text.find_first_not_of(" \t", p);
+            if (first != string::npos && text[first] != '\n') places.push_back(first);
+            if (text.find('\n', p) == string::npos) break;
+        }
+        size_t parses = document.wholeParses();
+        vector<double> latency;
+        for (int r = 0; r < 5; r++) {
+            for (size_t place : places) {
+                for (int undo = 0; undo < 2; undo++) {
+                    auto begin = clock::now();
+                    if (undo == 0) document.edit(place, place, " ");
+                    else document.edit(place, place + 1, "");
+                    latency.push_back(us(clock::now() - begin));
+                }
+            }
+        }
+        double total = 0;
+        for (double t : latency) total += t;
+        sort(latency.begin(), latency.end());
+        fprintf(stdout, "%s: %d lines, %zu declarations\n", filename.c_str(),
+            int(count(text.begin(), text.end(), '\n')), document.declSpans().size() - 1);
+        fprintf(stdout, "whole file parse %10.1f us\n", whole);
+        fprintf(stdout, "edit mean        %10.1f us\n", total / latency.size());
+        fprintf(stdout, "edit median      %10.1f us\n", latency[latency.size() / 2]);
+        fprintf(stdout, "edit 99%%         %10.1f us\n", latency[latency.size() * 99 / 100]);
+        fprintf(stdout, "edit max         %10.1f us\n", latency.back());
+        fprintf(stdout, "%zu edits, %zu parsed the whole file\n", latency.size(),
+            document.wholeParses() - parses);
+    }
+}
+
+// Peak resident set size of the process in KiB.
+size_t peakRss() {
+#ifndef _WIN32
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// Parse the files over and over as a long-lived process would, report the heap
+// allocations and arena bytes of one pass and the peak RSS after the first and
+// the last pass. The RSS stays flat as long as every tree dies with its arena.
+void benchParseMemory(const vector<string>& filenames) {
+    const int rounds = 200;
+    noteAllocationCounting();
+    size_t allocs = 0, bytes = 0, rssStart = peakRss(), rssFirst = 0;
+    for (int r = 0; r < rounds; r++) {
+        size_t count = allocationCount;
+        bytes = 0;
+        for (auto& filename : filenames) {
+            Arena arena;
+            parse(filename, arena);
+            bytes += arena.size();
+        }
+        if (r == 0) {
+            allocs = allocationCount - count;
+            rssFirst = peakRss();
+        }
+    }
+    fprintf(stdout, "%zu files, %d passes\n", filenames.size(), rounds);
+    fprintf(stdout, "allocations per pass %10zu\n", allocs);
+    fprintf(stdout, "arena bytes per pass %10zu\n", bytes);
+    fprintf(stdout, "distinct names       %10zu\n", symbols.size());
+    fprintf(stdout, "peak RSS at start    %10zu KiB\n", rssStart);
+    fprintf(stdout, "peak RSS after 1     %10zu KiB\n", rssFirst);
+    fprintf(stdout, "peak RSS after %-5d %10zu KiB\n", rounds, peakRss());
+}
+
+// A package made of the single source text, parsed and flattened, for the
+// checks and benchmarks to take through the phases they need. What the phases
+// make lives as long as it does.
+struct TextPackage {
+    Source source;
+    Arena arena;
+    Tree tree;
+    Package package;
+    deque<PackageInfo> infos;
+    Module module;
+
+    TextPackage(const string& text, const char* filename) : source(text.data(), text.size()) {
+        tree = flatten(parse(source, filename, arena));
+        package.name = tree[tree.root].a;
+        package.files.push_back(&tree);
+        package.filenames.push_back(filename);
+        infos.emplace_back(package);
+    }
+    PackageInfo& info() { return infos.front(); }
+    // Runs semantic analysis, checking the bodies on pool, and returns the
+    // errors.
+    vector<string> check(ThreadPool& pool) {
+        collect(info());
+        resolve(info());
+        checkBodies(info(), pool);
+        pool.wait();
+        return errorsOf(info());
+    }
+    // Checks and lowers the package into module, throwing the first error.
+    // Every allocation stays on the heap without stackAllocate.
+    void compile(ThreadPool& pool, bool stackAllocate = true) {
+        if (vector<string> errors = check(pool); !errors.empty()) throw runtime_error(errors.front());
+        lower(infos, module, pool);
+        if (!module.errors.empty()) throw runtime_error(module.errors.front());
+        for (auto& f : module.functions) verify(f);
+        if (stackAllocate) escape(module);
+    }
+};
+
+// Semantic errors of a package made of the single source text.
+vector<string> semanticErrors(const string& text) {
+    unique_ptr<TextPackage> package;
+    try {
+        package = make_unique<TextPackage>(text, "test.go");
+    }
+    catch (const runtime_error& e) {
+        return { e.what() };
+    }
+    ThreadPool pool(2);
+    return package->check(pool);
+}
+
+// Check small packages that must pass semantic analysis, and small ones that
+// must fail it with the error given.
+void checkSemantic(const vector<string>&) {
+    const pair<const char*, const char*> cases[] = {
+        // declarations may use each other in any order
+        { "var a = b + 1\nvar b = c * 2\nconst c = 3\nvar x [c]int\nvar y = x[2]", nullptr },
+        { "type List struct { next *List; v int }\nfunc (l *List) Len() int { if l == nil { return 0 }; return 1 + l.next.Len() }", nullptr },
+        { "type I interface { M() J }\ntype J interface { I }\ntype T struct{}\nfunc (T) M() J { return nil }\nvar _ I = T{}", nullptr },
+        { "const (\n A = iota * 10\n B\n C\n)\nvar a [C]int\nvar _ = a[19]", nullptr },
+        { "type S struct{ E }\ntype E struct{ x int }\nfunc (e *E) Get() int { return e.x }\nfunc f(s *S) int { return s.Get() + s.x }", nullptr },
+        { "func f() (int, error) { return 0, nil }\nfunc g() { x, err := f(); _, _ = x, err; m := map[string]int{}; v, ok := m[\"a\"]; _, _ = v, ok }", nullptr },
+        { "func f(xs ...int) int { s := 0; for _, x := range xs { s += x }; return s }\nvar _ = f(1, 2, 3) + f([]int{4}...)", nullptr },
+        { "func f(x interface{}) int { switch v := x.(type) { case int: return v; case string: return len(v) }; return 0 }", nullptr },
+        { "func f(c chan int) { L: for { select { case v := <-c: if v > 0 { break L }; case c <- 1: } } }", nullptr },
+        { "func f(x int) int { for { if x > 0 { return x } }; }\nfunc g(x int) int { switch { case x > 0: return 1; default: panic(x) } }", nullptr },
+        { "type T [2]struct{ a, b int }\nvar t = T{{1, 2}, {b: 3}}\nvar p = []*struct{ x int }{{1}, {2}}\nvar q = [...]string{4: \"e\"}\nvar _ [5]int = [len(q)]int{}", nullptr },
+        { "import \"fmt\"\nfunc main() { fmt.Println(fmt.Sprint(1)) }", nullptr },
+        { "type Buffer encoder\ntype encoder struct { pool interface{ Get() *Buffer } }\nfunc f(b *Buffer) *encoder { return (*encoder)(b) }", nullptr },
+        { "type Element struct { next *Element; list *List }\ntype List struct { root Element }", nullptr },
+        // and these must fail
+        { "var a = b\nvar b = a", "initialization cycle" },
+        { "type T struct { t T }", "invalid recursive type" },
+        { "type A B\ntype B A", "invalid recursive type" },
+        { "type A struct { b [2]B }\ntype B struct { a A }", "invalid recursive type" },
+        { "func f() int { }", "missing return" },
+        { "func f() { a := 1; a := 2; _ = a }", "no new variables on left side of :=" },
+        { "func f() int { return \"s\" }", "cannot use value of type untyped string as int value in return statement" },
+        { "var x int = y\nfunc g() { undefinedName() }", "undefined: y" },
+        { "func f() { var x int; x.y = 1 }", "has no field or method y" },
+        { "type I interface{ M() }\ntype T struct{}\nfunc (t *T) M() {}\nvar _ I = T{}", "missing method M" },
+        { "func f() { break }", "break is not in a loop, switch, or select" },
+        { "func f(x int) { switch x { case 1: fallthrough; case 2: }; for { fallthrough } }", "fallthrough statement out of place" },
+        { "func f() { L: for {} }", "label L defined and not used" },
+        { "func f(m map[[]int]bool) {}", "invalid map key type []int" },
+        { "func f() { 1 + 2 }", "is not used" },
+        { "func f() { var a [3]int; _ = a[5] }", "index 5 out of bounds" },
+        { "func f() (int, int) { return 1 }", "not enough return values" },
+        { "var s string = 1 + \"a\"", "mismatched types" },
+        { "func f() { go 1 }", "must be function call" },
+        { "const c = len([]int{})", "is not a constant" },
+        { "type T struct{}\nfunc (T) M() {}\nfunc (T) M() {}", "already declared" },
+        { "var _ = 1 / 0", "division by zero" },
+        // constants are exact, of any size, and fold iota and strings
+        { "const big = 1 << 100\nconst small = big >> 98 + 1e400 / 1e399\nvar a [small - 10]int\nvar _ = a[3]", nullptr },
+        { "var a [1 << 100 >> 98]int\nvar _ = a[4]", "out of bounds" },
+        { "const (\n A = 1 << (10 * iota)\n B\n C\n D\n E\n F\n G\n)\nvar a [G >> 58]int\nvar _ = a[3]", nullptr },
+        { "var a [^uint8(0)]int\nvar _ = a[254]\nvar b [0x1p-2 * 8 + 0.5 * 2]int\nvar _ = b[2]", nullptr },
+        { "const c = complex(1, 2) * complex(1, -2)\nvar a [real(c)]int\nvar _ = a[5]", "out of bounds" },
+        { "const s = \"ab\" + `c` + \"\\u4e16\"\nvar a [len(s) + len(string(0x4e16))]int\nvar _ = a[9]", "out of bounds" },
+        { "const x = 1_0.5e1_0 / 1e10 * 2 + 0x1.8p1i * 2i\nvar a [x]int\nvar _ = a[15]", "out of bounds" },
+        { "const tiny = 1e-1000000\nvar _ = tiny * 2", nullptr },
+        { "const x int8 = 100 * 2", "overflows int8" },
+        { "var _ int = 1 << 70", "overflows int" },
+        { "var _ = uint(0) - 1", "overflows uint" },
+        { "var _ = int(3.5)", "truncated" },
+        { "const _ = 1 << 1075", "invalid shift count" },
+        { "const _ = 1.0 / 0", "division by zero" },
+        { "const _ float32 = 1e39", "overflows float32" },
+        { "const _ float32 = 3.4028235e38\nconst _ float64 = 1e-400", nullptr },
+        // number literals are checked against their base and their separators
+        { "var _ = 0b102", "invalid digit '2' in binary literal" },
+        { "var _ = 08", "invalid digit '8' in octal literal" },
+        { "var _ = 0o8", "invalid digit '8' in octal literal" },
+        { "var _ = 0x", "hexadecimal literal has no digits" },
+        { "var _ = 1e", "exponent has no digits" },
+        { "var _ = 0x1p", "exponent has no digits" },
+        { "var _ = 0x1.0", "hexadecimal mantissa requires a 'p' exponent" },
+        { "var _ = 0b1.0", "invalid radix point in binary literal" },
+        { "var _ = 1_000__0", "'_' must separate successive digits" },
+        { "var _ = 1_", "'_' must separate successive digits" },
+        { "var _ = 08.5 + 0x_1p-2 + 0b_1 + 0o_17 + 1_000 + .5i", nullptr },
+        // composite types are identical when spelled the same anywhere
+        { "type I interface { M() J }\ntype J interface { I }\nvar a map[string][]struct{ x *[4]chan func(int, ...string) (interface{ J }, error) }\nfunc f() { var b map[string][]struct{ x *[4]chan func(int, ...string) (interface{ J }, error) }; a = b }", nullptr },
+        { "var a struct{ x int \"a\" }\nvar b struct{ x int \"b\" }\nfunc f() { a = b }", "cannot use" },
     };
-    parseFieldName = [&](Token&t)->AstNode* {
-        AstFieldName* node = nullptr;
-        if (t.type == TK_ID) {
-            node = new AstFieldName;
-            node->fieldName = t.lexeme;
-            t = next(f);
+    int checked = 0;
+    for (auto& [body, expected] : cases) {
+        string text = string("package p\n") + body + "\n";
+        vector<string> errors = semanticErrors(text);
+        bool failed = expected == nullptr ? !errors.empty() : errors.empty() ||
+            errors.front().find(expected) == string::npos;
+        if (failed) {
+            throw runtime_error(string(body) + "\nexpect " + (expected ? expected : "no error") +
+                ", got " + (errors.empty() ? "no error" : errors.front()));
         }
-        return node;
+        checked++;
+    }
+    // an error is reported where it is, and the statements after it are
+    // checked all the same
+    vector<string> errors = semanticErrors("package p\nfunc f() {\n\tx := 1 + \"s\"\n\tx++\n\tvar y string = 1\n\t_ = y\n}\n");
+    const vector<string> expected = {
+        "test.go:3:9: invalid operation: mismatched types untyped int and untyped string",
+        "test.go:5:17: cannot use value of type untyped int as string value in variable declaration",
+    };
+    if (errors != expected) {
+        string got;
+        for (auto& error : errors) got += "\n" + error;
+        throw runtime_error("a function with two errors fails with" + got);
+    }
+    checked++;
+    fprintf(stdout, "%d packages checked as expected\n", checked);
+}
+
+// The SSA form of every function of a package made of the single source text,
+// verified, or its first error.
+string ssaOf(const string& text) {
+    TextPackage package(text, "test.go");
+    ThreadPool pool(2);
+    try {
+        package.compile(pool);
+    }
+    catch (const runtime_error& e) {
+        return e.what();
+    }
+    string out;
+    for (auto& f : package.module.functions) out += functionString(package.module, f);
+    return out;
+}
+
+// Lower small packages and look for what their SSA form must, and with a
+// leading !, must not contain.
+void checkSsa(const vector<string>&) {
+    const pair<const char*, vector<const char*>> cases[] = {
+        // loop variables merge at the header, a variable only read is no phi
+        { "func f(n int) int { s := 0; for i := 0; i < n; i++ { s += i }; return s + n }",
+            { "Phi <int> v", "Lt <bool>", "!Phi <int> v1 " } },
+        { "func f(c bool) int { x := 1; if c { x = 2 }; return x }\nfunc g(c bool) int { x := 1; if c { c = false }; return x }",
+            { "Phi <int>", "p.g func(bool) int\nb0:\n    v1 = Param <bool> 0\n    v2 = Const <int> 1\n" } },
+        // taking the address or capturing puts a variable on the heap
+        { "func f() *int { x := 1; return &x }", { "Alloc <*int> heap", "Store" } },
+        { "func f() func() int { c := 0; return func() int { c++; return c } }",
+            { "MakeClosure <func() int> v", "p.f.func1", "FreeVar <*int> 0" } },
+        { "func f() int { var a [2]int; a[1] = 3; return a[1] }", { "Alloc <*[2]int>", "!heap", "IndexAddr" } },
+        // unless escape analysis shows it does not outlive the call
+        { "type T struct{ x int }\nfunc g(p *T) int { return p.x }\nfunc f() int { t := &T{1}; u := new(T); return g(t) + g(u) }",
+            { "Alloc <*T>", "!heap" } },
+        { "type T struct{ x int }\nvar k *T\nfunc g(p *T) { k = p }\nfunc f() { g(&T{1}) }", { "Alloc <*T> heap" } },
+        // && and || branch, fallthrough jumps to the next clause
+        { "func f(a, b bool) int { if a && b || !a { return 1 }; return 0 }", { "!And", "!Or", "!Not" } },
+        { "func f(x int) int { switch x { case 1: fallthrough; case 2: return 2 }; return 0 }", { "Eq <bool>", "Jump" } },
+        // calls of the package, of imports, of methods and of interfaces
+        { "import \"fmt\"\nfunc f() { fmt.Print(\"hello world\") }", { "CallExtern <invalid type> v1 fmt.Print", "String <string> \"hello world\"" } },
+        { "type I interface{ M() int }\ntype T struct{ x int }\nfunc (t *T) M() int { return t.x }\nfunc f(i I) int { var t T; return i.M() + t.M() }",
+            { "CallMethod <int> v", "Call <int> v", "p.(*T).M", "FieldAddr <*int> v1 x" } },
+        { "func f(xs ...int) int { return len(xs) }\nvar n = f(1, 2)", { "MakeSlice <[]int>", "Global <*int> p.n", "p.init func()" } },
+        // ranging over maps and strings
+        { "func f(m map[string]int) int { s := 0; for _, v := range m { s += v }; return s }", { "MapIter", "MapNext <(bool, string, int)>" } },
+        { "func f(s string) int32 { r := int32(0); for _, c := range s { r += c }; return r }", { "StringNext <(int32, int)>" } },
+        // code after a return is dropped
+        { "func f() int { return 1; x := 2; return x }", { "!Const <int> 2", "!b1" } },
+        { "func f(x interface{}) (int, bool) { v, ok := x.(int); return v, ok }", { "TypeAssert <(int, bool)> v1 commaok", "Extract <bool>" } },
+        // a select gives the case chosen and what the receives got
+        { "func f(c chan int, d chan string) (int, bool) { select { case v, ok := <-c: return v, ok; case d <- \"x\":; default: }; return 0, false }",
+            { "Choose <(int, bool, int)> v1 v2 v3 rs default", "Extract <int> v4 2", "Extract <bool> v4 1" } },
     };
-    parseElement = [&](Token&t)->AstNode* {
-        AstElement*node = nullptr;
-        if (auto*tmp = parseExpression(t); tmp != nullptr) {
-            node = new AstElement;
-            node->ae.expression = tmp;
+    int checked = 0;
+    for (auto& [body, patterns] : cases) {
+        string text = string("package p\n") + body + "\n";
+        string ssa = ssaOf(text);
+        for (const char* pattern : patterns) {
+            bool absent = pattern[0] == '!';
+            if ((ssa.find(pattern + absent) != string::npos) != absent) continue;
+            throw runtime_error(string(body) + "\nexpect " + (absent ? "no " : "") + (pattern + absent) + " in\n" + ssa);
         }
-        else if (auto*tmp = parseLiteralValue(t); tmp != nullptr) {
-            node = new AstElement;
-            node->ae.literalValue = tmp;
+        checked++;
+    }
+    fprintf(stdout, "%d packages lowered as expected\n", checked);
+}
+
+// Lowers the package made of the single source text and hands the module to
+// use, throwing its first error. Every allocation stays on the heap without
+// stackAllocate.
+void compileText(const string& text, const function<void(const Module&)>& use, bool stackAllocate = true) {
+    TextPackage package(text, "main.go");
+    ThreadPool pool(2);
+    package.compile(pool, stackAllocate);
+    use(package.module);
+}
+
+// Compiles the package made of the single source text to the executable
+// output, throwing its first error.
+void buildNative(const string& text, const string& output, bool optimize) {
+    compileText(text, [&](const Module& module) { link(assembly(module, optimize), output); });
+}
+
+// What the executable at path writes to its standard output and error, then
+// how it ended unless it exited with 0, as the interpreter tells it.
+string runNative(const string& path) {
+    FILE* pipe = popen((shellQuoted(path) + " 2>&1").c_str(), "r");
+    if (pipe == nullptr) throw runtime_error("cannot run " + path);
+    string out;
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof buffer, pipe)) > 0;) out.append(buffer, n);
+    int status = pclose(pipe);
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) out += "exit status " + to_string(WEXITSTATUS(status)) + "\n";
+    if (WIFSIGNALED(status)) out += "signal " + to_string(WTERMSIG(status)) + "\n";
+    return out;
+}
+
+// Small programs of package main and what they must print, for both backends.
+const pair<const char*, const char*> programCases[] = {
+    { "import \"fmt\"\nfunc main() { fmt.Print(\"hello world\") }", "hello world" },
+    // narrow integers wrap, division rounds toward zero, shifts past the
+    // width clear
+    { "import \"fmt\"\nfunc main() { var b int8 = 127; b++; x := -7; var u uint = 1; n := 70\n"
+        "fmt.Println(b, x/2, x%4, x/4, x%-1, u<<n, x>>n, 7.5/2, float32(1)/3, uint64(1<<63)) }",
+        "-128 -3 -3 -1 0 0 -1 3.75 0.33333334 9223372036854775808\n" },
+    // a typed float constant is rounded to its type, an untyped one is exact
+    { "import \"fmt\"\nconst f float32 = 0.1\nconst g = float32(1) / 3\nconst h float64 = 1<<53 + 1\n"
+        "func main() { fmt.Println(float64(f), float64(f) == 0.1, float64(g), h == 1<<53, float64(float32(0.7e-45)), 0.1+0.2 == 0.3) }",
+        "0.10000000149011612 false 0.3333333432674408 true 0 true\n" },
+    // a divisor that propagates as the constant 0 still panics
+    { "import \"fmt\"\nfunc main() { x := 0; fmt.Println(\"a\"); fmt.Println(10 / x) }",
+        "a\npanic: runtime error: integer divide by zero\nexit status 2\n" },
+    { "import \"fmt\"\nfunc main() { var u uint; fmt.Println(10 % u) }", "panic: runtime error: integer divide by zero\nexit status 2\n" },
+    { "import \"fmt\"\nfunc fib(n int) int { if n < 2 { return n }; return fib(n-1) + fib(n-2) }\n"
+        "func main() { s := 0; for i := 0; i < 10; i++ { s += i * i }; fmt.Println(fib(20), s) }",
+        "6765 285\n" },
+    { "import \"fmt\"\nfunc counter() func() int { c := 0; return func() int { c++; return c } }\n"
+        "func main() { f := counter(); f(); f(); g := counter(); fmt.Println(f(), g()) }", "3 1\n" },
+    { "import \"fmt\"\ntype P struct{ x, y int; name string }\nfunc (p P) Sum() int { return p.x + p.y }\n"
+        "func (p *P) Move(d int) { p.x += d }\n"
+        "func main() { p := P{1, 2, \"a\"}; p.Move(3); q := &p; q.Move(1); fmt.Println(p.Sum(), q.name, p) }",
+        "7 a {5 2 a}\n" },
+    { "import \"fmt\"\ntype S interface{ Area() float64 }\ntype R struct{ w, h float64 }\ntype C int\n"
+        "func (r R) Area() float64 { return r.w * r.h }\nfunc (c *C) Area() float64 { return float64(*c) }\n"
+        "func describe(x interface{}) string { switch v := x.(type) { case int: return \"int\"; case S: if v.Area() > 5 { return \"big\" }; return \"S\"; default: return \"?\" } }\n"
+        "func main() { c := C(3); var s S = R{2, 3}; t := S(&c); _, ok := s.(R)\n"
+        "fmt.Println(s.Area(), t.Area(), ok, s == R{2, 3}); fmt.Println(describe(1), describe(s), describe(t), describe(true)) }",
+        "6 3 true true\nint big S ?\n" },
+    { "import \"fmt\"\nfunc main() { m := map[string]int{}; for _, w := range []string{\"a\", \"b\", \"a\"} { m[w]++ }\n"
+        "delete(m, \"b\"); v, ok := m[\"b\"]; s := 0; for _, n := range m { s += n }; fmt.Println(len(m), m[\"a\"], v, ok, s) }",
+        "1 2 0 false 2\n" },
+    { "import \"fmt\"\nfunc main() { s := \"héllo\"; n := 0; for _, r := range s { if r > 127 { n++ } }\n"
+        "b := []byte(s); t := s[1:3] + string(b[0]) + string(rune(0x4e16)); fmt.Println(len(s), n, t, s < \"hz\", len([]rune(s))) }",
+        "6 1 éh世 false 5\n" },
+    { "import \"fmt\"\nfunc main() { var xs []int; for i := 0; i < 100; i++ { xs = append(xs, i) }\n"
+        "ys := make([]int, 3, 10); copy(ys, xs[5:]); ys = append(ys, xs[:2]...); a := [3]int{1, 2, 3}; z := a[1:]\n"
+        "fmt.Println(len(xs), cap(xs) >= 100, xs[99], ys, z, a) }",
+        "100 true 99 [5 6 7 0 1] [2 3] [1 2 3]\n" },
+    { "import \"fmt\"\nfunc main() { fmt.Printf(\"%d|%5s|%-3d|%x|%v|%q|%.2f|%t|%c\\n\", 42, \"go\", 7, 255, []string{\"a\"}, \"q\", 3.14159, true, 'A') }",
+        "42|   go|7  |ff|[a]|\"q\"|3.14|true|A\n" },
+    // fmt formats a value with its Error method, or else its String method,
+    // but not the value of an unexported field, nor for %d
+    { "import \"fmt\"\ntype C int\nfunc (c C) String() string { if c < 0 { return \"cold\" }; return \"warm\" }\n"
+        "type E struct{ code int }\nfunc (e *E) Error() string { return \"failed\" }\n"
+        "type B int\nfunc (B) String() string { return \"s\" }\nfunc (B) Error() string { return \"e\" }\n"
+        "type P struct{ T C; t C }\n"
+        "func main() { var err error = &E{1}; fmt.Println(C(1), err, B(0), []C{-1, 1}, P{-1, -1}, &E{2}, []error{err})\n"
+        "fmt.Printf(\"%v %s %d %q %x|%5s|%+v\\n\", C(1), C(-1), C(-1), C(1), B(0), B(0), P{1, 1}) }",
+        "warm failed e [cold warm] {cold -1} failed [failed]\nwarm cold -1 \"warm\" 65|    e|{T:warm t:1}\n" },
+    // a method fmt calls may print too
+    { "import \"fmt\"\ntype N struct{ xs []int }\n"
+        "func (n N) String() string { fmt.Print(\"<\", len(n.xs), \">\"); return \"n\" }\n"
+        "func main() { fmt.Println(N{[]int{1, 2}}, N{}) }",
+        "<2><0>n n\n" },
+    // maps print sorted by key
+    { "import \"fmt\"\ntype K struct{ a int; b string }\n"
+        "func main() { fmt.Println(map[string]int{\"b\": 2, \"c\": 3, \"a\": 1}, map[int]bool{3: true, -1: false, 2: true},\n"
+        "map[K]int{{2, \"a\"}: 1, {1, \"b\"}: 2, {1, \"a\"}: 3}, map[float64]string{2.5: \"x\", -1: \"y\"}) }",
+        "map[a:1 b:2 c:3] map[-1:false 2:true 3:true] map[{1 a}:3 {1 b}:2 {2 a}:1] map[-1:y 2.5:x]\n" },
+};
+
+// Compile small programs natively, with and without optimization, and compare
+// what they print with what they must.
+void checkNative(const vector<string>&) {
+    auto directory = filesystem::temp_directory_path() / ("g5-check-" + to_string(getpid()));
+    filesystem::create_directories(directory);
+    string exe = (directory / "a.out").string();
+    int checked = 0;
+    for (auto& [body, expected] : programCases) {
+        string text = string("package main\n") + body + "\n";
+        for (bool optimize : { false, true }) {
+            buildNative(text, exe, optimize);
+            string out = runNative(exe);
+            if (out != expected) {
+                filesystem::remove_all(directory);
+                throw runtime_error(string(body) + (optimize ? "" : "\nwithout optimization") + "\nexpect " +
+                    expected + "got " + out);
+            }
         }
-        return node;
+        checked++;
+    }
+    filesystem::remove_all(directory);
+    fprintf(stdout, "%d programs ran as expected\n", checked);
+}
+
+// Time compute kernels compiled without and with register allocation.
+void benchNative(const vector<string>&) {
+    const pair<const char*, const char*> kernels[] = {
+        { "loop", "func main() { s := 0; for i := 0; i < 300000000; i++ { s += i ^ (i >> 3) }; fmt.Println(s) }" },
+        { "collatz", "func main() { best := 0; for n := 1; n < 1000000; n++ { x, steps := n, 0\n"
+            "for x != 1 { if x%2 == 0 { x /= 2 } else { x = 3*x + 1 }; steps++ }; if steps > best { best = steps } }; fmt.Println(best) }" },
+        { "fib", "func fib(n int) int { if n < 2 { return n }; return fib(n-1) + fib(n-2) }\nfunc main() { fmt.Println(fib(35)) }" },
+        { "sieve", "func main() { n := 20000000; composite := make([]bool, n); count := 0\n"
+            "for i := 2; i < n; i++ { if !composite[i] { count++; for j := i * 2; j < n; j += i { composite[j] = true } } }; fmt.Println(count) }" },
+        { "matmul", "func main() { n := 200; a := make([]float64, n*n); b := make([]float64, n*n); c := make([]float64, n*n)\n"
+            "for i := range a { a[i] = float64(i % 7); b[i] = float64(i % 5) }\n"
+            "for i := 0; i < n; i++ { for j := 0; j < n; j++ { s := 0.0; for k := 0; k < n; k++ { s += a[i*n+k] * b[k*n+j] }; c[i*n+j] = s } }\n"
+            "fmt.Println(c[n*n-1]) }" },
     };
-    parseFunctionLit = [&](Token&t)->AstNode* {
-        AstFunctionLit* node = nullptr;
-        if (t.type == KW_func) {
-            node = new AstFunctionLit;
-            t = next(f);
-            node->signature = parseSignature(t);
-            t = next(f);
-            node->functionBody = parseBlock(t);
+    auto directory = filesystem::temp_directory_path() / ("g5-bench-" + to_string(getpid()));
+    filesystem::create_directories(directory);
+    string exe = (directory / "a.out").string();
+    fprintf(stdout, "%-10s %12s %12s %8s\n", "kernel", "-O0 ms", "ms", "speedup");
+    for (auto& [name, body] : kernels) {
+        string text = string("package main\nimport \"fmt\"\n") + body + "\n";
+        double ms[2];
+        string out[2];
+        for (bool optimize : { false, true }) {
+            buildNative(text, exe, optimize);
+            auto start = chrono::steady_clock::now();
+            out[optimize] = runNative(exe);
+            ms[optimize] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
         }
-        return node;
+        if (out[0] != out[1]) {
+            filesystem::remove_all(directory);
+            throw runtime_error(string(name) + " printed " + out[0] + " without optimization and " + out[1] + " with it");
+        }
+        fprintf(stdout, "%-10s %12.1f %12.1f %7.2fx\n", name, ms[0], ms[1], ms[0] / ms[1]);
+    }
+    filesystem::remove_all(directory);
+}
+
+// What the package made of the single source text prints when interpreted,
+// standard error included, and its exit status when it fails.
+string interpretText(const string& text) {
+    string out;
+    compileText(text, [&](const Module& module) {
+        Interpreter interp(module);
+        interp.capture = true;
+        int status = interp.run();
+        out = interp.output;
+        if (status != 0) out += "exit status " + to_string(status) + "\n";
+    });
+    return out;
+}
+
+// Interpret the programs the native backend runs, and others that panic,
+// recover and defer calls.
+void checkInterp(const vector<string>&) {
+    const pair<const char*, const char*> cases[] = {
+        // deferred calls run last first, their arguments evaluated at once
+        { "import \"fmt\"\nfunc main() { for i := 0; i < 3; i++ { defer fmt.Print(i) }; x := 10; defer fmt.Println(x); x = 20 }",
+            "10\n210" },
+        { "import \"fmt\"\nfunc f() (r int) { defer func() { if e := recover(); e != nil { r = -1 } }(); var a []int; return a[3] }\n"
+            "func main() { fmt.Println(f()); defer fmt.Println(\"deferred\", 1); fmt.Println(\"body\") }",
+            "-1\nbody\ndeferred 1\n" },
+        { "import \"fmt\"\nfunc g() { defer func() { recover() }(); panic(1) }\n"
+            "func main() { g(); fmt.Println(\"after\"); var m map[string]int; defer func() { fmt.Println(recover()) }(); m[\"a\"] = 1 }",
+            "after\nassignment to entry in nil map\n" },
+        { "import \"fmt\"\ntype T struct{ n int }\nfunc (t T) Show() { fmt.Println(\"n\", t.n) }\n"
+            "func main() { t := T{1}; defer t.Show(); t.n = 2; var s interface{ Show() } = T{3}; defer s.Show() }",
+            "n 3\nn 1\n" },
+        // a panic nothing recovers ends the program, as os.Exit does without
+        // running deferred calls
+        { "import \"fmt\"\nfunc main() { fmt.Println(\"a\"); x := 0; defer fmt.Println(\"b\"); fmt.Println(1 / x) }",
+            "a\nb\npanic: runtime error: integer divide by zero\nexit status 2\n" },
+        { "import (\"fmt\"; \"os\")\nfunc main() { fmt.Print(\"x\"); defer fmt.Println(\"never\"); os.Exit(3) }", "xexit status 3\n" },
+        { "func main() { defer func() { panic(\"second\") }(); panic(\"first\") }",
+            "panic: first\n\tpanic: second\nexit status 2\n" },
+        // frames go on in new stack segments as recursion deepens
+        { "import \"fmt\"\nfunc depth(n int) int { if n == 0 { return 0 }; var pad [16]int; pad[n%16] = 1; return depth(n-1) + pad[n%16] }\n"
+            "func main() { fmt.Println(depth(200000)) }",
+            "200000\n" },
+        // goroutines run on every worker, a panic in any of them ends the
+        // program
+        { "import \"fmt\"\ntype A struct{ base int }\nfunc (a *A) Set(out []int, done chan bool, i int) { out[i] = a.base; done <- true }\n"
+            "func sum(out []int, done chan bool, i int) { for j := 0; j <= i*1000; j++ { out[i] += j }; done <- true }\n"
+            "func main() { out := make([]int, 8); done := make(chan bool); for i := 0; i < 6; i++ { go sum(out, done, i) }\n"
+            "var s interface{ Set(out []int, done chan bool, i int) } = &A{7}; go s.Set(out, done, 6)\n"
+            "go func(i int) { out[i] = -1; done <- true }(7); for range out { <-done }; fmt.Println(out) }",
+            "[0 500500 2001000 4501500 8002000 12502500 7 -1]\n" },
+        { "import \"runtime\"\nfunc main() { go func() { panic(\"boom\") }(); for { runtime.Gosched() } }", "panic: boom\nexit status 2\n" },
+        // unbuffered channels hand values over, buffered ones queue them
+        // until closed
+        { "import \"fmt\"\nfunc main() { ping, pong := make(chan int), make(chan int)\n"
+            "go func() { for v := range ping { pong <- v * 2 }; close(pong) }()\n"
+            "for i := 1; i <= 3; i++ { ping <- i; fmt.Print(<-pong, \" \") }; close(ping); v, ok := <-pong\n"
+            "b := make(chan string, 3); b <- \"x\"; b <- \"y\"; fmt.Println(v, ok, len(b), cap(b)); close(b); for s := range b { fmt.Print(s) }; fmt.Println() }",
+            "2 4 6 0 false 2 3\nxy\n" },
+        // the deferred calls and the strings conversions build leave nothing
+        // behind, which the leak checker of a sanitized build looks at
+        { "import \"fmt\"\nvar n int\nfunc add(i int) { n += i }\nfunc step(i int) { defer add(i); defer fmt.Print(\"\") }\n"
+            "func main() { r := make([]rune, 100); for i := range r { r[i] = 'a' + rune(i%26) }; s := 0\n"
+            "for i := 0; i < 1000; i++ { step(i); s += len(string(r)) + len(string(rune(0x4e16 + i))) }; fmt.Println(n, s) }",
+            "499500 103000\n" },
+        // select takes a ready case, the default one when none is, and never
+        // one on a nil channel
+        { "import \"fmt\"\nfunc main() { c := make(chan int, 1); var n chan int\n"
+            "for i := 0; i < 3; i++ { select { case v := <-c: fmt.Println(\"got\", v); case n <- 1: fmt.Println(\"nil\"); case c <- i: fmt.Println(\"sent\", i); default: fmt.Println(\"none\") } }\n"
+            "close(c); select { case v, ok := <-c: fmt.Println(v, ok) } }",
+            "sent 0\ngot 0\nsent 2\n2 true\n" },
+        { "func main() { c := make(chan int); go func() { <-c }(); c <- 1; c <- 2 }",
+            "fatal error: all goroutines are asleep - deadlock!\nexit status 2\n" },
+        { "func main() { c := make(chan int, 1); close(c); c <- 1 }", "panic: send on closed channel\nexit status 2\n" },
+        // collections free the garbage but keep what is reachable, also
+        // through maps and what stores overwrite while marking
+        { "import \"fmt\"\ntype N struct { v int; next *N; s string }\n"
+            "func main() { var keep *N; m := map[int]*N{}; for i := 0; i < 400000; i++ { n := &N{i, nil, string(rune('a'+i%26))}\n"
+            "g := make([]*N, 4); g[0] = n; if i%1000 == 0 { n.next = keep; keep = n }; m[i%100] = g[0] }\n"
+            "s := 0; for n := keep; n != nil; n = n.next { s += n.v + len(n.s) }; for k, n := range m { s += n.v - k }; fmt.Println(s) }",
+            "119790400\n" },
     };
-    parseConversion = [&](Token&t)->AstNode* {
-        AstConversion*node = nullptr;
-        if (auto*tmp = parseType(t); tmp != nullptr) {
-            node = new AstConversion;
-            node->type = tmp;
-            expect(OP_LPAREN, "expectn (");
-            t = next(f);
-            node->expression = parseExpression(t);
-            t = next(f);
-            if (t.type == OP_COMMA) {
-                t = next(f);
+    int checked = 0;
+    auto check = [&](const char* body, const char* expected) {
+        string out = interpretText(string("package main\n") + body + "\n");
+        if (out != expected) throw runtime_error(string(body) + "\nexpect " + expected + "\ngot " + out);
+        checked++;
+    };
+    for (auto& [body, expected] : programCases) check(body, expected);
+    for (auto& [body, expected] : cases) check(body, expected);
+    fprintf(stdout, "%d programs interpreted as expected\n", checked);
+}
+
+// Time the interpreter on calls, loops, maps and strings, per operation.
+void benchInterp(const vector<string>&) {
+    struct Kernel {
+        const char* name;
+        const char* body;
+        double ops;
+    };
+    const Kernel kernels[] = {
+        { "fib", "func fib(n int) int { if n < 2 { return n }; return fib(n-1) + fib(n-2) }\nfunc main() { fmt.Println(fib(30)) }",
+            2692537 },
+        { "loop", "func main() { s := 0; for i := 0; i < 50000000; i++ { s += i ^ (i >> 3) }; fmt.Println(s) }", 50000000 },
+        { "map", "func main() { m := map[int]int{}; for i := 0; i < 1000000; i++ { m[i%50000] += i }\n"
+            "s := 0; for i := 0; i < 1000000; i++ { s += m[i%70000] }; fmt.Println(len(m), s) }",
+            2000000 },
+        { "concat", "func main() { n := 0; for i := 0; i < 1000000; i++ { s := \"key\" + string(rune('a'+i%26)) + \"/\"; n += len(s) }\n"
+            "fmt.Println(n) }",
+            1000000 },
+    };
+    fprintf(stdout, "%-10s %12s %12s\n", "kernel", "ms", "ns/op");
+    for (auto& kernel : kernels) {
+        string text = string("package main\nimport \"fmt\"\n") + kernel.body + "\n";
+        compileText(text, [&](const Module& module) {
+            Interpreter interp(module);
+            interp.capture = true;
+            auto start = chrono::steady_clock::now();
+            if (interp.run() != 0) throw runtime_error(string(kernel.name) + " failed: " + interp.output);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            fprintf(stdout, "%-10s %12.1f %12.2f\n", kernel.name, ms, ms * 1e6 / kernel.ops);
+        });
+    }
+}
+
+// The numbers of threads a benchmark runs with: those args gives from first
+// on, or else the powers of two below the number of cores and that number.
+vector<int> threadCounts(const vector<string>& args, size_t first = 0) {
+    vector<int> threads;
+    for (size_t i = first; i < args.size(); i++) threads.push_back(max(1, atoi(args[i].c_str())));
+    if (threads.empty()) {
+        int cores = max(1, int(thread::hardware_concurrency()));
+        for (int n = 1; n < cores; n *= 2) threads.push_back(n);
+        threads.push_back(cores);
+    }
+    return threads;
+}
+
+// Time goroutines on 1 to N threads, the counts given or powers of two up to
+// the cores there are: a million that do nothing, to see what starting and
+// scheduling one costs, and fewer that compute, to see the threads share the
+// work. main.main only starts them, the run ends when they are all done.
+void benchGoroutines(const vector<string>& args) {
+    struct Kernel {
+        const char* name;
+        const char* body;
+        int64_t goroutines;
+    };
+    const Kernel kernels[] = {
+        { "spawn", "func f() {}\nfunc main() { for i := 0; i < 1000000; i++ { go f() } }", 1000000 },
+        { "work", "var out []int\nfunc work(i int) { s := 0; for j := 0; j < 1000; j++ { s += j ^ i }; out[i] = s }\n"
+            "func main() { out = make([]int, 100000); for i := 0; i < 100000; i++ { go work(i) } }",
+            100000 },
+    };
+    vector<int> threads = threadCounts(args);
+    fprintf(stdout, "%-8s %8s %12s %12s %12s %10s\n", "kernel", "threads", "ms", "ns/spawn", "ns/goroutine", "speedup");
+    for (auto& kernel : kernels) {
+        compileText(string("package main\n") + kernel.body + "\n", [&](const Module& module) {
+            double first = 0;
+            for (int n : threads) {
+                Interpreter interp(module);
+                interp.capture = true;
+                interp.compile();
+                Scheduler scheduler(interp, n, true);
+                auto start = chrono::steady_clock::now();
+                if (scheduler.run() != 0) throw runtime_error(string(kernel.name) + " failed: " + interp.output);
+                auto end = chrono::steady_clock::now();
+                double ms = chrono::duration<double, milli>(end - start).count();
+                double spawn = chrono::duration<double, nano>(scheduler.mainDone - start).count() / double(kernel.goroutines);
+                if (first == 0) first = ms;
+                fprintf(stdout, "%-8s %8d %12.1f %12.1f %12.1f %9.2fx\n", kernel.name, n, ms, spawn,
+                    ms * 1e6 / double(kernel.goroutines), first / ms);
             }
-            if (t.type != OP_RPAREN) {
-                throw runtime_error("expect )");
+        });
+    }
+}
+
+// Time channels on 1 to N threads, per message sent: two goroutines playing
+// ping-pong over unbuffered and buffered channels, a producer fanning work
+// out to eight workers over a buffered channel and their results fanning back
+// in, and a select fanning in from four channels.
+void benchChannels(const vector<string>& args) {
+    struct Kernel {
+        const char* name;
+        const char* body;
+        int64_t messages;
+    };
+    auto pingPong = [](const char* size) {
+        return string("func main() { ping, pong := make(chan int, ") + size + "), make(chan int, " + size + ")\n"
+            "go func() { for v := range ping { pong <- v + 1 } }()\n"
+            "s := 0; for i := 0; i < 200000; i++ { ping <- i; s += <-pong }; close(ping); fmt.Println(s) }";
+    };
+    string unbuffered = pingPong("0"), buffered = pingPong("1");
+    const Kernel kernels[] = {
+        { "pingpong", unbuffered.c_str(), 400000 },
+        { "pingpong1", buffered.c_str(), 400000 },
+        { "fan", "func work(jobs, results chan int) { for j := range jobs { results <- j ^ (j >> 3) } }\n"
+            "func main() { jobs, results := make(chan int, 128), make(chan int, 128)\n"
+            "for w := 0; w < 8; w++ { go work(jobs, results) }\n"
+            "go func() { for i := 0; i < 500000; i++ { jobs <- i }; close(jobs) }()\n"
+            "s := 0; for i := 0; i < 500000; i++ { s += <-results }; fmt.Println(s) }",
+            1000000 },
+        { "select", "func send(c chan int) { for i := 0; i < 100000; i++ { c <- i } }\n"
+            "func main() { a, b, c, d := make(chan int), make(chan int, 16), make(chan int), make(chan int, 16)\n"
+            "go send(a); go send(b); go send(c); go send(d); s := 0\n"
+            "for i := 0; i < 400000; i++ { select { case v := <-a: s += v; case v := <-b: s += v; case v := <-c: s += v; case v := <-d: s += v } }\n"
+            "fmt.Println(s) }",
+            400000 },
+    };
+    vector<int> threads = threadCounts(args);
+    fprintf(stdout, "%-10s %8s %12s %12s\n", "kernel", "threads", "ms", "ns/message");
+    for (auto& kernel : kernels) {
+        compileText(string("package main\nimport \"fmt\"\n") + kernel.body + "\n", [&](const Module& module) {
+            for (int n : threads) {
+                Interpreter interp(module);
+                interp.capture = true;
+                interp.workers = n;
+                auto start = chrono::steady_clock::now();
+                if (interp.run() != 0) throw runtime_error(string(kernel.name) + " failed: " + interp.output);
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                fprintf(stdout, "%-10s %8d %12.1f %12.1f\n", kernel.name, n, ms, ms * 1e6 / double(kernel.messages));
             }
+        });
+    }
+}
+
+// Time the collector on binary-trees, the depth given or 16, on 1 to N
+// threads: goroutines each build and walk trees of one depth, one at a time,
+// while a long lived tree stays. The pauses are the times the world stood
+// still, and the overhead the most the heap held in spans against the most a
+// collection found live.
+void benchGc(const vector<string>& args) {
+    int depth = args.empty() ? 16 : max(4, atoi(args[0].c_str()));
+    vector<int> threads = threadCounts(args, 1);
+    string text = "package main\nimport \"fmt\"\ntype Node struct { left, right *Node }\n"
+        "func bottomUp(depth int) *Node { if depth <= 0 { return &Node{} }; return &Node{bottomUp(depth - 1), bottomUp(depth - 1)} }\n"
+        "func (n *Node) check() int { if n.left == nil { return 1 }; return 1 + n.left.check() + n.right.check() }\n"
+        "func main() { n := " + to_string(depth) + "; fmt.Println(bottomUp(n + 1).check()); long := bottomUp(n)\n"
+        "results := make(chan int, n)\n"
+        "for d := 4; d <= n; d += 2 { go func(depth int) { check := 0\n"
+        "for i := 0; i < 1 << uint(n - depth + 4); i++ { check += bottomUp(depth).check() }; results <- check }(d) }\n"
+        "s := 0; for d := 4; d <= n; d += 2 { s += <-results }; fmt.Println(s, long.check()) }\n";
+    int64_t nodes = (int64_t(1) << (depth + 2)) - 1 + (int64_t(1) << (depth + 1)) - 1;
+    for (int d = 4; d <= depth; d += 2) nodes += (int64_t(1) << (depth - d + 4)) * ((int64_t(1) << (d + 1)) - 1);
+    fprintf(stdout, "binary-trees depth %d, %lld nodes\n", depth, (long long)nodes);
+    fprintf(stdout, "%8s %10s %12s %6s %12s %12s %12s %10s\n", "threads", "ms", "Mnodes/s", "gcs", "max pause ms",
+        "peak heap MB", "peak live MB", "overhead");
+    compileText(text, [&](const Module& module) {
+        for (int n : threads) {
+            Interpreter interp(module);
+            interp.capture = true;
+            interp.workers = n;
+            heap.collections = 0;
+            heap.pauseMax = 0;
+            heap.peakLive = 0;
+            heap.peakFootprint = heap.footprint.load();
+            auto start = chrono::steady_clock::now();
+            if (interp.run() != 0) throw runtime_error("binary-trees failed: " + interp.output);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            double peak = double(heap.peakFootprint) / 1048576, live = double(heap.peakLive) / 1048576;
+            fprintf(stdout, "%8d %10.1f %12.2f %6lld %12.3f %12.1f %12.1f %9.2fx\n", n, ms, double(nodes) / ms / 1e3,
+                (long long)heap.collections.load(), double(heap.pauseMax) / 1e6, peak, live, live > 0 ? peak / live : 0.0);
         }
-        return node;
-    };
-    parseMethodExpr = [&](Token&t)->AstNode* {
-        AstMethodExpr*node = nullptr;
-        if (auto*tmp = parseType(t); tmp != nullptr) {
-            node = new AstMethodExpr;
-            node->receiverType = tmp;
-            expect(OP_DOT, "expect dot in method expression");
-            t = next(f);
-            node->methodName = expect(TK_ID, "expect method name").lexeme;
+    });
+    fprintf(stdout, "peak RSS %zu KiB\n", peakRss());
+}
+
+// Time allocating on 1 to N threads, with the heap and with the C library,
+// per allocation: eight goroutines making small structs, slices, closures
+// and now and then maps, keeping the last few. The C library frees nothing,
+// so the heap also collects what it takes.
+void benchAlloc(const vector<string>& args) {
+    vector<int> threads = threadCounts(args);
+    const int goroutines = 8, rounds = 100000;
+    string text = "package main\nimport \"fmt\"\ntype Point struct { x, y int; next *Point }\n"
+        "func work(id int, done chan int) { keep := make([]*Point, 256); s := 0\n"
+        "for i := 0; i < " + to_string(rounds) + "; i++ { p := &Point{i, id, keep[i % 256]}; keep[i % 256] = p; p.next = nil\n"
+        "b := make([]int, i % 16 + 1); b[0] = i; f := func() int { return p.x + b[0] }; s += f()\n"
+        "if i % 64 == 0 { m := map[int]int{i: id}; s += len(m) } }\n"
+        "done <- s }\n"
+        "func main() { done := make(chan int); for g := 0; g < " + to_string(goroutines) + "; g++ { go work(g, done) }\n"
+        "s := 0; for g := 0; g < " + to_string(goroutines) + "; g++ { s += <-done }; fmt.Println(s) }\n";
+    // a point, a slice and a closure every round, a map with its two arrays
+    // every 64
+    double allocations = double(goroutines) * rounds * (3 + 3.0 / 64);
+    fprintf(stdout, "%-8s %8s %12s %12s\n", "malloc", "threads", "ms", "ns/alloc");
+    compileText(text, [&](const Module& module) {
+        for (bool system : { false, true }) {
+            for (int n : threads) {
+                HeapCache& cache = threadCache();
+                {
+                    lock_guard<mutex> guard(heap.cachesLock);
+                    cache.flush();
+                }
+                heap.systemMalloc = system;
+                Interpreter interp(module);
+                interp.capture = true;
+                interp.workers = n;
+                auto start = chrono::steady_clock::now();
+                int status = interp.run();
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                heap.systemMalloc = false;
+                if (status != 0) throw runtime_error("allocating failed: " + interp.output);
+                fprintf(stdout, "%-8s %8d %12.1f %12.1f\n", system ? "system" : "heap", n, ms, ms * 1e6 / allocations);
+            }
         }
-        return node;
-    };
-    // parsing startup
+    });
+}
+
+// Time a loop of small vector arithmetic and slices of a local array with
+// every allocation on the heap, then with escape analysis moving those that
+// do not outlive their call to the frame. One allocation in 16 rounds escapes
+// into a global.
+void benchEscape(const vector<string>& args) {
+    int rounds = args.empty() ? 2000000 : max(1, atoi(args[0].c_str()));
+    string text = "package main\nimport \"fmt\"\ntype Vec struct { x, y, z int }\n"
+        "func (v *Vec) Add(o *Vec) { v.x += o.x; v.y += o.y; v.z += o.z }\n"
+        "func (v *Vec) Dot(o *Vec) int { return v.x*o.x + v.y*o.y + v.z*o.z }\n"
+        "func scale(v *Vec, k int) { v.x *= k; v.y *= k; v.z *= k }\n"
+        "func sum(xs []int) int { s := 0; for _, x := range xs { s += x }; return s }\n"
+        "var keep = make([]*Vec, 64)\n"
+        "func main() { s := 0\n"
+        "for i := 0; i < " + to_string(rounds) + "; i++ { a := &Vec{i, 1, 2}; b := new(Vec); b.x = i % 7; scale(b, 3); a.Add(b)\n"
+        "var c Vec; c.Add(a); buf := [4]int{i, 1, 2, 3}; s += sum(buf[:]) + a.Dot(&c)\n"
+        "if i % 16 == 0 { keep[i / 16 % 64] = &Vec{i, 0, 0} } }\n"
+        "fmt.Println(s, keep[0].x) }\n";
+    // a, b, c and buf every round, and what keep holds
+    double allocations = rounds * (4 + 1.0 / 16);
+    fprintf(stdout, "%d rounds, %.0f allocations\n", rounds, allocations);
+    fprintf(stdout, "%-8s %12s %12s %12s %6s\n", "escape", "on heap", "ms", "ns/round", "gcs");
+    string expected;
+    for (bool stackAllocate : { false, true }) {
+        compileText(text, [&](const Module& module) {
+            size_t onHeap = 0;
+            for (auto& f : module.functions) {
+                for (ValueId v = 1; v < f.values.size(); v++) onHeap += f.values[v].op == IR_ALLOC && (f.values[v].flags & V_HEAP);
+            }
+            Interpreter interp(module);
+            interp.capture = true;
+            heap.collections = 0;
+            auto start = chrono::steady_clock::now();
+            if (interp.run() != 0) throw runtime_error("escaping failed: " + interp.output);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (expected.empty()) expected = interp.output;
+            if (interp.output != expected) throw runtime_error("escape analysis changed the output to " + interp.output);
+            fprintf(stdout, "%-8s %12zu %12.1f %12.1f %6lld\n", stackAllocate ? "on" : "off", onHeap, ms, ms * 1e6 / rounds,
+                (long long)heap.collections.load());
+        }, stackAllocate);
+    }
+}
 
-    return parseSourceFile(t);
+// A deep copy of t made outside the type table, which identical() can only
+// compare by structure.
+const Type* copyType(const Type* t, Arena& arena) {
+    auto copy = [&](const Type* c) { return copyType(c, arena); };
+    auto tuple = [&](const TupleType* c) {
+        auto* r = arena.make<TupleType>();
+        for (const Type* e : c->types) r->types.push_back(copy(e));
+        return r;
+    };
+    switch (t->kind) {
+    case TY_ARRAY:
+        return arena.make<ArrayType>(static_cast<const ArrayType*>(t)->length, copy(static_cast<const ArrayType*>(t)->elem));
+    case TY_SLICE: return arena.make<SliceType>(copy(static_cast<const SliceType*>(t)->elem));
+    case TY_POINTER: return arena.make<PointerType>(copy(static_cast<const PointerType*>(t)->base));
+    case TY_MAP:
+        return arena.make<MapType>(copy(static_cast<const MapType*>(t)->key), copy(static_cast<const MapType*>(t)->elem));
+    case TY_CHAN:
+        return arena.make<ChanType>(copy(static_cast<const ChanType*>(t)->elem), static_cast<const ChanType*>(t)->dir);
+    case TY_TUPLE: return tuple(static_cast<const TupleType*>(t));
+    case TY_FUNC: {
+        auto* f = static_cast<const FuncType*>(t);
+        return arena.make<FuncType>(tuple(f->params), tuple(f->results), f->variadic);
+    }
+    case TY_STRUCT: {
+        auto* r = arena.make<StructType>();
+        for (auto field : static_cast<const StructType*>(t)->fields) {
+            field.type = copy(field.type);
+            r->fields.push_back(field);
+        }
+        return r;
+    }
+    default:
+        return t;
+    }
 }
 
-void emitStub() {}
+// Checking a package of assignments between deeply nested composite types,
+// then what identical() costs on the canonical types against copies of them
+// it has to walk.
+void benchTypes(const vector<string>&) {
+    const int depth = 12, functions = 50, assignments = 200;
+    string text = "package p\n";
+    for (int k = 0; k <= depth; k++) {
+        string elem = k == 0 ? "int" : "E" + to_string(k - 1);
+        text += "type E" + to_string(k) + " " + (k == 0 ? string("int") :
+            "map[string][]struct{ x *[4]chan func(int, ...string) (map[int]" + elem + ", error) }") + "\n";
+    }
+    // spelled out in full so that every use builds the composite types again
+    string spelled = "int";
+    for (int k = 1; k <= depth; k++) {
+        spelled = "map[string][]struct{ x *[4]chan func(int, ...string) (map[int]" + spelled + ", error) }";
+    }
+    text += "var a " + spelled + "\n";
+    for (int f = 0; f < functions; f++) {
+        text += "func f" + to_string(f) + "() {\n\tvar b " + spelled + "\n";
+        for (int i = 0; i < assignments; i++) text += i % 2 ? "\tb = a\n" : "\ta = b\n";
+        text += "}\n";
+    }
 
-void runtimeStub() {}
+    TextPackage package(text, "types.go");
+    PackageInfo& info = package.info();
+    size_t entries = typeTable.size();
+    ThreadPool pool(1);
+    auto start = chrono::steady_clock::now();
+    vector<string> errors = package.check(pool);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!errors.empty()) throw runtime_error(errors.front());
+    fprintf(stdout, "%zu lines, %d assignments checked in %.2f ms\n", size_t(count(text.begin(), text.end(), '\n')),
+        functions * assignments, seconds * 1e3);
+    fprintf(stdout, "type table: %zu new types, %zu types in %zu bytes\n", typeTable.size() - entries,
+        typeTable.size(), typeTable.bytes());
 
-//===----------------------------------------------------------------------===//
-// debug auxiliary functions, they are not part of 5 functions
-//===----------------------------------------------------------------------===//
-void printLex(const string & filename) {
-    fstream f(filename, ios::binary | ios::in);
-    while (lastToken != TK_EOF) {
-        auto[token, lexeme] = next(f);
-        fprintf(stdout, "<%d,%s,%d,%d>\n", token, lexeme.c_str(), line, column);
+    const Type* canonical = info.scope.lookup(symbols.intern("a"))->type;
+    Arena copies;
+    const Type* x = copyType(canonical, copies);
+    const Type* y = copyType(canonical, copies);
+    auto measure = [&](const Type* a, const Type* b) {
+        size_t rounds = 0, same = 0;
+        auto start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            for (int i = 0; i < 1000; i++) same += identical(a, b);
+            rounds += 1000;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2);
+        if (same != rounds) throw runtime_error("copies of a type are not identical");
+        return seconds / rounds * 1e9;
+    };
+    fprintf(stdout, "identical(), depth %d: canonical %8.2f ns/op, structural %8.2f ns/op\n", depth,
+        measure(canonical, canonical), measure(x, y));
+}
+
+// Checks the arithmetic of big integers against 128-bit integers, or 64-bit
+// ones with narrower operands where there are none, and the division of wider
+// ones against multiplying back.
+void checkConstant(const vector<string>&) {
+#ifdef __SIZEOF_INT128__
+    using Wide = __int128;
+    using UnsignedWide = unsigned __int128;
+#else
+    using Wide = int64_t;
+    using UnsignedWide = uint64_t;
+#endif
+    // products and shifts of operands this wide fit
+    const int operandBits = int(sizeof(Wide)) * 4 - 2;
+    uint64_t seed = 1;
+    auto next = [&] {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return seed >> 16;
+    };
+    // a number of a random width, so that small and carrying cases both occur
+    auto random = [&](int maxBits) {
+        BigInt v = bigInt(0);
+        int bits = int(next() % maxBits) + 1;
+        for (int i = 0; i < bits; i += 16) v = add(shiftLeft(v, 16), bigInt(int64_t(next() & 0xffff)));
+        v = limbs::bitLength(v.limbs) > uint64_t(bits) ? shiftRight(v, limbs::bitLength(v.limbs) - bits) : v;
+        return next() & 1 ? neg(v) : v;
+    };
+    auto wide = [](const BigInt& v) {
+        UnsignedWide m = 0;
+        for (size_t i = v.limbs.size(); i-- > 0;) m = m << 32 | v.limbs[i];
+        return v.negative ? -Wide(m) : Wide(m);
+    };
+    auto fail = [](const char* op, const BigInt& a, const BigInt& b) {
+        throw runtime_error(string("big integers ") + toString(a) + " " + op + " " + toString(b) + " are wrong");
+    };
+    const int rounds = 20000;
+    for (int i = 0; i < rounds; i++) {
+        BigInt a = random(operandBits), b = random(operandBits);
+        Wide x = wide(a), y = wide(b);
+        if (wide(add(a, b)) != x + y) fail("+", a, b);
+        if (wide(sub(a, b)) != x - y) fail("-", a, b);
+        if (wide(mul(a, b)) != x * y) fail("*", a, b);
+        if (compare(a, b) != (x < y ? -1 : x > y)) fail("<=>", a, b);
+        if (wide(bitwise(a, b, [](uint32_t p, uint32_t q) { return p & q; })) != (x & y)) fail("&", a, b);
+        if (wide(bitwise(a, b, [](uint32_t p, uint32_t q) { return p | q; })) != (x | y)) fail("|", a, b);
+        if (wide(bitwise(a, b, [](uint32_t p, uint32_t q) { return p ^ q; })) != (x ^ y)) fail("^", a, b);
+        if (wide(bitwise(a, b, [](uint32_t p, uint32_t q) { return p & ~q; })) != (x & ~y)) fail("&^", a, b);
+        int n = int(next() % (operandBits - 2));
+        if (wide(shiftLeft(a, n)) != x * (Wide(1) << n)) fail("<<", a, b);
+        if (wide(shiftRight(a, n)) != x >> n) fail(">>", a, b);
+        if (sign(b) != 0) {
+            BigInt q, r;
+            quoRem(a, b, q, r);
+            if (wide(q) != x / y || wide(r) != x % y) fail("/", a, b);
+        }
+        if (toString(a) != to_string(int64_t(x))) fail("string", a, b);
+    }
+    for (int i = 0; i < rounds; i++) {
+        BigInt a = random(600), b = random(300), q, r;
+        if (sign(b) == 0) continue;
+        quoRem(a, b, q, r);
+        bool ok = compare(add(mul(q, b), r), a) == 0 && limbs::compare(r.limbs, b.limbs) < 0 &&
+            (sign(r) == 0 || r.negative == a.negative);
+        if (!ok) fail("/", a, b);
+    }
+    // a fraction with a power of two in it converts exactly, others to the
+    // nearest float
+    Arena arena;
+    if (toDouble(*floatLiteral("0x1.8p-1074", arena).ratio) != 0x1.8p-1074 ||
+        toDouble(*floatLiteral("1.7976931348623157e308", arena).ratio) != DBL_MAX ||
+        toDouble(*floatLiteral("3.14159265358979323846264338327950288", arena).ratio) != 3.141592653589793 ||
+        // halfway rounds to even, and just above halfway rounds up
+        toDouble(*floatLiteral("9007199254740993", arena).ratio) != 9007199254740992.0 ||
+        toDouble(*floatLiteral("9007199254740993.0000000001", arena).ratio) != 9007199254740994.0 ||
+        toDouble(roundFloat(*floatLiteral("16777217.0000001", arena).ratio, true)) != 16777218.0) {
+        throw runtime_error("float literals convert to the wrong double");
+    }
+    fprintf(stdout, "%d operations on small and %d divisions of big integers checked\n", rounds, rounds);
+}
+
+// Folding generated enumerations of constants of growing size, declared by
+// iota groups whose implicit repetition re-evaluates the previous
+// expression, through the 64-bit path and through the big integer one.
+void benchConstant(const vector<string>&) {
+    auto generate = [](int constants, bool big) {
+        string text = "package p\n";
+        for (int group = 0; group * 100 < constants; group++) {
+            text += "const (\n";
+            text += big ? "\tC" + to_string(group) + "_0 = 1<<(iota+64) + iota*iota - 1<<65 | 0xff\n" :
+                "\tC" + to_string(group) + "_0 = (iota*iota + 3) << 2 | 1\n";
+            for (int i = 1; i < 100; i++) text += "\tC" + to_string(group) + "_" + to_string(i) + "\n";
+            text += ")\n";
+        }
+        return text;
+    };
+    fprintf(stdout, "%-10s %10s %10s %12s %12s\n", "path", "constants", "ms", "ns/constant", "arena bytes");
+    for (bool big : { false, true }) {
+        for (int constants : { 1000, 10000, 100000 }) {
+            string text = generate(constants, big);
+            TextPackage package(text, "enum.go");
+            PackageInfo& info = package.info();
+            auto start = chrono::steady_clock::now();
+            collect(info);
+            resolve(info);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (!errorsOf(info).empty()) throw runtime_error(errorsOf(info).front());
+            fprintf(stdout, "%-10s %10d %10.2f %12.1f %12zu\n", big ? "big" : "64-bit", constants, seconds * 1e3,
+                seconds / constants * 1e9, info.arena.size());
+        }
     }
 }
 
 int main(int argc, char *argv[]) {
-    //printLex(filename);
     if (argc < 2) {
-        fprintf(stderr, "specify your go source file\n");
+        fprintf(stderr, "usage: g5 [-j N] [-time] [-syntax-only] [-ssa] [-m] [-O0] [-S file] [-o file] [-run] <go source files or package directories>\n");
+        return 1;
+    }
+    static const map<string, void(*)(const vector<string>&)> debugOptions = {
+        { "-lex", [](const vector<string>& filenames) {
+            for (auto& filename : filenames) printLex(filename);
+        } },
+        { "-ast", [](const vector<string>& filenames) {
+            for (auto& filename : filenames) {
+                Arena arena;
+                printAst(parse(filename, arena));
+            }
+        } },
+        { "-tree", [](const vector<string>& filenames) {
+            for (auto& filename : filenames) {
+                Arena arena;
+                if (auto* ast = parse(filename, arena)) {
+                    Tree tree = flatten(ast);
+                    printTree(tree, tree.root);
+                }
+            }
+        } },
+        { "-api", printApi },
+        { "-bench-lex", benchLex },
+        { "-bench-keyword", benchKeyword },
+        { "-bench-parse", benchParse },
+        { "-bench-types", benchTypes },
+        { "-bench-constant", benchConstant },
+        { "-bench-scan", benchScan },
+        { "-check-reentrant", checkReentrant },
+        { "-check-expression", checkExpression },
+        { "-check-tree", checkTree },
+        { "-check-interner", checkInterner },
+        { "-check-incremental", checkIncremental },
+        { "-check-lazy", checkLazy },
+        { "-check-semantic", checkSemantic },
+        { "-check-constant", checkConstant },
+        { "-check-ssa", checkSsa },
+        { "-check-native", checkNative },
+        { "-bench-native", benchNative },
+        { "-check-interp", checkInterp },
+        { "-bench-interp", benchInterp },
+        { "-bench-goroutines", benchGoroutines },
+        { "-bench-channels", benchChannels },
+        { "-bench-gc", benchGc },
+        { "-bench-alloc", benchAlloc },
+        { "-bench-escape", benchEscape },
+        { "-bench-lazy", benchLazy },
+        { "-bench-incremental", benchIncremental },
+        { "-bench-tree", benchTree },
+        { "-bench-parse-memory", benchParseMemory },
+    };
+    try {
+        if (auto option = debugOptions.find(argv[1]); option != debugOptions.end()) {
+            option->second(vector<string>(argv + 2, argv + argc));
+            return 0;
+        }
+    }
+    catch (const exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    int jobs = max(1u, thread::hardware_concurrency());
+    bool timing = false, syntaxOnly = false, dumpSsa = false, explainEscapes = false, optimize = true, run = false;
+    string assemblyFile, output;
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            jobs = max(1, atoi(argv[++i]));
+        }
+        else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) {
+            jobs = max(1, atoi(arg.c_str() + 2));
+        }
+        else if (arg == "-time") {
+            timing = true;
+        }
+        else if (arg == "-syntax-only") {
+            syntaxOnly = true;
+        }
+        else if (arg == "-ssa") {
+            dumpSsa = true;
+        }
+        else if (arg == "-m") {
+            explainEscapes = true;
+        }
+        else if (arg == "-O0") {
+            optimize = false;
+        }
+        else if (arg == "-run") {
+            run = true;
+        }
+        else if (arg == "-S" && i + 1 < argc) {
+            assemblyFile = argv[++i];
+        }
+        else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+    auto phase = [timing](const char* name, auto&& work) {
+        auto start = chrono::steady_clock::now();
+        work();
+        if (timing) {
+            fprintf(stderr, "%-8s %10.3f ms\n", name,
+                chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+    };
+
+    // a directory stands for the package made of its .go files, tests aside
+    vector<string> filenames;
+    phase("load", [&] {
+        for (auto& path : paths) {
+            if (!filesystem::is_directory(path)) {
+                filenames.push_back(path);
+                continue;
+            }
+            vector<string> files;
+            for (auto& entry : filesystem::directory_iterator(path)) {
+                string name = entry.path().filename().string();
+                if (entry.is_regular_file() && name.size() > 3 &&
+                    name.compare(name.size() - 3, 3, ".go") == 0 &&
+                    (name.size() < 8 || name.compare(name.size() - 8, 8, "_test.go") != 0)) {
+                    files.push_back(entry.path().string());
+                }
+            }
+            sort(files.begin(), files.end());
+            filenames.insert(filenames.end(), files.begin(), files.end());
+        }
+    });
+
+    // every file gets an arena of its own so the workers never share one, they
+    // are all released together with the compilation. Later phases work on the
+    // compact trees flattened from them.
+    vector<Arena> arenas(filenames.size());
+    vector<const AstNode*> asts(filenames.size());
+    vector<Tree> trees(filenames.size());
+    vector<string> errors(filenames.size());
+    phase("parse", [&] {
+        ThreadPool pool(min<int>(jobs, max<size_t>(1, filenames.size())));
+        for (size_t i = 0; i < filenames.size(); i++) {
+            pool.submit([&, i] {
+                try {
+                    asts[i] = parse(filenames[i], arenas[i]);
+                    if (asts[i] != nullptr) trees[i] = flatten(asts[i]);
+                }
+                catch (const exception& e) {
+                    errors[i] = e.what();
+                }
+            });
+        }
+        pool.wait();
+    });
+
+    // files of one package are grouped by their package clause, in the order
+    // they were given
+    deque<Package> packages;
+    phase("merge", [&] {
+        map<Symbol, Package*> byName;
+        for (size_t i = 0; i < trees.size(); i++) {
+            if (trees[i].root == 0) continue;
+            Symbol name = trees[i][trees[i].root].a;
+            auto*& package = byName[name];
+            if (package == nullptr) {
+                package = &packages.emplace_back();
+                package->name = name;
+            }
+            package->files.push_back(&trees[i]);
+            package->filenames.push_back(filenames[i]);
+        }
+        if (!packages.empty()) {
+            grt.package = byName.count(symbols.intern("main")) ? "main" :
+                string(symbols.text(packages.front().name));
+        }
+    });
+
+    int failed = 0;
+    for (auto& error : errors) {
+        if (!error.empty()) {
+            fprintf(stderr, "%s\n", error.c_str());
+            failed++;
+        }
+    }
+    if (timing) {
+        fprintf(stderr, "%zu files, %zu packages, %d jobs\n", filenames.size(), packages.size(),
+            jobs);
+    }
+    if (failed != 0) return 1;
+    if (syntaxOnly) {
+        fprintf(stdout, "parsing passed\n");
+        return 0;
+    }
+
+    // semantic analysis, declarations are resolved one package at a time and
+    // function bodies are checked in parallel
+    deque<PackageInfo> infos;
+    phase("collect", [&] {
+        for (auto& package : packages) collect(infos.emplace_back(package));
+    });
+    phase("resolve", [&] {
+        for (auto& info : infos) resolve(info);
+    });
+    phase("check", [&] {
+        ThreadPool pool(jobs);
+        for (auto& info : infos) checkBodies(info, pool);
+        pool.wait();
+    });
+    for (auto& info : infos) {
+        for (auto& error : errorsOf(info)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            failed++;
+        }
+    }
+    if (failed != 0) return 1;
+    // an interpreted program has standard output to itself
+    if (!run) fprintf(stdout, "checking passed\n");
+    if (!dumpSsa && !explainEscapes && assemblyFile.empty() && output.empty() && !run) return 0;
+
+    Module module;
+    phase("lower", [&] {
+        ThreadPool pool(jobs);
+        lower(infos, module, pool);
+    });
+    for (auto& error : module.errors) fprintf(stderr, "%s\n", error.c_str());
+    if (!module.errors.empty()) return 1;
+    try {
+        for (auto& f : module.functions) verify(f);
+        // variables that do not outlive their call move to the frame, -m
+        // tells which and why the others stay on the heap
+        vector<string> notes;
+        phase("escape", [&] { escape(module, explainEscapes ? &notes : nullptr); });
+        if (explainEscapes) {
+            for (auto& note : notes) fprintf(stderr, "%s\n", note.c_str());
+        }
+        if (dumpSsa) {
+            for (auto& f : module.functions) fprintf(stdout, "%s\n", functionString(module, f).c_str());
+        }
+        if (run) {
+            int status = 0;
+            phase("run", [&] { status = runtime(module); });
+            return status;
+        }
+        if (assemblyFile.empty() && output.empty()) return 0;
+        string text;
+        phase("codegen", [&] { text = assembly(module, optimize); });
+        if (!assemblyFile.empty()) {
+            ofstream file(assemblyFile);
+            file << text;
+            if (!file) throw runtime_error("cannot write " + assemblyFile);
+        }
+        if (!output.empty()) phase("link", [&] { link(text, output); });
+    }
+    catch (const exception& e) {
+        fprintf(stderr, "%s\n", e.what());
         return 1;
     }
-    const AstNode* ast = parse(argv[1]);
-    fprintf(stdout, "parsing passed\n");
     return 0;
 }
\ No newline at end of file
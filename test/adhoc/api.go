@@ -0,0 +1,53 @@
+package api
+
+import (
+	"fmt"
+	str "strings"
+	. "unicode"
+	_ "os"
+)
+
+const (
+	MaxSize = 1 << 10
+	minSize = 16
+	Low, high, Mid = 1, 2, 3
+)
+
+const Single = "one"
+
+var (
+	Count   int
+	hidden  string
+	X, y, Z = 1, 2, 3
+)
+
+var Default = New()
+
+type Buffer struct {
+	data []byte
+}
+
+type (
+	Reader interface{ Read() int }
+	writer struct{}
+)
+
+type inner int
+
+func New() *Buffer { return &Buffer{} }
+
+func helper() string { return fmt.Sprint(str.ToUpper("x"), IsUpper('x')) }
+
+func (b *Buffer) Write(p []byte) { b.data = append(b.data, p...) }
+
+func (b Buffer) Len() int { return len(b.data) }
+
+func (b (*Buffer)) Reset() { b.data = nil }
+
+func ((Buffer)) Empty() bool { return true }
+
+func (b *Buffer) grow() {}
+
+func (w writer) Write() {}
+
+func (i inner) String() string { return "" }
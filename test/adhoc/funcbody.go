@@ -0,0 +1,20 @@
+package main
+
+import "fmt"
+
+func a() string {
+	s := "}{\"}"
+	r := '}'
+	q := '\''
+	t := `}
+{`
+	/* } */ // }
+	if len(s) > 0 { return s + string(r) + string(q) + t }
+	return "{"
+}
+
+func (x *T) b(m map[string]struct{}) { for k := range m { _ = k } }
+
+func c()
+
+type T struct{ f func() }
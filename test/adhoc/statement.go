@@ -1,7 +1,5 @@
 package main
 
-package main
-
 import (
 	"fmt"
 	_ "go/ast"
@@ -160,4 +158,4 @@ func task(startID int){
 	for i:=0;i<5;i++{
 		fmt.Println("goroutine:",startID,"- number:",i)
 	}
-}QA
\ No newline at end of file
+}
@@ -37,9 +37,9 @@ type (
 	A2 = A1
 )
 type(
-    C
-    D
-    E
+    C int
+    D string
+    E []byte
 )
 
 type (